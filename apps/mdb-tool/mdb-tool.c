@@ -204,6 +204,20 @@ static void del_sql_dir(void * data, int * argc, char *** _argv, int arg)
   bg_cmdline_remove_arg(argc, _argv, arg);
   }
 
+static void opt_explain(void * data, int * argc, char *** _argv, int arg)
+  {
+  if(!ensure_mdb(0))
+    return;
+
+  if(!mdb)
+    {
+    gavl_log(GAVL_LOG_ERROR, LOG_DOMAIN,
+             "explain option does not work with remote DBs");
+    return;
+    }
+  bg_mdb_explain_queries(mdb);
+  }
+
 static bg_cmdline_arg_t commands[] =
   {
     {
@@ -240,6 +254,11 @@ static bg_cmdline_arg_t commands[] =
       .help_string = "Delete SQL directory",
       .callback =    del_sql_dir,
     },
+    {
+      .arg =         "-explain",
+      .help_string = "Print query plans of the standard browse queries",
+      .callback =    opt_explain,
+    },
     /* TODO: add more */
     {
       /* End */
@@ -92,13 +92,16 @@ int main(int argc, char ** argv)
   {
   int result;
   int ret = EXIT_FAILURE;
-  gavl_time_t delay_time = GAVL_TIME_SCALE / 50; // 20 ms
+  int delay_time = 20; // ms
   server_t s;
 
   gavl_array_init(&fe_arr);
   bg_frontend_set_option(&fe_arr, "gmerlin,upnp", BG_PLUGIN_FRONTEND_MDB);
 
   bg_app_init("gmerlin-server", TRS("Gmerlin media server"), "server");
+
+  /* Revalidating podcast feeds */
+  bg_http_cache_init();
   
   /* Make strcasecmp work */
   setlocale(LC_COLLATE, "");
@@ -131,7 +134,7 @@ int main(int argc, char ** argv)
       if(bg_got_sigint())
         break;
       
-      gavl_time_delay(&delay_time);
+      server_wait(&s, delay_time);
       }
     }
   ret = EXIT_SUCCESS;
@@ -142,6 +145,7 @@ int main(int argc, char ** argv)
   
   server_cleanup(&s);
 
+  bg_http_cache_cleanup();
   bg_global_cleanup();
 
   return ret;
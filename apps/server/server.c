@@ -404,20 +404,69 @@ void server_cleanup(server_t * s)
   
   if(s->state_file)
     {
+    gavl_dictionary_t * dict;
+
+    /* Don't save runtime statistics */
+    if((dict = gavl_dictionary_get_dictionary_nc(&s->state, "server")))
+      gavl_dictionary_set(dict, "httpclients", NULL);
+    
     bg_dictionary_save_xml(&s->state, s->state_file, "state");
     free(s->state_file);
     }
   gavl_dictionary_free(&s->state);
   }
 
+/* Publish the streaming clients of the http server as state variable.
+   This is checked at most once per second and sent only if something changed. */
+
+static void update_client_stats(server_t * s)
+  {
+  gavl_value_t val;
+  gavl_dictionary_t * dict;
+  bg_http_server_client_stats_t stats;
+  gavl_time_t cur = gavl_time_get_monotonic();
+
+  if(s->client_stats_time &&
+     (cur - s->client_stats_time < GAVL_TIME_SCALE))
+    return;
+
+  s->client_stats_time = cur;
+  
+  bg_http_server_get_client_stats(s->srv, &stats);
+
+  if(!memcmp(&stats, &s->client_stats, sizeof(stats)))
+    return;
+
+  memcpy(&s->client_stats, &stats, sizeof(stats));
+  
+  gavl_value_init(&val);
+  dict = gavl_value_set_dictionary(&val);
+  
+  gavl_dictionary_set_int(dict, "active",   stats.active);
+  gavl_dictionary_set_int(dict, "queued",   stats.queued);
+  gavl_dictionary_set_int(dict, "waiting",  stats.waiting);
+  gavl_dictionary_set_int(dict, "rejected", stats.rejected);
+  
+  bg_state_set(&s->state, 1, "server", "httpclients", &val,
+               bg_mdb_get_controllable(s->mdb)->evt_sink, BG_MSG_STATE_CHANGED);
+  gavl_value_free(&val);
+  }
+
 int server_iteration(server_t * s)
   {
   int ret = 0;
 
   ret += bg_http_server_iteration(s->srv);
 
+  update_client_stats(s);
+
   ret += bg_frontends_ping(s->frontends, s->num_frontends);
   
   return ret;
   }
 
+void server_wait(server_t * s, int timeout)
+  {
+  bg_http_server_wait(s->srv, NULL, 0, timeout);
+  }
+
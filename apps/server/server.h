@@ -50,6 +50,9 @@ typedef struct
 
   gavl_dictionary_t state;
   char * state_file;
+
+  bg_http_server_client_stats_t client_stats;
+  gavl_time_t client_stats_time; // Last check of the client stats
   } server_t;
 
 int server_init(server_t * s, gavl_array_t * fe_arr);
@@ -58,5 +61,8 @@ int server_init(server_t * s, gavl_array_t * fe_arr);
 void server_cleanup(server_t * s);
 int server_iteration(server_t * s);
 
+/* Wait for incoming connections. Frontends are still pinged after the timeout */
+void server_wait(server_t * s, int timeout);
+
 void server_set_parameter(void * priv, const char * name,
                           const gavl_value_t * val);
@@ -30,6 +30,8 @@
 
 #include <config.h>
 
+#include <unistd.h>
+
 #include "app.h"
 #include "mainwindow.h"
 
@@ -66,10 +68,270 @@ static const char * multi_tags[] =
 
 static void splice(app_data_t * ad, int idx, int del, gavl_array_t * add);
 
+/*
+ *  Job scheduler: Tracks are taken from the top of the list and
+ *  transcoded in parallel.
+ */
+
+#define JOB_MEMORY_BASE   (64*1024*1024) // Plugins, codecs, packet buffers
+#define JOB_MEMORY_FRAMES 32             // Video frames in flight
+
+static int get_max_jobs(void)
+  {
+  int ret = 0;
+  const gavl_dictionary_t * dict;
+  
+  if((dict = bg_cfg_registry_find_section(bg_cfg_registry, PREFS_OUTPUT)))
+    gavl_dictionary_get_int(dict, "max_jobs", &ret);
+  
+  if((ret <= 0) && ((ret = sysconf(_SC_NPROCESSORS_ONLN)) < 1))
+    ret = 1;
+  return ret;
+  }
+
+/* Rough estimate, which only needs to be in the right order of magnitude */
+static int64_t get_job_memory(const gavl_dictionary_t * track)
+  {
+  int i, num;
+  int64_t ret = JOB_MEMORY_BASE;
+  const gavl_dictionary_t * s;
+  const gavl_video_format_t * fmt;
+  
+  num = gavl_track_get_num_streams(track, GAVL_STREAM_VIDEO);
+
+  for(i = 0; i < num; i++)
+    {
+    if((s = gavl_track_get_stream(track, GAVL_STREAM_VIDEO, i)) &&
+       (fmt = gavl_stream_get_video_format(s)))
+      ret += (int64_t)fmt->image_width * fmt->image_height * 4 * JOB_MEMORY_FRAMES;
+    }
+  return ret;
+  }
+
+static int64_t get_memory(int name)
+  {
+  long pages = sysconf(name);
+  long page_size = sysconf(_SC_PAGESIZE);
+  
+  if((pages <= 0) || (page_size <= 0))
+    return -1;
+  return (int64_t)pages * page_size;
+  }
+
+static transcoder_job_t * find_job(app_data_t * ad, int id)
+  {
+  int i;
+  for(i = 0; i < ad->num_jobs; i++)
+    {
+    if(ad->jobs[i].id == id)
+      return &ad->jobs[i];
+    }
+  return NULL;
+  }
+
+static int output_is_busy(app_data_t * ad, const char * output, int track_idx)
+  {
+  int i;
+  int ret = 0;
+  char * str;
+  
+  for(i = 0; i < ad->num_jobs; i++)
+    {
+    if(ad->jobs[i].output && !strcmp(ad->jobs[i].output, output))
+      return 1;
+    }
+
+  /* Tracks above in the list are written first */
+  for(i = 0; i < track_idx; i++)
+    {
+    if((str = transcoder_get_output(gavl_value_get_dictionary(&ad->tracks->entries[i]))))
+      {
+      ret = !strcmp(str, output);
+      free(str);
+      if(ret)
+        break;
+      }
+    }
+  return ret;
+  }
+
+static void update_progress(app_data_t * ad)
+  {
+  int i;
+  double percentage = 0.0;
+  char * str;
+  
+  if(!ad->num_jobs)
+    {
+    app_default_status(ad);
+    return;
+    }
+
+  for(i = 0; i < ad->num_jobs; i++)
+    percentage += ad->jobs[i].percentage;
+  percentage /= ad->num_jobs;
+
+  if(!ad->jobs[0].progress_msg)
+    gtk_label_set_text(GTK_LABEL(ad->status_left), "");
+  else if(ad->num_jobs == 1)
+    gtk_label_set_text(GTK_LABEL(ad->status_left), ad->jobs[0].progress_msg);
+  else
+    {
+    str = gavl_sprintf("%s (+%d)", ad->jobs[0].progress_msg, ad->num_jobs - 1);
+    gtk_label_set_text(GTK_LABEL(ad->status_left), str);
+    free(str);
+    }
+  gtk_progress_bar_set_fraction(GTK_PROGRESS_BAR(ad->progress), percentage);
+  }
+
+/* Stop a job and remove it. Unfinished tracks are appended to put_back */
+static void job_finish(app_data_t * ad, transcoder_job_t * job, gavl_array_t * put_back)
+  {
+  int idx = job - ad->jobs;
+  
+  transcoder_destroy(job->t);
+
+  if(put_back)
+    {
+    gavl_value_t val;
+    gavl_value_init(&val);
+    gavl_dictionary_move(gavl_value_set_dictionary(&val), &job->track);
+    gavl_array_splice_val_nocopy(put_back, -1, 0, &val);
+    }
+  
+  gavl_dictionary_free(&job->track);
+  if(job->output)
+    free(job->output);
+  if(job->progress_msg)
+    free(job->progress_msg);
+  
+  if(idx < ad->num_jobs - 1)
+    memmove(ad->jobs + idx, ad->jobs + idx + 1, (ad->num_jobs - 1 - idx) * sizeof(*ad->jobs));
+  ad->num_jobs--;
+  }
+
+/* Start as many jobs as we can */
+static void schedule_jobs(app_data_t * ad)
+  {
+  int i = 0;
+  int max_jobs;
+  int64_t memory = 0;
+  int64_t memory_budget;
+  int64_t memory_avail;
+  transcoder_job_t * job;
+  gavl_dictionary_t * track;
+  char * output;
+  
+  if(!ad->running)
+    return;
+
+  max_jobs = get_max_jobs();
+  
+  /* Don't let the jobs use more than half of the RAM */
+  if((memory_budget = get_memory(_SC_PHYS_PAGES)) > 0)
+    memory_budget /= 2;
+  
+  for(i = 0; i < ad->num_jobs; i++)
+    memory += ad->jobs[i].memory;
+
+  i = 0;
+  
+  while((ad->num_jobs < max_jobs) && (i < ad->tracks->num_entries))
+    {
+    int64_t job_memory;
+    
+    track = gavl_value_get_dictionary_nc(&ad->tracks->entries[i]);
+    
+    if(!(output = transcoder_get_output(track)))
+      {
+      gavl_log(GAVL_LOG_ERROR, LOG_DOMAIN, "Track has no label, skipping it");
+      splice(ad, i, 1, NULL);
+      continue;
+      }
+
+    /* Keep the order of tracks writing to the same file */
+    if(output_is_busy(ad, output, i))
+      {
+      free(output);
+      i++;
+      continue;
+      }
+
+    job_memory = get_job_memory(track);
+
+    /* We always run at least one job */
+    if(ad->num_jobs &&
+       (((memory_budget > 0) && (memory + job_memory > memory_budget)) ||
+        (((memory_avail = get_memory(_SC_AVPHYS_PAGES)) > 0) && (job_memory > memory_avail))))
+      {
+      gavl_log(GAVL_LOG_INFO, LOG_DOMAIN, "Not starting more than %d jobs due to memory limits",
+               ad->num_jobs);
+      free(output);
+      break;
+      }
+    
+    if(ad->num_jobs == ad->jobs_alloc)
+      {
+      ad->jobs_alloc += 8;
+      ad->jobs = realloc(ad->jobs, ad->jobs_alloc * sizeof(*ad->jobs));
+      }
+
+    job = &ad->jobs[ad->num_jobs];
+    memset(job, 0, sizeof(*job));
+
+    job->id = ad->next_job_id++;
+    job->output = output;
+    job->memory = job_memory;
+    
+    gavl_dictionary_move(&job->track, track);
+    splice(ad, i, 1, NULL);
+    
+    if(!(job->t = transcoder_create(&job->track, ad->transcoder_sink, job->id)))
+      {
+      gavl_log(GAVL_LOG_ERROR, LOG_DOMAIN, "Starting transcoder for %s failed", output);
+      gavl_dictionary_free(&job->track);
+      free(job->output);
+      continue;
+      }
+
+    ad->num_jobs++;
+    memory += job_memory;
+    }
+
+  if(!ad->num_jobs)
+    ad->running = 0;
+  
+  update_progress(ad);
+  }
+
+/* Stop all jobs and move the tracks back to the top of the list */
+static void stop_jobs(app_data_t * ad, int update_gui)
+  {
+  gavl_array_t arr;
+  
+  ad->running = 0;
+
+  gavl_array_init(&arr);
+  
+  while(ad->num_jobs)
+    job_finish(ad, &ad->jobs[0], &arr);
+
+  if(update_gui)
+    {
+    splice(ad, 0, 0, &arr);
+    update_progress(ad);
+    }
+  else
+    gavl_array_splice_array(ad->tracks, 0, 0, &arr);
+  
+  gavl_array_free(&arr);
+  }
 
 static int handle_transcoder_message(void * data, gavl_msg_t * msg)
   {
   app_data_t * ad = data;
+  transcoder_job_t * job;
+  
   switch(msg->NS)
     {
     case GAVL_MSG_NS_GENERIC:
@@ -78,32 +340,22 @@ static int handle_transcoder_message(void * data, gavl_msg_t * msg)
         {
         case GAVL_MSG_QUIT:
           //          fprintf(stderr, "transcoding complete\n");
-          transcoder_destroy(ad->t);
-          ad->t = NULL;
-          gavl_dictionary_reset(&ad->cur);
-          gtk_progress_bar_set_fraction(GTK_PROGRESS_BAR(ad->progress), 0.0);
+          if(!(job = find_job(ad, gavl_msg_get_arg_int(msg, 0))))
+            break;
+          
+          job_finish(ad, job, NULL);
+          
           /* Check for next track */
-          if(ad->tracks->num_entries)
-            {
-            gavl_dictionary_move(&ad->cur, gavl_value_get_dictionary_nc(&ad->tracks->entries[0]));
-  
-            if(!(ad->t = transcoder_create(&ad->cur, ad->transcoder_sink)))
-              return 1;
-            splice(ad, 0, 1, NULL);
-            }
-          else
-            app_default_status(ad);
+          schedule_jobs(ad);
           break;
         case GAVL_MSG_PROGRESS:
           {
-          double percentage;
-          const char * str;
-
-          percentage = gavl_msg_get_arg_float(msg, 0);
-          str = gavl_msg_get_arg_string_c(msg, 1);
-
-          gtk_label_set_text(GTK_LABEL(ad->status_left), str);
-          gtk_progress_bar_set_fraction(GTK_PROGRESS_BAR(ad->progress), percentage);
+          if(!(job = find_job(ad, gavl_msg_get_arg_int(msg, 2))))
+            break;
+          
+          job->percentage = gavl_msg_get_arg_float(msg, 0);
+          job->progress_msg = gavl_strrep(job->progress_msg, gavl_msg_get_arg_string_c(msg, 1));
+          update_progress(ad);
           }
           break;
         }
@@ -475,6 +727,15 @@ static const gavl_parameter_info_t audio_parameters[] =
   {
     OPT_ACTION_AV,
     OPT_LANGUAGE,
+    {
+      .name = "normalize",
+      .long_name = TRS("Normalize"),
+      .type = GAVL_PARAMETER_STRINGLIST,
+      .multi_names = (const char*[]){ "off", "peak", "replaygain", NULL },
+      .multi_labels = (const char*[]){ "Off", "Peak", "ReplayGain", NULL },
+      .val_default = GAVL_VALUE_INIT_STRING("off"),
+      .help_string = TRS("Peak: Amplify to full scale. ReplayGain: Apply the track gain from the metadata. Without tags, audio only files are decoded once to find the peak. Needs action \"Transcode\"."),
+    },
     { },
   };
 
@@ -510,6 +771,15 @@ static const gavl_parameter_info_t output_parameters[] =
       .type =      BG_PARAMETER_DIRECTORY,
       .val_default = GAVL_VALUE_INIT_STRING("."),
     },
+    {
+      .name =      "max_jobs",
+      .long_name = TRS("Parallel jobs"),
+      .type =      BG_PARAMETER_INT,
+      .val_min =   GAVL_VALUE_INIT_INT(0),
+      .val_max =   GAVL_VALUE_INIT_INT(64),
+      .val_default = GAVL_VALUE_INIT_INT(0),
+      .help_string = TRS("Maximum number of tracks to transcode at the same time. 0 means one per CPU core. Fewer jobs are started if memory is low."),
+    },
     { /* End of parameters */ }
   };
 
@@ -900,27 +1170,13 @@ static void action_copy(GSimpleAction *action, GVariant *param, gpointer user_da
 
 static void action_cancel(GSimpleAction *action, GVariant *param, gpointer user_data)
   {
-  gavl_array_t arr;
-  gavl_value_t val;
-
   app_data_t * ad = get_app_data_win(user_data);
 
-  if(!ad->t)
+  if(!ad->num_jobs)
     return;
 
-  transcoder_destroy(ad->t);
-  ad->t = NULL;
-
-  /* Move track back to the list */
-  gavl_array_init(&arr);
-  gavl_value_init(&val);
-  gavl_dictionary_move(gavl_value_set_dictionary(&val), &ad->cur);
-  
-  gavl_array_splice_val_nocopy(&arr, 0, 0, &val);
-  splice(ad, 0, 0, &arr);
-  gavl_array_free(&arr);
-  
-  app_default_status(ad);
+  /* Move tracks back to the list */
+  stop_jobs(ad, 1);
   }
 
 static void action_start(GSimpleAction *action, GVariant *param, gpointer user_data)
@@ -932,17 +1188,13 @@ static void action_start(GSimpleAction *action, GVariant *param, gpointer user_d
   
   g_print("Start\n");
 
-  if(ad->t || !ad->tracks || !ad->tracks->num_entries)
+  if(ad->running || !ad->tracks || !ad->tracks->num_entries)
     {
     return;
     }
 
-  gavl_dictionary_move(&ad->cur, gavl_value_get_dictionary_nc(&ad->tracks->entries[0]));
-  if(!(ad->t = transcoder_create(&ad->cur, ad->transcoder_sink)))
-    return;
-  
-  splice(ad, 0, 1, NULL);
-  
+  ad->running = 1;
+  schedule_jobs(ad);
   };
 
 /* Paste callbacks */
@@ -1808,6 +2060,10 @@ void destroy_app_data(void * priv)
   char * filename;
 
   app_data_t * data = priv;
+
+  /* Unfinished tracks are saved with the state */
+  stop_jobs(data, 0);
+  
   bg_msg_sink_destroy(data->dlg_sink);
   bg_msg_sink_destroy(data->transcoder_sink);
 
@@ -1820,6 +2076,9 @@ void destroy_app_data(void * priv)
   
   gavl_dictionary_free(&data->state);
   g_source_remove(data->idle_tag);
+
+  if(data->jobs)
+    free(data->jobs);
   
   free(data);
   }
@@ -75,6 +75,21 @@ extern const gavl_parameter_info_t metadata_bulk_parameters[];
 const gavl_parameter_info_t * get_metadata_parameters(const gavl_dictionary_t * track);
 
 
+/* A track being transcoded */
+
+typedef struct
+  {
+  transcoder_t * t;
+  gavl_dictionary_t track;
+  
+  int id;
+  char * output;  // Output file without extension
+  int64_t memory; // Estimated memory usage
+  
+  double percentage;
+  char * progress_msg;
+  } transcoder_job_t;
+
 typedef struct
   {
   gavl_array_t * tracks;
@@ -93,9 +108,15 @@ typedef struct
   /* Application state */
   gavl_dictionary_t state;
 
-  gavl_dictionary_t cur;
+  /* Running jobs */
+  transcoder_job_t * jobs;
+  int num_jobs;
+  int jobs_alloc;
+  int next_job_id;
+  
+  /* Start new jobs when others are finished */
+  int running;
   
-  transcoder_t * t;
   guint idle_tag;
   } app_data_t;
 
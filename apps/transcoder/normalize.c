@@ -0,0 +1,395 @@
+/*****************************************************************
+ * gmerlin - a general purpose multimedia framework and applications
+ *
+ * Copyright (c) 2001 - 2024 Members of the Gmerlin project
+ * http://github.com/bplaum
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * *****************************************************************/
+
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+#include <unistd.h>
+
+#include "transcode.h"
+
+#include <gavl/log.h>
+#define LOG_DOMAIN "normalize"
+
+#include <gavl/peakdetector.h>
+#include <gavl/utils.h>
+#include <gmerlin/utils.h>
+
+/*
+ *  Audio normalization
+ *
+ *  The gain is taken from ReplayGain tags if possible. Otherwise the
+ *  stream is decoded once to find the peak (pass 1). The converted
+ *  audio of pass 1 is kept so pass 2 doesn't need to decode again.
+ *  It is stored in memory up to CACHE_MEM_MAX bytes and in a temporary
+ *  file after that. If caching fails, the audio isn't normalized: Pass 2
+ *  plays the cached part and continues with the source.
+ */
+
+#define CACHE_MEM_MAX (64*1024*1024)
+
+#define META_REPLAYGAIN_TRACK_GAIN "REPLAYGAIN_TRACK_GAIN"
+#define META_REPLAYGAIN_TRACK_PEAK "REPLAYGAIN_TRACK_PEAK"
+
+/* Stored before the samples of each frame */
+typedef struct
+  {
+  int64_t timestamp;
+  int valid_samples;
+  } cache_header_t;
+
+struct transcoder_normalizer_s
+  {
+  gavl_audio_source_t * in;
+  gavl_audio_source_t * out;
+
+  gavl_audio_format_t fmt;
+  gavl_volume_control_t * vc;
+
+  int mode;
+  double gain; // dB
+  double peak; // From the tags or pass 1, 0.0 if unknown
+  int have_gain;
+  int need_analysis;
+
+  /* Cache */
+  int cached;
+  gavl_buffer_t mem;
+  int mem_pos;
+
+  FILE * file;
+  int64_t file_len; // Completely written bytes
+  int64_t file_pos;
+
+  /* Caching failed: The frame, which couldn't be cached is passed
+     after the cache and then the source is read */
+  int incomplete;
+  gavl_audio_frame_t * pending;
+  };
+
+static int get_tag(const gavl_dictionary_t * track,
+                   const gavl_dictionary_t * stream,
+                   const char * key, double * ret)
+  {
+  const char * str = NULL;
+  char * rest;
+  const gavl_dictionary_t * m;
+
+  if(stream && (m = gavl_stream_get_metadata(stream)))
+    str = gavl_dictionary_get_string_i(m, key);
+
+  if(!str && track && (m = gavl_track_get_metadata(track)))
+    str = gavl_dictionary_get_string_i(m, key);
+
+  if(!str)
+    return 0;
+
+  /* e.g. "-6.20 dB" */
+  *ret = strtod(str, &rest);
+  if(rest == str)
+    return 0;
+  return 1;
+  }
+
+static int frame_bytes(const gavl_audio_format_t * fmt, int num_samples)
+  {
+  return num_samples * fmt->num_channels * gavl_bytes_per_sample(fmt->sample_format);
+  }
+
+static int cache_write(transcoder_normalizer_t * n, const gavl_audio_frame_t * f)
+  {
+  cache_header_t h;
+  int len = frame_bytes(&n->fmt, f->valid_samples);
+
+  memset(&h, 0, sizeof(h));
+  h.timestamp = f->timestamp;
+  h.valid_samples = f->valid_samples;
+
+  if(!n->file && (n->mem.len + sizeof(h) + len > CACHE_MEM_MAX))
+    {
+    /* Spill to a temporary file */
+    int fd;
+    char * filename = gavl_sprintf("%s/gmerlin-transcoder-XXXXXX", bg_tempdir());
+
+    if((fd = mkstemp(filename)) < 0)
+      {
+      gavl_log(GAVL_LOG_ERROR, LOG_DOMAIN, "Cannot create temporary file %s", filename);
+      free(filename);
+      return 0;
+      }
+    unlink(filename);
+
+    gavl_log(GAVL_LOG_INFO, LOG_DOMAIN, "Caching audio in %s", filename);
+    free(filename);
+
+    if(!(n->file = fdopen(fd, "w+")))
+      {
+      close(fd);
+      return 0;
+      }
+    }
+
+  if(n->file)
+    {
+    if((fwrite(&h, 1, sizeof(h), n->file) < sizeof(h)) ||
+       (fwrite(f->samples.u_8, 1, len, n->file) < len))
+      {
+      gavl_log(GAVL_LOG_ERROR, LOG_DOMAIN, "Writing to temporary file failed");
+      return 0;
+      }
+    n->file_len += sizeof(h) + len;
+    }
+  else
+    {
+    gavl_buffer_append_data(&n->mem, (const uint8_t*)&h, sizeof(h));
+    gavl_buffer_append_data(&n->mem, f->samples.u_8, len);
+    }
+  return 1;
+  }
+
+static gavl_source_status_t cache_read(transcoder_normalizer_t * n, gavl_audio_frame_t * f)
+  {
+  cache_header_t h;
+  int len;
+
+  if(n->mem_pos < n->mem.len)
+    {
+    memcpy(&h, n->mem.buf + n->mem_pos, sizeof(h));
+    n->mem_pos += sizeof(h);
+
+    if(h.valid_samples > n->fmt.samples_per_frame)
+      return GAVL_SOURCE_EOF;
+
+    len = frame_bytes(&n->fmt, h.valid_samples);
+    memcpy(f->samples.u_8, n->mem.buf + n->mem_pos, len);
+    n->mem_pos += len;
+    }
+  else if(n->file && (n->file_pos < n->file_len))
+    {
+    if(fread(&h, 1, sizeof(h), n->file) < sizeof(h))
+      return GAVL_SOURCE_EOF;
+
+    if(h.valid_samples > n->fmt.samples_per_frame)
+      return GAVL_SOURCE_EOF;
+
+    len = frame_bytes(&n->fmt, h.valid_samples);
+    if(fread(f->samples.u_8, 1, len, n->file) < len)
+      return GAVL_SOURCE_EOF;
+    n->file_pos += sizeof(h) + len;
+    }
+  else if(n->pending)
+    {
+    gavl_audio_frame_copy(&n->fmt, f, n->pending, 0, 0,
+                          n->pending->valid_samples, n->pending->valid_samples);
+    f->timestamp = n->pending->timestamp;
+    f->valid_samples = n->pending->valid_samples;
+    
+    gavl_audio_frame_destroy(n->pending);
+    n->pending = NULL;
+    return GAVL_SOURCE_OK;
+    }
+  else
+    return GAVL_SOURCE_EOF;
+
+  f->timestamp = h.timestamp;
+  f->valid_samples = h.valid_samples;
+  return GAVL_SOURCE_OK;
+  }
+
+static gavl_source_status_t read_func(void * priv, gavl_audio_frame_t ** frame)
+  {
+  gavl_source_status_t st;
+  transcoder_normalizer_t * n = priv;
+
+  if(n->cached)
+    {
+    st = cache_read(n, *frame);
+
+    /* Continue with the source */
+    if((st == GAVL_SOURCE_EOF) && n->incomplete)
+      {
+      n->cached = 0;
+      st = gavl_audio_source_read_frame(n->in, frame);
+      }
+    }
+  else
+    st = gavl_audio_source_read_frame(n->in, frame);
+
+  if(st != GAVL_SOURCE_OK)
+    return st;
+
+  gavl_volume_control_apply(n->vc, *frame);
+  return GAVL_SOURCE_OK;
+  }
+
+static void set_gain(transcoder_normalizer_t * n)
+  {
+  double max_gain = 0.0;
+
+  if(n->peak > 0.0)
+    max_gain = -20.0 * log10(n->peak);
+
+  if((n->mode == TRANSCODER_NORMALIZE_REPLAYGAIN) && n->have_gain)
+    {
+    /* Don't clip */
+    if((n->peak > 0.0) && (n->gain > max_gain))
+      n->gain = max_gain;
+    }
+  else
+    n->gain = max_gain;
+
+  gavl_log(GAVL_LOG_INFO, LOG_DOMAIN, "Gain: %.2f dB", n->gain);
+  gavl_volume_control_set_volume(n->vc, n->gain);
+  }
+
+int transcoder_normalize_mode(const char * str)
+  {
+  if(!str)
+    return TRANSCODER_NORMALIZE_OFF;
+  if(!strcmp(str, "peak"))
+    return TRANSCODER_NORMALIZE_PEAK;
+  if(!strcmp(str, "replaygain"))
+    return TRANSCODER_NORMALIZE_REPLAYGAIN;
+  return TRANSCODER_NORMALIZE_OFF;
+  }
+
+transcoder_normalizer_t *
+transcoder_normalizer_create(bg_media_source_stream_t * st,
+                             const gavl_dictionary_t * track,
+                             const gavl_dictionary_t * stream,
+                             int mode, int can_analyze)
+  {
+  transcoder_normalizer_t * ret = calloc(1, sizeof(*ret));
+
+  ret->mode = mode;
+  ret->in = st->asrc;
+
+  if(mode == TRANSCODER_NORMALIZE_REPLAYGAIN)
+    ret->have_gain = get_tag(track, stream, META_REPLAYGAIN_TRACK_GAIN, &ret->gain);
+
+  get_tag(track, stream, META_REPLAYGAIN_TRACK_PEAK, &ret->peak);
+
+  /* Interleaved, so frames can be cached in one piece */
+  gavl_audio_format_copy(&ret->fmt, gavl_audio_source_get_src_format(ret->in));
+  ret->fmt.interleave_mode = GAVL_INTERLEAVE_ALL;
+  gavl_audio_source_set_dst(ret->in, 0, &ret->fmt);
+
+  ret->vc = gavl_volume_control_create();
+  gavl_volume_control_set_format(ret->vc, &ret->fmt);
+  gavl_volume_control_set_volume(ret->vc, 0.0);
+
+  ret->out = gavl_audio_source_create(read_func, ret, 0, &ret->fmt);
+  st->asrc = ret->out;
+
+  if(ret->have_gain || (ret->peak > 0.0))
+    set_gain(ret);
+  else if(can_analyze)
+    ret->need_analysis = 1;
+  else
+    gavl_log(GAVL_LOG_WARNING, LOG_DOMAIN,
+             "Not normalizing: No ReplayGain tags and analyzing is only done for files with one stream");
+  
+  return ret;
+  }
+
+int transcoder_normalizer_need_analysis(transcoder_normalizer_t * n)
+  {
+  return n->need_analysis;
+  }
+
+int transcoder_normalizer_analyze(transcoder_normalizer_t * n,
+                                  int (*progress)(void * data, gavl_time_t t),
+                                  void * data)
+  {
+  int ret = 0;
+  gavl_audio_frame_t * f;
+  gavl_peak_detector_t * pd;
+  double peak = 0.0;
+
+  pd = gavl_peak_detector_create();
+  gavl_peak_detector_set_format(pd, &n->fmt);
+
+  while(1)
+    {
+    f = NULL;
+    if(gavl_audio_source_read_frame(n->in, &f) != GAVL_SOURCE_OK)
+      {
+      ret = 1;
+      break;
+      }
+
+    gavl_peak_detector_update(pd, f);
+
+    if(!cache_write(n, f))
+      {
+      /* Keep this frame for pass 2 */
+      n->pending = gavl_audio_frame_create(&n->fmt);
+      gavl_audio_frame_copy(&n->fmt, n->pending, f, 0, 0,
+                            f->valid_samples, f->valid_samples);
+      n->pending->timestamp = f->timestamp;
+      n->pending->valid_samples = f->valid_samples;
+      n->incomplete = 1;
+      ret = 1;
+      break;
+      }
+
+    if(!progress(data, gavl_time_unscale(n->fmt.samplerate, f->timestamp + f->valid_samples)))
+      break;
+    }
+
+  if(ret)
+    {
+    if(n->file)
+      fseek(n->file, 0, SEEK_SET);
+    n->cached = 1;
+    n->need_analysis = 0;
+
+    if(n->incomplete)
+      {
+      /* The peak of the whole stream is unknown */
+      gavl_log(GAVL_LOG_WARNING, LOG_DOMAIN, "Caching audio failed, not normalizing");
+      }
+    else
+      {
+      gavl_peak_detector_get_peak(pd, NULL, NULL, &peak);
+      n->peak = peak;
+      
+      gavl_log(GAVL_LOG_INFO, LOG_DOMAIN, "Peak: %f, cached %d bytes in memory%s",
+               n->peak, n->mem.len, (n->file ? " and a temporary file" : ""));
+      set_gain(n);
+      }
+    }
+
+  gavl_peak_detector_destroy(pd);
+  return ret;
+  }
+
+void transcoder_normalizer_destroy(transcoder_normalizer_t * n)
+  {
+  gavl_audio_source_destroy(n->out);
+  gavl_volume_control_destroy(n->vc);
+  gavl_buffer_free(&n->mem);
+  if(n->file)
+    fclose(n->file);
+  if(n->pending)
+    gavl_audio_frame_destroy(n->pending);
+  free(n);
+  }
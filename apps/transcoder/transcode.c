@@ -144,49 +144,80 @@ static void sanitize_label(char* str)
   }
 
 
-static int open_output(transcoder_t * t, const gavl_dictionary_t * track)
+static char * get_label(const gavl_dictionary_t * track)
   {
-  char * label = NULL;
-  char * outfile = NULL;
+  char * label;
   const char * var;
-  const char * ext;
-  const char * path;
-  /* TODO: Subdir */
-  //  const char * subdir;
-  const gavl_dictionary_t * dict;
-  const gavl_array_t * arr;
-  int result = 0;
   const gavl_dictionary_t * m;
-  bg_encoder_plugin_t * enc;
-  enc = (bg_encoder_plugin_t*)t->encoder->plugin;
   
   if(!(m = gavl_track_get_metadata(track)) ||
      !(var = gavl_dictionary_get_string(m, GAVL_META_LABEL)))
-    goto fail;
+    return NULL;
   
   label = gavl_strdup(var);
   sanitize_label(label);
+  return label;
+  }
+
+char * transcoder_get_output(const gavl_dictionary_t * track)
+  {
+  char * label;
+  char * ret;
+  const char * path;
+  /* TODO: Subdir */
+  //  const char * subdir;
+  const gavl_dictionary_t * dict;
+  
+  if(!(label = get_label(track)))
+    return NULL;
 
   if(!(dict = bg_cfg_registry_find_section(bg_cfg_registry, PREFS_OUTPUT)) ||
      !(path = gavl_dictionary_get_string(dict, "output_path")))
     path = ".";
+
+  ret = gavl_sprintf("%s/%s", path, label);
+  free(label);
+  return ret;
+  }
+
+static int open_output(transcoder_t * t, const gavl_dictionary_t * track)
+  {
+  char * label = NULL;
+  char * output = NULL;
+  char * outfile = NULL;
+  const char * ext;
+  const gavl_array_t * arr;
+  int result = 0;
+  const gavl_dictionary_t * m;
+  bg_encoder_plugin_t * enc;
+  enc = (bg_encoder_plugin_t*)t->encoder->plugin;
+  
+  m = gavl_track_get_metadata(track);
+  
+  if(!(label = get_label(track)) ||
+     !(output = transcoder_get_output(track)))
+    goto fail;
   
   if(!(arr = bg_plugin_info_get_extensions(t->encoder->info)) ||
      !(ext = gavl_string_array_get(arr, 0)))
     goto fail;
 
-  outfile = gavl_sprintf("%s/%s.%s", path, label, ext);
+  outfile = gavl_sprintf("%s.%s", output, ext);
 
   fprintf(stderr, "Opening %s\n", outfile);
 
-  result = enc->open(t->encoder->priv, outfile, m);
-
+  if((result = enc->open(t->encoder->priv, outfile, m)))
+    t->flags |= TRANSCODER_FLAG_OPEN;
+  
   t->progress_msg = gavl_sprintf("Encoding %s.%s", label, ext);
   
   fail:
   
   if(outfile)
     free(outfile);
+
+  if(output)
+    free(output);
   
   if(label)
     free(label);
@@ -194,6 +225,53 @@ static int open_output(transcoder_t * t, const gavl_dictionary_t * track)
   return result;
   }
 
+static void init_normalizers(transcoder_t * t, const gavl_dictionary_t * track)
+  {
+  int i, num, mode;
+  int can_analyze;
+  const gavl_dictionary_t * cfg;
+  bg_media_source_stream_t * st;
+  int num_active = 0;
+  
+  /* Pass 1 makes the demultiplexer buffer all other streams.
+     Do it only if the normalized stream is the only one */
+  for(i = 0; i < t->src->num_streams; i++)
+    {
+    if((t->src->streams[i]->action != BG_STREAM_ACTION_OFF) &&
+       (t->src->streams[i]->type != GAVL_STREAM_MSG))
+      num_active++;
+    }
+  can_analyze = (num_active == 1);
+  
+  num = bg_media_source_get_num_streams(t->src, GAVL_STREAM_AUDIO);
+
+  for(i = 0; i < num; i++)
+    {
+    st = bg_media_source_get_audio_stream(t->src, i);
+
+    if(!(cfg = bg_track_get_config(st->s, BG_TRACK_CONFIG_TRANSCODE)) ||
+       !(mode = transcoder_normalize_mode(gavl_dictionary_get_string(cfg, "normalize"))))
+      continue;
+
+    if(st->action != BG_STREAM_ACTION_DECODE)
+      {
+      gavl_log(GAVL_LOG_WARNING, LOG_DOMAIN,
+               "Cannot normalize audio stream %d: Stream is copied", i+1);
+      continue;
+      }
+
+    if(!(st = bg_media_source_get_audio_stream(&t->src_filter, i)) || !st->asrc)
+      continue;
+    
+    t->normalizers = realloc(t->normalizers,
+                             (t->num_normalizers+1) * sizeof(*t->normalizers));
+    
+    t->normalizers[t->num_normalizers++] =
+      transcoder_normalizer_create(st, track, gavl_track_get_audio_stream(track, i),
+                                   mode, can_analyze);
+    }
+  }
+
 static int transcoder_init(transcoder_t * t, const gavl_dictionary_t * track)
   {
   int num_variants = 0;
@@ -268,6 +346,9 @@ static int transcoder_init(transcoder_t * t, const gavl_dictionary_t * track)
   /* input -> filters  */
   bg_media_source_filter_connect(&t->src_filter, t->src);
 
+  /* filters -> normalization */
+  init_normalizers(t, track);
+  
   /* filters -> encoder */
 
   if(!bg_media_encoder_connect(&t->src_encoder, &t->src_filter, t->encoder))
@@ -300,25 +381,92 @@ static int handle_cmd(void * data, gavl_msg_t * msg)
   return 1;
   }
 
-static void * thread_func(void * data)
+static void send_progress(transcoder_t * t, gavl_time_t transcoded, const char * str)
+  {
+  gavl_time_t cur = gavl_timer_get(t->timer);
+  
+  if((t->duration != GAVL_TIME_UNDEFINED) &&
+     (transcoded != GAVL_TIME_UNDEFINED) &&
+     ((t->last_progress_time == GAVL_TIME_UNDEFINED) ||
+      (cur - t->last_progress_time >= GAVL_TIME_SCALE / 2)))
+    {
+    double percentage;
+    gavl_msg_t * msg = bg_msg_sink_get(t->ctrl.evt_sink);
+    gavl_msg_set_id_ns(msg, GAVL_MSG_PROGRESS, GAVL_MSG_NS_GENERIC);
+
+    percentage = (double)transcoded / (double)t->duration;
+      
+    gavl_msg_set_arg_float(msg, 0, percentage);
+    gavl_msg_set_arg_string(msg, 1, str);
+    gavl_msg_set_arg_int(msg, 2, t->id);
+      
+    bg_msg_sink_put(t->ctrl.evt_sink);
+      
+    t->last_progress_time = cur;
+    }
+  }
+
+static void send_quit(transcoder_t * t)
+  {
+  gavl_msg_t * msg = bg_msg_sink_get(t->ctrl.evt_sink);
+  gavl_msg_set_id_ns(msg, GAVL_MSG_QUIT, GAVL_MSG_NS_GENERIC);
+  gavl_msg_set_arg_int(msg, 0, t->id);
+  bg_msg_sink_put(t->ctrl.evt_sink);
+  }
+
+static int analyze_progress(void * data, gavl_time_t time)
   {
   transcoder_t * t = data;
-  gavl_source_status_t st;
 
+  if(!bg_msg_sink_iteration(t->ctrl.cmd_sink))
+    {
+    /* Got cancel command */
+    gavl_log(GAVL_LOG_INFO, LOG_DOMAIN, "Got cancel command");
+    t->flags |= TRANSCODER_FLAG_DELETE;
+    return 0;
+    }
+  send_progress(t, time, "Analyzing audio");
+  return 1;
+  }
+
+static void * thread_func(void * data)
+  {
+  int i;
+  transcoder_t * t = data;
   gavl_time_t transcoded;
-  gavl_time_t cur;
+  gavl_time_t delay_time = GAVL_TIME_SCALE / 50;
+
+  /* Normalization pass 1 */
+  for(i = 0; i < t->num_normalizers; i++)
+    {
+    if(!transcoder_normalizer_need_analysis(t->normalizers[i]))
+      continue;
+
+    if(!transcoder_normalizer_analyze(t->normalizers[i], analyze_progress, t))
+      {
+      if(!(t->flags & TRANSCODER_FLAG_DELETE))
+        {
+        /* Error */
+        t->flags |= TRANSCODER_FLAG_DELETE;
+        send_quit(t);
+        }
+      return NULL;
+      }
+    t->last_progress_time = GAVL_TIME_UNDEFINED;
+    }
+  
+  /* One thread per stream, reading packets from the input is serialized */
+  bg_media_encoder_set_flags(&t->src_encoder,
+                             BG_ENCODER_SYNC_READ | BG_ENCODER_SYNC_INTERLEAVE);
+  bg_media_encoder_set_input(&t->src_encoder, t->src);
+  bg_media_encoder_start(&t->src_encoder);
   
   while(1)
     {
-    
-    st = bg_media_encoder_process(&t->src_encoder, &transcoded);
-    
-    if(st != GAVL_SOURCE_OK)
+    if(bg_media_encoder_eof(&t->src_encoder))
       {
       /* Encoding completed */
-      gavl_msg_t * msg = bg_msg_sink_get(t->ctrl.evt_sink);
-      gavl_msg_set_id_ns(msg, GAVL_MSG_QUIT, GAVL_MSG_NS_GENERIC);
-      bg_msg_sink_put(t->ctrl.evt_sink);
+      send_quit(t);
 
       //      fprintf(stderr, "Transcoding complete\n");
       
@@ -326,8 +474,6 @@ static void * thread_func(void * data)
       break;
       }
 
-    //    fprintf(stderr, "Transcoder iteration %f\n", gavl_time_to_seconds(transcoded));
-    
     if(!bg_msg_sink_iteration(t->ctrl.cmd_sink))
       {
       /* Got cancel command */
@@ -336,51 +482,47 @@ static void * thread_func(void * data)
       break;
       }
 
-    cur = gavl_timer_get(t->timer);
-    if((t->duration != GAVL_TIME_UNDEFINED) &&
-       ((t->last_progress_time == GAVL_TIME_UNDEFINED) ||
-        (cur - t->last_progress_time >= GAVL_TIME_SCALE / 2)))
-      {
-      double percentage;
-      gavl_msg_t * msg = bg_msg_sink_get(t->ctrl.evt_sink);
-      gavl_msg_set_id_ns(msg, GAVL_MSG_PROGRESS, GAVL_MSG_NS_GENERIC);
-
-      percentage = (double)transcoded / (double)t->duration;
-      
-      gavl_msg_set_arg_float(msg, 0, percentage);
-
-      
-      gavl_msg_set_arg_string(msg, 1, t->progress_msg);
-      
-      bg_msg_sink_put(t->ctrl.evt_sink);
-      
-      t->last_progress_time = cur;
-      }
+    transcoded = bg_media_encoder_get_time(&t->src_encoder);
+    
+    //    fprintf(stderr, "Transcoder iteration %f\n", gavl_time_to_seconds(transcoded));
+    
+    send_progress(t, transcoded, t->progress_msg);
+    gavl_time_delay(&delay_time);
     }
+
+  /* Join the stream threads */
+  bg_media_encoder_stop(&t->src_encoder);
   return NULL;
   } 
 
 
-transcoder_t * transcoder_create(const gavl_dictionary_t * track, bg_msg_sink_t * sink)
+static void transcoder_cleanup(transcoder_t * t);
+
+transcoder_t * transcoder_create(const gavl_dictionary_t * track, bg_msg_sink_t * sink,
+                                 int id)
   {
   transcoder_t * ret = calloc(1, sizeof(*ret));
 
+  ret->id = id;
   ret->last_progress_time = GAVL_TIME_UNDEFINED;
   ret->duration = GAVL_TIME_UNDEFINED;
 
   ret->timer = gavl_timer_create();
   gavl_timer_start(ret->timer);
-  
-  
-  if(!transcoder_init(ret, track))
-    {
-    transcoder_destroy(ret);
-    ret = NULL;
-    }
 
   bg_controllable_init(&ret->ctrl,
                        bg_msg_sink_create(handle_cmd, ret, 0),
                        bg_msg_hub_create(1));
+  
+  if(!transcoder_init(ret, track))
+    {
+    /* No thread running yet */
+    ret->flags |= TRANSCODER_FLAG_DELETE;
+    transcoder_cleanup(ret);
+    gavl_timer_destroy(ret->timer);
+    free(ret);
+    return NULL;
+    }
 
   bg_msg_hub_connect_sink(ret->ctrl.evt_hub, sink);
   
@@ -391,19 +533,29 @@ transcoder_t * transcoder_create(const gavl_dictionary_t * track, bg_msg_sink_t
 
 static void transcoder_cleanup(transcoder_t * t)
   {
+  int i;
   bg_encoder_plugin_t * enc;
   /* Close */
   if(t->progress_msg)
     free(t->progress_msg);
 
-  enc = (bg_encoder_plugin_t*)t->encoder->plugin;
-
-  enc->close(t->encoder->priv, !!(t->flags & TRANSCODER_FLAG_DELETE));
+  if(t->flags & TRANSCODER_FLAG_OPEN)
+    {
+    enc = (bg_encoder_plugin_t*)t->encoder->plugin;
+    enc->close(t->encoder->priv, !!(t->flags & TRANSCODER_FLAG_DELETE));
+    }
   
   bg_controllable_cleanup(&t->ctrl);
+
+  for(i = 0; i < t->num_normalizers; i++)
+    transcoder_normalizer_destroy(t->normalizers[i]);
+  if(t->normalizers)
+    free(t->normalizers);
   
-  bg_plugin_unref(t->input);
-  bg_plugin_unref(t->encoder);
+  if(t->input)
+    bg_plugin_unref(t->input);
+  if(t->encoder)
+    bg_plugin_unref(t->encoder);
   }
 
 void transcoder_destroy(transcoder_t * t)
@@ -31,6 +31,34 @@
  */
 
 #define TRANSCODER_FLAG_DELETE (1<<0)
+#define TRANSCODER_FLAG_OPEN   (1<<1) // Output file was opened
+
+/* Audio normalization (normalize.c) */
+
+#define TRANSCODER_NORMALIZE_OFF        0
+#define TRANSCODER_NORMALIZE_PEAK       1
+#define TRANSCODER_NORMALIZE_REPLAYGAIN 2
+
+typedef struct transcoder_normalizer_s transcoder_normalizer_t;
+
+int transcoder_normalize_mode(const char * str);
+
+/* Replaces st->asrc. Pass 1 is only done if can_analyze is set */
+transcoder_normalizer_t *
+transcoder_normalizer_create(bg_media_source_stream_t * st,
+                             const gavl_dictionary_t * track,
+                             const gavl_dictionary_t * stream,
+                             int mode, int can_analyze);
+
+int transcoder_normalizer_need_analysis(transcoder_normalizer_t * n);
+
+/* Pass 1: Find the peak and cache the audio. progress returns 0 to cancel.
+   If caching fails, the audio is passed through without normalization */
+int transcoder_normalizer_analyze(transcoder_normalizer_t * n,
+                                  int (*progress)(void * data, gavl_time_t t),
+                                  void * data);
+
+void transcoder_normalizer_destroy(transcoder_normalizer_t * n);
 
 typedef struct
   {
@@ -50,11 +78,26 @@ typedef struct
   
   char * progress_msg;
 
+  transcoder_normalizer_t ** normalizers;
+  int num_normalizers;
+
   int flags;
+
+  /* Passed with all messages so the application knows the job */
+  int id;
   } transcoder_t;
 
+/*
+ *  Messages sent to msg_sink:
+ *  GAVL_MSG_QUIT:     arg0: id
+ *  GAVL_MSG_PROGRESS: arg0: percentage, arg1: message, arg2: id
+ */
+
 transcoder_t * transcoder_create(const gavl_dictionary_t * track,
-                                 bg_msg_sink_t * msg_sink);
+                                 bg_msg_sink_t * msg_sink, int id);
 
 void transcoder_destroy(transcoder_t * t);
 
+/* Output file of a track without extension */
+char * transcoder_get_output(const gavl_dictionary_t * track);
+
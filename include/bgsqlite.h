@@ -118,6 +118,9 @@ int64_t bg_sqlite_get_int(sqlite3 * db, const char * sql);
 
 
 
+/* Registers the collation "strcoll" and the function sortkey(text), which
+   returns a BLOB ordered like the argument with COLLATE strcoll */
+
 void bg_sqlite_init_strcoll(sqlite3 * db);
 
 char * bg_sqlite_make_group_condition(const char * id);
@@ -138,4 +141,89 @@ int bg_sqlite_set_group_container(sqlite3 * db, gavl_dictionary_t * ret, const c
                                   const char * child_class, int * idxp, int * totalp);
 
 
+/* Prepared statement cache
+ *
+ * Keeps compiled statements of one connection keyed by their SQL text.
+ * Values must be passed as bound parameters (?1, ?2, ...) instead of
+ * being printed into the SQL, otherwise each query is a cache miss.
+ */
+
+typedef struct bg_sqlite_stmt_cache_s bg_sqlite_stmt_cache_t;
+
+bg_sqlite_stmt_cache_t * bg_sqlite_stmt_cache_create(sqlite3 * db, int max_stmts);
+void bg_sqlite_stmt_cache_destroy(bg_sqlite_stmt_cache_t * c);
+
+sqlite3 * bg_sqlite_stmt_cache_get_db(bg_sqlite_stmt_cache_t * c);
+
+/* Get a reset statement for the SQL. Returns NULL on syntax error.
+   Every statement obtained this way must be passed to
+   bg_sqlite_stmt_cache_release() (or one of the exec functions below,
+   which do that) when done. */
+
+sqlite3_stmt * bg_sqlite_stmt_cache_get(bg_sqlite_stmt_cache_t * c, const char * sql);
+void bg_sqlite_stmt_cache_release(bg_sqlite_stmt_cache_t * c, sqlite3_stmt * st);
+
+void bg_sqlite_stmt_cache_get_stats(bg_sqlite_stmt_cache_t * c,
+                                    int64_t * hits, int64_t * compiles);
+
+void bg_sqlite_stmt_cache_log_stats(bg_sqlite_stmt_cache_t * c);
+
+/* Typed binding (idx starts with 1) */
+
+int bg_sqlite_bind_int(sqlite3_stmt * st, int idx, int val);
+int bg_sqlite_bind_long(sqlite3_stmt * st, int idx, int64_t val);
+int bg_sqlite_bind_string(sqlite3_stmt * st, int idx, const char * val);
+int bg_sqlite_bind_value(sqlite3_stmt * st, int idx, const gavl_value_t * val);
+
+/* 1: Got row, 0: Done, -1: Error */
+int bg_sqlite_step(sqlite3_stmt * st);
+
+/* Run the statement to completion and pass each row to the callback
+   (same semantics as for bg_sqlite_exec()). Releases the statement */
+
+int bg_sqlite_stmt_exec(bg_sqlite_stmt_cache_t * c,
+                        sqlite3_stmt * st,
+                        int (*callback)(void*,int,char**,char**),
+                        void * data);
+
+/* Return first column of the first row as integer or -1. Releases the statement */
+int64_t bg_sqlite_stmt_get_int(bg_sqlite_stmt_cache_t * c, sqlite3_stmt * st);
+
+/* Convenience: Get statement, bind num_args int64_t arguments and execute it */
+
+int bg_sqlite_exec_cached(bg_sqlite_stmt_cache_t * c,
+                          const char * sql,
+                          int (*callback)(void*,int,char**,char**),
+                          void * data, int num_args, ...);
+
+/* Cached versions of the functions above */
+
+int64_t bg_sqlite_string_to_id_cached(bg_sqlite_stmt_cache_t * c,
+                                      const char * table,
+                                      const char * id_row,
+                                      const char * string_row,
+                                      const char * str);
+
+int64_t bg_sqlite_string_to_id_add_cached(bg_sqlite_stmt_cache_t * c,
+                                          const char * table,
+                                          const char * id_row,
+                                          const char * string_row,
+                                          const char * str);
+
+char * bg_sqlite_id_to_string_cached(bg_sqlite_stmt_cache_t * c,
+                                     const char * table,
+                                     const char * string_row,
+                                     const char * id_row,
+                                     int64_t id);
+
+int64_t bg_sqlite_id_to_id_cached(bg_sqlite_stmt_cache_t * c,
+                                  const char * table,
+                                  const char * dst_row,
+                                  const char * src_row,
+                                  int64_t id);
+
+int64_t bg_sqlite_get_max_int_cached(bg_sqlite_stmt_cache_t * c, const char * table,
+                                     const char * row);
+
+
 #endif // BGSQLITE_H_INCLUDED
@@ -778,6 +778,11 @@ int bg_dictionary_load_xml_string(gavl_dictionary_t * ret,
 char * bg_dictionary_save_xml_string(const gavl_dictionary_t * d,
                                      const char * root);
 
+/* Binary interface: Compact, numbers are little endian */
+
+void bg_value_to_buffer(const gavl_value_t * v, gavl_buffer_t * buf);
+int bg_value_from_buffer(gavl_value_t * v, const uint8_t * data, int len);
+
 gavl_dictionary_t * bg_edl_load(const char * filename);
 
 void bg_edl_save(const gavl_dictionary_t * edl, const char * filename);
@@ -169,6 +169,10 @@ bg_msg_from_json_str(gavl_msg_t * msg, const char * str);
 char * bg_msg_to_json_str(const gavl_msg_t * msg);
 void bg_msg_to_json_buf(const gavl_msg_t * msg, gavl_buffer_t * buf);
 
+/* Binary serialization (see bg_value_to_buffer()). Appends to buf */
+void bg_msg_to_buffer(const gavl_msg_t * msg, gavl_buffer_t * buf);
+int bg_msg_from_buffer(gavl_msg_t * msg, const uint8_t * data, int len);
+
 void bg_msg_dump(gavl_msg_t * msg, int indent);
 
 
@@ -189,8 +193,18 @@ void bg_msg_sink_put_copy(bg_msg_sink_t * sink, const gavl_msg_t * msg);
 /* Messages processed in the last call to bg_msg_sink_iteration */
 int bg_msg_sink_get_num(bg_msg_sink_t * sink);
 
-/* Wait until at least one message arrives */
-void bg_msg_sink_wait(bg_msg_sink_t * sink, int timeout);
+/* Wait until at least one message arrives (timeout in milliseconds, -1: infinite).
+   Returns 1 if messages are available, 0 on timeout */
+int bg_msg_sink_wait(bg_msg_sink_t * sink, int timeout);
+
+/* Wait for messages in any of the sinks or for any fd becoming readable.
+   Returns 1 if something is available, 0 on timeout */
+int bg_msg_sinks_wait(bg_msg_sink_t ** sinks, int num_sinks,
+                      const int * fds, int num_fds, int timeout);
+
+/* File descriptor, which is readable while messages are queued
+   (asynchronous sinks only, -1 otherwise) */
+int bg_msg_sink_get_fd(bg_msg_sink_t * sink);
 
 bg_msg_sink_t * bg_msg_sink_create(gavl_handle_msg_func cb, void * cb_data, int sync);
 void bg_msg_sink_destroy(bg_msg_sink_t *);
@@ -88,4 +88,17 @@ void bg_http_cache_cleanup(void);
 int bg_http_cache_get(const char * uri, gavl_dictionary_t * dict);
 int bg_http_cache_put(const gavl_dictionary_t * dict);
 
+/* Return values of bg_http_cache_fetch() */
+#define BG_HTTP_FETCH_ERROR        0
+#define BG_HTTP_FETCH_LOADED       1
+#define BG_HTTP_FETCH_NOT_MODIFIED 2
+
+/* GET with If-None-Match/If-Modified-Since from the cache entry. If revalidate
+   is zero, the body is always loaded. dict receives the mimetype.
+   If cache_info is non-NULL, the entry for a loaded body is returned there
+   instead of being stored. Pass it to bg_http_cache_put() after the body
+   was processed successfully. */
+int bg_http_cache_fetch(const char * uri, gavl_buffer_t * buf, gavl_dictionary_t * dict,
+                        gavl_dictionary_t * cache_info, int revalidate);
+
 #endif // BG_HTTP_H_INCLUDED
@@ -84,6 +84,10 @@ void bg_http_connection_init(bg_http_connection_t * conn);
 int bg_http_connection_read_req(bg_http_connection_t * conn, int fd,
                                 int timeout);
 
+/* Initialize from a complete request header, which was already read from fd */
+int bg_http_connection_parse_req(bg_http_connection_t * conn, int fd,
+                                 const char * header);
+
 void bg_http_connection_init_res(bg_http_connection_t * conn,
                                  const char * protocol,
                                  int status_i, const char * status);
@@ -135,6 +139,18 @@ int bg_server_storage_handle_http(bg_http_connection_t * conn, void * data);
 typedef void (*bg_http_server_thread_func)(bg_http_connection_t * conn, void * data);
 typedef void (*bg_http_server_thread_cleanup)(void * priv);
 
+/* Send the next chunk. Return 1 if there is more to send, 0 when done
+   and -1 on error. It should not block if the socket is not writable */
+typedef int (*bg_http_server_chunk_func)(bg_http_connection_t * conn, void * data);
+
+typedef struct
+  {
+  int active;   // Clients handled by a thread right now
+  int queued;   // Clients waiting for a thread
+  int waiting;  // Chunked clients waiting for their socket
+  int rejected; // Clients rejected because the queue was full (total)
+  } bg_http_server_client_stats_t;
+
 /* Server */
 
 
@@ -162,6 +178,9 @@ void bg_http_server_set_server_string(bg_http_server_t * s, const char * str);
 
 int bg_http_server_has_path(bg_http_server_t * s, const char * path);
 
+/* Handlers are called from a pool of worker threads and can run in parallel.
+   bg_http_server_remove_handler() waits until no handler is running */
+
 void bg_http_server_add_handler(bg_http_server_t * s,
                                 bg_http_handler_t h,
                                 int protocol,
@@ -185,13 +204,32 @@ const gavl_socket_address_t * bg_http_server_get_address(bg_http_server_t * s);
  *  In this case the thread should sleep a short time before calling this function again.
  */
 
-void bg_http_server_create_client_thread(bg_http_server_t * s,
-                                         bg_http_server_thread_func tf,
-                                         bg_http_server_thread_cleanup cf,
+/* Streaming clients are handled by a pool of threads. The thread function
+   is responsible for calling bg_http_server_put_connection().
+   Return 0 if the client was rejected. In this case the connection is closed and
+   cf is called */
+
+int bg_http_server_create_client_thread(bg_http_server_t * s,
+                                        bg_http_server_thread_func tf,
+                                        bg_http_server_thread_cleanup cf,
+                                        bg_http_connection_t * conn, void * priv);
+
+/* Same as above but the chunk function is called repeatedly until it returns <= 0.
+   Between the calls, no thread is used while the socket is not writable. */
+
+int bg_http_server_create_client_chunked(bg_http_server_t * s,
+                                         bg_http_server_chunk_func cf,
+                                         bg_http_server_thread_cleanup cleanup,
                                          bg_http_connection_t * conn, void * priv);
 
+void bg_http_server_get_client_stats(bg_http_server_t * s, bg_http_server_client_stats_t * stats);
+
 int bg_http_server_iteration(bg_http_server_t * s);
 
+/* Wait until a new connection or a request on an idle connection arrives
+   or until any of the sinks has messages (timeout in milliseconds) */
+int bg_http_server_wait(bg_http_server_t * s, bg_msg_sink_t ** sinks, int num_sinks, int timeout);
+
 gavl_time_t bg_http_server_get_time(bg_http_server_t * s);
 
 void bg_http_server_set_static_path(bg_http_server_t * s, const char * path);
@@ -132,6 +132,19 @@
 
 #define BG_FUNC_DB_DEL_SQL_DIR            204
 
+/*
+ *  Search the objects of the sqlite backend
+ *
+ *  ContextID: Passed back with the response
+ *  arg0: query (dictionary, see below)
+ *  arg1: sort  (string array) Metadata tags prefixed with '+' (ascending) or
+ *                             '-' (descending). Can be empty.
+ *  arg2: start (int)
+ *  arg3: num   (int) <= 0 means all
+ */
+
+#define BG_FUNC_DB_SEARCH                 205
+
 /*
  *  ContextID: album_id
  *  arg0: metadata   (dictionary)
@@ -155,6 +168,46 @@
 
 #define BG_RESP_ADD_SQL_DIR               303
 #define BG_RESP_DEL_SQL_DIR               304
+
+/*
+ *  ContextID: Same as in the request
+ *  arg0: tracks (array)
+ *  arg1: start  (int)
+ *  arg2: total  (int) Total number of matches
+ */
+
+#define BG_RESP_DB_SEARCH                 305
+
+/*
+ *  Search queries are trees of dictionaries. An empty dictionary matches
+ *  everything.
+ *
+ *  Logical nodes: op:   BG_MDB_SEARCH_OP_AND or BG_MDB_SEARCH_OP_OR
+ *                 args: Operands (array of dictionaries)
+ *
+ *  Relations:     op:   One of the other operators
+ *                 tag:  Metadata tag (e.g. GAVL_META_TITLE or GAVL_META_CLASS)
+ *                 val:  Value (string), "true" or "false" for BG_MDB_SEARCH_OP_EXISTS
+ *
+ *  Tags which are not stored in the database never exist.
+ */
+
+#define BG_MDB_SEARCH_OP   "op"
+#define BG_MDB_SEARCH_ARGS "args"
+#define BG_MDB_SEARCH_TAG  "tag"
+#define BG_MDB_SEARCH_VAL  "val"
+
+#define BG_MDB_SEARCH_OP_AND           "and"
+#define BG_MDB_SEARCH_OP_OR            "or"
+#define BG_MDB_SEARCH_OP_EQUAL         "="
+#define BG_MDB_SEARCH_OP_NOT_EQUAL     "!="
+#define BG_MDB_SEARCH_OP_LESS          "<"
+#define BG_MDB_SEARCH_OP_LESS_EQUAL    "<="
+#define BG_MDB_SEARCH_OP_GREATER       ">"
+#define BG_MDB_SEARCH_OP_GREATER_EQUAL ">="
+#define BG_MDB_SEARCH_OP_CONTAINS      "contains"
+#define BG_MDB_SEARCH_OP_NOT_CONTAINS  "doesNotContain"
+#define BG_MDB_SEARCH_OP_EXISTS        "exists"
       
 typedef struct bg_mdb_s bg_mdb_t;
 
@@ -182,6 +235,9 @@ void bg_mdb_del_sql_directory(bg_controllable_t * db, const char * dir);
 void bg_mdb_add_sql_directory_sync(bg_controllable_t * db, const char * dir);
 void bg_mdb_del_sql_directory_sync(bg_controllable_t * db, const char * dir);
 
+/* Print the query plans of the standard browse queries to stdout */
+void bg_mdb_explain_queries(bg_mdb_t * db);
+
 
 bg_cfg_ctx_t * bg_mdb_get_cfg(bg_mdb_t * db);
 
@@ -203,6 +259,11 @@ void bg_mdb_get_browse_children_request(const gavl_msg_t * req, const char ** id
 void bg_mdb_set_browse_children_request(gavl_msg_t * req, const char * id,
                                         int start, int num, int one_answer);
 
+void bg_mdb_set_search_request(gavl_msg_t * req, const char * ctx_id,
+                               const gavl_dictionary_t * query,
+                               const gavl_array_t * sort,
+                               int start, int num);
+
 
 /* Utilities */
 
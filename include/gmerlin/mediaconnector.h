@@ -207,12 +207,26 @@ int bg_media_source_filter_connect(bg_media_source_t * filter_src,
 /* Non-continuous streams need this */
 #define BG_ENCODER_GOT_SINK_FRAME  (1<<4)
 #define BG_ENCODER_GOT_SRC_FRAME   (1<<5)
+/* Multithreaded mode: Reading must be serialized completely (decoded by the input plugin) */
+#define BG_ENCODER_STREAM_LOCK_READ  (1<<6)
+/* Multithreaded mode: The frame sink encodes and writes to the file */
+#define BG_ENCODER_STREAM_LOCK_WRITE (1<<7)
 
 #define BG_ENCODER_STATE_INIT      0
 #define BG_ENCODER_STATE_RUNNING   1
 #define BG_ENCODER_STATE_STOP      2
 #define BG_ENCODER_STATE_EOF       3
 
+/* Flags for the multithreaded mode */
+
+/* All streams come from the same demultiplexer: Reading packets is serialized
+   and decoded A/V frames are passed to the encoding threads through small queues.
+   See bg_media_encoder_set_input() */
+#define BG_ENCODER_SYNC_READ       (1<<0)
+/* Keep the continuous streams close together in time for the multiplexer */
+#define BG_ENCODER_SYNC_INTERLEAVE (1<<1)
+
+typedef struct bg_encoder_queue_s bg_encoder_queue_t;
 
 
 typedef struct
@@ -222,6 +236,15 @@ typedef struct
   pthread_barrier_t barrier;
   int state;
   int num_threads;
+
+  pthread_cond_t cond;        // Signalled when a stream time changes
+  pthread_mutex_t read_mutex;    // BG_ENCODER_SYNC_READ (recursive)
+  pthread_mutex_t write_mutex;   // Serializes writing to the output file
+  pthread_mutex_t noncont_mutex; // Serializes flushing the non-continuous streams
+  int flags;
+  int num_noncont;            // Flushed by the continuous stream threads
+  bg_media_source_t * src;
+  bg_media_source_t * input;  // Demultiplexer side (see bg_media_encoder_set_input())
   } bg_encoder_t;
 
 
@@ -249,7 +272,12 @@ typedef struct
   pthread_t th;
   
   gavl_stream_stats_t stats;
+
+  /* Multithreaded mode, protected by the mutex of bg_encoder_t */
+  gavl_time_t sync_time;
+  int sync_eof;
   
+  bg_encoder_queue_t * q;
   } bg_encoder_stream_t;
 
 
@@ -278,10 +306,23 @@ gavl_source_status_t bg_media_encoder_process_stream(bg_media_source_stream_t *
 gavl_source_status_t bg_media_encoder_process(bg_media_source_t * src, gavl_time_t * time);
 
 /* Multithread */
+
+/* Set BG_ENCODER_SYNC_* flags before calling bg_media_encoder_start() */
+void bg_media_encoder_set_flags(bg_media_source_t * src, int flags);
+
+/* Source of the input plugin, which must have the same streams as src.
+   With BG_ENCODER_SYNC_READ, only reading packets from its packet sources is
+   serialized, so the streams decoded by codec plugins are decoded in parallel.
+   Without it, reading decoded frames is serialized completely. */
+void bg_media_encoder_set_input(bg_media_source_t * src, bg_media_source_t * input);
+
 void bg_media_encoder_start(bg_media_source_t * src);
 void bg_media_encoder_stop(bg_media_source_t * src);
 int bg_media_encoder_eof(bg_media_source_t * src);
 
+/* Largest time of the continuous streams (for progress reporting) */
+gavl_time_t bg_media_encoder_get_time(bg_media_source_t * src);
+
 void bg_media_encoder_dump_stats(bg_media_source_t * src);
 
 
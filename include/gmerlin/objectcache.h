@@ -25,6 +25,16 @@
 
 typedef struct bg_object_cache_s bg_object_cache_t;
 
+typedef struct
+  {
+  int64_t memory_hits;
+  int64_t disk_hits;
+  int64_t misses;
+  int64_t memory_evictions; // Moved to disk
+  int64_t disk_evictions;   // Deleted
+  int64_t compactions;      // Disk cache file rewritten
+  } bg_object_cache_stats_t;
+
 /* Return 1 if a cache item is not expired yet */
 typedef int (*bg_object_cache_check_func)(const gavl_value_t * val, const char * id, void * priv);
 
@@ -43,6 +53,9 @@ bg_object_cache_t * bg_object_cache_create(int max_disk_cache_size,
 
 void bg_object_cache_destroy(bg_object_cache_t * cache);
 
+void bg_object_cache_get_stats(const bg_object_cache_t * cache,
+                               bg_object_cache_stats_t * ret);
+
 // void bg_object_cache_cleanup(bg_object_cache_t * cache, bg_object_cache_check_func f, void * priv);
 
 #if 0
@@ -55,6 +55,15 @@
 #define BG_PLAYER_STATE_MODE          "mode"          // int
 #define BG_PLAYER_STATE_MUTE          "mute"          // int
 
+/* Video playback statistics (dictionary), see BG_PLAYER_VIDEO_STATS_* */
+#define BG_PLAYER_STATE_VIDEO_STATS   "video_stats"
+
+#define BG_PLAYER_VIDEO_STATS_DECODE_DURATION "decode_duration" // long (Average, GAVL_TIME_SCALE)
+#define BG_PLAYER_VIDEO_STATS_RENDER_DURATION "render_duration" // long (Average, GAVL_TIME_SCALE)
+#define BG_PLAYER_VIDEO_STATS_QUEUE_DEPTH     "queue_depth"     // int  (Decoded frames waiting)
+#define BG_PLAYER_VIDEO_STATS_QUEUE_SIZE      "queue_size"      // int  (0: No decoder thread)
+#define BG_PLAYER_VIDEO_STATS_DROPPED         "dropped"         // long (Since start of the track)
+
 /* All of them are read/write */
 #define BG_PLAYER_STATE_AUDIO_STREAM_USER     "audio_stream_user"    // int
 #define BG_PLAYER_STATE_VIDEO_STREAM_USER     "video_stream_user"    // int
@@ -92,6 +92,7 @@
 #define BG_PLUGIN_HANDLES_OVERLAYS   (1<<23)  //!< Plugin compresses overlays
 
 #define BG_PLUGIN_UNSUPPORTED     (1<<25)  //!< Plugin is not supported. Only for a foreign API plugins
+#define BG_PLUGIN_THREADED_ENCODING (1<<26) //!< Encoder: Frame sinks of different streams can be used concurrently. Writing to the file is serialized by the plugin
 
 
 #define BG_PLUGIN_ALL 0xFFFFFFFF //!< Mask of all possible plugin flags
@@ -99,7 +100,7 @@
 /** @}
  */
 
-#define BG_PLUGIN_API_VERSION 48
+#define BG_PLUGIN_API_VERSION 49
 
 /* Include this into all plugin modules exactly once
    to let the plugin loader obtain the API version */
@@ -1012,6 +1013,19 @@ struct bg_image_reader_plugin_s
    *  and the plugin is reset.
    */
   int (*read_image)(void * priv, gavl_video_frame_t * frame);
+
+  /** \brief Set the maximum size needed by the caller (optional)
+   *  \param priv The handle returned by the create() method
+   *  \param max_width Maximum width or 0
+   *  \param max_height Maximum height or 0
+   *
+   *  Must be called before \ref read_header(). Images larger than
+   *  max_width x max_height can then be decoded at a reduced resolution,
+   *  which is still larger than max_width x max_height. The format returned by
+   *  \ref read_header() is the one of the reduced image. Readers which can't
+   *  do this cheaply should leave this NULL.
+   */
+  void (*set_max_size)(void * priv, int max_width, int max_height);
   };
 
 /**  
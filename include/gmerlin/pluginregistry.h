@@ -591,6 +591,27 @@ gavl_video_frame_t * bg_plugin_registry_load_image(bg_plugin_registry_t * reg,
                                                    gavl_video_format_t * format,
                                                    gavl_dictionary_t * m);
 
+/** \ingroup plugin_registry
+ *  \brief Load an image for downscaling
+ *  \param reg A plugin registry
+ *  \param filename Image filename
+ *  \param format Returns format of the image
+ *  \param m Returns metadata
+ *  \param max_width Width of the largest downscaled image you'll need
+ *  \param max_height Height of the largest downscaled image you'll need
+ *  \returns The frame, which contains the image
+ *
+ *  Like \ref bg_plugin_registry_load_image but the image can be delivered
+ *  at a reduced resolution, if the reader supports this. It will still be
+ *  larger than max_width x max_height if the original was.
+ */
+
+gavl_video_frame_t * bg_plugin_registry_load_image_max(bg_plugin_registry_t * reg,
+                                                       const char * filename,
+                                                       gavl_video_format_t * format,
+                                                       gavl_dictionary_t * m,
+                                                       int max_width, int max_height);
+
 gavl_video_frame_t *
 bg_plugin_registry_load_image_convert(bg_plugin_registry_t * r,
                                       const char * filename,
@@ -25,10 +25,14 @@
  *   Ringbuffer
  *
  *   - One writer thread
- *   - Multiple reader threads
+ *   - Multiple reader threads, each one having its own sequence number
+ *     as read cursor.
  * 
- *   - Reader threads block when no data is available
+ *   - Reads return zero when no data is available
  *
+ *   - Readers can access the data without copying (bg_ring_buffer_read_ref()).
+ *     The element is kept until it's released, even if the writer overwrote
+ *     it in the meantime.
  */
 
 #ifndef BG_RINGBUFFER_H_INCLUDED
@@ -37,10 +41,11 @@
 /* Overwrite the buffer if the reader was too slow */
 #define BG_RINGBUFFER_OVERWRITE     (1<<0)
 
-/* Only one reader. */
+/* Only one reader. Not needed anymore, multiple readers are always supported */
 #define BG_RINGBUFFER_SINGLE_READER (1<<1)
 
 typedef struct bg_ring_buffer_s bg_ring_buffer_t;
+typedef struct bg_ring_buffer_ref_s bg_ring_buffer_ref_t;
 
 typedef void * (*bg_ring_buffer_alloc_func)(void * priv);
 typedef void (*bg_ring_buffer_free_func)(void * priv, void * buffer);
@@ -62,6 +67,15 @@ void bg_ring_buffer_write(bg_ring_buffer_t * buf, const void * data);
    
 int bg_ring_buffer_read(bg_ring_buffer_t * buf, void * data, int64_t * seqno);
 
+/* Same as above but return the data without copying. Returns NULL
+   if no data is available. Pass the returned reference to bg_ring_buffer_unref()
+   when you are done with the data. */
+
+const void * bg_ring_buffer_read_ref(bg_ring_buffer_t * buf, int64_t * seqno,
+                                     bg_ring_buffer_ref_t ** ref);
+
+void bg_ring_buffer_unref(bg_ring_buffer_t * buf, bg_ring_buffer_ref_t * ref);
+
 bg_ring_buffer_t * bg_ring_buffer_create_audio(int num_elements,
                                                gavl_audio_format_t * fmt,
                                                int flags);
@@ -71,6 +71,13 @@ xmlNodePtr bg_track_to_didl(xmlDocPtr ret, const gavl_dictionary_t * track, char
 
 char ** bg_didl_create_filter(const char * Filter);
 
+/* Convert SearchCriteria into a query for BG_FUNC_DB_SEARCH.
+   Returns 0 if the criteria are invalid or unsupported */
+int bg_didl_parse_search_criteria(const char * str, gavl_dictionary_t * ret);
+
+/* Convert SortCriteria into a sort array for BG_FUNC_DB_SEARCH */
+int bg_didl_parse_sort_criteria(const char * str, gavl_array_t * ret);
+
 
 // char * bg_didl_get_location(xmlNodePtr didl, gavl_time_t * duration);
 
@@ -38,6 +38,9 @@ void bg_upnp_event_context_server_set_value(gavl_dictionary_t * dict, const char
 
 const char * bg_upnp_event_context_server_get_value(const gavl_dictionary_t * dict, const char * name);
 
+/* Like above but returns a copy. Use this from the http handlers */
+char * bg_upnp_event_context_server_get_value_dup(const gavl_dictionary_t * dict, const char * name);
+
 /* Send moderate events */
 
 int bg_upnp_event_context_server_update(gavl_dictionary_t * dict);
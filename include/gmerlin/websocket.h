@@ -49,6 +49,10 @@ char * bg_websocket_make_path(const char * klass);
    bg_websocket_context_iteration() regularly to actually send the events to the clients. 
 */
 
+/* Messages are exchanged as JSON text frames (subprotocol "json") or
+   as binary frames encoded with bg_msg_to_buffer() (subprotocol "gmerlin-bin").
+   The server takes the first subprotocol offered by the client, which it supports. */
+
 /* If srv or path are NULL, you need to call bg_websocket_context_handle_request
    from your own http handler */
 bg_websocket_context_t *
@@ -66,6 +70,17 @@ void bg_websocket_context_destroy(bg_websocket_context_t * ctx);
 
 int bg_websocket_context_num_clients(bg_websocket_context_t * ctx);
 
+/* permessage-deflate (RFC 7692) is negotiated if the client offers it and
+   enable is nonzero. Messages smaller than 256 bytes are sent uncompressed.
+   Without server context takeover, less memory is needed and broadcasts are
+   compressed only once for all clients, at the expense of a worse compression ratio.
+   Without client context takeover, the clients need less memory.
+   Default is enabled with context takeover on both sides.
+   Affects only connections established afterwards. */
+
+void bg_websocket_context_set_compression(bg_websocket_context_t * ctx, int enable,
+                                          int server_takeover, int client_takeover);
+
 /* Connection (client) */
 
 bg_websocket_connection_t *
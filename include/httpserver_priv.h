@@ -42,22 +42,39 @@ typedef struct
   void * data;
   } http_handler_t;
 
+/* Streaming client, handled by the client thread pool */
+
 typedef struct client_thread_s
   {
   bg_http_connection_t conn;
 
   void * priv;
-  pthread_t th;
 
   void (*cleanup)(void * priv);
   void (*thread_func)(bg_http_connection_t * conn, void * priv);
-
-  int stopped;
-  pthread_mutex_t stopped_mutex;
+  int (*chunk_func)(bg_http_connection_t * conn, void * priv);
+  
+  struct client_thread_s * next;
+  struct client_thread_s * prev;
   } client_thread_t;
 
 #define NUM_HEADERS 16
 
+/* Connections handled by the front end: Either idle (keep-alive) or
+   waiting for the rest of the request header */
+
+#define CONN_READ_HEADER 0
+#define CONN_IDLE        1
+
+typedef struct
+  {
+  int fd;
+  int state;
+  int idx;
+  gavl_time_t last_active;
+  gavl_buffer_t buf;
+  } http_conn_t;
+
 typedef struct
   {
   char * uri;
@@ -67,16 +84,28 @@ typedef struct
 
 struct bg_http_server_s
   {
-  bg_http_connection_t req; // Used for all requests
-
   /* Config stuff */
   int max_ka_sockets;
+  int num_workers;
   int port;
   char * bind_addr;
   
-  /* */
-
-  bg_http_keepalive_t * ka;
+  /* Front end */
+  int efd;
+  http_conn_t ** conns;
+  int num_conns;
+  int conns_alloc;
+  pthread_mutex_t conns_mutex;
+  gavl_time_t last_check;
+  
+  /* Complete requests waiting for a worker */
+  pthread_t * workers;
+  bg_http_connection_t * jobs;
+  int jobs_start;
+  int num_jobs;
+  int jobs_quit;
+  pthread_mutex_t jobs_mutex;
+  pthread_cond_t jobs_cond;
 
   gavl_socket_address_t * addr;
   gavl_socket_address_t * remote_addr;
@@ -89,7 +118,7 @@ struct bg_http_server_s
   http_handler_t * handlers;
   int num_handlers;
   int handlers_alloc;
-  pthread_mutex_t handlers_mutex;
+  pthread_rwlock_t handlers_lock;
   
   const char * server_string;
 
@@ -98,17 +127,31 @@ struct bg_http_server_s
 
   bg_media_dirs_t * dirs;
 
-  /* Client threads */
+  /* Client thread pool */
+  int max_client_threads;
+  pthread_t * client_threads;
+  int num_client_threads;
+  
+  client_thread_t * clients_first; // Queue
+  client_thread_t * clients_last;
+  client_thread_t * clients_waiting_first;
+  int clients_active;
+  int clients_queued;
+  int clients_waiting;
+  int clients_rejected;
+  int clients_quit;
   
-  client_thread_t ** threads;
-  int threads_alloc;
-  int num_threads;
-
   pthread_mutex_t threads_mutex;
+  pthread_cond_t threads_cond;
+
+  /* Chunked clients waiting for their socket to become writable */
+  int wfd;
   bg_mdb_t * mdb;
 
+  /* Cached file headers (most recently used first) */
   header_t headers[NUM_HEADERS];
   int num_headers;
+  pthread_mutex_t headers_mutex;
 
   bg_http_playlist_handler_t * playlist_handler;
   
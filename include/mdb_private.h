@@ -136,6 +136,9 @@ void bg_mdb_create_recorder(bg_mdb_backend_t * b);
 /* mdb_thumbnail.c */
 
 void bg_mdb_init_thumbnails(bg_mdb_t * mdb);
+
+/* Join the thumbnailer threads. Must be called before the mdb goes away */
+void bg_mdb_stop_thumbnails(bg_mdb_t * mdb);
 void bg_mdb_cleanup_thumbnails(bg_mdb_t * mdb);
 void bg_mdb_clear_thumbnail_uris(gavl_dictionary_t * track);
 
@@ -143,7 +146,20 @@ void bg_mdb_clear_thumbnail_uris(gavl_dictionary_t * track);
 // void bg_mdb_create_thumbnails(bg_mdb_t * mdb, gavl_dictionary_t * track);
 
 /* New version */
-void bg_mdb_make_thumbnails(bg_mdb_t * mdb, const char * filename);
+
+#define BG_MDB_THUMBNAIL_PRIORITY_LOW    0 // Library scans
+#define BG_MDB_THUMBNAIL_PRIORITY_NORMAL 1
+#define BG_MDB_THUMBNAIL_PRIORITY_HIGH   2 // Objects, which are browsed right now
+#define BG_MDB_THUMBNAIL_NUM_PRIORITIES  3
+
+typedef struct bg_mdb_thumbnailer_s bg_mdb_thumbnailer_t;
+
+/* Create the thumbnails in the background */
+void bg_mdb_queue_thumbnails(bg_mdb_t * mdb, const char * filename, int priority);
+
+/* Create the thumbnails and return after they are in the database.
+   Returns 0 if the thumbnailer is shutting down */
+int bg_mdb_make_thumbnails(bg_mdb_t * mdb, const char * filename);
 void bg_mdb_purge_thumbnails(bg_mdb_t * mdb);
 
 
@@ -212,6 +228,7 @@ struct bg_mdb_s
   {
   sqlite3 * thumbnail_db;
   pthread_mutex_t thumbnail_mutex;
+  bg_mdb_thumbnailer_t * thumbnailer;
   
   gavl_timer_t * timer;
 
@@ -305,5 +322,27 @@ int bg_mdb_fs_cache_put(bg_mdb_fs_cache_t * c, const char * filename,
                         time_t mtime, const gavl_dictionary_t * m);
 
 
+/* Filesystem watcher (inotify). bg_fs_watch_create() returns NULL if
+   not supported */
+
+#define BG_FS_WATCH_CHANGED 1 // File or directory was created or changed
+#define BG_FS_WATCH_DELETED 2 // File or directory was removed
+
+typedef struct bg_fs_watch_s bg_fs_watch_t;
+
+bg_fs_watch_t * bg_fs_watch_create();
+void bg_fs_watch_destroy(bg_fs_watch_t * w);
+
+int bg_fs_watch_add(bg_fs_watch_t * w, const char * dir, int recursive);
+void bg_fs_watch_remove(bg_fs_watch_t * w, const char * dir);
+
+/* Get the changed paths (path -> BG_FS_WATCH_* flags) after a burst
+   of events settled. Returns 1 if ret was filled, 0 if there is nothing
+   to do and -1 if events were lost and a full rescan is needed */
+
+int bg_fs_watch_get_changes(bg_fs_watch_t * w, gavl_dictionary_t * ret);
+
+/* Apply filesystem changes to the cache. Returns number of changes */
+int bg_mdb_fs_cache_ping(bg_mdb_fs_cache_t * c);
 
 #endif // MDB_PRIVATE_H_INCLUDED
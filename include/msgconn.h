@@ -31,9 +31,18 @@ typedef struct
   } msg_buf_t;
 
 
+/* Circular buffer */
 typedef struct
   {
-  msg_buf_t queue;
+  gavl_msg_t ** buf;
+  int start;
+  int len;
+  int alloc;
+  } msg_ring_t;
+
+typedef struct
+  {
+  msg_ring_t queue;
   msg_buf_t pool;
 
   } msg_queue_t;
@@ -69,6 +78,12 @@ struct bg_msg_sink_s
   pthread_mutex_t rm;          // routing table mutex
   pthread_mutex_t write_mutex; // Write active mutex
   //  pthread_mutex_t queue_mutex; // Queue mutex
+
+  /* Readable while messages are queued. Created on demand by bg_msg_sink_get_fd().
+     For eventfd, both are the same. */
+  int wakeup_fd_read;
+  int wakeup_fd_write;
+  int wakeup_signalled;
   };
 
 int bg_msg_routing_table_get(bg_msg_sink_t * sink, const char * id);
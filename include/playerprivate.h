@@ -157,6 +157,34 @@ typedef struct
 
   } bg_player_subtitle_stream_t;
 
+/* Decode-ahead queue for video frames */
+
+#define BG_PLAYER_VIDEO_QUEUE_SIZE   4 // Maximum number of decoded frames waiting
+#define BG_PLAYER_VIDEO_QUEUE_FRAMES (BG_PLAYER_VIDEO_QUEUE_SIZE+1) // + the one being shown
+
+typedef struct
+  {
+  int active; // 0 if frames are read synchronously in the output thread
+
+  gavl_video_frame_t * frames[BG_PLAYER_VIDEO_QUEUE_FRAMES];
+
+  gavl_video_frame_t * free[BG_PLAYER_VIDEO_QUEUE_FRAMES];
+  int num_free;
+
+  gavl_video_frame_t * ready[BG_PLAYER_VIDEO_QUEUE_FRAMES];
+  int ready_start;
+  int num_ready;
+
+  int eof;
+
+  /* Decoding time since the last statistics update */
+  gavl_time_t decode_time;
+  int decode_frames;
+  
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;
+  } bg_player_video_queue_t;
+
 typedef struct
   {
   bg_video_filter_chain_t * fc;
@@ -196,9 +224,15 @@ typedef struct
 
   bg_thread_t * th;
 
+  /* Decoder thread */
+  bg_thread_t * decode_th;
+  bg_player_video_queue_t q;
+  
   int64_t skip;
   int64_t last_frame_time;
 
+  int64_t frames_dropped;
+
   int do_skip;
   
   gavl_video_source_t * in_src_int;
@@ -284,7 +318,7 @@ typedef struct
 
 /* The player */
 
-#define PLAYER_MAX_THREADS 2
+#define PLAYER_MAX_THREADS 3
 
 #define SRC_HAS_TRACK    (1<<0)
 
@@ -546,6 +580,10 @@ int bg_player_ov_init(bg_player_video_stream_t * vs);
 void bg_player_ov_cleanup(bg_player_video_stream_t * ctx);
 void * bg_player_ov_thread(void *);
 
+/* Decode ahead if the frames can be buffered */
+void bg_player_ov_init_queue(bg_player_t * p);
+void * bg_player_ov_decode_thread(void *);
+
 /* Update still image: To be called during pause */
 void bg_player_ov_update_still(bg_player_t * p);
 void bg_player_ov_handle_events(bg_player_video_stream_t * s);
@@ -27,9 +27,11 @@
 #include <stdio.h>
 
 #include <gavl/gavl.h>
+#include <gavl/numptr.h>
 
 #include <gmerlin/parameter.h>
 #include <gmerlin/bggavl.h>
+#include <gmerlin/bgmsg.h>
 #include <gmerlin/xmlutils.h>
 #include <gmerlin/utils.h>
 #include <gmerlin/http.h>
@@ -1920,3 +1922,436 @@ gavl_dictionary_t * bg_track_get_config_nc(gavl_dictionary_t * track, const char
   ret = gavl_dictionary_get_dictionary_create(ret, tag);
   return ret;
   }
+
+/* Binary interface */
+
+/* All numbers are little endian */
+
+static void write_u32(gavl_buffer_t * buf, uint32_t val)
+  {
+  uint8_t data[4];
+  GAVL_32LE_2_PTR(val, data);
+  gavl_buffer_append_data(buf, data, 4);
+  }
+
+static void write_u64(gavl_buffer_t * buf, uint64_t val)
+  {
+  uint8_t data[8];
+  GAVL_64LE_2_PTR(val, data);
+  gavl_buffer_append_data(buf, data, 8);
+  }
+
+static void write_doubles(gavl_buffer_t * buf, const double * val, int num)
+  {
+  int i;
+  union
+    {
+    double d;
+    uint64_t i;
+    } u;
+
+  for(i = 0; i < num; i++)
+    {
+    u.d = val[i];
+    write_u64(buf, u.i);
+    }
+  }
+
+static void write_string(gavl_buffer_t * buf, const char * str)
+  {
+  uint32_t len;
+  
+  if(!str)
+    {
+    write_u32(buf, 0xFFFFFFFF);
+    return;
+    }
+  len = strlen(str);
+  write_u32(buf, len);
+  gavl_buffer_append_data(buf, (const uint8_t*)str, len);
+  }
+
+static void dictionary_to_buffer(const gavl_dictionary_t * dict, gavl_buffer_t * buf)
+  {
+  int i;
+  write_u32(buf, dict->num_entries);
+  
+  for(i = 0; i < dict->num_entries; i++)
+    {
+    write_string(buf, dict->entries[i].name);
+    bg_value_to_buffer(&dict->entries[i].v, buf);
+    }
+  }
+
+void bg_value_to_buffer(const gavl_value_t * v, gavl_buffer_t * buf)
+  {
+  uint8_t type = v->type;
+  gavl_buffer_append_data(buf, &type, 1);
+  
+  switch(v->type)
+    {
+    case GAVL_TYPE_UNDEFINED:
+      break;
+    case GAVL_TYPE_INT:
+      write_u32(buf, v->v.i);
+      break;
+    case GAVL_TYPE_LONG:
+      write_u64(buf, v->v.l);
+      break;
+    case GAVL_TYPE_FLOAT:
+      write_doubles(buf, &v->v.d, 1);
+      break;
+    case GAVL_TYPE_STRING:
+      write_string(buf, v->v.str);
+      break;
+    case GAVL_TYPE_BINARY:
+      write_u32(buf, v->v.buffer->len);
+      gavl_buffer_append_data(buf, v->v.buffer->buf, v->v.buffer->len);
+      break;
+    case GAVL_TYPE_AUDIOFORMAT:
+      {
+      gavl_dictionary_t dict;
+      gavl_dictionary_init(&dict);
+      gavl_audio_format_to_dictionary(v->v.audioformat, &dict);
+      dictionary_to_buffer(&dict, buf);
+      gavl_dictionary_free(&dict);
+      }
+      break;
+    case GAVL_TYPE_VIDEOFORMAT:
+      {
+      gavl_dictionary_t dict;
+      gavl_dictionary_init(&dict);
+      gavl_video_format_to_dictionary(v->v.videoformat, &dict);
+      dictionary_to_buffer(&dict, buf);
+      gavl_dictionary_free(&dict);
+      }
+      break;
+    case GAVL_TYPE_COLOR_RGB:
+      write_doubles(buf, v->v.color, 3);
+      break;
+    case GAVL_TYPE_COLOR_RGBA:
+      write_doubles(buf, v->v.color, 4);
+      break;
+    case GAVL_TYPE_POSITION:
+      write_doubles(buf, v->v.position, 2);
+      break;
+    case GAVL_TYPE_DICTIONARY:
+      dictionary_to_buffer(v->v.dictionary, buf);
+      break;
+    case GAVL_TYPE_ARRAY:
+      {
+      int i;
+      write_u32(buf, v->v.array->num_entries);
+      for(i = 0; i < v->v.array->num_entries; i++)
+        bg_value_to_buffer(&v->v.array->entries[i], buf);
+      }
+      break;
+    }
+  }
+
+static int read_data(const uint8_t * data, int len, int * pos, void * ret, int bytes)
+  {
+  if(*pos + bytes > len)
+    return 0;
+  memcpy(ret, data + *pos, bytes);
+  *pos += bytes;
+  return 1;
+  }
+
+static int read_u32(const uint8_t * data, int len, int * pos, uint32_t * ret)
+  {
+  if(*pos + 4 > len)
+    return 0;
+  *ret = GAVL_PTR_2_32LE(data + *pos);
+  *pos += 4;
+  return 1;
+  }
+
+static int read_u64(const uint8_t * data, int len, int * pos, uint64_t * ret)
+  {
+  if(*pos + 8 > len)
+    return 0;
+  *ret = GAVL_PTR_2_64LE(data + *pos);
+  *pos += 8;
+  return 1;
+  }
+
+static int read_doubles(const uint8_t * data, int len, int * pos, double * ret, int num)
+  {
+  int i;
+  union
+    {
+    double d;
+    uint64_t i;
+    } u;
+
+  for(i = 0; i < num; i++)
+    {
+    if(!read_u64(data, len, pos, &u.i))
+      return 0;
+    ret[i] = u.d;
+    }
+  return 1;
+  }
+
+static int read_string(const uint8_t * data, int len, int * pos, char ** ret)
+  {
+  uint32_t str_len;
+
+  if(!read_u32(data, len, pos, &str_len))
+    return 0;
+
+  if(str_len == 0xFFFFFFFF)
+    {
+    *ret = NULL;
+    return 1;
+    }
+  
+  if(str_len > len - *pos)
+    return 0;
+
+  *ret = gavl_strndup((const char*)data + *pos, (const char*)data + *pos + str_len);
+  *pos += str_len;
+  return 1;
+  }
+
+/* The buffers can come from the network, so we limit the nesting depth
+   to keep the recursion off the stack limit */
+
+#define BUFFER_MAX_DEPTH 64
+
+static int value_from_buffer(gavl_value_t * v, const uint8_t * data, int len, int * pos, int depth);
+
+static int dictionary_from_buffer(gavl_dictionary_t * dict, const uint8_t * data, int len, int * pos,
+                                  int depth)
+  {
+  uint32_t i, num;
+  char * name;
+  gavl_value_t val;
+  
+  if(!read_u32(data, len, pos, &num))
+    return 0;
+
+  for(i = 0; i < num; i++)
+    {
+    if(!read_string(data, len, pos, &name) || !name)
+      return 0;
+
+    gavl_value_init(&val);
+    
+    if(!value_from_buffer(&val, data, len, pos, depth))
+      {
+      gavl_value_free(&val);
+      free(name);
+      return 0;
+      }
+    gavl_dictionary_set_nocopy(dict, name, &val);
+    free(name);
+    }
+  return 1;
+  }
+
+static int type_valid(uint8_t type)
+  {
+  switch(type)
+    {
+    case GAVL_TYPE_UNDEFINED:
+    case GAVL_TYPE_INT:
+    case GAVL_TYPE_LONG:
+    case GAVL_TYPE_FLOAT:
+    case GAVL_TYPE_STRING:
+    case GAVL_TYPE_BINARY:
+    case GAVL_TYPE_AUDIOFORMAT:
+    case GAVL_TYPE_VIDEOFORMAT:
+    case GAVL_TYPE_COLOR_RGB:
+    case GAVL_TYPE_COLOR_RGBA:
+    case GAVL_TYPE_POSITION:
+    case GAVL_TYPE_DICTIONARY:
+    case GAVL_TYPE_ARRAY:
+      return 1;
+    }
+  return 0;
+  }
+
+static int value_from_buffer(gavl_value_t * v, const uint8_t * data, int len, int * pos, int depth)
+  {
+  uint8_t type;
+
+  if(!read_data(data, len, pos, &type, 1))
+    return 0;
+
+  if(!type_valid(type))
+    {
+    gavl_log(GAVL_LOG_ERROR, LOG_DOMAIN, "Unknown value type %d in buffer", type);
+    return 0;
+    }
+  
+  if(depth >= BUFFER_MAX_DEPTH)
+    {
+    gavl_log(GAVL_LOG_ERROR, LOG_DOMAIN, "Values in buffer nested too deeply");
+    return 0;
+    }
+  
+  gavl_value_set_type(v, type);
+  
+  switch(v->type)
+    {
+    case GAVL_TYPE_UNDEFINED:
+      break;
+    case GAVL_TYPE_INT:
+      {
+      uint32_t i;
+      if(!read_u32(data, len, pos, &i))
+        return 0;
+      v->v.i = (int32_t)i;
+      }
+      break;
+    case GAVL_TYPE_LONG:
+      {
+      uint64_t l;
+      if(!read_u64(data, len, pos, &l))
+        return 0;
+      v->v.l = (int64_t)l;
+      }
+      break;
+    case GAVL_TYPE_FLOAT:
+      return read_doubles(data, len, pos, &v->v.d, 1);
+    case GAVL_TYPE_STRING:
+      return read_string(data, len, pos, &v->v.str);
+    case GAVL_TYPE_BINARY:
+      {
+      uint32_t buf_len;
+      gavl_buffer_t * buf = gavl_value_get_binary_nc(v);
+
+      if(!read_u32(data, len, pos, &buf_len) ||
+         (buf_len > len - *pos))
+        return 0;
+      gavl_buffer_append_data(buf, data + *pos, buf_len);
+      *pos += buf_len;
+      }
+      break;
+    case GAVL_TYPE_AUDIOFORMAT:
+      {
+      int res = 0;
+      gavl_dictionary_t dict;
+      gavl_dictionary_init(&dict);
+      
+      if(dictionary_from_buffer(&dict, data, len, pos, depth + 1) &&
+         gavl_audio_format_from_dictionary(gavl_value_set_audio_format(v), &dict))
+        res = 1;
+      gavl_dictionary_free(&dict);
+      return res;
+      }
+    case GAVL_TYPE_VIDEOFORMAT:
+      {
+      int res = 0;
+      gavl_dictionary_t dict;
+      gavl_dictionary_init(&dict);
+      
+      if(dictionary_from_buffer(&dict, data, len, pos, depth + 1) &&
+         gavl_video_format_from_dictionary(gavl_value_set_video_format(v), &dict))
+        res = 1;
+      gavl_dictionary_free(&dict);
+      return res;
+      }
+    case GAVL_TYPE_COLOR_RGB:
+      return read_doubles(data, len, pos, v->v.color, 3);
+    case GAVL_TYPE_COLOR_RGBA:
+      return read_doubles(data, len, pos, v->v.color, 4);
+    case GAVL_TYPE_POSITION:
+      return read_doubles(data, len, pos, v->v.position, 2);
+    case GAVL_TYPE_DICTIONARY:
+      return dictionary_from_buffer(v->v.dictionary, data, len, pos, depth + 1);
+    case GAVL_TYPE_ARRAY:
+      {
+      uint32_t i, num;
+      gavl_value_t el;
+      gavl_array_t * arr = v->v.array;
+      
+      if(!read_u32(data, len, pos, &num))
+        return 0;
+
+      for(i = 0; i < num; i++)
+        {
+        gavl_value_init(&el);
+        if(!value_from_buffer(&el, data, len, pos, depth + 1))
+          {
+          gavl_value_free(&el);
+          return 0;
+          }
+        gavl_array_splice_val_nocopy(arr, -1, 0, &el);
+        }
+      }
+      break;
+    default:
+      return 0;
+    }
+  return 1;
+  }
+
+int bg_value_from_buffer(gavl_value_t * v, const uint8_t * data, int len)
+  {
+  int pos = 0;
+  
+  if(!value_from_buffer(v, data, len, &pos, 0) || (pos != len))
+    {
+    gavl_value_reset(v);
+    return 0;
+    }
+  return 1;
+  }
+
+/* A message is written like an array value. The first element is
+   the header, the others are the arguments. */
+
+void bg_msg_to_buffer(const gavl_msg_t * msg, gavl_buffer_t * buf)
+  {
+  int i;
+  uint8_t type;
+
+  type = GAVL_TYPE_ARRAY;
+  gavl_buffer_append_data(buf, &type, 1);
+  write_u32(buf, msg->num_args + 1);
+
+  type = GAVL_TYPE_DICTIONARY;
+  gavl_buffer_append_data(buf, &type, 1);
+  dictionary_to_buffer(&msg->header, buf);
+
+  for(i = 0; i < msg->num_args; i++)
+    bg_value_to_buffer(&msg->args[i], buf);
+  }
+
+int bg_msg_from_buffer(gavl_msg_t * msg, const uint8_t * data, int len)
+  {
+  int i;
+  int ret = 0;
+  gavl_value_t val;
+  gavl_array_t * arr;
+  gavl_dictionary_t * header;
+  
+  gavl_value_init(&val);
+
+  if(!bg_value_from_buffer(&val, data, len) ||
+     !(arr = gavl_value_get_array_nc(&val)) ||
+     !arr->num_entries ||
+     (arr->num_entries - 1 > GAVL_MSG_MAX_ARGS) ||
+     !(header = gavl_value_get_dictionary_nc(&arr->entries[0])))
+    {
+    gavl_log(GAVL_LOG_ERROR, LOG_DOMAIN, "Invalid binary message (%d bytes)", len);
+    goto fail;
+    }
+
+  gavl_msg_free(msg);
+  gavl_dictionary_move(&msg->header, header);
+  
+  msg->num_args = arr->num_entries - 1;
+  for(i = 0; i < msg->num_args; i++)
+    gavl_value_move(&msg->args[i], &arr->entries[i+1]);
+
+  gavl_msg_apply_header(msg);
+  ret = 1;
+  
+  fail:
+  gavl_value_free(&val);
+  return ret;
+  }
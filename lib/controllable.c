@@ -109,11 +109,12 @@ static int handle_msg_function(void * data, gavl_msg_t * msg)
     return 1;
   }
 
+#define PING_INTERVAL 20 // ms
+
 int bg_controllable_call_function(bg_controllable_t * c, gavl_msg_t * func,
                                   gavl_handle_msg_func cb, void * data, int timeout)
   {
   int result = 0;
-  gavl_time_t delay_time = GAVL_TIME_SCALE / 50; // 20ms
   bg_control_t ctrl;
   function_context_t ctx;
   gavl_timer_t * timer = gavl_timer_create();
@@ -149,7 +150,20 @@ int bg_controllable_call_function(bg_controllable_t * c, gavl_msg_t * func,
       break;
       }
     if(!bg_msg_sink_get_num(ctrl.evt_sink))
-      gavl_time_delay(&delay_time);
+      {
+      /* Remote controllables need to be pinged regularly */
+      if(c->ping_func)
+        bg_msg_sink_wait(ctrl.evt_sink, PING_INTERVAL);
+      else
+        {
+        /* A negative timeout would wait forever */
+        int remaining = timeout - (gavl_timer_get(timer)*1000) / GAVL_TIME_SCALE + 1;
+
+        if(remaining < 0)
+          remaining = 0;
+        bg_msg_sink_wait(ctrl.evt_sink, remaining);
+        }
+      }
     }
   
   gavl_timer_destroy(timer);
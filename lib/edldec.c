@@ -21,6 +21,8 @@
 
 
 #include <string.h>
+#include <stdlib.h>
+#include <pthread.h>
 
 #include <config.h>
 #include <gavl/metatags.h>
@@ -99,6 +101,14 @@ typedef struct
   int timescale;
   bg_media_source_stream_t * src_s;
   //  gavl_stream_type_t type;  
+
+  /* Source of the next segment, opened and seeked in the background */
+  source_t * prefetch;
+  int prefetch_idx;
+  int prefetch_result;
+  int64_t prefetch_time;
+  gavl_stream_type_t prefetch_type;
+  pthread_t prefetch_th;
   
   } stream_t;
 
@@ -106,7 +116,8 @@ struct edldec_s
   {
   int num_sources;
   source_t * sources;
-
+  pthread_mutex_t sources_mutex; // Protects the slot selection and refcounts
+  
   stream_t * streams;
   int num_streams;
   
@@ -251,6 +262,18 @@ static int segment_from_dictionary(edl_segment_t * seg,
   return 1;
   }
 
+static int compare_segments(const void * p1, const void * p2)
+  {
+  const edl_segment_t * s1 = p1;
+  const edl_segment_t * s2 = p2;
+
+  if(s1->dst_time < s2->dst_time)
+    return -1;
+  if(s1->dst_time > s2->dst_time)
+    return 1;
+  return 0;
+  }
+
 static int stream_init(stream_t * s, gavl_dictionary_t * es,
                        struct edldec_s * dec)
   {
@@ -278,6 +301,16 @@ static int stream_init(stream_t * s, gavl_dictionary_t * es,
           return 0;
         }
       }
+
+    /* The segment lookup needs them ordered by destination time */
+    for(i = 1; i < s->num_segs; i++)
+      {
+      if(s->segs[i].dst_time < s->segs[i-1].dst_time)
+        {
+        qsort(s->segs, s->num_segs, sizeof(*s->segs), compare_segments);
+        break;
+        }
+      }
     }
 
   dict = gavl_stream_get_metadata(es);
@@ -290,8 +323,11 @@ static int stream_init(stream_t * s, gavl_dictionary_t * es,
   return 1;
   }
 
+static void prefetch_cancel(stream_t * s);
+
 static void stream_cleanup(stream_t * s)
   {
+  prefetch_cancel(s);
   free_segments(s->segs, s->num_segs);
   }
 
@@ -303,18 +339,26 @@ edl_dst_time_to_src(edldec_t * dec,
                     int64_t * src_time,
                     int64_t * mute_time)
   {
-  int i;
+  int i, end, mid;
   const edl_segment_t * seg = NULL;
-  
-  for(i = 0; i < st->num_segs; i++)
+
+  /* Binary search for the first segment ending after dst_time */
+  i = 0;
+  end = st->num_segs;
+
+  while(i < end)
     {
-    if(st->segs[i].dst_time + st->segs[i].dst_duration > dst_time)
-      {
-      seg = &st->segs[i];
-      break;
-      }
+    mid = (i + end) / 2;
+    
+    if(st->segs[mid].dst_time + st->segs[mid].dst_duration > dst_time)
+      end = mid;
+    else
+      i = mid + 1;
     }
 
+  if(i < st->num_segs)
+    seg = &st->segs[i];
+  
   if(!seg) // After the last segment
     {
     gavl_time_t duration = gavl_track_get_duration(dec->ti_cur);
@@ -341,9 +385,10 @@ edl_dst_time_to_src(edldec_t * dec,
   }
 
 
-static source_t * get_source(edldec_t * dec, gavl_stream_type_t type,
-                             const edl_segment_t * seg,
-                             int64_t src_time)
+/* Find a slot for the source of a segment and reference it */
+
+static source_t * acquire_source(edldec_t * dec, gavl_stream_type_t type,
+                                 const edl_segment_t * seg)
   {
   int i;
   source_t * ret = NULL;
@@ -352,18 +397,23 @@ static source_t * get_source(edldec_t * dec, gavl_stream_type_t type,
 
   if(!location)
     location = gavl_dictionary_get_string(&dec->mi, GAVL_META_URI);
+
+  /* Referenced slots might be initialized by a prefetch thread:
+     Check the refcount first */
+  
+  pthread_mutex_lock(&dec->sources_mutex);
   
   /* Find a cached source */
   for(i = 0; i < dec->num_sources; i++)
     {
     source_t * s = dec->sources + i;
 
-    if(s->location &&
+    if(!s->refcount &&
+       s->location &&
        !strcmp(s->location, location) &&
        (s->track == seg->track) &&
        (s->type == type) &&
-       (s->stream == seg->stream) &&
-       !s->refcount)
+       (s->stream == seg->stream))
       ret = s;
     }
   
@@ -373,7 +423,7 @@ static source_t * get_source(edldec_t * dec, gavl_stream_type_t type,
     for(i = 0; i < dec->num_sources; i++)
       {
       source_t * s = dec->sources + i;
-      if(!s->location)
+      if(!s->refcount && !s->location)
         {
         ret = s;
         break;
@@ -396,10 +446,43 @@ static source_t * get_source(edldec_t * dec, gavl_stream_type_t type,
       }
     }
 
+  if(ret)
+    source_ref(ret);
+  
+  pthread_mutex_unlock(&dec->sources_mutex);
+  return ret;
+  }
+
+static void release_source(edldec_t * dec, source_t * s, int cleanup)
+  {
+  pthread_mutex_lock(&dec->sources_mutex);
+  source_unref(s);
+  if(cleanup)
+    source_cleanup(s);
+  pthread_mutex_unlock(&dec->sources_mutex);
+  }
+
+/* Returns a referenced source */
+
+static source_t * get_source(edldec_t * dec, gavl_stream_type_t type,
+                             const edl_segment_t * seg,
+                             int64_t src_time)
+  {
+  source_t * ret;
+
+  if(!(ret = acquire_source(dec, type, seg)))
+    {
+    gavl_log(GAVL_LOG_ERROR, LOG_DOMAIN, "No free source");
+    return NULL;
+    }
+  
   if(!ret->location)
     {
     if(!source_init(ret, dec, seg, type))
+      {
+      release_source(dec, ret, 1);
       return NULL;
+      }
     }
 
   gavl_log(GAVL_LOG_DEBUG, LOG_DOMAIN, "Seeking to %"PRId64, src_time);
@@ -409,6 +492,104 @@ static source_t * get_source(edldec_t * dec, gavl_stream_type_t type,
   return ret;  
   }
 
+/*
+ *  Open and seek the source of the next segment while the current one
+ *  is played, so there is no stall at the cut.
+ */
+
+static void * prefetch_thread(void * data)
+  {
+  stream_t * s = data;
+  const edl_segment_t * seg = &s->segs[s->prefetch_idx];
+  
+  if(!s->prefetch->location &&
+     !source_init(s->prefetch, s->dec, seg, s->prefetch_type))
+    return NULL;
+  
+  bg_input_plugin_seek(s->prefetch->h, s->prefetch_time, seg->timescale);
+  s->prefetch_result = 1;
+  return NULL;
+  }
+
+static void prefetch_start(stream_t * s, gavl_stream_type_t type)
+  {
+  int idx = s->seg_idx + 1;
+
+  if(s->prefetch || (idx >= s->num_segs))
+    return;
+
+  /* No free slot: Open it when we get there */
+  if(!(s->prefetch = acquire_source(s->dec, type, &s->segs[idx])))
+    return;
+  
+  s->prefetch_idx    = idx;
+  s->prefetch_type   = type;
+  s->prefetch_time   = s->segs[idx].src_time;
+  s->prefetch_result = 0;
+  
+  pthread_create(&s->prefetch_th, NULL, prefetch_thread, s);
+  }
+
+static void prefetch_cancel(stream_t * s)
+  {
+  if(!s->prefetch)
+    return;
+
+  pthread_join(s->prefetch_th, NULL);
+
+  /* Keep successfully opened sources for later */
+  release_source(s->dec, s->prefetch, !s->prefetch_result);
+  s->prefetch = NULL;
+  }
+
+/* Get the prefetched source if it's the right one */
+
+static source_t * prefetch_finish(stream_t * s, int64_t src_time)
+  {
+  source_t * ret;
+  
+  if(!s->prefetch)
+    return NULL;
+
+  if(s->prefetch_idx != s->seg_idx)
+    {
+    prefetch_cancel(s);
+    return NULL;
+    }
+
+  pthread_join(s->prefetch_th, NULL);
+  ret = s->prefetch;
+  s->prefetch = NULL;
+
+  if(!s->prefetch_result)
+    {
+    release_source(s->dec, ret, 1);
+    return NULL;
+    }
+  
+  if(s->prefetch_time != src_time)
+    bg_input_plugin_seek(ret->h, src_time, s->segs[s->seg_idx].timescale);
+  
+  return ret;
+  }
+
+static source_t * stream_get_source(stream_t * s, gavl_stream_type_t type,
+                                    int64_t src_time)
+  {
+  if(s->src)
+    {
+    release_source(s->dec, s->src, 0);
+    s->src = NULL;
+    }
+
+  if(!(s->src = prefetch_finish(s, src_time)) &&
+     !(s->src = get_source(s->dec, type, &s->segs[s->seg_idx], src_time)))
+    return NULL;
+  
+  prefetch_start(s, type);
+  return s->src;
+  }
+
 static bg_media_source_t * get_src_edl(void * priv)
   {
   edldec_t * ed = priv;
@@ -477,9 +658,6 @@ static int set_track_edl(void * priv, int track)
   {
   int i;
   edldec_t * ed = priv;
-  /* Reset sources */
-  for(i = 0; i < ed->num_sources; i++)
-    ed->sources[i].refcount = 0;
   
   /* Clean up earlier streams */
   if(ed->ti_cur)
@@ -488,6 +666,10 @@ static int set_track_edl(void * priv, int track)
     bg_media_source_cleanup(&ed->src);
     bg_media_source_init(&ed->src);
     }
+
+  /* Reset sources */
+  for(i = 0; i < ed->num_sources; i++)
+    ed->sources[i].refcount = 0;
   ed->ti_cur = gavl_get_track_nc(&ed->mi, track);
 
   if(!streams_create(ed))
@@ -512,6 +694,7 @@ static void destroy_edl(void * priv)
     }
 
   bg_media_source_cleanup(&ed->src);
+  pthread_mutex_destroy(&ed->sources_mutex);
   
   gavl_dictionary_free(&ed->mi);
 
@@ -523,52 +706,33 @@ static void destroy_edl(void * priv)
 static gavl_audio_source_t * get_audio_source(stream_t * s,
                                               int64_t src_time)
   {
-  const edl_segment_t * seg = &s->segs[s->seg_idx];
-    
-  if(s->src)
-    source_unref(s->src);
-  if(!(s->src = get_source(s->dec, GAVL_STREAM_AUDIO, seg, src_time)))
+  if(!stream_get_source(s, GAVL_STREAM_AUDIO, src_time))
     return NULL;
-  source_ref(s->src);
-  return bg_media_source_get_audio_source((s->src)->h->src, seg->stream);
+  return bg_media_source_get_audio_source((s->src)->h->src, s->segs[s->seg_idx].stream);
   }
 
 static gavl_video_source_t * get_video_source(stream_t * s,
                                               int64_t src_time)
   {
-  const edl_segment_t * seg = &s->segs[s->seg_idx];
-  if(s->src)
-    source_unref(s->src);
-  if(!(s->src = get_source(s->dec, GAVL_STREAM_VIDEO, seg, src_time)))
+  if(!stream_get_source(s, GAVL_STREAM_VIDEO, src_time))
     return NULL;
-  source_ref(s->src);
-  
-  return bg_media_source_get_video_source((s->src)->h->src, seg->stream);
+  return bg_media_source_get_video_source((s->src)->h->src, s->segs[s->seg_idx].stream);
   }
 
 static gavl_packet_source_t * get_text_source(stream_t * s,
                                               int64_t src_time)
   {
-  const edl_segment_t * seg = &s->segs[s->seg_idx];
-  if(s->src)
-    source_unref(s->src);
-  if(!(s->src = get_source(s->dec, GAVL_STREAM_TEXT, seg, src_time)))
+  if(!stream_get_source(s, GAVL_STREAM_TEXT, src_time))
     return NULL;
-  source_ref(s->src);
-  return bg_media_source_get_text_source((s->src)->h->src, seg->stream);
+  return bg_media_source_get_text_source((s->src)->h->src, s->segs[s->seg_idx].stream);
   }
 
 static gavl_video_source_t * get_overlay_source(stream_t * s,
                                                 int64_t src_time)
   {
-  const edl_segment_t * seg = &s->segs[s->seg_idx];
-  if(s->src)
-    source_unref(s->src);
-
-  if(!(s->src = get_source(s->dec, GAVL_STREAM_OVERLAY, seg, src_time)))
+  if(!stream_get_source(s, GAVL_STREAM_OVERLAY, src_time))
     return NULL;
-  source_ref(s->src);
-  return bg_media_source_get_overlay_source((s->src)->h->src, seg->stream);
+  return bg_media_source_get_overlay_source((s->src)->h->src, s->segs[s->seg_idx].stream);
   }
 
 /* Check if pts is inside the segment. */
@@ -1333,6 +1497,7 @@ bg_plugin_handle_t * bg_input_plugin_load_edl(const gavl_dictionary_t * edl)
 
   priv->num_sources = max_streams * 2; // We can keep twice as many files open than we have streams
   priv->sources = calloc(priv->num_sources, sizeof(*priv->sources));
+  pthread_mutex_init(&priv->sources_mutex, NULL);
   return ret;
   }
 
@@ -39,6 +39,19 @@
 
 #include <mdb_private.h>
 
+/* Maximum number of watched directories. The least recently used
+   ones are dropped and scanned again when they are accessed */
+#define MAX_SYNCED       1024
+#define SYNCED_HASH_SIZE 1024
+
+typedef struct synced_dir_s
+  {
+  char * path;
+  struct synced_dir_s * prev; // LRU list, most recent first
+  struct synced_dir_s * next;
+  struct synced_dir_s * hnext; // Hash chain
+  } synced_dir_t;
+
 struct bg_mdb_fs_cache_s
   {
   sqlite3 * db;
@@ -54,9 +67,154 @@ struct bg_mdb_fs_cache_s
   char * current_path;
   gavl_array_t current_dir;
   int current_mask;
-  
+
+  /* Directories, which are watched and up to date */
+  bg_fs_watch_t * watch;
+  synced_dir_t * synced_head;
+  synced_dir_t * synced_tail;
+  synced_dir_t * synced_hash[SYNCED_HASH_SIZE];
+  int num_synced;
   };
 
+static int hash_path(const char * path)
+  {
+  uint32_t ret = 5381;
+
+  while(*path)
+    {
+    ret = ret * 33 + (uint8_t)(*path);
+    path++;
+    }
+  return ret & (SYNCED_HASH_SIZE-1);
+  }
+
+static synced_dir_t * synced_find(bg_mdb_fs_cache_t * c, const char * path)
+  {
+  synced_dir_t * d = c->synced_hash[hash_path(path)];
+
+  while(d)
+    {
+    if(!strcmp(d->path, path))
+      return d;
+    d = d->hnext;
+    }
+  return NULL;
+  }
+
+static void synced_unlink(bg_mdb_fs_cache_t * c, synced_dir_t * d)
+  {
+  if(d->prev)
+    d->prev->next = d->next;
+  else
+    c->synced_head = d->next;
+
+  if(d->next)
+    d->next->prev = d->prev;
+  else
+    c->synced_tail = d->prev;
+
+  d->prev = NULL;
+  d->next = NULL;
+  }
+
+static void synced_push_front(bg_mdb_fs_cache_t * c, synced_dir_t * d)
+  {
+  d->prev = NULL;
+  d->next = c->synced_head;
+
+  if(c->synced_head)
+    c->synced_head->prev = d;
+  else
+    c->synced_tail = d;
+  c->synced_head = d;
+  }
+
+static void synced_remove(bg_mdb_fs_cache_t * c, synced_dir_t * d)
+  {
+  synced_dir_t ** ptr = &c->synced_hash[hash_path(d->path)];
+
+  while(*ptr)
+    {
+    if(*ptr == d)
+      {
+      *ptr = d->hnext;
+      break;
+      }
+    ptr = &(*ptr)->hnext;
+    }
+  
+  synced_unlink(c, d);
+  free(d->path);
+  free(d);
+  c->num_synced--;
+  }
+
+static void synced_clear(bg_mdb_fs_cache_t * c)
+  {
+  while(c->synced_head)
+    {
+    if(c->watch)
+      bg_fs_watch_remove(c->watch, c->synced_head->path);
+    synced_remove(c, c->synced_head);
+    }
+  }
+
+/* Remove a directory and its subdirectories */
+
+static void synced_remove_tree(bg_mdb_fs_cache_t * c, const char * path,
+                               void (*func)(bg_mdb_fs_cache_t * c, const char * path))
+  {
+  synced_dir_t * d;
+  synced_dir_t * next;
+  int len = strlen(path);
+
+  d = c->synced_head;
+  
+  while(d)
+    {
+    next = d->next;
+    
+    if(!strncmp(d->path, path, len) &&
+       ((d->path[len] == '\0') || (d->path[len] == '/')))
+      {
+      if(func)
+        func(c, d->path);
+      synced_remove(c, d);
+      }
+    d = next;
+    }
+  }
+
+/* Start watching a directory */
+
+static void synced_add(bg_mdb_fs_cache_t * c, const char * path)
+  {
+  int h;
+  synced_dir_t * d;
+  
+  if(c->num_synced >= MAX_SYNCED)
+    {
+    char * evict = gavl_strdup(c->synced_tail->path);
+    
+    /* The watches of subdirectories are removed as well */
+    bg_fs_watch_remove(c->watch, evict);
+    synced_remove_tree(c, evict, NULL);
+    free(evict);
+    }
+
+  if(!bg_fs_watch_add(c->watch, path, 0))
+    return;
+  
+  d = calloc(1, sizeof(*d));
+  d->path = gavl_strdup(path);
+
+  h = hash_path(path);
+  d->hnext = c->synced_hash[h];
+  c->synced_hash[h] = d;
+
+  synced_push_front(c, d);
+  c->num_synced++;
+  }
 
 #define META_NAME   "name"
 #define META_PARENT "parent"
@@ -101,6 +259,8 @@ bg_mdb_fs_cache_t * bg_mdb_fs_cache_create(const char * path)
     }
   
   bg_sqlite_init_strcoll(c->db);
+
+  c->watch = bg_fs_watch_create();
   
   bg_sqlite_exec(c->db, "CREATE TABLE IF NOT EXISTS files("
                  META_PARENT" TEXT, "
@@ -206,6 +366,15 @@ void bg_mdb_fs_cache_destroy(bg_mdb_fs_cache_t * c)
 
   if(c->db)
     sqlite3_close(c->db);
+
+  synced_clear(c);
+  if(c->watch)
+    bg_fs_watch_destroy(c->watch);
+
+  if(c->current_path)
+    free(c->current_path);
+  gavl_array_free(&c->current_dir);
+  
   free(c);
   }
 
@@ -523,6 +692,7 @@ static int scan_directory(bg_mdb_fs_cache_t * c, const char * path)
   const char * fs_name = NULL;
 
   struct stat st;
+  synced_dir_t * d;
 
   if(stat(path, &st))
     {
@@ -535,6 +705,18 @@ static int scan_directory(bg_mdb_fs_cache_t * c, const char * path)
     /* Multitrack file is already loaded if parent directory is loaded */
     return 1;
     }
+
+  /* Watched directories are kept up to date by bg_mdb_fs_cache_ping() */
+  if((d = synced_find(c, path)))
+    {
+    synced_unlink(c, d);
+    synced_push_front(c, d);
+    return 1;
+    }
+  
+  /* Start watching before scanning so we don't miss changes */
+  if(c->watch)
+    synced_add(c, path);
   
   /* (Re)load directory */
 
@@ -853,3 +1035,93 @@ int bg_mdb_fs_browse_children(bg_mdb_fs_cache_t * c, const char * path,
   
   return 1;
   }
+
+static void delete_children(bg_mdb_fs_cache_t * c, const char * path)
+  {
+  sqlite3_bind_text(c->delete_children, sqlite3_bind_parameter_index(c->delete_children, ":"META_PARENT), path, -1, SQLITE_STATIC);
+  sqlite3_step(c->delete_children);
+  sqlite3_reset(c->delete_children);
+  sqlite3_clear_bindings(c->delete_children);
+  }
+
+/* Forget a directory and its subdirectories */
+
+static void unsync_directory(bg_mdb_fs_cache_t * c, const char * path)
+  {
+  synced_remove_tree(c, path, delete_children);
+  }
+
+static void apply_change(bg_mdb_fs_cache_t * c, const char * path, int flags)
+  {
+  struct stat st;
+  char * parent;
+  const char * pos;
+  
+  if(!(pos = strrchr(path, '/')))
+    return;
+
+  parent = gavl_strndup(path, pos);
+
+  /* Invalidate memory cache */
+  if(c->current_path && !strcmp(c->current_path, parent))
+    {
+    free(c->current_path);
+    c->current_path = NULL;
+    }
+  
+  if((flags & BG_FS_WATCH_DELETED) || stat(path, &st))
+    {
+    delete_from_db(c, path);
+    delete_children(c, path);
+    unsync_directory(c, path);
+    }
+  else if(synced_find(c, parent))
+    {
+    /* Parent is up to date except for this entry */
+    add_to_db(c, path, S_ISDIR(st.st_mode) ? GAVL_META_CLASS_DIRECTORY : GAVL_META_CLASS_LOCATION,
+              st.st_mtime);
+    }
+  
+  free(parent);
+  }
+
+int bg_mdb_fs_cache_ping(bg_mdb_fs_cache_t * c)
+  {
+  int i;
+  int result;
+  gavl_dictionary_t changes;
+  
+  if(!c->watch)
+    return 0;
+
+  gavl_dictionary_init(&changes);
+  
+  result = bg_fs_watch_get_changes(c->watch, &changes);
+
+  if(!result)
+    return 0;
+  
+  if(result < 0)
+    {
+    /* Events got lost: Rescan all directories when they are accessed next time */
+    synced_clear(c);
+    
+    if(c->current_path)
+      {
+      free(c->current_path);
+      c->current_path = NULL;
+      }
+    return 1;
+    }
+  
+  for(i = 0; i < changes.num_entries; i++)
+    {
+    int flags = 0;
+    gavl_value_get_int(&changes.entries[i].v, &flags);
+    apply_change(c, changes.entries[i].name, flags);
+    }
+  
+  result = changes.num_entries;
+  gavl_dictionary_free(&changes);
+  return result;
+  }
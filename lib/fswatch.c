@@ -0,0 +1,428 @@
+/*****************************************************************
+ * gmerlin - a general purpose multimedia framework and applications
+ *
+ * Copyright (c) 2001 - 2024 Members of the Gmerlin project
+ * http://github.com/bplaum
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * *****************************************************************/
+
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <dirent.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include <config.h>
+
+#ifdef HAVE_INOTIFY
+#include <sys/inotify.h>
+#endif
+
+#include <gavl/gavl.h>
+#include <gavl/utils.h>
+#include <gavl/log.h>
+#define LOG_DOMAIN "fswatch"
+
+#include <gmerlin/mdb.h>
+#include <gmerlin/utils.h>
+
+#include <mdb_private.h>
+
+/* Changes are reported after no new event came in for this time */
+#define SETTLE_TIME  (2*GAVL_TIME_SCALE)
+
+/* .. or if the oldest pending change is older than this */
+#define MAX_DELAY    (30*GAVL_TIME_SCALE)
+
+/* Hash table for finding pending changes by path */
+#define HASH_SIZE    1024
+
+#ifdef HAVE_INOTIFY
+
+#define WATCH_MASK (IN_CLOSE_WRITE | IN_CREATE | IN_DELETE | IN_MOVED_FROM | \
+                    IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF | IN_ATTRIB)
+
+typedef struct
+  {
+  int wd;
+  int recursive;
+  int root;      // Added by bg_fs_watch_add()
+  char * path;
+  } watch_t;
+
+typedef struct
+  {
+  char * path;
+  int flags;
+  int hnext; // Next change in the hash chain (index + 1)
+  } change_t;
+
+struct bg_fs_watch_s
+  {
+  int fd;
+
+  watch_t * watches;
+  int num_watches;
+  int watches_alloc;
+
+  change_t * changes;
+  int num_changes;
+  int changes_alloc;
+
+  int hash[HASH_SIZE]; // First change of each hash chain (index + 1)
+
+  int overflow;
+
+  gavl_timer_t * timer;
+  gavl_time_t first_event;
+  gavl_time_t last_event;
+  };
+
+bg_fs_watch_t * bg_fs_watch_create()
+  {
+  bg_fs_watch_t * ret;
+  int fd;
+
+  if((fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC)) < 0)
+    {
+    gavl_log(GAVL_LOG_WARNING, LOG_DOMAIN, "inotify_init1 failed: %s", strerror(errno));
+    return NULL;
+    }
+
+  ret = calloc(1, sizeof(*ret));
+  ret->fd = fd;
+  ret->timer = gavl_timer_create();
+  gavl_timer_start(ret->timer);
+  return ret;
+  }
+
+void bg_fs_watch_destroy(bg_fs_watch_t * w)
+  {
+  int i;
+
+  close(w->fd);
+
+  for(i = 0; i < w->num_watches; i++)
+    free(w->watches[i].path);
+  if(w->watches)
+    free(w->watches);
+
+  for(i = 0; i < w->num_changes; i++)
+    free(w->changes[i].path);
+  if(w->changes)
+    free(w->changes);
+
+  gavl_timer_destroy(w->timer);
+  free(w);
+  }
+
+static watch_t * find_watch_by_wd(bg_fs_watch_t * w, int wd)
+  {
+  int i;
+  for(i = 0; i < w->num_watches; i++)
+    {
+    if(w->watches[i].wd == wd)
+      return &w->watches[i];
+    }
+  return NULL;
+  }
+
+static void delete_watch(bg_fs_watch_t * w, watch_t * watch)
+  {
+  int idx = watch - w->watches;
+
+  free(watch->path);
+  if(idx < w->num_watches - 1)
+    memmove(w->watches + idx, w->watches + idx + 1,
+            (w->num_watches - 1 - idx) * sizeof(*w->watches));
+  w->num_watches--;
+  }
+
+static int add_watch(bg_fs_watch_t * w, const char * dir, int recursive, int root)
+  {
+  int wd;
+  watch_t * watch;
+  DIR * d;
+  struct dirent * dent_ptr;
+  char * filename;
+  struct stat st;
+
+  if((wd = inotify_add_watch(w->fd, dir, WATCH_MASK)) < 0)
+    {
+    gavl_log(GAVL_LOG_WARNING, LOG_DOMAIN, "Cannot watch %s: %s", dir, strerror(errno));
+
+    /* Out of watches: Changes in this directory would get lost,
+       so the caller must rescan everything */
+    if((errno == ENOSPC) || (errno == ENOMEM))
+      w->overflow = 1;
+    return 0;
+    }
+
+  /* The same directory gets the same wd. It might have been moved,
+     so we update the path */
+  if((watch = find_watch_by_wd(w, wd)))
+    {
+    if(strcmp(watch->path, dir))
+      {
+      free(watch->path);
+      watch->path = gavl_strdup(dir);
+      }
+    }
+  else
+    {
+    if(w->num_watches == w->watches_alloc)
+      {
+      w->watches_alloc += 128;
+      w->watches = realloc(w->watches, w->watches_alloc * sizeof(*w->watches));
+      }
+    watch = &w->watches[w->num_watches++];
+    watch->wd = wd;
+    watch->path = gavl_strdup(dir);
+    watch->recursive = 0;
+    watch->root = 0;
+    }
+
+  if(root)
+    watch->root = 1;
+
+  if(!recursive)
+    return 1;
+
+  watch->recursive = 1;
+
+  if(!(d = opendir(dir)))
+    return 1;
+
+  while((dent_ptr = readdir(d)))
+    {
+    if(dent_ptr->d_name[0] == '.')
+      continue;
+
+    filename = gavl_sprintf("%s/%s", dir, dent_ptr->d_name);
+
+    if(!stat(filename, &st) && S_ISDIR(st.st_mode) &&
+       !add_watch(w, filename, 1, 0))
+      {
+      free(filename);
+      closedir(d);
+      return 0;
+      }
+    free(filename);
+    }
+  closedir(d);
+  return 1;
+  }
+
+int bg_fs_watch_add(bg_fs_watch_t * w, const char * dir, int recursive)
+  {
+  return add_watch(w, dir, recursive, 1);
+  }
+
+void bg_fs_watch_remove(bg_fs_watch_t * w, const char * dir)
+  {
+  int i = 0;
+  int len = strlen(dir);
+
+  while(i < w->num_watches)
+    {
+    if(!strncmp(w->watches[i].path, dir, len) &&
+       ((w->watches[i].path[len] == '\0') || (w->watches[i].path[len] == '/')))
+      {
+      inotify_rm_watch(w->fd, w->watches[i].wd);
+      delete_watch(w, &w->watches[i]);
+      }
+    else
+      i++;
+    }
+  }
+
+static int hash_path(const char * path)
+  {
+  uint32_t ret = 5381;
+
+  while(*path)
+    {
+    ret = ret * 33 + (uint8_t)(*path);
+    path++;
+    }
+  return ret & (HASH_SIZE-1);
+  }
+
+/* Collapse multiple events for the same file */
+
+static void add_change(bg_fs_watch_t * w, char * path, int flags)
+  {
+  int idx;
+  int h = hash_path(path);
+  gavl_time_t t = gavl_timer_get(w->timer);
+
+  if(!w->num_changes)
+    w->first_event = t;
+  w->last_event = t;
+
+  idx = w->hash[h];
+  
+  while(idx)
+    {
+    if(!strcmp(w->changes[idx-1].path, path))
+      {
+      /* Latest event wins */
+      w->changes[idx-1].flags = flags;
+      free(path);
+      return;
+      }
+    idx = w->changes[idx-1].hnext;
+    }
+
+  if(w->num_changes == w->changes_alloc)
+    {
+    w->changes_alloc += 128;
+    w->changes = realloc(w->changes, w->changes_alloc * sizeof(*w->changes));
+    }
+
+  w->changes[w->num_changes].path = path;
+  w->changes[w->num_changes].flags = flags;
+  w->changes[w->num_changes].hnext = w->hash[h];
+  w->num_changes++;
+  w->hash[h] = w->num_changes;
+  }
+
+static void clear_changes(bg_fs_watch_t * w)
+  {
+  int i;
+  for(i = 0; i < w->num_changes; i++)
+    free(w->changes[i].path);
+  w->num_changes = 0;
+  memset(w->hash, 0, sizeof(w->hash));
+  }
+
+static void handle_event(bg_fs_watch_t * w, const struct inotify_event * ev)
+  {
+  watch_t * watch;
+  char * path;
+
+  if(ev->mask & IN_Q_OVERFLOW)
+    {
+    gavl_log(GAVL_LOG_WARNING, LOG_DOMAIN, "Event queue overflow");
+    w->overflow = 1;
+    clear_changes(w);
+    return;
+    }
+
+  if(!(watch = find_watch_by_wd(w, ev->wd)))
+    return;
+
+  if(ev->mask & IN_IGNORED)
+    {
+    delete_watch(w, watch);
+    return;
+    }
+
+  if(ev->mask & (IN_DELETE_SELF | IN_MOVE_SELF))
+    {
+    /* Subdirectories are reported by their parent. After a move within the
+       tree, IN_MOVED_TO already updated watch->path to the new location. */
+    if(watch->root)
+      add_change(w, gavl_strdup(watch->path), BG_FS_WATCH_DELETED);
+    return;
+    }
+
+  if(!ev->len || (ev->name[0] == '.'))
+    return;
+
+  path = gavl_sprintf("%s/%s", watch->path, ev->name);
+
+  if(ev->mask & (IN_DELETE | IN_MOVED_FROM))
+    {
+    add_change(w, path, BG_FS_WATCH_DELETED);
+    return;
+    }
+
+  if((ev->mask & IN_ISDIR) && watch->recursive &&
+     (ev->mask & (IN_CREATE | IN_MOVED_TO)))
+    add_watch(w, path, 1, 0);
+
+  add_change(w, path, BG_FS_WATCH_CHANGED);
+  }
+
+int bg_fs_watch_get_changes(bg_fs_watch_t * w, gavl_dictionary_t * ret)
+  {
+  int i;
+  ssize_t len;
+  gavl_time_t t;
+  const struct inotify_event * ev;
+  char buf[4096] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+
+  while((len = read(w->fd, buf, sizeof(buf))) > 0)
+    {
+    for(i = 0; i < len; i += sizeof(struct inotify_event) + ev->len)
+      {
+      ev = (const struct inotify_event *)(buf + i);
+      handle_event(w, ev);
+      }
+    }
+
+  if(w->overflow)
+    {
+    w->overflow = 0;
+    clear_changes(w);
+    return -1;
+    }
+
+  if(!w->num_changes)
+    return 0;
+
+  t = gavl_timer_get(w->timer);
+
+  if((t - w->last_event < SETTLE_TIME) &&
+     (t - w->first_event < MAX_DELAY))
+    return 0;
+
+  for(i = 0; i < w->num_changes; i++)
+    gavl_dictionary_set_int(ret, w->changes[i].path, w->changes[i].flags);
+
+  clear_changes(w);
+  return 1;
+  }
+
+#else // !HAVE_INOTIFY
+
+bg_fs_watch_t * bg_fs_watch_create()
+  {
+  return NULL;
+  }
+
+void bg_fs_watch_destroy(bg_fs_watch_t * w)
+  {
+
+  }
+
+int bg_fs_watch_add(bg_fs_watch_t * w, const char * dir, int recursive)
+  {
+  return 0;
+  }
+
+void bg_fs_watch_remove(bg_fs_watch_t * w, const char * dir)
+  {
+
+  }
+
+int bg_fs_watch_get_changes(bg_fs_watch_t * w, gavl_dictionary_t * ret)
+  {
+  return 0;
+  }
+
+#endif // !HAVE_INOTIFY
@@ -23,6 +23,7 @@
 
 #include <config.h>
 
+#include <gavl/http.h>
 #include <gmerlin/http.h>
 #include <gmerlin/application.h>
 #include <gmerlin/utils.h>
@@ -243,3 +244,56 @@ int bg_http_cache_put(const gavl_dictionary_t * dict)
   pthread_mutex_unlock(&mutex);
   return 1;
   }
+
+int bg_http_cache_fetch(const char * uri, gavl_buffer_t * buf, gavl_dictionary_t * dict,
+                        gavl_dictionary_t * cache_info, int revalidate)
+  {
+  int ret = BG_HTTP_FETCH_ERROR;
+  gavl_io_t * io;
+  gavl_dictionary_t * client_cache_info;
+  const gavl_dictionary_t * res;
+  
+  io = gavl_http_client_create();
+  gavl_http_client_set_response_body(io, buf);
+
+  client_cache_info = gavl_http_client_get_cache_info(io);
+  bg_http_cache_get(uri, client_cache_info);
+
+  if(!revalidate)
+    {
+    /* Unconditional request, the entry is updated nevertheless */
+    gavl_dictionary_set(client_cache_info, GAVL_HTTP_ETAG, NULL);
+    gavl_dictionary_set(client_cache_info, GAVL_META_MTIME, NULL);
+    }
+  
+  if(!gavl_http_client_open(io, "GET", uri))
+    goto fail;
+
+  res = gavl_http_client_get_response(io);
+  
+  if(gavl_http_response_get_status_int(res) == 304)
+    {
+    ret = BG_HTTP_FETCH_NOT_MODIFIED;
+    bg_http_cache_put(client_cache_info);
+    }
+  else
+    {
+    if(dict)
+      gavl_dictionary_set_string(dict, GAVL_META_MIMETYPE,
+                                 gavl_dictionary_get_string_i(res, "Content-Type"));
+    ret = BG_HTTP_FETCH_LOADED;
+
+    /* Let the caller decide if the body was good */
+    if(cache_info)
+      {
+      gavl_dictionary_reset(cache_info);
+      gavl_dictionary_copy(cache_info, client_cache_info);
+      }
+    else
+      bg_http_cache_put(client_cache_info);
+    }
+  
+  fail:
+  gavl_io_destroy(io);
+  return ret;
+  }
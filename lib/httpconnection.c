@@ -149,34 +149,14 @@ void bg_http_connection_clear_keepalive(bg_http_connection_t * c)
   c->flags &= ~BG_HTTP_REQ_KEEPALIVE;
   }
 
-int bg_http_connection_read_req(bg_http_connection_t * req, int fd, int timeout)
-  {
-  gavl_io_t * io;
-
-  /* Return silently for connect() floods or closed keepalive sockets */
-  if(gavl_socket_is_disconnected(fd, timeout))
-    {
-    //  gavl_log(GAVL_LOG_WARNING, LOG_DOMAIN, "Socket disconnected");
-    gavl_socket_close(fd);
-    return 0;
-    }
-  io = gavl_io_create_socket(fd, timeout, 0);
-
-  
-  
-  req->fd = fd;
+/* Set the members after the request header was read */
 
-  if(!gavl_http_request_read(io, &req->req) ||
-     !(req->method   = gavl_http_request_get_method(&req->req)) ||
+static int init_req(bg_http_connection_t * req)
+  {
+  if(!(req->method   = gavl_http_request_get_method(&req->req)) ||
      !(req->path     = gavl_http_request_get_path(&req->req)) ||
      !(req->protocol = gavl_http_request_get_protocol(&req->req)))
-    {
-    gavl_io_destroy(io);
-    bg_http_connection_free(req);
     return 0;
-    }
-
-  gavl_io_destroy(io);
   
   if(!strncmp(req->protocol, "HTTP/", 5))
     req->protocol_i = BG_HTTP_PROTO_HTTP;
@@ -205,6 +185,46 @@ int bg_http_connection_read_req(bg_http_connection_t * req, int fd, int timeout)
   return 1;
   }
 
+int bg_http_connection_read_req(bg_http_connection_t * req, int fd, int timeout)
+  {
+  gavl_io_t * io;
+
+  /* Return silently for connect() floods or closed keepalive sockets */
+  if(gavl_socket_is_disconnected(fd, timeout))
+    {
+    //  gavl_log(GAVL_LOG_WARNING, LOG_DOMAIN, "Socket disconnected");
+    gavl_socket_close(fd);
+    return 0;
+    }
+  io = gavl_io_create_socket(fd, timeout, 0);
+  
+  req->fd = fd;
+
+  if(!gavl_http_request_read(io, &req->req) ||
+     !init_req(req))
+    {
+    gavl_io_destroy(io);
+    bg_http_connection_free(req);
+    return 0;
+    }
+
+  gavl_io_destroy(io);
+  return 1;
+  }
+
+int bg_http_connection_parse_req(bg_http_connection_t * req, int fd, const char * header)
+  {
+  req->fd = fd;
+  
+  if(!gavl_http_request_from_string(&req->req, header) ||
+     !init_req(req))
+    {
+    bg_http_connection_free(req);
+    return 0;
+    }
+  return 1;
+  }
+
 int bg_http_connection_write_res(bg_http_connection_t * req)
   {
   int result;
@@ -22,11 +22,23 @@
 
 
 #include <string.h>
-
+#include <unistd.h>
+#include <errno.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/stat.h>
 
 #include <config.h>
 
+#ifdef HAVE_SYS_SENDFILE_H
+#include <sys/sendfile.h>
+#endif
+
 #include <gavl/numptr.h>
+#include <gavl/utils.h>
 
 
 #include <gmerlin/utils.h>
@@ -39,6 +51,7 @@
 
 #include <gmerlin/translation.h>
 #include <gmerlin/log.h>
+#include <gmerlin/application.h>
 
 #define LOG_DOMAIN "lpcmhandler"
 
@@ -61,11 +74,436 @@
 
 // http://host:port/wav<id>.wav
 
+/*
+ *  Converted PCM data is cached in segments of SEGMENT_SAMPLES samples.
+ *  The segments are files in the cache directory named <md5>.<index>, where
+ *  the md5 sum is built from the object id and the output format.
+ *  The directory is cleared at startup.
+ */
+
+#define SEGMENT_SAMPLES (1<<18)
+#define CACHE_MAX_SIZE  ((int64_t)512*1024*1024)
+
+typedef struct
+  {
+  char * name;
+  int64_t size;
+  int64_t last_used;
+  } segment_t;
+
 struct bg_lpcm_handler_s
   {
   bg_http_server_t * srv;
+
+  /* Segment cache */
+  char * cache_dir;
+  
+  segment_t * segments;
+  int num_segments;
+  int segments_alloc;
+  
+  int64_t cache_size;
+  int64_t use_counter;
+  int tmp_counter;
+  
+  pthread_mutex_t cache_mutex;
   };
 
+/* State of one request */
+
+typedef struct
+  {
+  bg_lpcm_handler_t * h;
+  char key[GAVL_MD5_LENGTH];
+  
+  bg_plugin_handle_t * handle;
+  gavl_audio_source_t * asrc;
+  const gavl_audio_format_t * fmt;
+  gavl_dsp_context_t * dsp;
+  
+  int block_align;
+  int out_rate;
+  
+  int64_t dec_pos; // Byte position of the decoder in the PCM data
+
+  /* Decoded data belonging to the next segment */
+  gavl_buffer_t carry;
+  int carry_off;
+
+  int segments_cached;
+  int segments_decoded;
+  } pcm_stream_t;
+
+static void cache_init(bg_lpcm_handler_t * h)
+  {
+  DIR * d;
+  struct dirent * dent_ptr;
+  char * filename;
+  const char * app;
+  
+  pthread_mutex_init(&h->cache_mutex, NULL);
+
+  if(!(app = bg_app_get_name()) ||
+     !(h->cache_dir = gavl_search_cache_dir(PACKAGE, app, "lpcm")))
+    return;
+  
+  /* Remove segments from the last run */
+  if(!(d = opendir(h->cache_dir)))
+    return;
+
+  while((dent_ptr = readdir(d)))
+    {
+    if(dent_ptr->d_name[0] == '.')
+      continue;
+    filename = gavl_sprintf("%s/%s", h->cache_dir, dent_ptr->d_name);
+    unlink(filename);
+    free(filename);
+    }
+  closedir(d);
+  }
+
+static void cache_free(bg_lpcm_handler_t * h)
+  {
+  int i;
+
+  for(i = 0; i < h->num_segments; i++)
+    free(h->segments[i].name);
+  if(h->segments)
+    free(h->segments);
+  if(h->cache_dir)
+    free(h->cache_dir);
+  pthread_mutex_destroy(&h->cache_mutex);
+  }
+
+static char * segment_name(const char * key, int64_t seg)
+  {
+  return gavl_sprintf("%s.%"PRId64, key, seg);
+  }
+
+static void cache_delete(bg_lpcm_handler_t * h, int idx)
+  {
+  char * filename;
+  
+  filename = gavl_sprintf("%s/%s", h->cache_dir, h->segments[idx].name);
+  unlink(filename);
+  free(filename);
+
+  h->cache_size -= h->segments[idx].size;
+  free(h->segments[idx].name);
+  
+  if(idx < h->num_segments - 1)
+    memmove(h->segments + idx, h->segments + idx + 1,
+            (h->num_segments - 1 - idx) * sizeof(*h->segments));
+  h->num_segments--;
+  }
+
+/* Return an open file descriptor for a cached segment or -1 */
+
+static int cache_open(bg_lpcm_handler_t * h, const char * key, int64_t seg)
+  {
+  int i;
+  int ret = -1;
+  char * name;
+  char * filename;
+  
+  name = segment_name(key, seg);
+
+  pthread_mutex_lock(&h->cache_mutex);
+
+  for(i = 0; i < h->num_segments; i++)
+    {
+    if(!strcmp(h->segments[i].name, name))
+      {
+      filename = gavl_sprintf("%s/%s", h->cache_dir, name);
+      
+      if((ret = open(filename, O_RDONLY)) >= 0)
+        h->segments[i].last_used = ++h->use_counter;
+      else
+        cache_delete(h, i);
+      
+      free(filename);
+      break;
+      }
+    }
+  
+  pthread_mutex_unlock(&h->cache_mutex);
+  free(name);
+  return ret;
+  }
+
+static char * cache_tmp_file(bg_lpcm_handler_t * h)
+  {
+  char * ret;
+  pthread_mutex_lock(&h->cache_mutex);
+  ret = gavl_sprintf("%s/tmp-%d", h->cache_dir, h->tmp_counter++);
+  pthread_mutex_unlock(&h->cache_mutex);
+  return ret;
+  }
+
+/* Move a completely written segment into the cache */
+
+static void cache_add(bg_lpcm_handler_t * h, const char * key, int64_t seg,
+                      const char * tmp_file, int64_t size)
+  {
+  int i;
+  int oldest;
+  char * filename;
+  char * name;
+  
+  name = segment_name(key, seg);
+  filename = gavl_sprintf("%s/%s", h->cache_dir, name);
+  
+  pthread_mutex_lock(&h->cache_mutex);
+
+  /* Another request was faster */
+  for(i = 0; i < h->num_segments; i++)
+    {
+    if(!strcmp(h->segments[i].name, name))
+      {
+      pthread_mutex_unlock(&h->cache_mutex);
+      unlink(tmp_file);
+      free(filename);
+      free(name);
+      return;
+      }
+    }
+
+  if(rename(tmp_file, filename))
+    {
+    pthread_mutex_unlock(&h->cache_mutex);
+    unlink(tmp_file);
+    free(filename);
+    free(name);
+    return;
+    }
+  
+  if(h->num_segments == h->segments_alloc)
+    {
+    h->segments_alloc += 64;
+    h->segments = realloc(h->segments, h->segments_alloc * sizeof(*h->segments));
+    }
+  h->segments[h->num_segments].name = name;
+  h->segments[h->num_segments].size = size;
+  h->segments[h->num_segments].last_used = ++h->use_counter;
+  h->num_segments++;
+  h->cache_size += size;
+  
+  /* Remove least recently used segments */
+  while((h->cache_size > CACHE_MAX_SIZE) && (h->num_segments > 1))
+    {
+    oldest = 0;
+    for(i = 1; i < h->num_segments; i++)
+      {
+      if(h->segments[i].last_used < h->segments[oldest].last_used)
+        oldest = i;
+      }
+    cache_delete(h, oldest);
+    }
+  
+  pthread_mutex_unlock(&h->cache_mutex);
+  free(filename);
+  }
+
+/* Send len bytes starting at off from a segment file */
+
+static int send_segment(int fd, int file_fd, int64_t off, int64_t len)
+  {
+#ifdef HAVE_SYS_SENDFILE_H
+  off_t pos = off;
+  ssize_t result;
+  
+  while(len > 0)
+    {
+    if((result = sendfile(fd, file_fd, &pos, len)) <= 0)
+      {
+      if((result < 0) && (errno == EINTR))
+        continue;
+      return 0;
+      }
+    len -= result;
+    }
+  return 1;
+#else
+  uint8_t buf[16*1024];
+  int bytes;
+  
+  while(len > 0)
+    {
+    bytes = (len > sizeof(buf)) ? sizeof(buf) : len;
+
+    if(pread(file_fd, buf, bytes, off) != bytes)
+      return 0;
+    if(gavl_socket_write_data(fd, buf, bytes) < bytes)
+      return 0;
+    off += bytes;
+    len -= bytes;
+    }
+  return 1;
+#endif
+  }
+
+/* Decode the segment starting at seg_start, store it in the cache and
+   send the part between *pos and send_end to the client */
+
+static int decode_segment(pcm_stream_t * s, int fd, int64_t seg,
+                          int64_t seg_start, int64_t seg_end,
+                          int64_t * pos, int64_t send_end)
+  {
+  int tmp_fd;
+  char * tmp_file;
+  const uint8_t * data;
+  int64_t n, m, num;
+  gavl_audio_frame_t * f;
+  int ret = 0;
+  
+  if(s->dec_pos != seg_start)
+    {
+    bg_input_plugin_seek(s->handle, seg_start / s->block_align, s->out_rate);
+    s->dec_pos = seg_start;
+    gavl_buffer_reset(&s->carry);
+    s->carry_off = 0;
+    }
+
+  tmp_file = cache_tmp_file(s->h);
+  
+  if((tmp_fd = open(tmp_file, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0)
+    gavl_log(GAVL_LOG_WARNING, LOG_DOMAIN, "Cannot open %s: %s", tmp_file, strerror(errno));
+  
+  while(s->dec_pos < seg_end)
+    {
+    if(s->carry_off < s->carry.len)
+      {
+      data = s->carry.buf + s->carry_off;
+      n = s->carry.len - s->carry_off;
+      }
+    else
+      {
+      f = NULL;
+      if(gavl_audio_source_read_frame(s->asrc, &f) != GAVL_SOURCE_OK)
+        break;
+      
+      if(s->dsp)
+        gavl_dsp_audio_frame_swap_endian(s->dsp, f, s->fmt);
+      
+      data = f->samples.u_8;
+      n = f->valid_samples * s->block_align;
+      }
+    
+    m = n;
+    if(m > seg_end - s->dec_pos)
+      m = seg_end - s->dec_pos;
+    
+    if((tmp_fd >= 0) && (write(tmp_fd, data, m) != m))
+      {
+      gavl_log(GAVL_LOG_WARNING, LOG_DOMAIN, "Writing %s failed: %s", tmp_file, strerror(errno));
+      close(tmp_fd);
+      unlink(tmp_file);
+      tmp_fd = -1;
+      }
+    
+    /* Part requested by the client */
+    if((*pos < send_end) && (s->dec_pos + m > *pos))
+      {
+      num = s->dec_pos + m;
+      if(num > send_end)
+        num = send_end;
+      num -= *pos;
+      
+      if(gavl_socket_write_data(fd, data + (*pos - s->dec_pos), num) < num)
+        goto fail;
+      *pos += num;
+      }
+    
+    s->dec_pos += m;
+    
+    /* Keep the rest for the next segment */
+    if(data == s->carry.buf + s->carry_off)
+      s->carry_off += m;
+    else if(m < n)
+      {
+      gavl_buffer_reset(&s->carry);
+      gavl_buffer_append_data(&s->carry, data + m, n - m);
+      s->carry_off = 0;
+      }
+    }
+
+  s->segments_decoded++;
+  
+  if(s->dec_pos < seg_end)
+    {
+    /* Stream ended too early */
+    if(*pos < send_end)
+      goto fail;
+    }
+  else if(tmp_fd >= 0)
+    {
+    close(tmp_fd);
+    tmp_fd = -1;
+    cache_add(s->h, s->key, seg, tmp_file, seg_end - seg_start);
+    }
+  
+  ret = 1;
+  
+  fail:
+  
+  if(tmp_fd >= 0)
+    {
+    close(tmp_fd);
+    unlink(tmp_file);
+    }
+  free(tmp_file);
+  
+  return ret;
+  }
+
+/* Send the PCM data between start and end (excluding the WAV header) */
+
+static int send_pcm(pcm_stream_t * s, int fd, int64_t start, int64_t end, int64_t total)
+  {
+  int64_t seg;
+  int64_t seg_start;
+  int64_t seg_end;
+  int64_t send_end;
+  int64_t seg_bytes = (int64_t)SEGMENT_SAMPLES * s->block_align;
+  int file_fd;
+  int result;
+  
+  while(start < end)
+    {
+    seg = start / seg_bytes;
+    seg_start = seg * seg_bytes;
+
+    seg_end = seg_start + seg_bytes;
+    if(seg_end > total)
+      seg_end = total;
+    
+    send_end = (end < seg_end) ? end : seg_end;
+    
+    if((file_fd = cache_open(s->h, s->key, seg)) >= 0)
+      {
+      result = send_segment(fd, file_fd, start - seg_start, send_end - start);
+      close(file_fd);
+      
+      if(!result)
+        return 0;
+      
+      s->segments_cached++;
+      start = send_end;
+      }
+    else if(!decode_segment(s, fd, seg, seg_start, seg_end, &start, send_end))
+      return 0;
+    }
+  return 1;
+  }
+
+static double get_thread_time()
+  {
+  struct timespec ts;
+  if(clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts))
+    return 0.0;
+  return (double)ts.tv_sec + (double)ts.tv_nsec / 1.0e9;
+  }
+
 
 #define SET_FOURCC(dst, c) memcpy(dst, c, 4); dst+=4
 
@@ -161,7 +599,11 @@ static void thread_func(bg_http_connection_t * conn, void * priv, int format)
   int num_bytes;
   gavl_dsp_context_t * dsp = NULL;
 
+  int use_cache = 0;
+  pcm_stream_t ps;
+  double cpu_time = get_thread_time();
   
+  memset(&ps, 0, sizeof(ps));
   gavl_dictionary_init(&track);
   
   /* Get object */
@@ -315,6 +757,26 @@ static void thread_func(bg_http_connection_t * conn, void * priv, int format)
 
   gavl_audio_source_set_dst(asrc, 0, &fmt);
   block_align = channels * 2;
+
+  /* Only cache if we can seek to exact sample positions */
+  if(sample_accurate && h->cache_dir)
+    {
+    char * tmp_string;
+    
+    use_cache = 1;
+    
+    ps.h = h;
+    ps.handle = handle;
+    ps.asrc = asrc;
+    ps.fmt = &fmt;
+    ps.dsp = dsp;
+    ps.block_align = block_align;
+    ps.out_rate = out_rate;
+
+    tmp_string = gavl_sprintf("%s %d %d %d", id, format, out_rate, channels);
+    gavl_md5_buffer_str(tmp_string, strlen(tmp_string), ps.key);
+    free(tmp_string);
+    }
   
   /* Seek */
 
@@ -377,7 +839,7 @@ static void thread_func(bg_http_connection_t * conn, void * priv, int format)
 
   /* Seek source */
 
-  if(byte_offset > header_len)
+  if(!use_cache && (byte_offset > header_len))
     {
     int64_t seek_time = (byte_offset-header_len) / block_align;
 
@@ -511,7 +973,25 @@ static void thread_func(bg_http_connection_t * conn, void * priv, int format)
       
       }
     
-    while(1)
+    if(use_cache)
+      {
+      int64_t data_start = byte_offset;
+
+      if(data_start < header_len)
+        data_start = header_len;
+      
+      /* The response is incomplete, so the connection can't be reused */
+      if(!send_pcm(&ps, conn->fd, data_start - header_len,
+                   byte_offset + byte_len - header_len,
+                   stream_duration * block_align))
+        {
+        gavl_log(GAVL_LOG_WARNING, LOG_DOMAIN, "Sending %s failed", id);
+        bg_http_connection_clear_keepalive(conn);
+        goto fail;
+        }
+      }
+    
+    while(!use_cache)
       {
       f = NULL;
     
@@ -542,6 +1022,19 @@ static void thread_func(bg_http_connection_t * conn, void * priv, int format)
 
   if(dsp)
     gavl_dsp_context_destroy(dsp);
+
+  gavl_buffer_free(&ps.carry);
+
+  if(result)
+    {
+    if(use_cache)
+      gavl_log(GAVL_LOG_INFO, LOG_DOMAIN,
+               "Finished %s: %d segments from cache, %d decoded, CPU time: %.3f s",
+               id, ps.segments_cached, ps.segments_decoded, get_thread_time() - cpu_time);
+    else
+      gavl_log(GAVL_LOG_INFO, LOG_DOMAIN, "Finished %s, CPU time: %.3f s",
+               id, get_thread_time() - cpu_time);
+    }
   
   if(!result)
     {
@@ -605,6 +1098,7 @@ bg_lpcm_handler_t * bg_lpcm_handler_create(bg_mdb_t * mdb, bg_http_server_t * sr
   bg_lpcm_handler_t * ret;
   ret = calloc(1, sizeof(*ret));
   ret->srv = srv;
+  cache_init(ret);
   bg_http_server_add_handler(srv, handle_http_lpcm, BG_HTTP_PROTO_HTTP, LPCM_PATH, // E.g. /static/ can be NULL
                              ret);
   bg_http_server_add_handler(srv, handle_http_wav, BG_HTTP_PROTO_HTTP, WAV_PATH, // E.g. /static/ can be NULL
@@ -614,6 +1108,7 @@ bg_lpcm_handler_t * bg_lpcm_handler_create(bg_mdb_t * mdb, bg_http_server_t * sr
 
 void bg_lpcm_handler_destroy(bg_lpcm_handler_t * h)
   {
+  cache_free(h);
   free(h);
   }
 
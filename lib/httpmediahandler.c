@@ -28,10 +28,16 @@
 
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/socket.h>
 #include <fcntl.h>
 
 
 #include <config.h>
+
+#ifdef HAVE_SYS_SENDFILE_H
+#include <sys/sendfile.h>
+#endif
+
 #include <gavl/gavl.h>
 #include <gavl/metatags.h>
 #include <gavl/numptr.h>
@@ -55,6 +61,13 @@
 
 #define THREAD_THRESHOLD (1024*1024) // 1 M
 
+/* Bytes sent at once before other clients get their turn */
+#define CHUNK_SIZE (256*1024)
+
+#if !HAVE_DECL_MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
 /* id3 and flac tag handling */
 
 #define CACHE_AGE (60*60)
@@ -67,10 +80,12 @@ typedef struct
   bg_http_server_t * s;
   
   header_t h;
+  int file_fd;
   
   } media_handler_t;
 
-static header_t * header_get(bg_http_server_t * srv, const gavl_dictionary_t * m, char * filename);
+static int header_get(bg_http_server_t * srv, const gavl_dictionary_t * m, char * filename,
+                      header_t * ret);
 
 static void thread_func_media(bg_http_connection_t * conn, void * priv)
   {
@@ -116,9 +131,87 @@ static void thread_func_media(bg_http_connection_t * conn, void * priv)
   //  fprintf(stderr, "gavl_socket_send_file done\n");
   }
 
+/* Send the next chunk without blocking */
+
+static int chunk_func_media(bg_http_connection_t * conn, void * priv)
+  {
+  ssize_t result;
+  int64_t len;
+  off_t off;
+  media_handler_t * handler = priv;
+
+  if(handler->len <= 0)
+    return 0;
+  
+  if((handler->h.buf.len > 0) && (handler->off < handler->h.buf.len))
+    {
+    /* Header */
+    len = handler->h.buf.len - handler->off;
+    
+    if(len > handler->len)
+      len = handler->len;
+    if(len > CHUNK_SIZE)
+      len = CHUNK_SIZE;
+
+    result = send(conn->fd, handler->h.buf.buf + handler->off, len, MSG_DONTWAIT | MSG_NOSIGNAL);
+    }
+  else
+    {
+    /* File */
+    if((handler->file_fd < 0) &&
+       ((handler->file_fd = open(handler->filename, O_RDONLY)) < 0))
+      {
+      gavl_log(GAVL_LOG_ERROR, LOG_DOMAIN, "Cannot open %s: %s", handler->filename, strerror(errno));
+      return -1;
+      }
+    
+    off = handler->off - handler->h.buf.len + handler->h.offset;
+    len = handler->len;
+    
+    if(len > CHUNK_SIZE)
+      len = CHUNK_SIZE;
+    
+#ifdef HAVE_SYS_SENDFILE_H
+      {
+      int flags = fcntl(conn->fd, F_GETFL);
+      fcntl(conn->fd, F_SETFL, flags | O_NONBLOCK);
+      result = sendfile(conn->fd, handler->file_fd, &off, len);
+      fcntl(conn->fd, F_SETFL, flags);
+      }
+#else
+      {
+      uint8_t buf[16*1024];
+
+      if(len > sizeof(buf))
+        len = sizeof(buf);
+      
+      if((result = pread(handler->file_fd, buf, len, off)) > 0)
+        result = send(conn->fd, buf, result, MSG_DONTWAIT | MSG_NOSIGNAL);
+      }
+#endif
+    }
+
+  if(result < 0)
+    {
+    if((errno == EAGAIN) || (errno == EWOULDBLOCK) || (errno == EINTR))
+      return 1;
+    return -1;
+    }
+  else if(!result) // File got shorter
+    return -1;
+  
+  handler->off += result;
+  handler->len -= result;
+  
+  return (handler->len > 0) ? 1 : 0;
+  }
+
 static void free_data(media_handler_t * data)
   {
   free(data->filename);
+  gavl_buffer_free(&data->h.buf);
+  if(data->file_fd >= 0)
+    close(data->file_fd);
   }
 
 static void cleanup(void * data)
@@ -145,7 +238,8 @@ static int handle_http_mediafile(bg_http_connection_t * conn, void * data)
   int64_t total_bytes;
   const char * range;
   const char * var;
-  header_t * h = NULL;
+  header_t h;
+  int have_header = 0;
   
   int64_t start_byte = 0;
   int64_t end_byte = 0;
@@ -157,6 +251,8 @@ static int handle_http_mediafile(bg_http_connection_t * conn, void * data)
   
   if(!(local_path_enc = bg_media_dirs_http_to_local(s->dirs, conn->path)))
     return 0; // Not our business
+
+  memset(&h, 0, sizeof(h));
   
   //  fprintf(stderr, "Got media path: %s\n", local_path);
   
@@ -239,7 +335,7 @@ static int handle_http_mediafile(bg_http_connection_t * conn, void * data)
           bg_mdb_get_thumbnails(s->mdb, track);
 
         /* Get header including cover */
-        h = header_get(s, metadata, local_path);
+        have_header = header_get(s, metadata, local_path, &h);
         }
       
       //      fprintf(stderr, "Got media info:\n");
@@ -250,10 +346,10 @@ static int handle_http_mediafile(bg_http_connection_t * conn, void * data)
   
   total_bytes = st.st_size;
 
-  if(h)
+  if(have_header)
     {
-    total_bytes -= h->offset;
-    total_bytes += h->buf.len;
+    total_bytes -= h.offset;
+    total_bytes += h.buf.len;
     }
   
   /* Check transfer mode */
@@ -297,6 +393,7 @@ static int handle_http_mediafile(bg_http_connection_t * conn, void * data)
   /* Check for bytes range */
 
   memset(&mh, 0, sizeof(mh));
+  mh.file_fd = -1;
   mh.filename = gavl_strdup(local_path);
   mh.s = s;
   
@@ -339,10 +436,10 @@ static int handle_http_mediafile(bg_http_connection_t * conn, void * data)
     mh.len = total_bytes;
     }
 
-  if(h)
+  if(have_header)
     {
-    gavl_buffer_copy(&mh.h.buf, &h->buf);
-    mh.h.offset = h->offset;
+    gavl_buffer_copy(&mh.h.buf, &h.buf);
+    mh.h.offset = h.offset;
     }
 
   
@@ -427,7 +524,7 @@ static int handle_http_mediafile(bg_http_connection_t * conn, void * data)
     {
     mhp = calloc(1, sizeof(*mhp));
     memcpy(mhp, &mh, sizeof(mh));
-    bg_http_server_create_client_thread(s, thread_func_media, cleanup, conn, mhp);
+    bg_http_server_create_client_chunked(s, chunk_func_media, cleanup, conn, mhp);
     }
     
   result = 1;
@@ -444,6 +541,8 @@ static int handle_http_mediafile(bg_http_connection_t * conn, void * data)
 
   if(mi)
     gavl_dictionary_destroy(mi);
+
+  bg_http_server_free_header(&h);
   
   return 1;
   }
@@ -596,37 +695,56 @@ static int header_get_mp3(header_t * ret, const gavl_dictionary_t * m, char * fi
   return result; 
   }
 
-static header_t * header_get(bg_http_server_t * srv, const gavl_dictionary_t * m, char * filename)
+/* Look up a cached header and move it to the front.
+   Called with headers_mutex locked */
+
+static header_t * header_find(bg_http_server_t * srv, const char * filename)
+  {
+  int i;
+  header_t tmp;
+
+  for(i = 0; i < srv->num_headers; i++)
+    {
+    if(strcmp(srv->headers[i].uri, filename))
+      continue;
+
+    /* Move to first place in the array */
+    if(i > 0)
+      {
+      memcpy(&tmp, &srv->headers[i], sizeof(tmp));
+      memmove(&srv->headers[1], &srv->headers[0], i * sizeof(tmp));
+      memcpy(&srv->headers[0], &tmp, sizeof(tmp));
+      }
+    return &srv->headers[0];
+    }
+  return NULL;
+  }
+
+/* The header is copied to ret because the cache is shared by all
+   request threads. The file is read without holding the lock. */
+
+static int header_get(bg_http_server_t * srv, const gavl_dictionary_t * m, char * filename,
+                      header_t * ret)
   {
   const char * format;
   const gavl_dictionary_t * dict;
-  int i;
+  header_t * cached;
   header_t h;
 
   memset(&h, 0, sizeof(h));
+
+  pthread_mutex_lock(&srv->headers_mutex);
   
-  for(i = 0; i < srv->num_headers; i++)
+  if((cached = header_find(srv, filename)))
     {
-    if(!strcmp(srv->headers[i].uri, filename))
-      {
-      /* Move to first place in the array */
-
-      if(i > 0)
-        {
-        header_t tmp;
-        memcpy(&tmp, &srv->headers[i], sizeof(tmp));
-        
-        if(i < srv->num_headers - 1)
-          memmove(&srv->headers[i], &srv->headers[i+1], (srv->num_headers - 1 - i) * sizeof(tmp));
-        
-        memmove(&srv->headers[1], &srv->headers[0], (srv->num_headers - 1) * sizeof(tmp));
-        memcpy(&srv->headers[0], &tmp, sizeof(tmp));
-        }
-      
-      return &srv->headers[0];
-      }
+    ret->offset = cached->offset;
+    gavl_buffer_copy(&ret->buf, &cached->buf);
+    pthread_mutex_unlock(&srv->headers_mutex);
+    return 1;
     }
 
+  pthread_mutex_unlock(&srv->headers_mutex);
+  
   /* Load header from file */
   
   if((dict = gavl_metadata_get_src(m, GAVL_META_SRC, 0, NULL, NULL)) &&
@@ -635,22 +753,35 @@ static header_t * header_get(bg_http_server_t * srv, const gavl_dictionary_t * m
     if(!strcmp(format, GAVL_META_FORMAT_MP3))
       {
       if(!header_get_mp3(&h, m, filename))
-        return NULL;
+        return 0;
 
       h.uri = gavl_strdup(filename);
       }
     else if(!strcmp(format, GAVL_META_FORMAT_FLAC))
       {
       if(!header_get_flac(&h, m, filename))
-        return NULL;
+        return 0;
 
       h.uri = gavl_strdup(filename);
       }
     else
-      return NULL;
+      return 0;
     }
   else
-    return NULL;
+    return 0;
+
+  ret->offset = h.offset;
+  gavl_buffer_copy(&ret->buf, &h.buf);
+  
+  pthread_mutex_lock(&srv->headers_mutex);
+
+  /* Another thread could have loaded the same file meanwhile */
+  if(header_find(srv, filename))
+    {
+    pthread_mutex_unlock(&srv->headers_mutex);
+    bg_http_server_free_header(&h);
+    return 1;
+    }
   
   /* Delete last */
   
@@ -661,6 +792,9 @@ static header_t * header_get(bg_http_server_t * srv, const gavl_dictionary_t * m
     }
   memmove(&srv->headers[1], &srv->headers[0], srv->num_headers * sizeof(h));
   memcpy(&srv->headers[0], &h, sizeof(h));
-  return &srv->headers[0];
+  srv->num_headers++;
+  
+  pthread_mutex_unlock(&srv->headers_mutex);
+  return 1;
   }
 
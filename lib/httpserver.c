@@ -26,6 +26,8 @@
 
 #include <poll.h>
 #include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
 #include <sys/stat.h>
 #include <errno.h>
 #include <pthread.h>
@@ -57,7 +59,22 @@
 #include <gmerlin/log.h>
 #define LOG_DOMAIN "httpserver"
 
-#define TIMEOUT GAVL_TIME_SCALE/2000
+/* Idle keep-alive connections are closed after this time */
+#define KA_TIMEOUT     (10*GAVL_TIME_SCALE)
+
+/* Time a client has to send the complete request header */
+#define HEADER_TIMEOUT (10*GAVL_TIME_SCALE)
+
+#define MAX_HEADER_SIZE (16*1024)
+#define READ_SIZE       1024
+
+/* Maximum number of complete requests waiting for a worker */
+#define MAX_JOBS        256
+
+#define MAX_EVENTS      64
+
+/* Maximum number of streaming clients waiting for a thread */
+#define MAX_CLIENTS_QUEUED 64
 
 #define WEB_ROOT DATA_DIR"/web"
 
@@ -87,10 +104,26 @@ static const bg_parameter_info_t parameters[] =
       .name =      "max_keepalive_sockets",
       .type = BG_PARAMETER_INT,
       .long_name =  TRS("Maximum number of keep-alive sockets"),
-      .val_default = GAVL_VALUE_INIT_INT(16),
-      .val_min     = GAVL_VALUE_INIT_INT(0),
+      .val_default = GAVL_VALUE_INIT_INT(1024),
+      .val_min     = GAVL_VALUE_INIT_INT(16),
       .val_max     = GAVL_VALUE_INIT_INT(65535),
     },
+    {
+      .name =      "num_workers",
+      .type = BG_PARAMETER_INT,
+      .long_name =  TRS("Request handler threads"),
+      .val_default = GAVL_VALUE_INIT_INT(4),
+      .val_min     = GAVL_VALUE_INIT_INT(1),
+      .val_max     = GAVL_VALUE_INIT_INT(64),
+    },
+    {
+      .name =      "max_client_threads",
+      .type = BG_PARAMETER_INT,
+      .long_name =  TRS("Maximum number of streaming threads"),
+      .val_default = GAVL_VALUE_INIT_INT(16),
+      .val_min     = GAVL_VALUE_INIT_INT(1),
+      .val_max     = GAVL_VALUE_INIT_INT(256),
+    },
     {
       .name =      "max_client_ids",
       .type = BG_PARAMETER_INT,
@@ -105,86 +138,624 @@ static const bg_parameter_info_t parameters[] =
 
 
 
-/* Client thread stuff */
+/* Client thread pool */
+
+static void client_thread_destroy(client_thread_t * th)
+  {
+  if(th->cleanup)
+    th->cleanup(th->priv);
+
+  bg_http_connection_free(&th->conn);
+  free(th);
+  }
+
+/* Called with threads_mutex locked */
+
+static void client_push(bg_http_server_t * s, client_thread_t * th)
+  {
+  th->next = NULL;
+  
+  if(s->clients_last)
+    s->clients_last->next = th;
+  else
+    s->clients_first = th;
+  s->clients_last = th;
+  s->clients_queued++;
+  pthread_cond_signal(&s->threads_cond);
+  }
+
+/* List of clients waiting for their socket. Called with threads_mutex locked */
+
+static void waiting_link(bg_http_server_t * s, client_thread_t * th)
+  {
+  th->prev = NULL;
+  th->next = s->clients_waiting_first;
+  if(th->next)
+    th->next->prev = th;
+  s->clients_waiting_first = th;
+  s->clients_waiting++;
+  }
 
-static void * thread_func(void * priv)
+static void waiting_unlink(bg_http_server_t * s, client_thread_t * th)
   {
-  client_thread_t * th = priv;
+  if(th->prev)
+    th->prev->next = th->next;
+  else
+    s->clients_waiting_first = th->next;
+
+  if(th->next)
+    th->next->prev = th->prev;
+  s->clients_waiting--;
+  }
 
-  gavl_log(GAVL_LOG_INFO, LOG_DOMAIN, "Client thread started");
+/* Wait until the socket becomes writable */
+
+static void client_park(bg_http_server_t * s, client_thread_t * th)
+  {
+  struct epoll_event ev;
   
-  th->thread_func(&th->conn, th->priv);
+  memset(&ev, 0, sizeof(ev));
+  ev.events = EPOLLOUT | EPOLLONESHOT;
+  ev.data.ptr = th;
 
-  /* Signal that we are done */
-  pthread_mutex_lock(&th->stopped_mutex);
-  th->stopped = 1;
-  pthread_mutex_unlock(&th->stopped_mutex);
+  pthread_mutex_lock(&s->threads_mutex);
+  waiting_link(s, th);
+  pthread_mutex_unlock(&s->threads_mutex);
   
-  gavl_log(GAVL_LOG_INFO, LOG_DOMAIN, "Client thread finished");
+  if(epoll_ctl(s->wfd, EPOLL_CTL_ADD, th->conn.fd, &ev) < 0)
+    {
+    gavl_log(GAVL_LOG_ERROR, LOG_DOMAIN, "epoll_ctl failed: %s", strerror(errno));
+    pthread_mutex_lock(&s->threads_mutex);
+    waiting_unlink(s, th);
+    pthread_mutex_unlock(&s->threads_mutex);
+    
+    bg_http_connection_clear_keepalive(&th->conn);
+    client_thread_destroy(th);
+    }
+  }
+
+/* Move clients with writable sockets back into the queue */
+
+static int clients_wakeup(bg_http_server_t * s)
+  {
+  int i;
+  int num_events;
+  int ret = 0;
+  client_thread_t * th;
+  struct epoll_event events[MAX_EVENTS];
+  
+  while((num_events = epoll_wait(s->wfd, events, MAX_EVENTS, 0)) > 0)
+    {
+    pthread_mutex_lock(&s->threads_mutex);
+
+    for(i = 0; i < num_events; i++)
+      {
+      th = events[i].data.ptr;
+      epoll_ctl(s->wfd, EPOLL_CTL_DEL, th->conn.fd, NULL);
+      waiting_unlink(s, th);
+      client_push(s, th);
+      }
+    pthread_mutex_unlock(&s->threads_mutex);
+    
+    ret += num_events;
+    
+    if(num_events < MAX_EVENTS)
+      break;
+    }
+  return ret;
+  }
+
+static void * client_thread_func(void * priv)
+  {
+  int result;
+  struct pollfd pfd;
+  client_thread_t * th;
+  bg_http_server_t * s = priv;
+  
+  pthread_mutex_lock(&s->threads_mutex);
+
+  while(1)
+    {
+    while(!s->clients_first && !s->clients_quit)
+      pthread_cond_wait(&s->threads_cond, &s->threads_mutex);
+
+    if(s->clients_quit)
+      break;
+    
+    th = s->clients_first;
+    s->clients_first = th->next;
+    if(!s->clients_first)
+      s->clients_last = NULL;
+
+    s->clients_queued--;
+    s->clients_active++;
+    
+    pthread_mutex_unlock(&s->threads_mutex);
+
+    if(th->thread_func)
+      {
+      th->thread_func(&th->conn, th->priv);
+      client_thread_destroy(th);
+      }
+    else
+      {
+      result = th->chunk_func(&th->conn, th->priv);
+
+      if(result > 0)
+        {
+        /* Go to the end of the queue if the socket is writable already */
+        pfd.fd = th->conn.fd;
+        pfd.events = POLLOUT;
+        pfd.revents = 0;
+
+        if(poll(&pfd, 1, 0) > 0)
+          {
+          pthread_mutex_lock(&s->threads_mutex);
+          client_push(s, th);
+          pthread_mutex_unlock(&s->threads_mutex);
+          }
+        else
+          client_park(s, th);
+        }
+      else
+        {
+        if(result < 0)
+          bg_http_connection_clear_keepalive(&th->conn);
+        bg_http_server_put_connection(s, &th->conn);
+        client_thread_destroy(th);
+        }
+      }
+    
+    pthread_mutex_lock(&s->threads_mutex);
+    s->clients_active--;
+    }
+  
+  pthread_mutex_unlock(&s->threads_mutex);
   return NULL;
   }
 
-void bg_http_server_create_client_thread(bg_http_server_t * s,
-                                         bg_http_server_thread_func tf,
-                                         bg_http_server_thread_cleanup cf,
-                                         bg_http_connection_t * conn, void * priv)
+static int create_client(bg_http_server_t * s, client_thread_t * th,
+                         bg_http_connection_t * conn)
+  {
+  memcpy(&th->conn, conn, sizeof(th->conn));
+  bg_http_connection_init(conn);
+  
+  pthread_mutex_lock(&s->threads_mutex);
+
+  if(!s->client_threads)
+    {
+    pthread_mutex_unlock(&s->threads_mutex);
+    client_thread_destroy(th);
+    return 0;
+    }
+  
+  /* Start threads on demand */
+  if((s->clients_active + s->clients_queued >= s->num_client_threads) &&
+     (s->num_client_threads < s->max_client_threads))
+    {
+    pthread_create(&s->client_threads[s->num_client_threads], NULL, client_thread_func, s);
+    s->num_client_threads++;
+    }
+  
+  if(s->clients_queued >= MAX_CLIENTS_QUEUED)
+    {
+    s->clients_rejected++;
+    pthread_mutex_unlock(&s->threads_mutex);
+
+    gavl_log(GAVL_LOG_WARNING, LOG_DOMAIN, "Too many streaming clients, rejecting connection");
+    bg_http_connection_clear_keepalive(&th->conn);
+    client_thread_destroy(th);
+    return 0;
+    }
+
+  client_push(s, th);
+  pthread_mutex_unlock(&s->threads_mutex);
+  return 1;
+  }
+
+int bg_http_server_create_client_thread(bg_http_server_t * s,
+                                        bg_http_server_thread_func tf,
+                                        bg_http_server_thread_cleanup cf,
+                                        bg_http_connection_t * conn, void * priv)
   {
   client_thread_t * th = calloc(1, sizeof(*th));
   th->cleanup = cf;
   th->thread_func = tf;
   th->priv = priv;
-  
-  memcpy(&th->conn, conn, sizeof(th->conn));
-  bg_http_connection_init(conn);
-  
+  return create_client(s, th, conn);
+  }
+
+int bg_http_server_create_client_chunked(bg_http_server_t * s,
+                                         bg_http_server_chunk_func cf,
+                                         bg_http_server_thread_cleanup cleanup,
+                                         bg_http_connection_t * conn, void * priv)
+  {
+  client_thread_t * th = calloc(1, sizeof(*th));
+  th->cleanup = cleanup;
+  th->chunk_func = cf;
+  th->priv = priv;
+  return create_client(s, th, conn);
+  }
+
+void bg_http_server_get_client_stats(bg_http_server_t * s, bg_http_server_client_stats_t * stats)
+  {
   pthread_mutex_lock(&s->threads_mutex);
+  stats->active   = s->clients_active;
+  stats->queued   = s->clients_queued;
+  stats->waiting  = s->clients_waiting;
+  stats->rejected = s->clients_rejected;
+  pthread_mutex_unlock(&s->threads_mutex);
+  }
 
-  if(s->num_threads + 1 > s->threads_alloc)
+static void start_client_threads(bg_http_server_t * s)
+  {
+  if((s->wfd = epoll_create1(EPOLL_CLOEXEC)) < 0)
     {
-    s->threads_alloc += 16;
-    s->threads = realloc(s->threads, s->threads_alloc * sizeof(*s->threads));
+    gavl_log(GAVL_LOG_ERROR, LOG_DOMAIN, "epoll_create1 failed: %s", strerror(errno));
+    return;
     }
-  s->threads[s->num_threads] = th;
-  s->num_threads++;
+  s->client_threads = calloc(s->max_client_threads, sizeof(*s->client_threads));
+  }
+
+static void stop_client_threads(bg_http_server_t * s)
+  {
+  int i;
+  client_thread_t * th;
+  
+  if(!s->client_threads)
+    return;
+
+  /* Threads finish their current client */
+  pthread_mutex_lock(&s->threads_mutex);
+  s->clients_quit = 1;
+  pthread_cond_broadcast(&s->threads_cond);
   pthread_mutex_unlock(&s->threads_mutex);
+
+  for(i = 0; i < s->num_client_threads; i++)
+    pthread_join(s->client_threads[i], NULL);
+  free(s->client_threads);
+  s->client_threads = NULL;
+
+  while((th = s->clients_first))
+    {
+    s->clients_first = th->next;
+    client_thread_destroy(th);
+    }
+  s->clients_last = NULL;
+
+  while((th = s->clients_waiting_first))
+    {
+    s->clients_waiting_first = th->next;
+    client_thread_destroy(th);
+    }
+  }
+
+/* */
+
+/* Front end connections */
+
+static http_conn_t * add_conn(bg_http_server_t * s, int fd, int state)
+  {
+  struct epoll_event ev;
+  http_conn_t * c = calloc(1, sizeof(*c));
+
+  c->fd = fd;
+  c->state = state;
+  c->last_active = gavl_timer_get(s->timer);
+  
+  pthread_mutex_lock(&s->conns_mutex);
+
+  if(s->num_conns == s->conns_alloc)
+    {
+    s->conns_alloc += 128;
+    s->conns = realloc(s->conns, s->conns_alloc * sizeof(*s->conns));
+    }
+  c->idx = s->num_conns;
+  s->conns[s->num_conns++] = c;
+  
+  memset(&ev, 0, sizeof(ev));
+  ev.events = EPOLLIN | EPOLLRDHUP;
+  ev.data.ptr = c;
+  
+  if(epoll_ctl(s->efd, EPOLL_CTL_ADD, fd, &ev) < 0)
+    gavl_log(GAVL_LOG_ERROR, LOG_DOMAIN, "epoll_ctl failed: %s", strerror(errno));
   
-  pthread_create(&th->th, NULL, thread_func, th);
+  pthread_mutex_unlock(&s->conns_mutex);
+  return c;
   }
 
-static int client_thread_finished(client_thread_t * th)
+/* Called with conns_mutex locked */
+
+static void remove_conn(bg_http_server_t * s, http_conn_t * c)
   {
-  int ret;
+  if(c->fd >= 0)
+    {
+    epoll_ctl(s->efd, EPOLL_CTL_DEL, c->fd, NULL);
+    gavl_socket_close(c->fd);
+    }
+  
+  if(c->idx < s->num_conns - 1)
+    {
+    s->conns[c->idx] = s->conns[s->num_conns - 1];
+    s->conns[c->idx]->idx = c->idx;
+    }
+  s->num_conns--;
+  
+  gavl_buffer_free(&c->buf);
+  free(c);
+  }
 
-  pthread_mutex_lock(&th->stopped_mutex);
-  ret = th->stopped;
-  pthread_mutex_unlock(&th->stopped_mutex);
-  return ret;
+/* Read as much of the request header as is available without blocking.
+   The body must stay in the socket for the handler, so we peek first and
+   consume only up to the end of the header.
+   Return 1 if the header is complete, 0 if more data is needed and -1 on error */
+
+static int conn_read_header(http_conn_t * c)
+  {
+  int result;
+  int start;
+  char * pos;
+
+  gavl_buffer_alloc(&c->buf, c->buf.len + READ_SIZE + 1);
+  
+  result = recv(c->fd, c->buf.buf + c->buf.len, READ_SIZE, MSG_PEEK | MSG_DONTWAIT);
+
+  if(result < 0)
+    {
+    if((errno == EAGAIN) || (errno == EWOULDBLOCK) || (errno == EINTR))
+      return 0;
+    return -1;
+    }
+  else if(!result) // Closed
+    return -1;
+  
+  c->buf.buf[c->buf.len + result] = '\0';
+
+  /* The delimiter can span the previous chunk */
+  start = (c->buf.len > 3) ? c->buf.len - 3 : 0;
+
+  if((pos = strstr((char*)c->buf.buf + start, "\r\n\r\n")))
+    result = (pos + 4) - (char*)(c->buf.buf + c->buf.len);
+  
+  if(recv(c->fd, c->buf.buf + c->buf.len, result, MSG_DONTWAIT) != result)
+    return -1;
+  
+  c->buf.len += result;
+  c->buf.buf[c->buf.len] = '\0';
+  
+  if(pos)
+    return 1;
+
+  if(c->buf.len > MAX_HEADER_SIZE)
+    {
+    gavl_log(GAVL_LOG_WARNING, LOG_DOMAIN, "Request header too large");
+    return -1;
+    }
+  return 0;
   }
 
-static void client_thread_destroy(client_thread_t * th)
+/* Close connections, which timed out, and enforce the maximum number of connections.
+   Called with conns_mutex locked */
+
+static void check_conns(bg_http_server_t * s, gavl_time_t current_time)
   {
-  pthread_join(th->th, NULL);
+  int i;
+  http_conn_t * c;
+  http_conn_t * oldest;
+  
+  i = 0;
+  while(i < s->num_conns)
+    {
+    c = s->conns[i];
 
-  if(th->cleanup)
-    th->cleanup(th->priv);
-  pthread_mutex_destroy(&th->stopped_mutex);
+    if(current_time - c->last_active >
+       ((c->state == CONN_IDLE) ? KA_TIMEOUT : HEADER_TIMEOUT))
+      {
+      if(c->state == CONN_READ_HEADER)
+        gavl_log(GAVL_LOG_DEBUG, LOG_DOMAIN, "Timeout while reading request header");
+      remove_conn(s, c);
+      }
+    else
+      i++;
+    }
 
-  bg_http_connection_free(&th->conn);
+  /* Close the connections idle for the longest time. If there are no idle
+     connections, close the ones which are slowest to send their request */
   
-  free(th);
+  while(s->num_conns > s->max_ka_sockets)
+    {
+    oldest = NULL;
+    
+    for(i = 0; i < s->num_conns; i++)
+      {
+      c = s->conns[i];
+      
+      if(!oldest ||
+         (c->state > oldest->state) ||
+         ((c->state == oldest->state) && (c->last_active < oldest->last_active)))
+        oldest = c;
+      }
+    remove_conn(s, oldest);
+    }
   }
 
-/* */
+static void close_conns(bg_http_server_t * s)
+  {
+  pthread_mutex_lock(&s->conns_mutex);
+  while(s->num_conns)
+    remove_conn(s, s->conns[0]);
+  pthread_mutex_unlock(&s->conns_mutex);
+  
+  if(s->conns)
+    free(s->conns);
+  }
 
 void bg_http_server_put_connection(bg_http_server_t * s, bg_http_connection_t * conn)
   {
   if((conn->flags & BG_HTTP_REQ_KEEPALIVE) && (conn->fd > -1))
     {
-    bg_http_keepalive_push(s->ka, conn->fd, conn->current_time);
+    add_conn(s, conn->fd, CONN_IDLE);
     conn->fd = -1;
     }
   }
 
+/* Worker threads */
+
+static void handle_client_connection(bg_http_server_t * s, bg_http_connection_t * req)
+  {
+  int i;
+  int result = 0;
+  
+  gavl_log(GAVL_LOG_DEBUG, LOG_DOMAIN, "Got request: %s %s %s", req->method, req->path, req->protocol);
+  
+  req->current_time = gavl_timer_get(s->timer);
+
+  /* Handlers run in parallel. Removing a handler waits until it's not used anymore */
+  pthread_rwlock_rdlock(&s->handlers_lock);
+  
+  for(i = 0; i < s->num_handlers; i++)
+    {
+    // Wrong protocol
+    if(!(s->handlers[i].protocols & req->protocol_i)) 
+      continue;
+    
+    if(s->handlers[i].path)
+      {
+      int len = strlen(s->handlers[i].path);
+      
+      if(strncmp(s->handlers[i].path, req->path, len))
+        continue;
+
+      req->path+=len;
+
+      result = s->handlers[i].func(req, s->handlers[i].data);
+      break;
+      }
+    else
+      {
+      if((result = s->handlers[i].func(req, s->handlers[i].data)))
+        break;
+      }
+    }
+  pthread_rwlock_unlock(&s->handlers_lock);
+  
+  if(!result) // 404
+    gavl_http_response_init(&req->res, req->protocol, 404, "Not Found");
+
+  /* Send response (if not already done) */
+  bg_http_server_write_res(s, req);
+  bg_http_server_put_connection(s, req);
+  
+  /* Cleanup */
+  bg_http_connection_free(req);
+  }
+
+static void * worker_func(void * data)
+  {
+  bg_http_connection_t req;
+  bg_http_server_t * s = data;
+
+  pthread_mutex_lock(&s->jobs_mutex);
+
+  while(1)
+    {
+    while(!s->num_jobs && !s->jobs_quit)
+      pthread_cond_wait(&s->jobs_cond, &s->jobs_mutex);
+
+    if(s->jobs_quit)
+      break;
+
+    memcpy(&req, &s->jobs[s->jobs_start], sizeof(req));
+    s->jobs_start = (s->jobs_start + 1) % MAX_JOBS;
+    s->num_jobs--;
+    
+    pthread_mutex_unlock(&s->jobs_mutex);
+    handle_client_connection(s, &req);
+    pthread_mutex_lock(&s->jobs_mutex);
+    }
+  
+  pthread_mutex_unlock(&s->jobs_mutex);
+  return NULL;
+  }
+
+static void start_workers(bg_http_server_t * s)
+  {
+  int i;
+  
+  s->jobs = calloc(MAX_JOBS, sizeof(*s->jobs));
+  s->workers = calloc(s->num_workers, sizeof(*s->workers));
+
+  for(i = 0; i < s->num_workers; i++)
+    pthread_create(&s->workers[i], NULL, worker_func, s);
+  }
+
+static void stop_workers(bg_http_server_t * s)
+  {
+  int i;
+
+  if(!s->workers)
+    return;
+  
+  pthread_mutex_lock(&s->jobs_mutex);
+  s->jobs_quit = 1;
+  pthread_cond_broadcast(&s->jobs_cond);
+  pthread_mutex_unlock(&s->jobs_mutex);
+
+  for(i = 0; i < s->num_workers; i++)
+    pthread_join(s->workers[i], NULL);
+  
+  free(s->workers);
+  s->workers = NULL;
+  
+  /* Requests not handled anymore */
+  while(s->num_jobs)
+    {
+    bg_http_connection_free(&s->jobs[s->jobs_start]);
+    s->jobs_start = (s->jobs_start + 1) % MAX_JOBS;
+    s->num_jobs--;
+    }
+  free(s->jobs);
+  }
+
+/* Pass a complete request to the workers. Called with conns_mutex locked
+   from the thread calling bg_http_server_iteration() */
+
+static void dispatch_request(bg_http_server_t * s, http_conn_t * c)
+  {
+  bg_http_connection_t req;
+  int fd = c->fd;
+  
+  bg_http_connection_init(&req);
+
+  /* The connection is owned by the request from now on */
+  epoll_ctl(s->efd, EPOLL_CTL_DEL, fd, NULL);
+  c->fd = -1;
+  
+  if(!bg_http_connection_parse_req(&req, fd, (const char*)c->buf.buf))
+    {
+    gavl_log(GAVL_LOG_DEBUG, LOG_DOMAIN, "Couldn't parse request");
+    remove_conn(s, c);
+    return;
+    }
+  remove_conn(s, c);
+  
+  /* There is space, see jobs_full() */
+  pthread_mutex_lock(&s->jobs_mutex);
+  memcpy(&s->jobs[(s->jobs_start + s->num_jobs) % MAX_JOBS], &req, sizeof(req));
+  s->num_jobs++;
+  pthread_cond_signal(&s->jobs_cond);
+  pthread_mutex_unlock(&s->jobs_mutex);
+  }
+
+static int jobs_full(bg_http_server_t * s)
+  {
+  int ret;
+  pthread_mutex_lock(&s->jobs_mutex);
+  ret = (s->num_jobs == MAX_JOBS);
+  pthread_mutex_unlock(&s->jobs_mutex);
+  return ret;
+  }
+
 #define STATIC_PATH_HTTP  "h"
 #define STATIC_PATH_LOCAL "l"
 
@@ -376,11 +947,20 @@ bg_http_server_t * bg_http_server_create(void)
   {
   bg_http_server_t * ret;
   ret = calloc(1, sizeof(*ret));
-  ret->max_ka_sockets = 10;
+  ret->max_ka_sockets = 1024;
+  ret->num_workers = 4;
+  ret->max_client_threads = 16;
+  ret->efd = -1;
+  ret->wfd = -1;
   ret->timer = gavl_timer_create();
 
   pthread_mutex_init(&ret->threads_mutex, NULL);
-  pthread_mutex_init(&ret->handlers_mutex, NULL);
+  pthread_cond_init(&ret->threads_cond, NULL);
+  pthread_mutex_init(&ret->conns_mutex, NULL);
+  pthread_mutex_init(&ret->jobs_mutex, NULL);
+  pthread_cond_init(&ret->jobs_cond, NULL);
+  pthread_rwlock_init(&ret->handlers_lock, NULL);
+  pthread_mutex_init(&ret->headers_mutex, NULL);
 
   if(!bg_http_server)
     bg_http_server = ret;
@@ -397,6 +977,15 @@ void bg_http_server_destroy(bg_http_server_t * s)
   {
   int i;
 
+  stop_workers(s);
+  stop_client_threads(s);
+  close_conns(s);
+  
+  if(s->efd >= 0)
+    close(s->efd);
+  if(s->wfd >= 0)
+    close(s->wfd);
+  
   if(s->dirs)
     bg_media_dirs_destroy(s->dirs);
   
@@ -411,9 +1000,6 @@ void bg_http_server_destroy(bg_http_server_t * s)
   if(s->root_file)
     free(s->root_file);
   
-  if(s->ka)
-    bg_http_keepalive_destroy(s->ka);
-
   for(i = 0; i < s->num_handlers; i++)
     {
     if(s->handlers[i].path)
@@ -443,7 +1029,12 @@ void bg_http_server_destroy(bg_http_server_t * s)
   gavl_array_free(&s->static_dirs);
 
   pthread_mutex_destroy(&s->threads_mutex);
-  pthread_mutex_destroy(&s->handlers_mutex);
+  pthread_cond_destroy(&s->threads_cond);
+  pthread_mutex_destroy(&s->conns_mutex);
+  pthread_mutex_destroy(&s->jobs_mutex);
+  pthread_cond_destroy(&s->jobs_cond);
+  pthread_rwlock_destroy(&s->handlers_lock);
+  pthread_mutex_destroy(&s->headers_mutex);
 
   
   free(s);
@@ -504,16 +1095,16 @@ int bg_http_server_has_path(bg_http_server_t * s, const char * path)
   {
   int i;
 
-  pthread_mutex_lock(&s->handlers_mutex);
+  pthread_rwlock_rdlock(&s->handlers_lock);
   for(i = 0; i < s->num_handlers; i++)
     {
     if(s->handlers[i].path && !strncmp(path, s->handlers[i].path, strlen(s->handlers[i].path)))
       {
-      pthread_mutex_unlock(&s->handlers_mutex);
+      pthread_rwlock_unlock(&s->handlers_lock);
       return 1;
       }
     }
-  pthread_mutex_unlock(&s->handlers_mutex);
+  pthread_rwlock_unlock(&s->handlers_lock);
   return 0;
   }
 
@@ -535,6 +1126,10 @@ void bg_http_server_set_parameter(void * sp, const char * name, const gavl_value
     s->bind_addr = gavl_strrep(s->bind_addr, val->v.str);
   else if(!strcmp(name, "max_keepalive_sockets"))
     s->max_ka_sockets = val->v.i;
+  else if(!strcmp(name, "num_workers"))
+    s->num_workers = val->v.i;
+  else if(!strcmp(name, "max_client_threads"))
+    s->max_client_threads = val->v.i;
   }
 
 int bg_http_server_get_parameter(void * sp, const char * name, gavl_value_t * val)
@@ -556,7 +1151,7 @@ void bg_http_server_add_handler(bg_http_server_t * s,
                                 const char * path, // E.g. /static/ can be NULL
                                 void * data)
   {
-  pthread_mutex_lock(&s->handlers_mutex);
+  pthread_rwlock_wrlock(&s->handlers_lock);
   
   if(s->num_handlers + 1 > s->handlers_alloc)
     {
@@ -569,7 +1164,7 @@ void bg_http_server_add_handler(bg_http_server_t * s,
   s->handlers[s->num_handlers].path = gavl_strdup(path);
   s->handlers[s->num_handlers].data = data;
   s->num_handlers++;
-  pthread_mutex_unlock(&s->handlers_mutex);
+  pthread_rwlock_unlock(&s->handlers_lock);
   }
 
 void bg_http_server_remove_handler(bg_http_server_t * s,
@@ -578,8 +1173,8 @@ void bg_http_server_remove_handler(bg_http_server_t * s,
   {
   int idx = -1;
   int i = 0;
-  pthread_mutex_lock(&s->handlers_mutex);
-  while(s->handlers[i].func)
+  pthread_rwlock_wrlock(&s->handlers_lock);
+  while(i < s->num_handlers)
     {
     if((s->handlers[i].data == data) ||
        (s->handlers[i].path && path && !strcmp(s->handlers[i].path, path)))
@@ -592,7 +1187,7 @@ void bg_http_server_remove_handler(bg_http_server_t * s,
 
   if(idx < 0)
     {
-    pthread_mutex_unlock(&s->handlers_mutex);
+    pthread_rwlock_unlock(&s->handlers_lock);
     return;
     }
   if(s->handlers[idx].path)
@@ -603,7 +1198,7 @@ void bg_http_server_remove_handler(bg_http_server_t * s,
             s->handlers + idx + 1,
             sizeof(*s->handlers) * (s->num_handlers-1 - idx));
   s->num_handlers--;
-  pthread_mutex_unlock(&s->handlers_mutex);
+  pthread_rwlock_unlock(&s->handlers_lock);
   }
 
 int bg_http_server_start(bg_http_server_t * s)
@@ -611,8 +1206,6 @@ int bg_http_server_start(bg_http_server_t * s)
   const char * addr;
   char addr_str[GAVL_SOCKET_ADDR_STR_LEN];
   
-  s->ka = bg_http_keepalive_create(s->max_ka_sockets);
-
   s->addr = gavl_socket_address_create();
   s->remote_addr = gavl_socket_address_create();
   
@@ -630,7 +1223,7 @@ int bg_http_server_start(bg_http_server_t * s)
     }
   
   s->fd = gavl_listen_socket_create_inet(s->addr, 0 /* Port */,
-                                       10 /* queue_size */,
+                                       128 /* queue_size */,
                                        GAVL_SOCKET_REUSEADDR /* flags */);
   
   if(s->fd < 0)
@@ -656,67 +1249,19 @@ int bg_http_server_start(bg_http_server_t * s)
 
   if(s->dirs)
     bg_media_dirs_set_root_uri(s->dirs, s->root_url);
-  
-  gavl_timer_start(s->timer);
-  
-  return 1;
-  }
 
-static void handle_client_connection(bg_http_server_t * s, int fd)
-  {
-  int i;
-  int result = 0;
-  
-  if(!bg_http_connection_read_req(&s->req, fd, TIMEOUT))
+  if((s->efd = epoll_create1(EPOLL_CLOEXEC)) < 0)
     {
-    gavl_log(GAVL_LOG_DEBUG, LOG_DOMAIN, "Couldn't read request");
-    goto fail;
-    }
-
-  gavl_log(GAVL_LOG_DEBUG, LOG_DOMAIN, "Got request: %s %s %s", s->req.method, s->req.path, s->req.protocol);
-  
-  s->req.current_time = gavl_timer_get(s->timer);
-
-  pthread_mutex_lock(&s->handlers_mutex);
-  
-  for(i = 0; i < s->num_handlers; i++)
-    {
-    // Wrong protocol
-    if(!(s->handlers[i].protocols & s->req.protocol_i)) 
-      continue;
-    
-    if(s->handlers[i].path)
-      {
-      int len = strlen(s->handlers[i].path);
-      
-      if(strncmp(s->handlers[i].path, s->req.path, len))
-        continue;
-
-      s->req.path+=len;
-
-      result = s->handlers[i].func(&s->req, s->handlers[i].data);
-      break;
-      }
-    else
-      {
-      if((result = s->handlers[i].func(&s->req, s->handlers[i].data)))
-        break;
-      }
+    gavl_log(GAVL_LOG_ERROR, LOG_DOMAIN, "epoll_create1 failed: %s", strerror(errno));
+    return 0;
     }
-  pthread_mutex_unlock(&s->handlers_mutex);
   
-  if(!result) // 404
-    gavl_http_response_init(&s->req.res, s->req.protocol, 404, "Not Found");
+  gavl_timer_start(s->timer);
 
-  /* Send response (if not already done) */
-  bg_http_server_write_res(s, &s->req);
-  bg_http_server_put_connection(s, &s->req);
-  
-  fail:
-  
-  /* Cleanup */
-  bg_http_connection_free(&s->req);
+  start_workers(s);
+  start_client_threads(s);
   
+  return 1;
   }
 
 /* 
@@ -729,52 +1274,105 @@ int bg_http_server_iteration(bg_http_server_t * s)
   int i;
   int fd;
   int ret = 0;
-  int ka_idx;
+  int num_events;
+  http_conn_t * c;
+  gavl_time_t current_time;
+  struct epoll_event events[MAX_EVENTS];
   char addr_str[GAVL_SOCKET_ADDR_STR_LEN];
 
-  /* Remove finished clients */
-  pthread_mutex_lock(&s->threads_mutex);
+  if(s->wfd >= 0)
+    ret += clients_wakeup(s);
+  
+  if(s->efd < 0)
+    return ret;
+  
+  while((fd = gavl_listen_socket_accept(s->fd, 0, s->remote_addr)) >= 0)
+    {
+    gavl_log(GAVL_LOG_DEBUG, LOG_DOMAIN, "Got connection from %s fd: %d",
+           gavl_socket_address_to_string(s->remote_addr, addr_str), fd);
+    add_conn(s, fd, CONN_READ_HEADER);
+    ret++;
+    }
 
-  i = 0;
+  current_time = gavl_timer_get(s->timer);
   
-  while(i < s->num_threads)
+  /* Only this thread removes connections, so the pointers returned by
+     epoll_wait() stay valid */
+  
+  while((num_events = epoll_wait(s->efd, events, MAX_EVENTS, 0)) > 0)
     {
-    if(client_thread_finished(s->threads[i]))
+    pthread_mutex_lock(&s->conns_mutex);
+    
+    for(i = 0; i < num_events; i++)
       {
-      client_thread_destroy(s->threads[i]);
-      if(i < s->num_threads-1)
+      c = events[i].data.ptr;
+
+      /* All workers busy: Leave the remaining sockets alone until
+         the next iteration */
+      if(jobs_full(s))
         {
-        memmove(s->threads + i, s->threads + i + 1,
-                (s->num_threads - 1 - i) * sizeof(*s->threads));
+        num_events = 0;
+        break;
+        }
+
+      if(c->state == CONN_IDLE)
+        {
+        gavl_log(GAVL_LOG_DEBUG, LOG_DOMAIN, "Reusing keep-alive connection");
+        c->state = CONN_READ_HEADER;
+        c->last_active = current_time;
         }
-      s->num_threads--;
+      
+      switch(conn_read_header(c))
+        {
+        case 1:
+          dispatch_request(s, c);
+          break;
+        case -1:
+          remove_conn(s, c);
+          break;
+        }
+      ret++;
       }
-    else
-      i++;
-    }
 
-  pthread_mutex_unlock(&s->threads_mutex);
-  
-  ka_idx = 0;
+    pthread_mutex_unlock(&s->conns_mutex);
+
+    if(num_events < MAX_EVENTS)
+      break;
+    }
   
-  while((fd = bg_http_keepalive_accept(s->ka, gavl_timer_get(s->timer),
-                                       &ka_idx)) >= 0)
+  if(current_time - s->last_check > GAVL_TIME_SCALE)
     {
-    gavl_log(GAVL_LOG_DEBUG, LOG_DOMAIN, "Reusing keep-alive connection");
-    handle_client_connection(s, fd);
-    ret++;
+    pthread_mutex_lock(&s->conns_mutex);
+    check_conns(s, current_time);
+    pthread_mutex_unlock(&s->conns_mutex);
+    s->last_check = current_time;
     }
-  while((fd = gavl_listen_socket_accept(s->fd, 0, s->remote_addr)) >= 0)
+  
+  return ret;
+  }
+
+int bg_http_server_wait(bg_http_server_t * s, bg_msg_sink_t ** sinks, int num_sinks, int timeout)
+  {
+  int fds[3];
+  int num_fds = 0;
+
+  /* If all workers are busy, pending connections and requests are not read
+     by bg_http_server_iteration(). Their fds would stay readable, so we
+     wait only for the timeout then. */
+  if(!s->jobs || !jobs_full(s))
     {
-    gavl_log(GAVL_LOG_DEBUG, LOG_DOMAIN, "Got connection from %s fd: %d",
-           gavl_socket_address_to_string(s->remote_addr, addr_str), fd);
-    handle_client_connection(s, fd);
-    ret++;
+    if(s->fd >= 0)
+      fds[num_fds++] = s->fd;
+
+    /* The epoll fd becomes readable if any connection has data */
+    if(s->efd >= 0)
+      fds[num_fds++] = s->efd;
     }
 
+  if(s->wfd >= 0)
+    fds[num_fds++] = s->wfd;
   
-  
-  return ret;
+  return bg_msg_sinks_wait(sinks, num_sinks, fds, num_fds, timeout);
   }
 
 gavl_time_t bg_http_server_get_time(bg_http_server_t * s)
@@ -245,6 +245,31 @@ void bg_mdb_set_browse_children_request(gavl_msg_t * msg, const char * id,
     }
   }
 
+void bg_mdb_set_search_request(gavl_msg_t * msg, const char * ctx_id,
+                               const gavl_dictionary_t * query,
+                               const gavl_array_t * sort,
+                               int start, int num)
+  {
+  gavl_msg_set_id_ns(msg, BG_FUNC_DB_SEARCH, BG_MSG_NS_DB);
+
+  if(ctx_id)
+    gavl_dictionary_set_string(&msg->header, GAVL_MSG_CONTEXT_ID, ctx_id);
+
+  gavl_msg_set_arg_dictionary(msg, 0, query);
+
+  if(sort)
+    gavl_msg_set_arg_array(msg, 1, sort);
+  else
+    {
+    gavl_array_t arr;
+    gavl_array_init(&arr);
+    gavl_msg_set_arg_array(msg, 1, &arr);
+    }
+  
+  gavl_msg_set_arg_int(msg, 2, start);
+  gavl_msg_set_arg_int(msg, 3, num);
+  }
+
 void bg_mdb_get_browse_children_request(const gavl_msg_t * req, const char ** id,
                                         int * start, int * num, int * one_answer)
   {
@@ -459,6 +484,7 @@ static int handle_cmd(void * priv, gavl_msg_t * msg)
           break;
         case BG_FUNC_DB_ADD_SQL_DIR:
         case BG_FUNC_DB_DEL_SQL_DIR:
+        case BG_FUNC_DB_SEARCH:
           /* Forward to sql backend */
           be = be_from_name(db, MDB_BACKEND_SQLITE);
           break;
@@ -870,6 +896,18 @@ static int handle_be_msg(void * priv, gavl_msg_t * msg)
             }
           
           break;
+        case BG_RESP_DB_SEARCH:
+          if(db->srv &&
+             (arg_val = gavl_msg_get_arg_nc(msg, 0)) &&
+             (arg_arr = gavl_value_get_array_nc(arg_val)))
+            {
+            for(i = 0; i < arg_arr->num_entries; i++)
+              {
+              if((arg_dict = gavl_value_get_dictionary_nc(&arg_arr->entries[i])))
+                bg_http_server_add_playlist_uris(db->srv, arg_dict);
+              }
+            }
+          break;
         case BG_RESP_DB_BROWSE_OBJECT:
           /*
            *  ContextID: album_id
@@ -1024,10 +1062,12 @@ void bg_mdb_unexport_media_directory(bg_msg_sink_t * sink, const char * path)
 
 /* Backend thread */
 
+/* Backends with a ping function are woken up at least every 50 ms */
+#define PING_INTERVAL 50
+
 static void * backend_thread(void * data)
   {
   int ops;
-  gavl_time_t delay_time = GAVL_TIME_SCALE / 20; // 50 ms
   bg_mdb_backend_t * be = data;
 
   //  fprintf(stderr, "Backend thread\n");
@@ -1049,7 +1089,7 @@ static void * backend_thread(void * data)
     ops += bg_msg_sink_get_num(be->ctrl.cmd_sink);
     
     if(!ops)
-      gavl_time_delay(&delay_time);
+      bg_msg_sink_wait(be->ctrl.cmd_sink, be->ping_func ? PING_INTERVAL : -1);
     }
 
   //  fprintf(stderr, "Backend thread finished\n");
@@ -1060,9 +1100,12 @@ static void * backend_thread(void * data)
 static void * mdb_thread(void * data)
   {
   int ops;
-  gavl_time_t delay_time = GAVL_TIME_SCALE / 20; // 50 ms
+  int timeout;
   bg_mdb_t * mdb = data;
-  
+  bg_msg_sink_t * sinks[2];
+
+  sinks[0] = mdb->ctrl.cmd_sink;
+  sinks[1] = mdb->be_evt_sink;
   
   while(1)
     {
@@ -1090,7 +1133,19 @@ static void * mdb_thread(void * data)
       }
     
     if(!ops)
-      gavl_time_delay(&delay_time);
+      {
+      /* Sleep until the next message or until the config must be saved */
+      if(mdb->cfg_save_time != GAVL_TIME_UNDEFINED)
+        {
+        timeout = ((mdb->cfg_save_time - gavl_timer_get(mdb->timer)) * 1000) / GAVL_TIME_SCALE + 1;
+        if(timeout < 0)
+          timeout = 0;
+        }
+      else
+        timeout = -1;
+      
+      bg_msg_sinks_wait(sinks, 2, NULL, 0, timeout);
+      }
     }
   return NULL;
   }
@@ -1401,13 +1456,12 @@ bg_mdb_t * bg_mdb_create(const char * path, int do_create, int * locked)
 
   if(do_create)
     {
-    gavl_time_t delay_time = GAVL_TIME_SCALE / 10;
     /* Wait until the creation is complete */
     while(1)
       {
       bg_msg_sink_iteration(sink);
       if(!done)
-        gavl_time_delay(&delay_time);
+        bg_msg_sink_wait(sink, -1);
       else
         {
         gavl_log(GAVL_LOG_INFO, LOG_DOMAIN, "Creation completed");
@@ -1463,13 +1517,18 @@ void bg_mdb_stop(bg_mdb_t * db)
   gavl_msg_set_id_ns(msg, GAVL_CMD_QUIT, GAVL_MSG_NS_GENERIC);
   bg_msg_sink_put(db->ctrl.cmd_sink);
   pthread_join(db->th, NULL);
-  
+
+  /* Nobody can queue thumbnails anymore */
+  bg_mdb_stop_thumbnails(db);
   }
 
 void bg_mdb_destroy(bg_mdb_t * db)
   {
   int i;
   bg_controllable_t * ctrl;
+
+  /* The thumbnailer threads use db->path and db->ctrl */
+  bg_mdb_stop_thumbnails(db);
   
   if(db->cfg_save_time != GAVL_TIME_UNDEFINED)
     {
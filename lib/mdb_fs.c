@@ -60,6 +60,7 @@ typedef struct
   bg_mdb_fs_cache_t * c;
   gavl_dictionary_t config;
   fs_root_t root[NUM_ROOT];
+  int exported;
   } fs_t;
 
 static void finalize_func(bg_mdb_backend_t * be, gavl_dictionary_t * track, const char * id_prefix, const char * path_prefix)
@@ -450,15 +451,21 @@ static int ping_fs(bg_mdb_backend_t * be)
   fs_t * p = be->priv;
   int i, j;
 
-  for(i = 0; i < NUM_ROOT; i++)
+  if(!p->exported)
     {
-    for(j = 0; j < p->root[i].dirs->num_entries; j++)
+    for(i = 0; i < NUM_ROOT; i++)
       {
-      bg_mdb_export_media_directory(be->ctrl.evt_sink, gavl_string_array_get(p->root[i].dirs, j));
+      for(j = 0; j < p->root[i].dirs->num_entries; j++)
+        {
+        bg_mdb_export_media_directory(be->ctrl.evt_sink, gavl_string_array_get(p->root[i].dirs, j));
+        }
       }
+    p->exported = 1;
+    ret++;
     }
-  
-  be->ping_func = NULL;
+
+  /* Apply changes in watched directories */
+  ret += bg_mdb_fs_cache_ping(p->c);
   
   return ret;
   }
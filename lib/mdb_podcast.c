@@ -22,6 +22,7 @@
 
 #define _GNU_SOURCE
 
+#include <pthread.h>
 #include <time.h>
 #include <string.h>
 #include <unistd.h>
@@ -729,11 +730,17 @@ static int load_items_ard(bg_mdb_backend_t * b, const char * uri, char * md5,
   return ret;
   }
 
+/* Returns one of the BG_HTTP_FETCH_* values. The http cache entry is
+   returned in cache_info and must be stored after the items were saved */
+
 static int load_items(bg_mdb_backend_t * b, const char * uri, char * md5,
-                      gavl_dictionary_t * channel, gavl_array_t * items)
+                      gavl_dictionary_t * channel, gavl_array_t * items,
+                      gavl_dictionary_t * cache_info, int revalidate)
   {
-  int ret = 0;
+  int ret = BG_HTTP_FETCH_ERROR;
+  int result;
   int idx = 0;
+  gavl_buffer_t buf;
   xmlNodePtr image;
   gavl_dictionary_t * channel_m;
   gavl_dictionary_t * mdb_dict;
@@ -753,14 +760,32 @@ static int load_items(bg_mdb_backend_t * b, const char * uri, char * md5,
     return load_items_ard(b, uri, md5, channel, items);
     }
 
-  doc = bg_xml_from_url(uri, NULL);
+  gavl_buffer_init(&buf);
+  
+  result = bg_http_cache_fetch(uri, &buf, NULL, cache_info, revalidate);
+
+  if(result == BG_HTTP_FETCH_NOT_MODIFIED)
+    {
+    gavl_buffer_free(&buf);
+    return result;
+    }
+  
+  if(result == BG_HTTP_FETCH_LOADED)
+    doc = xmlReadMemory((char*)buf.buf, buf.len, NULL, NULL,
+                        XML_PARSE_RECOVER |
+                        XML_PARSE_NOERROR |
+                        XML_PARSE_NOWARNING);
+  else
+    doc = NULL;
+  
+  gavl_buffer_free(&buf);
   
   //  podcasts_t * priv = b->priv;
   
   if(!doc)
     {
     gavl_log(GAVL_LOG_ERROR, LOG_DOMAIN, "Could not load %s", uri);
-    return 0;
+    return BG_HTTP_FETCH_ERROR;
     }
   //  fprintf(stderr, "Loaded %s\n", uri);
 
@@ -961,7 +986,7 @@ static int load_items(bg_mdb_backend_t * b, const char * uri, char * md5,
   
   gavl_track_set_num_children(channel, num_containers, items->num_entries);
   
-  ret = 1;
+  ret = BG_HTTP_FETCH_LOADED;
   
   fail:
   
@@ -999,6 +1024,7 @@ static void save_subscriptions(bg_mdb_backend_t * b)
 static int subscribe(bg_mdb_backend_t * b, int i, const gavl_value_t * val, gavl_array_t * root_arr)
   {
   gavl_value_t channel_val;
+  gavl_dictionary_t cache_info;
   gavl_dictionary_t * channel;
   char md5[33];
   char * filename;
@@ -1034,10 +1060,11 @@ static int subscribe(bg_mdb_backend_t * b, int i, const gavl_value_t * val, gavl
   gavl_value_init(&channel_val);
   channel = gavl_value_set_dictionary(&channel_val);
   gavl_array_init(&items);
+  gavl_dictionary_init(&cache_info);
   
   bg_get_filename_hash(uri, md5);
 
-  if(load_items(b, uri, md5, channel, &items))
+  if(load_items(b, uri, md5, channel, &items, &cache_info, 0) == BG_HTTP_FETCH_LOADED)
     {
     gavl_string_array_insert_at(&p->subscriptions, i, uri);
     save_subscriptions(b);
@@ -1047,6 +1074,8 @@ static int subscribe(bg_mdb_backend_t * b, int i, const gavl_value_t * val, gavl
     bg_array_save_xml(&items, filename, "items");
     free(filename);
 
+    bg_http_cache_put(&cache_info);
+
     gavl_array_splice_val_nocopy(root_arr, i, 0, &channel_val);
     ret = 1;
     }
@@ -1056,6 +1085,7 @@ static int subscribe(bg_mdb_backend_t * b, int i, const gavl_value_t * val, gavl
     }
 
   gavl_array_free(&items);
+  gavl_dictionary_free(&cache_info);
   return ret;
   }
 
@@ -1081,20 +1111,94 @@ static void unsubscribe(bg_mdb_backend_t * b, int idx, gavl_array_t * index)
 #define TIME_EQUAL     1
 #define TIME_DIFFERENT 2
 
+/*
+ *  The feeds are loaded by a pool of threads. The results are consumed
+ *  in order by the backend thread, which sends the events and saves
+ *  the data. Unchanged feeds are detected by a conditional GET.
+ */
+
+/* Maximum number of concurrent connections */
+#define FEED_THREADS 8
+
+typedef struct
+  {
+  const char * uri;
+  char md5[33];
+
+  gavl_dictionary_t channel;
+  gavl_array_t items;
+  gavl_dictionary_t cache_info; // Stored after the feed was applied
+
+  int result;
+  int done;
+  } feed_job_t;
+
+typedef struct
+  {
+  bg_mdb_backend_t * b;
+  
+  feed_job_t * jobs;
+  int num_jobs;
+  int next_job;
+
+  int revalidate;
+  
+  pthread_mutex_t mutex;
+  pthread_cond_t cond; // Worker finished a job
+  } feed_pool_t;
+
+static void * feed_thread(void * data)
+  {
+  int idx;
+  int result;
+  feed_job_t * job;
+  feed_pool_t * fp = data;
+  
+  while(1)
+    {
+    pthread_mutex_lock(&fp->mutex);
+    
+    if(fp->next_job >= fp->num_jobs)
+      {
+      pthread_mutex_unlock(&fp->mutex);
+      break;
+      }
+    idx = fp->next_job++;
+    pthread_mutex_unlock(&fp->mutex);
+
+    job = &fp->jobs[idx];
+    
+    result = load_items(fp->b, job->uri, job->md5,
+                        &job->channel, &job->items, &job->cache_info,
+                        fp->revalidate);
+    
+    pthread_mutex_lock(&fp->mutex);
+    job->result = result;
+    job->done = 1;
+    pthread_cond_broadcast(&fp->cond);
+    pthread_mutex_unlock(&fp->mutex);
+    }
+  return NULL;
+  }
+
 static int check_update(bg_mdb_backend_t * b)
   {
   int i;
   podcasts_t * p = b->priv;
   char * filename;
   gavl_array_t idx;
-  //  gavl_array_t items;
   gavl_time_t current_time;
+  gavl_time_t start_time;
   
   int ret = 0;
-  char md5[33];
 
   int num_changed = 0;
+  int num_unmodified = 0;
   int full = 0;
+  int num_threads;
+  
+  feed_pool_t fp;
+  pthread_t * threads;
   
   current_time = gavl_timer_get(p->timer);
   
@@ -1113,14 +1217,46 @@ static int check_update(bg_mdb_backend_t * b)
   if(!access(filename, R_OK))
     bg_array_load_xml(&idx, filename, "items");
   free(filename);
+
+  memset(&fp, 0, sizeof(fp));
+
+  fp.b = b;
+  fp.revalidate = !full;
+  fp.num_jobs = p->subscriptions.num_entries;
+  
+  if(fp.num_jobs > idx.num_entries)
+    fp.num_jobs = idx.num_entries;
+
+  if(fp.num_jobs)
+    fp.jobs = calloc(fp.num_jobs, sizeof(*fp.jobs));
+  
+  for(i = 0; i < fp.num_jobs; i++)
+    {
+    fp.jobs[i].uri = gavl_string_array_get(&p->subscriptions, i);
+    bg_get_filename_hash(fp.jobs[i].uri, fp.jobs[i].md5);
+    }
+  
+  num_threads = FEED_THREADS;
+  if(num_threads > fp.num_jobs)
+    num_threads = fp.num_jobs;
+  
+  pthread_mutex_init(&fp.mutex, NULL);
+  pthread_cond_init(&fp.cond, NULL);
+
+  start_time = current_time;
+  
+  threads = calloc(num_threads, sizeof(*threads));
+  for(i = 0; i < num_threads; i++)
+    pthread_create(&threads[i], NULL, feed_thread, &fp);
   
   /* Load feeds */
-  for(i = 0; i < p->subscriptions.num_entries; i++)
+  for(i = 0; i < fp.num_jobs; i++)
     {
     int pub_time = TIME_MISSING;
     int build_time = TIME_MISSING;
     
     const char * uri;
+    const char * md5;
     
     const char * str;
     const char * str_new;
@@ -1129,34 +1265,42 @@ static int check_update(bg_mdb_backend_t * b)
 
     gavl_dictionary_t * channel;
     
-    gavl_array_t items_new;
-    gavl_dictionary_t channel_new;
+    gavl_array_t * items_new;
+    gavl_dictionary_t * channel_new;
 
     gavl_msg_t * evt;
     int old_num = 0;
+    feed_job_t * job = &fp.jobs[i];
     
-    gavl_array_init(&items_new);
-    gavl_dictionary_init(&channel_new);
-
-    if(i >= idx.num_entries)
-      break;
+    pthread_mutex_lock(&fp.mutex);
+    while(!job->done)
+      pthread_cond_wait(&fp.cond, &fp.mutex);
+    pthread_mutex_unlock(&fp.mutex);
+
+    uri = job->uri;
+    md5 = job->md5;
+    items_new = &job->items;
+    channel_new = &job->channel;
     
-    if(!(channel = gavl_value_get_dictionary_nc(&idx.entries[i])) ||
-       !(m = gavl_dictionary_get_dictionary_create(channel, GAVL_META_METADATA)))
+    if(job->result == BG_HTTP_FETCH_NOT_MODIFIED)
+      {
+      gavl_log(GAVL_LOG_DEBUG, LOG_DOMAIN, "Channel %s not modified", uri);
+      num_unmodified++;
       continue;
-
-    uri = gavl_string_array_get(&p->subscriptions, i);
-
-    bg_get_filename_hash(uri, md5);
+      }
     
-    if(!load_items(b, uri, md5, &channel_new, &items_new))
+    if((job->result != BG_HTTP_FETCH_LOADED) ||
+       !(channel = gavl_value_get_dictionary_nc(&idx.entries[i])) ||
+       !(m = gavl_dictionary_get_dictionary_create(channel, GAVL_META_METADATA)))
       {
-      gavl_dictionary_reset(&channel_new);
-      gavl_array_reset(&items_new);
+      /* Keep the old cache entry so the feed is loaded again next time */
+      gavl_array_free(items_new);
+      gavl_dictionary_free(channel_new);
+      gavl_dictionary_free(&job->cache_info);
       continue;
       }
     
-    m_new = gavl_track_get_metadata(&channel_new);
+    m_new = gavl_track_get_metadata(channel_new);
     
     if(!full)
       {
@@ -1183,8 +1327,10 @@ static int check_update(bg_mdb_backend_t * b)
          (build_time != TIME_DIFFERENT))
         {
         /* Feed didn't change */
-        gavl_array_free(&items_new);
-        gavl_dictionary_free(&channel_new);
+        bg_http_cache_put(&job->cache_info);
+        gavl_array_free(items_new);
+        gavl_dictionary_free(channel_new);
+        gavl_dictionary_free(&job->cache_info);
         continue;
         }
     
@@ -1197,7 +1343,7 @@ static int check_update(bg_mdb_backend_t * b)
     old_num = gavl_track_get_num_children(channel);
     
     gavl_dictionary_free(channel);
-    gavl_dictionary_move(channel, &channel_new);
+    gavl_dictionary_move(channel, channel_new);
 
     /* Update channel */
     
@@ -1212,7 +1358,7 @@ static int check_update(bg_mdb_backend_t * b)
     
     /* Update channel items */
 
-    bg_mdb_tracks_finalize(&items_new, 0, items_new.num_entries);
+    bg_mdb_tracks_finalize(items_new, 0, items_new->num_entries);
     
     evt = bg_msg_sink_get(b->ctrl.evt_sink);
 
@@ -1225,20 +1371,32 @@ static int check_update(bg_mdb_backend_t * b)
   
     gavl_msg_set_arg_int(evt, 0, 0); // idx
     gavl_msg_set_arg_int(evt, 1, old_num); // del
-    gavl_msg_set_arg_array(evt, 2, &items_new);
+    gavl_msg_set_arg_array(evt, 2, items_new);
     
     bg_msg_sink_put(b->ctrl.evt_sink);
     
 
     /* Save items */
     filename = gavl_sprintf("%s/%s", p->dir, md5);
-    bg_array_save_xml(&items_new, filename, "items");
+    bg_array_save_xml(items_new, filename, "items");
     free(filename);
+
+    bg_http_cache_put(&job->cache_info);
     
-    gavl_array_free(&items_new);
-    gavl_dictionary_free(&channel_new);
+    gavl_array_free(items_new);
+    gavl_dictionary_free(channel_new);
+    gavl_dictionary_free(&job->cache_info);
     }
 
+  for(i = 0; i < num_threads; i++)
+    pthread_join(threads[i], NULL);
+
+  free(threads);
+  if(fp.jobs)
+    free(fp.jobs);
+  pthread_mutex_destroy(&fp.mutex);
+  pthread_cond_destroy(&fp.cond);
+  
   if(num_changed)
     {
     /* Save index */
@@ -1253,6 +1411,12 @@ static int check_update(bg_mdb_backend_t * b)
   
   p->last_update_time = gavl_timer_get(p->timer);
 
+  gavl_log(GAVL_LOG_INFO, LOG_DOMAIN,
+           "Checked %d feeds with %d threads in %.1f s: %d changed, %d not modified",
+           fp.num_jobs, num_threads,
+           gavl_time_to_seconds(p->last_update_time - start_time),
+           num_changed, num_unmodified);
+  
   if(full)
     {
     p->last_full_update_time = p->last_update_time;
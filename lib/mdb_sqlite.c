@@ -24,10 +24,13 @@
 
 #include <unistd.h>
 #include <string.h>
+#include <stdio.h>
 #include <dirent.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <ctype.h>
+#include <locale.h>
+#include <pthread.h>
 
 #include <gmerlin/mdb.h>
 #include <gmerlin/utils.h>
@@ -49,6 +52,10 @@
 #define META_DB_ID       "DBID"
 #define META_SCAN_DIR_ID "ScanDirID"
 
+/* strxfrm() of the search title (see bg_sqlite_init_strcoll()). Not part
+   of the column tables, it is always the last column */
+#define META_SORT_KEY    "SortKey"
+
 #define META_POSTER_ID    "PosterID"
 #define META_WALLPAPER_ID "WallaperID"
 #define META_COVER_ID     "CoverID"
@@ -64,6 +71,89 @@
 #define DEL_FLAG_CHILDREN (1<<1)
 #define DEL_FLAG_PARENT   (1<<2)
 
+/* Maximum number of prepared statements kept per connection */
+#define STMT_CACHE_SIZE 256
+
+/* Schema version (stored as PRAGMA user_version). Version history:
+ * 0: Initial schema without indexes
+ * 1: Indexes for array tables, parent IDs, scan dirs, dates, URIs and names
+ * 2: Sort keys for the search titles
+ */
+#define SCHEMA_VERSION  2
+
+/* Connection settings */
+#define CACHE_SIZE_KB   32768
+#define MMAP_SIZE       (256*1024*1024)
+
+/* Browse queries, which are also passed to bg_mdb_explain_queries() */
+
+#define SQL_SONGS_BY_ARTIST \
+  "SELECT songs."META_DB_ID" FROM songs INNER JOIN " \
+  "song_artists_arr " \
+  "ON songs."META_DB_ID" = song_artists_arr.OBJ_ID " \
+  "WHERE song_artists_arr.NAME_ID = ?1 ORDER BY " \
+  "songs."META_SORT_KEY";"
+
+#define SQL_ARTISTS_BY_GENRE \
+  "SELECT ID FROM song_artists WHERE ID in (SELECT DISTINCT song_artists_arr.NAME_ID " \
+  "FROM song_artists_arr INNER JOIN song_genres_arr " \
+  "ON song_artists_arr.OBJ_ID = song_genres_arr.OBJ_ID " \
+  "WHERE song_genres_arr.NAME_ID = ?1) ORDER BY NAME;"
+
+#define SQL_SONGS_BY_GENRE_ARTIST \
+  "SELECT song_artists_arr.OBJ_ID " \
+  "FROM song_artists_arr INNER JOIN song_genres_arr " \
+  "ON song_artists_arr.OBJ_ID = song_genres_arr.OBJ_ID " \
+  "INNER JOIN songs " \
+  "ON songs."META_DB_ID" = song_genres_arr.OBJ_ID " \
+  "WHERE song_genres_arr.NAME_ID = ?1 AND " \
+  "song_artists_arr.NAME_ID = ?2 ORDER BY songs."META_SORT_KEY";"
+
+#define SQL_SONG_YEARS \
+  "SELECT DISTINCT substr("GAVL_META_DATE", 1, 4) FROM " \
+  "songs ORDER BY "GAVL_META_DATE";"
+
+#define SQL_SONGS_BY_YEAR \
+  "select "META_DB_ID" FROM " \
+  "songs WHERE " \
+  GAVL_META_DATE" GLOB (?1 || '*') " \
+  "ORDER BY "META_SORT_KEY";"
+
+#define SQL_SONGS_BY_GENRE_YEAR \
+  "SELECT songs."META_DB_ID" FROM " \
+  "songs INNER JOIN song_genres_arr ON " \
+  "song_genres_arr.OBJ_ID = songs.DBID WHERE " \
+  "song_genres_arr.NAME_ID = ?1 AND songs."GAVL_META_DATE" GLOB (?2 || '*') " \
+  "ORDER BY songs."META_SORT_KEY";"
+
+#define SQL_ALBUMS_BY_ARTIST \
+  "SELECT albums."META_DB_ID" FROM albums INNER JOIN album_artists_arr " \
+  "ON albums."META_DB_ID" = album_artists_arr.OBJ_ID " \
+  "WHERE album_artists_arr.NAME_ID = ?1 " \
+  "ORDER BY albums."GAVL_META_DATE", albums."META_SORT_KEY";"
+
+#define SQL_ALBUM_TRACKS \
+  "SELECT "META_DB_ID" FROM songs " \
+  "WHERE "META_PARENT_ID" = ?1 " \
+  "ORDER BY "GAVL_META_TRACKNUMBER";"
+
+#define SQL_MOVIES_BY_GENRE \
+  "SELECT movies."META_DB_ID" FROM movies INNER JOIN " \
+  "movie_genres_arr " \
+  "ON movies."META_DB_ID" = movie_genres_arr.OBJ_ID " \
+  "WHERE movie_genres_arr.NAME_ID = ?1 ORDER BY " \
+  "movies."META_SORT_KEY";"
+
+#define SQL_MOVIE_PARTS \
+  "SELECT "GAVL_META_APPROX_DURATION", " \
+  GAVL_META_URI", " \
+  GAVL_META_MIMETYPE", " \
+  GAVL_META_MTIME" FROM movie_parts WHERE " \
+  META_PARENT_ID" = ?1 ORDER BY "GAVL_META_IDX";"
+
+#define SQL_SEASON_EPISODES \
+  "SELECT "META_DB_ID" FROM episodes WHERE "META_PARENT_ID" = ?1 ORDER BY "GAVL_META_EPISODENUMBER";"
+
 /* Folder structure generated completely on the fly
  * using SQL queries
  * Queries, which take too long are cached
@@ -577,7 +667,8 @@ typedef struct
 typedef struct
   {
   sqlite3 * db;
-
+  bg_sqlite_stmt_cache_t * stmts;
+  
   int num_added;
   int num_removed;
 
@@ -595,15 +686,30 @@ typedef struct
   const char * songs_id;
 
   int have_params;
+
+  /* Threads for loading media infos, 0: Number of CPUs */
+  int probe_threads;
+  
+  /* Objects loaded in advance by browse_children() */
+  gavl_dictionary_t prefetch;
+  /* Types of the prefetched objects, keyed by database ID */
+  gavl_dictionary_t prefetch_types;
+
+  /* Watches the scan directories for changes */
+  bg_fs_watch_t * watch;
+  int watch_init;
+
+  /* Full text index is there */
+  int have_fts;
   
   } sqlite_priv_t;
 
 static void set_image_type(bg_mdb_backend_t * b, int64_t image_id, int type)
   {
-  char * sql;
   sqlite_priv_t * p = b->priv;
-  sql = gavl_sprintf("UPDATE images SET "META_IMAGE_TYPE" = %d WHERE "META_DB_ID" = %"PRId64";", type, image_id);
-  bg_sqlite_exec(p->db, sql, NULL, NULL);
+  bg_sqlite_exec_cached(p->stmts,
+                        "UPDATE images SET "META_IMAGE_TYPE" = ?1 WHERE "META_DB_ID" = ?2;",
+                        NULL, NULL, 2, (int64_t)type, image_id);
   }
 
 
@@ -769,3515 +875,3861 @@ static int create_tables(bg_mdb_backend_t * b)
   return 1;
   }
 
-static void append_cols(sqlite_priv_t * p,
-                        const gavl_dictionary_t * dict, const column_t * cols,
-                        char ** sql, char ** sql2, int first)
+/* Schema migration */
+
+static int create_index(sqlite_priv_t * p, const char * table, const char * cols, const char * suffix)
+  {
+  int result;
+  char * sql;
+
+  sql = gavl_sprintf("CREATE INDEX IF NOT EXISTS %s_%s ON %s(%s);", table, suffix, table, cols);
+  result = bg_sqlite_exec(p->db, sql, NULL, NULL);
+  free(sql);
+  return result;
+  }
+
+static int create_id_table_index(sqlite_priv_t * p, const column_t * cols)
   {
   int i = 0;
-  int num = 0;
-  const gavl_value_t * val;
-  char * tmp_string;
 
-  if(first)
-    num = 0;
-  else
-    num = 1;
-  
   while(cols[i].name)
     {
-    if(!(val = gavl_dictionary_get(dict, cols[i].name)))
-      {
-      i++;
-      continue;
-      }
-    
-    switch(cols[i].type)
-      {
-      case GAVL_TYPE_INT:
-        {
-        int val_i;
-        if(gavl_value_get_int(val, &val_i))
-          {
-          if(num)
-            *sql = gavl_strcat(*sql, ", ");
-          *sql = gavl_strcat(*sql, cols[i].name);
+    if(cols[i].id_table && !create_index(p, cols[i].id_table, "NAME", "name"))
+      return 0;
+    i++;
+    }
+  return 1;
+  }
 
-          if(num)
-            *sql2 = gavl_strcat(*sql2, ", ");
-          
-          
-          tmp_string = sqlite3_mprintf("%d", val_i);
-          
-          *sql2 = gavl_strcat(*sql2, tmp_string);
-          sqlite3_free(tmp_string);
-          num++;
-          }
-        }
-        break;
-      case GAVL_TYPE_LONG:
-        {
-        int64_t val_l;
-        if(gavl_value_get_long(val, &val_l))
-          {
-          if(num)
-            *sql = gavl_strcat(*sql, ", ");
-          *sql = gavl_strcat(*sql, cols[i].name);
+/* Version 1: Indexes for the joins and lookups done while browsing and scanning */
 
-          if(num)
-            *sql2 = gavl_strcat(*sql2, ", ");
-          
-          tmp_string = sqlite3_mprintf("%" PRId64, val_l);
+static int create_indexes(sqlite_priv_t * p)
+  {
+  int i, j;
+  const obj_table_t * tab;
+  
+  i = 0;
+  while(obj_tables[i].table_name)
+    {
+    tab = &obj_tables[i];
 
-          *sql2 = gavl_strcat(*sql2, tmp_string);
-          sqlite3_free(tmp_string);
-          num++;
-          }
-        }
-        break;
-      case GAVL_TYPE_STRING:
+    /* Array tables are joined in both directions. The ID (rowid) is
+       part of each index, so these are covering */
+    if(tab->arrays)
+      {
+      j = 0;
+      while(tab->arrays[j].name)
         {
-        const char * val_s;
-        if((val_s = gavl_value_get_string(val)))
-          {
-          if(num)
-            *sql = gavl_strcat(*sql, ", ");
-          *sql = gavl_strcat(*sql, cols[i].name);
-          
-          if(num)
-            *sql2 = gavl_strcat(*sql2, ", ");
-          
-          if(cols[i].id_table)
-            tmp_string = sqlite3_mprintf("%"PRId64,
-                                         bg_sqlite_string_to_id_add(p->db,
-                                                                    cols[i].id_table,
-                                                                    "ID", "NAME", val_s));
-          else
-            tmp_string = sqlite3_mprintf("%Q", val_s);
-          
-          *sql2 = gavl_strcat(*sql2, tmp_string);
-          sqlite3_free(tmp_string);
-          num++;
-          }
+        if(!create_index(p, tab->arrays[j].array_table_name, "OBJ_ID, NAME_ID", "obj") ||
+           !create_index(p, tab->arrays[j].array_table_name, "NAME_ID, OBJ_ID", "name") ||
+           !create_index(p, tab->arrays[j].id_table_name, "NAME", "name"))
+          return 0;
+        j++;
         }
-        break;
-      default:
-        break;
       }
+    
+    if(has_col(tab, META_PARENT_ID) &&
+       !create_index(p, tab->table_name, META_PARENT_ID, "parent"))
+      return 0;
+
+    if(has_col(tab, META_SCAN_DIR_ID) &&
+       !create_index(p, tab->table_name, META_SCAN_DIR_ID, "scandir"))
+      return 0;
+    
+    if(has_col(tab, GAVL_META_DATE) &&
+       !create_index(p, tab->table_name, GAVL_META_DATE, "date"))
+      return 0;
+    
+    if(has_src_col(tab, GAVL_META_URI) &&
+       !create_index(p, tab->table_name, GAVL_META_URI, "uri"))
+      return 0;
+
+    if(!create_id_table_index(p, tab->cols) ||
+       (tab->src_cols && !create_id_table_index(p, tab->src_cols)))
+      return 0;
+    
     i++;
     }
+
+  if(!create_index(p, "objects", "TYPE", "type"))
+    return 0;
+  
+  return 1;
   }
 
-static void append_array(sqlite_priv_t * p,
-                         const gavl_dictionary_t * dict, const array_t * arr, int64_t object_id)
+/* Version 2: Sort keys */
+
+static int create_sort_keys(sqlite_priv_t * p)
   {
-  int j = 0, result;
-  int64_t string_id;
-  int64_t row_id = -1;
+  int i;
+  int result;
   char * sql;
   
-  const char * str;
-  
-  while((str = gavl_dictionary_get_string_array(dict, arr->name, j)))
+  i = 0;
+  while(obj_tables[i].table_name)
     {
-    //    if(!strcmp(arr->name, GAVL_META_SUBTITLE_LANGUAGES))
-    //      fprintf(stderr, "Blupp\n");
-    
-    
-    string_id = bg_sqlite_string_to_id_add(p->db, arr->id_table_name, "ID", "NAME", str);
-
-
-    if(row_id < 0)
-      row_id = bg_sqlite_get_max_int(p->db, arr->array_table_name, "ID");
-
-    row_id++;
-
-    sql = sqlite3_mprintf("INSERT INTO %s (ID, OBJ_ID, NAME_ID) VALUES (%"PRId64", %"PRId64", %"PRId64"); ",
-                          arr->array_table_name, row_id, object_id, string_id);
-    
-    result = bg_sqlite_exec(p->db, sql, NULL, NULL);
-    sqlite3_free(sql);
-    if(!result)
-      return;
-    
-    j++;
+    if(has_col(&obj_tables[i], GAVL_META_SEARCH_TITLE))
+      {
+      sql = gavl_sprintf("ALTER TABLE %s ADD COLUMN "META_SORT_KEY" BLOB;",
+                         obj_tables[i].table_name);
+      result = bg_sqlite_exec(p->db, sql, NULL, NULL);
+      free(sql);
+      
+      if(!result ||
+         !create_index(p, obj_tables[i].table_name, META_SORT_KEY, "sortkey"))
+        return 0;
+      }
+    i++;
     }
+  
+  return bg_sqlite_exec(p->db,
+                        "CREATE TABLE IF NOT EXISTS properties(NAME TEXT PRIMARY KEY, VALUE TEXT);",
+                        NULL, NULL);
   }
 
-static int64_t create_object(sqlite_priv_t * p, type_id_t type)
+/* Sort keys depend on LC_COLLATE, so they are recalculated when it changes.
+   Only rows whose key actually differs are written, which keeps the index
+   updates small if the old and new locale collate (mostly) the same way. */
+
+static void update_sort_keys(sqlite_priv_t * p)
   {
-  int result;
+  int i;
+  int changed = 0;
   char * sql;
-  int64_t id;
+  char * locale = NULL;
+  const char * cur_locale;
 
-  if((id = bg_sqlite_get_max_int(p->db, "objects", META_DB_ID)) < 0)
-    return -1;
+  if(!(cur_locale = setlocale(LC_COLLATE, NULL)))
+    return;
+  
+  bg_sqlite_exec(p->db, "SELECT VALUE FROM properties WHERE NAME = 'collate_locale';",
+                 bg_sqlite_string_callback, &locale);
 
-  id++;
+  if(locale && !strcmp(locale, cur_locale))
+    {
+    free(locale);
+    return;
+    }
 
-  sql = sqlite3_mprintf("INSERT INTO OBJECTS (" META_DB_ID ", TYPE) VALUES (%"PRId64", %d); ",
-                        id, type);
+  gavl_log(GAVL_LOG_INFO, LOG_DOMAIN, "Calculating sort keys for locale %s", cur_locale);
+  
+  bg_sqlite_start_transaction(p->db);
+  
+  i = 0;
+  while(obj_tables[i].table_name)
+    {
+    if(has_col(&obj_tables[i], GAVL_META_SEARCH_TITLE))
+      {
+      sql = gavl_sprintf("UPDATE %s SET "META_SORT_KEY" = sortkey("GAVL_META_SEARCH_TITLE") "
+                         "WHERE "META_SORT_KEY" IS NOT sortkey("GAVL_META_SEARCH_TITLE");",
+                         obj_tables[i].table_name);
+      if(bg_sqlite_exec(p->db, sql, NULL, NULL))
+        changed += sqlite3_changes(p->db);
+      free(sql);
+      }
+    i++;
+    }
 
-  result = bg_sqlite_exec(p->db, sql, NULL, NULL);
+  sql = sqlite3_mprintf("INSERT OR REPLACE INTO properties (NAME, VALUE) VALUES ('collate_locale', %Q);",
+                        cur_locale);
+  bg_sqlite_exec(p->db, sql, NULL, NULL);
   sqlite3_free(sql);
-  if(!result)
-    return -1;
   
-  p->num_added++;
+  bg_sqlite_end_transaction(p->db);
+
+  gavl_log(GAVL_LOG_INFO, LOG_DOMAIN, "Updated %d sort keys", changed);
   
-  return id;
+  if(locale)
+    free(locale);
   }
 
-/* Automatically create containers for some types */
+/* Full text index for searching. FTS5 is an optional sqlite module, so the
+   table is not part of the versioned schema. It's created (and filled from
+   the object tables) if it's missing. The rowid is the DBID of the object. */
 
-static void set_dict_value(bg_mdb_backend_t * be,
-                           gavl_dictionary_t * dict,
-                           const column_t * col,
-                           const char * val)
+#define FTS_TABLE "fulltext"
+
+#define FTS_COL_INDEXED (1<<0)
+#define FTS_COL_MULTI   (1<<1) // Multiple values separated by FTS_SEPARATOR
+#define FTS_COL_INT     (1<<2)
+
+#define FTS_SEPARATOR "; "
+
+static const struct
   {
-  sqlite_priv_t * p;
-  
-  if(!val)
-    return;
+  const char * tag;
+  const char * col;
+  int flags;
+  }
+fts_cols[] =
+  {
+    { GAVL_META_TITLE,       "Title",       FTS_COL_INDEXED },
+    { GAVL_META_ARTIST,      "Artist",      FTS_COL_INDEXED | FTS_COL_MULTI },
+    { GAVL_META_DIRECTOR,    "Artist",      FTS_COL_INDEXED | FTS_COL_MULTI },
+    { GAVL_META_ACTOR,       "Artist",      FTS_COL_INDEXED | FTS_COL_MULTI },
+    { GAVL_META_ALBUM,       "Album",       FTS_COL_INDEXED },
+    { GAVL_META_SHOW,        "Album",       FTS_COL_INDEXED },
+    { GAVL_META_GENRE,       "Genre",       FTS_COL_INDEXED | FTS_COL_MULTI },
+    { GAVL_META_DATE,        "Date",        0 },
+    { GAVL_META_TRACKNUMBER, "TrackNumber", FTS_COL_INT },
+    { /* End */ }
+  };
 
-  p = be->priv;
-  
-  switch(col->type)
+static int fts_get_col(const char * tag)
+  {
+  int i = 0;
+
+  while(fts_cols[i].tag)
     {
-    case GAVL_TYPE_INT:
-      {
-      int val_i = atoi(val);
-      gavl_dictionary_set_int(dict, col->name, val_i);
-      }
-      break;
-    case GAVL_TYPE_LONG:
-      {
-      int64_t val_l = strtoll(val, NULL, 10);
-      gavl_dictionary_set_long(dict, col->name, val_l);
-      }
-      break;
-    case GAVL_TYPE_STRING:
-      if(col->id_table)
-        {
-        int64_t val_l = strtoll(val, NULL, 10);
-        gavl_dictionary_set_string_nocopy(dict, col->name,
-                                          bg_sqlite_id_to_string(p->db, col->id_table,
-                                                                 "NAME", "ID", val_l));
-        }
-      else
-        gavl_dictionary_set_string(dict, col->name, val);
-      break;
-    default:
-      break;
+    if(!strcmp(fts_cols[i].tag, tag))
+      return i;
+    i++;
     }
+  return -1;
   }
 
-static int query_object_callback(void * data, int argc, char **argv, char **azColName)
+static int fts_is_indexed(type_id_t type)
   {
-  int i;
-  int j;
-  gavl_dictionary_t * m;
-  query_t * q = data;
-  
-  q->obj = gavl_dictionary_create();
-  m = gavl_dictionary_get_dictionary_create(q->obj, GAVL_META_METADATA);
-  
-  for(i = 0; i < argc; i++)
+  switch(type)
     {
-    j = 0;
-    while(q->table->cols[j].name)
-      {
-      if(!strcasecmp(azColName[i], q->table->cols[j].name))
-        {
-        set_dict_value(q->be, m, &q->table->cols[j], argv[i]);
-        break;
-        }
-      j++;
-      }
+    case TYPE_SONG:
+    case TYPE_ALBUM:
+    case TYPE_TV_SHOW:
+    case TYPE_TV_EPISODE:
+    case TYPE_MOVIE:
+      return 1;
+    default:
+      break;
     }
   return 0;
   }
 
-static int query_object_callback_full(void * data, int argc, char **argv, char **azColName)
+static const array_t * get_array(const obj_table_t * tab, const char * name)
   {
-  int arg_idx;
-  int col_idx;
+  int i = 0;
 
-  gavl_dictionary_t * m;
-  query_t * q = data;
+  if(!tab->arrays)
+    return NULL;
   
-  q->obj   = gavl_dictionary_create();
-
-  m = gavl_dictionary_get_dictionary_create(q->obj, GAVL_META_METADATA);
-  
-  arg_idx = 0;
-  col_idx = 0;
-  while(q->table->cols[col_idx].name)
+  while(tab->arrays[i].name)
     {
-    set_dict_value(q->be, m, &q->table->cols[col_idx], argv[arg_idx]);
-    col_idx++;
-    arg_idx++;
+    if(!strcmp(tab->arrays[i].name, name))
+      return &tab->arrays[i];
+    i++;
     }
+  return NULL;
+  }
 
-  if(q->table->src_cols)
-    {
-    gavl_dictionary_t * src;
+/* Subquery, which concatenates all array values for a column */
 
-    col_idx = 0;
-    src = gavl_metadata_add_src(m, GAVL_META_SRC, NULL, NULL);
-    
-    while(q->table->src_cols[col_idx].name)
+static char * fts_array_sql(const obj_table_t * tab, const char * col)
+  {
+  int i = 0;
+  char * tmp_string;
+  char * ret = NULL;
+  const array_t * arr;
+  
+  while(fts_cols[i].tag)
+    {
+    if(!strcmp(fts_cols[i].col, col) &&
+       (arr = get_array(tab, fts_cols[i].tag)))
       {
-      set_dict_value(q->be, src, &q->table->src_cols[col_idx], argv[arg_idx]);
-      col_idx++;
-      arg_idx++;
+      tmp_string = gavl_sprintf("SELECT NAME FROM %s WHERE ID IN "
+                                "(SELECT NAME_ID FROM %s WHERE OBJ_ID = %s."META_DB_ID")",
+                                arr->id_table_name, arr->array_table_name, tab->table_name);
+      if(ret)
+        {
+        ret = gavl_strcat(ret, " UNION ALL ");
+        ret = gavl_strcat(ret, tmp_string);
+        free(tmp_string);
+        }
+      else
+        ret = tmp_string;
       }
+    i++;
     }
-  return 0;
+
+  if(!ret)
+    return gavl_strdup("NULL");
+
+  tmp_string = gavl_sprintf("(SELECT group_concat(NAME, '"FTS_SEPARATOR"') FROM (%s))", ret);
+  free(ret);
+  return tmp_string;
   }
 
+/* INSERT statement, which copies the full text columns of a table */
 
-static int query_array_callback(void * data, int argc, char **argv, char **azColName)
+static char * fts_insert_sql(const obj_table_t * tab)
   {
-  char * tmp_string;
-  
-  gavl_dictionary_t * m;
-  query_t * q = data;
-  m = gavl_track_get_metadata_nc(q->obj);
-  gavl_dictionary_append_string_array(m, q->tag, argv[0]);
+  char * ret;
+  char * artist;
+  char * genre;
+  const char * album;
+  
+  if(tab->type == TYPE_SONG)
+    album = "(SELECT albums."GAVL_META_TITLE" FROM albums WHERE "
+      "albums."META_DB_ID" = songs."META_PARENT_ID")";
+  else if(tab->type == TYPE_TV_EPISODE)
+    album = "(SELECT shows."GAVL_META_TITLE" FROM shows INNER JOIN seasons "
+      "ON shows."META_DB_ID" = seasons."META_PARENT_ID" "
+      "WHERE seasons."META_DB_ID" = episodes."META_PARENT_ID")";
+  else
+    album = "NULL";
+    
+  artist = fts_array_sql(tab, "Artist");
+  genre  = fts_array_sql(tab, "Genre");
+    
+  ret = gavl_sprintf("INSERT INTO "FTS_TABLE" (rowid, Title, Artist, Album, Genre, Date, TrackNumber) "
+                     "SELECT %s."META_DB_ID", %s, %s, %s, %s, %s, %s FROM %s",
+                     tab->table_name,
+                     has_col(tab, GAVL_META_TITLE) ? GAVL_META_TITLE : "NULL",
+                     artist, album, genre,
+                     has_col(tab, GAVL_META_DATE) ? "NULLIF("GAVL_META_DATE", '"DATE_UNDEFINED"')" : "NULL",
+                     has_col(tab, GAVL_META_TRACKNUMBER) ? GAVL_META_TRACKNUMBER : "NULL",
+                     tab->table_name);
+  free(artist);
+  free(genre);
+  return ret;
+  }
 
-  tmp_string = gavl_sprintf("%s"GAVL_META_ID, q->tag);
-  gavl_dictionary_append_string_array(m, tmp_string, argv[1]);
-  free(tmp_string);
+static int fts_fill(sqlite_priv_t * p)
+  {
+  int i;
+  int result;
+  char * sql;
+  const obj_table_t * tab;
   
-  return 0;
+  i = 0;
+  while(obj_tables[i].table_name)
+    {
+    tab = &obj_tables[i];
+    i++;
+    
+    if(!fts_is_indexed(tab->type))
+      continue;
+
+    sql = fts_insert_sql(tab);
+    sql = gavl_strcat(sql, ";");
+    result = bg_sqlite_exec(p->db, sql, NULL, NULL);
+    free(sql);
+
+    if(!result)
+      return 0;
+    }
+  return 1;
   }
 
-static void set_image_url(gavl_dictionary_t * m,
-                          const gavl_dictionary_t * image_obj,
-                          const char * key)
+/* Re-read the full text rows of the objects in tab matching cond (with ?1 = id) */
+
+static void fts_refresh(sqlite_priv_t * p, const obj_table_t * tab, const char * cond, int64_t id)
   {
-  gavl_dictionary_t * src;
-  src = gavl_metadata_add_src(m, key, NULL, NULL);
-  
-  image_obj = gavl_track_get_src(image_obj, GAVL_META_SRC, 0, NULL, NULL);
+  char * sql;
+
+  sql = gavl_sprintf("DELETE FROM "FTS_TABLE" WHERE rowid IN "
+                     "(SELECT %s."META_DB_ID" FROM %s WHERE %s);",
+                     tab->table_name, tab->table_name, cond);
+  bg_sqlite_exec_cached(p->stmts, sql, NULL, NULL, 1, id);
+  free(sql);
+
+  sql = fts_insert_sql(tab);
+  sql = gavl_strcat(sql, " WHERE ");
+  sql = gavl_strcat(sql, cond);
+  sql = gavl_strcat(sql, ";");
+  bg_sqlite_exec_cached(p->stmts, sql, NULL, NULL, 1, id);
+  free(sql);
+  }
+
+static char * fts_join(const gavl_dictionary_t * m, const obj_table_t * tab, const char * col)
+  {
+  int i, j;
+  const char * var;
+  char * ret = NULL;
   
-  gavl_dictionary_copy(src, image_obj);
+  i = 0;
+  while(fts_cols[i].tag)
+    {
+    if(!strcmp(fts_cols[i].col, col) && get_array(tab, fts_cols[i].tag))
+      {
+      j = 0;
+      while((var = gavl_dictionary_get_string_array(m, fts_cols[i].tag, j)))
+        {
+        if(ret)
+          {
+          ret = gavl_strcat(ret, FTS_SEPARATOR);
+          ret = gavl_strcat(ret, var);
+          }
+        else
+          ret = gavl_strdup(var);
+        j++;
+        }
+      }
+    i++;
+    }
+  return ret;
   }
 
+static const char * fts_get_album(const obj_table_t * tab, const gavl_dictionary_t * m)
+  {
+  if(tab->type == TYPE_SONG)
+    return gavl_dictionary_get_string(m, GAVL_META_ALBUM);
+  else if(tab->type == TYPE_TV_EPISODE)
+    return gavl_dictionary_get_string(m, GAVL_META_SHOW);
+  return NULL;
+  }
 
-/*
-      sql = sqlite3_mprintf("SELECT "GAVL_META_APPROX_DURTION", "
-                            GAVL_META_URI", "
-                            META_MIMETYPE_ID", "
-                            GAVL_META_MTIME" FROM movie_parts WHERE "
-                            META_PARENT_ID" = %"PRId64" ORDER BY "GAVL_META_IDX";", id);
-  
-  
- */
+/* Check, which indexed columns of an updated object differ from the full text row */
 
 typedef struct
   {
-  gavl_dictionary_t * obj;
-  sqlite3 * db;
-  } query_part_t;
-  
+  const obj_table_t * tab;
+  const gavl_dictionary_t * m;
+  int found;
+  int changed;
+  int title_changed;
+  } fts_check_t;
 
-static int query_part_callback(void * data, int argc, char **argv, char **azColName)
+static int fts_str_differs(const char * s1, const char * s2)
   {
+  if(s1 && s2)
+    return !!strcmp(s1, s2);
+  return (s1 != s2);
+  }
+
+static int fts_check_callback(void * data, int argc, char **argv, char **azColName)
+  {
+  int track;
+  const char * date = NULL;
+  char * track_str = NULL;
+  char * artist;
+  char * genre;
+  fts_check_t * c = data;
+
+  c->found = 1;
   
-  gavl_dictionary_t * part;
-  
-  //  gavl_dictionary_t * m;
-  char * mimetype;
-  query_part_t * q = data;
-  int64_t mimetype_id;
-  int64_t duration;
-  int64_t mtime;
-  const char * uri;
-  gavl_dictionary_t * src;
+  if(fts_str_differs(argv[0], gavl_dictionary_get_string(c->m, GAVL_META_TITLE)))
+    {
+    c->title_changed = 1;
+    c->changed = 1;
+    }
   
-  duration    = strtoll(argv[0], NULL, 10);
-  uri         = argv[1];
-  mimetype_id = strtoll(argv[2], NULL, 10);
-  mtime       = strtoll(argv[3], NULL, 10);
+  if(has_col(c->tab, GAVL_META_DATE) &&
+     (date = gavl_dictionary_get_string(c->m, GAVL_META_DATE)) &&
+     !strcmp(date, DATE_UNDEFINED))
+    date = NULL;
+
+  if(has_col(c->tab, GAVL_META_TRACKNUMBER) &&
+     gavl_dictionary_get_int(c->m, GAVL_META_TRACKNUMBER, &track))
+    track_str = gavl_sprintf("%d", track);
+
+  artist = fts_join(c->m, c->tab, "Artist");
+  genre  = fts_join(c->m, c->tab, "Genre");
+  
+  if(fts_str_differs(argv[1], artist) ||
+     fts_str_differs(argv[2], fts_get_album(c->tab, c->m)) ||
+     fts_str_differs(argv[3], genre) ||
+     fts_str_differs(argv[4], date) ||
+     fts_str_differs(argv[5], track_str))
+    c->changed = 1;
+
+  if(track_str)
+    free(track_str);
+  if(artist)
+    free(artist);
+  if(genre)
+    free(genre);
+  return 0;
+  }
+
+/* Update the full text index after an object was changed. Songs and
+   episodes also contain the album- or show title */
+
+static void fts_update(sqlite_priv_t * p, const obj_table_t * tab,
+                       const gavl_dictionary_t * m, int64_t id)
+  {
+  fts_check_t c;
   
-  mimetype = bg_sqlite_id_to_string(q->db, "movie_mimetypes", "NAME", "ID", mimetype_id);
+  if(!p->have_fts || !fts_is_indexed(tab->type))
+    return;
+
+  /* Parents are updated for each added child, mostly without touching
+     the indexed columns */
   
-  //  m = gavl_track_get_metadata_nc(q->obj);
+  memset(&c, 0, sizeof(c));
+  c.tab = tab;
+  c.m = m;
   
-  //  src = gavl_metadata_get_src(m, GAVL_META_SRC, 0, NULL, NULL);
-  //  parts = gavl_dictionary_get_array_nc(m, GAVL_META_PARTS);
+  bg_sqlite_exec_cached(p->stmts,
+                        "SELECT Title, Artist, Album, Genre, Date, TrackNumber FROM "FTS_TABLE" "
+                        "WHERE rowid = ?1;",
+                        fts_check_callback, &c, 1, id);
 
-  part = gavl_track_append_part(q->obj, mimetype, uri);
-  src = gavl_track_get_src_nc(part, GAVL_META_SRC, 0);
-  gavl_dictionary_set_long(src, GAVL_META_MTIME, mtime);
-  gavl_dictionary_set_long(src, GAVL_META_APPROX_DURATION, duration);
+  if(c.found && !c.changed)
+    return;
   
-  if(mimetype)
-    free(mimetype);
+  fts_refresh(p, tab, META_DB_ID" = ?1", id);
+
+  if(!c.found || !c.title_changed)
+    return;
   
-  return 0;
+  if(tab->type == TYPE_ALBUM)
+    fts_refresh(p, get_obj_table(TYPE_SONG), META_PARENT_ID" = ?1", id);
+  else if(tab->type == TYPE_TV_SHOW)
+    fts_refresh(p, get_obj_table(TYPE_TV_EPISODE),
+                META_PARENT_ID" IN (SELECT seasons."META_DB_ID" FROM seasons "
+                "WHERE seasons."META_PARENT_ID" = ?1)", id);
   }
 
-static void query_images(bg_mdb_backend_t * b,
-                         gavl_dictionary_t * m)
+static void init_fts(sqlite_priv_t * p)
   {
-  query_t q1;
-  int64_t sub_id;
-  char * sql;
-  sqlite_priv_t * p = b->priv;
+  if(bg_sqlite_get_int(p->db, "SELECT count(*) FROM sqlite_master WHERE name = '"FTS_TABLE"';") > 0)
+    {
+    p->have_fts = 1;
+    return;
+    }
 
-  memset(&q1, 0, sizeof(q1));
-  q1.be = b;
+  gavl_log(GAVL_LOG_INFO, LOG_DOMAIN, "Creating full text index");
   
-  /* Cover */
-  if(gavl_dictionary_get_long(m, META_COVER_ID, &sub_id) && (sub_id > 0))
-    {
-    q1.obj = NULL;
-    q1.table = get_obj_table(TYPE_IMAGE);
-    
-    sql = sqlite3_mprintf("SELECT * FROM images WHERE "META_DB_ID" = %"PRId64";", sub_id);
-    bg_sqlite_exec(p->db, sql, query_object_callback_full, &q1);
-    
-    sqlite3_free(sql);
+  bg_sqlite_start_transaction(p->db);
 
-    
-    if(q1.obj)
-      {
-      set_image_url(m, q1.obj, GAVL_META_COVER_URL);
-      gavl_dictionary_destroy(q1.obj);
-      q1.obj = NULL;
-      }
-    }
-  /* Poster */
-  if(gavl_dictionary_get_long(m, META_POSTER_ID, &sub_id) && (sub_id > 0))
+  if(!bg_sqlite_exec(p->db,
+                     "CREATE VIRTUAL TABLE "FTS_TABLE" USING fts5(Title, Artist, Album, Genre, "
+                     "Date UNINDEXED, TrackNumber UNINDEXED, "
+                     "tokenize = 'unicode61 remove_diacritics 2');", NULL, NULL) ||
+     !fts_fill(p))
     {
-    q1.obj = NULL;
-    q1.table = get_obj_table(TYPE_IMAGE);
-    
-    sql = sqlite3_mprintf("SELECT * FROM images WHERE "META_DB_ID" = %"PRId64";", sub_id);
-    bg_sqlite_exec(p->db, sql, query_object_callback_full, &q1);
-    sqlite3_free(sql);
-    if(q1.obj)
-      {
-      set_image_url(m, q1.obj, GAVL_META_POSTER_URL);
-      gavl_dictionary_destroy(q1.obj);
-      q1.obj = NULL;
-      }
+    bg_sqlite_exec(p->db, "ROLLBACK;", NULL, NULL);
+    gavl_log(GAVL_LOG_WARNING, LOG_DOMAIN, "Creating full text index failed, searching is disabled");
+    return;
     }
-  /* Wallapaper */
-  if(gavl_dictionary_get_long(m, META_WALLPAPER_ID, &sub_id) && (sub_id > 0))
-    {
-    q1.obj = NULL;
-    q1.table = get_obj_table(TYPE_IMAGE);
+  
+  bg_sqlite_end_transaction(p->db);
+  p->have_fts = 1;
+  }
 
-    sql = sqlite3_mprintf("SELECT * FROM images WHERE "META_DB_ID" = %"PRId64";", sub_id);
-    bg_sqlite_exec(p->db, sql, query_object_callback_full, &q1);
-    sqlite3_free(sql);
-    if(q1.obj)
-      {
-      set_image_url(m, q1.obj, GAVL_META_WALLPAPER_URL);
-      gavl_dictionary_destroy(q1.obj);
-      q1.obj = NULL;
-      }
-    }
+static void fts_add(sqlite_priv_t * p, const obj_table_t * tab,
+                    const gavl_dictionary_t * m, int64_t id)
+  {
+  int track;
+  char * artist;
+  char * genre;
+  const char * album;
+  const char * date = NULL;
+  sqlite3_stmt * st;
+  
+  if(!p->have_fts || !fts_is_indexed(tab->type))
+    return;
 
+  album = fts_get_album(tab, m);
+
+  if(has_col(tab, GAVL_META_DATE) &&
+     (date = gavl_dictionary_get_string(m, GAVL_META_DATE)) &&
+     !strcmp(date, DATE_UNDEFINED))
+    date = NULL;
+  
+  artist = fts_join(m, tab, "Artist");
+  genre  = fts_join(m, tab, "Genre");
+  
+  if((st = bg_sqlite_stmt_cache_get(p->stmts,
+                                    "INSERT INTO "FTS_TABLE" (rowid, Title, Artist, Album, Genre, Date, TrackNumber) "
+                                    "VALUES (?1, ?2, ?3, ?4, ?5, ?6, ?7);")))
+    {
+    bg_sqlite_bind_long(st, 1, id);
+    bg_sqlite_bind_string(st, 2, gavl_dictionary_get_string(m, GAVL_META_TITLE));
+    bg_sqlite_bind_string(st, 3, artist);
+    bg_sqlite_bind_string(st, 4, album);
+    bg_sqlite_bind_string(st, 5, genre);
+    bg_sqlite_bind_string(st, 6, date);
+
+    if(has_col(tab, GAVL_META_TRACKNUMBER) &&
+       gavl_dictionary_get_int(m, GAVL_META_TRACKNUMBER, &track))
+      bg_sqlite_bind_int(st, 7, track);
+    else
+      bg_sqlite_bind_string(st, 7, NULL);
+    
+    bg_sqlite_stmt_exec(p->stmts, st, NULL, NULL);
+    }
+  
+  if(artist)
+    free(artist);
+  if(genre)
+    free(genre);
   }
 
-static gavl_dictionary_t * query_sqlite_object(bg_mdb_backend_t * b, int64_t id, type_id_t type)
+static int migrate_schema(bg_mdb_backend_t * b)
   {
+  int64_t version;
   char * sql;
-  int result;
+  int result = 1;
   sqlite_priv_t * p = b->priv;
-  query_t q;
-  query_t q1;
-  gavl_dictionary_t * m;
-  int64_t sub_id;
-
   
-  memset(&q, 0, sizeof(q));
-  memset(&q1, 0, sizeof(q1));
+  if((version = bg_sqlite_get_int(p->db, "PRAGMA user_version;")) < 0)
+    return 0;
 
-  q.be = b;
-  q1.be = b;
-  
-  /* Get type */
+  if(version >= SCHEMA_VERSION)
+    return 1;
 
-  if(type < 0)
-    type = bg_sqlite_id_to_id(p->db, "OBJECTS", "TYPE", "ID", id);
+  gavl_log(GAVL_LOG_INFO, LOG_DOMAIN, "Upgrading database schema from version %"PRId64" to %d",
+           version, SCHEMA_VERSION);
   
-  if((type < 0) || !(q.table = get_obj_table(type)))
-    return 0;
+  bg_sqlite_start_transaction(p->db);
   
-  /* Query object */
-  sql = sqlite3_mprintf("SELECT * FROM %s WHERE "META_DB_ID" = %"PRId64";", q.table->table_name, id);
+  if(version < 1)
+    result = create_indexes(p);
+  if(result && (version < 2))
+    result = create_sort_keys(p);
+  
+  if(result)
+    {
+    sql = gavl_sprintf("PRAGMA user_version = %d;", SCHEMA_VERSION);
+    result = bg_sqlite_exec(p->db, sql, NULL, NULL);
+    free(sql);
+    }
 
-  result = bg_sqlite_exec(p->db, sql, query_object_callback_full, &q);
-  sqlite3_free(sql);
   if(!result)
-    return NULL;
-
-  /* Query arrays */
-  if(q.table->arrays)
     {
-    int i = 0;
-    while(q.table->arrays[i].name)
-      {
-      /* SELECT show_genres.NAME FROM
-         show_genres_arr INNER JOIN show_genres ON show_genres.ID = show_genres_arr.NAME_ID
-         WHERE show_genres_arr.OBJ_ID = 2
-         ORDER BY show_genres_arr.ID; */
-      
-      sql = sqlite3_mprintf("SELECT %s.NAME, %s.ID FROM "
-                            "%s INNER JOIN %s ON %s.ID = %s.NAME_ID "
-                            "WHERE %s.OBJ_ID = %"PRId64" ORDER BY %s.ID;",
-                            q.table->arrays[i].id_table_name,
-                            q.table->arrays[i].id_table_name,
-                            q.table->arrays[i].array_table_name,
-                            q.table->arrays[i].id_table_name,
-                            q.table->arrays[i].id_table_name,
-                            q.table->arrays[i].array_table_name,
-                            q.table->arrays[i].array_table_name,
-                            id,
-                            q.table->arrays[i].array_table_name);
-
-      //      fprintf(stderr, "Query array\n%s\n", sql);
-      
-      q.tag = q.table->arrays[i].name;
-      
-      result = bg_sqlite_exec(p->db, sql, query_array_callback, &q);
-      sqlite3_free(sql);
-      if(!result)
-        return 0;
-      
-      i++;
-      }
+    bg_sqlite_exec(p->db, "ROLLBACK;", NULL, NULL);
+    gavl_log(GAVL_LOG_ERROR, LOG_DOMAIN, "Upgrading database schema failed");
+    return 0;
     }
-
-  if(!q.obj)
-    return NULL;
   
-  m = gavl_track_get_metadata_nc(q.obj);
+  bg_sqlite_end_transaction(p->db);
+
+  /* Give the query planner statistics for the new indexes */
+  bg_sqlite_exec(p->db, "ANALYZE;", NULL, NULL);
+  return 1;
+  }
+
+static void set_pragmas(sqlite_priv_t * p)
+  {
+  char * sql;
   
-  /* Image URIs */
+  /* Readers (browse requests) don't block the writer (rescans) */
+  bg_sqlite_exec(p->db, "PRAGMA journal_mode = WAL;", NULL, NULL);
 
-  query_images(b, m);
-  /* NFO */
-  if(gavl_dictionary_get_long(m, META_NFO_ID, &sub_id) && (sub_id > 0))
-    {
-    
-    }
+  /* Safe in WAL mode: A power loss can only lose the last transactions */
+  bg_sqlite_exec(p->db, "PRAGMA synchronous = NORMAL;", NULL, NULL);
+  bg_sqlite_exec(p->db, "PRAGMA temp_store = MEMORY;", NULL, NULL);
+
+  sql = gavl_sprintf("PRAGMA cache_size = -%d;", CACHE_SIZE_KB);
+  bg_sqlite_exec(p->db, sql, NULL, NULL);
+  free(sql);
+
+  sql = gavl_sprintf("PRAGMA mmap_size = %d;", MMAP_SIZE);
+  bg_sqlite_exec(p->db, sql, NULL, NULL);
+  free(sql);
+  }
+
+/* Append column names and placeholders. The values are appended to vals
+   in the same order */
+
+static void append_cols(sqlite_priv_t * p,
+                        const gavl_dictionary_t * dict, const column_t * cols,
+                        char ** sql, char ** sql2, gavl_array_t * vals)
+  {
+  int i = 0;
+  const gavl_value_t * val;
+  gavl_value_t bind_val;
   
-  if(gavl_dictionary_get_long(m, META_PARENT_ID, &sub_id) && (sub_id > 0))
+  while(cols[i].name)
     {
-    gavl_dictionary_set_string_nocopy(m, GAVL_META_ALBUM,
-                                      bg_sqlite_id_to_string(p->db, "albums",
-                                                             GAVL_META_TITLE, META_DB_ID, sub_id));
-    }
+    if(!(val = gavl_dictionary_get(dict, cols[i].name)))
+      {
+      i++;
+      continue;
+      }
 
-  /*
-    const char * mimetype;
+    gavl_value_init(&bind_val);
+    
+    switch(cols[i].type)
+      {
+      case GAVL_TYPE_INT:
+        {
+        int val_i;
+        if(gavl_value_get_int(val, &val_i))
+          gavl_value_set_int(&bind_val, val_i);
+        }
+        break;
+      case GAVL_TYPE_LONG:
+        {
+        int64_t val_l;
+        if(gavl_value_get_long(val, &val_l))
+          gavl_value_set_long(&bind_val, val_l);
+        }
+        break;
+      case GAVL_TYPE_STRING:
+        {
+        const char * val_s;
+        if((val_s = gavl_value_get_string(val)))
+          {
+          if(cols[i].id_table)
+            gavl_value_set_long(&bind_val,
+                                bg_sqlite_string_to_id_add_cached(p->stmts,
+                                                                  cols[i].id_table,
+                                                                  "ID", "NAME", val_s));
+          else
+            gavl_value_set_string(&bind_val, val_s);
+          }
+        }
+        break;
+      default:
+        break;
+      }
 
-  */
+    if(bind_val.type != GAVL_TYPE_UNDEFINED)
+      {
+      if(vals->num_entries)
+        {
+        *sql = gavl_strcat(*sql, ", ");
+        *sql2 = gavl_strcat(*sql2, ", ");
+        }
+      *sql = gavl_strcat(*sql, cols[i].name);
+      *sql2 = gavl_strcat(*sql2, "?");
+      gavl_array_splice_val_nocopy(vals, -1, 0, &bind_val);
+      }
+    
+    i++;
+    }
+  }
+
+static void append_array(sqlite_priv_t * p,
+                         const gavl_dictionary_t * dict, const array_t * arr, int64_t object_id)
+  {
+  int j = 0, result;
+  int64_t string_id;
+  int64_t row_id = -1;
+  char * sql = NULL;
   
-  /* Parts */
+  const char * str;
   
-  if(q.obj)
+  while((str = gavl_dictionary_get_string_array(dict, arr->name, j)))
     {
-    if(type == TYPE_MOVIE)
-      {
-      query_part_t qp;
-      qp.db = p->db;
-      qp.obj = q.obj;
+    //    if(!strcmp(arr->name, GAVL_META_SUBTITLE_LANGUAGES))
+    //      fprintf(stderr, "Blupp\n");
+    
+    
+    string_id = bg_sqlite_string_to_id_add_cached(p->stmts, arr->id_table_name, "ID", "NAME", str);
 
-      sql = sqlite3_mprintf("SELECT "GAVL_META_APPROX_DURATION", "
-                            GAVL_META_URI", "
-                            GAVL_META_MIMETYPE", "
-                            GAVL_META_MTIME" FROM movie_parts WHERE "
-                            META_PARENT_ID" = %"PRId64" ORDER BY "GAVL_META_IDX";", id);
-      bg_sqlite_exec(p->db, sql, query_part_callback, &qp);
-      sqlite3_free(sql);
-      
-      gavl_dictionary_set_string(gavl_track_get_metadata_nc(q.obj), GAVL_META_CLASS,
-                                 GAVL_META_CLASS_MOVIE);
 
-      //      fprintf(stderr, "Got movie:\n");
-      //      gavl_dictionary_dump(q.obj, 2);
-      }
-    else
-      gavl_dictionary_set_string(gavl_track_get_metadata_nc(q.obj),
-                                 GAVL_META_CLASS, get_type_class(type));
+    if(row_id < 0)
+      row_id = bg_sqlite_get_max_int_cached(p->stmts, arr->array_table_name, "ID");
+
+    row_id++;
+
+    if(!sql)
+      sql = sqlite3_mprintf("INSERT INTO %s (ID, OBJ_ID, NAME_ID) VALUES (?1, ?2, ?3);",
+                            arr->array_table_name);
+    
+    result = bg_sqlite_exec_cached(p->stmts, sql, NULL, NULL, 3, row_id, object_id, string_id);
+    if(!result)
+      break;
+    
+    j++;
     }
 
-  return q.obj;
+  if(sql)
+    sqlite3_free(sql);
   }
 
-typedef struct
+static int64_t create_object(sqlite_priv_t * p, type_id_t type)
   {
-  char * sql;
-  const obj_table_t * tab;
-  } update_foreach_t;
+  int result;
+  int64_t id;
 
-static void update_foreach_func(void * priv, const char * name,
-                                const gavl_value_t * val)
-  {
-  char * tmp_string = NULL;
-  update_foreach_t * f = priv;
+  if((id = bg_sqlite_get_max_int_cached(p->stmts, "objects", META_DB_ID)) < 0)
+    return -1;
 
-  if(!strcmp(name, META_DB_ID))
-    return;
+  id++;
 
-  if(!strcmp(name, GAVL_META_NUM_CONTAINER_CHILDREN))
-    return;
+  result = bg_sqlite_exec_cached(p->stmts,
+                                 "INSERT INTO OBJECTS (" META_DB_ID ", TYPE) VALUES (?1, ?2);",
+                                 NULL, NULL, 2, id, (int64_t)type);
+  if(!result)
+    return -1;
   
-  if(!strcmp(name, GAVL_META_NUM_ITEM_CHILDREN))
+  p->num_added++;
+  
+  return id;
+  }
+
+/* Automatically create containers for some types */
+
+static void set_dict_value(bg_mdb_backend_t * be,
+                           gavl_dictionary_t * dict,
+                           const column_t * col,
+                           const char * val)
+  {
+  sqlite_priv_t * p;
+  
+  if(!val)
     return;
+
+  p = be->priv;
   
-  switch(val->type)
+  switch(col->type)
     {
     case GAVL_TYPE_INT:
-      tmp_string = sqlite3_mprintf("%s = %d", name, val->v.i);
+      {
+      int val_i = atoi(val);
+      gavl_dictionary_set_int(dict, col->name, val_i);
+      }
       break;
     case GAVL_TYPE_LONG:
-      tmp_string = sqlite3_mprintf("%s = %"PRId64, name, val->v.l);
+      {
+      int64_t val_l = strtoll(val, NULL, 10);
+      gavl_dictionary_set_long(dict, col->name, val_l);
+      }
       break;
     case GAVL_TYPE_STRING:
-      tmp_string = sqlite3_mprintf("%s = %Q", name, val->v.str);
+      if(col->id_table)
+        {
+        int64_t val_l = strtoll(val, NULL, 10);
+        gavl_dictionary_set_string_nocopy(dict, col->name,
+                                          bg_sqlite_id_to_string_cached(p->stmts, col->id_table,
+                                                                        "NAME", "ID", val_l));
+        }
+      else
+        gavl_dictionary_set_string(dict, col->name, val);
       break;
     default:
-      return;
+      break;
     }
-
-  if(!f->sql)
-    f->sql = gavl_sprintf("UPDATE %s SET ", f->tab->table_name);
-  else
-    f->sql = gavl_strcat(f->sql, ", ");
-
-  f->sql = gavl_strcat(f->sql, tmp_string);
-
-  sqlite3_free(tmp_string);
-
   }
 
-static void update_object(bg_mdb_backend_t * b,
-                          const gavl_dictionary_t * dict,
-                          const obj_table_t * tab)
+static int query_object_callback(void * data, int argc, char **argv, char **azColName)
   {
-  int64_t id;
-  update_foreach_t f;
-  char * tmp_string;
-  int result;
-  sqlite_priv_t * p = b->priv;
-  const gavl_dictionary_t * m = gavl_track_get_metadata(dict);
-
-  gavl_dictionary_get_long(m, META_DB_ID, &id);
+  int i;
+  int j;
+  gavl_dictionary_t * m;
+  query_t * q = data;
   
-  f.sql = NULL;
-  f.tab = tab;
+  q->obj = gavl_dictionary_create();
+  m = gavl_dictionary_get_dictionary_create(q->obj, GAVL_META_METADATA);
   
-  gavl_dictionary_foreach(m, update_foreach_func, &f);
+  for(i = 0; i < argc; i++)
+    {
+    j = 0;
+    while(q->table->cols[j].name)
+      {
+      if(!strcasecmp(azColName[i], q->table->cols[j].name))
+        {
+        set_dict_value(q->be, m, &q->table->cols[j], argv[i]);
+        break;
+        }
+      j++;
+      }
+    }
+  return 0;
+  }
 
-  tmp_string = gavl_sprintf(" WHERE "META_DB_ID" = %"PRId64";", id);
-  f.sql = gavl_strcat(f.sql, tmp_string);
-  free(tmp_string);
-
-  result = bg_sqlite_exec(p->db, f.sql, NULL, NULL);
-  free(f.sql);
-  if(!result)
-    return;
-  }
-
-static int64_t add_child_album(bg_mdb_backend_t * b, gavl_dictionary_t * dict)
+static int query_object_callback_full(void * data, int argc, char **argv, char **azColName)
   {
-  const char * title;
-  const char * artist;
-  const gavl_dictionary_t * m;
-  int result;
-  char * sql;
-  int64_t artist_id;
-  int64_t album_id;
-  gavl_dictionary_t album_dict;
-  gavl_dictionary_t * album_m;
-  
-  sqlite_priv_t * p = b->priv;
-
-  query_t q;
-  memset(&q, 0, sizeof(q));
-  q.be = b;
+  int arg_idx;
+  int col_idx;
 
-  //  fprintf(stderr, "add child album:\n");
-  //  gavl_dictionary_dump(dict, 2);
-  
-  m = gavl_track_get_metadata(dict);
+  gavl_dictionary_t * m;
+  query_t * q = data;
   
-  title  = gavl_dictionary_get_string(m, GAVL_META_ALBUM);
-  artist = gavl_dictionary_get_string_array(m, GAVL_META_ALBUMARTIST, 0);
+  q->obj   = gavl_dictionary_create();
 
-  artist_id = bg_sqlite_string_to_id(p->db, "album_artists", "ID", "NAME", artist);
-  if(artist_id < 0)
-    goto create_new;
-  
-  /* Query db */
-  
-  q.table = get_obj_table(TYPE_ALBUM);
-  
-  sql = sqlite3_mprintf("SELECT "META_DB_ID", "
-                        GAVL_META_APPROX_DURATION", "
-                        GAVL_META_DATE", "
-                        GAVL_META_NUM_CHILDREN" FROM albums WHERE "
-                        META_DB_ID" IN (SELECT OBJ_ID FROM album_artists_arr WHERE NAME_ID = %"PRId64") "
-                        "AND "GAVL_META_TITLE" = %Q;", artist_id, title);
+  m = gavl_dictionary_get_dictionary_create(q->obj, GAVL_META_METADATA);
   
-  result = bg_sqlite_exec(p->db, sql, query_object_callback, &q);
-
-  sqlite3_free(sql);
-  if(!result)
-    goto create_new;
+  arg_idx = 0;
+  col_idx = 0;
+  while(q->table->cols[col_idx].name)
+    {
+    set_dict_value(q->be, m, &q->table->cols[col_idx], argv[arg_idx]);
+    col_idx++;
+    arg_idx++;
+    }
 
-  else if(q.obj)
+  if(q->table->src_cols)
     {
-    const char * album_date;
-    const char * song_date;
-    int num = 0;
-    gavl_time_t container_duration = 0;
-    gavl_time_t child_duration = 0;
-    
-    album_m = gavl_track_get_metadata_nc(q.obj);
+    gavl_dictionary_t * src;
 
-    gavl_dictionary_get_int(album_m, GAVL_META_NUM_CHILDREN, &num);
-    num++;
-    gavl_dictionary_set_int(album_m, GAVL_META_NUM_CHILDREN, num);
+    col_idx = 0;
+    src = gavl_metadata_add_src(m, GAVL_META_SRC, NULL, NULL);
     
-    if((album_date = gavl_dictionary_get_string(album_m, GAVL_META_DATE)) &&
-       (song_date = gavl_dictionary_get_string(m, GAVL_META_DATE)) &&
-       strcmp(album_date, DATE_UNDEFINED) &&
-       strcmp(album_date, song_date))
+    while(q->table->src_cols[col_idx].name)
       {
-      gavl_dictionary_set_string(album_m, GAVL_META_DATE, DATE_UNDEFINED);
+      set_dict_value(q->be, src, &q->table->src_cols[col_idx], argv[arg_idx]);
+      col_idx++;
+      arg_idx++;
       }
+    }
+  return 0;
+  }
 
-    /* Duration */
-    gavl_dictionary_get_long(album_m, GAVL_META_APPROX_DURATION, &container_duration);
-    gavl_dictionary_get_long(m, GAVL_META_APPROX_DURATION, &child_duration);
-    container_duration += child_duration;
-    gavl_dictionary_set_long(album_m, GAVL_META_APPROX_DURATION, container_duration);
-
-    gavl_dictionary_get_long(album_m, META_DB_ID, &album_id);
-    
-    update_object(b, q.obj, q.table);
 
-    gavl_dictionary_destroy(q.obj);
-    q.obj = NULL;
-    return album_id;
-    }
-  
-  create_new:
-  
-  gavl_dictionary_init(&album_dict);
+static void append_array_value(gavl_dictionary_t * obj, const char * tag,
+                               const char * name, const char * id)
+  {
+  char * tmp_string;
+  gavl_dictionary_t * m;
 
-  album_m = gavl_dictionary_get_dictionary_create(&album_dict, GAVL_META_METADATA);
-  gavl_dictionary_set_string(album_m, GAVL_META_CLASS,
-                             GAVL_META_CLASS_MUSICALBUM);
-  
-  album_id = create_object(p, TYPE_ALBUM);
-  
-  bg_plugin_registry_get_container_data(bg_plugin_reg, &album_dict, dict);
+  m = gavl_track_get_metadata_nc(obj);
+  gavl_dictionary_append_string_array(m, tag, name);
 
-  gavl_track_set_num_children(&album_dict, 0, 1);
-  
-  gavl_dictionary_set(album_m, GAVL_META_APPROX_DURATION , gavl_dictionary_get(m, GAVL_META_APPROX_DURATION));
-  gavl_dictionary_set_long(album_m, META_DB_ID, album_id);
-  add_object(b, &album_dict, -1, album_id);
-  
-  gavl_dictionary_free(&album_dict);
-  
-  return album_id;
+  tmp_string = gavl_sprintf("%s"GAVL_META_ID, tag);
+  gavl_dictionary_append_string_array(m, tmp_string, id);
+  free(tmp_string);
   }
 
-static int64_t add_child_tv_show(bg_mdb_backend_t * b, gavl_dictionary_t * episode)
+static int query_array_callback(void * data, int argc, char **argv, char **azColName)
   {
-  /* TODO: Read .nfo file */
-  int64_t show_id;
-  const gavl_dictionary_t * m;
-  int result;
-  char * sql;
-  const char * show;
-  gavl_dictionary_t show_dict;
-  gavl_dictionary_t * show_m;
-
-  sqlite_priv_t * p = b->priv;
-  query_t q;
-  memset(&q, 0, sizeof(q));
-  q.be = b;
-  
-  m = gavl_track_get_metadata(episode);
+  query_t * q = data;
+  append_array_value(q->obj, q->tag, argv[0], argv[1]);
+  return 0;
+  }
 
-  q.table = get_obj_table(TYPE_TV_SHOW);
-  
-  if(!(show = gavl_dictionary_get_string(m, GAVL_META_SHOW)))
-    return -1;
+static void set_image_url(gavl_dictionary_t * m,
+                          const gavl_dictionary_t * image_obj,
+                          const char * key)
+  {
+  gavl_dictionary_t * src;
+  src = gavl_metadata_add_src(m, key, NULL, NULL);
   
-  sql = sqlite3_mprintf("SELECT "META_DB_ID", "
-                        GAVL_META_NUM_CHILDREN" FROM shows WHERE "
-                        GAVL_META_TITLE" = %Q;", show);
+  image_obj = gavl_track_get_src(image_obj, GAVL_META_SRC, 0, NULL, NULL);
   
-  result = bg_sqlite_exec(p->db, sql, query_object_callback, &q);
-  sqlite3_free(sql);
-  if(!result)
-    goto create_new;
-  else if(q.obj)
-    {
-    int num = 0;
-    gavl_dictionary_t * show_m = gavl_track_get_metadata_nc(q.obj);
+  gavl_dictionary_copy(src, image_obj);
+  }
 
-    gavl_dictionary_get_int(show_m, GAVL_META_NUM_CHILDREN, &num);
-    num++;
-    gavl_dictionary_set_int(show_m, GAVL_META_NUM_CHILDREN, num);
-    
-    gavl_dictionary_get_long(show_m, META_DB_ID, &show_id);
-    
-    update_object(b, q.obj, q.table);
 
-    gavl_dictionary_destroy(q.obj);
-    q.obj = NULL;
-    return show_id;
-    }
+/*
+      sql = sqlite3_mprintf("SELECT "GAVL_META_APPROX_DURTION", "
+                            GAVL_META_URI", "
+                            META_MIMETYPE_ID", "
+                            GAVL_META_MTIME" FROM movie_parts WHERE "
+                            META_PARENT_ID" = %"PRId64" ORDER BY "GAVL_META_IDX";", id);
   
-  create_new:
-
-  gavl_dictionary_init(&show_dict);
-  show_m = gavl_dictionary_get_dictionary_create(&show_dict, GAVL_META_METADATA);
+  
+ */
 
-  gavl_dictionary_set_string(show_m, GAVL_META_CLASS,
-                             GAVL_META_CLASS_TV_SHOW);
+typedef struct
+  {
+  gavl_dictionary_t * obj;
+  bg_sqlite_stmt_cache_t * stmts;
+  } query_part_t;
   
-  show_id = create_object(p, TYPE_TV_SHOW);
 
-  bg_plugin_registry_get_container_data(bg_plugin_reg, &show_dict, episode);
+static int query_part_callback(void * data, int argc, char **argv, char **azColName)
+  {
   
-  gavl_track_set_num_children(&show_dict, 1, 0);
+  gavl_dictionary_t * part;
   
-  gavl_dictionary_set_long(show_m, META_DB_ID, show_id);
+  //  gavl_dictionary_t * m;
+  char * mimetype;
+  query_part_t * q = data;
+  int64_t mimetype_id;
+  int64_t duration;
+  int64_t mtime;
+  const char * uri;
+  gavl_dictionary_t * src;
   
-  // gavl_dictionary_set(season_m, GAVL_META_GENRE, gavl_dictionary_get(m, GAVL_META_GENRE));
+  duration    = strtoll(argv[0], NULL, 10);
+  uri         = argv[1];
+  mimetype_id = strtoll(argv[2], NULL, 10);
+  mtime       = strtoll(argv[3], NULL, 10);
   
-  add_object(b, &show_dict, -1, show_id);
-  gavl_dictionary_free(&show_dict);
+  mimetype = bg_sqlite_id_to_string_cached(q->stmts, "movie_mimetypes", "NAME", "ID", mimetype_id);
   
-  return show_id;
-  }
-
-static int64_t add_child_tv_season(bg_mdb_backend_t * b, gavl_dictionary_t * episode)
-  {
-  const char * show;
-  int season = -1;
-  int64_t show_id;
-  int64_t season_id;
+  //  m = gavl_track_get_metadata_nc(q->obj);
   
-  const gavl_dictionary_t * m;
-  int result;
-  char * sql;
-  gavl_dictionary_t season_dict;
-  gavl_dictionary_t * season_m;
+  //  src = gavl_metadata_get_src(m, GAVL_META_SRC, 0, NULL, NULL);
+  //  parts = gavl_dictionary_get_array_nc(m, GAVL_META_PARTS);
+
+  part = gavl_track_append_part(q->obj, mimetype, uri);
+  src = gavl_track_get_src_nc(part, GAVL_META_SRC, 0);
+  gavl_dictionary_set_long(src, GAVL_META_MTIME, mtime);
+  gavl_dictionary_set_long(src, GAVL_META_APPROX_DURATION, duration);
   
-  sqlite_priv_t * p = b->priv;
-  query_t q;
-  memset(&q, 0, sizeof(q));
-  q.be = b;
+  if(mimetype)
+    free(mimetype);
   
-  m = gavl_track_get_metadata(episode);
+  return 0;
+  }
 
-  if(!(show = gavl_dictionary_get_string(m, GAVL_META_SHOW)) ||
-     !gavl_dictionary_get_int(m, GAVL_META_SEASON, &season))
-    return -1;
-  
-  show_id = bg_sqlite_string_to_id(p->db, "shows", META_DB_ID, GAVL_META_TITLE, show);
-  if(show_id < 0)
-    goto create_new;
-  
-  /* Query db */
-  
-  q.table = get_obj_table(TYPE_TV_SEASON);
-  
-  sql = sqlite3_mprintf("SELECT "META_DB_ID", "
-                        GAVL_META_APPROX_DURATION", "
-                        GAVL_META_DATE", "
-                        GAVL_META_NUM_CHILDREN" FROM seasons WHERE "
-                        META_PARENT_ID" = %"PRId64" AND "GAVL_META_SEASON" = %d;",
-                        show_id, season);
-  
-  result = bg_sqlite_exec(p->db, sql, query_object_callback, &q);
-  sqlite3_free(sql);
-  if(!result)
-    goto create_new;
+static void query_images(bg_mdb_backend_t * b,
+                         gavl_dictionary_t * m)
+  {
+  query_t q1;
+  int64_t sub_id;
+  sqlite_priv_t * p = b->priv;
 
-  else if(q.obj)
+  memset(&q1, 0, sizeof(q1));
+  q1.be = b;
+  
+  /* Cover */
+  if(gavl_dictionary_get_long(m, META_COVER_ID, &sub_id) && (sub_id > 0))
     {
-    const char * season_date;
-    const char * episode_date;
-    int num = 0;
-    gavl_time_t container_duration = 0;
-    gavl_time_t child_duration = 0;
+    q1.obj = NULL;
+    q1.table = get_obj_table(TYPE_IMAGE);
     
-    season_m = gavl_track_get_metadata_nc(q.obj);
-
-    gavl_dictionary_get_int(season_m, GAVL_META_NUM_CHILDREN, &num);
-    num++;
-    gavl_dictionary_set_int(season_m, GAVL_META_NUM_CHILDREN, num);
+    bg_sqlite_exec_cached(p->stmts, "SELECT * FROM images WHERE "META_DB_ID" = ?1;",
+                          query_object_callback_full, &q1, 1, sub_id);
     
-    if((season_date = gavl_dictionary_get_string(season_m, GAVL_META_DATE)) &&
-       (episode_date = gavl_dictionary_get_string(m, GAVL_META_DATE)))
+    if(q1.obj)
       {
-      if(strcmp(episode_date, season_date) < 0)
-        gavl_dictionary_set_string(season_m, GAVL_META_DATE, season_date);
+      set_image_url(m, q1.obj, GAVL_META_COVER_URL);
+      gavl_dictionary_destroy(q1.obj);
+      q1.obj = NULL;
       }
+    }
+  /* Poster */
+  if(gavl_dictionary_get_long(m, META_POSTER_ID, &sub_id) && (sub_id > 0))
+    {
+    q1.obj = NULL;
+    q1.table = get_obj_table(TYPE_IMAGE);
     
-    /* Duration */
-    gavl_dictionary_get_long(season_m, GAVL_META_APPROX_DURATION, &container_duration);
-    gavl_dictionary_get_long(m, GAVL_META_APPROX_DURATION, &child_duration);
-    container_duration += child_duration;
-    gavl_dictionary_set_long(season_m, GAVL_META_APPROX_DURATION, container_duration);
-
-    gavl_dictionary_get_long(season_m, META_DB_ID, &season_id);
-    
-    update_object(b, q.obj, q.table);
+    bg_sqlite_exec_cached(p->stmts, "SELECT * FROM images WHERE "META_DB_ID" = ?1;",
+                          query_object_callback_full, &q1, 1, sub_id);
+    if(q1.obj)
+      {
+      set_image_url(m, q1.obj, GAVL_META_POSTER_URL);
+      gavl_dictionary_destroy(q1.obj);
+      q1.obj = NULL;
+      }
+    }
+  /* Wallapaper */
+  if(gavl_dictionary_get_long(m, META_WALLPAPER_ID, &sub_id) && (sub_id > 0))
+    {
+    q1.obj = NULL;
+    q1.table = get_obj_table(TYPE_IMAGE);
 
-    gavl_dictionary_destroy(q.obj);
-    q.obj = NULL;
-    return season_id;
+    bg_sqlite_exec_cached(p->stmts, "SELECT * FROM images WHERE "META_DB_ID" = ?1;",
+                          query_object_callback_full, &q1, 1, sub_id);
+    if(q1.obj)
+      {
+      set_image_url(m, q1.obj, GAVL_META_WALLPAPER_URL);
+      gavl_dictionary_destroy(q1.obj);
+      q1.obj = NULL;
+      }
     }
-  
-  create_new:
 
-  show_id = add_child_tv_show(b, episode);
-  
-  gavl_dictionary_init(&season_dict);
-  season_m = gavl_dictionary_get_dictionary_create(&season_dict, GAVL_META_METADATA);
-  gavl_dictionary_set_long(season_m, META_DB_ID, season_id);
-  gavl_dictionary_set_long(season_m, META_PARENT_ID, show_id);
+  }
 
-  gavl_dictionary_set_string(season_m, GAVL_META_CLASS, GAVL_META_CLASS_TV_SEASON);
-  
-  season_id = create_object(p, TYPE_TV_SEASON);
-  
-  bg_plugin_registry_get_container_data(bg_plugin_reg, &season_dict, episode);
-  
-  gavl_dictionary_set(season_m, GAVL_META_DATE, gavl_dictionary_get(m, GAVL_META_DATE));
-  
-  gavl_track_set_num_children(&season_dict, 0, 1);
-  
-  gavl_dictionary_set(season_m, GAVL_META_APPROX_DURATION , gavl_dictionary_get(m, GAVL_META_APPROX_DURATION));
-  
-  add_object(b, &season_dict, -1, season_id);
-  
-  gavl_dictionary_free(&season_dict);
-  
-  return season_id;
-  // #endif
-  //  return -1;
+/*
+ *  Batched object queries
+ *
+ *  browse_children() loads the database objects for a page of children
+ *  with a few set based queries. The results are stored in p->prefetch
+ *  (keyed by type and database ID) and picked up by query_sqlite_object().
+ */
+
+#define PREFETCH_BATCH   256
+#define PREFETCH_KEY_LEN  32
+
+typedef struct
+  {
+  bg_mdb_backend_t * be;
+  const obj_table_t * table;
+  const char * tag;
+  gavl_dictionary_t * dict; // Temporary results (images, album titles)
+  int types;                // Bitmask of the object types found
+  } prefetch_t;
+
+static void prefetch_key(char * ret, type_id_t type, const char * id)
+  {
+  snprintf(ret, PREFETCH_KEY_LEN, "%d:%s", type, id);
   }
 
-static int64_t add_movie_part(bg_mdb_backend_t * b, const gavl_dictionary_t * part_track)
+static gavl_dictionary_t * prefetch_lookup(sqlite_priv_t * p, type_id_t type, const char * id)
   {
-  const gavl_dictionary_t * part_m;
-  int result;
-  char * sql;
-  query_t q;
-  const char * title;
-  const char * date;
-  int64_t movie_id;
+  char key[PREFETCH_KEY_LEN];
+  prefetch_key(key, type, id);
+  return gavl_dictionary_get_dictionary_nc(&p->prefetch, key);
+  }
 
-  gavl_dictionary_t movie_dict;
+/* Take an object out of the prefetch cache */
 
-  gavl_dictionary_t * movie_m;
-  sqlite_priv_t * p = b->priv;
-  
-  part_m = gavl_track_get_metadata(part_track);
-  
-  memset(&q, 0, sizeof(q));
-  q.be = b;
+static gavl_dictionary_t * prefetch_get(sqlite_priv_t * p, type_id_t type, int64_t id)
+  {
+  gavl_dictionary_t * ret;
+  gavl_dictionary_t * dict;
+  char id_str[PREFETCH_KEY_LEN];
+  char key[PREFETCH_KEY_LEN];
   
-  /* Query db */
+  if(!p->prefetch.num_entries)
+    return NULL;
 
-  title = gavl_dictionary_get_string(part_m, GAVL_META_TITLE);
-  date = gavl_dictionary_get_string(part_m, GAVL_META_DATE);
-  
-  q.table = get_obj_table(TYPE_MOVIE);
+  snprintf(id_str, PREFETCH_KEY_LEN, "%"PRId64, id);
+  prefetch_key(key, type, id_str);
   
-  sql = sqlite3_mprintf("SELECT "META_DB_ID", "
-                        GAVL_META_APPROX_DURATION" FROM movies WHERE "
-                        GAVL_META_TITLE" = %Q AND "GAVL_META_DATE" = %Q;",
-                        title, date);
-
-  result = bg_sqlite_exec(p->db, sql, query_object_callback, &q);
-  sqlite3_free(sql);
+  if(!(dict = gavl_dictionary_get_dictionary_nc(&p->prefetch, key)))
+    return NULL;
 
-  if(!result)
-    goto create_new;
-  
-  else if(q.obj)
-    {
-    gavl_time_t movie_duration = 0;
-    gavl_time_t part_duration = 0;
-    
-    movie_m = gavl_track_get_metadata_nc(q.obj);
-    gavl_dictionary_get_long(movie_m, META_DB_ID, &movie_id);
-    
-    /* Duration */
-    gavl_dictionary_get_long(movie_m, GAVL_META_APPROX_DURATION, &movie_duration);
-    gavl_dictionary_get_long(part_m, GAVL_META_APPROX_DURATION, &part_duration);
-    movie_duration += part_duration;
-    gavl_dictionary_set_long(movie_m, GAVL_META_APPROX_DURATION, movie_duration);
-    update_object(b, q.obj, q.table);
+  ret = gavl_dictionary_create();
+  gavl_dictionary_move(ret, dict);
+  gavl_dictionary_set(&p->prefetch, key, NULL);
+  return ret;
+  }
 
-    gavl_dictionary_destroy(q.obj);
-    q.obj = NULL;
-    
-    return movie_id;
-    }
-  
-  create_new:
+static int prefetch_type_callback(void * data, int argc, char **argv, char **azColName)
+  {
+  int type;
+  prefetch_t * pf = data;
+  sqlite_priv_t * p = pf->be->priv;
 
-  gavl_dictionary_init(&movie_dict);
+  type = atoi(argv[1]);
+  pf->types |= 1 << type;
+  gavl_dictionary_set_int(&p->prefetch_types, argv[0], type);
+  return 0;
+  }
 
-  gavl_dictionary_copy(&movie_dict, part_track);
+/* Type of an object from the last prefetch or -1 */
 
-  movie_m = gavl_track_get_metadata_nc(&movie_dict);
-  gavl_dictionary_set(movie_m, GAVL_META_SRC, NULL);
+static type_id_t prefetch_get_type(sqlite_priv_t * p, int64_t id)
+  {
+  int ret;
+  char id_str[PREFETCH_KEY_LEN];
 
-  gavl_dictionary_set_string(movie_m, GAVL_META_CLASS, GAVL_META_CLASS_MOVIE);
+  if(!p->prefetch_types.num_entries)
+    return -1;
   
-  movie_id = create_object(p, TYPE_MOVIE);
-  add_object(b, &movie_dict, -1, movie_id);
-  gavl_dictionary_free(&movie_dict);
+  snprintf(id_str, PREFETCH_KEY_LEN, "%"PRId64, id);
   
-  return movie_id;
+  if(!gavl_dictionary_get_int(&p->prefetch_types, id_str, &ret))
+    return -1;
+  return ret;
   }
 
-static void delete_objects(bg_mdb_backend_t * b,
-                           const gavl_array_t * arr,
-                           int del_flags)
+static int prefetch_object_callback(void * data, int argc, char **argv, char **azColName)
   {
-  int i;
+  query_t q;
+  gavl_value_t val;
+  char key[PREFETCH_KEY_LEN];
+  prefetch_t * pf = data;
+  sqlite_priv_t * p = pf->be->priv;
   
-  const gavl_dictionary_t * dict;
+  memset(&q, 0, sizeof(q));
+  q.be = pf->be;
+  q.table = pf->table;
 
-  //  fprintf(stderr, "delete_objects: %p\n", arr);
-  //  gavl_array_dump(arr, 2);
+  query_object_callback_full(&q, argc, argv, azColName);
   
-  for(i = 0; i < arr->num_entries; i++)
-    {
-    if((dict = gavl_value_get_dictionary(&arr->entries[i])))
-      delete_object(b, dict, del_flags);
-    }
+  gavl_value_init(&val);
+  gavl_dictionary_move(gavl_value_set_dictionary(&val), q.obj);
+  gavl_dictionary_destroy(q.obj);
+  
+  prefetch_key(key, pf->table->type, argv[0]);
+  gavl_dictionary_set_nocopy(&p->prefetch, key, &val);
+  return 0;
   }
 
-typedef struct
+static int prefetch_array_callback(void * data, int argc, char **argv, char **azColName)
   {
-  type_id_t type;
-  gavl_array_t * ret;
-  } get_related_array_t;
+  gavl_dictionary_t * obj;
+  prefetch_t * pf = data;
 
-static int get_related_array_cb(void * data, int argc, char **argv, char **azColName)
+  if((obj = prefetch_lookup(pf->be->priv, pf->table->type, argv[0])))
+    append_array_value(obj, pf->tag, argv[1], argv[2]);
+  return 0;
+  }
+
+static int prefetch_image_callback(void * data, int argc, char **argv, char **azColName)
   {
-  int i;
+  query_t q;
   gavl_value_t val;
-  gavl_dictionary_t * dict;
-  get_related_array_t * q = data;
+  prefetch_t * pf = data;
+
+  memset(&q, 0, sizeof(q));
+  q.be = pf->be;
+  q.table = pf->table;
+  
+  query_object_callback_full(&q, argc, argv, azColName);
 
   gavl_value_init(&val);
-  dict = gavl_value_set_dictionary(&val);
+  gavl_dictionary_move(gavl_value_set_dictionary(&val), q.obj);
+  gavl_dictionary_destroy(q.obj);
   
-  for(i = 0; i < argc; i++)
-    {
-    if(!strcmp(azColName[i], GAVL_META_URI))
-      {
-      gavl_dictionary_set_string(dict, GAVL_META_URI, argv[i]);
-      }
-    else if(!strcmp(azColName[i], META_DB_ID))
-      {
-      gavl_dictionary_set_long(dict, META_DB_ID, strtoll(argv[i], NULL, 10));
-      }
-    }
-  gavl_dictionary_set_int(dict, "TYPE", q->type);
-  gavl_array_splice_val_nocopy(q->ret, -1, 0, &val);
+  gavl_dictionary_set_nocopy(pf->dict, argv[0], &val);
   return 0;
   }
 
-static void get_related_array(bg_mdb_backend_t * b,
-                              gavl_array_t * ret, const char * tag, int64_t id)
+static int prefetch_album_callback(void * data, int argc, char **argv, char **azColName)
   {
-  int i;
-  get_related_array_t priv;
+  prefetch_t * pf = data;
+  gavl_dictionary_set_string(pf->dict, argv[0], argv[1]);
+  return 0;
+  }
+
+static int prefetch_part_callback(void * data, int argc, char **argv, char **azColName)
+  {
+  query_part_t qp;
+  prefetch_t * pf = data;
+  sqlite_priv_t * p = pf->be->priv;
+  
+  if(!(qp.obj = prefetch_lookup(p, TYPE_MOVIE, argv[0])))
+    return 0;
+  
+  qp.stmts = p->stmts;
+  return query_part_callback(&qp, argc-1, argv+1, azColName+1);
+  }
+
+static void prefetch_append_id(char ** list, int64_t id)
+  {
+  char * tmp_string;
+
+  if(*list)
+    tmp_string = gavl_sprintf(",%"PRId64, id);
+  else
+    tmp_string = gavl_sprintf("%"PRId64, id);
+
+  *list = gavl_strcat(*list, tmp_string);
+  free(tmp_string);
+  }
+
+static void prefetch_set_image(prefetch_t * pf, gavl_dictionary_t * m,
+                               const char * id_key, const char * url_key)
+  {
+  int64_t sub_id;
+  const gavl_dictionary_t * image;
+  char id_str[PREFETCH_KEY_LEN];
+
+  if(!gavl_dictionary_get_long(m, id_key, &sub_id) || (sub_id <= 0))
+    return;
+
+  snprintf(id_str, PREFETCH_KEY_LEN, "%"PRId64, sub_id);
+
+  if((image = gavl_dictionary_get_dictionary(pf->dict, id_str)))
+    set_image_url(m, image, url_key);
+  }
+
+/* Load all objects of a table at once */
+
+static void prefetch_table(bg_mdb_backend_t * b, const obj_table_t * table, const char * ids)
+  {
+  int i;
   char * sql;
+  char * image_ids = NULL;
+  char * album_ids = NULL;
+  int64_t sub_id;
+  prefetch_t pf;
+  gavl_dictionary_t * m;
+  gavl_dictionary_t tmp;
   sqlite_priv_t * p = b->priv;
   
-  memset(&priv, 0, sizeof(priv));
-  priv.ret = ret;
+  memset(&pf, 0, sizeof(pf));
+  pf.be = b;
+  pf.table = table;
   
-  i = 0;
+  sql = gavl_sprintf("SELECT * FROM %s WHERE "META_DB_ID" IN (%s);", table->table_name, ids);
+  bg_sqlite_exec(p->db, sql, prefetch_object_callback, &pf);
+  free(sql);
 
-  while(obj_tables[i].table_name)
+  /* Arrays */
+  if(table->arrays)
     {
-    if(!has_col(&obj_tables[i], tag))
+    i = 0;
+    while(table->arrays[i].name)
       {
+      sql = sqlite3_mprintf("SELECT %s.OBJ_ID, %s.NAME, %s.ID FROM "
+                            "%s INNER JOIN %s ON %s.ID = %s.NAME_ID "
+                            "WHERE %s.OBJ_ID IN (%s) ORDER BY %s.OBJ_ID, %s.ID;",
+                            table->arrays[i].array_table_name,
+                            table->arrays[i].id_table_name,
+                            table->arrays[i].id_table_name,
+                            table->arrays[i].array_table_name,
+                            table->arrays[i].id_table_name,
+                            table->arrays[i].id_table_name,
+                            table->arrays[i].array_table_name,
+                            table->arrays[i].array_table_name,
+                            ids,
+                            table->arrays[i].array_table_name,
+                            table->arrays[i].array_table_name);
+      pf.tag = table->arrays[i].name;
+      bg_sqlite_exec(p->db, sql, prefetch_array_callback, &pf);
+      sqlite3_free(sql);
       i++;
-      continue;
       }
+    }
+
+  /* Collect image and album IDs */
+  for(i = 0; i < p->prefetch.num_entries; i++)
+    {
+    if((atoi(p->prefetch.entries[i].name) != table->type) ||
+       !(m = gavl_value_get_dictionary_nc(&p->prefetch.entries[i].v)) ||
+       !(m = gavl_track_get_metadata_nc(m)))
+      continue;
     
-    priv.type = obj_tables[i].type;
-    if(has_src_col(&obj_tables[i], GAVL_META_URI))
-      {
-      sql = gavl_sprintf("SELECT "META_DB_ID", "GAVL_META_URI" from %s WHERE %s = %"PRId64";",
-                       obj_tables[i].table_name, tag, id);
-      }
-    else
+    if(gavl_dictionary_get_long(m, META_COVER_ID, &sub_id) && (sub_id > 0))
+      prefetch_append_id(&image_ids, sub_id);
+    if(gavl_dictionary_get_long(m, META_POSTER_ID, &sub_id) && (sub_id > 0))
+      prefetch_append_id(&image_ids, sub_id);
+    if(gavl_dictionary_get_long(m, META_WALLPAPER_ID, &sub_id) && (sub_id > 0))
+      prefetch_append_id(&image_ids, sub_id);
+    if(gavl_dictionary_get_long(m, META_PARENT_ID, &sub_id) && (sub_id > 0))
+      prefetch_append_id(&album_ids, sub_id);
+    }
+  
+  /* Images */
+  if(image_ids)
+    {
+    gavl_dictionary_init(&tmp);
+    pf.dict = &tmp;
+    pf.table = get_obj_table(TYPE_IMAGE);
+    
+    sql = gavl_sprintf("SELECT * FROM images WHERE "META_DB_ID" IN (%s);", image_ids);
+    bg_sqlite_exec(p->db, sql, prefetch_image_callback, &pf);
+    free(sql);
+    
+    for(i = 0; i < p->prefetch.num_entries; i++)
       {
-      sql = gavl_sprintf("SELECT "META_DB_ID" from %s WHERE %s = %"PRId64";",
-                       obj_tables[i].table_name, tag, id);
+      if((atoi(p->prefetch.entries[i].name) != table->type) ||
+         !(m = gavl_value_get_dictionary_nc(&p->prefetch.entries[i].v)) ||
+         !(m = gavl_track_get_metadata_nc(m)))
+        continue;
+      
+      prefetch_set_image(&pf, m, META_COVER_ID,     GAVL_META_COVER_URL);
+      prefetch_set_image(&pf, m, META_POSTER_ID,    GAVL_META_POSTER_URL);
+      prefetch_set_image(&pf, m, META_WALLPAPER_ID, GAVL_META_WALLPAPER_URL);
       }
-
-    //    fprintf(stderr, "get_realated_array: %s\n", sql);
     
-    if(!bg_sqlite_exec(p->db, sql, get_related_array_cb, &priv))
+    gavl_dictionary_free(&tmp);
+    free(image_ids);
+    pf.table = table;
+    }
+  
+  /* Album titles */
+  if(album_ids)
+    {
+    gavl_dictionary_init(&tmp);
+    pf.dict = &tmp;
+    
+    sql = gavl_sprintf("SELECT "META_DB_ID", "GAVL_META_TITLE" FROM albums WHERE "META_DB_ID" IN (%s);",
+                       album_ids);
+    bg_sqlite_exec(p->db, sql, prefetch_album_callback, &pf);
+    free(sql);
+
+    for(i = 0; i < p->prefetch.num_entries; i++)
       {
-      free(sql);
-      return;
-      }
+      char id_str[PREFETCH_KEY_LEN];
+      const char * title;
+      
+      if((atoi(p->prefetch.entries[i].name) != table->type) ||
+         !(m = gavl_value_get_dictionary_nc(&p->prefetch.entries[i].v)) ||
+         !(m = gavl_track_get_metadata_nc(m)) ||
+         !gavl_dictionary_get_long(m, META_PARENT_ID, &sub_id) ||
+         (sub_id <= 0))
+        continue;
 
-    //    fprintf(stderr, "get_realated_array: %p %s\n", ret, sql);
-    //    gavl_array_dump(ret, 2);
+      snprintf(id_str, PREFETCH_KEY_LEN, "%"PRId64, sub_id);
+      
+      if((title = gavl_dictionary_get_string(&tmp, id_str)))
+        gavl_dictionary_set_string(m, GAVL_META_ALBUM, title);
+      }
     
+    gavl_dictionary_free(&tmp);
+    free(album_ids);
+    }
+  
+  /* Parts */
+  if(table->type == TYPE_MOVIE)
+    {
+    sql = gavl_sprintf("SELECT "META_PARENT_ID", "
+                       GAVL_META_APPROX_DURATION", "
+                       GAVL_META_URI", "
+                       GAVL_META_MIMETYPE", "
+                       GAVL_META_MTIME" FROM movie_parts WHERE "
+                       META_PARENT_ID" IN (%s) ORDER BY "META_PARENT_ID", "GAVL_META_IDX";", ids);
+    bg_sqlite_exec(p->db, sql, prefetch_part_callback, &pf);
     free(sql);
-    i++;
     }
+
+  /* Class */
+  for(i = 0; i < p->prefetch.num_entries; i++)
+    {
+    if((atoi(p->prefetch.entries[i].name) != table->type) ||
+       !(m = gavl_value_get_dictionary_nc(&p->prefetch.entries[i].v)) ||
+       !(m = gavl_track_get_metadata_nc(m)))
+      continue;
+    
+    if(table->type == TYPE_MOVIE)
+      gavl_dictionary_set_string(m, GAVL_META_CLASS, GAVL_META_CLASS_MOVIE);
+    else
+      gavl_dictionary_set_string(m, GAVL_META_CLASS, get_type_class(table->type));
+    }
+  
   }
 
-/* Get array of children */
-static void get_child_array(bg_mdb_backend_t * b,
-                            gavl_array_t * ret, type_id_t type, int64_t id)
+/*
+ *  Prefetch the objects for a range of browse results. Child IDs end with
+ *  the database ID of the object (if any).
+ */
+
+static void prefetch_objects(bg_mdb_backend_t * b, const gavl_array_t * children,
+                             int start, int num)
   {
-  get_related_array_t priv;
+  int i;
   char * sql;
+  char * ids = NULL;
+  const char * id;
+  const char * pos;
+  char * rest;
+  int64_t db_id;
+  prefetch_t pf;
+  const gavl_dictionary_t * dict;
   sqlite_priv_t * p = b->priv;
-
-  const obj_table_t * tab;
-  
-  memset(&priv, 0, sizeof(priv));
-  priv.ret = ret;
-  priv.type = type;
   
-  tab = get_obj_table(type);
+  gavl_dictionary_reset(&p->prefetch);
+  gavl_dictionary_reset(&p->prefetch_types);
   
-  if(has_src_col(tab, GAVL_META_URI))
-    {
-    sql = gavl_sprintf("SELECT "META_DB_ID", "GAVL_META_URI" from %s WHERE %s = %"PRId64";",
-                     tab->table_name, META_PARENT_ID, id);
-    }
-  else
+  for(i = start; i < start + num; i++)
     {
-    sql = gavl_sprintf("SELECT "META_DB_ID" from %s WHERE %s = %"PRId64";",
-                     tab->table_name, META_PARENT_ID, id);
+    if(!(dict = gavl_value_get_dictionary(&children->entries[i])) ||
+       !(id = gavl_track_get_id(dict)) ||
+       !(pos = strrchr(id, '/')))
+      continue;
+    pos++;
+
+    db_id = strtoll(pos, &rest, 10);
+    
+    if((rest == pos) || (*rest != '\0') || (db_id <= 0))
+      continue;
+    
+    prefetch_append_id(&ids, db_id);
     }
   
-  if(!bg_sqlite_exec(p->db, sql, get_related_array_cb, &priv))
-    {
-    free(sql);
+  if(!ids)
     return;
-    }
+
+  memset(&pf, 0, sizeof(pf));
+  pf.be = b;
+  
+  /* The types of all objects of the page in one query */
+  sql = gavl_sprintf("SELECT "META_DB_ID", TYPE FROM objects WHERE "META_DB_ID" IN (%s);", ids);
+  bg_sqlite_exec(p->db, sql, prefetch_type_callback, &pf);
   free(sql);
+
+  i = 0;
+  while(obj_tables[i].table_name)
+    {
+    if(pf.types & (1 << obj_tables[i].type))
+      prefetch_table(b, &obj_tables[i], ids);
+    i++;
+    }
+  free(ids);
   }
 
-static void
-delete_object_internal(bg_mdb_backend_t * b, int64_t id, type_id_t type,
-                       const char * uri, int del_flags)
+static gavl_dictionary_t * query_sqlite_object(bg_mdb_backend_t * b, int64_t id, type_id_t type)
   {
-  int i;
-
-  query_t q;
   char * sql;
-  int64_t parent_id = -1;
-  type_id_t parent_type = 0;
-  type_id_t child_type = 0;
+  int result;
   sqlite_priv_t * p = b->priv;
+  query_t q;
+  query_t q1;
+  gavl_dictionary_t * m;
+  int64_t sub_id;
 
-  gavl_dictionary_t * parent_m;
-  const gavl_dictionary_t * obj_m;
-  gavl_dictionary_t * obj = NULL;
-
-  int is_item = 0;
-  int num_children;
-  int64_t duration;
-  int64_t parent_duration = GAVL_TIME_UNDEFINED;
   
   memset(&q, 0, sizeof(q));
+  memset(&q1, 0, sizeof(q1));
+
   q.be = b;
+  q1.be = b;
   
-  gavl_log(GAVL_LOG_INFO, LOG_DOMAIN, "Deleting object %"PRId64, id);
+  /* Get type */
+
+  if((type < 0) && ((type = prefetch_get_type(p, id)) < 0))
+    type = bg_sqlite_id_to_id_cached(p->stmts, "objects", "TYPE", META_DB_ID, id);
   
-  /* Remove from parent */
+  if((type < 0) || !(q.table = get_obj_table(type)))
+    return 0;
+
+  if((q.obj = prefetch_get(p, type, id)))
+    return q.obj;
   
-  switch(type)
-    {
-    case TYPE_SONG:
-      parent_type = TYPE_ALBUM;
-      is_item = 1;
-      break;
-    case TYPE_TV_SEASON:
-      parent_type = TYPE_TV_SHOW;
-      child_type = TYPE_TV_EPISODE;
-      break;
-    case TYPE_TV_EPISODE:
-      parent_type = TYPE_TV_SEASON;
-      is_item = 1;
-      break;
-    case TYPE_MOVIE_PART:
-      parent_type = TYPE_MOVIE;
-      is_item = 1;
-      break;
-    case TYPE_ALBUM:
-      child_type = TYPE_SONG;
-      break;
-    case TYPE_TV_SHOW:
-      child_type = TYPE_TV_SEASON;
-      break;
-    case TYPE_MOVIE:
-      child_type = TYPE_MOVIE_PART;
-      is_item = 1;
-      break;
-    case TYPE_IMAGE:
-      if(del_flags & DEL_FLAG_RELATED)
-        {
-        gavl_array_t arr;
-        gavl_array_init(&arr);
-        /* Delete related movies and songs */
-        
-        get_related_array(b, &arr, META_POSTER_ID, id);
-        get_related_array(b, &arr, META_WALLPAPER_ID, id);
-        get_related_array(b, &arr, META_COVER_ID, id);
+  /* Query object */
+  sql = sqlite3_mprintf("SELECT * FROM %s WHERE "META_DB_ID" = ?1;", q.table->table_name);
 
-        delete_objects(b, &arr, del_flags);
-        gavl_array_free(&arr);
-        }
-      break;
-    case TYPE_NFO:
-      if(del_flags & DEL_FLAG_RELATED)
-        {
-        /* Delete related movies and shows */
-        gavl_array_t arr;
-        gavl_array_init(&arr);
-        get_related_array(b, &arr, META_NFO_ID, id);
-        
-        delete_objects(b, &arr, del_flags);
-        gavl_array_free(&arr);
-        }
-      break;
-    }
+  result = bg_sqlite_exec_cached(p->stmts, sql, query_object_callback_full, &q, 1, id);
+  sqlite3_free(sql);
+  if(!result)
+    return NULL;
 
-  if((del_flags & DEL_FLAG_CHILDREN) && (child_type > 0))
-    {
-    gavl_array_t arr;
-    gavl_array_init(&arr);
-    get_child_array(b, &arr, child_type, id);
-    delete_objects(b, &arr, del_flags & ~DEL_FLAG_PARENT);
-    gavl_array_free(&arr);
-    }
-  
-  if((del_flags & DEL_FLAG_PARENT) && (parent_type > 0))
+  /* Query arrays */
+  if(q.table->arrays)
     {
-    q.table = get_obj_table(type);
-
-    sql = gavl_sprintf("SELECT "META_DB_ID", "GAVL_META_APPROX_DURATION", "META_PARENT_ID" "
-                     "from %s WHERE "META_DB_ID" = %"PRId64";",
-                       q.table->table_name, id);
+    int i = 0;
+    while(q.table->arrays[i].name)
+      {
+      /* SELECT show_genres.NAME FROM
+         show_genres_arr INNER JOIN show_genres ON show_genres.ID = show_genres_arr.NAME_ID
+         WHERE show_genres_arr.OBJ_ID = 2
+         ORDER BY show_genres_arr.ID; */
       
-    
-    bg_sqlite_exec(p->db, sql, query_object_callback, &q);
-    free(sql);
-    
-    if(!q.obj)
-      goto go_on;
-
-    obj = q.obj;
-    q.obj = NULL;
-    
-    obj_m = gavl_track_get_metadata(obj);
-    
-    q.table = get_obj_table(parent_type);
-    
-    gavl_dictionary_get_long(obj_m, META_PARENT_ID, &parent_id);
+      sql = sqlite3_mprintf("SELECT %s.NAME, %s.ID FROM "
+                            "%s INNER JOIN %s ON %s.ID = %s.NAME_ID "
+                            "WHERE %s.OBJ_ID = ?1 ORDER BY %s.ID;",
+                            q.table->arrays[i].id_table_name,
+                            q.table->arrays[i].id_table_name,
+                            q.table->arrays[i].array_table_name,
+                            q.table->arrays[i].id_table_name,
+                            q.table->arrays[i].id_table_name,
+                            q.table->arrays[i].array_table_name,
+                            q.table->arrays[i].array_table_name,
+                            q.table->arrays[i].array_table_name);
 
-    if(parent_type == TYPE_MOVIE)
-      {
-      sql = gavl_sprintf("SELECT "META_DB_ID", "GAVL_META_APPROX_DURATION" "
-                       "from %s WHERE "META_DB_ID" = %"PRId64";",
-                       q.table->table_name, parent_id);
-      }
-    else if(parent_type == TYPE_TV_SHOW)
-      {
-      sql = gavl_sprintf("SELECT "META_DB_ID", "GAVL_META_NUM_CHILDREN" "
-                       "from %s WHERE "META_DB_ID" = %"PRId64";",
-                       q.table->table_name, parent_id);
-      }
-    else
-      {
-      sql = gavl_sprintf("SELECT "META_DB_ID", "GAVL_META_APPROX_DURATION", "
-                       GAVL_META_NUM_CHILDREN" from %s WHERE "META_DB_ID" = %"PRId64";",
-                       q.table->table_name, parent_id);
+      //      fprintf(stderr, "Query array\n%s\n", sql);
+      
+      q.tag = q.table->arrays[i].name;
+      
+      result = bg_sqlite_exec_cached(p->stmts, sql, query_array_callback, &q, 1, id);
+      sqlite3_free(sql);
+      if(!result)
+        return 0;
+      
+      i++;
       }
-    
-    bg_sqlite_exec(p->db, sql, query_object_callback, &q);
-    free(sql);
-    
-    if(!q.obj)
-      goto go_on;
-    
-    parent_m = gavl_track_get_metadata_nc(q.obj);
-
-    if(gavl_dictionary_get_long(parent_m, GAVL_META_APPROX_DURATION, &parent_duration))
-      {
-      gavl_dictionary_get_long(obj_m, GAVL_META_APPROX_DURATION, &duration);
-      parent_duration -= duration;
+    }
 
-      if(parent_duration <= 0)
-        {
-        //        fprintf(stderr, "Deleting parent object (duration <= 0)\n");
-        delete_object_internal(b, parent_id, parent_type, NULL, del_flags);
-        goto go_on;
-        }
-      gavl_dictionary_set_long(parent_m, GAVL_META_APPROX_DURATION, parent_duration);
-      }
-    
-    if((num_children = gavl_track_get_num_children(q.obj)) > 0)
-      {
-      num_children--;
-      if(num_children <= 0)
-        {
-        //        fprintf(stderr, "Deleting parent object (num_children <= 0)\n");
-        delete_object_internal(b, parent_id, parent_type, NULL, 0);
-        goto go_on;
-        }
+  if(!q.obj)
+    return NULL;
+  
+  m = gavl_track_get_metadata_nc(q.obj);
+  
+  /* Image URIs */
 
-      if(is_item)
-        gavl_track_set_num_children(q.obj, 0, num_children);
-      else
-        gavl_track_set_num_children(q.obj, num_children, 0);
-      }
+  query_images(b, m);
+  /* NFO */
+  if(gavl_dictionary_get_long(m, META_NFO_ID, &sub_id) && (sub_id > 0))
+    {
     
-    update_object(b, q.obj, q.table);
     }
   
-  go_on:
+  if(gavl_dictionary_get_long(m, META_PARENT_ID, &sub_id) && (sub_id > 0))
+    {
+    gavl_dictionary_set_string_nocopy(m, GAVL_META_ALBUM,
+                                      bg_sqlite_id_to_string_cached(p->stmts, "albums",
+                                                                    GAVL_META_TITLE, META_DB_ID, sub_id));
+    }
+
+  /*
+    const char * mimetype;
+
+  */
   
-  if(obj)
-    gavl_dictionary_destroy(obj);
-  if(q.obj)
-    gavl_dictionary_destroy(q.obj);
+  /* Parts */
   
-  /* Dedicated table */
-  if((q.table = get_obj_table(type)))
+  if(q.obj)
     {
-    sql = gavl_sprintf("DELETE FROM %s WHERE "META_DB_ID" = %"PRId64";",
-                     q.table->table_name, id);
-    bg_sqlite_exec(p->db, sql, NULL, NULL);
-    free(sql);
-    
-    /* Remove arrays */
-
-    if(q.table->arrays)
+    if(type == TYPE_MOVIE)
       {
-      i = 0;
+      query_part_t qp;
+      qp.stmts = p->stmts;
+      qp.obj = q.obj;
+
+      bg_sqlite_exec_cached(p->stmts,
+                            SQL_MOVIE_PARTS,
+                            query_part_callback, &qp, 1, id);
       
-      while(q.table->arrays[i].name)
-        {
-        /* Remove from array */
-        sql = gavl_sprintf("DELETE FROM %s WHERE OBJ_ID = %"PRId64";",
-                         q.table->arrays[i].array_table_name, id);
-        bg_sqlite_exec(p->db, sql, NULL, NULL);
-        free(sql);
+      gavl_dictionary_set_string(gavl_track_get_metadata_nc(q.obj), GAVL_META_CLASS,
+                                 GAVL_META_CLASS_MOVIE);
 
-        /* Remove orphaned IDs */
-        sql = gavl_sprintf("DELETE FROM %s WHERE ID NOT IN (SELECT DISTINCT NAME_ID FROM %s);",
-                         q.table->arrays[i].id_table_name, q.table->arrays[i].array_table_name);
-        bg_sqlite_exec(p->db, sql, NULL, NULL);
-        free(sql);
-        
-        i++;
-        }
+      //      fprintf(stderr, "Got movie:\n");
+      //      gavl_dictionary_dump(q.obj, 2);
       }
-      
+    else
+      gavl_dictionary_set_string(gavl_track_get_metadata_nc(q.obj),
+                                 GAVL_META_CLASS, get_type_class(type));
     }
 
-  /* Object table */
-  sql = gavl_sprintf("DELETE FROM objects WHERE "META_DB_ID" = %"PRId64";", id);
-  bg_sqlite_exec(p->db, sql, NULL, NULL);
-  free(sql);
-
-  
-  
-  
-  }
-
-static void delete_object(bg_mdb_backend_t * b, const gavl_dictionary_t * obj, int del_flags)
-  {
-  int64_t id;
-  type_id_t type;
-  const char * uri;
-
-  uri = gavl_dictionary_get_string(obj, GAVL_META_URI);
-  gavl_dictionary_get_long(obj, META_DB_ID, &id);
-  gavl_dictionary_get_int(obj, "TYPE", (int*)&type);
-  
-  delete_object_internal(b, id, type, uri, del_flags);
+  return q.obj;
   }
 
-
-static int64_t add_object(bg_mdb_backend_t * b, gavl_dictionary_t * track,
-                          int64_t scan_dir_id, int64_t obj_id)
+typedef struct
   {
-  int64_t id;
-  int i, result;
-  const char * klass;
-  gavl_dictionary_t * m;
-  type_id_t type;
-  const obj_table_t * tab;
   char * sql;
-  char * sql2;
-  sqlite_priv_t * p = b->priv;
-  const char * var;
-  int no_obj_table = 0;
-
-  //  bg_mdb_create_thumbnails(b->db, track);
-  
-  m = gavl_track_get_metadata_nc(track);
-
-  if(!(klass = gavl_dictionary_get_string(m, GAVL_META_CLASS)))
-    return -1;
+  const obj_table_t * tab;
+  } update_foreach_t;
 
-  gavl_log(GAVL_LOG_INFO, LOG_DOMAIN, "Adding object %s %s",
-           gavl_dictionary_get_string(m, GAVL_META_LABEL), 
-           klass);
-  
-  /* Single part movies are handled same as multipart in the db */
-  if(!strcmp(klass, GAVL_META_CLASS_MOVIE) && (obj_id < 0))
-    {
-    gavl_dictionary_set_string(m, GAVL_META_CLASS, GAVL_META_CLASS_MOVIE_PART);
-    klass = gavl_dictionary_get_string(m, GAVL_META_CLASS);
-    }
-  
-  if(!(type = get_type_id(klass)) ||
-     !(tab = get_obj_table(type)))
-    return -1;
+static void update_foreach_func(void * priv, const char * name,
+                                const gavl_value_t * val)
+  {
+  char * tmp_string = NULL;
+  update_foreach_t * f = priv;
 
-  /* OBJECTS */
+  if(!strcmp(name, META_DB_ID))
+    return;
 
-  no_obj_table = 0;
+  if(!strcmp(name, GAVL_META_NUM_CONTAINER_CHILDREN))
+    return;
   
-  if(has_col(tab, GAVL_META_DATE) &&
-     !gavl_dictionary_get_string(m, GAVL_META_DATE))
-    gavl_dictionary_set_string(m, GAVL_META_DATE, DATE_UNDEFINED);
-
-  if(has_col(tab, META_IMAGE_TYPE) &&
-     !gavl_dictionary_get_int(m, META_IMAGE_TYPE, &i))
-    gavl_dictionary_set_int(m, META_IMAGE_TYPE, IMAGE_TYPE_IMAGE);
+  if(!strcmp(name, GAVL_META_NUM_ITEM_CHILDREN))
+    return;
   
-  /* Parent container */
-  switch(type)
+  switch(val->type)
     {
-    case TYPE_SONG:
-      gavl_dictionary_set_long(m, META_PARENT_ID, add_child_album(b, track));
+    case GAVL_TYPE_INT:
+      tmp_string = sqlite3_mprintf("%s = %d", name, val->v.i);
       break;
-    case TYPE_TV_EPISODE:
-      gavl_dictionary_set_long(m, META_PARENT_ID, add_child_tv_season(b, track));
+    case GAVL_TYPE_LONG:
+      tmp_string = sqlite3_mprintf("%s = %"PRId64, name, val->v.l);
       break;
-    case TYPE_MOVIE_PART:
-      /* Check if the movie already exists */
-      gavl_dictionary_set_long(m, META_PARENT_ID, add_movie_part(b, track));
+    case GAVL_TYPE_STRING:
+      tmp_string = sqlite3_mprintf("%s = %Q", name, val->v.str);
       break;
     default:
-      break;
+      return;
     }
 
-  /* IDs for external resoures */
-  if(has_col(tab, META_POSTER_ID))
+  if(!f->sql)
+    f->sql = gavl_sprintf("UPDATE %s SET ", f->tab->table_name);
+  else
+    f->sql = gavl_strcat(f->sql, ", ");
+
+  f->sql = gavl_strcat(f->sql, tmp_string);
+
+  sqlite3_free(tmp_string);
+
+  if(!strcmp(name, GAVL_META_SEARCH_TITLE) && (val->type == GAVL_TYPE_STRING))
     {
-    if((var = gavl_dictionary_get_string_image_uri(m, GAVL_META_POSTER_URL, 0, NULL, NULL, NULL)))
-      {
-      id = bg_sqlite_string_to_id(p->db, "images", META_DB_ID, GAVL_META_URI, var);
-      gavl_dictionary_set_long(m, META_POSTER_ID, id);
-      set_image_type(b, id, IMAGE_TYPE_POSTER);
-      }
-    else
-      gavl_dictionary_set_long(m, META_POSTER_ID, -1);
-    }
-  if(has_col(tab, META_WALLPAPER_ID))
-    {
-    if((var = gavl_dictionary_get_string_image_uri(m, GAVL_META_WALLPAPER_URL, 0, NULL, NULL, NULL)))
-      {
-      id = bg_sqlite_string_to_id(p->db, "images", META_DB_ID, GAVL_META_URI, var);
-      gavl_dictionary_set_long(m, META_WALLPAPER_ID, id);
-      set_image_type(b, id, IMAGE_TYPE_WALLPAPER);
-      }
-    else
-      gavl_dictionary_set_long(m, META_WALLPAPER_ID, -1);
-    }
-  if(has_col(tab, META_COVER_ID))
-    {
-    if((var = gavl_dictionary_get_string_image_uri(m, GAVL_META_COVER_URL, 0, NULL, NULL, NULL)))
-      {
-      id = bg_sqlite_string_to_id(p->db, "images", META_DB_ID, GAVL_META_URI, var);
-      gavl_dictionary_set_long(m, META_COVER_ID, id);
-      set_image_type(b, id, IMAGE_TYPE_COVER);
-      }
-    else
-      gavl_dictionary_set_long(m, META_COVER_ID, -1);
-    }
-  if(has_col(tab, META_NFO_ID))
-    {
-    if((var = gavl_dictionary_get_string(m, GAVL_META_NFO_FILE)))
-      gavl_dictionary_set_long(m, META_NFO_ID,
-                               bg_sqlite_string_to_id(p->db, "nfos", META_DB_ID, GAVL_META_URI, var));
-    else
-      gavl_dictionary_set_long(m, META_NFO_ID, -1);
+    tmp_string = sqlite3_mprintf(", "META_SORT_KEY" = sortkey(%Q)", val->v.str);
+    f->sql = gavl_strcat(f->sql, tmp_string);
+    sqlite3_free(tmp_string);
     }
+  }
 
-  if(has_array(tab, GAVL_META_COUNTRY))
-    {
-    if(!gavl_dictionary_get_item(m, GAVL_META_COUNTRY, 0))
-      gavl_dictionary_set_string(m, GAVL_META_COUNTRY, "Unknown");
-    }
+static void update_object(bg_mdb_backend_t * b,
+                          const gavl_dictionary_t * dict,
+                          const obj_table_t * tab)
+  {
+  int64_t id;
+  update_foreach_t f;
+  char * tmp_string;
+  int result;
+  sqlite_priv_t * p = b->priv;
+  const gavl_dictionary_t * m = gavl_track_get_metadata(dict);
+
+  gavl_dictionary_get_long(m, META_DB_ID, &id);
   
-  if(scan_dir_id >= 0)
-    gavl_dictionary_set_long(m, META_SCAN_DIR_ID, scan_dir_id);
+  f.sql = NULL;
+  f.tab = tab;
   
-  /* Dedicated obj table */
+  gavl_dictionary_foreach(m, update_foreach_func, &f);
 
-  if(!no_obj_table)
-    {
-    if((obj_id < 0) && ((obj_id = create_object(p, type)) < 0))
-      return -1;
-    
-    if(!strcmp(klass, GAVL_META_CLASS_MOVIE))
-      {
-      gavl_dictionary_set_long(m, META_PARENT_ID, obj_id);
-      }
-    
-    gavl_dictionary_set_long(m, META_DB_ID, obj_id);
+  tmp_string = gavl_sprintf(" WHERE "META_DB_ID" = %"PRId64";", id);
+  f.sql = gavl_strcat(f.sql, tmp_string);
+  free(tmp_string);
+
+  result = bg_sqlite_exec(p->db, f.sql, NULL, NULL);
+  free(f.sql);
+  if(!result)
+    return;
+
+  fts_update(p, tab, m, id);
+  }
+
+static int64_t add_child_album(bg_mdb_backend_t * b, gavl_dictionary_t * dict)
+  {
+  const char * title;
+  const char * artist;
+  const gavl_dictionary_t * m;
+  int result;
+  char * sql;
+  int64_t artist_id;
+  int64_t album_id;
+  gavl_dictionary_t album_dict;
+  gavl_dictionary_t * album_m;
   
+  sqlite_priv_t * p = b->priv;
+
+  query_t q;
+  memset(&q, 0, sizeof(q));
+  q.be = b;
+
+  //  fprintf(stderr, "add child album:\n");
+  //  gavl_dictionary_dump(dict, 2);
   
-    sql  = gavl_sprintf("INSERT INTO %s (", tab->table_name);
-    sql2 = gavl_sprintf(") VALUES (");
+  m = gavl_track_get_metadata(dict);
   
-    append_cols(p, m, tab->cols, &sql, &sql2, 1);
+  title  = gavl_dictionary_get_string(m, GAVL_META_ALBUM);
+  artist = gavl_dictionary_get_string_array(m, GAVL_META_ALBUMARTIST, 0);
 
-    if(tab->src_cols)
-      {
-      const gavl_dictionary_t * src = gavl_metadata_get_src(m, GAVL_META_SRC, 0,
-                                                              NULL, NULL);
-      append_cols(p, src, tab->src_cols, &sql, &sql2, 0);
-      }
+  artist_id = bg_sqlite_string_to_id(p->db, "album_artists", "ID", "NAME", artist);
+  if(artist_id < 0)
+    goto create_new;
   
-    sql = gavl_strcat(sql, sql2);
-    sql = gavl_strcat(sql, ");");
-    
-    result = bg_sqlite_exec(p->db, sql, NULL, NULL);
-
-    free(sql);
-    free(sql2);
+  /* Query db */
   
-    if(!result)
-      return -1;
-
-    }
+  q.table = get_obj_table(TYPE_ALBUM);
   
-  /* Arrays */
-  if(!no_obj_table)
+  sql = sqlite3_mprintf("SELECT "META_DB_ID", "
+                        GAVL_META_APPROX_DURATION", "
+                        GAVL_META_DATE", "
+                        GAVL_META_NUM_CHILDREN" FROM albums WHERE "
+                        META_DB_ID" IN (SELECT OBJ_ID FROM album_artists_arr WHERE NAME_ID = %"PRId64") "
+                        "AND "GAVL_META_TITLE" = %Q;", artist_id, title);
+  
+  result = bg_sqlite_exec(p->db, sql, query_object_callback, &q);
+
+  sqlite3_free(sql);
+  if(!result)
+    goto create_new;
+
+  else if(q.obj)
     {
-    i = 0;
+    const char * album_date;
+    const char * song_date;
+    int num = 0;
+    gavl_time_t container_duration = 0;
+    gavl_time_t child_duration = 0;
+    
+    album_m = gavl_track_get_metadata_nc(q.obj);
 
-    if(tab->arrays)
+    gavl_dictionary_get_int(album_m, GAVL_META_NUM_CHILDREN, &num);
+    num++;
+    gavl_dictionary_set_int(album_m, GAVL_META_NUM_CHILDREN, num);
+    
+    if((album_date = gavl_dictionary_get_string(album_m, GAVL_META_DATE)) &&
+       (song_date = gavl_dictionary_get_string(m, GAVL_META_DATE)) &&
+       strcmp(album_date, DATE_UNDEFINED) &&
+       strcmp(album_date, song_date))
       {
-      while(tab->arrays[i].name)
-        {
-        append_array(p, m, &tab->arrays[i], obj_id);
-        i++;
-        }
+      gavl_dictionary_set_string(album_m, GAVL_META_DATE, DATE_UNDEFINED);
       }
+
+    /* Duration */
+    gavl_dictionary_get_long(album_m, GAVL_META_APPROX_DURATION, &container_duration);
+    gavl_dictionary_get_long(m, GAVL_META_APPROX_DURATION, &child_duration);
+    container_duration += child_duration;
+    gavl_dictionary_set_long(album_m, GAVL_META_APPROX_DURATION, container_duration);
+
+    gavl_dictionary_get_long(album_m, META_DB_ID, &album_id);
+    
+    update_object(b, q.obj, q.table);
+
+    gavl_dictionary_destroy(q.obj);
+    q.obj = NULL;
+    return album_id;
     }
+  
+  create_new:
+  
+  gavl_dictionary_init(&album_dict);
 
+  album_m = gavl_dictionary_get_dictionary_create(&album_dict, GAVL_META_METADATA);
+  gavl_dictionary_set_string(album_m, GAVL_META_CLASS,
+                             GAVL_META_CLASS_MUSICALBUM);
   
+  album_id = create_object(p, TYPE_ALBUM);
   
-  return obj_id;
+  bg_plugin_registry_get_container_data(bg_plugin_reg, &album_dict, dict);
+
+  gavl_track_set_num_children(&album_dict, 0, 1);
+  
+  gavl_dictionary_set(album_m, GAVL_META_APPROX_DURATION , gavl_dictionary_get(m, GAVL_META_APPROX_DURATION));
+  gavl_dictionary_set_long(album_m, META_DB_ID, album_id);
+  add_object(b, &album_dict, -1, album_id);
+  
+  gavl_dictionary_free(&album_dict);
+  
+  return album_id;
   }
 
-static void scan_directory(bg_mdb_backend_t * b, const char * dir, gavl_array_t * files)
+static int64_t add_child_tv_show(bg_mdb_backend_t * b, gavl_dictionary_t * episode)
   {
-#if 0
-  struct
-    {
-    struct dirent d;
-    char b[NAME_MAX]; /* Make sure there is enough memory */
-    } dent;
-#endif
-  
-  struct dirent * dent_ptr = NULL;
-  DIR * d;
-  struct stat st;
-  char * filename;
+  /* TODO: Read .nfo file */
+  int64_t show_id;
+  const gavl_dictionary_t * m;
+  int result;
+  char * sql;
+  const char * show;
+  gavl_dictionary_t show_dict;
+  gavl_dictionary_t * show_m;
 
-  /* Load files (recursively) */
+  sqlite_priv_t * p = b->priv;
+  query_t q;
+  memset(&q, 0, sizeof(q));
+  q.be = b;
   
-  d = opendir(dir);
+  m = gavl_track_get_metadata(episode);
 
-  while((dent_ptr = readdir(d)))
+  q.table = get_obj_table(TYPE_TV_SHOW);
+  
+  if(!(show = gavl_dictionary_get_string(m, GAVL_META_SHOW)))
+    return -1;
+  
+  sql = sqlite3_mprintf("SELECT "META_DB_ID", "
+                        GAVL_META_NUM_CHILDREN" FROM shows WHERE "
+                        GAVL_META_TITLE" = %Q;", show);
+  
+  result = bg_sqlite_exec(p->db, sql, query_object_callback, &q);
+  sqlite3_free(sql);
+  if(!result)
+    goto create_new;
+  else if(q.obj)
     {
-    if(!dent_ptr)
-      break;
+    int num = 0;
+    gavl_dictionary_t * show_m = gavl_track_get_metadata_nc(q.obj);
 
-    if(dent_ptr->d_name[0] == '.')
-      continue;
+    gavl_dictionary_get_int(show_m, GAVL_META_NUM_CHILDREN, &num);
+    num++;
+    gavl_dictionary_set_int(show_m, GAVL_META_NUM_CHILDREN, num);
     
-    filename = gavl_sprintf("%s/%s", dir, dent_ptr->d_name);
-
-#ifdef _DIRENT_HAVE_D_TYPE
+    gavl_dictionary_get_long(show_m, META_DB_ID, &show_id);
+    
+    update_object(b, q.obj, q.table);
 
-    if(dent_ptr->d_type == DT_DIR)
-      {
-      scan_directory(b, filename, files);
-      free(filename);
-      continue;
-      }
-    else if((dent_ptr->d_type == DT_REG) ||
-            (dent_ptr->d_type == DT_LNK))
-      {
-      /* File */
-      if(!stat(filename, &st))
-        {
-        append_file_nocopy(files, filename, st.st_mtime);
-        filename = NULL;
-        }
-      }
-    else
-      {
-      free(filename);
-      continue;
-      }
-#else
-    if(!stat(filename, &st))
-      {
-      if(S_ISDIR(st.st_mode))
-        {
-        scan_directory(b, filename, files);
-        free(filename);
-        continue;
-        }
-      else
-        {
-        /* File */
-        append_file_nocopy(files, filename, st.st_mtime);
-        filename = NULL;
-        }
-      }
-#endif // _DIRENT_HAVE_D_TYPE
-
-    if(filename)
-      free(filename);
+    gavl_dictionary_destroy(q.obj);
+    q.obj = NULL;
+    return show_id;
     }
   
-  closedir(d);
+  create_new:
 
-  }
+  gavl_dictionary_init(&show_dict);
+  show_m = gavl_dictionary_get_dictionary_create(&show_dict, GAVL_META_METADATA);
 
-static int first_pass(const char * location)
-  {
-  const char * mimetype = NULL;
-  if(!(mimetype = bg_url_to_mimetype(location)))
-    return 0;
+  gavl_dictionary_set_string(show_m, GAVL_META_CLASS,
+                             GAVL_META_CLASS_TV_SHOW);
   
-  if(!strncmp(mimetype, "image/", 6))
-    return 1;
+  show_id = create_object(p, TYPE_TV_SHOW);
+
+  bg_plugin_registry_get_container_data(bg_plugin_reg, &show_dict, episode);
   
-  if(!strcmp(mimetype, "text/x-nfo"))
-    return 1;
+  gavl_track_set_num_children(&show_dict, 1, 0);
   
-  return 0;
+  gavl_dictionary_set_long(show_m, META_DB_ID, show_id);
+  
+  // gavl_dictionary_set(season_m, GAVL_META_GENRE, gavl_dictionary_get(m, GAVL_META_GENRE));
+  
+  add_object(b, &show_dict, -1, show_id);
+  gavl_dictionary_free(&show_dict);
+  
+  return show_id;
   }
 
-static void add_files(bg_mdb_backend_t * b, gavl_array_t * arr, int64_t scan_dir_id)
+static int64_t add_child_tv_season(bg_mdb_backend_t * b, gavl_dictionary_t * episode)
   {
-  int i;
-  const gavl_dictionary_t * dict;
-  const char * location;
-  const char * mimetype;
-  gavl_dictionary_t * mi;
-  gavl_dictionary_t * track;
+  const char * show;
+  int season = -1;
+  int64_t show_id;
+  int64_t season_id;
   
-  /* Handle .nfo and images first */
-  i = 0;
-  while(i < arr->num_entries)
-    {
-    if((dict = gavl_value_get_dictionary(&arr->entries[i])) &&
-       (location = gavl_dictionary_get_string(dict, GAVL_META_URI)))
-      {
-      if(!first_pass(location))
-        {
-        i++;
-        continue;
-        }
-      mimetype = bg_url_to_mimetype(location);
-
-      
-      if(!strcmp(mimetype, "text/x-nfo"))
-        {
-        int64_t mtime;
-        
-        if(gavl_dictionary_get_long(dict, GAVL_META_MTIME, &mtime))
-          {
-          gavl_dictionary_t * m;
-          gavl_dictionary_t * obj = gavl_dictionary_create();
-
-          gavl_log(GAVL_LOG_INFO, LOG_DOMAIN, "Adding file: %s",
-                 location);
-          
-          m = gavl_dictionary_get_dictionary_create(obj, GAVL_META_METADATA);
-          gavl_dictionary_copy(m, dict);
-          gavl_dictionary_set_string(m, GAVL_META_CLASS, "nfo");
-          
-          add_object(b, obj, scan_dir_id, -1);
-          
-          gavl_dictionary_destroy(obj); 
-          }
-        
-        gavl_array_splice_val(arr, i, 1, NULL);
-        continue;
-        }
+  const gavl_dictionary_t * m;
+  int result;
+  char * sql;
+  gavl_dictionary_t season_dict;
+  gavl_dictionary_t * season_m;
+  
+  sqlite_priv_t * p = b->priv;
+  query_t q;
+  memset(&q, 0, sizeof(q));
+  q.be = b;
+  
+  m = gavl_track_get_metadata(episode);
 
-      mi = NULL;
-      
-      if(!is_blacklisted(location)) // TODO: Make this more elegant
-        {
-        gavl_log(GAVL_LOG_INFO, LOG_DOMAIN, "Loading %s", location);
-      
-        mi = bg_plugin_registry_load_media_info(bg_plugin_reg,
-                                                location,
-                                                BG_INPUT_FLAG_GET_FORMAT);
-        }
-      
-      if(mi)
-        {
-        /* Multitrack files are ignored for now */
-        if((gavl_get_num_tracks(mi) == 1) && (track = gavl_get_track_nc(mi, 0)))
-          {
-          gavl_log(GAVL_LOG_INFO, LOG_DOMAIN, "Adding file: %s", location);
-          add_object(b, track, scan_dir_id, -1);
-          }
-        gavl_dictionary_destroy(mi);
-        gavl_array_splice_val(arr, i, 1, NULL);
-        }
-      else
-        i++;
-      }
-    else
-      i++;
-    }
+  if(!(show = gavl_dictionary_get_string(m, GAVL_META_SHOW)) ||
+     !gavl_dictionary_get_int(m, GAVL_META_SEASON, &season))
+    return -1;
   
+  show_id = bg_sqlite_string_to_id(p->db, "shows", META_DB_ID, GAVL_META_TITLE, show);
+  if(show_id < 0)
+    goto create_new;
   
-  /* Rest of the stuff */
+  /* Query db */
   
-  for(i = 0; i < arr->num_entries; i++)
+  q.table = get_obj_table(TYPE_TV_SEASON);
+  
+  sql = sqlite3_mprintf("SELECT "META_DB_ID", "
+                        GAVL_META_APPROX_DURATION", "
+                        GAVL_META_DATE", "
+                        GAVL_META_NUM_CHILDREN" FROM seasons WHERE "
+                        META_PARENT_ID" = %"PRId64" AND "GAVL_META_SEASON" = %d;",
+                        show_id, season);
+  
+  result = bg_sqlite_exec(p->db, sql, query_object_callback, &q);
+  sqlite3_free(sql);
+  if(!result)
+    goto create_new;
+
+  else if(q.obj)
     {
-    if((dict = gavl_value_get_dictionary(&arr->entries[i])) &&
-       (location = gavl_dictionary_get_string(dict, GAVL_META_URI)))
-      {
-      mi = NULL;
+    const char * season_date;
+    const char * episode_date;
+    int num = 0;
+    gavl_time_t container_duration = 0;
+    gavl_time_t child_duration = 0;
+    
+    season_m = gavl_track_get_metadata_nc(q.obj);
 
-      if(!is_blacklisted(location))
-        {
-        gavl_log(GAVL_LOG_INFO, LOG_DOMAIN, "Loading %s", location);
-        mi = bg_plugin_registry_load_media_info(bg_plugin_reg,
-                                                location,
-                                                BG_INPUT_FLAG_GET_FORMAT);
-        
-        }
-      if(mi)
-        {
-        /* Multitrack files are ignored for now */
-        if((gavl_get_num_tracks(mi) == 1) && (track = gavl_get_track_nc(mi, 0)))
-          {
-          gavl_log(GAVL_LOG_INFO, LOG_DOMAIN, "Adding file: %s", location);
-          add_object(b, track, scan_dir_id, -1);
-          }
-        gavl_dictionary_destroy(mi);
-        }
+    gavl_dictionary_get_int(season_m, GAVL_META_NUM_CHILDREN, &num);
+    num++;
+    gavl_dictionary_set_int(season_m, GAVL_META_NUM_CHILDREN, num);
+    
+    if((season_date = gavl_dictionary_get_string(season_m, GAVL_META_DATE)) &&
+       (episode_date = gavl_dictionary_get_string(m, GAVL_META_DATE)))
+      {
+      if(strcmp(episode_date, season_date) < 0)
+        gavl_dictionary_set_string(season_m, GAVL_META_DATE, season_date);
       }
     
-    }
-  }
-
-/*
- *  0: URI
- *  1: Object ID
- *  2: MTIME
- */
-
-typedef struct
-  {
-  int type;
-  gavl_array_t arr;
-  } get_files_t;
+    /* Duration */
+    gavl_dictionary_get_long(season_m, GAVL_META_APPROX_DURATION, &container_duration);
+    gavl_dictionary_get_long(m, GAVL_META_APPROX_DURATION, &child_duration);
+    container_duration += child_duration;
+    gavl_dictionary_set_long(season_m, GAVL_META_APPROX_DURATION, container_duration);
 
-static int get_files_db_callback(void * data, int argc, char **argv, char **azColName)
-  {
-  gavl_value_t val;
-  gavl_dictionary_t * dict;
-  get_files_t * gf = data;
+    gavl_dictionary_get_long(season_m, META_DB_ID, &season_id);
+    
+    update_object(b, q.obj, q.table);
 
-  gavl_value_init(&val);
-  dict = gavl_value_set_dictionary(&val);
+    gavl_dictionary_destroy(q.obj);
+    q.obj = NULL;
+    return season_id;
+    }
+  
+  create_new:
 
-  gavl_dictionary_set_string(dict, GAVL_META_URI, argv[0]);
-  gavl_dictionary_set_long(dict,   META_DB_ID, strtoll(argv[1], NULL, 10));
+  show_id = add_child_tv_show(b, episode);
+  
+  gavl_dictionary_init(&season_dict);
+  season_m = gavl_dictionary_get_dictionary_create(&season_dict, GAVL_META_METADATA);
+  gavl_dictionary_set_long(season_m, META_DB_ID, season_id);
+  gavl_dictionary_set_long(season_m, META_PARENT_ID, show_id);
 
-  if(!argv[2])
-    gavl_dictionary_set_long(dict,   GAVL_META_MTIME, 0);
-  else
-    gavl_dictionary_set_long(dict,   GAVL_META_MTIME, strtoll(argv[2], NULL, 10));
-  gavl_dictionary_set_int(dict,    "TYPE", gf->type);
+  gavl_dictionary_set_string(season_m, GAVL_META_CLASS, GAVL_META_CLASS_TV_SEASON);
   
-  gavl_array_splice_val_nocopy(&gf->arr, -1, 0, &val);
-  return 0;
+  season_id = create_object(p, TYPE_TV_SEASON);
+  
+  bg_plugin_registry_get_container_data(bg_plugin_reg, &season_dict, episode);
+  
+  gavl_dictionary_set(season_m, GAVL_META_DATE, gavl_dictionary_get(m, GAVL_META_DATE));
+  
+  gavl_track_set_num_children(&season_dict, 0, 1);
+  
+  gavl_dictionary_set(season_m, GAVL_META_APPROX_DURATION , gavl_dictionary_get(m, GAVL_META_APPROX_DURATION));
+  
+  add_object(b, &season_dict, -1, season_id);
+  
+  gavl_dictionary_free(&season_dict);
+  
+  return season_id;
+  // #endif
+  //  return -1;
   }
 
-static int find_by_uri(gavl_array_t * files, const char * uri)
+static int64_t add_movie_part(bg_mdb_backend_t * b, const gavl_dictionary_t * part_track)
   {
-  int i;
-  gavl_dictionary_t * dict;
-  const char * var;
-  
-  for(i = 0; i < files->num_entries; i++)
-    {
-    if((dict = gavl_value_get_dictionary_nc(&files->entries[i])) &&
-       (var = gavl_dictionary_get_string(dict, GAVL_META_URI)) &&
-       !(strcmp(var, uri)))
-      return i;
-    }
-  return -1;
-  }
-
-static void get_files_db(bg_mdb_backend_t * b, gavl_array_t * ret, int64_t id, int pass)
-  {
-  int i;
-  get_files_t gf;
+  const gavl_dictionary_t * part_m;
+  int result;
   char * sql;
-  sqlite_priv_t * priv;
-  priv = b->priv;
+  query_t q;
+  const char * title;
+  const char * date;
+  int64_t movie_id;
+
+  gavl_dictionary_t movie_dict;
+
+  gavl_dictionary_t * movie_m;
+  sqlite_priv_t * p = b->priv;
   
-  memset(&gf, 0, sizeof(gf));
+  part_m = gavl_track_get_metadata(part_track);
+  
+  memset(&q, 0, sizeof(q));
+  q.be = b;
+  
+  /* Query db */
 
-  i = 0;
-  while(obj_tables[i].table_name)
-    {
-    if(!has_col(&obj_tables[i], META_SCAN_DIR_ID) ||
-       (!has_src_col(&obj_tables[i], GAVL_META_URI) &&
-        !has_col(&obj_tables[i], GAVL_META_URI)) ||
-       (pass != obj_tables[i].pass))
-      {
-      i++;
-      continue;
-      }
-    gf.type = obj_tables[i].type;
-    sql = gavl_sprintf("SELECT "GAVL_META_URI", "META_DB_ID", "GAVL_META_MTIME" FROM %s WHERE "
-                     META_SCAN_DIR_ID" = %"PRId64";", obj_tables[i].table_name, id);
+  title = gavl_dictionary_get_string(part_m, GAVL_META_TITLE);
+  date = gavl_dictionary_get_string(part_m, GAVL_META_DATE);
+  
+  q.table = get_obj_table(TYPE_MOVIE);
+  
+  sql = sqlite3_mprintf("SELECT "META_DB_ID", "
+                        GAVL_META_APPROX_DURATION" FROM movies WHERE "
+                        GAVL_META_TITLE" = %Q AND "GAVL_META_DATE" = %Q;",
+                        title, date);
 
-    //    fprintf(stderr, "Get files SQL: %s\n", sql);
+  result = bg_sqlite_exec(p->db, sql, query_object_callback, &q);
+  sqlite3_free(sql);
 
-    if(!bg_sqlite_exec(priv->db, sql, get_files_db_callback, &gf))
-      return;
-    free(sql);
-    i++;
+  if(!result)
+    goto create_new;
+  
+  else if(q.obj)
+    {
+    gavl_time_t movie_duration = 0;
+    gavl_time_t part_duration = 0;
+    
+    movie_m = gavl_track_get_metadata_nc(q.obj);
+    gavl_dictionary_get_long(movie_m, META_DB_ID, &movie_id);
+    
+    /* Duration */
+    gavl_dictionary_get_long(movie_m, GAVL_META_APPROX_DURATION, &movie_duration);
+    gavl_dictionary_get_long(part_m, GAVL_META_APPROX_DURATION, &part_duration);
+    movie_duration += part_duration;
+    gavl_dictionary_set_long(movie_m, GAVL_META_APPROX_DURATION, movie_duration);
+    update_object(b, q.obj, q.table);
+
+    gavl_dictionary_destroy(q.obj);
+    q.obj = NULL;
+    
+    return movie_id;
     }
+  
+  create_new:
 
-  gavl_log(GAVL_LOG_INFO, LOG_DOMAIN, "Got %d files from database", gf.arr.num_entries);
+  gavl_dictionary_init(&movie_dict);
 
-  //  fprintf(stderr, "Got %d files from database\n", gf.arr.num_entries);
+  gavl_dictionary_copy(&movie_dict, part_track);
 
-  gavl_array_splice_array(ret, -1, 0, &gf.arr);
-  gavl_array_free(&gf.arr);
+  movie_m = gavl_track_get_metadata_nc(&movie_dict);
+  gavl_dictionary_set(movie_m, GAVL_META_SRC, NULL);
+
+  gavl_dictionary_set_string(movie_m, GAVL_META_CLASS, GAVL_META_CLASS_MOVIE);
+  
+  movie_id = create_object(p, TYPE_MOVIE);
+  add_object(b, &movie_dict, -1, movie_id);
+  gavl_dictionary_free(&movie_dict);
   
+  return movie_id;
   }
 
-static void delete_directory(bg_mdb_backend_t * b, const char * dir)
+static void delete_objects(bg_mdb_backend_t * b,
+                           const gavl_array_t * arr,
+                           int del_flags)
   {
-  gavl_array_t files;
-  int64_t id;
   int i;
-  char * sql;
   
-  sqlite_priv_t * priv = b->priv;
+  const gavl_dictionary_t * dict;
 
-  bg_mdb_unexport_media_directory(b->ctrl.evt_sink, dir);
+  //  fprintf(stderr, "delete_objects: %p\n", arr);
+  //  gavl_array_dump(arr, 2);
   
-  if((id = bg_sqlite_string_to_id(priv->db, "scandirs", "ID", "PATH", dir)) < 0)
+  for(i = 0; i < arr->num_entries; i++)
     {
-    gavl_log(GAVL_LOG_WARNING, LOG_DOMAIN, "No such directory %s in db", dir);
-    return;
+    if((dict = gavl_value_get_dictionary(&arr->entries[i])))
+      delete_object(b, dict, del_flags);
     }
-  gavl_array_init(&files);
-  
-  get_files_db(b, &files, id, 1);
-  get_files_db(b, &files, id, 2);
-  
-  bg_sqlite_start_transaction(priv->db);
-  
-  for(i = 0; i < files.num_entries; i++)
-    delete_object(b, gavl_value_get_dictionary(&files.entries[i]),
-                  DEL_FLAG_RELATED | DEL_FLAG_PARENT | DEL_FLAG_CHILDREN);
-  
-  sql = gavl_sprintf("DELETE FROM scandirs WHERE ID = %"PRId64";", id);
-  bg_sqlite_exec(priv->db, sql, NULL, NULL);
-  free(sql);
-  
-  bg_sqlite_end_transaction(priv->db);
-
-  gavl_array_free(&files);
   }
 
-static void add_directory(bg_mdb_backend_t * b, const char * dir)
+typedef struct
   {
-  int64_t id;
-  sqlite_priv_t * priv;
-  gavl_array_t files_fs;
-  int is_new = 0;
-  
-  priv = b->priv;
+  type_id_t type;
+  gavl_array_t * ret;
+  } get_related_array_t;
 
-  id = bg_sqlite_string_to_id(priv->db, "scandirs", "ID", "PATH", dir);
+static int get_related_array_cb(void * data, int argc, char **argv, char **azColName)
+  {
+  int i;
+  gavl_value_t val;
+  gavl_dictionary_t * dict;
+  get_related_array_t * q = data;
 
-  if(id > 0)
-    gavl_log(GAVL_LOG_INFO, LOG_DOMAIN, "Re-scanning directory %s", dir);
-  else
+  gavl_value_init(&val);
+  dict = gavl_value_set_dictionary(&val);
+  
+  for(i = 0; i < argc; i++)
     {
-    gavl_log(GAVL_LOG_INFO, LOG_DOMAIN, "Adding directory %s", dir);
-    is_new = 1;
+    if(!strcmp(azColName[i], GAVL_META_URI))
+      {
+      gavl_dictionary_set_string(dict, GAVL_META_URI, argv[i]);
+      }
+    else if(!strcmp(azColName[i], META_DB_ID))
+      {
+      gavl_dictionary_set_long(dict, META_DB_ID, strtoll(argv[i], NULL, 10));
+      }
     }
+  gavl_dictionary_set_int(dict, "TYPE", q->type);
+  gavl_array_splice_val_nocopy(q->ret, -1, 0, &val);
+  return 0;
+  }
+
+static void get_related_array(bg_mdb_backend_t * b,
+                              gavl_array_t * ret, const char * tag, int64_t id)
+  {
+  int i;
+  get_related_array_t priv;
+  char * sql;
+  sqlite_priv_t * p = b->priv;
   
-  gavl_array_init(&files_fs);
-  scan_directory(b, dir, &files_fs);
-  gavl_log(GAVL_LOG_INFO, LOG_DOMAIN, "Scanned directory, found %d files", files_fs.num_entries);
+  memset(&priv, 0, sizeof(priv));
+  priv.ret = ret;
   
-  bg_sqlite_start_transaction(priv->db);
+  i = 0;
 
-  /* Already present. Update */
-  if(id > 0)
+  while(obj_tables[i].table_name)
     {
-    int db_idx;
-    const char * uri;
-    const gavl_dictionary_t * file_fs;
-    const gavl_dictionary_t * file_db;
-    int64_t mtime_fs;
-    int64_t mtime_db;
-    int file_idx;
-    gavl_array_t files_db;
-
-    gavl_array_init(&files_db);
-
-    get_files_db(b, &files_db, id, 1);
-
-    /* Remove objects from data, where the file disappeared */
-    db_idx = 0;
-    
-    while(db_idx < files_db.num_entries)
+    if(!has_col(&obj_tables[i], tag))
       {
-      if((file_db = gavl_value_get_dictionary(&files_db.entries[db_idx])) &&
-         (uri = gavl_dictionary_get_string(file_db,GAVL_META_URI)) &&
-         (file_idx = find_by_uri(&files_fs, uri)) < 0)
-        {
-        delete_object(b, file_db, DEL_FLAG_RELATED | DEL_FLAG_PARENT | DEL_FLAG_CHILDREN );
-        gavl_array_splice_val(&files_db, db_idx, 1, NULL);
-        }
-      else
-        db_idx++;
+      i++;
+      continue;
       }
     
-    /* Remove outdated files from database. up-to-date files are removed from the db */
-    
-    file_idx = 0;
-    
-    while(file_idx < files_fs.num_entries)
+    priv.type = obj_tables[i].type;
+    if(has_src_col(&obj_tables[i], GAVL_META_URI))
       {
-      mtime_fs = -1;
-      mtime_db = -1;
-
-      if(!(file_fs = gavl_value_get_dictionary(&files_fs.entries[file_idx])) ||
-         !(uri = gavl_dictionary_get_string(file_fs,GAVL_META_URI)) ||
-         ((db_idx = find_by_uri(&files_db, uri)) < 0) ||
-         !(file_db = gavl_value_get_dictionary(&files_db.entries[db_idx])) ||
-         !gavl_dictionary_get_long(file_fs, GAVL_META_MTIME, &mtime_fs) ||
-         !gavl_dictionary_get_long(file_db, GAVL_META_MTIME, &mtime_db))
-        {
-        //        fprintf(stderr, "Skipping %s %d %"PRId64" %"PRId64"\n", uri,
-        //                db_idx, mtime_fs, mtime_db);
-        file_idx++;
-        continue;
-        }
-
-      
-      /* File on filesystem is newer than db entry: Remove so we can re-add it later */
-
-      if(mtime_fs > mtime_db)  // Entry out of date: Remove from db
-        {
-        gavl_log(GAVL_LOG_INFO, LOG_DOMAIN, "%s out of date, removing for re-adding later", uri);
-        
-        delete_object(b, file_db, DEL_FLAG_RELATED | DEL_FLAG_PARENT | DEL_FLAG_CHILDREN );
-        gavl_array_splice_val(&files_db, db_idx, 1, NULL);
-        file_idx++;
-        }
-      else // Entry up to date: Remove from files
-        {
-        gavl_array_splice_val(&files_fs, file_idx, 1, NULL);
-        }
+      sql = gavl_sprintf("SELECT "META_DB_ID", "GAVL_META_URI" from %s WHERE %s = ?1;",
+                       obj_tables[i].table_name, tag);
       }
-    
-    gavl_array_reset(&files_db);
-    get_files_db(b, &files_db, id, 2);
-
-    /* Remove objects from data, where the file disappeared */
-    db_idx = 0;
-    
-    while(db_idx < files_db.num_entries)
+    else
       {
-      if((file_db = gavl_value_get_dictionary(&files_db.entries[db_idx])) &&
-         (uri = gavl_dictionary_get_string(file_db,GAVL_META_URI)) &&
-         (file_idx = find_by_uri(&files_fs, uri)) < 0)
-        {
-        delete_object(b, file_db, DEL_FLAG_RELATED | DEL_FLAG_PARENT | DEL_FLAG_CHILDREN );
-        gavl_array_splice_val(&files_db, db_idx, 1, NULL);
-        }
-      else
-        db_idx++;
+      sql = gavl_sprintf("SELECT "META_DB_ID" from %s WHERE %s = ?1;",
+                       obj_tables[i].table_name, tag);
       }
+
+    //    fprintf(stderr, "get_realated_array: %s\n", sql);
     
-    /* Remove outdated files from database. up-to-date files are removed from the db */
-    
-    file_idx = 0;
-    
-    while(file_idx < files_fs.num_entries)
+    if(!bg_sqlite_exec_cached(p->stmts, sql, get_related_array_cb, &priv, 1, id))
       {
-      mtime_fs = -1;
-      mtime_db = -1;
-      
-      if(!(file_fs = gavl_value_get_dictionary(&files_fs.entries[file_idx])) ||
-         !(uri = gavl_dictionary_get_string(file_fs,GAVL_META_URI)) ||
-         ((db_idx = find_by_uri(&files_db, uri)) < 0) ||
-         !(file_db = gavl_value_get_dictionary(&files_db.entries[db_idx])) ||
-         !gavl_dictionary_get_long(file_fs, GAVL_META_MTIME, &mtime_fs) ||
-         !gavl_dictionary_get_long(file_db, GAVL_META_MTIME, &mtime_db))
-        {
-        //        fprintf(stderr, "Skipping %s %d %"PRId64" %"PRId64"\n", uri,
-        //                db_idx, mtime_fs, mtime_db);
-        file_idx++;
-        continue;
-        }
-      
-      /* File on filesystem is newer than db entry: Remove so we can re-add it later */
-
-      if(mtime_fs > mtime_db)  // Entry out of date: Remove from db
-        {
-        gavl_log(GAVL_LOG_INFO, LOG_DOMAIN, "%s out of date, removing for re-adding later", uri);
-        
-        delete_object(b, file_db, DEL_FLAG_RELATED | DEL_FLAG_PARENT | DEL_FLAG_CHILDREN );
-        gavl_array_splice_val(&files_db, db_idx, 1, NULL);
-        file_idx++;
-        }
-      else // Entry up to date: Remove from files
-        {
-        gavl_array_splice_val(&files_fs, file_idx, 1, NULL);
-        }
+      free(sql);
+      return;
       }
 
+    //    fprintf(stderr, "get_realated_array: %p %s\n", ret, sql);
+    //    gavl_array_dump(ret, 2);
     
-    gavl_array_free(&files_db);
-    }
-  else // scandir not in db
-    {
-    id = bg_sqlite_string_to_id_add(priv->db, "scandirs", "ID", "PATH", dir);
+    free(sql);
+    i++;
     }
-  
-  
-  /* Add new files */
-  add_files(b, &files_fs, id);
-
-  bg_sqlite_end_transaction(priv->db);
+  }
 
-  if(is_new)
-    {
-    bg_mdb_export_media_directory(b->ctrl.evt_sink, dir);
-    gavl_log(GAVL_LOG_INFO, LOG_DOMAIN, "Done adding %s", dir);
-    }
-  else
-    gavl_log(GAVL_LOG_INFO, LOG_DOMAIN, "Done re-scanning %s", dir);
-  }
-
-static void destroy_sqlite(bg_mdb_backend_t * b)
+/* Get array of children */
+static void get_child_array(bg_mdb_backend_t * b,
+                            gavl_array_t * ret, type_id_t type, int64_t id)
   {
-  sqlite_priv_t * priv;
-  priv = b->priv;
-  sqlite3_close(priv->db);
+  get_related_array_t priv;
+  char * sql;
+  sqlite_priv_t * p = b->priv;
 
-  gavl_dictionary_free(&priv->songs);
-  gavl_dictionary_free(&priv->movies);
-  gavl_dictionary_free(&priv->albums);
-  gavl_dictionary_free(&priv->series);
+  const obj_table_t * tab;
   
-  free(priv);
-  }
-
-/* Browse functions */
-
-static int starts_with(const char ** id, const char * str)
-  {
-  if(gavl_string_starts_with(*id, str))
-    {
-    (*id) += strlen(str);
-    return 1;
-    }
-  else
-    return 0;
-  }
-
-static void finalize_metadata_album(gavl_dictionary_t * m)
-  {
-  int i;
-  int num1, num2;
-  int year;
+  memset(&priv, 0, sizeof(priv));
+  priv.ret = ret;
+  priv.type = type;
   
-  const char * str;
-  const char * id;
+  tab = get_obj_table(type);
   
-  if((num1 = gavl_dictionary_get_num_items(m, GAVL_META_ARTIST)) &&
-     (num2 = gavl_dictionary_get_num_items(m, GAVL_META_ARTIST GAVL_META_ID)) &&
-     (num1 == num2))
+  if(has_src_col(tab, GAVL_META_URI))
     {
-    for(i = 0; i < num1; i++)
-      {
-      str = gavl_dictionary_get_string_array(m, GAVL_META_ARTIST, i);
-      id = gavl_dictionary_get_string_array(m, GAVL_META_ARTIST GAVL_META_ID, i);
-
-      gavl_dictionary_append_string_array_nocopy(m, GAVL_META_ARTIST "Container", 
-                                                 gavl_sprintf("/albums/artist/%s/%s", bg_mdb_get_group_id(str), id) );
-      }
+    sql = gavl_sprintf("SELECT "META_DB_ID", "GAVL_META_URI" from %s WHERE %s = %"PRId64";",
+                     tab->table_name, META_PARENT_ID, id);
     }
-
-  if((num1 = gavl_dictionary_get_num_items(m, GAVL_META_GENRE)) &&
-     (num2 = gavl_dictionary_get_num_items(m, GAVL_META_GENRE GAVL_META_ID)) &&
-     (num1 == num2))
+  else
     {
-    for(i = 0; i < num1; i++)
-      {
-      id = gavl_dictionary_get_string_array(m, GAVL_META_GENRE GAVL_META_ID, i);
-      gavl_dictionary_append_string_array_nocopy(m, GAVL_META_GENRE "Container", 
-                                                 gavl_sprintf("/albums/genre-artist/%s", id) );
-      }
+    sql = gavl_sprintf("SELECT "META_DB_ID" from %s WHERE %s = %"PRId64";",
+                     tab->table_name, META_PARENT_ID, id);
     }
   
-  if((year = gavl_dictionary_get_year(m, GAVL_META_DATE)))
-    gavl_dictionary_set_string_nocopy(m, GAVL_META_YEAR "Container", gavl_sprintf("/albums/year/%d", year));
-  
+  if(!bg_sqlite_exec(p->db, sql, get_related_array_cb, &priv))
+    {
+    free(sql);
+    return;
+    }
+  free(sql);
   }
 
-static void finalize_metadata_song(gavl_dictionary_t * m)
+static void
+delete_object_internal(bg_mdb_backend_t * b, int64_t id, type_id_t type,
+                       const char * uri, int del_flags)
   {
-  /* Make "links" for artist and genre */
-
   int i;
-  int num1, num2;
-  int year;
 
-  const char * str;
-  const char * id;
+  query_t q;
+  char * sql;
+  int64_t parent_id = -1;
+  type_id_t parent_type = 0;
+  type_id_t child_type = 0;
+  sqlite_priv_t * p = b->priv;
+
+  gavl_dictionary_t * parent_m;
+  const gavl_dictionary_t * obj_m;
+  gavl_dictionary_t * obj = NULL;
+
+  int is_item = 0;
+  int num_children;
+  int64_t duration;
+  int64_t parent_duration = GAVL_TIME_UNDEFINED;
   
-  if((num1 = gavl_dictionary_get_num_items(m, GAVL_META_ARTIST)) &&
-     (num2 = gavl_dictionary_get_num_items(m, GAVL_META_ARTIST GAVL_META_ID)) &&
-     (num1 == num2))
+  memset(&q, 0, sizeof(q));
+  q.be = b;
+  
+  gavl_log(GAVL_LOG_INFO, LOG_DOMAIN, "Deleting object %"PRId64, id);
+  
+  /* Remove from parent */
+  
+  switch(type)
     {
-    for(i = 0; i < num1; i++)
-      {
-      str = gavl_dictionary_get_string_array(m, GAVL_META_ARTIST, i);
-      id = gavl_dictionary_get_string_array(m, GAVL_META_ARTIST GAVL_META_ID, i);
-
-      gavl_dictionary_append_string_array_nocopy(m, GAVL_META_ARTIST "Container", 
-                                                 gavl_sprintf("/songs/artist/%s/%s", bg_mdb_get_group_id(str), id) );
-      }
+    case TYPE_SONG:
+      parent_type = TYPE_ALBUM;
+      is_item = 1;
+      break;
+    case TYPE_TV_SEASON:
+      parent_type = TYPE_TV_SHOW;
+      child_type = TYPE_TV_EPISODE;
+      break;
+    case TYPE_TV_EPISODE:
+      parent_type = TYPE_TV_SEASON;
+      is_item = 1;
+      break;
+    case TYPE_MOVIE_PART:
+      parent_type = TYPE_MOVIE;
+      is_item = 1;
+      break;
+    case TYPE_ALBUM:
+      child_type = TYPE_SONG;
+      break;
+    case TYPE_TV_SHOW:
+      child_type = TYPE_TV_SEASON;
+      break;
+    case TYPE_MOVIE:
+      child_type = TYPE_MOVIE_PART;
+      is_item = 1;
+      break;
+    case TYPE_IMAGE:
+      if(del_flags & DEL_FLAG_RELATED)
+        {
+        gavl_array_t arr;
+        gavl_array_init(&arr);
+        /* Delete related movies and songs */
+        
+        get_related_array(b, &arr, META_POSTER_ID, id);
+        get_related_array(b, &arr, META_WALLPAPER_ID, id);
+        get_related_array(b, &arr, META_COVER_ID, id);
 
-    
+        delete_objects(b, &arr, del_flags);
+        gavl_array_free(&arr);
+        }
+      break;
+    case TYPE_NFO:
+      if(del_flags & DEL_FLAG_RELATED)
+        {
+        /* Delete related movies and shows */
+        gavl_array_t arr;
+        gavl_array_init(&arr);
+        get_related_array(b, &arr, META_NFO_ID, id);
+        
+        delete_objects(b, &arr, del_flags);
+        gavl_array_free(&arr);
+        }
+      break;
     }
 
-  if((num1 = gavl_dictionary_get_num_items(m, GAVL_META_GENRE)) &&
-     (num2 = gavl_dictionary_get_num_items(m, GAVL_META_GENRE GAVL_META_ID)) &&
-     (num1 == num2))
+  if((del_flags & DEL_FLAG_CHILDREN) && (child_type > 0))
     {
-
-    for(i = 0; i < num1; i++)
-      {
-      id = gavl_dictionary_get_string_array(m, GAVL_META_GENRE GAVL_META_ID, i);
-      
-      gavl_dictionary_append_string_array_nocopy(m, GAVL_META_GENRE "Container", 
-                                                 gavl_sprintf("/songs/genre-artist/%s", id) );
-      }
-    
+    gavl_array_t arr;
+    gavl_array_init(&arr);
+    get_child_array(b, &arr, child_type, id);
+    delete_objects(b, &arr, del_flags & ~DEL_FLAG_PARENT);
+    gavl_array_free(&arr);
     }
-
-  
-  if((year = gavl_dictionary_get_year(m, GAVL_META_DATE)))
-    gavl_dictionary_set_string_nocopy(m, GAVL_META_YEAR "Container", gavl_sprintf("/songs/year/%d", year));
-
   
-  }
-
-static void finalize_metadata_movie(gavl_dictionary_t * m)
-  {
-
-  int i;
+  if((del_flags & DEL_FLAG_PARENT) && (parent_type > 0))
+    {
+    q.table = get_obj_table(type);
 
-  int num1, num2;
-  int year;
+    sql = gavl_sprintf("SELECT "META_DB_ID", "GAVL_META_APPROX_DURATION", "META_PARENT_ID" "
+                     "from %s WHERE "META_DB_ID" = %"PRId64";",
+                       q.table->table_name, id);
+      
+    
+    bg_sqlite_exec(p->db, sql, query_object_callback, &q);
+    free(sql);
+    
+    if(!q.obj)
+      goto go_on;
 
-  const char * str;
-  const char * id;
-  
-  if((num1 = gavl_dictionary_get_num_items(m, GAVL_META_ACTOR)) &&
-     (num2 = gavl_dictionary_get_num_items(m, GAVL_META_ACTOR GAVL_META_ID)) &&
-     (num1 == num2))
-    {
-    for(i = 0; i < num1; i++)
-      {
-      str = gavl_dictionary_get_string_array(m, GAVL_META_ACTOR, i);
-      id = gavl_dictionary_get_string_array(m, GAVL_META_ACTOR GAVL_META_ID, i);
+    obj = q.obj;
+    q.obj = NULL;
     
-      gavl_dictionary_append_string_array_nocopy(m, GAVL_META_ACTOR "Container", 
-                                                 gavl_sprintf("/movies/actor/%s/%s", bg_mdb_get_group_id(str), id) );
-      }
+    obj_m = gavl_track_get_metadata(obj);
     
+    q.table = get_obj_table(parent_type);
     
-    }
+    gavl_dictionary_get_long(obj_m, META_PARENT_ID, &parent_id);
 
-  if((num1 = gavl_dictionary_get_num_items(m, GAVL_META_DIRECTOR)) &&
-     (num2 = gavl_dictionary_get_num_items(m, GAVL_META_DIRECTOR GAVL_META_ID)) &&
-     (num1 == num2))
-    {
-    for(i = 0; i < num1; i++)
+    if(parent_type == TYPE_MOVIE)
       {
-      str = gavl_dictionary_get_string_array(m, GAVL_META_DIRECTOR, i);
-      id = gavl_dictionary_get_string_array(m, GAVL_META_DIRECTOR GAVL_META_ID, i);
-    
-      gavl_dictionary_append_string_array_nocopy(m, GAVL_META_DIRECTOR "Container", 
-                                                 gavl_sprintf("/movies/director/%s/%s", bg_mdb_get_group_id(str), id) );
-      }
-
-    
-    }
-
-  if((num1 = gavl_dictionary_get_num_items(m, GAVL_META_GENRE)) &&
-     (num2 = gavl_dictionary_get_num_items(m, GAVL_META_GENRE GAVL_META_ID)) &&
-     (num1 == num2))
-    {
-    for(i = 0; i < num1; i++)
+      sql = gavl_sprintf("SELECT "META_DB_ID", "GAVL_META_APPROX_DURATION" "
+                       "from %s WHERE "META_DB_ID" = %"PRId64";",
+                       q.table->table_name, parent_id);
+      }
+    else if(parent_type == TYPE_TV_SHOW)
       {
-      id = gavl_dictionary_get_string_array(m, GAVL_META_GENRE GAVL_META_ID, i);
-      
-      gavl_dictionary_append_string_array_nocopy(m, GAVL_META_GENRE "Container", 
-                                                 gavl_sprintf("/movies/genre/%s", id) );
+      sql = gavl_sprintf("SELECT "META_DB_ID", "GAVL_META_NUM_CHILDREN" "
+                       "from %s WHERE "META_DB_ID" = %"PRId64";",
+                       q.table->table_name, parent_id);
+      }
+    else
+      {
+      sql = gavl_sprintf("SELECT "META_DB_ID", "GAVL_META_APPROX_DURATION", "
+                       GAVL_META_NUM_CHILDREN" from %s WHERE "META_DB_ID" = %"PRId64";",
+                       q.table->table_name, parent_id);
       }
     
-    }
+    bg_sqlite_exec(p->db, sql, query_object_callback, &q);
+    free(sql);
+    
+    if(!q.obj)
+      goto go_on;
+    
+    parent_m = gavl_track_get_metadata_nc(q.obj);
 
-  if((num1 = gavl_dictionary_get_num_items(m, GAVL_META_COUNTRY)) &&
-     (num2 = gavl_dictionary_get_num_items(m, GAVL_META_COUNTRY GAVL_META_ID)) &&
-     (num1 == num2))
-    {
-    for(i = 0; i < num1; i++)
+    if(gavl_dictionary_get_long(parent_m, GAVL_META_APPROX_DURATION, &parent_duration))
       {
-      id = gavl_dictionary_get_string_array(m, GAVL_META_COUNTRY GAVL_META_ID, i);
+      gavl_dictionary_get_long(obj_m, GAVL_META_APPROX_DURATION, &duration);
+      parent_duration -= duration;
+
+      if(parent_duration <= 0)
+        {
+        //        fprintf(stderr, "Deleting parent object (duration <= 0)\n");
+        delete_object_internal(b, parent_id, parent_type, NULL, del_flags);
+        goto go_on;
+        }
+      gavl_dictionary_set_long(parent_m, GAVL_META_APPROX_DURATION, parent_duration);
+      }
     
-      gavl_dictionary_append_string_array_nocopy(m, GAVL_META_COUNTRY "Container", 
-                                                 gavl_sprintf("/movies/country/%s", id) );
+    if((num_children = gavl_track_get_num_children(q.obj)) > 0)
+      {
+      num_children--;
+      if(num_children <= 0)
+        {
+        //        fprintf(stderr, "Deleting parent object (num_children <= 0)\n");
+        delete_object_internal(b, parent_id, parent_type, NULL, 0);
+        goto go_on;
+        }
+
+      if(is_item)
+        gavl_track_set_num_children(q.obj, 0, num_children);
+      else
+        gavl_track_set_num_children(q.obj, num_children, 0);
       }
+    
+    update_object(b, q.obj, q.table);
     }
-
-  if((year = gavl_dictionary_get_year(m, GAVL_META_DATE)))
-    gavl_dictionary_set_string_nocopy(m, GAVL_META_YEAR "Container", gavl_sprintf("/movies/year/%d", year));
-  }
-
-static int browse_object_series(bg_mdb_backend_t * b, const char * id, gavl_dictionary_t * ret)
-  {
-  char * rest;
-  int64_t series_id;
-  gavl_dictionary_t * m;
-  gavl_dictionary_t * obj;
-  sqlite_priv_t * s;
-  int num = 0;
-  s = b->priv;
-  m = gavl_track_get_metadata_nc(ret);
   
-  id++;
+  go_on:
   
-  series_id = strtoll(id, &rest, 10);
-        
-  id = rest;
+  if(obj)
+    gavl_dictionary_destroy(obj);
+  if(q.obj)
+    gavl_dictionary_destroy(q.obj);
   
-  if(*id == '\0')  // /series/all/20
+  /* Dedicated table */
+  if((q.table = get_obj_table(type)))
     {
-    if(!(obj = query_sqlite_object(b, series_id, TYPE_TV_SHOW)))
-      return 0;
-
-    gavl_dictionary_merge2(m, gavl_track_get_metadata(obj));
-    gavl_dictionary_set(m, GAVL_META_LABEL, gavl_dictionary_get(m, GAVL_META_TITLE));
-
-    /* add "all episodes" */
-    gavl_dictionary_get_int(m, GAVL_META_NUM_CHILDREN, &num);
-    num++;
-    gavl_dictionary_set_int(m, GAVL_META_NUM_CHILDREN, num);
-    gavl_dictionary_set_int(m, GAVL_META_NUM_CONTAINER_CHILDREN, num);
+    sql = gavl_sprintf("DELETE FROM %s WHERE "META_DB_ID" = %"PRId64";",
+                     q.table->table_name, id);
+    bg_sqlite_exec(p->db, sql, NULL, NULL);
+    free(sql);
     
-    gavl_dictionary_destroy(obj);
-    return 1;
-    }
-  else if(*id == '/')  // /series/all/20/...
-    {
-    int64_t season_id;
-
-    id++;
+    /* Remove arrays */
 
-    if(!strncmp(id, "all", 3))
-      {
-      season_id = -1;
-      id += 3;
-      }
-    else
-      {
-      season_id = strtoll(id, &rest, 10);
-      id = rest;
-      }
-    
-    if(*id == '\0')  // /series/all/20/40
+    if(q.table->arrays)
       {
-      if(season_id == -1) // /series/all/20/all
+      i = 0;
+      
+      while(q.table->arrays[i].name)
         {
-        query_t q;
-        char * sql;
-        
-        // int64_t poster_id, wallpaper_id;
-        int64_t num_children = 0;
-        
-        gavl_dictionary_set_string(m, GAVL_META_CLASS, GAVL_META_CLASS_CONTAINER);
-        gavl_dictionary_set_string(m, GAVL_META_LABEL, "All episodes");
-
-        gavl_dictionary_set_string(m, GAVL_META_CHILD_CLASS, GAVL_META_CLASS_TV_EPISODE);
-        
-        
-        sql = gavl_sprintf("SELECT COUNT("META_DB_ID") FROM episodes WHERE "META_PARENT_ID" in (SELECT "META_DB_ID" FROM seasons "
-                         "WHERE "META_PARENT_ID" = %"PRId64");", series_id);
-
-        bg_sqlite_exec(s->db, sql, bg_sqlite_int_callback, &num_children);
+        /* Remove from array */
+        sql = gavl_sprintf("DELETE FROM %s WHERE OBJ_ID = %"PRId64";",
+                         q.table->arrays[i].array_table_name, id);
+        bg_sqlite_exec(p->db, sql, NULL, NULL);
         free(sql);
 
-        gavl_track_set_num_children(ret, 0, num_children);
-        
-        /* Poster- and wallpaper ID */
-        memset(&q, 0, sizeof(q));
-        q.be = b;
-        q.table = get_obj_table(TYPE_TV_SHOW);
-        
-        sql = gavl_sprintf("SELECT "META_POSTER_ID", "META_WALLPAPER_ID" FROM shows WHERE "META_DB_ID" = %"PRId64";", series_id);
-        bg_sqlite_exec(s->db, sql, query_object_callback, &q);
+        /* Remove orphaned IDs */
+        sql = gavl_sprintf("DELETE FROM %s WHERE ID NOT IN (SELECT DISTINCT NAME_ID FROM %s);",
+                         q.table->arrays[i].id_table_name, q.table->arrays[i].array_table_name);
+        bg_sqlite_exec(p->db, sql, NULL, NULL);
         free(sql);
         
-        if(q.obj)
-          {
-          const gavl_dictionary_t * m1;
-
-          //          fprintf(stderr, "Object:\n");
-          //          gavl_dictionary_dump(q.obj, 2);
-          //          fprintf(stderr, "\n");
-
-          if((m1 = gavl_track_get_metadata(q.obj)))
-            {
-            gavl_dictionary_merge2(m, m1);
-            }
-          gavl_dictionary_destroy(q.obj);
-
-          query_images(b, m);
-          }
-        
-        }
-      else
-        {
-        int season;
-        int num;
-        
-        if(!(obj = query_sqlite_object(b, season_id, TYPE_TV_SEASON)))
-          return 0;
-      
-        gavl_dictionary_merge2(m, gavl_track_get_metadata(obj));
-
-        gavl_dictionary_get_int(m, GAVL_META_SEASON, &season);
-        gavl_dictionary_get_int(m, GAVL_META_NUM_CHILDREN, &num);
-        gavl_dictionary_set_int(m, GAVL_META_NUM_ITEM_CHILDREN, num);
-        
-        gavl_dictionary_set_string_nocopy(m, GAVL_META_LABEL, gavl_sprintf("Season %d", season));
-      
-        gavl_dictionary_destroy(obj);
+        i++;
         }
-      return 1;
       }
-    else if(*id == '/')  // /series/all/20/40/
-      {
-      int64_t episode_id;
-      id++;
-      episode_id = strtoll(id, &rest, 10);
-
-      if(!(obj = query_sqlite_object(b, episode_id, TYPE_TV_EPISODE)))
-        return 0;
-      
-      gavl_dictionary_merge2(m, gavl_track_get_metadata(obj));
-
-      gavl_dictionary_set(m, GAVL_META_LABEL, gavl_dictionary_get(m, GAVL_META_TITLE));
       
-      gavl_dictionary_destroy(obj);
-      return 1;
-      }
     }
-  else
-    return 0;
 
-  return 0;
+  /* Full text index */
+  if(p->have_fts && fts_is_indexed(type))
+    bg_sqlite_exec_cached(p->stmts, "DELETE FROM "FTS_TABLE" WHERE rowid = ?1;", NULL, NULL, 1, id);
+  
+  /* Object table */
+  sql = gavl_sprintf("DELETE FROM objects WHERE "META_DB_ID" = %"PRId64";", id);
+  bg_sqlite_exec(p->db, sql, NULL, NULL);
+  free(sql);
+
+  
+  
+  
   }
 
-static int browse_object_internal(bg_mdb_backend_t * b, const char * id_p, gavl_dictionary_t * ret)
+static void delete_object(bg_mdb_backend_t * b, const gavl_dictionary_t * obj, int del_flags)
   {
-  gavl_dictionary_t * m;
-  sqlite_priv_t * s;
-  int64_t artist_id;
-  int64_t genre_id;
-  char * rest;
-  char * sql;
-  const char * id;
-  gavl_dictionary_t * obj;
-  
-  s = b->priv;
+  int64_t id;
+  type_id_t type;
+  const char * uri;
 
-  m = gavl_track_get_metadata_nc(ret);
+  uri = gavl_dictionary_get_string(obj, GAVL_META_URI);
+  gavl_dictionary_get_long(obj, META_DB_ID, &id);
+  gavl_dictionary_get_int(obj, "TYPE", (int*)&type);
   
-  if(id_p)
-    {
-    id = id_p;
-    gavl_dictionary_set_string(m, GAVL_META_ID, id);
-    }
-  else
-    id = gavl_dictionary_get_string(m, GAVL_META_ID);
+  delete_object_internal(b, id, type, uri, del_flags);
+  }
 
-  if(s->songs_id && starts_with(&id, s->songs_id))
-    {
-    if(*id != '/')
-      return 0;
-    id++;
 
-    if(starts_with(&id, "artist")) // /songs/artist
-      {
-      if(*id == '\0')
-        {
-        gavl_array_t arr;
-        gavl_array_init(&arr);
-        
-        gavl_dictionary_set_string(m, GAVL_META_LABEL, "Artist");
-        gavl_dictionary_set_string(m, GAVL_META_CLASS, GAVL_META_CLASS_CONTAINER);
-        
-        bg_sqlite_exec(s->db, "SELECT NAME FROM song_artists", append_string_callback, &arr);
+static int64_t add_object(bg_mdb_backend_t * b, gavl_dictionary_t * track,
+                          int64_t scan_dir_id, int64_t obj_id)
+  {
+  int64_t id;
+  int i, result;
+  const char * klass;
+  gavl_dictionary_t * m;
+  type_id_t type;
+  const obj_table_t * tab;
+  char * sql;
+  char * sql2;
+  sqlite3_stmt * st;
+  gavl_array_t vals;
+  sqlite_priv_t * p = b->priv;
+  const char * var;
+  int no_obj_table = 0;
 
-        gavl_track_set_num_children(ret, bg_mdb_get_num_groups(&arr), 0);
-        gavl_array_free(&arr);
-        return 1;
-        }
-      else if(*id == '/')
-        {
-        const char * pos;
+  //  bg_mdb_create_thumbnails(b->db, track);
+  
+  m = gavl_track_get_metadata_nc(track);
 
-        id++;
+  if(!(klass = gavl_dictionary_get_string(m, GAVL_META_CLASS)))
+    return -1;
 
-        if(!(pos = strchr(id, '/'))) // /songs/artist/a
-          {
-          gavl_array_t arr;
-          gavl_array_init(&arr);
-          bg_sqlite_exec(s->db, "SELECT NAME FROM song_artists", append_string_callback, &arr);
+  gavl_log(GAVL_LOG_INFO, LOG_DOMAIN, "Adding object %s %s",
+           gavl_dictionary_get_string(m, GAVL_META_LABEL), 
+           klass);
+  
+  /* Single part movies are handled same as multipart in the db */
+  if(!strcmp(klass, GAVL_META_CLASS_MOVIE) && (obj_id < 0))
+    {
+    gavl_dictionary_set_string(m, GAVL_META_CLASS, GAVL_META_CLASS_MOVIE_PART);
+    klass = gavl_dictionary_get_string(m, GAVL_META_CLASS);
+    }
+  
+  if(!(type = get_type_id(klass)) ||
+     !(tab = get_obj_table(type)))
+    return -1;
 
-          gavl_track_set_num_children(ret, bg_mdb_get_group_size(&arr, id), 0);
-          
-          gavl_dictionary_set_string(m, GAVL_META_LABEL, bg_mdb_get_group_label(id));
+  /* OBJECTS */
 
-          gavl_dictionary_set_string(m, GAVL_META_CLASS, GAVL_META_CLASS_CONTAINER);
-          gavl_dictionary_set_string(m, GAVL_META_CHILD_CLASS, GAVL_META_CLASS_CONTAINER_ARTIST);
-          gavl_array_free(&arr);
-          return 1;
-          }
-        else  // /songs/artist/a/152
-          {
-          char * rest;
-          int64_t artist_id;
-          
-          id = pos;
-          id++;
-          artist_id = strtoll(id, &rest, 10);
+  no_obj_table = 0;
+  
+  if(has_col(tab, GAVL_META_DATE) &&
+     !gavl_dictionary_get_string(m, GAVL_META_DATE))
+    gavl_dictionary_set_string(m, GAVL_META_DATE, DATE_UNDEFINED);
 
-          id = rest;
+  if(has_col(tab, META_IMAGE_TYPE) &&
+     !gavl_dictionary_get_int(m, META_IMAGE_TYPE, &i))
+    gavl_dictionary_set_int(m, META_IMAGE_TYPE, IMAGE_TYPE_IMAGE);
+  
+  /* Parent container */
+  switch(type)
+    {
+    case TYPE_SONG:
+      gavl_dictionary_set_long(m, META_PARENT_ID, add_child_album(b, track));
+      break;
+    case TYPE_TV_EPISODE:
+      gavl_dictionary_set_long(m, META_PARENT_ID, add_child_tv_season(b, track));
+      break;
+    case TYPE_MOVIE_PART:
+      /* Check if the movie already exists */
+      gavl_dictionary_set_long(m, META_PARENT_ID, add_movie_part(b, track));
+      break;
+    default:
+      break;
+    }
 
-          if(*id == '\0')  // /songs/artist/a/123
-            {
-            gavl_dictionary_set_string_nocopy(m, GAVL_META_LABEL,
-                                              bg_sqlite_id_to_string(s->db,
-                                                                     "song_artists",
-                                                                     "NAME", "ID", artist_id));
+  /* IDs for external resoures */
+  if(has_col(tab, META_POSTER_ID))
+    {
+    if((var = gavl_dictionary_get_string_image_uri(m, GAVL_META_POSTER_URL, 0, NULL, NULL, NULL)))
+      {
+      id = bg_sqlite_string_to_id_cached(p->stmts, "images", META_DB_ID, GAVL_META_URI, var);
+      gavl_dictionary_set_long(m, META_POSTER_ID, id);
+      set_image_type(b, id, IMAGE_TYPE_POSTER);
+      }
+    else
+      gavl_dictionary_set_long(m, META_POSTER_ID, -1);
+    }
+  if(has_col(tab, META_WALLPAPER_ID))
+    {
+    if((var = gavl_dictionary_get_string_image_uri(m, GAVL_META_WALLPAPER_URL, 0, NULL, NULL, NULL)))
+      {
+      id = bg_sqlite_string_to_id_cached(p->stmts, "images", META_DB_ID, GAVL_META_URI, var);
+      gavl_dictionary_set_long(m, META_WALLPAPER_ID, id);
+      set_image_type(b, id, IMAGE_TYPE_WALLPAPER);
+      }
+    else
+      gavl_dictionary_set_long(m, META_WALLPAPER_ID, -1);
+    }
+  if(has_col(tab, META_COVER_ID))
+    {
+    if((var = gavl_dictionary_get_string_image_uri(m, GAVL_META_COVER_URL, 0, NULL, NULL, NULL)))
+      {
+      id = bg_sqlite_string_to_id_cached(p->stmts, "images", META_DB_ID, GAVL_META_URI, var);
+      gavl_dictionary_set_long(m, META_COVER_ID, id);
+      set_image_type(b, id, IMAGE_TYPE_COVER);
+      }
+    else
+      gavl_dictionary_set_long(m, META_COVER_ID, -1);
+    }
+  if(has_col(tab, META_NFO_ID))
+    {
+    if((var = gavl_dictionary_get_string(m, GAVL_META_NFO_FILE)))
+      gavl_dictionary_set_long(m, META_NFO_ID,
+                               bg_sqlite_string_to_id_cached(p->stmts, "nfos", META_DB_ID, GAVL_META_URI, var));
+    else
+      gavl_dictionary_set_long(m, META_NFO_ID, -1);
+    }
 
-            gavl_dictionary_set_string(m, GAVL_META_CLASS,
-                                       GAVL_META_CLASS_CONTAINER_ARTIST);
-            gavl_dictionary_set_string(m, GAVL_META_CHILD_CLASS, GAVL_META_CLASS_SONG);
+  if(has_array(tab, GAVL_META_COUNTRY))
+    {
+    if(!gavl_dictionary_get_item(m, GAVL_META_COUNTRY, 0))
+      gavl_dictionary_set_string(m, GAVL_META_COUNTRY, "Unknown");
+    }
+  
+  if(scan_dir_id >= 0)
+    gavl_dictionary_set_long(m, META_SCAN_DIR_ID, scan_dir_id);
+  
+  /* Dedicated obj table */
 
-            /* num_children */
-            sql = gavl_sprintf("SELECT count(OBJ_ID) "
-                             "FROM song_artists_arr WHERE "
-                             "NAME_ID = %"PRId64";", artist_id);
+  if(!no_obj_table)
+    {
+    if((obj_id < 0) && ((obj_id = create_object(p, type)) < 0))
+      return -1;
+    
+    if(!strcmp(klass, GAVL_META_CLASS_MOVIE))
+      {
+      gavl_dictionary_set_long(m, META_PARENT_ID, obj_id);
+      }
+    
+    gavl_dictionary_set_long(m, META_DB_ID, obj_id);
+  
+  
+    sql  = gavl_sprintf("INSERT INTO %s (", tab->table_name);
+    sql2 = gavl_sprintf(") VALUES (");
 
-            gavl_track_set_num_children(ret, 0, (int)bg_sqlite_get_int(s->db, sql));
-            
-            free(sql);
-            
-            return 1;
-            }
-          else if(*id == '/')   // /songs/artist/a/123/1200
-            {
-            int64_t song_id;
-            id++;
-            song_id = strtoll(id, &rest, 10);
-            
-            if(!(obj = query_sqlite_object(b, song_id, TYPE_SONG)))
-              return 0;
-            
-            gavl_dictionary_merge2(m, gavl_track_get_metadata(obj));
-            gavl_dictionary_set(m, GAVL_META_LABEL, gavl_dictionary_get(m, GAVL_META_TITLE));
+    gavl_array_init(&vals);
+    
+    append_cols(p, m, tab->cols, &sql, &sql2, &vals);
 
-            finalize_metadata_song(m);
-            
-            gavl_dictionary_destroy(obj);
-            return 1;
-            }
-          else
-            return 0;
-          }
-        }
-      else
-        return 0;
+    if(tab->src_cols)
+      {
+      const gavl_dictionary_t * src = gavl_metadata_get_src(m, GAVL_META_SRC, 0,
+                                                              NULL, NULL);
+      append_cols(p, src, tab->src_cols, &sql, &sql2, &vals);
       }
-    else if(starts_with(&id, "genre-artist")) // /songs/genre-artist
+
+    if(has_col(tab, GAVL_META_SEARCH_TITLE) &&
+       (var = gavl_dictionary_get_string(m, GAVL_META_SEARCH_TITLE)))
       {
-      if(*id == '\0')
-        {
-        gavl_dictionary_set_string(m, GAVL_META_LABEL, "Genre-Artist");
-        gavl_dictionary_set_string(m, GAVL_META_CLASS, GAVL_META_CLASS_CONTAINER);
-        gavl_dictionary_set_string(m, GAVL_META_CHILD_CLASS, GAVL_META_CLASS_CONTAINER_GENRE);
-                
-        gavl_track_set_num_children(ret, bg_sqlite_get_int(s->db, "SELECT COUNT(ID) FROM song_genres;"), 0);
-        return 1;
-        }
-      else if(*id == '/')  // /songs/genre-artist/1
-        {
-        id++;
-        genre_id = strtoll(id, &rest, 10);
+      gavl_value_t bind_val;
+      
+      sql  = gavl_strcat(sql, ", "META_SORT_KEY);
+      sql2 = gavl_strcat(sql2, ", sortkey(?)");
+      
+      gavl_value_init(&bind_val);
+      gavl_value_set_string(&bind_val, var);
+      gavl_array_splice_val_nocopy(&vals, -1, 0, &bind_val);
+      }
+    
+    sql = gavl_strcat(sql, sql2);
+    sql = gavl_strcat(sql, ");");
 
-        if(id == rest)
-          return 0;
+    /* The column set only depends on which tags are present, so the
+       number of different statements is small */
+    
+    if((st = bg_sqlite_stmt_cache_get(p->stmts, sql)))
+      {
+      for(i = 0; i < vals.num_entries; i++)
+        bg_sqlite_bind_value(st, i+1, &vals.entries[i]);
+      result = bg_sqlite_stmt_exec(p->stmts, st, NULL, NULL);
+      }
+    else
+      result = 0;
+    
+    free(sql);
+    free(sql2);
+    gavl_array_free(&vals);
+    
+    if(!result)
+      return -1;
 
-        id = rest;
-
-        if(*id == '\0')
-          {
-          gavl_dictionary_set_string_nocopy(m, GAVL_META_LABEL,
-                                            bg_sqlite_id_to_string(s->db,
-                                                                   "song_genres",
-                                                                   "NAME", "ID", genre_id));
-          
-          gavl_dictionary_set_string(m, GAVL_META_CLASS, GAVL_META_CLASS_CONTAINER_GENRE);
-          gavl_dictionary_set_string(m, GAVL_META_CHILD_CLASS, GAVL_META_CLASS_CONTAINER_ARTIST);
-          
-          sql = gavl_sprintf("SELECT count(DISTINCT song_artists_arr.NAME_ID) "
-                           "FROM song_artists_arr INNER JOIN song_genres_arr "
-                           "ON song_artists_arr.OBJ_ID = song_genres_arr.OBJ_ID "
-                           "WHERE song_genres_arr.NAME_ID = %"PRId64";", genre_id);
+    }
+  
+  /* Arrays */
+  if(!no_obj_table)
+    {
+    i = 0;
 
-          gavl_track_set_num_children(ret, (int)bg_sqlite_get_int(s->db, sql), 0);
-          free(sql);
-          
-          
-          return 1;
-          }
-        else if(*id == '/')
-          {
-          id++;
-          artist_id = strtoll(id, &rest, 10);
+    if(tab->arrays)
+      {
+      while(tab->arrays[i].name)
+        {
+        append_array(p, m, &tab->arrays[i], obj_id);
+        i++;
+        }
+      }
 
-          id = rest;
+    fts_add(p, tab, m, obj_id);
+    }
 
-          if(*id == '\0')
-            {
-            gavl_dictionary_set_string(m, GAVL_META_CLASS, GAVL_META_CLASS_CONTAINER_ARTIST);
-            gavl_dictionary_set_string(m, GAVL_META_CHILD_CLASS, GAVL_META_CLASS_SONG);
-          
-            gavl_dictionary_set_string_nocopy(m, GAVL_META_LABEL,
-                                              bg_sqlite_id_to_string(s->db,
-                                                                     "song_artists",
-                                                                     "NAME", "ID", artist_id));
+  
+  
+  return obj_id;
+  }
 
-            sql = gavl_sprintf("SELECT count(song_artists_arr.OBJ_ID) "
-                             "FROM song_artists_arr INNER JOIN song_genres_arr "
-                             "ON song_artists_arr.OBJ_ID = song_genres_arr.OBJ_ID "
-                             "WHERE song_genres_arr.NAME_ID = %"PRId64" AND "
-                             "song_artists_arr.NAME_ID = %"PRId64";", genre_id, artist_id);
+static void scan_directory(bg_mdb_backend_t * b, const char * dir, gavl_array_t * files)
+  {
+#if 0
+  struct
+    {
+    struct dirent d;
+    char b[NAME_MAX]; /* Make sure there is enough memory */
+    } dent;
+#endif
+  
+  struct dirent * dent_ptr = NULL;
+  DIR * d;
+  struct stat st;
+  char * filename;
 
-            gavl_track_set_num_children(ret, 0, (int)bg_sqlite_get_int(s->db, sql));
-            free(sql);
-            
-            return 1;
-            }
-          else if(*id == '/')
-            {
-            int64_t obj_id;
-            id++;
+  /* Load files (recursively) */
+  
+  d = opendir(dir);
 
-            obj_id = strtoll(id, &rest, 10);
+  while((dent_ptr = readdir(d)))
+    {
+    if(!dent_ptr)
+      break;
 
-            if(!(obj = query_sqlite_object(b, obj_id, TYPE_SONG)))
-              return 0;
-            
-            gavl_dictionary_merge2(m, gavl_track_get_metadata(obj));
-            gavl_dictionary_set(m, GAVL_META_LABEL, gavl_dictionary_get(m, GAVL_META_TITLE));
+    if(dent_ptr->d_name[0] == '.')
+      continue;
+    
+    filename = gavl_sprintf("%s/%s", dir, dent_ptr->d_name);
 
-            finalize_metadata_song(m);
-            
-            gavl_dictionary_destroy(obj);
-            return 1;
-            }
-          else          
-            return 0;
+#ifdef _DIRENT_HAVE_D_TYPE
 
-          }
-        else
-          return 0;
-        
+    if(dent_ptr->d_type == DT_DIR)
+      {
+      scan_directory(b, filename, files);
+      free(filename);
+      continue;
+      }
+    else if((dent_ptr->d_type == DT_REG) ||
+            (dent_ptr->d_type == DT_LNK))
+      {
+      /* File */
+      if(!stat(filename, &st))
+        {
+        append_file_nocopy(files, filename, st.st_mtime);
+        filename = NULL;
         }
-      else
-        return 0;
       }
-    else if(starts_with(&id, "genre-year"))
+    else
       {
-      if(*id == '\0')
+      free(filename);
+      continue;
+      }
+#else
+    if(!stat(filename, &st))
+      {
+      if(S_ISDIR(st.st_mode))
         {
-        gavl_dictionary_set_string(m, GAVL_META_LABEL, "Genre-Year");
-        gavl_dictionary_set_string(m, GAVL_META_CLASS, GAVL_META_CLASS_CONTAINER);
-        gavl_dictionary_set_string(m, GAVL_META_CHILD_CLASS, GAVL_META_CLASS_CONTAINER_GENRE);
-        
-        gavl_track_set_num_children(ret, bg_sqlite_get_int(s->db, "SELECT COUNT(ID) FROM song_genres;"), 0);
-        
-        return 1;
+        scan_directory(b, filename, files);
+        free(filename);
+        continue;
         }
-      else if(*id == '/')
+      else
         {
-        id++;
-        genre_id = strtoll(id, &rest, 10);
+        /* File */
+        append_file_nocopy(files, filename, st.st_mtime);
+        filename = NULL;
+        }
+      }
+#endif // _DIRENT_HAVE_D_TYPE
 
-        if(id == rest)
-          return 0;
-        id = rest;
+    if(filename)
+      free(filename);
+    }
+  
+  closedir(d);
 
-        if(*id == '\0') // /songs/genre-year/1
-          {
-          gavl_dictionary_set_string_nocopy(m, GAVL_META_LABEL,
-                                            bg_sqlite_id_to_string(s->db,
-                                                                   "song_genres",
-                                                                   "NAME", "ID", genre_id));
-          
-          gavl_dictionary_set_string(m, GAVL_META_CLASS, GAVL_META_CLASS_CONTAINER_GENRE);
-          gavl_dictionary_set_string(m, GAVL_META_CHILD_CLASS, GAVL_META_CLASS_CONTAINER_YEAR);
-          
-          sql = gavl_sprintf("SELECT count(DISTINCT substr(songs."GAVL_META_DATE", 1, 4)) FROM "
-                           "songs INNER JOIN song_genres_arr ON "
-                           "song_genres_arr.OBJ_ID = songs.DBID WHERE "
-                           "song_genres_arr.NAME_ID = %"PRId64" ;", genre_id);
+  }
 
-          gavl_track_set_num_children(ret, bg_sqlite_get_int(s->db, sql), 0);
-          free(sql);
-          
-          return 1;
-          }
-        else if(*id == '/')  // /songs/genre-year/1/1960...
-          {
-          int year;
+static int first_pass(const char * location)
+  {
+  const char * mimetype = NULL;
+  if(!(mimetype = bg_url_to_mimetype(location)))
+    return 0;
+  
+  if(!strncmp(mimetype, "image/", 6))
+    return 1;
+  
+  if(!strcmp(mimetype, "text/x-nfo"))
+    return 1;
+  
+  return 0;
+  }
 
-          id++;
-          
-          year = strtol(id, &rest, 10);
+/*
+ *  Loading the media infos is done by a pool of threads. The results are
+ *  consumed in order by the backend thread, which is the only one writing
+ *  to the database.
+ */
 
-          id = rest;
+/* Number of media infos the workers can load ahead of the writer */
+#define PROBE_RESULTS_PER_THREAD 8
 
-          if(*id == '\0')  // /songs/genre-year/1/1960
-            {
-            gavl_dictionary_set_string(m, GAVL_META_CLASS, GAVL_META_CLASS_CONTAINER_YEAR);
-            gavl_dictionary_set_string(m, GAVL_META_CHILD_CLASS, GAVL_META_CLASS_SONG);
+/* Objects inserted per transaction */
+#define PROBE_TRANSACTION_SIZE   1000
 
-            if(year < 9999)
-              gavl_dictionary_set_string_nocopy(m, GAVL_META_LABEL, gavl_sprintf("%d", year));
-            else
-              gavl_dictionary_set_string(m, GAVL_META_LABEL, "Unknown");
-                        
-            /* num children */
-            sql = gavl_sprintf("SELECT count(songs."META_DB_ID") FROM "
-                             "songs INNER JOIN song_genres_arr ON "
-                             "song_genres_arr.OBJ_ID = songs.DBID WHERE "
-                             "song_genres_arr.NAME_ID = %"PRId64" AND songs."GAVL_META_DATE" GLOB '%d*';", genre_id, year);
+/* Log the throughput every 10 seconds */
+#define PROBE_LOG_INTERVAL       (10*GAVL_TIME_SCALE)
 
-            gavl_track_set_num_children(ret, 0, bg_sqlite_get_int(s->db, sql));
-            
-            free(sql);
-            
-            return 1;
-            }
-          else if(*id == '/')
-            {
-            int64_t song_id;
+typedef struct
+  {
+  const char * location;
+  gavl_dictionary_t * mi;
+  int done;
+  } probe_job_t;
 
-            id++;
-            song_id = strtoll(id, NULL, 10);
-            
-            if(!(obj = query_sqlite_object(b, song_id, TYPE_SONG)))
-              return 0;
-            
-            gavl_dictionary_merge2(m, gavl_track_get_metadata(obj));
-            gavl_dictionary_set(m, GAVL_META_LABEL, gavl_dictionary_get(m, GAVL_META_TITLE));
+typedef struct
+  {
+  probe_job_t * jobs;
+  int num_jobs;
 
-            finalize_metadata_song(m);
-            
-            gavl_dictionary_destroy(obj);
-            return 1;
-            }
-          else
-            return 0;
-          
-          }
-        else
-          return 0;
-        
-        }
-      else
-        return 0;
-      }
-    else if(starts_with(&id, "genre")) // songs/genre...
-      {
-      if(*id == '\0') // songs/genre
-        {
-        gavl_dictionary_set_string(m, GAVL_META_LABEL, "Genre");
-        gavl_dictionary_set_string(m, GAVL_META_CLASS, GAVL_META_CLASS_CONTAINER);
-        gavl_dictionary_set_string(m, GAVL_META_CHILD_CLASS, GAVL_META_CLASS_CONTAINER_GENRE);
+  int next_job;    // Next job to be taken by a worker
+  int next_result; // Next result to be taken by the writer
+  int max_ahead;
+  
+  pthread_mutex_t mutex;
+  pthread_cond_t job_cond;    // Writer took a result
+  pthread_cond_t result_cond; // Worker finished a job
+  } probe_pool_t;
 
-        gavl_track_set_num_children(ret, bg_sqlite_get_int(s->db, "SELECT COUNT(ID) FROM song_genres;"), 0);
-        
-        return 1;
-        }
-      else if(*id == '/') // songs/genre/...
-        {
-        const char * pos;
-        id++;
-        genre_id = strtoll(id, &rest, 10);
+static void * probe_thread(void * data)
+  {
+  int idx;
+  gavl_dictionary_t * mi;
+  probe_pool_t * pp = data;
+  
+  while(1)
+    {
+    pthread_mutex_lock(&pp->mutex);
 
-        if(id == rest)
-          return 0;
+    while((pp->next_job < pp->num_jobs) &&
+          (pp->next_job >= pp->next_result + pp->max_ahead))
+      pthread_cond_wait(&pp->job_cond, &pp->mutex);
+    
+    if(pp->next_job >= pp->num_jobs)
+      {
+      pthread_mutex_unlock(&pp->mutex);
+      break;
+      }
+    idx = pp->next_job++;
+    pthread_mutex_unlock(&pp->mutex);
+    
+    gavl_log(GAVL_LOG_INFO, LOG_DOMAIN, "Loading %s", pp->jobs[idx].location);
+    
+    mi = bg_plugin_registry_load_media_info(bg_plugin_reg,
+                                            pp->jobs[idx].location,
+                                            BG_INPUT_FLAG_GET_FORMAT);
+    
+    pthread_mutex_lock(&pp->mutex);
+    pp->jobs[idx].mi = mi;
+    pp->jobs[idx].done = 1;
+    pthread_cond_broadcast(&pp->result_cond);
+    pthread_mutex_unlock(&pp->mutex);
+    }
+  return NULL;
+  }
 
-        id = rest;
-        if(*id == '\0')  // songs/genre/1
-          {
-          gavl_array_t arr;
-          gavl_array_init(&arr);
-          
-          gavl_dictionary_set_string_nocopy(m, GAVL_META_LABEL,
-                                     bg_sqlite_id_to_string(s->db,
-                                                            "song_genres",
-                                                            "NAME", "ID", genre_id));
-          
-          gavl_dictionary_set_string(m, GAVL_META_CLASS, GAVL_META_CLASS_CONTAINER_GENRE);
-          gavl_dictionary_set_string(m, GAVL_META_CHILD_CLASS, GAVL_META_CLASS_CONTAINER);
-          
-          /* num children */
+static int get_probe_threads(sqlite_priv_t * p)
+  {
+  long ret;
 
-          sql = gavl_sprintf("SELECT songs."GAVL_META_SEARCH_TITLE" "
-                           "FROM song_genres_arr INNER JOIN songs "
-                           "ON song_genres_arr.OBJ_ID = songs."META_DB_ID" "
-                           "WHERE song_genres_arr.NAME_ID = %"PRId64";", genre_id);
+  if(p->probe_threads > 0)
+    return p->probe_threads;
+  
+  if((ret = sysconf(_SC_NPROCESSORS_ONLN)) < 1)
+    ret = 1;
+  return ret;
+  }
 
-          bg_sqlite_exec(s->db, sql, append_string_callback, &arr);
+static void add_nfo(bg_mdb_backend_t * b, const gavl_dictionary_t * dict,
+                    const char * location, int64_t scan_dir_id)
+  {
+  int64_t mtime;
+  gavl_dictionary_t * m;
+  gavl_dictionary_t * obj;
 
-          gavl_track_set_num_children(ret, bg_mdb_get_num_groups(&arr), 0);
-          gavl_array_free(&arr);
-          free(sql);
+  if(!gavl_dictionary_get_long(dict, GAVL_META_MTIME, &mtime))
+    return;
+  
+  gavl_log(GAVL_LOG_INFO, LOG_DOMAIN, "Adding file: %s",
+           location);
+  
+  obj = gavl_dictionary_create();
+  
+  m = gavl_dictionary_get_dictionary_create(obj, GAVL_META_METADATA);
+  gavl_dictionary_copy(m, dict);
+  gavl_dictionary_set_string(m, GAVL_META_CLASS, "nfo");
           
-          return 1;
-          }
-        else if(*id == '/') // songs/genre/1/...
-          {
-          id++;
+  add_object(b, obj, scan_dir_id, -1);
+  gavl_dictionary_destroy(obj); 
+  }
 
-          if(!(pos = strchr(id, '/')))
-            {
-            
-            gavl_dictionary_set_string(m, GAVL_META_CLASS, GAVL_META_CLASS_CONTAINER);
-            gavl_dictionary_set_string(m, GAVL_META_CHILD_CLASS, GAVL_META_CLASS_SONG);
-            
-            gavl_dictionary_set_string(m, GAVL_META_LABEL, bg_mdb_get_group_label(id));
+static void add_files(bg_mdb_backend_t * b, gavl_array_t * arr, int64_t scan_dir_id)
+  {
+  int i;
+  int pass;
+  int num_threads;
+  int num_added = 0;
+  const gavl_dictionary_t * dict;
+  const char * location;
+  const char * mimetype;
+  gavl_dictionary_t * mi;
+  gavl_dictionary_t * track;
+  probe_pool_t pp;
+  pthread_t * threads;
+  gavl_time_t start_time;
+  gavl_time_t last_log_time;
+  gavl_time_t cur_time;
+  sqlite_priv_t * p = b->priv;
+  
+  memset(&pp, 0, sizeof(pp));
+  
+  pp.jobs = calloc(arr->num_entries, sizeof(*pp.jobs));
+  
+  /* Handle .nfo files and collect the jobs. Images go first, the
+     objects referencing them are added in the second pass */
+  
+  for(pass = 0; pass < 2; pass++)
+    {
+    for(i = 0; i < arr->num_entries; i++)
+      {
+      if(!(dict = gavl_value_get_dictionary(&arr->entries[i])) ||
+         !(location = gavl_dictionary_get_string(dict, GAVL_META_URI)) ||
+         (first_pass(location) != !pass))
+        continue;
 
-            if(!gavl_dictionary_get(m, GAVL_META_NUM_CHILDREN))
-              {
-              int64_t num_children = 0;
-              char * cond;
-              
-              cond = bg_sqlite_make_group_condition(id);
-            
-              sql = gavl_sprintf("SELECT count(songs."META_DB_ID") "
-                               "FROM song_genres_arr INNER JOIN songs "
-                               "ON song_genres_arr.OBJ_ID = songs."META_DB_ID" "
-                               "WHERE song_genres_arr.NAME_ID = %"PRId64" AND songs."GAVL_META_SEARCH_TITLE" %s;",
-                               genre_id, cond);
+      if(!pass && (mimetype = bg_url_to_mimetype(location)) &&
+         !strcmp(mimetype, "text/x-nfo"))
+        {
+        add_nfo(b, dict, location, scan_dir_id);
+        continue;
+        }
+      
+      if(is_blacklisted(location)) // TODO: Make this more elegant
+        continue;
+      
+      pp.jobs[pp.num_jobs].location = location;
+      pp.num_jobs++;
+      }
+    }
 
-              bg_sqlite_exec(s->db, sql, bg_sqlite_int_callback, &num_children);
+  if(!pp.num_jobs)
+    {
+    free(pp.jobs);
+    return;
+    }
+  
+  num_threads = get_probe_threads(p);
+  if(num_threads > pp.num_jobs)
+    num_threads = pp.num_jobs;
 
-              gavl_track_set_num_children(ret, 0, num_children);
-              
-              free(cond);
-              free(sql);
-              }
-            
-            return 1;
-            }
-          else
-            {
-            int64_t song_id;
-            id = pos;
-            id++;
+  pp.max_ahead = num_threads * PROBE_RESULTS_PER_THREAD;
+  
+  pthread_mutex_init(&pp.mutex, NULL);
+  pthread_cond_init(&pp.job_cond, NULL);
+  pthread_cond_init(&pp.result_cond, NULL);
+  
+  start_time = gavl_timer_get(b->db->timer);
+  last_log_time = start_time;
+  
+  threads = calloc(num_threads, sizeof(*threads));
+  for(i = 0; i < num_threads; i++)
+    pthread_create(&threads[i], NULL, probe_thread, &pp);
+  
+  /* Write the results in the order of the jobs */
+  for(i = 0; i < pp.num_jobs; i++)
+    {
+    pthread_mutex_lock(&pp.mutex);
+    while(!pp.jobs[i].done)
+      pthread_cond_wait(&pp.result_cond, &pp.mutex);
 
-            song_id = strtoll(id, NULL, 10);
-            
-            if(!(obj = query_sqlite_object(b, song_id, TYPE_SONG)))
-              return 0;
-            
-            gavl_dictionary_merge2(m, gavl_track_get_metadata(obj));
-            gavl_dictionary_set(m, GAVL_META_LABEL, gavl_dictionary_get(m, GAVL_META_TITLE));
+    mi = pp.jobs[i].mi;
+    pp.jobs[i].mi = NULL;
+    pp.next_result++;
+    pthread_cond_broadcast(&pp.job_cond);
+    pthread_mutex_unlock(&pp.mutex);
 
-            finalize_metadata_song(m);
-            
-            gavl_dictionary_destroy(obj);
-            return 1;
-            }
-          
-          }
-        else
-          return 0;
+    if(!mi)
+      continue;
+    
+    /* Multitrack files are ignored for now */
+    if((gavl_get_num_tracks(mi) == 1) && (track = gavl_get_track_nc(mi, 0)))
+      {
+      gavl_log(GAVL_LOG_INFO, LOG_DOMAIN, "Adding file: %s", pp.jobs[i].location);
+      add_object(b, track, scan_dir_id, -1);
+      num_added++;
 
+      if(!(num_added % PROBE_TRANSACTION_SIZE))
+        {
+        bg_sqlite_end_transaction(p->db);
+        bg_sqlite_start_transaction(p->db);
         }
-      else
-        return 0;
       }
+    gavl_dictionary_destroy(mi);
 
-    else if(starts_with(&id, "year"))
+    cur_time = gavl_timer_get(b->db->timer);
+    if(cur_time - last_log_time > PROBE_LOG_INTERVAL)
       {
-      if(*id == '\0')
-        {
-        gavl_dictionary_set_string(m, GAVL_META_LABEL, "Year");
-        gavl_dictionary_set_string(m, GAVL_META_CLASS, GAVL_META_CLASS_CONTAINER);
-        gavl_dictionary_set_string(m, GAVL_META_CHILD_CLASS, GAVL_META_CLASS_CONTAINER_YEAR);
-        
-        gavl_track_set_num_children(ret, bg_sqlite_get_int(s->db,
-                                                           "SELECT count(DISTINCT substr("GAVL_META_DATE", 1, 4)) FROM songs;"), 0);
-        return 1;
-        }
-      else if(*id == '/')  // /songs/year/1960...
-        {
-        int year;
+      gavl_log(GAVL_LOG_INFO, LOG_DOMAIN, "Loaded %d/%d files (%.1f files/s)",
+               i + 1, pp.num_jobs,
+               (double)(i + 1) * GAVL_TIME_SCALE / (double)(cur_time - start_time));
+      last_log_time = cur_time;
+      }
+    }
 
-        id++;
-          
-        year = strtol(id, &rest, 10);
+  for(i = 0; i < num_threads; i++)
+    pthread_join(threads[i], NULL);
 
-        id = rest;
+  cur_time = gavl_timer_get(b->db->timer);
+  
+  gavl_log(GAVL_LOG_INFO, LOG_DOMAIN, "Loaded %d files with %d threads in %.1f s (%.1f files/s)",
+           pp.num_jobs, num_threads,
+           gavl_time_to_seconds(cur_time - start_time),
+           (cur_time > start_time) ?
+           (double)pp.num_jobs * GAVL_TIME_SCALE / (double)(cur_time - start_time) : 0.0);
+  
+  free(threads);
+  free(pp.jobs);
+  pthread_mutex_destroy(&pp.mutex);
+  pthread_cond_destroy(&pp.job_cond);
+  pthread_cond_destroy(&pp.result_cond);
+  }
 
-        if(*id == '\0')  // /songs/year/1960
-          {
-          gavl_dictionary_set_string(m, GAVL_META_CLASS, GAVL_META_CLASS_CONTAINER_YEAR);
-          gavl_dictionary_set_string(m, GAVL_META_CHILD_CLASS, GAVL_META_CLASS_SONG);
+/*
+ *  0: URI
+ *  1: Object ID
+ *  2: MTIME
+ */
 
-          if(year < 9999)
-            gavl_dictionary_set_string_nocopy(m, GAVL_META_LABEL, gavl_sprintf("%d", year));
-          else
-            gavl_dictionary_set_string(m, GAVL_META_LABEL, "Unknown");
-                        
-          /* num children */
-          sql = gavl_sprintf("SELECT count("META_DB_ID") FROM "
-                           "songs WHERE "
-                           GAVL_META_DATE" GLOB '%d*';", year);
-          
-          gavl_track_set_num_children(ret, 0, bg_sqlite_get_int(s->db, sql));
-          
-          free(sql);
-          
-          return 1;
-          }
-#if 1
-        else if(*id == '/')
-          {
-          int64_t song_id;
-          
-          id++;
-          song_id = strtoll(id, NULL, 10);
-          
-          if(!(obj = query_sqlite_object(b, song_id, TYPE_SONG)))
-            return 0;
-          
-          gavl_dictionary_merge2(m, gavl_track_get_metadata(obj));
-          gavl_dictionary_set(m, GAVL_META_LABEL, gavl_dictionary_get(m, GAVL_META_TITLE));
-          
-          finalize_metadata_song(m);
-          
-          gavl_dictionary_destroy(obj);
-          return 1;
-          }
-        else
-          return 0;
-        
-#endif
-        }
-      
-      else
-        return 0;
+typedef struct
+  {
+  int type;
+  gavl_array_t arr;
+  } get_files_t;
 
+static int get_files_db_callback(void * data, int argc, char **argv, char **azColName)
+  {
+  gavl_value_t val;
+  gavl_dictionary_t * dict;
+  get_files_t * gf = data;
 
-      }
+  gavl_value_init(&val);
+  dict = gavl_value_set_dictionary(&val);
 
-    
+  gavl_dictionary_set_string(dict, GAVL_META_URI, argv[0]);
+  gavl_dictionary_set_long(dict,   META_DB_ID, strtoll(argv[1], NULL, 10));
+
+  if(!argv[2])
+    gavl_dictionary_set_long(dict,   GAVL_META_MTIME, 0);
+  else
+    gavl_dictionary_set_long(dict,   GAVL_META_MTIME, strtoll(argv[2], NULL, 10));
+  gavl_dictionary_set_int(dict,    "TYPE", gf->type);
+  
+  gavl_array_splice_val_nocopy(&gf->arr, -1, 0, &val);
+  return 0;
+  }
 
+static int find_by_uri(gavl_array_t * files, const char * uri)
+  {
+  int i;
+  gavl_dictionary_t * dict;
+  const char * var;
+  
+  for(i = 0; i < files->num_entries; i++)
+    {
+    if((dict = gavl_value_get_dictionary_nc(&files->entries[i])) &&
+       (var = gavl_dictionary_get_string(dict, GAVL_META_URI)) &&
+       !(strcmp(var, uri)))
+      return i;
     }
-  else if(s->albums_id && starts_with(&id, s->albums_id))
+  return -1;
+  }
+
+/* If path is non-NULL, only files at or below path are returned */
+
+static void get_files_db(bg_mdb_backend_t * b, gavl_array_t * ret, int64_t id, int pass,
+                         const char * path)
+  {
+  int i;
+  get_files_t gf;
+  char * sql;
+  sqlite_priv_t * priv;
+  priv = b->priv;
+  
+  memset(&gf, 0, sizeof(gf));
+
+  i = 0;
+  while(obj_tables[i].table_name)
     {
-    if(*id != '/')
-      return 0;
-    id++;
+    if(!has_col(&obj_tables[i], META_SCAN_DIR_ID) ||
+       (!has_src_col(&obj_tables[i], GAVL_META_URI) &&
+        !has_col(&obj_tables[i], GAVL_META_URI)) ||
+       (pass != obj_tables[i].pass))
+      {
+      i++;
+      continue;
+      }
+    gf.type = obj_tables[i].type;
+    if(path)
+      sql = sqlite3_mprintf("SELECT "GAVL_META_URI", "META_DB_ID", "GAVL_META_MTIME" FROM %s WHERE "
+                            META_SCAN_DIR_ID" = %"PRId64" AND ("GAVL_META_URI" = %Q OR "
+                            "substr("GAVL_META_URI", 1, length(%Q) + 1) = %Q || '/');",
+                            obj_tables[i].table_name, id, path, path, path);
+    else
+      sql = sqlite3_mprintf("SELECT "GAVL_META_URI", "META_DB_ID", "GAVL_META_MTIME" FROM %s WHERE "
+                            META_SCAN_DIR_ID" = %"PRId64";", obj_tables[i].table_name, id);
 
-    if(starts_with(&id, "artist"))  // /albums/artist
+    //    fprintf(stderr, "Get files SQL: %s\n", sql);
+
+    if(!bg_sqlite_exec(priv->db, sql, get_files_db_callback, &gf))
       {
-      if(*id == '\0')
-        {
-        gavl_array_t arr;
-        gavl_array_init(&arr);
+      sqlite3_free(sql);
+      return;
+      }
+    sqlite3_free(sql);
+    i++;
+    }
 
-        gavl_dictionary_set_string(m, GAVL_META_LABEL, "Artist");
-        gavl_dictionary_set_string(m, GAVL_META_CLASS, GAVL_META_CLASS_CONTAINER);
-        gavl_dictionary_set_string(m, GAVL_META_CHILD_CLASS, GAVL_META_CLASS_CONTAINER);
-                    
-        bg_sqlite_exec(s->db, "SELECT NAME FROM album_artists", append_string_callback, &arr);
+  if(!path)
+    gavl_log(GAVL_LOG_INFO, LOG_DOMAIN, "Got %d files from database", gf.arr.num_entries);
 
-        gavl_track_set_num_children(ret, bg_mdb_get_num_groups(&arr), 0);
-        gavl_array_free(&arr);
-        return 1;
-        }
-      else if(*id == '/')   // /albums/artist/a
-        {
-        const char * pos;
-        id++;
+  //  fprintf(stderr, "Got %d files from database\n", gf.arr.num_entries);
 
-        if(!(pos = strchr(id, '/'))) // /albums/artist/a
-          {
-          gavl_array_t arr;
-          gavl_array_init(&arr);
-          bg_sqlite_exec(s->db, "SELECT NAME FROM album_artists", append_string_callback, &arr);
-          gavl_track_set_num_children(ret, bg_mdb_get_group_size(&arr, id), 0);
+  gavl_array_splice_array(ret, -1, 0, &gf.arr);
+  gavl_array_free(&gf.arr);
+  
+  }
 
-          gavl_dictionary_set_string(m, GAVL_META_LABEL, bg_mdb_get_group_label(id));
-          gavl_dictionary_set_string(m, GAVL_META_CLASS, GAVL_META_CLASS_CONTAINER);
-          gavl_dictionary_set_string(m, GAVL_META_CHILD_CLASS, GAVL_META_CLASS_CONTAINER_ARTIST);
-          gavl_array_free(&arr);
-          return 1;
-          }
-        else  // /albums/artist/a/152
-          {
-          int64_t artist_id;
-          char * rest = NULL;
+/* Synchronize files in the database with files on the filesystem.
+   Outdated and disappeared files are removed from the db, up-to-date
+   files are removed from files_fs */
 
-          id = pos;
-          id++;
-          
-          artist_id = strtoll(id, &rest, 10);
-          
-          if(!(pos = strchr(id, '/'))) // /albums/artist/a/152
-            {
-            gavl_dictionary_set_string(m, GAVL_META_CLASS,
-                                       GAVL_META_CLASS_CONTAINER_ARTIST);
-            gavl_dictionary_set_string(m, GAVL_META_CHILD_CLASS, GAVL_META_CLASS_MUSICALBUM);
-            
-            gavl_dictionary_set_string_nocopy(m, GAVL_META_LABEL,
-                                       bg_sqlite_id_to_string(s->db,
-                                                              "album_artists",
-                                                              "NAME", "ID", artist_id));
+static void sync_files(bg_mdb_backend_t * b, gavl_array_t * files_fs, gavl_array_t * files_db)
+  {
+  int db_idx;
+  const char * uri;
+  const gavl_dictionary_t * file_fs;
+  const gavl_dictionary_t * file_db;
+  int64_t mtime_fs;
+  int64_t mtime_db;
+  int file_idx;
 
-            /* num_children */
-            sql = gavl_sprintf("SELECT count(OBJ_ID) "
-                             "FROM album_artists_arr WHERE "
-                             "NAME_ID = %"PRId64";", artist_id);
+  /* Remove objects from data, where the file disappeared */
+  db_idx = 0;
+  
+  while(db_idx < files_db->num_entries)
+    {
+    if((file_db = gavl_value_get_dictionary(&files_db->entries[db_idx])) &&
+       (uri = gavl_dictionary_get_string(file_db,GAVL_META_URI)) &&
+       (file_idx = find_by_uri(files_fs, uri)) < 0)
+      {
+      delete_object(b, file_db, DEL_FLAG_RELATED | DEL_FLAG_PARENT | DEL_FLAG_CHILDREN );
+      gavl_array_splice_val(files_db, db_idx, 1, NULL);
+      }
+    else
+      db_idx++;
+    }
+  
+  /* Remove outdated files from database. up-to-date files are removed from the db */
+  
+  file_idx = 0;
+  
+  while(file_idx < files_fs->num_entries)
+    {
+    mtime_fs = -1;
+    mtime_db = -1;
+
+    if(!(file_fs = gavl_value_get_dictionary(&files_fs->entries[file_idx])) ||
+       !(uri = gavl_dictionary_get_string(file_fs,GAVL_META_URI)) ||
+       ((db_idx = find_by_uri(files_db, uri)) < 0) ||
+       !(file_db = gavl_value_get_dictionary(&files_db->entries[db_idx])) ||
+       !gavl_dictionary_get_long(file_fs, GAVL_META_MTIME, &mtime_fs) ||
+       !gavl_dictionary_get_long(file_db, GAVL_META_MTIME, &mtime_db))
+      {
+      //        fprintf(stderr, "Skipping %s %d %"PRId64" %"PRId64"\n", uri,
+      //                db_idx, mtime_fs, mtime_db);
+      file_idx++;
+      continue;
+      }
+    
+    /* File on filesystem is newer than db entry: Remove so we can re-add it later */
 
-            gavl_track_set_num_children(ret, (int)bg_sqlite_get_int(s->db, sql), 0);
+    if(mtime_fs > mtime_db)  // Entry out of date: Remove from db
+      {
+      gavl_log(GAVL_LOG_INFO, LOG_DOMAIN, "%s out of date, removing for re-adding later", uri);
+      
+      delete_object(b, file_db, DEL_FLAG_RELATED | DEL_FLAG_PARENT | DEL_FLAG_CHILDREN );
+      gavl_array_splice_val(files_db, db_idx, 1, NULL);
+      file_idx++;
+      }
+    else // Entry up to date: Remove from files
+      {
+      gavl_array_splice_val(files_fs, file_idx, 1, NULL);
+      }
+    }
+  }
 
-            free(sql);
-            
-            return 1;
-            }
-          else  // /albums/artist/a/152/1001
-            {
-            int64_t album_id;
-            
-            id = pos;
-            id++;
-            album_id = strtoll(id, &rest, 10);
+static void delete_directory(bg_mdb_backend_t * b, const char * dir)
+  {
+  gavl_array_t files;
+  int64_t id;
+  int i;
+  char * sql;
+  
+  sqlite_priv_t * priv = b->priv;
 
-            id = rest;
-            
-            if(*id == '\0')
-              {
-              int year;
-              int num_children = 0;
-              
-              if(!(obj = query_sqlite_object(b, album_id, TYPE_ALBUM)))
-                return 0;
-              
-              gavl_dictionary_merge2(m, gavl_track_get_metadata(obj));
+  bg_mdb_unexport_media_directory(b->ctrl.evt_sink, dir);
 
-              if((year = gavl_dictionary_get_year(m,
-                                                  GAVL_META_DATE)))
-                {
-                gavl_dictionary_set_string_nocopy(m, GAVL_META_LABEL,
-                                                  gavl_sprintf("%s (%d)",
-                                                             gavl_dictionary_get_string(m, GAVL_META_TITLE), year));
-                }
-              else
-                {
-                gavl_dictionary_set(m, GAVL_META_LABEL,
-                                    gavl_dictionary_get(m, GAVL_META_TITLE));
-                }
+  if(priv->watch)
+    bg_fs_watch_remove(priv->watch, dir);
+  
+  if((id = bg_sqlite_string_to_id(priv->db, "scandirs", "ID", "PATH", dir)) < 0)
+    {
+    gavl_log(GAVL_LOG_WARNING, LOG_DOMAIN, "No such directory %s in db", dir);
+    return;
+    }
+  gavl_array_init(&files);
+  
+  get_files_db(b, &files, id, 1, NULL);
+  get_files_db(b, &files, id, 2, NULL);
+  
+  bg_sqlite_start_transaction(priv->db);
+  
+  for(i = 0; i < files.num_entries; i++)
+    delete_object(b, gavl_value_get_dictionary(&files.entries[i]),
+                  DEL_FLAG_RELATED | DEL_FLAG_PARENT | DEL_FLAG_CHILDREN);
+  
+  sql = gavl_sprintf("DELETE FROM scandirs WHERE ID = %"PRId64";", id);
+  bg_sqlite_exec(priv->db, sql, NULL, NULL);
+  free(sql);
+  
+  bg_sqlite_end_transaction(priv->db);
 
-              if(gavl_dictionary_get_int(m, GAVL_META_NUM_CHILDREN, &num_children))
-                gavl_dictionary_set_int(m, GAVL_META_NUM_ITEM_CHILDREN, num_children);
+  gavl_array_free(&files);
+  }
 
-              gavl_dictionary_set_int(m, GAVL_META_NUM_CONTAINER_CHILDREN, 0);
+static void add_directory(bg_mdb_backend_t * b, const char * dir)
+  {
+  int64_t id;
+  sqlite_priv_t * priv;
+  gavl_array_t files_fs;
+  int is_new = 0;
+  
+  priv = b->priv;
 
-              finalize_metadata_album(m);
-              
-              gavl_dictionary_destroy(obj);
-              return 1;
-              }
-            else if(*id == '/')
-              {
-              int64_t song_id;
+  id = bg_sqlite_string_to_id(priv->db, "scandirs", "ID", "PATH", dir);
 
-              id++;
-              song_id = strtoll(id, &rest, 10);
-              
-              if(!(obj = query_sqlite_object(b, song_id, TYPE_SONG)))
-                return 0;
-              
-              gavl_dictionary_merge2(m, gavl_track_get_metadata(obj));
-              gavl_dictionary_set(m, GAVL_META_LABEL, gavl_dictionary_get(m, GAVL_META_TITLE));
+  if(id > 0)
+    gavl_log(GAVL_LOG_INFO, LOG_DOMAIN, "Re-scanning directory %s", dir);
+  else
+    {
+    gavl_log(GAVL_LOG_INFO, LOG_DOMAIN, "Adding directory %s", dir);
+    is_new = 1;
+    }
+  
+  /* Start watching before scanning so we don't miss changes */
+  if(priv->watch && priv->watch_init)
+    bg_fs_watch_add(priv->watch, dir, 1);
+  
+  gavl_array_init(&files_fs);
+  scan_directory(b, dir, &files_fs);
+  gavl_log(GAVL_LOG_INFO, LOG_DOMAIN, "Scanned directory, found %d files", files_fs.num_entries);
+  
+  bg_sqlite_start_transaction(priv->db);
 
-              finalize_metadata_song(m);
-              
-              gavl_dictionary_destroy(obj);
-              return 1;
-              }
-            else
-              return 0;
-            
-            }
-          }
-        }
-      else
-        return 0;
-      }
-    else if(starts_with(&id, "genre-artist"))
-      {
-      if(*id == '\0') // /albums/genre-artist
-        {
-        gavl_dictionary_set_string(m, GAVL_META_LABEL, "Genre-Artist");
-        gavl_dictionary_set_string(m, GAVL_META_CLASS, GAVL_META_CLASS_CONTAINER);
-        gavl_dictionary_set_string(m, GAVL_META_CHILD_CLASS, GAVL_META_CLASS_CONTAINER_GENRE);
+  /* Already present. Update */
+  if(id > 0)
+    {
+    gavl_array_t files_db;
 
-        gavl_track_set_num_children(ret, bg_sqlite_get_int(s->db, "SELECT COUNT(ID) FROM album_genres;"), 0);
-        
-        return 1;
-        }
-      else if(*id == '/')  // /albums/genre-artist/1
-        {
-        id++;
-        genre_id = strtoll(id, &rest, 10);
+    gavl_array_init(&files_db);
 
-        if(id == rest)
-          return 0;
+    get_files_db(b, &files_db, id, 1, NULL);
+    sync_files(b, &files_fs, &files_db);
+    
+    gavl_array_reset(&files_db);
+    get_files_db(b, &files_db, id, 2, NULL);
+    sync_files(b, &files_fs, &files_db);
+    
+    gavl_array_free(&files_db);
+    }
+  else // scandir not in db
+    {
+    id = bg_sqlite_string_to_id_add(priv->db, "scandirs", "ID", "PATH", dir);
+    }
+  
+  
+  /* Add new files */
+  add_files(b, &files_fs, id);
 
-        id = rest;
-        if(*id == '\0')  // /albums/genre-artist/1
-          {
-          gavl_dictionary_set_string_nocopy(m, GAVL_META_LABEL,
-                                     bg_sqlite_id_to_string(s->db,
-                                                            "album_genres",
-                                                            "NAME", "ID", genre_id));
-          
-          gavl_dictionary_set_string(m, GAVL_META_CLASS, GAVL_META_CLASS_CONTAINER_GENRE);
-          gavl_dictionary_set_string(m, GAVL_META_CHILD_CLASS, GAVL_META_CLASS_CONTAINER_ARTIST);
+  bg_sqlite_end_transaction(priv->db);
 
-          sql = gavl_sprintf("SELECT count(DISTINCT album_artists_arr.NAME_ID) "
-                           "FROM album_artists_arr INNER JOIN album_genres_arr "
-                           "ON album_artists_arr.OBJ_ID = album_genres_arr.OBJ_ID "
-                           "WHERE album_genres_arr.NAME_ID = %"PRId64";", genre_id);
+  if(is_new)
+    {
+    bg_mdb_export_media_directory(b->ctrl.evt_sink, dir);
+    gavl_log(GAVL_LOG_INFO, LOG_DOMAIN, "Done adding %s", dir);
+    }
+  else
+    gavl_log(GAVL_LOG_INFO, LOG_DOMAIN, "Done re-scanning %s", dir);
+  }
 
-          gavl_track_set_num_children(ret, (int)bg_sqlite_get_int(s->db, sql), 0);
-          free(sql);
+/* Get the scan directory containing path */
 
-          return 1;
-          }
-        else if(*id == '/') // /albums/genre-artist/1/123
-          {
-          id++;
-          artist_id = strtoll(id, &rest, 10);
+static int64_t get_scandir(gavl_array_t * scandirs, sqlite_priv_t * priv, const char * path)
+  {
+  int i, len;
+  const char * dir;
+  const char * ret = NULL;
+  int ret_len = 0;
+  
+  for(i = 0; i < scandirs->num_entries; i++)
+    {
+    if(!(dir = gavl_string_array_get(scandirs, i)))
+      continue;
+    
+    len = strlen(dir);
+    
+    if(!strncmp(path, dir, len) && (path[len] == '/') && (len > ret_len))
+      {
+      ret = dir;
+      ret_len = len;
+      }
+    }
+  
+  if(!ret)
+    return -1;
+  
+  return bg_sqlite_string_to_id(priv->db, "scandirs", "ID", "PATH", ret);
+  }
 
-          id = rest;
+/* Append files to an array, which are not already there */
 
-          if(*id == '\0')
-            {
-            gavl_dictionary_set_string(m, GAVL_META_CLASS, GAVL_META_CLASS_CONTAINER_ARTIST);
-            gavl_dictionary_set_string(m, GAVL_META_CHILD_CLASS, GAVL_META_CLASS_MUSICALBUM);
+static void merge_files(gavl_array_t * dst, gavl_array_t * src)
+  {
+  int i;
+  const char * uri;
+  const gavl_dictionary_t * dict;
+  
+  for(i = 0; i < src->num_entries; i++)
+    {
+    if((dict = gavl_value_get_dictionary(&src->entries[i])) &&
+       (uri = gavl_dictionary_get_string(dict, GAVL_META_URI)) &&
+       (find_by_uri(dst, uri) < 0))
+      gavl_array_splice_val(dst, -1, 0, &src->entries[i]);
+    }
+  }
 
-            gavl_dictionary_set_string_nocopy(m, GAVL_META_LABEL,
-                                       bg_sqlite_id_to_string(s->db,
-                                                              "album_artists",
-                                                              "NAME", "ID", artist_id));
+static void apply_fs_changes(bg_mdb_backend_t * b, gavl_dictionary_t * changes)
+  {
+  int i;
+  int flags;
+  int64_t id;
+  struct stat st;
+  char * id_str;
+  const char * path;
+  gavl_array_t scandirs;
+  gavl_array_t files_fs;
+  gavl_array_t files_db;
+  gavl_array_t * add;
+  gavl_dictionary_t add_files_dict; // scandir id -> files
+  
+  sqlite_priv_t * priv = b->priv;
+  
+  gavl_array_init(&scandirs);
+  gavl_array_init(&files_fs);
+  gavl_array_init(&files_db);
+  gavl_dictionary_init(&add_files_dict);
+  
+  bg_sqlite_get_string_array(priv->db, "scandirs", "PATH", &scandirs);
+  
+  lock_root_containers(b, 1);
+  bg_sqlite_start_transaction(priv->db);
+  
+  for(i = 0; i < changes->num_entries; i++)
+    {
+    path = changes->entries[i].name;
+    flags = 0;
+    gavl_value_get_int(&changes->entries[i].v, &flags);
+    
+    if((id = get_scandir(&scandirs, priv, path)) < 0)
+      continue;
+    
+    //    fprintf(stderr, "Filesystem change: %s %d\n", path, flags);
+    
+    if(!(flags & BG_FS_WATCH_DELETED) && !stat(path, &st))
+      {
+      if(S_ISDIR(st.st_mode))
+        scan_directory(b, path, &files_fs);
+      else
+        append_file_nocopy(&files_fs, gavl_strdup(path), st.st_mtime);
+      }
+    
+    /* Removes deleted and outdated files from the db */
+    get_files_db(b, &files_db, id, 1, path);
+    sync_files(b, &files_fs, &files_db);
+    gavl_array_reset(&files_db);
+    
+    get_files_db(b, &files_db, id, 2, path);
+    sync_files(b, &files_fs, &files_db);
+    gavl_array_reset(&files_db);
 
-            sql = gavl_sprintf("SELECT count(album_artists_arr.OBJ_ID) "
-                             "FROM album_artists_arr INNER JOIN album_genres_arr "
-                             "ON album_artists_arr.OBJ_ID = album_genres_arr.OBJ_ID "
-                             "WHERE album_genres_arr.NAME_ID = %"PRId64" AND "
-                             "album_artists_arr.NAME_ID = %"PRId64";", genre_id, artist_id);
+    /* Collect new files */
+    if(files_fs.num_entries)
+      {
+      id_str = gavl_sprintf("%"PRId64, id);
+      
+      add = gavl_dictionary_get_array_create(&add_files_dict, id_str);
+      merge_files(add, &files_fs);
+      free(id_str);
+      gavl_array_reset(&files_fs);
+      }
+    }
+  
+  for(i = 0; i < add_files_dict.num_entries; i++)
+    {
+    if((add = gavl_value_get_array_nc(&add_files_dict.entries[i].v)))
+      add_files(b, add, strtoll(add_files_dict.entries[i].name, NULL, 10));
+    }
+  
+  bg_sqlite_end_transaction(priv->db);
+  lock_root_containers(b, 0);
+  update_root_containers(b);
+  
+  gavl_array_free(&scandirs);
+  gavl_array_free(&files_fs);
+  gavl_array_free(&files_db);
+  gavl_dictionary_free(&add_files_dict);
+  }
 
-            gavl_track_set_num_children(ret, (int)bg_sqlite_get_int(s->db, sql), 0);
-            free(sql);
-            return 1;
-            }
-          else if(*id == '/')
-            {
-            // /albums/genre-artist/1/123/1000
+static int ping_sqlite(bg_mdb_backend_t * b)
+  {
+  int i;
+  int result;
+  gavl_array_t scandirs;
+  gavl_dictionary_t changes;
+  
+  sqlite_priv_t * priv = b->priv;
 
-            int64_t obj_id;
-            id++;
+  if(!priv->watch)
+    {
+    b->ping_func = NULL;
+    return 0;
+    }
+  
+  if(!priv->watch_init)
+    {
+    gavl_array_init(&scandirs);
+    bg_sqlite_get_string_array(priv->db, "scandirs", "PATH", &scandirs);
 
-            obj_id = strtoll(id, &rest, 10);
+    for(i = 0; i < scandirs.num_entries; i++)
+      bg_fs_watch_add(priv->watch, gavl_string_array_get(&scandirs, i), 1);
 
-            id = rest;
+    gavl_array_free(&scandirs);
+    priv->watch_init = 1;
+    return 1;
+    }
+  
+  gavl_dictionary_init(&changes);
+  
+  result = bg_fs_watch_get_changes(priv->watch, &changes);
 
-            if(*id == '\0')
-              {
-              int year;
-              int num_children = 0;
-              
-              if(!(obj = query_sqlite_object(b, obj_id, TYPE_ALBUM)))
-                return 0;
-            
-              gavl_dictionary_merge2(m, gavl_dictionary_get_dictionary(obj, GAVL_META_METADATA));
-              
-              if((year = gavl_dictionary_get_year(m,
-                                                  GAVL_META_DATE)))
-                {
-                gavl_dictionary_set_string_nocopy(m, GAVL_META_LABEL,
-                                                  gavl_sprintf("%s (%d)",
-                                                             gavl_dictionary_get_string(m, GAVL_META_TITLE), year));
-                }
-              else
-                {
-                gavl_dictionary_set(m, GAVL_META_LABEL,
-                                    gavl_dictionary_get(m, GAVL_META_TITLE));
-                }
+  if(!result)
+    return 0;
 
-              if(gavl_dictionary_get_int(m, GAVL_META_NUM_CHILDREN, &num_children))
-                gavl_dictionary_set_int(m, GAVL_META_NUM_ITEM_CHILDREN, num_children);
+  if(result < 0)
+    {
+    /* Events got lost: Do a full rescan */
+    gavl_log(GAVL_LOG_WARNING, LOG_DOMAIN, "Lost filesystem events, rescanning all directories");
+    
+    gavl_array_init(&scandirs);
+    bg_sqlite_get_string_array(priv->db, "scandirs", "PATH", &scandirs);
+
+    lock_root_containers(b, 1);
+    for(i = 0; i < scandirs.num_entries; i++)
+      add_directory(b, gavl_string_array_get(&scandirs, i));
+    lock_root_containers(b, 0);
+    update_root_containers(b);
+    
+    gavl_array_free(&scandirs);
+    return 1;
+    }
 
-              gavl_dictionary_set_int(m, GAVL_META_NUM_CONTAINER_CHILDREN, 0);
+  gavl_log(GAVL_LOG_INFO, LOG_DOMAIN, "Applying %d filesystem changes", changes.num_entries);
+  apply_fs_changes(b, &changes);
+  
+  gavl_dictionary_free(&changes);
+  return 1;
+  }
 
-              finalize_metadata_album(m);
-                            
-              gavl_dictionary_destroy(obj);
-              return 1;
-              }
-            else if(*id == '/') // /albums/genre-artist/1/123/1000/1001
-              {
-              id++;
-              obj_id = strtoll(id, NULL, 10);
-              
-              if(!(obj = query_sqlite_object(b, obj_id, TYPE_SONG)))
-                return 0;
-            
-              gavl_dictionary_merge2(m, gavl_dictionary_get_dictionary(obj, GAVL_META_METADATA));
-              gavl_dictionary_set(m, GAVL_META_LABEL, gavl_dictionary_get(m, GAVL_META_TITLE));
+static void destroy_sqlite(bg_mdb_backend_t * b)
+  {
+  sqlite_priv_t * priv;
+  priv = b->priv;
 
-              finalize_metadata_song(m);
-              
-              gavl_dictionary_destroy(obj);
-              return 1;
-              }
-            
-            }
-          else
-            return 0;
-          }
-        else
-          return 0;
+  if(priv->watch)
+    bg_fs_watch_destroy(priv->watch);
 
-        }
-      else
-        return 0;
-      }
-    else if(starts_with(&id, "genre-year"))
-      {
-      if(*id == '\0')
-        {
-        gavl_dictionary_set_string(m, GAVL_META_LABEL, "Genre-Year");
-        gavl_dictionary_set_string(m, GAVL_META_CLASS, GAVL_META_CLASS_CONTAINER);
-        gavl_dictionary_set_string(m, GAVL_META_CHILD_CLASS, GAVL_META_CLASS_CONTAINER_GENRE);
-        
-        gavl_track_set_num_children(ret, bg_sqlite_get_int(s->db, "SELECT COUNT(ID) FROM album_genres;"), 0);
-        return 1;
-        }
-      else if(*id == '/')
-        {
-        id++;
-        genre_id = strtoll(id, &rest, 10);
+  if(priv->stmts)
+    bg_sqlite_stmt_cache_destroy(priv->stmts);
+  
+  sqlite3_close(priv->db);
 
-        if(id == rest)
-          return 0;
-        id = rest;
-        if(*id == '\0')
-          {
-          gavl_dictionary_set_string_nocopy(m, GAVL_META_LABEL,
-                                     bg_sqlite_id_to_string(s->db,
-                                                            "album_genres",
-                                                            "NAME", "ID", genre_id));
-          
-          gavl_dictionary_set_string(m, GAVL_META_CLASS, GAVL_META_CLASS_CONTAINER_GENRE);
-          gavl_dictionary_set_string(m, GAVL_META_CHILD_CLASS, GAVL_META_CLASS_CONTAINER_YEAR);
+  gavl_dictionary_free(&priv->songs);
+  gavl_dictionary_free(&priv->movies);
+  gavl_dictionary_free(&priv->albums);
+  gavl_dictionary_free(&priv->series);
+  gavl_dictionary_free(&priv->prefetch);
+  gavl_dictionary_free(&priv->prefetch_types);
+  
+  free(priv);
+  }
 
-          sql = gavl_sprintf("SELECT count(DISTINCT substr(albums."GAVL_META_DATE", 1, 4)) FROM "
-                           "albums INNER JOIN album_genres_arr ON "
-                           "album_genres_arr.OBJ_ID = albums.DBID WHERE "
-                           "album_genres_arr.NAME_ID = %"PRId64" ;", genre_id);
+/* Browse functions */
 
-          gavl_track_set_num_children(ret, bg_sqlite_get_int(s->db, sql), 0);
-          free(sql);
+static int starts_with(const char ** id, const char * str)
+  {
+  if(gavl_string_starts_with(*id, str))
+    {
+    (*id) += strlen(str);
+    return 1;
+    }
+  else
+    return 0;
+  }
 
-          return 1;
-          }
+static void finalize_metadata_album(gavl_dictionary_t * m)
+  {
+  int i;
+  int num1, num2;
+  int year;
+  
+  const char * str;
+  const char * id;
+  
+  if((num1 = gavl_dictionary_get_num_items(m, GAVL_META_ARTIST)) &&
+     (num2 = gavl_dictionary_get_num_items(m, GAVL_META_ARTIST GAVL_META_ID)) &&
+     (num1 == num2))
+    {
+    for(i = 0; i < num1; i++)
+      {
+      str = gavl_dictionary_get_string_array(m, GAVL_META_ARTIST, i);
+      id = gavl_dictionary_get_string_array(m, GAVL_META_ARTIST GAVL_META_ID, i);
 
-        else if(*id == '/')  // /albums/genre-year/1/1960...
-          {
-          int year;
+      gavl_dictionary_append_string_array_nocopy(m, GAVL_META_ARTIST "Container", 
+                                                 gavl_sprintf("/albums/artist/%s/%s", bg_mdb_get_group_id(str), id) );
+      }
+    }
 
-          id++;
-          
-          year = strtol(id, &rest, 10);
+  if((num1 = gavl_dictionary_get_num_items(m, GAVL_META_GENRE)) &&
+     (num2 = gavl_dictionary_get_num_items(m, GAVL_META_GENRE GAVL_META_ID)) &&
+     (num1 == num2))
+    {
+    for(i = 0; i < num1; i++)
+      {
+      id = gavl_dictionary_get_string_array(m, GAVL_META_GENRE GAVL_META_ID, i);
+      gavl_dictionary_append_string_array_nocopy(m, GAVL_META_GENRE "Container", 
+                                                 gavl_sprintf("/albums/genre-artist/%s", id) );
+      }
+    }
+  
+  if((year = gavl_dictionary_get_year(m, GAVL_META_DATE)))
+    gavl_dictionary_set_string_nocopy(m, GAVL_META_YEAR "Container", gavl_sprintf("/albums/year/%d", year));
+  
+  }
 
-          id = rest;
+static void finalize_metadata_song(gavl_dictionary_t * m)
+  {
+  /* Make "links" for artist and genre */
 
-          if(*id == '\0')  // /albums/genre-year/1/1960
-            {
-            gavl_dictionary_set_string(m, GAVL_META_CLASS, GAVL_META_CLASS_CONTAINER_YEAR);
-            gavl_dictionary_set_string(m, GAVL_META_CHILD_CLASS, GAVL_META_CLASS_MUSICALBUM);
+  int i;
+  int num1, num2;
+  int year;
 
-            if(year < 9999)
-              gavl_dictionary_set_string_nocopy(m, GAVL_META_LABEL, gavl_sprintf("%d", year));
-            else
-              gavl_dictionary_set_string(m, GAVL_META_LABEL, "Unknown");
-            
-            /* num children */
-            sql = gavl_sprintf("SELECT count(albums."META_DB_ID") FROM "
-                             "albums INNER JOIN album_genres_arr ON "
-                             "album_genres_arr.OBJ_ID = albums.DBID WHERE "
-                             "album_genres_arr.NAME_ID = %"PRId64" AND albums."GAVL_META_DATE" GLOB '%d*';", genre_id, year);
+  const char * str;
+  const char * id;
+  
+  if((num1 = gavl_dictionary_get_num_items(m, GAVL_META_ARTIST)) &&
+     (num2 = gavl_dictionary_get_num_items(m, GAVL_META_ARTIST GAVL_META_ID)) &&
+     (num1 == num2))
+    {
+    for(i = 0; i < num1; i++)
+      {
+      str = gavl_dictionary_get_string_array(m, GAVL_META_ARTIST, i);
+      id = gavl_dictionary_get_string_array(m, GAVL_META_ARTIST GAVL_META_ID, i);
 
-            gavl_track_set_num_children(ret, bg_sqlite_get_int(s->db, sql), 0);
-            free(sql);
-            
-            return 1;
-            }
-          else if(*id == '/')
-            {
-#if 1
-            int64_t album_id;
-            const char * pos;
-            
-            id++;
+      gavl_dictionary_append_string_array_nocopy(m, GAVL_META_ARTIST "Container", 
+                                                 gavl_sprintf("/songs/artist/%s/%s", bg_mdb_get_group_id(str), id) );
+      }
 
-            if(!(pos = strchr(id, '/')))
-              {
-              int num_children = 0;
-              
-              album_id = strtoll(id, NULL, 10);
-            
-              if(!(obj = query_sqlite_object(b, album_id, TYPE_ALBUM)))
-                return 0;
-            
-              gavl_dictionary_merge2(m, gavl_track_get_metadata(obj));
-              gavl_dictionary_set(m, GAVL_META_LABEL, gavl_dictionary_get(m, GAVL_META_TITLE));
+    
+    }
 
-              if(gavl_dictionary_get_int(m, GAVL_META_NUM_CHILDREN, &num_children))
-                gavl_dictionary_set_int(m, GAVL_META_NUM_ITEM_CHILDREN, num_children);
+  if((num1 = gavl_dictionary_get_num_items(m, GAVL_META_GENRE)) &&
+     (num2 = gavl_dictionary_get_num_items(m, GAVL_META_GENRE GAVL_META_ID)) &&
+     (num1 == num2))
+    {
 
-              gavl_dictionary_set_int(m, GAVL_META_NUM_CONTAINER_CHILDREN, 0);
+    for(i = 0; i < num1; i++)
+      {
+      id = gavl_dictionary_get_string_array(m, GAVL_META_GENRE GAVL_META_ID, i);
+      
+      gavl_dictionary_append_string_array_nocopy(m, GAVL_META_GENRE "Container", 
+                                                 gavl_sprintf("/songs/genre-artist/%s", id) );
+      }
+    
+    }
 
-              finalize_metadata_album(m);
-                            
-              gavl_dictionary_destroy(obj);
-              return 1;
-              }
-            else
-              {
-              int64_t song_id;
-              id = pos;
-              id++;
-              song_id = strtoll(id, &rest, 10);
-              
-              if(!(obj = query_sqlite_object(b, song_id, TYPE_SONG)))
-                return 0;
-              
-              gavl_dictionary_merge2(m, gavl_track_get_metadata(obj));
-              gavl_dictionary_set(m, GAVL_META_LABEL, gavl_dictionary_get(m, GAVL_META_TITLE));
+  
+  if((year = gavl_dictionary_get_year(m, GAVL_META_DATE)))
+    gavl_dictionary_set_string_nocopy(m, GAVL_META_YEAR "Container", gavl_sprintf("/songs/year/%d", year));
 
-              finalize_metadata_song(m);
-              
-              gavl_dictionary_destroy(obj);
-              return 1;
-              }
-            
-#endif
-            }
-          else
-            return 0;
-          }
-        else
-          return 0;
+  
+  }
 
-        }
-      else
-        return 0;
-      }
+static void finalize_metadata_movie(gavl_dictionary_t * m)
+  {
 
-    else if(starts_with(&id, "year"))
+  int i;
+
+  int num1, num2;
+  int year;
+
+  const char * str;
+  const char * id;
+  
+  if((num1 = gavl_dictionary_get_num_items(m, GAVL_META_ACTOR)) &&
+     (num2 = gavl_dictionary_get_num_items(m, GAVL_META_ACTOR GAVL_META_ID)) &&
+     (num1 == num2))
+    {
+    for(i = 0; i < num1; i++)
       {
-      if(*id == '\0')
-        {
-        gavl_dictionary_set_string(m, GAVL_META_LABEL, "Year");
-        gavl_dictionary_set_string(m, GAVL_META_CLASS, GAVL_META_CLASS_CONTAINER);
-        gavl_dictionary_set_string(m, GAVL_META_CHILD_CLASS, GAVL_META_CLASS_CONTAINER_YEAR);
-        
-        gavl_track_set_num_children(ret, bg_sqlite_get_int(s->db,
-                                                           "SELECT count(DISTINCT substr("GAVL_META_DATE", 1, 4)) FROM albums;"), 0);
-        return 1;
-        }
-      else if(*id == '/')  // /albums/year/1960...
-        {
-        int year;
+      str = gavl_dictionary_get_string_array(m, GAVL_META_ACTOR, i);
+      id = gavl_dictionary_get_string_array(m, GAVL_META_ACTOR GAVL_META_ID, i);
+    
+      gavl_dictionary_append_string_array_nocopy(m, GAVL_META_ACTOR "Container", 
+                                                 gavl_sprintf("/movies/actor/%s/%s", bg_mdb_get_group_id(str), id) );
+      }
+    
+    
+    }
 
-        id++;
-          
-        year = strtol(id, &rest, 10);
+  if((num1 = gavl_dictionary_get_num_items(m, GAVL_META_DIRECTOR)) &&
+     (num2 = gavl_dictionary_get_num_items(m, GAVL_META_DIRECTOR GAVL_META_ID)) &&
+     (num1 == num2))
+    {
+    for(i = 0; i < num1; i++)
+      {
+      str = gavl_dictionary_get_string_array(m, GAVL_META_DIRECTOR, i);
+      id = gavl_dictionary_get_string_array(m, GAVL_META_DIRECTOR GAVL_META_ID, i);
+    
+      gavl_dictionary_append_string_array_nocopy(m, GAVL_META_DIRECTOR "Container", 
+                                                 gavl_sprintf("/movies/director/%s/%s", bg_mdb_get_group_id(str), id) );
+      }
 
-        id = rest;
+    
+    }
 
-        if(*id == '\0')  // /albums/year/1960
-          {
-          gavl_dictionary_set_string(m, GAVL_META_CLASS, GAVL_META_CLASS_CONTAINER_YEAR);
-          gavl_dictionary_set_string(m, GAVL_META_CHILD_CLASS, GAVL_META_CLASS_MUSICALBUM);
+  if((num1 = gavl_dictionary_get_num_items(m, GAVL_META_GENRE)) &&
+     (num2 = gavl_dictionary_get_num_items(m, GAVL_META_GENRE GAVL_META_ID)) &&
+     (num1 == num2))
+    {
+    for(i = 0; i < num1; i++)
+      {
+      id = gavl_dictionary_get_string_array(m, GAVL_META_GENRE GAVL_META_ID, i);
+      
+      gavl_dictionary_append_string_array_nocopy(m, GAVL_META_GENRE "Container", 
+                                                 gavl_sprintf("/movies/genre/%s", id) );
+      }
+    
+    }
 
-          if(year < 9999)
-            gavl_dictionary_set_string_nocopy(m, GAVL_META_LABEL, gavl_sprintf("%d", year));
-          else
-            gavl_dictionary_set_string(m, GAVL_META_LABEL, "Unknown");
-                        
-          /* num children */
-          sql = gavl_sprintf("SELECT count("META_DB_ID") FROM "
-                           "albums WHERE "
-                           GAVL_META_DATE" GLOB '%d*';", year);
-          
-          gavl_track_set_num_children(ret, bg_sqlite_get_int(s->db, sql), 0);
-          
-          free(sql);
-          
-          return 1;
-          }
+  if((num1 = gavl_dictionary_get_num_items(m, GAVL_META_COUNTRY)) &&
+     (num2 = gavl_dictionary_get_num_items(m, GAVL_META_COUNTRY GAVL_META_ID)) &&
+     (num1 == num2))
+    {
+    for(i = 0; i < num1; i++)
+      {
+      id = gavl_dictionary_get_string_array(m, GAVL_META_COUNTRY GAVL_META_ID, i);
+    
+      gavl_dictionary_append_string_array_nocopy(m, GAVL_META_COUNTRY "Container", 
+                                                 gavl_sprintf("/movies/country/%s", id) );
+      }
+    }
 
-        else if(*id == '/')
-          {
-          
-          int64_t obj_id;
-          id++;
+  if((year = gavl_dictionary_get_year(m, GAVL_META_DATE)))
+    gavl_dictionary_set_string_nocopy(m, GAVL_META_YEAR "Container", gavl_sprintf("/movies/year/%d", year));
+  }
 
-          obj_id = strtoll(id, &rest, 10);
+static int browse_object_series(bg_mdb_backend_t * b, const char * id, gavl_dictionary_t * ret)
+  {
+  char * rest;
+  int64_t series_id;
+  gavl_dictionary_t * m;
+  gavl_dictionary_t * obj;
+  sqlite_priv_t * s;
+  int num = 0;
+  s = b->priv;
+  m = gavl_track_get_metadata_nc(ret);
+  
+  id++;
+  
+  series_id = strtoll(id, &rest, 10);
+        
+  id = rest;
+  
+  if(*id == '\0')  // /series/all/20
+    {
+    if(!(obj = query_sqlite_object(b, series_id, TYPE_TV_SHOW)))
+      return 0;
 
-          id = rest;
+    gavl_dictionary_merge2(m, gavl_track_get_metadata(obj));
+    gavl_dictionary_set(m, GAVL_META_LABEL, gavl_dictionary_get(m, GAVL_META_TITLE));
 
-          if(*id == '\0') // /albums/year/1960/1000/1001
-            {
-            int num_children = 0;
-              
-            if(!(obj = query_sqlite_object(b, obj_id, TYPE_ALBUM)))
-              return 0;
-            
-            gavl_dictionary_merge2(m, gavl_dictionary_get_dictionary(obj, GAVL_META_METADATA));
-              
-            gavl_dictionary_set(m, GAVL_META_LABEL,
-                                gavl_dictionary_get(m, GAVL_META_TITLE));
-            
-            if(gavl_dictionary_get_int(m, GAVL_META_NUM_CHILDREN, &num_children))
-              gavl_dictionary_set_int(m, GAVL_META_NUM_ITEM_CHILDREN, num_children);
+    /* add "all episodes" */
+    gavl_dictionary_get_int(m, GAVL_META_NUM_CHILDREN, &num);
+    num++;
+    gavl_dictionary_set_int(m, GAVL_META_NUM_CHILDREN, num);
+    gavl_dictionary_set_int(m, GAVL_META_NUM_CONTAINER_CHILDREN, num);
+    
+    gavl_dictionary_destroy(obj);
+    return 1;
+    }
+  else if(*id == '/')  // /series/all/20/...
+    {
+    int64_t season_id;
 
-            gavl_dictionary_set_int(m, GAVL_META_NUM_CONTAINER_CHILDREN, 0);
+    id++;
 
-            finalize_metadata_album(m);
-                            
-            gavl_dictionary_destroy(obj);
-            return 1;
-            }
-          else if(*id == '/') // /albums/year/1960/1000/1001
-            {
-            id++;
-            obj_id = strtoll(id, NULL, 10);
-              
-            if(!(obj = query_sqlite_object(b, obj_id, TYPE_SONG)))
-              return 0;
-            
-            gavl_dictionary_merge2(m, gavl_dictionary_get_dictionary(obj, GAVL_META_METADATA));
-            gavl_dictionary_set(m, GAVL_META_LABEL, gavl_dictionary_get(m, GAVL_META_TITLE));
+    if(!strncmp(id, "all", 3))
+      {
+      season_id = -1;
+      id += 3;
+      }
+    else
+      {
+      season_id = strtoll(id, &rest, 10);
+      id = rest;
+      }
+    
+    if(*id == '\0')  // /series/all/20/40
+      {
+      if(season_id == -1) // /series/all/20/all
+        {
+        query_t q;
+        char * sql;
+        
+        // int64_t poster_id, wallpaper_id;
+        int64_t num_children = 0;
+        
+        gavl_dictionary_set_string(m, GAVL_META_CLASS, GAVL_META_CLASS_CONTAINER);
+        gavl_dictionary_set_string(m, GAVL_META_LABEL, "All episodes");
 
-            finalize_metadata_song(m);
-              
-            gavl_dictionary_destroy(obj);
-            return 1;
+        gavl_dictionary_set_string(m, GAVL_META_CHILD_CLASS, GAVL_META_CLASS_TV_EPISODE);
+        
+        
+        sql = gavl_sprintf("SELECT COUNT("META_DB_ID") FROM episodes WHERE "META_PARENT_ID" in (SELECT "META_DB_ID" FROM seasons "
+                         "WHERE "META_PARENT_ID" = %"PRId64");", series_id);
+
+        bg_sqlite_exec(s->db, sql, bg_sqlite_int_callback, &num_children);
+        free(sql);
+
+        gavl_track_set_num_children(ret, 0, num_children);
+        
+        /* Poster- and wallpaper ID */
+        memset(&q, 0, sizeof(q));
+        q.be = b;
+        q.table = get_obj_table(TYPE_TV_SHOW);
+        
+        sql = gavl_sprintf("SELECT "META_POSTER_ID", "META_WALLPAPER_ID" FROM shows WHERE "META_DB_ID" = %"PRId64";", series_id);
+        bg_sqlite_exec(s->db, sql, query_object_callback, &q);
+        free(sql);
+        
+        if(q.obj)
+          {
+          const gavl_dictionary_t * m1;
+
+          //          fprintf(stderr, "Object:\n");
+          //          gavl_dictionary_dump(q.obj, 2);
+          //          fprintf(stderr, "\n");
+
+          if((m1 = gavl_track_get_metadata(q.obj)))
+            {
+            gavl_dictionary_merge2(m, m1);
             }
-            
+          gavl_dictionary_destroy(q.obj);
+
+          query_images(b, m);
           }
-        else
-          return 0;
+        
         }
-      
       else
+        {
+        int season;
+        int num;
+        
+        if(!(obj = query_sqlite_object(b, season_id, TYPE_TV_SEASON)))
+          return 0;
+      
+        gavl_dictionary_merge2(m, gavl_track_get_metadata(obj));
+
+        gavl_dictionary_get_int(m, GAVL_META_SEASON, &season);
+        gavl_dictionary_get_int(m, GAVL_META_NUM_CHILDREN, &num);
+        gavl_dictionary_set_int(m, GAVL_META_NUM_ITEM_CHILDREN, num);
+        
+        gavl_dictionary_set_string_nocopy(m, GAVL_META_LABEL, gavl_sprintf("Season %d", season));
+      
+        gavl_dictionary_destroy(obj);
+        }
+      return 1;
+      }
+    else if(*id == '/')  // /series/all/20/40/
+      {
+      int64_t episode_id;
+      id++;
+      episode_id = strtoll(id, &rest, 10);
+
+      if(!(obj = query_sqlite_object(b, episode_id, TYPE_TV_EPISODE)))
         return 0;
+      
+      gavl_dictionary_merge2(m, gavl_track_get_metadata(obj));
+
+      gavl_dictionary_set(m, GAVL_META_LABEL, gavl_dictionary_get(m, GAVL_META_TITLE));
+      
+      gavl_dictionary_destroy(obj);
+      return 1;
       }
-    
     }
-  else if(s->movies_id && starts_with(&id, s->movies_id))
+  else
+    return 0;
+
+  return 0;
+  }
+
+static int browse_object_internal(bg_mdb_backend_t * b, const char * id_p, gavl_dictionary_t * ret)
+  {
+  gavl_dictionary_t * m;
+  sqlite_priv_t * s;
+  int64_t artist_id;
+  int64_t genre_id;
+  char * rest;
+  char * sql;
+  const char * id;
+  gavl_dictionary_t * obj;
+  
+  s = b->priv;
+
+  m = gavl_track_get_metadata_nc(ret);
+  
+  if(id_p)
+    {
+    id = id_p;
+    gavl_dictionary_set_string(m, GAVL_META_ID, id);
+    }
+  else
+    id = gavl_dictionary_get_string(m, GAVL_META_ID);
+
+  if(s->songs_id && starts_with(&id, s->songs_id))
     {
     if(*id != '/')
       return 0;
     id++;
 
-    if(starts_with(&id, "actor"))
+    if(starts_with(&id, "artist")) // /songs/artist
       {
       if(*id == '\0')
         {
         gavl_array_t arr;
         gavl_array_init(&arr);
-
-        gavl_dictionary_set_string(m, GAVL_META_LABEL, "Actor");
-        gavl_dictionary_set_string(m, GAVL_META_CLASS, GAVL_META_CLASS_CONTAINER);
-        gavl_dictionary_set_string(m, GAVL_META_CHILD_CLASS, GAVL_META_CLASS_CONTAINER);
         
-        /* num children */
+        gavl_dictionary_set_string(m, GAVL_META_LABEL, "Artist");
+        gavl_dictionary_set_string(m, GAVL_META_CLASS, GAVL_META_CLASS_CONTAINER);
         
-        bg_sqlite_exec(s->db, "SELECT NAME FROM movie_actors", append_string_callback, &arr);
+        bg_sqlite_exec(s->db, "SELECT NAME FROM song_artists", append_string_callback, &arr);
 
         gavl_track_set_num_children(ret, bg_mdb_get_num_groups(&arr), 0);
         gavl_array_free(&arr);
-        
         return 1;
         }
       else if(*id == '/')
         {
-        char * pos;
+        const char * pos;
+
         id++;
-        
-        if(!(pos = strchr(id, '/'))) // /movies/actor/a
+
+        if(!(pos = strchr(id, '/'))) // /songs/artist/a
           {
           gavl_array_t arr;
           gavl_array_init(&arr);
-          bg_sqlite_exec(s->db, "SELECT NAME FROM movie_actors", append_string_callback, &arr);
+          bg_sqlite_exec(s->db, "SELECT NAME FROM song_artists", append_string_callback, &arr);
 
           gavl_track_set_num_children(ret, bg_mdb_get_group_size(&arr, id), 0);
-
+          
           gavl_dictionary_set_string(m, GAVL_META_LABEL, bg_mdb_get_group_label(id));
+
           gavl_dictionary_set_string(m, GAVL_META_CLASS, GAVL_META_CLASS_CONTAINER);
-          gavl_dictionary_set_string(m, GAVL_META_CHILD_CLASS, GAVL_META_CLASS_CONTAINER_ACTOR);
+          gavl_dictionary_set_string(m, GAVL_META_CHILD_CLASS, GAVL_META_CLASS_CONTAINER_ARTIST);
           gavl_array_free(&arr);
           return 1;
           }
-        else  //  /movies/actor/a/152
+        else  // /songs/artist/a/152
           {
-          int64_t actor_id;
+          char * rest;
+          int64_t artist_id;
+          
           id = pos;
           id++;
-          
-          actor_id = strtoll(id, &rest, 10);
-          
+          artist_id = strtoll(id, &rest, 10);
+
           id = rest;
-          
-          if(*id == '\0')
+
+          if(*id == '\0')  // /songs/artist/a/123
             {
-            gavl_dictionary_set_string(m, GAVL_META_CLASS, GAVL_META_CLASS_CONTAINER_ACTOR);
-            gavl_dictionary_set_string(m, GAVL_META_CHILD_CLASS, GAVL_META_CLASS_MOVIE);
-            
             gavl_dictionary_set_string_nocopy(m, GAVL_META_LABEL,
                                               bg_sqlite_id_to_string(s->db,
-                                                                     "movie_actors",
-                                                                     "NAME", "ID", actor_id));
+                                                                     "song_artists",
+                                                                     "NAME", "ID", artist_id));
 
-            
+            gavl_dictionary_set_string(m, GAVL_META_CLASS,
+                                       GAVL_META_CLASS_CONTAINER_ARTIST);
+            gavl_dictionary_set_string(m, GAVL_META_CHILD_CLASS, GAVL_META_CLASS_SONG);
+
+            /* num_children */
             sql = gavl_sprintf("SELECT count(OBJ_ID) "
-                             "FROM movie_actors_arr WHERE "
-                             "NAME_ID = %"PRId64";", actor_id);
+                             "FROM song_artists_arr WHERE "
+                             "NAME_ID = %"PRId64";", artist_id);
 
             gavl_track_set_num_children(ret, 0, (int)bg_sqlite_get_int(s->db, sql));
+            
             free(sql);
             
             return 1;
             }
-          else if(*id == '/') //   //  /movies/actor/a/152/22009
+          else if(*id == '/')   // /songs/artist/a/123/1200
             {
-            int64_t movie_id;
+            int64_t song_id;
             id++;
-            movie_id = strtoll(id, &rest, 10);
+            song_id = strtoll(id, &rest, 10);
             
-            if(!(obj = query_sqlite_object(b, movie_id, TYPE_MOVIE)))
+            if(!(obj = query_sqlite_object(b, song_id, TYPE_SONG)))
               return 0;
             
             gavl_dictionary_merge2(m, gavl_track_get_metadata(obj));
             gavl_dictionary_set(m, GAVL_META_LABEL, gavl_dictionary_get(m, GAVL_META_TITLE));
 
-            finalize_metadata_movie(m);
-            /* Copy parts */
-            gavl_dictionary_set(ret, GAVL_META_PARTS, gavl_dictionary_get(obj, GAVL_META_PARTS));
-            
+            finalize_metadata_song(m);
             
             gavl_dictionary_destroy(obj);
             return 1;
@@ -4289,345 +4741,321 @@ static int browse_object_internal(bg_mdb_backend_t * b, const char * id_p, gavl_
       else
         return 0;
       }
-    else if(starts_with(&id, "all"))
-      {
-      if(*id == '\0')
-        {
-        gavl_dictionary_set_string(m, GAVL_META_LABEL, "All");
-        gavl_dictionary_set_string(m, GAVL_META_CLASS, GAVL_META_CLASS_CONTAINER);
-        gavl_dictionary_set_string(m, GAVL_META_CHILD_CLASS, GAVL_META_CLASS_MOVIE);
-
-        /* num_children */
-
-        gavl_track_set_num_children(ret, 0, bg_sqlite_get_int(s->db, "SELECT count("META_DB_ID") FROM movies"));
-        return 1;
-        }
-      else if(*id == '/')
-        {
-        int64_t movie_id;
-        id++;
-        movie_id = strtoll(id, &rest, 10);
-            
-        if(!(obj = query_sqlite_object(b, movie_id, TYPE_MOVIE)))
-          return 0;
-            
-        gavl_dictionary_merge2(m, gavl_track_get_metadata(obj));
-        gavl_dictionary_set(m, GAVL_META_LABEL, gavl_dictionary_get(m, GAVL_META_TITLE));
-        finalize_metadata_movie(m);
-        /* Copy parts */
-        gavl_dictionary_set(ret, GAVL_META_PARTS, gavl_dictionary_get(obj, GAVL_META_PARTS));
-
-        gavl_dictionary_destroy(obj);
-        return 1;
-        }
-      else
-        return 0;
-      }
-    else if(starts_with(&id, "country"))
+    else if(starts_with(&id, "genre-artist")) // /songs/genre-artist
       {
       if(*id == '\0')
         {
-        gavl_dictionary_set_string(m, GAVL_META_LABEL, "Country");
+        gavl_dictionary_set_string(m, GAVL_META_LABEL, "Genre-Artist");
         gavl_dictionary_set_string(m, GAVL_META_CLASS, GAVL_META_CLASS_CONTAINER);
-        gavl_dictionary_set_string(m, GAVL_META_CHILD_CLASS, GAVL_META_CLASS_CONTAINER_COUNTRY);
-
-        /* num_children */
-
-        gavl_track_set_num_children(ret, bg_sqlite_get_int(s->db, "SELECT count(ID) FROM movie_countries"), 0);
+        gavl_dictionary_set_string(m, GAVL_META_CHILD_CLASS, GAVL_META_CLASS_CONTAINER_GENRE);
+                
+        gavl_track_set_num_children(ret, bg_sqlite_get_int(s->db, "SELECT COUNT(ID) FROM song_genres;"), 0);
         return 1;
         }
-      else if(*id == '/')
+      else if(*id == '/')  // /songs/genre-artist/1
         {
-        int64_t country_id;
         id++;
+        genre_id = strtoll(id, &rest, 10);
 
-        country_id = strtoll(id, &rest, 10);
+        if(id == rest)
+          return 0;
 
         id = rest;
 
         if(*id == '\0')
           {
-          gavl_dictionary_set_string(m, GAVL_META_CLASS, GAVL_META_CLASS_CONTAINER_COUNTRY);
-          gavl_dictionary_set_string(m, GAVL_META_CHILD_CLASS, GAVL_META_CLASS_MOVIE);
-
           gavl_dictionary_set_string_nocopy(m, GAVL_META_LABEL,
                                             bg_sqlite_id_to_string(s->db,
-                                                                   "movie_countries",
-                                                                   "NAME", "ID", country_id));
+                                                                   "song_genres",
+                                                                   "NAME", "ID", genre_id));
           
-          sql = gavl_sprintf("SELECT count(OBJ_ID) "
-                           "FROM movie_countries_arr WHERE "
-                           "NAME_ID = %"PRId64";", country_id);
+          gavl_dictionary_set_string(m, GAVL_META_CLASS, GAVL_META_CLASS_CONTAINER_GENRE);
+          gavl_dictionary_set_string(m, GAVL_META_CHILD_CLASS, GAVL_META_CLASS_CONTAINER_ARTIST);
+          
+          sql = gavl_sprintf("SELECT count(DISTINCT song_artists_arr.NAME_ID) "
+                           "FROM song_artists_arr INNER JOIN song_genres_arr "
+                           "ON song_artists_arr.OBJ_ID = song_genres_arr.OBJ_ID "
+                           "WHERE song_genres_arr.NAME_ID = %"PRId64";", genre_id);
 
-          gavl_track_set_num_children(ret, 0, (int)bg_sqlite_get_int(s->db, sql));
+          gavl_track_set_num_children(ret, (int)bg_sqlite_get_int(s->db, sql), 0);
           free(sql);
           
+          
           return 1;
           }
         else if(*id == '/')
           {
-          int64_t movie_id;
           id++;
-          movie_id = strtoll(id, &rest, 10);
+          artist_id = strtoll(id, &rest, 10);
+
+          id = rest;
+
+          if(*id == '\0')
+            {
+            gavl_dictionary_set_string(m, GAVL_META_CLASS, GAVL_META_CLASS_CONTAINER_ARTIST);
+            gavl_dictionary_set_string(m, GAVL_META_CHILD_CLASS, GAVL_META_CLASS_SONG);
+          
+            gavl_dictionary_set_string_nocopy(m, GAVL_META_LABEL,
+                                              bg_sqlite_id_to_string(s->db,
+                                                                     "song_artists",
+                                                                     "NAME", "ID", artist_id));
+
+            sql = gavl_sprintf("SELECT count(song_artists_arr.OBJ_ID) "
+                             "FROM song_artists_arr INNER JOIN song_genres_arr "
+                             "ON song_artists_arr.OBJ_ID = song_genres_arr.OBJ_ID "
+                             "WHERE song_genres_arr.NAME_ID = %"PRId64" AND "
+                             "song_artists_arr.NAME_ID = %"PRId64";", genre_id, artist_id);
+
+            gavl_track_set_num_children(ret, 0, (int)bg_sqlite_get_int(s->db, sql));
+            free(sql);
             
-          if(!(obj = query_sqlite_object(b, movie_id, TYPE_MOVIE)))
-            return 0;
+            return 1;
+            }
+          else if(*id == '/')
+            {
+            int64_t obj_id;
+            id++;
+
+            obj_id = strtoll(id, &rest, 10);
+
+            if(!(obj = query_sqlite_object(b, obj_id, TYPE_SONG)))
+              return 0;
             
-          gavl_dictionary_merge2(m, gavl_track_get_metadata(obj));
-          gavl_dictionary_set(m, GAVL_META_LABEL, gavl_dictionary_get(m, GAVL_META_TITLE));
-          finalize_metadata_movie(m);
-          /* Copy parts */
-          gavl_dictionary_set(ret, GAVL_META_PARTS, gavl_dictionary_get(obj, GAVL_META_PARTS));
+            gavl_dictionary_merge2(m, gavl_track_get_metadata(obj));
+            gavl_dictionary_set(m, GAVL_META_LABEL, gavl_dictionary_get(m, GAVL_META_TITLE));
+
+            finalize_metadata_song(m);
+            
+            gavl_dictionary_destroy(obj);
+            return 1;
+            }
+          else          
+            return 0;
 
-          gavl_dictionary_destroy(obj);
-          return 1;
           }
         else
           return 0;
-
         
         }
       else
         return 0;
       }
-    else if(starts_with(&id, "language"))
+    else if(starts_with(&id, "genre-year"))
       {
       if(*id == '\0')
         {
-        gavl_dictionary_set_string(m, GAVL_META_LABEL, "Language");
+        gavl_dictionary_set_string(m, GAVL_META_LABEL, "Genre-Year");
         gavl_dictionary_set_string(m, GAVL_META_CLASS, GAVL_META_CLASS_CONTAINER);
-        gavl_dictionary_set_string(m, GAVL_META_CHILD_CLASS, GAVL_META_CLASS_CONTAINER_LANGUAGE);
-
-        /* num_children */
-
-        gavl_track_set_num_children(ret, bg_sqlite_get_int(s->db,
-                                                           "SELECT count(ID) FROM movie_audio_languages"), 0);
+        gavl_dictionary_set_string(m, GAVL_META_CHILD_CLASS, GAVL_META_CLASS_CONTAINER_GENRE);
+        
+        gavl_track_set_num_children(ret, bg_sqlite_get_int(s->db, "SELECT COUNT(ID) FROM song_genres;"), 0);
         
         return 1;
         }
       else if(*id == '/')
         {
-        int64_t language_id;
         id++;
+        genre_id = strtoll(id, &rest, 10);
 
-        language_id = strtoll(id, &rest, 10);
-
+        if(id == rest)
+          return 0;
         id = rest;
 
-        if(*id == '\0')
+        if(*id == '\0') // /songs/genre-year/1
           {
-          gavl_dictionary_set_string(m, GAVL_META_CLASS, GAVL_META_CLASS_CONTAINER_LANGUAGE);
-          gavl_dictionary_set_string(m, GAVL_META_CHILD_CLASS, GAVL_META_CLASS_MOVIE);
-
           gavl_dictionary_set_string_nocopy(m, GAVL_META_LABEL,
                                             bg_sqlite_id_to_string(s->db,
-                                                                   "movie_audio_languages",
-                                                                   "NAME", "ID", language_id));
+                                                                   "song_genres",
+                                                                   "NAME", "ID", genre_id));
           
-          sql = gavl_sprintf("SELECT count(OBJ_ID) "
-                           "FROM movie_audio_languages_arr WHERE "
-                           "NAME_ID = %"PRId64";", language_id);
+          gavl_dictionary_set_string(m, GAVL_META_CLASS, GAVL_META_CLASS_CONTAINER_GENRE);
+          gavl_dictionary_set_string(m, GAVL_META_CHILD_CLASS, GAVL_META_CLASS_CONTAINER_YEAR);
+          
+          sql = gavl_sprintf("SELECT count(DISTINCT substr(songs."GAVL_META_DATE", 1, 4)) FROM "
+                           "songs INNER JOIN song_genres_arr ON "
+                           "song_genres_arr.OBJ_ID = songs.DBID WHERE "
+                           "song_genres_arr.NAME_ID = %"PRId64" ;", genre_id);
 
-          gavl_track_set_num_children(ret, 0, (int)bg_sqlite_get_int(s->db, sql));
+          gavl_track_set_num_children(ret, bg_sqlite_get_int(s->db, sql), 0);
           free(sql);
           
           return 1;
           }
-        else if(*id == '/')
+        else if(*id == '/')  // /songs/genre-year/1/1960...
           {
-          int64_t movie_id;
+          int year;
+
           id++;
-          movie_id = strtoll(id, &rest, 10);
-            
-          if(!(obj = query_sqlite_object(b, movie_id, TYPE_MOVIE)))
-            return 0;
-            
-          gavl_dictionary_merge2(m, gavl_track_get_metadata(obj));
-          gavl_dictionary_set(m, GAVL_META_LABEL, gavl_dictionary_get(m, GAVL_META_TITLE));
-          finalize_metadata_movie(m);
-          /* Copy parts */
-          gavl_dictionary_set(ret, GAVL_META_PARTS, gavl_dictionary_get(obj, GAVL_META_PARTS));
           
-          gavl_dictionary_destroy(obj);
-          return 1;
-          }
-        else
-          return 0;
-
-        
-        }
-      else
-        return 0;
-      }
-    
-    else if(starts_with(&id, "director"))
-      {
-      if(*id == '\0')
-        {
-        gavl_array_t arr;
-        gavl_array_init(&arr);
-
-        gavl_dictionary_set_string(m, GAVL_META_LABEL, "Director");
-        gavl_dictionary_set_string(m, GAVL_META_CLASS, GAVL_META_CLASS_CONTAINER);
-        gavl_dictionary_set_string(m, GAVL_META_CHILD_CLASS, GAVL_META_CLASS_CONTAINER);
-
-        /* num children */
-        
-        bg_sqlite_exec(s->db, "SELECT NAME FROM movie_directors", append_string_callback, &arr);
+          year = strtol(id, &rest, 10);
 
-        gavl_track_set_num_children(ret, bg_mdb_get_num_groups(&arr), 0);
-        gavl_array_free(&arr);
-        
-        return 1;
-        }
-      else if(*id == '/')
-        {
-        id++;
+          id = rest;
 
-        if(*id == '\0')
-          {
-          /* Invalid ID */
-          gavl_dictionary_set_string(m, GAVL_META_CLASS, GAVL_META_CLASS_CONTAINER);
-          return 1;
-          }
-        else
-          {
-          char * pos;
-          
-          if(!(pos = strchr(id, '/'))) // /movies/director/a
+          if(*id == '\0')  // /songs/genre-year/1/1960
             {
-            gavl_array_t arr;
-            gavl_array_init(&arr);
-
-            bg_sqlite_exec(s->db, "SELECT NAME FROM movie_actors", append_string_callback, &arr);
+            gavl_dictionary_set_string(m, GAVL_META_CLASS, GAVL_META_CLASS_CONTAINER_YEAR);
+            gavl_dictionary_set_string(m, GAVL_META_CHILD_CLASS, GAVL_META_CLASS_SONG);
 
-            gavl_track_set_num_children(ret, bg_mdb_get_group_size(&arr, id), 0);
-            gavl_dictionary_set_string(m, GAVL_META_LABEL, bg_mdb_get_group_label(id));
-            gavl_dictionary_set_string(m, GAVL_META_CLASS, GAVL_META_CLASS_CONTAINER);
-            gavl_dictionary_set_string(m, GAVL_META_CHILD_CLASS, GAVL_META_CLASS_CONTAINER_DIRECTOR);
+            if(year < 9999)
+              gavl_dictionary_set_string_nocopy(m, GAVL_META_LABEL, gavl_sprintf("%d", year));
+            else
+              gavl_dictionary_set_string(m, GAVL_META_LABEL, "Unknown");
+                        
+            /* num children */
+            sql = gavl_sprintf("SELECT count(songs."META_DB_ID") FROM "
+                             "songs INNER JOIN song_genres_arr ON "
+                             "song_genres_arr.OBJ_ID = songs.DBID WHERE "
+                             "song_genres_arr.NAME_ID = %"PRId64" AND songs."GAVL_META_DATE" GLOB '%d*';", genre_id, year);
 
-            gavl_array_free(&arr);
+            gavl_track_set_num_children(ret, 0, bg_sqlite_get_int(s->db, sql));
+            
+            free(sql);
+            
             return 1;
             }
-          else  // /movies/director/a/152
+          else if(*id == '/')
             {
-            int64_t director_id;
-            id = pos;
-            id++;
-          
-            director_id = strtoll(id, &rest, 10);
-          
-            id = rest;
-          
-            if(*id == '\0')
-              {
-              gavl_dictionary_set_string(m, GAVL_META_CLASS, GAVL_META_CLASS_CONTAINER_DIRECTOR);
-              gavl_dictionary_set_string(m, GAVL_META_CHILD_CLASS, GAVL_META_CLASS_MOVIE);
+            int64_t song_id;
 
-              gavl_dictionary_set_string_nocopy(m, GAVL_META_LABEL,
-                                                bg_sqlite_id_to_string(s->db,
-                                                                       "movie_directors",
-                                                                       "NAME", "ID", director_id));
+            id++;
+            song_id = strtoll(id, NULL, 10);
             
-
-              sql = gavl_sprintf("SELECT count(OBJ_ID) "
-                               "FROM movie_directors_arr WHERE "
-                               "NAME_ID = %"PRId64";", director_id);
-
-              gavl_track_set_num_children(ret, 0, (int)bg_sqlite_get_int(s->db, sql));
-              free(sql);
-              
-              return 1;
-              }
-            else if(*id == '/')
-              {
-              int64_t movie_id;
-              id++;
-              movie_id = strtoll(id, &rest, 10);
+            if(!(obj = query_sqlite_object(b, song_id, TYPE_SONG)))
+              return 0;
             
-              if(!(obj = query_sqlite_object(b, movie_id, TYPE_MOVIE)))
-                return 0;
+            gavl_dictionary_merge2(m, gavl_track_get_metadata(obj));
+            gavl_dictionary_set(m, GAVL_META_LABEL, gavl_dictionary_get(m, GAVL_META_TITLE));
+
+            finalize_metadata_song(m);
             
-              gavl_dictionary_merge2(m, gavl_track_get_metadata(obj));
-              gavl_dictionary_set(m, GAVL_META_LABEL, gavl_dictionary_get(m, GAVL_META_TITLE));
-              finalize_metadata_movie(m);
-              /* Copy parts */
-              gavl_dictionary_set(ret, GAVL_META_PARTS, gavl_dictionary_get(obj, GAVL_META_PARTS));
-              
-              gavl_dictionary_destroy(obj);
-              return 1;
-              }
-            else
-              return 0;
+            gavl_dictionary_destroy(obj);
+            return 1;
             }
+          else
+            return 0;
+          
           }
+        else
+          return 0;
+        
         }
+      else
+        return 0;
       }
-    else if(starts_with(&id, "genre"))
+    else if(starts_with(&id, "genre")) // songs/genre...
       {
-      if(*id == '\0')
+      if(*id == '\0') // songs/genre
         {
         gavl_dictionary_set_string(m, GAVL_META_LABEL, "Genre");
         gavl_dictionary_set_string(m, GAVL_META_CLASS, GAVL_META_CLASS_CONTAINER);
         gavl_dictionary_set_string(m, GAVL_META_CHILD_CLASS, GAVL_META_CLASS_CONTAINER_GENRE);
 
-        /* num_children */
-
-        gavl_track_set_num_children(ret, bg_sqlite_get_int(s->db, "SELECT COUNT(ID) FROM movie_genres;"), 0);
+        gavl_track_set_num_children(ret, bg_sqlite_get_int(s->db, "SELECT COUNT(ID) FROM song_genres;"), 0);
+        
         return 1;
         }
-      else if(*id == '/') // /movies/genre/1
+      else if(*id == '/') // songs/genre/...
         {
-        int64_t genre_id;
+        const char * pos;
         id++;
-        
         genre_id = strtoll(id, &rest, 10);
-        
-        id = rest;
 
-        if(*id == '\0')
+        if(id == rest)
+          return 0;
+
+        id = rest;
+        if(*id == '\0')  // songs/genre/1
           {
+          gavl_array_t arr;
+          gavl_array_init(&arr);
+          
+          gavl_dictionary_set_string_nocopy(m, GAVL_META_LABEL,
+                                     bg_sqlite_id_to_string(s->db,
+                                                            "song_genres",
+                                                            "NAME", "ID", genre_id));
+          
           gavl_dictionary_set_string(m, GAVL_META_CLASS, GAVL_META_CLASS_CONTAINER_GENRE);
-          gavl_dictionary_set_string(m, GAVL_META_CHILD_CLASS, GAVL_META_CLASS_MOVIE);
+          gavl_dictionary_set_string(m, GAVL_META_CHILD_CLASS, GAVL_META_CLASS_CONTAINER);
+          
+          /* num children */
 
-          gavl_dictionary_set_string_nocopy(m, GAVL_META_LABEL,
-                                            bg_sqlite_id_to_string(s->db,
-                                                                   "movie_genres",
-                                                                   "NAME", "ID", genre_id));
+          sql = gavl_sprintf("SELECT songs."GAVL_META_SEARCH_TITLE" "
+                           "FROM song_genres_arr INNER JOIN songs "
+                           "ON song_genres_arr.OBJ_ID = songs."META_DB_ID" "
+                           "WHERE song_genres_arr.NAME_ID = %"PRId64";", genre_id);
 
-          sql = gavl_sprintf("SELECT count(OBJ_ID) "
-                           "FROM movie_genres_arr WHERE "
-                           "NAME_ID = %"PRId64";", genre_id);
+          bg_sqlite_exec(s->db, sql, append_string_callback, &arr);
 
-          gavl_track_set_num_children(ret, 0, (int)bg_sqlite_get_int(s->db, sql));
+          gavl_track_set_num_children(ret, bg_mdb_get_num_groups(&arr), 0);
+          gavl_array_free(&arr);
           free(sql);
           
           return 1;
           }
-        else if(*id == '/')
+        else if(*id == '/') // songs/genre/1/...
           {
-          int64_t movie_id;
           id++;
-          movie_id = strtoll(id, &rest, 10);
+
+          if(!(pos = strchr(id, '/')))
+            {
             
-          if(!(obj = query_sqlite_object(b, movie_id, TYPE_MOVIE)))
-            return 0;
+            gavl_dictionary_set_string(m, GAVL_META_CLASS, GAVL_META_CLASS_CONTAINER);
+            gavl_dictionary_set_string(m, GAVL_META_CHILD_CLASS, GAVL_META_CLASS_SONG);
             
-          gavl_dictionary_merge2(m, gavl_track_get_metadata(obj));
-          gavl_dictionary_set(m, GAVL_META_LABEL, gavl_dictionary_get(m, GAVL_META_TITLE));
-          finalize_metadata_movie(m);
-          /* Copy parts */
-          gavl_dictionary_set(ret, GAVL_META_PARTS, gavl_dictionary_get(obj, GAVL_META_PARTS));
+            gavl_dictionary_set_string(m, GAVL_META_LABEL, bg_mdb_get_group_label(id));
+
+            if(!gavl_dictionary_get(m, GAVL_META_NUM_CHILDREN))
+              {
+              int64_t num_children = 0;
+              char * cond;
+              
+              cond = bg_sqlite_make_group_condition(id);
+            
+              sql = gavl_sprintf("SELECT count(songs."META_DB_ID") "
+                               "FROM song_genres_arr INNER JOIN songs "
+                               "ON song_genres_arr.OBJ_ID = songs."META_DB_ID" "
+                               "WHERE song_genres_arr.NAME_ID = %"PRId64" AND songs."GAVL_META_SEARCH_TITLE" %s;",
+                               genre_id, cond);
+
+              bg_sqlite_exec(s->db, sql, bg_sqlite_int_callback, &num_children);
+
+              gavl_track_set_num_children(ret, 0, num_children);
+              
+              free(cond);
+              free(sql);
+              }
+            
+            return 1;
+            }
+          else
+            {
+            int64_t song_id;
+            id = pos;
+            id++;
+
+            song_id = strtoll(id, NULL, 10);
+            
+            if(!(obj = query_sqlite_object(b, song_id, TYPE_SONG)))
+              return 0;
+            
+            gavl_dictionary_merge2(m, gavl_track_get_metadata(obj));
+            gavl_dictionary_set(m, GAVL_META_LABEL, gavl_dictionary_get(m, GAVL_META_TITLE));
+
+            finalize_metadata_song(m);
+            
+            gavl_dictionary_destroy(obj);
+            return 1;
+            }
           
-          gavl_dictionary_destroy(obj);
-          return 1;
           }
         else
           return 0;
+
         }
       else
         return 0;
       }
+
     else if(starts_with(&id, "year"))
       {
       if(*id == '\0')
@@ -4635,1035 +5063,1338 @@ static int browse_object_internal(bg_mdb_backend_t * b, const char * id_p, gavl_
         gavl_dictionary_set_string(m, GAVL_META_LABEL, "Year");
         gavl_dictionary_set_string(m, GAVL_META_CLASS, GAVL_META_CLASS_CONTAINER);
         gavl_dictionary_set_string(m, GAVL_META_CHILD_CLASS, GAVL_META_CLASS_CONTAINER_YEAR);
-
-        /* num_children */
-
-        gavl_track_set_num_children(ret, bg_sqlite_get_int(s->db,
-                                                           "SELECT count(DISTINCT substr("GAVL_META_DATE", 1, 4)) FROM movies"), 0);
         
+        gavl_track_set_num_children(ret, bg_sqlite_get_int(s->db,
+                                                           "SELECT count(DISTINCT substr("GAVL_META_DATE", 1, 4)) FROM songs;"), 0);
         return 1;
         }
-      else if(*id == '/')
+      else if(*id == '/')  // /songs/year/1960...
         {
         int year;
+
         id++;
-        
+          
         year = strtol(id, &rest, 10);
-        
+
         id = rest;
 
-        if(*id == '\0')
+        if(*id == '\0')  // /songs/year/1960
           {
           gavl_dictionary_set_string(m, GAVL_META_CLASS, GAVL_META_CLASS_CONTAINER_YEAR);
-          gavl_dictionary_set_string(m, GAVL_META_CHILD_CLASS, GAVL_META_CLASS_MOVIE);
-
-          gavl_dictionary_set_string_nocopy(m, GAVL_META_LABEL, gavl_sprintf("%d", year));
-
-          /* num_children */
-          sql = gavl_sprintf("SELECT count("META_DB_ID") FROM movies where substr("GAVL_META_DATE", 1, 4) = '%d';", year);
+          gavl_dictionary_set_string(m, GAVL_META_CHILD_CLASS, GAVL_META_CLASS_SONG);
 
+          if(year < 9999)
+            gavl_dictionary_set_string_nocopy(m, GAVL_META_LABEL, gavl_sprintf("%d", year));
+          else
+            gavl_dictionary_set_string(m, GAVL_META_LABEL, "Unknown");
+                        
+          /* num children */
+          sql = gavl_sprintf("SELECT count("META_DB_ID") FROM "
+                           "songs WHERE "
+                           GAVL_META_DATE" GLOB '%d*';", year);
+          
           gavl_track_set_num_children(ret, 0, bg_sqlite_get_int(s->db, sql));
+          
           free(sql);
+          
           return 1;
           }
+#if 1
         else if(*id == '/')
           {
-          int64_t movie_id;
+          int64_t song_id;
+          
           id++;
-          movie_id = strtoll(id, &rest, 10);
-            
-          if(!(obj = query_sqlite_object(b, movie_id, TYPE_MOVIE)))
+          song_id = strtoll(id, NULL, 10);
+          
+          if(!(obj = query_sqlite_object(b, song_id, TYPE_SONG)))
             return 0;
-            
+          
           gavl_dictionary_merge2(m, gavl_track_get_metadata(obj));
           gavl_dictionary_set(m, GAVL_META_LABEL, gavl_dictionary_get(m, GAVL_META_TITLE));
-          finalize_metadata_movie(m);
-          /* Copy parts */
-          gavl_dictionary_set(ret, GAVL_META_PARTS, gavl_dictionary_get(obj, GAVL_META_PARTS));
+          
+          finalize_metadata_song(m);
           
           gavl_dictionary_destroy(obj);
           return 1;
           }
         else
           return 0;
+        
+#endif
         }
+      
       else
         return 0;
+
+
       }
+
+    
+
     }
-  else if(s->series_id && starts_with(&id, s->series_id))
+  else if(s->albums_id && starts_with(&id, s->albums_id))
     {
     if(*id != '/')
       return 0;
     id++;
 
-    if(starts_with(&id, "all"))
+    if(starts_with(&id, "artist"))  // /albums/artist
       {
-      if(*id == '\0') // /series/all
+      if(*id == '\0')
         {
-        gavl_dictionary_set_string(m, GAVL_META_LABEL, "All");
+        gavl_array_t arr;
+        gavl_array_init(&arr);
+
+        gavl_dictionary_set_string(m, GAVL_META_LABEL, "Artist");
         gavl_dictionary_set_string(m, GAVL_META_CLASS, GAVL_META_CLASS_CONTAINER);
-        gavl_dictionary_set_string(m, GAVL_META_CHILD_CLASS, GAVL_META_CLASS_TV_SHOW);
+        gavl_dictionary_set_string(m, GAVL_META_CHILD_CLASS, GAVL_META_CLASS_CONTAINER);
+                    
+        bg_sqlite_exec(s->db, "SELECT NAME FROM album_artists", append_string_callback, &arr);
 
-        gavl_track_set_num_children(ret, bg_sqlite_get_int(s->db, "SELECT COUNT("META_DB_ID") FROM shows;"), 0);
-        
+        gavl_track_set_num_children(ret, bg_mdb_get_num_groups(&arr), 0);
+        gavl_array_free(&arr);
         return 1;
         }
-      else if(*id == '/')  // /series/all/..
+      else if(*id == '/')   // /albums/artist/a
         {
-        return browse_object_series(b, id, ret);
+        const char * pos;
+        id++;
+
+        if(!(pos = strchr(id, '/'))) // /albums/artist/a
+          {
+          gavl_array_t arr;
+          gavl_array_init(&arr);
+          bg_sqlite_exec(s->db, "SELECT NAME FROM album_artists", append_string_callback, &arr);
+          gavl_track_set_num_children(ret, bg_mdb_get_group_size(&arr, id), 0);
+
+          gavl_dictionary_set_string(m, GAVL_META_LABEL, bg_mdb_get_group_label(id));
+          gavl_dictionary_set_string(m, GAVL_META_CLASS, GAVL_META_CLASS_CONTAINER);
+          gavl_dictionary_set_string(m, GAVL_META_CHILD_CLASS, GAVL_META_CLASS_CONTAINER_ARTIST);
+          gavl_array_free(&arr);
+          return 1;
+          }
+        else  // /albums/artist/a/152
+          {
+          int64_t artist_id;
+          char * rest = NULL;
+
+          id = pos;
+          id++;
+          
+          artist_id = strtoll(id, &rest, 10);
+          
+          if(!(pos = strchr(id, '/'))) // /albums/artist/a/152
+            {
+            gavl_dictionary_set_string(m, GAVL_META_CLASS,
+                                       GAVL_META_CLASS_CONTAINER_ARTIST);
+            gavl_dictionary_set_string(m, GAVL_META_CHILD_CLASS, GAVL_META_CLASS_MUSICALBUM);
+            
+            gavl_dictionary_set_string_nocopy(m, GAVL_META_LABEL,
+                                       bg_sqlite_id_to_string(s->db,
+                                                              "album_artists",
+                                                              "NAME", "ID", artist_id));
+
+            /* num_children */
+            sql = gavl_sprintf("SELECT count(OBJ_ID) "
+                             "FROM album_artists_arr WHERE "
+                             "NAME_ID = %"PRId64";", artist_id);
+
+            gavl_track_set_num_children(ret, (int)bg_sqlite_get_int(s->db, sql), 0);
+
+            free(sql);
+            
+            return 1;
+            }
+          else  // /albums/artist/a/152/1001
+            {
+            int64_t album_id;
+            
+            id = pos;
+            id++;
+            album_id = strtoll(id, &rest, 10);
+
+            id = rest;
+            
+            if(*id == '\0')
+              {
+              int year;
+              int num_children = 0;
+              
+              if(!(obj = query_sqlite_object(b, album_id, TYPE_ALBUM)))
+                return 0;
+              
+              gavl_dictionary_merge2(m, gavl_track_get_metadata(obj));
+
+              if((year = gavl_dictionary_get_year(m,
+                                                  GAVL_META_DATE)))
+                {
+                gavl_dictionary_set_string_nocopy(m, GAVL_META_LABEL,
+                                                  gavl_sprintf("%s (%d)",
+                                                             gavl_dictionary_get_string(m, GAVL_META_TITLE), year));
+                }
+              else
+                {
+                gavl_dictionary_set(m, GAVL_META_LABEL,
+                                    gavl_dictionary_get(m, GAVL_META_TITLE));
+                }
+
+              if(gavl_dictionary_get_int(m, GAVL_META_NUM_CHILDREN, &num_children))
+                gavl_dictionary_set_int(m, GAVL_META_NUM_ITEM_CHILDREN, num_children);
+
+              gavl_dictionary_set_int(m, GAVL_META_NUM_CONTAINER_CHILDREN, 0);
+
+              finalize_metadata_album(m);
+              
+              gavl_dictionary_destroy(obj);
+              return 1;
+              }
+            else if(*id == '/')
+              {
+              int64_t song_id;
+
+              id++;
+              song_id = strtoll(id, &rest, 10);
+              
+              if(!(obj = query_sqlite_object(b, song_id, TYPE_SONG)))
+                return 0;
+              
+              gavl_dictionary_merge2(m, gavl_track_get_metadata(obj));
+              gavl_dictionary_set(m, GAVL_META_LABEL, gavl_dictionary_get(m, GAVL_META_TITLE));
+
+              finalize_metadata_song(m);
+              
+              gavl_dictionary_destroy(obj);
+              return 1;
+              }
+            else
+              return 0;
+            
+            }
+          }
         }
       else
         return 0;
       }
-    else if(starts_with(&id, "genre"))
+    else if(starts_with(&id, "genre-artist"))
       {
-      if(*id == '\0')
+      if(*id == '\0') // /albums/genre-artist
         {
-        gavl_dictionary_set_string(m, GAVL_META_LABEL, "Genre");
+        gavl_dictionary_set_string(m, GAVL_META_LABEL, "Genre-Artist");
         gavl_dictionary_set_string(m, GAVL_META_CLASS, GAVL_META_CLASS_CONTAINER);
         gavl_dictionary_set_string(m, GAVL_META_CHILD_CLASS, GAVL_META_CLASS_CONTAINER_GENRE);
+
+        gavl_track_set_num_children(ret, bg_sqlite_get_int(s->db, "SELECT COUNT(ID) FROM album_genres;"), 0);
         
-        gavl_track_set_num_children(ret, bg_sqlite_get_int(s->db, "SELECT COUNT(ID) FROM show_genres;"), 0);
         return 1;
         }
-      else if(*id == '/')
+      else if(*id == '/')  // /albums/genre-artist/1
         {
         id++;
-
         genre_id = strtoll(id, &rest, 10);
-        
+
         if(id == rest)
           return 0;
+
         id = rest;
-        if(*id == '\0')
+        if(*id == '\0')  // /albums/genre-artist/1
           {
           gavl_dictionary_set_string_nocopy(m, GAVL_META_LABEL,
                                      bg_sqlite_id_to_string(s->db,
-                                                            "show_genres",
+                                                            "album_genres",
                                                             "NAME", "ID", genre_id));
           
           gavl_dictionary_set_string(m, GAVL_META_CLASS, GAVL_META_CLASS_CONTAINER_GENRE);
-          /* TODO: num children */
+          gavl_dictionary_set_string(m, GAVL_META_CHILD_CLASS, GAVL_META_CLASS_CONTAINER_ARTIST);
 
-          sql = gavl_sprintf("SELECT count(OBJ_ID) "
-                           "FROM show_genres_arr WHERE "
-                           "NAME_ID = %"PRId64";", genre_id);
+          sql = gavl_sprintf("SELECT count(DISTINCT album_artists_arr.NAME_ID) "
+                           "FROM album_artists_arr INNER JOIN album_genres_arr "
+                           "ON album_artists_arr.OBJ_ID = album_genres_arr.OBJ_ID "
+                           "WHERE album_genres_arr.NAME_ID = %"PRId64";", genre_id);
 
           gavl_track_set_num_children(ret, (int)bg_sqlite_get_int(s->db, sql), 0);
           free(sql);
 
           return 1;
           }
-        else if(*id == '/')
-          return browse_object_series(b, id, ret);
-        else
-          return 0;
+        else if(*id == '/') // /albums/genre-artist/1/123
+          {
+          id++;
+          artist_id = strtoll(id, &rest, 10);
 
-        }
-      else
-        return 0;
-      }
-    }
-  
-  return 0;
-  }
+          id = rest;
 
-static int browse_object(bg_mdb_backend_t * b, const char * id_p, gavl_dictionary_t * ret)
-  {
-  char * parent_id = NULL;
-  
-  if(!browse_object_internal(b, id_p, ret))
-    return 0;
+          if(*id == '\0')
+            {
+            gavl_dictionary_set_string(m, GAVL_META_CLASS, GAVL_META_CLASS_CONTAINER_ARTIST);
+            gavl_dictionary_set_string(m, GAVL_META_CHILD_CLASS, GAVL_META_CLASS_MUSICALBUM);
 
-  if(!id_p)
-    id_p = gavl_track_get_id(ret);
-  
-  /* Get next and previous */
-  if((parent_id = bg_mdb_get_parent_id(id_p)))
-    {
-    gavl_array_t arr;
-    gavl_array_init(&arr);
-    
-    if(browse_children_ids(b, parent_id, &arr))
-      {
-      int i;
-      const char * last_id = NULL;
-      const char * id = NULL;
-      const gavl_dictionary_t * dict;
+            gavl_dictionary_set_string_nocopy(m, GAVL_META_LABEL,
+                                       bg_sqlite_id_to_string(s->db,
+                                                              "album_artists",
+                                                              "NAME", "ID", artist_id));
 
-      for(i = 0; i < arr.num_entries; i++)
-        {
-        if((dict = gavl_value_get_dictionary(&arr.entries[i])) &&
-           (id = gavl_track_get_id(dict)))
-          {
-          if(!strcmp(id, id_p))
+            sql = gavl_sprintf("SELECT count(album_artists_arr.OBJ_ID) "
+                             "FROM album_artists_arr INNER JOIN album_genres_arr "
+                             "ON album_artists_arr.OBJ_ID = album_genres_arr.OBJ_ID "
+                             "WHERE album_genres_arr.NAME_ID = %"PRId64" AND "
+                             "album_artists_arr.NAME_ID = %"PRId64";", genre_id, artist_id);
+
+            gavl_track_set_num_children(ret, (int)bg_sqlite_get_int(s->db, sql), 0);
+            free(sql);
+            return 1;
+            }
+          else if(*id == '/')
             {
-            gavl_dictionary_t * m;
-            m = gavl_track_get_metadata_nc(ret);
+            // /albums/genre-artist/1/123/1000
+
+            int64_t obj_id;
+            id++;
+
+            obj_id = strtoll(id, &rest, 10);
+
+            id = rest;
+
+            if(*id == '\0')
+              {
+              int year;
+              int num_children = 0;
+              
+              if(!(obj = query_sqlite_object(b, obj_id, TYPE_ALBUM)))
+                return 0;
             
-            if(last_id)
-              gavl_dictionary_set_string(m, GAVL_META_PREVIOUS_ID, last_id);
+              gavl_dictionary_merge2(m, gavl_dictionary_get_dictionary(obj, GAVL_META_METADATA));
+              
+              if((year = gavl_dictionary_get_year(m,
+                                                  GAVL_META_DATE)))
+                {
+                gavl_dictionary_set_string_nocopy(m, GAVL_META_LABEL,
+                                                  gavl_sprintf("%s (%d)",
+                                                             gavl_dictionary_get_string(m, GAVL_META_TITLE), year));
+                }
+              else
+                {
+                gavl_dictionary_set(m, GAVL_META_LABEL,
+                                    gavl_dictionary_get(m, GAVL_META_TITLE));
+                }
 
-            if((i < arr.num_entries-1) &&
-               (dict = gavl_value_get_dictionary(&arr.entries[i+1])) &&
-               (id = gavl_track_get_id(dict)))
-              gavl_dictionary_set_string(m, GAVL_META_NEXT_ID, id);
-            break;
+              if(gavl_dictionary_get_int(m, GAVL_META_NUM_CHILDREN, &num_children))
+                gavl_dictionary_set_int(m, GAVL_META_NUM_ITEM_CHILDREN, num_children);
+
+              gavl_dictionary_set_int(m, GAVL_META_NUM_CONTAINER_CHILDREN, 0);
+
+              finalize_metadata_album(m);
+                            
+              gavl_dictionary_destroy(obj);
+              return 1;
+              }
+            else if(*id == '/') // /albums/genre-artist/1/123/1000/1001
+              {
+              id++;
+              obj_id = strtoll(id, NULL, 10);
+              
+              if(!(obj = query_sqlite_object(b, obj_id, TYPE_SONG)))
+                return 0;
+            
+              gavl_dictionary_merge2(m, gavl_dictionary_get_dictionary(obj, GAVL_META_METADATA));
+              gavl_dictionary_set(m, GAVL_META_LABEL, gavl_dictionary_get(m, GAVL_META_TITLE));
+
+              finalize_metadata_song(m);
+              
+              gavl_dictionary_destroy(obj);
+              return 1;
+              }
+            
             }
-          last_id = id;
+          else
+            return 0;
           }
+        else
+          return 0;
+
         }
+      else
+        return 0;
       }
-    
-    gavl_array_free(&arr);
-    free(parent_id);
-    }
-  //  bg_track_find_subtitles(ret);
-  bg_mdb_add_http_uris(b->db, ret);
-  return 1;
-  }
-
-typedef struct
-  {
-  gavl_array_t * arr;
-  const char * parent_id;
-  } append_id_t;
+    else if(starts_with(&id, "genre-year"))
+      {
+      if(*id == '\0')
+        {
+        gavl_dictionary_set_string(m, GAVL_META_LABEL, "Genre-Year");
+        gavl_dictionary_set_string(m, GAVL_META_CLASS, GAVL_META_CLASS_CONTAINER);
+        gavl_dictionary_set_string(m, GAVL_META_CHILD_CLASS, GAVL_META_CLASS_CONTAINER_GENRE);
+        
+        gavl_track_set_num_children(ret, bg_sqlite_get_int(s->db, "SELECT COUNT(ID) FROM album_genres;"), 0);
+        return 1;
+        }
+      else if(*id == '/')
+        {
+        id++;
+        genre_id = strtoll(id, &rest, 10);
 
-static gavl_dictionary_t * append_id(gavl_array_t * arr, char * id)
-  {
-  gavl_dictionary_t * dict;
-  gavl_dictionary_t * m;
+        if(id == rest)
+          return 0;
+        id = rest;
+        if(*id == '\0')
+          {
+          gavl_dictionary_set_string_nocopy(m, GAVL_META_LABEL,
+                                     bg_sqlite_id_to_string(s->db,
+                                                            "album_genres",
+                                                            "NAME", "ID", genre_id));
+          
+          gavl_dictionary_set_string(m, GAVL_META_CLASS, GAVL_META_CLASS_CONTAINER_GENRE);
+          gavl_dictionary_set_string(m, GAVL_META_CHILD_CLASS, GAVL_META_CLASS_CONTAINER_YEAR);
 
-  gavl_value_t val;
+          sql = gavl_sprintf("SELECT count(DISTINCT substr(albums."GAVL_META_DATE", 1, 4)) FROM "
+                           "albums INNER JOIN album_genres_arr ON "
+                           "album_genres_arr.OBJ_ID = albums.DBID WHERE "
+                           "album_genres_arr.NAME_ID = %"PRId64" ;", genre_id);
 
-  gavl_value_init(&val);
-    
-  dict = gavl_value_set_dictionary(&val);
-  m = gavl_dictionary_get_dictionary_create(dict, GAVL_META_METADATA);
-  gavl_dictionary_set_string_nocopy(m, GAVL_META_ID, id);
-  gavl_array_splice_val_nocopy(arr, -1, 0, &val);
-  return dict;
-  }
+          gavl_track_set_num_children(ret, bg_sqlite_get_int(s->db, sql), 0);
+          free(sql);
 
-static int append_id_callback(void * data, int argc, char **argv, char **azColName)
-  {
-  append_id_t * a = data;
-  append_id(a->arr, gavl_sprintf("%s/%s", a->parent_id, argv[0]));
-  return 0;
-  }
+          return 1;
+          }
 
-static int browse_children_series(bg_mdb_backend_t * b, const char * id,
-                                  append_id_t * a)
-  {
-  char * rest;
-  int64_t series_id;
-  char * sql;
-  sqlite_priv_t * s;
+        else if(*id == '/')  // /albums/genre-year/1/1960...
+          {
+          int year;
 
-  id++;
+          id++;
+          
+          year = strtol(id, &rest, 10);
 
-  series_id = strtoll(id, &rest, 10);
+          id = rest;
 
-  id = rest;
+          if(*id == '\0')  // /albums/genre-year/1/1960
+            {
+            gavl_dictionary_set_string(m, GAVL_META_CLASS, GAVL_META_CLASS_CONTAINER_YEAR);
+            gavl_dictionary_set_string(m, GAVL_META_CHILD_CLASS, GAVL_META_CLASS_MUSICALBUM);
 
-  s = b->priv;
+            if(year < 9999)
+              gavl_dictionary_set_string_nocopy(m, GAVL_META_LABEL, gavl_sprintf("%d", year));
+            else
+              gavl_dictionary_set_string(m, GAVL_META_LABEL, "Unknown");
+            
+            /* num children */
+            sql = gavl_sprintf("SELECT count(albums."META_DB_ID") FROM "
+                             "albums INNER JOIN album_genres_arr ON "
+                             "album_genres_arr.OBJ_ID = albums.DBID WHERE "
+                             "album_genres_arr.NAME_ID = %"PRId64" AND albums."GAVL_META_DATE" GLOB '%d*';", genre_id, year);
 
-  if(*id == '\0')
-    {
-    sql = gavl_sprintf("SELECT "META_DB_ID" FROM seasons WHERE "META_PARENT_ID" = %"PRId64" ORDER BY "GAVL_META_SEASON";", series_id);
-    bg_sqlite_exec(s->db, sql, append_id_callback, a);  
-    free(sql);
+            gavl_track_set_num_children(ret, bg_sqlite_get_int(s->db, sql), 0);
+            free(sql);
+            
+            return 1;
+            }
+          else if(*id == '/')
+            {
+#if 1
+            int64_t album_id;
+            const char * pos;
+            
+            id++;
 
-    append_id(a->arr, gavl_sprintf("%s/all", a->parent_id));
-    return 1;
-    }
-  else if(*id == '/')
-    {
-    id++;
+            if(!(pos = strchr(id, '/')))
+              {
+              int num_children = 0;
+              
+              album_id = strtoll(id, NULL, 10);
+            
+              if(!(obj = query_sqlite_object(b, album_id, TYPE_ALBUM)))
+                return 0;
+            
+              gavl_dictionary_merge2(m, gavl_track_get_metadata(obj));
+              gavl_dictionary_set(m, GAVL_META_LABEL, gavl_dictionary_get(m, GAVL_META_TITLE));
 
-    if(!strcmp(id, "all"))
-      {
-      sql = gavl_sprintf("SELECT "META_DB_ID" FROM episodes WHERE "META_PARENT_ID" in (SELECT "META_DB_ID" FROM seasons "
-                       "WHERE "META_PARENT_ID" = %"PRId64") ORDER BY "GAVL_META_SEARCH_TITLE" COLLATE strcoll;", series_id);
-      
-      bg_sqlite_exec(s->db, sql, append_id_callback, a);  
-      free(sql);
-      }
-    else
-      {
-      int64_t season_id = strtoll(id, &rest, 10);
-      sql = gavl_sprintf("SELECT "META_DB_ID" FROM episodes WHERE "META_PARENT_ID" = %"PRId64" ORDER BY "GAVL_META_EPISODENUMBER";", season_id);
-      bg_sqlite_exec(s->db, sql, append_id_callback, a);  
-      free(sql);
-      }
-    return 1;
-    }
-  else
-    return 0;
+              if(gavl_dictionary_get_int(m, GAVL_META_NUM_CHILDREN, &num_children))
+                gavl_dictionary_set_int(m, GAVL_META_NUM_ITEM_CHILDREN, num_children);
 
-  return 0;
-  
-  }
+              gavl_dictionary_set_int(m, GAVL_META_NUM_CONTAINER_CHILDREN, 0);
 
-static int browse_children_ids(bg_mdb_backend_t * b, const char * id,
-                               gavl_array_t * ret)
-  {
-  sqlite_priv_t * s;
-  gavl_value_t val;
-  const char * id_orig = id;
-  append_id_t a;
-  char * sql;
-  //  int result;
-  int64_t genre_id;
-  char * rest;
-  
-  s = b->priv;
-  
-  gavl_value_init(&val);
-  
-  if(s->songs_id && starts_with(&id, s->songs_id))
-    {
-    if(*id == '\0') // /songs
-      {
-      append_id(ret, gavl_sprintf("%s/artist", s->songs_id));
-      append_id(ret, gavl_sprintf("%s/genre", s->songs_id));
-      append_id(ret, gavl_sprintf("%s/genre-artist", s->songs_id));
-      append_id(ret, gavl_sprintf("%s/genre-year", s->songs_id));
-      append_id(ret, gavl_sprintf("%s/year", s->songs_id));
-      
-      return 1;
-      }
-    else
-      {
-      if(*id != '/')
-        return 0;
-      id++;
-
-      a.arr       = ret;
-      a.parent_id = id_orig;
-      
-      if(starts_with(&id, "artist"))
-        {
-        if(*id == '\0')
-          {
-          /* Groups */
-          int i, j;
-          int num;
-          gavl_array_t arr;
-          gavl_array_init(&arr);
-          
-          bg_sqlite_exec(s->db, "SELECT NAME FROM song_artists", append_string_callback, &arr);
-          
-          for(i = 0; i < bg_mdb_num_groups; i++)
-            {
-            num = 0;
-            
-            for(j = 0; j < arr.num_entries; j++)
-              {
-              if(bg_mdb_test_group_condition(bg_mdb_groups[i].id, 
-                                      gavl_value_get_string(&arr.entries[j])))
-                num++;
+              finalize_metadata_album(m);
+                            
+              gavl_dictionary_destroy(obj);
+              return 1;
               }
-
-            if(num)
+            else
               {
-              gavl_dictionary_t * dict, *m;
+              int64_t song_id;
+              id = pos;
+              id++;
+              song_id = strtoll(id, &rest, 10);
               
-              dict = append_id(ret, gavl_sprintf("%s/artist/%s", s->songs_id, bg_mdb_groups[i].id));
+              if(!(obj = query_sqlite_object(b, song_id, TYPE_SONG)))
+                return 0;
+              
+              gavl_dictionary_merge2(m, gavl_track_get_metadata(obj));
+              gavl_dictionary_set(m, GAVL_META_LABEL, gavl_dictionary_get(m, GAVL_META_TITLE));
 
-              gavl_track_set_num_children(dict, num, 0);
+              finalize_metadata_song(m);
               
-              m = gavl_track_get_metadata_nc(dict);
-              gavl_dictionary_set_string(m, GAVL_META_LABEL, bg_mdb_groups[i].label);
+              gavl_dictionary_destroy(obj);
+              return 1;
               }
             
-            // gavl_value_set_string_nocopy(&val, gavl_sprintf("%s/genre-year", s->songs_id));
-            // gavl_array_splice_val_nocopy(ret, -1, 0, &val);
+#endif
             }
-          gavl_array_free(&arr);
-          return 1;
+          else
+            return 0;
           }
-        else if(*id == '/') // /songs/artist/a
-          {
-          const char * pos;
-          id++;
-
-          if(!(pos = strchr(id, '/')))  // /songs/artist/a
-            {
-            char * cond;
-
-            if((cond = bg_sqlite_make_group_condition(id)))
-              {
-              sql = gavl_sprintf("SELECT ID FROM song_artists WHERE NAME %s ORDER BY NAME;", cond);
-              bg_sqlite_exec(s->db, sql, append_id_callback, &a);  
-              free(sql);
-              free(cond);
-              }
-            return 1;
-            }
-          else   // /songs/artist/a/123
-            {
-            int64_t artist_id;
-            
-            id = pos;
-            id++;
-            artist_id = strtoll(id, NULL, 10);
+        else
+          return 0;
 
-            sql = gavl_sprintf("SELECT songs."META_DB_ID" FROM songs INNER JOIN "
-                             "song_artists_arr "
-                             "ON songs."META_DB_ID" = song_artists_arr.OBJ_ID "
-                             "WHERE song_artists_arr.NAME_ID = %"PRId64" ORDER BY "
-                             "songs."GAVL_META_SEARCH_TITLE" COLLATE strcoll;", artist_id);
+        }
+      else
+        return 0;
+      }
 
-            bg_sqlite_exec(s->db, sql, append_id_callback, &a);  
-            free(sql);
-            return 1;
-            }
-          }
-        else
-          {
-          
-          }
+    else if(starts_with(&id, "year"))
+      {
+      if(*id == '\0')
+        {
+        gavl_dictionary_set_string(m, GAVL_META_LABEL, "Year");
+        gavl_dictionary_set_string(m, GAVL_META_CLASS, GAVL_META_CLASS_CONTAINER);
+        gavl_dictionary_set_string(m, GAVL_META_CHILD_CLASS, GAVL_META_CLASS_CONTAINER_YEAR);
         
+        gavl_track_set_num_children(ret, bg_sqlite_get_int(s->db,
+                                                           "SELECT count(DISTINCT substr("GAVL_META_DATE", 1, 4)) FROM albums;"), 0);
+        return 1;
         }
-      else if(starts_with(&id, "genre-artist"))
+      else if(*id == '/')  // /albums/year/1960...
         {
-        if(*id == '\0') // songs/genre-artist
+        int year;
+
+        id++;
+          
+        year = strtol(id, &rest, 10);
+
+        id = rest;
+
+        if(*id == '\0')  // /albums/year/1960
           {
-          bg_sqlite_exec(s->db,                                      
-                         "SELECT ID FROM song_genres ORDER BY NAME", /* SQL to be evaluated */
-                         append_id_callback, &a);
+          gavl_dictionary_set_string(m, GAVL_META_CLASS, GAVL_META_CLASS_CONTAINER_YEAR);
+          gavl_dictionary_set_string(m, GAVL_META_CHILD_CLASS, GAVL_META_CLASS_MUSICALBUM);
+
+          if(year < 9999)
+            gavl_dictionary_set_string_nocopy(m, GAVL_META_LABEL, gavl_sprintf("%d", year));
+          else
+            gavl_dictionary_set_string(m, GAVL_META_LABEL, "Unknown");
+                        
+          /* num children */
+          sql = gavl_sprintf("SELECT count("META_DB_ID") FROM "
+                           "albums WHERE "
+                           GAVL_META_DATE" GLOB '%d*';", year);
+          
+          gavl_track_set_num_children(ret, bg_sqlite_get_int(s->db, sql), 0);
+          
+          free(sql);
+          
           return 1;
           }
+
         else if(*id == '/')
           {
-          id++;
-          genre_id = strtoll(id, &rest, 10);
           
-          if(id == rest)
-            return 0;
+          int64_t obj_id;
+          id++;
+
+          obj_id = strtoll(id, &rest, 10);
+
           id = rest;
 
-          if(*id == '\0') // songs/genre-artist/1
-            {
-            sql = gavl_sprintf("SELECT ID FROM song_artists WHERE ID in (SELECT DISTINCT song_artists_arr.NAME_ID "
-                             "FROM song_artists_arr INNER JOIN song_genres_arr "
-                             "ON song_artists_arr.OBJ_ID = song_genres_arr.OBJ_ID "
-                             "WHERE song_genres_arr.NAME_ID = %"PRId64") ORDER BY NAME;", genre_id);
-            bg_sqlite_exec(s->db, sql, append_id_callback, &a);  
-            free(sql);
-            return 1;
-            }
-          else if(*id == '/')  // songs/genre-artist/1/123
+          if(*id == '\0') // /albums/year/1960/1000/1001
             {
-            int64_t artist_id;
-            id++;
-            artist_id = strtoll(id, &rest, 10);
+            int num_children = 0;
+              
+            if(!(obj = query_sqlite_object(b, obj_id, TYPE_ALBUM)))
+              return 0;
             
-            id = rest;
+            gavl_dictionary_merge2(m, gavl_dictionary_get_dictionary(obj, GAVL_META_METADATA));
+              
+            gavl_dictionary_set(m, GAVL_META_LABEL,
+                                gavl_dictionary_get(m, GAVL_META_TITLE));
             
-            if(*id == '\0')
-              {
-              sql = gavl_sprintf("SELECT song_artists_arr.OBJ_ID "
-                               "FROM "
-                               "song_artists_arr INNER JOIN song_genres_arr "
-                               "ON song_artists_arr.OBJ_ID = song_genres_arr.OBJ_ID "
-                               "INNER JOIN songs "
-                               "ON songs."META_DB_ID" = song_genres_arr.OBJ_ID "
-                               "WHERE song_genres_arr.NAME_ID = %"PRId64" AND "
-                               "song_artists_arr.NAME_ID = %"PRId64" ORDER BY songs."GAVL_META_SEARCH_TITLE" COLLATE strcoll;", genre_id, artist_id);
-              bg_sqlite_exec(s->db, sql, append_id_callback, &a);  
-              free(sql);
-              return 1;
-              }
-            else
-              return 0;
-            }
-          else
-            return 0;
+            if(gavl_dictionary_get_int(m, GAVL_META_NUM_CHILDREN, &num_children))
+              gavl_dictionary_set_int(m, GAVL_META_NUM_ITEM_CHILDREN, num_children);
 
-          }
-        else
-          return 0;
-        
-        }
-      else if(starts_with(&id, "genre-year"))
-        {
-        if(*id == '\0')
-          {
-          bg_sqlite_exec(s->db,                                      
-                         "SELECT ID FROM song_genres ORDER BY NAME", /* SQL to be evaluated */
-                         append_id_callback, &a);
-          return 1;
-          }
-        else if(*id == '/')
-          {
-          id++;
-          genre_id = strtoll(id, &rest, 10);
-        
-          if(id == rest)
-            return 0;
-          id = rest;
+            gavl_dictionary_set_int(m, GAVL_META_NUM_CONTAINER_CHILDREN, 0);
 
-          if(*id == '\0') // /songs/genre-year/1
-            {
-            sql = gavl_sprintf("SELECT DISTINCT substr(songs."GAVL_META_DATE", 1, 4) FROM "
-                             "songs INNER JOIN song_genres_arr ON "
-                             "song_genres_arr.OBJ_ID = songs.DBID WHERE "
-                             "song_genres_arr.NAME_ID = %"PRId64" ORDER BY songs."GAVL_META_DATE";", genre_id);
-            bg_sqlite_exec(s->db,                                    
-                           sql,
-                           append_id_callback, &a);
-            free(sql);
+            finalize_metadata_album(m);
+                            
+            gavl_dictionary_destroy(obj);
             return 1;
             }
-          else if(*id == '/') // /songs/genre-year/1/1960
+          else if(*id == '/') // /albums/year/1960/1000/1001
             {
-            int year;
             id++;
-
-            year = strtol(id, &rest, 10);
-        
-            if(id == rest)
+            obj_id = strtoll(id, NULL, 10);
+              
+            if(!(obj = query_sqlite_object(b, obj_id, TYPE_SONG)))
               return 0;
-            id = rest;
+            
+            gavl_dictionary_merge2(m, gavl_dictionary_get_dictionary(obj, GAVL_META_METADATA));
+            gavl_dictionary_set(m, GAVL_META_LABEL, gavl_dictionary_get(m, GAVL_META_TITLE));
 
-            if(*id == '\0')
-              {
-              sql = gavl_sprintf("SELECT songs."META_DB_ID" FROM "
-                               "songs INNER JOIN song_genres_arr ON "
-                               "song_genres_arr.OBJ_ID = songs.DBID WHERE "
-                               "song_genres_arr.NAME_ID = %"PRId64" AND songs."GAVL_META_DATE" GLOB '%d*' "
-                               "ORDER BY songs."GAVL_META_SEARCH_TITLE" COLLATE strcoll;", genre_id, year);
-              bg_sqlite_exec(s->db,                                      
-                             sql,
-                             append_id_callback, &a);
+            finalize_metadata_song(m);
               
-              free(sql);
-              return 1;
-              }
-            else 
-              return 0;
+            gavl_dictionary_destroy(obj);
+            return 1;
             }
-          else
-            return 0;
-          
+            
           }
-      
+        else
+          return 0;
         }
+      
+      else
+        return 0;
+      }
+    
+    }
+  else if(s->movies_id && starts_with(&id, s->movies_id))
+    {
+    if(*id != '/')
+      return 0;
+    id++;
 
-      /* /songs/year */
-
-      else if(starts_with(&id, "year"))
+    if(starts_with(&id, "actor"))
+      {
+      if(*id == '\0')
         {
-        if(*id == '\0')
-          {
-          bg_sqlite_exec(s->db,                                      
-                         "SELECT DISTINCT substr("GAVL_META_DATE", 1, 4) FROM "
-                         "songs ORDER BY "GAVL_META_DATE";",
-                         append_id_callback, &a);
-          return 1;
-          }
-        else if(*id == '/') // /songs/year/1960
-          {
-          int year;
-          id++;
+        gavl_array_t arr;
+        gavl_array_init(&arr);
 
-          year = strtol(id, &rest, 10);
+        gavl_dictionary_set_string(m, GAVL_META_LABEL, "Actor");
+        gavl_dictionary_set_string(m, GAVL_META_CLASS, GAVL_META_CLASS_CONTAINER);
+        gavl_dictionary_set_string(m, GAVL_META_CHILD_CLASS, GAVL_META_CLASS_CONTAINER);
         
-          if(id == rest)
-            return 0;
-          id = rest;
+        /* num children */
+        
+        bg_sqlite_exec(s->db, "SELECT NAME FROM movie_actors", append_string_callback, &arr);
 
-          if(*id == '\0')
-            {
-            sql = gavl_sprintf("select "META_DB_ID" FROM "
-                             "songs WHERE "
-                             GAVL_META_DATE" GLOB '%d*' "
-                             "ORDER BY "GAVL_META_SEARCH_TITLE" COLLATE strcoll;", year);
-            bg_sqlite_exec(s->db,                                      
-                           sql,
-                           append_id_callback, &a);
-              
-            free(sql);
-            return 1;
-            }
-          else 
-            return 0;
-          }
-        else
-          return 0;
-          
+        gavl_track_set_num_children(ret, bg_mdb_get_num_groups(&arr), 0);
+        gavl_array_free(&arr);
         
+        return 1;
         }
-
-      /* /songs/genre */
-         
-      else if(starts_with(&id, "genre"))
+      else if(*id == '/')
         {
-        if(*id == '\0')
+        char * pos;
+        id++;
+        
+        if(!(pos = strchr(id, '/'))) // /movies/actor/a
           {
-          bg_sqlite_exec(s->db,                                        
-                         "SELECT ID FROM song_genres ORDER BY NAME", /* SQL to be evaluated */
-                         append_id_callback, &a);
+          gavl_array_t arr;
+          gavl_array_init(&arr);
+          bg_sqlite_exec(s->db, "SELECT NAME FROM movie_actors", append_string_callback, &arr);
+
+          gavl_track_set_num_children(ret, bg_mdb_get_group_size(&arr, id), 0);
+
+          gavl_dictionary_set_string(m, GAVL_META_LABEL, bg_mdb_get_group_label(id));
+          gavl_dictionary_set_string(m, GAVL_META_CLASS, GAVL_META_CLASS_CONTAINER);
+          gavl_dictionary_set_string(m, GAVL_META_CHILD_CLASS, GAVL_META_CLASS_CONTAINER_ACTOR);
+          gavl_array_free(&arr);
           return 1;
           }
-        else if(*id == '/')
+        else  //  /movies/actor/a/152
           {
+          int64_t actor_id;
+          id = pos;
           id++;
-          genre_id = strtoll(id, &rest, 10);
-        
-          if(id == rest)
-            return 0;
+          
+          actor_id = strtoll(id, &rest, 10);
+          
           id = rest;
-
+          
           if(*id == '\0')
             {
-            gavl_array_t arr;
-            int i, j, num;
-            gavl_array_init(&arr);
-            
-            sql = gavl_sprintf("SELECT songs."GAVL_META_SEARCH_TITLE" "
-                             "FROM song_genres_arr INNER JOIN songs "
-                             "ON song_genres_arr.OBJ_ID = songs."META_DB_ID" "
-                             "WHERE song_genres_arr.NAME_ID = %"PRId64";", genre_id);
-            
-            bg_sqlite_exec(s->db, sql, append_string_callback, &arr);
+            gavl_dictionary_set_string(m, GAVL_META_CLASS, GAVL_META_CLASS_CONTAINER_ACTOR);
+            gavl_dictionary_set_string(m, GAVL_META_CHILD_CLASS, GAVL_META_CLASS_MOVIE);
             
-            free(sql);
+            gavl_dictionary_set_string_nocopy(m, GAVL_META_LABEL,
+                                              bg_sqlite_id_to_string(s->db,
+                                                                     "movie_actors",
+                                                                     "NAME", "ID", actor_id));
 
-            for(i = 0; i < bg_mdb_num_groups; i++)
-              {
-              num = 0;
             
-              for(j = 0; j < arr.num_entries; j++)
-                {
-                if(bg_mdb_test_group_condition(bg_mdb_groups[i].id, 
-                                        gavl_value_get_string(&arr.entries[j])))
-                  num++;
-                }
-
-              if(num)
-                {
-                gavl_dictionary_t * dict, *m;
-                
-                dict = append_id(ret, gavl_sprintf("%s/genre/%"PRId64"/%s", s->songs_id, genre_id, bg_mdb_groups[i].id));
-
-                m = gavl_track_get_metadata_nc(dict);
+            sql = gavl_sprintf("SELECT count(OBJ_ID) "
+                             "FROM movie_actors_arr WHERE "
+                             "NAME_ID = %"PRId64";", actor_id);
 
-                gavl_track_set_num_children(dict, 0, num);
-                
-                gavl_dictionary_set_string(m, GAVL_META_LABEL, bg_mdb_groups[i].label);
-                }
+            gavl_track_set_num_children(ret, 0, (int)bg_sqlite_get_int(s->db, sql));
+            free(sql);
             
-              // gavl_value_set_string_nocopy(&val, gavl_sprintf("%s/genre-year", s->songs_id));
-              // gavl_array_splice_val_nocopy(ret, -1, 0, &val);
-
-              }
-            gavl_array_free(&arr);
             return 1;
             }
-          else if(*id == '/')
+          else if(*id == '/') //   //  /movies/actor/a/152/22009
             {
-            char * pos;
+            int64_t movie_id;
             id++;
-
-            if(!(pos = strchr(id, '/')))
-              {
-              char * cond = bg_sqlite_make_group_condition(id);
-
-              if(cond)
-                {
-                sql = gavl_sprintf("SELECT songs."META_DB_ID" "
-                                 "FROM song_genres_arr INNER JOIN songs "
-                                 "ON song_genres_arr.OBJ_ID = songs."META_DB_ID" "
-                                 "WHERE song_genres_arr.NAME_ID = %"PRId64" AND "
-                                 "songs."GAVL_META_SEARCH_TITLE" %s ORDER BY songs."GAVL_META_SEARCH_TITLE" COLLATE strcoll;", genre_id, cond);
-
-                bg_sqlite_exec(s->db, sql, append_id_callback, &a);  
-                free(sql);
-                free(cond);
-                return 1;
-                }
-              }
-            else
+            movie_id = strtoll(id, &rest, 10);
+            
+            if(!(obj = query_sqlite_object(b, movie_id, TYPE_MOVIE)))
               return 0;
+            
+            gavl_dictionary_merge2(m, gavl_track_get_metadata(obj));
+            gavl_dictionary_set(m, GAVL_META_LABEL, gavl_dictionary_get(m, GAVL_META_TITLE));
+
+            finalize_metadata_movie(m);
+            /* Copy parts */
+            gavl_dictionary_set(ret, GAVL_META_PARTS, gavl_dictionary_get(obj, GAVL_META_PARTS));
+            
+            
+            gavl_dictionary_destroy(obj);
+            return 1;
             }
           else
             return 0;
           }
-        else
-          return 0;
         }
+      else
+        return 0;
       }
-    }
-  else if(s->albums_id && starts_with(&id, s->albums_id))
-    {
-    if(*id == '\0') // /albums
+    else if(starts_with(&id, "all"))
       {
-      append_id(ret, gavl_sprintf("%s/artist", s->albums_id));
-      append_id(ret, gavl_sprintf("%s/genre-artist", s->albums_id));
-      append_id(ret, gavl_sprintf("%s/genre-year", s->albums_id));
-      append_id(ret, gavl_sprintf("%s/year", s->albums_id));
-      return 1;
+      if(*id == '\0')
+        {
+        gavl_dictionary_set_string(m, GAVL_META_LABEL, "All");
+        gavl_dictionary_set_string(m, GAVL_META_CLASS, GAVL_META_CLASS_CONTAINER);
+        gavl_dictionary_set_string(m, GAVL_META_CHILD_CLASS, GAVL_META_CLASS_MOVIE);
+
+        /* num_children */
+
+        gavl_track_set_num_children(ret, 0, bg_sqlite_get_int(s->db, "SELECT count("META_DB_ID") FROM movies"));
+        return 1;
+        }
+      else if(*id == '/')
+        {
+        int64_t movie_id;
+        id++;
+        movie_id = strtoll(id, &rest, 10);
+            
+        if(!(obj = query_sqlite_object(b, movie_id, TYPE_MOVIE)))
+          return 0;
+            
+        gavl_dictionary_merge2(m, gavl_track_get_metadata(obj));
+        gavl_dictionary_set(m, GAVL_META_LABEL, gavl_dictionary_get(m, GAVL_META_TITLE));
+        finalize_metadata_movie(m);
+        /* Copy parts */
+        gavl_dictionary_set(ret, GAVL_META_PARTS, gavl_dictionary_get(obj, GAVL_META_PARTS));
+
+        gavl_dictionary_destroy(obj);
+        return 1;
+        }
+      else
+        return 0;
       }
-    else
+    else if(starts_with(&id, "country"))
       {
-      if(*id != '/')
-        return 0;
-
-      id++;
+      if(*id == '\0')
+        {
+        gavl_dictionary_set_string(m, GAVL_META_LABEL, "Country");
+        gavl_dictionary_set_string(m, GAVL_META_CLASS, GAVL_META_CLASS_CONTAINER);
+        gavl_dictionary_set_string(m, GAVL_META_CHILD_CLASS, GAVL_META_CLASS_CONTAINER_COUNTRY);
 
-      a.arr       = ret;
-      a.parent_id = id_orig;
+        /* num_children */
 
-      if(starts_with(&id, "artist"))
+        gavl_track_set_num_children(ret, bg_sqlite_get_int(s->db, "SELECT count(ID) FROM movie_countries"), 0);
+        return 1;
+        }
+      else if(*id == '/')
         {
+        int64_t country_id;
+        id++;
+
+        country_id = strtoll(id, &rest, 10);
+
+        id = rest;
+
         if(*id == '\0')
           {
-          /* Groups */
-          int i, j;
-          int num;
-          gavl_array_t arr;
-          gavl_array_init(&arr);
+          gavl_dictionary_set_string(m, GAVL_META_CLASS, GAVL_META_CLASS_CONTAINER_COUNTRY);
+          gavl_dictionary_set_string(m, GAVL_META_CHILD_CLASS, GAVL_META_CLASS_MOVIE);
+
+          gavl_dictionary_set_string_nocopy(m, GAVL_META_LABEL,
+                                            bg_sqlite_id_to_string(s->db,
+                                                                   "movie_countries",
+                                                                   "NAME", "ID", country_id));
           
-          bg_sqlite_exec(s->db, "SELECT NAME FROM album_artists", append_string_callback, &arr);
+          sql = gavl_sprintf("SELECT count(OBJ_ID) "
+                           "FROM movie_countries_arr WHERE "
+                           "NAME_ID = %"PRId64";", country_id);
+
+          gavl_track_set_num_children(ret, 0, (int)bg_sqlite_get_int(s->db, sql));
+          free(sql);
           
-          for(i = 0; i < bg_mdb_num_groups; i++)
-            {
-            num = 0;
+          return 1;
+          }
+        else if(*id == '/')
+          {
+          int64_t movie_id;
+          id++;
+          movie_id = strtoll(id, &rest, 10);
             
-            for(j = 0; j < arr.num_entries; j++)
-              {
-              if(bg_mdb_test_group_condition(bg_mdb_groups[i].id, 
-                                      gavl_value_get_string(&arr.entries[j])))
-                num++;
-              }
+          if(!(obj = query_sqlite_object(b, movie_id, TYPE_MOVIE)))
+            return 0;
+            
+          gavl_dictionary_merge2(m, gavl_track_get_metadata(obj));
+          gavl_dictionary_set(m, GAVL_META_LABEL, gavl_dictionary_get(m, GAVL_META_TITLE));
+          finalize_metadata_movie(m);
+          /* Copy parts */
+          gavl_dictionary_set(ret, GAVL_META_PARTS, gavl_dictionary_get(obj, GAVL_META_PARTS));
 
-            if(num)
-              {
-              gavl_dictionary_t * dict, *m;
-              
-              dict = append_id(ret, gavl_sprintf("%s/artist/%s", s->albums_id, bg_mdb_groups[i].id));
+          gavl_dictionary_destroy(obj);
+          return 1;
+          }
+        else
+          return 0;
 
-              gavl_track_set_num_children(dict, num, 0);
-                            
-              m = gavl_track_get_metadata_nc(dict);
+        
+        }
+      else
+        return 0;
+      }
+    else if(starts_with(&id, "language"))
+      {
+      if(*id == '\0')
+        {
+        gavl_dictionary_set_string(m, GAVL_META_LABEL, "Language");
+        gavl_dictionary_set_string(m, GAVL_META_CLASS, GAVL_META_CLASS_CONTAINER);
+        gavl_dictionary_set_string(m, GAVL_META_CHILD_CLASS, GAVL_META_CLASS_CONTAINER_LANGUAGE);
 
-              gavl_track_set_num_children(dict, num, 0);
-              gavl_dictionary_set_string(m, GAVL_META_LABEL, bg_mdb_groups[i].label);
-              }
-            }
-          gavl_array_free(&arr);
+        /* num_children */
+
+        gavl_track_set_num_children(ret, bg_sqlite_get_int(s->db,
+                                                           "SELECT count(ID) FROM movie_audio_languages"), 0);
+        
+        return 1;
+        }
+      else if(*id == '/')
+        {
+        int64_t language_id;
+        id++;
+
+        language_id = strtoll(id, &rest, 10);
+
+        id = rest;
+
+        if(*id == '\0')
+          {
+          gavl_dictionary_set_string(m, GAVL_META_CLASS, GAVL_META_CLASS_CONTAINER_LANGUAGE);
+          gavl_dictionary_set_string(m, GAVL_META_CHILD_CLASS, GAVL_META_CLASS_MOVIE);
+
+          gavl_dictionary_set_string_nocopy(m, GAVL_META_LABEL,
+                                            bg_sqlite_id_to_string(s->db,
+                                                                   "movie_audio_languages",
+                                                                   "NAME", "ID", language_id));
+          
+          sql = gavl_sprintf("SELECT count(OBJ_ID) "
+                           "FROM movie_audio_languages_arr WHERE "
+                           "NAME_ID = %"PRId64";", language_id);
+
+          gavl_track_set_num_children(ret, 0, (int)bg_sqlite_get_int(s->db, sql));
+          free(sql);
+          
           return 1;
           }
-        else
+        else if(*id == '/')
           {
-          const char * pos;
+          int64_t movie_id;
           id++;
+          movie_id = strtoll(id, &rest, 10);
+            
+          if(!(obj = query_sqlite_object(b, movie_id, TYPE_MOVIE)))
+            return 0;
+            
+          gavl_dictionary_merge2(m, gavl_track_get_metadata(obj));
+          gavl_dictionary_set(m, GAVL_META_LABEL, gavl_dictionary_get(m, GAVL_META_TITLE));
+          finalize_metadata_movie(m);
+          /* Copy parts */
+          gavl_dictionary_set(ret, GAVL_META_PARTS, gavl_dictionary_get(obj, GAVL_META_PARTS));
+          
+          gavl_dictionary_destroy(obj);
+          return 1;
+          }
+        else
+          return 0;
 
-          if(!(pos = strchr(id, '/')))  // /albums/artist/a
+        
+        }
+      else
+        return 0;
+      }
+    
+    else if(starts_with(&id, "director"))
+      {
+      if(*id == '\0')
+        {
+        gavl_array_t arr;
+        gavl_array_init(&arr);
+
+        gavl_dictionary_set_string(m, GAVL_META_LABEL, "Director");
+        gavl_dictionary_set_string(m, GAVL_META_CLASS, GAVL_META_CLASS_CONTAINER);
+        gavl_dictionary_set_string(m, GAVL_META_CHILD_CLASS, GAVL_META_CLASS_CONTAINER);
+
+        /* num children */
+        
+        bg_sqlite_exec(s->db, "SELECT NAME FROM movie_directors", append_string_callback, &arr);
+
+        gavl_track_set_num_children(ret, bg_mdb_get_num_groups(&arr), 0);
+        gavl_array_free(&arr);
+        
+        return 1;
+        }
+      else if(*id == '/')
+        {
+        id++;
+
+        if(*id == '\0')
+          {
+          /* Invalid ID */
+          gavl_dictionary_set_string(m, GAVL_META_CLASS, GAVL_META_CLASS_CONTAINER);
+          return 1;
+          }
+        else
+          {
+          char * pos;
+          
+          if(!(pos = strchr(id, '/'))) // /movies/director/a
             {
-            char * cond;
+            gavl_array_t arr;
+            gavl_array_init(&arr);
 
-            if((cond = bg_sqlite_make_group_condition(id)))
-              {
-              sql = gavl_sprintf("SELECT ID FROM album_artists WHERE NAME %s ORDER BY NAME;", cond);
-              bg_sqlite_exec(s->db, sql, append_id_callback, &a);  
-              free(sql);
-              free(cond);
-              }
+            bg_sqlite_exec(s->db, "SELECT NAME FROM movie_actors", append_string_callback, &arr);
+
+            gavl_track_set_num_children(ret, bg_mdb_get_group_size(&arr, id), 0);
+            gavl_dictionary_set_string(m, GAVL_META_LABEL, bg_mdb_get_group_label(id));
+            gavl_dictionary_set_string(m, GAVL_META_CLASS, GAVL_META_CLASS_CONTAINER);
+            gavl_dictionary_set_string(m, GAVL_META_CHILD_CLASS, GAVL_META_CLASS_CONTAINER_DIRECTOR);
+
+            gavl_array_free(&arr);
             return 1;
             }
-          else   // /albums/artist/a/123
+          else  // /movies/director/a/152
             {
-            int64_t artist_id;
-            
+            int64_t director_id;
             id = pos;
             id++;
-            artist_id = strtoll(id, &rest, 10);
-
+          
+            director_id = strtoll(id, &rest, 10);
+          
             id = rest;
-            
+          
             if(*id == '\0')
               {
-              sql = gavl_sprintf("SELECT albums."META_DB_ID" FROM albums INNER JOIN album_artists_arr "
-                               "ON albums."META_DB_ID" = album_artists_arr.OBJ_ID "
-                               "WHERE album_artists_arr.NAME_ID = %"PRId64" "
-                               "ORDER BY albums."GAVL_META_DATE", albums."GAVL_META_SEARCH_TITLE" COLLATE strcoll;", artist_id);
-              bg_sqlite_exec(s->db, sql, append_id_callback, &a);  
+              gavl_dictionary_set_string(m, GAVL_META_CLASS, GAVL_META_CLASS_CONTAINER_DIRECTOR);
+              gavl_dictionary_set_string(m, GAVL_META_CHILD_CLASS, GAVL_META_CLASS_MOVIE);
+
+              gavl_dictionary_set_string_nocopy(m, GAVL_META_LABEL,
+                                                bg_sqlite_id_to_string(s->db,
+                                                                       "movie_directors",
+                                                                       "NAME", "ID", director_id));
+            
+
+              sql = gavl_sprintf("SELECT count(OBJ_ID) "
+                               "FROM movie_directors_arr WHERE "
+                               "NAME_ID = %"PRId64";", director_id);
+
+              gavl_track_set_num_children(ret, 0, (int)bg_sqlite_get_int(s->db, sql));
               free(sql);
+              
               return 1;
               }
             else if(*id == '/')
               {
-              int64_t album_id;
-            
+              int64_t movie_id;
               id++;
-              album_id = strtoll(id, &rest, 10);
-
-              sql = gavl_sprintf("SELECT "META_DB_ID" FROM songs "
-                               "WHERE "META_PARENT_ID" = %"PRId64" "
-                               "ORDER BY "GAVL_META_TRACKNUMBER";", album_id);
-              bg_sqlite_exec(s->db, sql, append_id_callback, &a);  
-              free(sql);
-              return 1;
+              movie_id = strtoll(id, &rest, 10);
+            
+              if(!(obj = query_sqlite_object(b, movie_id, TYPE_MOVIE)))
+                return 0;
+            
+              gavl_dictionary_merge2(m, gavl_track_get_metadata(obj));
+              gavl_dictionary_set(m, GAVL_META_LABEL, gavl_dictionary_get(m, GAVL_META_TITLE));
+              finalize_metadata_movie(m);
+              /* Copy parts */
+              gavl_dictionary_set(ret, GAVL_META_PARTS, gavl_dictionary_get(obj, GAVL_META_PARTS));
               
+              gavl_dictionary_destroy(obj);
+              return 1;
               }
             else
               return 0;
             }
-          
-          
           }
-      
         }
-      else if(starts_with(&id, "genre-artist"))
+      }
+    else if(starts_with(&id, "genre"))
+      {
+      if(*id == '\0')
+        {
+        gavl_dictionary_set_string(m, GAVL_META_LABEL, "Genre");
+        gavl_dictionary_set_string(m, GAVL_META_CLASS, GAVL_META_CLASS_CONTAINER);
+        gavl_dictionary_set_string(m, GAVL_META_CHILD_CLASS, GAVL_META_CLASS_CONTAINER_GENRE);
+
+        /* num_children */
+
+        gavl_track_set_num_children(ret, bg_sqlite_get_int(s->db, "SELECT COUNT(ID) FROM movie_genres;"), 0);
+        return 1;
+        }
+      else if(*id == '/') // /movies/genre/1
         {
+        int64_t genre_id;
+        id++;
+        
+        genre_id = strtoll(id, &rest, 10);
+        
+        id = rest;
+
         if(*id == '\0')
           {
-          bg_sqlite_exec(s->db,                                        
-                         "SELECT ID FROM album_genres ORDER BY NAME", /* SQL to be evaluated */
-                         append_id_callback, &a);
+          gavl_dictionary_set_string(m, GAVL_META_CLASS, GAVL_META_CLASS_CONTAINER_GENRE);
+          gavl_dictionary_set_string(m, GAVL_META_CHILD_CLASS, GAVL_META_CLASS_MOVIE);
+
+          gavl_dictionary_set_string_nocopy(m, GAVL_META_LABEL,
+                                            bg_sqlite_id_to_string(s->db,
+                                                                   "movie_genres",
+                                                                   "NAME", "ID", genre_id));
+
+          sql = gavl_sprintf("SELECT count(OBJ_ID) "
+                           "FROM movie_genres_arr WHERE "
+                           "NAME_ID = %"PRId64";", genre_id);
+
+          gavl_track_set_num_children(ret, 0, (int)bg_sqlite_get_int(s->db, sql));
+          free(sql);
+          
           return 1;
           }
-        else if(*id == '/') // /genre/artist/1
+        else if(*id == '/')
           {
+          int64_t movie_id;
           id++;
-          genre_id = strtoll(id, &rest, 10);
-        
-          if(id == rest)
-            return 0;
-          id = rest;
-
-          if(*id == '\0')
-            {
-            sql = gavl_sprintf("SELECT ID FROM album_artists WHERE ID in (SELECT DISTINCT album_artists_arr.NAME_ID "
-                             "FROM album_artists_arr INNER JOIN album_genres_arr "
-                             "ON album_artists_arr.OBJ_ID = album_genres_arr.OBJ_ID "
-                             "WHERE album_genres_arr.NAME_ID = %"PRId64") ORDER BY NAME;", genre_id);
-            bg_sqlite_exec(s->db, sql, append_id_callback, &a);  
-            free(sql);
-            return 1;
-            }
-          else if(*id == '/')  // /genre/artist/1/7
-            {
-
-            int64_t artist_id;
-            id++;
-            artist_id = strtoll(id, &rest, 10);
-            
-            id = rest;
+          movie_id = strtoll(id, &rest, 10);
             
-            if(*id == '\0')
-              {
-              sql = gavl_sprintf("SELECT album_artists_arr.OBJ_ID "
-                               "FROM "
-                               "album_artists_arr INNER JOIN album_genres_arr "
-                               "ON album_artists_arr.OBJ_ID = album_genres_arr.OBJ_ID "
-                               "INNER JOIN albums "
-                               "ON albums."META_DB_ID" = album_genres_arr.OBJ_ID "
-                               "WHERE album_genres_arr.NAME_ID = %"PRId64" AND "
-                               "album_artists_arr.NAME_ID = %"PRId64" ORDER BY albums."GAVL_META_DATE", albums."GAVL_META_SEARCH_TITLE" COLLATE strcoll;",
-                               genre_id, artist_id);
-              bg_sqlite_exec(s->db, sql, append_id_callback, &a);  
-              free(sql);
-              return 1;
-              }
-            else if(*id == '/') // /genre/artist/1/7/110
-
-              {
-              int64_t album_id;
-              id++;
-              album_id = strtoll(id, &rest, 10);
-
-              id = rest;
-
-              if(*id == '\0')
-                {
-                sql = gavl_sprintf("SELECT "META_DB_ID" FROM songs "
-                                 "WHERE "META_PARENT_ID" = %"PRId64" "
-                                 "ORDER BY "GAVL_META_TRACKNUMBER";", album_id);
-                bg_sqlite_exec(s->db, sql, append_id_callback, &a);  
-                free(sql);
-                return 1;
-                }
-              else
-                return 0;
-              }
-            else
-              return 0;
-            }
-          else
+          if(!(obj = query_sqlite_object(b, movie_id, TYPE_MOVIE)))
             return 0;
+            
+          gavl_dictionary_merge2(m, gavl_track_get_metadata(obj));
+          gavl_dictionary_set(m, GAVL_META_LABEL, gavl_dictionary_get(m, GAVL_META_TITLE));
+          finalize_metadata_movie(m);
+          /* Copy parts */
+          gavl_dictionary_set(ret, GAVL_META_PARTS, gavl_dictionary_get(obj, GAVL_META_PARTS));
           
+          gavl_dictionary_destroy(obj);
+          return 1;
           }
         else
           return 0;
         }
-      else if(starts_with(&id, "genre-year"))
+      else
+        return 0;
+      }
+    else if(starts_with(&id, "year"))
+      {
+      if(*id == '\0')
         {
+        gavl_dictionary_set_string(m, GAVL_META_LABEL, "Year");
+        gavl_dictionary_set_string(m, GAVL_META_CLASS, GAVL_META_CLASS_CONTAINER);
+        gavl_dictionary_set_string(m, GAVL_META_CHILD_CLASS, GAVL_META_CLASS_CONTAINER_YEAR);
+
+        /* num_children */
+
+        gavl_track_set_num_children(ret, bg_sqlite_get_int(s->db,
+                                                           "SELECT count(DISTINCT substr("GAVL_META_DATE", 1, 4)) FROM movies"), 0);
+        
+        return 1;
+        }
+      else if(*id == '/')
+        {
+        int year;
+        id++;
+        
+        year = strtol(id, &rest, 10);
+        
+        id = rest;
+
         if(*id == '\0')
           {
-          bg_sqlite_exec(s->db,                                       
-                         "SELECT ID FROM album_genres ORDER BY NAME", /* SQL to be evaluated */
-                         append_id_callback, &a);
+          gavl_dictionary_set_string(m, GAVL_META_CLASS, GAVL_META_CLASS_CONTAINER_YEAR);
+          gavl_dictionary_set_string(m, GAVL_META_CHILD_CLASS, GAVL_META_CLASS_MOVIE);
+
+          gavl_dictionary_set_string_nocopy(m, GAVL_META_LABEL, gavl_sprintf("%d", year));
+
+          /* num_children */
+          sql = gavl_sprintf("SELECT count("META_DB_ID") FROM movies where substr("GAVL_META_DATE", 1, 4) = '%d';", year);
+
+          gavl_track_set_num_children(ret, 0, bg_sqlite_get_int(s->db, sql));
+          free(sql);
           return 1;
           }
         else if(*id == '/')
           {
+          int64_t movie_id;
           id++;
-          
-          genre_id = strtoll(id, &rest, 10);
-        
-          if(id == rest)
-            return 0;
-          id = rest;
-          
-          if(*id == '\0')
-            {
-
-            sql = gavl_sprintf("SELECT DISTINCT substr(albums."GAVL_META_DATE", 1, 4) FROM "
-                             "albums INNER JOIN album_genres_arr ON "
-                             "album_genres_arr.OBJ_ID = albums.DBID WHERE "
-                             "album_genres_arr.NAME_ID = %"PRId64" ORDER BY albums."GAVL_META_DATE";", genre_id);
-            bg_sqlite_exec(s->db,                                      
-                           sql,
-                           append_id_callback, &a);
-            free(sql);
-            return 1;
-
-            
-            }
-          else if(*id == '/')
-            {
-
-            int year;
-            id++;
-
-            year = strtol(id, &rest, 10);
-        
-            if(id == rest)
-              return 0;
-            id = rest;
-
-            if(*id == '\0')
-              {
-              sql = gavl_sprintf("SELECT albums."META_DB_ID" FROM "
-                               "albums INNER JOIN album_genres_arr ON "
-                               "album_genres_arr.OBJ_ID = albums.DBID WHERE "
-                               "album_genres_arr.NAME_ID = %"PRId64" AND albums."GAVL_META_DATE" GLOB '%d*' "
-                               "ORDER BY albums."GAVL_META_SEARCH_TITLE" COLLATE strcoll;", genre_id, year);
-              bg_sqlite_exec(s->db,                                      
-                             sql,
-                             append_id_callback, &a);
-              
-              free(sql);
-              return 1;
-              }
-            else if(*id == '/')
-              {
-              int64_t album_id;
-            
-              id++;
-              album_id = strtoll(id, &rest, 10);
-
-              sql = gavl_sprintf("SELECT "META_DB_ID" FROM songs "
-                               "WHERE "META_PARENT_ID" = %"PRId64" "
-                               "ORDER BY "GAVL_META_TRACKNUMBER";", album_id);
-              bg_sqlite_exec(s->db, sql, append_id_callback, &a);  
-              free(sql);
-              return 1;
-              
-
-              }
+          movie_id = strtoll(id, &rest, 10);
             
-            }
-          else
+          if(!(obj = query_sqlite_object(b, movie_id, TYPE_MOVIE)))
             return 0;
+            
+          gavl_dictionary_merge2(m, gavl_track_get_metadata(obj));
+          gavl_dictionary_set(m, GAVL_META_LABEL, gavl_dictionary_get(m, GAVL_META_TITLE));
+          finalize_metadata_movie(m);
+          /* Copy parts */
+          gavl_dictionary_set(ret, GAVL_META_PARTS, gavl_dictionary_get(obj, GAVL_META_PARTS));
+          
+          gavl_dictionary_destroy(obj);
+          return 1;
           }
         else
           return 0;
-        
         }
+      else
+        return 0;
+      }
+    }
+  else if(s->series_id && starts_with(&id, s->series_id))
+    {
+    if(*id != '/')
+      return 0;
+    id++;
 
-      /* /albums/year */
+    if(starts_with(&id, "all"))
+      {
+      if(*id == '\0') // /series/all
+        {
+        gavl_dictionary_set_string(m, GAVL_META_LABEL, "All");
+        gavl_dictionary_set_string(m, GAVL_META_CLASS, GAVL_META_CLASS_CONTAINER);
+        gavl_dictionary_set_string(m, GAVL_META_CHILD_CLASS, GAVL_META_CLASS_TV_SHOW);
 
-      else if(starts_with(&id, "year"))
+        gavl_track_set_num_children(ret, bg_sqlite_get_int(s->db, "SELECT COUNT("META_DB_ID") FROM shows;"), 0);
+        
+        return 1;
+        }
+      else if(*id == '/')  // /series/all/..
+        {
+        return browse_object_series(b, id, ret);
+        }
+      else
+        return 0;
+      }
+    else if(starts_with(&id, "genre"))
+      {
+      if(*id == '\0')
+        {
+        gavl_dictionary_set_string(m, GAVL_META_LABEL, "Genre");
+        gavl_dictionary_set_string(m, GAVL_META_CLASS, GAVL_META_CLASS_CONTAINER);
+        gavl_dictionary_set_string(m, GAVL_META_CHILD_CLASS, GAVL_META_CLASS_CONTAINER_GENRE);
+        
+        gavl_track_set_num_children(ret, bg_sqlite_get_int(s->db, "SELECT COUNT(ID) FROM show_genres;"), 0);
+        return 1;
+        }
+      else if(*id == '/')
         {
+        id++;
+
+        genre_id = strtoll(id, &rest, 10);
+        
+        if(id == rest)
+          return 0;
+        id = rest;
         if(*id == '\0')
           {
-          bg_sqlite_exec(s->db,                                      
-                         "SELECT DISTINCT substr("GAVL_META_DATE", 1, 4) FROM "
-                         "albums ORDER BY "GAVL_META_DATE";",
-                         append_id_callback, &a);
-          return 1;
-          }
-        else if(*id == '/') // /songs/year/1960
-          {
-          int year;
-          id++;
+          gavl_dictionary_set_string_nocopy(m, GAVL_META_LABEL,
+                                     bg_sqlite_id_to_string(s->db,
+                                                            "show_genres",
+                                                            "NAME", "ID", genre_id));
+          
+          gavl_dictionary_set_string(m, GAVL_META_CLASS, GAVL_META_CLASS_CONTAINER_GENRE);
+          /* TODO: num children */
 
-          year = strtol(id, &rest, 10);
-        
-          if(id == rest)
-            return 0;
-          id = rest;
+          sql = gavl_sprintf("SELECT count(OBJ_ID) "
+                           "FROM show_genres_arr WHERE "
+                           "NAME_ID = %"PRId64";", genre_id);
 
-          if(*id == '\0')
-            {
-            sql = gavl_sprintf("select "META_DB_ID" FROM "
-                             "albums WHERE "
-                             GAVL_META_DATE" GLOB '%d*' "
-                             "ORDER BY "GAVL_META_SEARCH_TITLE" COLLATE strcoll;", year);
-            bg_sqlite_exec(s->db,                                      
-                           sql,
-                           append_id_callback, &a);
-              
-            free(sql);
-            return 1;
-            }
-          else if(*id == '/')
-            {
-            int64_t album_id;
-            
-            id++;
-            album_id = strtoll(id, &rest, 10);
+          gavl_track_set_num_children(ret, (int)bg_sqlite_get_int(s->db, sql), 0);
+          free(sql);
 
-            sql = gavl_sprintf("SELECT "META_DB_ID" FROM songs "
-                             "WHERE "META_PARENT_ID" = %"PRId64" "
-                             "ORDER BY "GAVL_META_TRACKNUMBER";", album_id);
-            bg_sqlite_exec(s->db, sql, append_id_callback, &a);  
-            free(sql);
-            return 1;
-            }
-          else 
-            return 0;
+          return 1;
           }
+        else if(*id == '/')
+          return browse_object_series(b, id, ret);
         else
           return 0;
-          
-        
-        }
-
-
 
-      
+        }
+      else
+        return 0;
       }
+    }
+  
+  return 0;
+  }
+
+static int browse_object(bg_mdb_backend_t * b, const char * id_p, gavl_dictionary_t * ret)
+  {
+  char * parent_id = NULL;
+  
+  if(!browse_object_internal(b, id_p, ret))
+    return 0;
+
+  if(!id_p)
+    id_p = gavl_track_get_id(ret);
+  
+  /* Get next and previous */
+  if((parent_id = bg_mdb_get_parent_id(id_p)))
+    {
+    gavl_array_t arr;
+    gavl_array_init(&arr);
+    
+    if(browse_children_ids(b, parent_id, &arr))
+      {
+      int i;
+      const char * last_id = NULL;
+      const char * id = NULL;
+      const gavl_dictionary_t * dict;
+
+      for(i = 0; i < arr.num_entries; i++)
+        {
+        if((dict = gavl_value_get_dictionary(&arr.entries[i])) &&
+           (id = gavl_track_get_id(dict)))
+          {
+          if(!strcmp(id, id_p))
+            {
+            gavl_dictionary_t * m;
+            m = gavl_track_get_metadata_nc(ret);
+            
+            if(last_id)
+              gavl_dictionary_set_string(m, GAVL_META_PREVIOUS_ID, last_id);
 
+            if((i < arr.num_entries-1) &&
+               (dict = gavl_value_get_dictionary(&arr.entries[i+1])) &&
+               (id = gavl_track_get_id(dict)))
+              gavl_dictionary_set_string(m, GAVL_META_NEXT_ID, id);
+            break;
+            }
+          last_id = id;
+          }
+        }
+      }
+    
+    gavl_array_free(&arr);
+    free(parent_id);
     }
-  else if(s->movies_id && starts_with(&id, s->movies_id))
+  //  bg_track_find_subtitles(ret);
+  bg_mdb_add_http_uris(b->db, ret);
+  return 1;
+  }
+
+typedef struct
+  {
+  gavl_array_t * arr;
+  const char * parent_id;
+  } append_id_t;
+
+static gavl_dictionary_t * append_id(gavl_array_t * arr, char * id)
+  {
+  gavl_dictionary_t * dict;
+  gavl_dictionary_t * m;
+
+  gavl_value_t val;
+
+  gavl_value_init(&val);
+    
+  dict = gavl_value_set_dictionary(&val);
+  m = gavl_dictionary_get_dictionary_create(dict, GAVL_META_METADATA);
+  gavl_dictionary_set_string_nocopy(m, GAVL_META_ID, id);
+  gavl_array_splice_val_nocopy(arr, -1, 0, &val);
+  return dict;
+  }
+
+static int append_id_callback(void * data, int argc, char **argv, char **azColName)
+  {
+  append_id_t * a = data;
+  append_id(a->arr, gavl_sprintf("%s/%s", a->parent_id, argv[0]));
+  return 0;
+  }
+
+static int browse_children_series(bg_mdb_backend_t * b, const char * id,
+                                  append_id_t * a)
+  {
+  char * rest;
+  int64_t series_id;
+  sqlite_priv_t * s;
+
+  id++;
+
+  series_id = strtoll(id, &rest, 10);
+
+  id = rest;
+
+  s = b->priv;
+
+  if(*id == '\0')
     {
-    if(*id == '\0') // /movies
+    bg_sqlite_exec_cached(s->stmts,
+                          "SELECT "META_DB_ID" FROM seasons WHERE "META_PARENT_ID" = ?1 ORDER BY "GAVL_META_SEASON";",
+                          append_id_callback, a, 1, series_id);
+
+    append_id(a->arr, gavl_sprintf("%s/all", a->parent_id));
+    return 1;
+    }
+  else if(*id == '/')
+    {
+    id++;
+
+    if(!strcmp(id, "all"))
       {
-      append_id(ret, gavl_sprintf("%s/all", s->movies_id));
-      append_id(ret, gavl_sprintf("%s/actor", s->movies_id));
-      append_id(ret, gavl_sprintf("%s/director", s->movies_id));
-      append_id(ret, gavl_sprintf("%s/genre", s->movies_id));
-      append_id(ret, gavl_sprintf("%s/year", s->movies_id));
-      append_id(ret, gavl_sprintf("%s/country", s->movies_id));
-      append_id(ret, gavl_sprintf("%s/language", s->movies_id));
+      bg_sqlite_exec_cached(s->stmts,
+                            "SELECT "META_DB_ID" FROM episodes WHERE "META_PARENT_ID" in (SELECT "META_DB_ID" FROM seasons "
+                            "WHERE "META_PARENT_ID" = ?1) ORDER BY "META_SORT_KEY";",
+                            append_id_callback, a, 1, series_id);
+      }
+    else
+      {
+      int64_t season_id = strtoll(id, &rest, 10);
+      bg_sqlite_exec_cached(s->stmts,
+                            SQL_SEASON_EPISODES,
+                            append_id_callback, a, 1, season_id);
+      }
+    return 1;
+    }
+  else
+    return 0;
+
+  return 0;
+  
+  }
+
+static int browse_children_ids(bg_mdb_backend_t * b, const char * id,
+                               gavl_array_t * ret)
+  {
+  sqlite_priv_t * s;
+  gavl_value_t val;
+  const char * id_orig = id;
+  append_id_t a;
+  char * sql;
+  //  int result;
+  int64_t genre_id;
+  char * rest;
+  
+  s = b->priv;
+  
+  gavl_value_init(&val);
+  
+  if(s->songs_id && starts_with(&id, s->songs_id))
+    {
+    if(*id == '\0') // /songs
+      {
+      append_id(ret, gavl_sprintf("%s/artist", s->songs_id));
+      append_id(ret, gavl_sprintf("%s/genre", s->songs_id));
+      append_id(ret, gavl_sprintf("%s/genre-artist", s->songs_id));
+      append_id(ret, gavl_sprintf("%s/genre-year", s->songs_id));
+      append_id(ret, gavl_sprintf("%s/year", s->songs_id));
+      
       return 1;
       }
     else
@@ -5671,13 +6402,13 @@ static int browse_children_ids(bg_mdb_backend_t * b, const char * id,
       if(*id != '/')
         return 0;
       id++;
-      
+
       a.arr       = ret;
       a.parent_id = id_orig;
-
-      if(starts_with(&id, "actor"))
+      
+      if(starts_with(&id, "artist"))
         {
-        if(*id == '\0') // /movies/actor
+        if(*id == '\0')
           {
           /* Groups */
           int i, j;
@@ -5685,7 +6416,7 @@ static int browse_children_ids(bg_mdb_backend_t * b, const char * id,
           gavl_array_t arr;
           gavl_array_init(&arr);
           
-          bg_sqlite_exec(s->db, "SELECT NAME FROM movie_actors", append_string_callback, &arr);
+          bg_sqlite_exec_cached(s->stmts, "SELECT NAME FROM song_artists", append_string_callback, &arr, 0);
           
           for(i = 0; i < bg_mdb_num_groups; i++)
             {
@@ -5702,140 +6433,321 @@ static int browse_children_ids(bg_mdb_backend_t * b, const char * id,
               {
               gavl_dictionary_t * dict, *m;
               
-              dict = append_id(ret, gavl_sprintf("%s/actor/%s", s->movies_id, bg_mdb_groups[i].id));
-
-              m = gavl_track_get_metadata_nc(dict);
+              dict = append_id(ret, gavl_sprintf("%s/artist/%s", s->songs_id, bg_mdb_groups[i].id));
 
               gavl_track_set_num_children(dict, num, 0);
+              
+              m = gavl_track_get_metadata_nc(dict);
               gavl_dictionary_set_string(m, GAVL_META_LABEL, bg_mdb_groups[i].label);
               }
+            
+            // gavl_value_set_string_nocopy(&val, gavl_sprintf("%s/genre-year", s->songs_id));
+            // gavl_array_splice_val_nocopy(ret, -1, 0, &val);
             }
           gavl_array_free(&arr);
           return 1;
           }
-        else if(*id == '/')
+        else if(*id == '/') // /songs/artist/a
           {
           const char * pos;
           id++;
 
-          if(!(pos = strchr(id, '/')))  // /movies/actor/a
+          if(!(pos = strchr(id, '/')))  // /songs/artist/a
             {
             char * cond;
 
             if((cond = bg_sqlite_make_group_condition(id)))
               {
-              sql = gavl_sprintf("SELECT ID FROM movie_actors WHERE NAME %s ORDER BY NAME;", cond);
-              bg_sqlite_exec(s->db, sql, append_id_callback, &a);  
+              sql = gavl_sprintf("SELECT ID FROM song_artists WHERE NAME %s ORDER BY NAME;", cond);
+              bg_sqlite_exec_cached(s->stmts, sql, append_id_callback, &a, 0);
               free(sql);
               free(cond);
               }
             return 1;
             }
-          else   // /movie/actor/a/123
+          else   // /songs/artist/a/123
             {
-            int64_t actor_id;
+            int64_t artist_id;
             
             id = pos;
             id++;
-            actor_id = strtoll(id, NULL, 10);
-
-            sql = gavl_sprintf("SELECT movies."META_DB_ID" FROM movies INNER JOIN "
-                             "movie_actors_arr "
-                             "ON movies."META_DB_ID" = movie_actors_arr.OBJ_ID "
-                             "WHERE movie_actors_arr.NAME_ID = %"PRId64" ORDER BY "
-                             "movies."GAVL_META_DATE";", actor_id);
+            artist_id = strtoll(id, NULL, 10);
 
-            bg_sqlite_exec(s->db, sql, append_id_callback, &a);  
-            free(sql);
+            bg_sqlite_exec_cached(s->stmts,
+                                  SQL_SONGS_BY_ARTIST,
+                                  append_id_callback, &a, 1, artist_id);
             return 1;
             }
           }
         else
-          return 0;
-        
-        }
-      else if(starts_with(&id, "all"))
-        {
-        if(*id == '\0') // /movies/all
-          {
-          // fprintf(stderr, "SELECT "META_DB_ID" FROM movies ORDER BY "GAVL_META_SEARCH_TITLE" COLLATE strcoll;\n"); /* SQL to be evaluated */
-          
-          bg_sqlite_exec(s->db,                                        
-                         "SELECT "META_DB_ID" FROM movies ORDER BY "GAVL_META_SEARCH_TITLE" COLLATE strcoll;", /* SQL to be evaluated */
-                         append_id_callback, &a);
-          return 1;
-          }
-        else if(*id == '/')
           {
           
           }
-        else
-          return 0;
         
         }
-      else if(starts_with(&id, "country"))
+      else if(starts_with(&id, "genre-artist"))
         {
-        if(*id == '\0') // /movies/country
+        if(*id == '\0') // songs/genre-artist
           {
-          bg_sqlite_exec(s->db,                                        
-                         "SELECT ID FROM movie_countries ORDER BY NAME;", /* SQL to be evaluated */
-                         append_id_callback, &a);
+          bg_sqlite_exec_cached(s->stmts,
+                                "SELECT ID FROM song_genres ORDER BY NAME", /* SQL to be evaluated */
+                                append_id_callback, &a, 0);
           return 1;
           }
         else if(*id == '/')
           {
-          int64_t country_id;
-            
           id++;
-          country_id = strtoll(id, NULL, 10);
-          
-          sql = gavl_sprintf("SELECT movies."META_DB_ID" FROM movies INNER JOIN "
-                           "movie_countries_arr "
-                           "ON movies."META_DB_ID" = movie_countries_arr.OBJ_ID "
-                           "WHERE movie_countries_arr.NAME_ID = %"PRId64" ORDER BY "
-                           "movies."GAVL_META_SEARCH_TITLE";", country_id);
-          
-          bg_sqlite_exec(s->db, sql, append_id_callback, &a);  
-          free(sql);
-          return 1;
+          genre_id = strtoll(id, &rest, 10);
           
+          if(id == rest)
+            return 0;
+          id = rest;
+
+          if(*id == '\0') // songs/genre-artist/1
+            {
+            bg_sqlite_exec_cached(s->stmts,
+                                  SQL_ARTISTS_BY_GENRE,
+                                  append_id_callback, &a, 1, genre_id);
+            return 1;
+            }
+          else if(*id == '/')  // songs/genre-artist/1/123
+            {
+            int64_t artist_id;
+            id++;
+            artist_id = strtoll(id, &rest, 10);
+            
+            id = rest;
+            
+            if(*id == '\0')
+              {
+              bg_sqlite_exec_cached(s->stmts,
+                                    SQL_SONGS_BY_GENRE_ARTIST,
+                                    append_id_callback, &a, 2, genre_id, artist_id);
+              return 1;
+              }
+            else
+              return 0;
+            }
+          else
+            return 0;
+
           }
         else
           return 0;
-      
+        
         }
-      else if(starts_with(&id, "language"))
+      else if(starts_with(&id, "genre-year"))
         {
-        if(*id == '\0') // /movies/language
+        if(*id == '\0')
           {
-          bg_sqlite_exec(s->db,                                        
-                         "SELECT ID FROM movie_audio_languages ORDER BY NAME", /* SQL to be evaluated */
-                         append_id_callback, &a);
+          bg_sqlite_exec_cached(s->stmts,
+                                "SELECT ID FROM song_genres ORDER BY NAME", /* SQL to be evaluated */
+                                append_id_callback, &a, 0);
           return 1;
           }
         else if(*id == '/')
           {
-          int64_t language_id;
-            
           id++;
-          language_id = strtoll(id, NULL, 10);
-          
-          sql = gavl_sprintf("SELECT movies."META_DB_ID" FROM movies INNER JOIN "
-                           "movie_audio_languages_arr "
-                           "ON movies."META_DB_ID" = movie_audio_languages_arr.OBJ_ID "
-                           "WHERE movie_audio_languages_arr.NAME_ID = %"PRId64" ORDER BY "
-                           "movies."GAVL_META_SEARCH_TITLE" COLLATE strcoll;", language_id);
-          
-          bg_sqlite_exec(s->db, sql, append_id_callback, &a);  
-          free(sql);
+          genre_id = strtoll(id, &rest, 10);
+        
+          if(id == rest)
+            return 0;
+          id = rest;
+
+          if(*id == '\0') // /songs/genre-year/1
+            {
+            bg_sqlite_exec_cached(s->stmts,
+                                  "SELECT DISTINCT substr(songs."GAVL_META_DATE", 1, 4) FROM "
+                                  "songs INNER JOIN song_genres_arr ON "
+                                  "song_genres_arr.OBJ_ID = songs.DBID WHERE "
+                                  "song_genres_arr.NAME_ID = ?1 ORDER BY songs."GAVL_META_DATE";",
+                                  append_id_callback, &a, 1, genre_id);
+            return 1;
+            }
+          else if(*id == '/') // /songs/genre-year/1/1960
+            {
+            int year;
+            id++;
+
+            year = strtol(id, &rest, 10);
+        
+            if(id == rest)
+              return 0;
+            id = rest;
+
+            if(*id == '\0')
+              {
+              bg_sqlite_exec_cached(s->stmts,
+                                    SQL_SONGS_BY_GENRE_YEAR,
+                                    append_id_callback, &a, 2, genre_id, (int64_t)year);
+              return 1;
+              }
+            else 
+              return 0;
+            }
+          else
+            return 0;
+          
+          }
+      
+        }
+
+      /* /songs/year */
+
+      else if(starts_with(&id, "year"))
+        {
+        if(*id == '\0')
+          {
+          bg_sqlite_exec_cached(s->stmts,
+                                SQL_SONG_YEARS,
+                                append_id_callback, &a, 0);
           return 1;
+          }
+        else if(*id == '/') // /songs/year/1960
+          {
+          int year;
+          id++;
+
+          year = strtol(id, &rest, 10);
+        
+          if(id == rest)
+            return 0;
+          id = rest;
+
+          if(*id == '\0')
+            {
+            bg_sqlite_exec_cached(s->stmts,
+                                  SQL_SONGS_BY_YEAR,
+                                  append_id_callback, &a, 1, (int64_t)year);
+            return 1;
+            }
+          else 
+            return 0;
+          }
+        else
+          return 0;
           
+        
+        }
+
+      /* /songs/genre */
+         
+      else if(starts_with(&id, "genre"))
+        {
+        if(*id == '\0')
+          {
+          bg_sqlite_exec_cached(s->stmts,
+                                "SELECT ID FROM song_genres ORDER BY NAME", /* SQL to be evaluated */
+                                append_id_callback, &a, 0);
+          return 1;
+          }
+        else if(*id == '/')
+          {
+          id++;
+          genre_id = strtoll(id, &rest, 10);
+        
+          if(id == rest)
+            return 0;
+          id = rest;
+
+          if(*id == '\0')
+            {
+            gavl_array_t arr;
+            int i, j, num;
+            gavl_array_init(&arr);
+            
+            bg_sqlite_exec_cached(s->stmts,
+                                  "SELECT songs."GAVL_META_SEARCH_TITLE" "
+                                  "FROM song_genres_arr INNER JOIN songs "
+                                  "ON song_genres_arr.OBJ_ID = songs."META_DB_ID" "
+                                  "WHERE song_genres_arr.NAME_ID = ?1;",
+                                  append_string_callback, &arr, 1, genre_id);
+
+            for(i = 0; i < bg_mdb_num_groups; i++)
+              {
+              num = 0;
+            
+              for(j = 0; j < arr.num_entries; j++)
+                {
+                if(bg_mdb_test_group_condition(bg_mdb_groups[i].id, 
+                                        gavl_value_get_string(&arr.entries[j])))
+                  num++;
+                }
+
+              if(num)
+                {
+                gavl_dictionary_t * dict, *m;
+                
+                dict = append_id(ret, gavl_sprintf("%s/genre/%"PRId64"/%s", s->songs_id, genre_id, bg_mdb_groups[i].id));
+
+                m = gavl_track_get_metadata_nc(dict);
+
+                gavl_track_set_num_children(dict, 0, num);
+                
+                gavl_dictionary_set_string(m, GAVL_META_LABEL, bg_mdb_groups[i].label);
+                }
+            
+              // gavl_value_set_string_nocopy(&val, gavl_sprintf("%s/genre-year", s->songs_id));
+              // gavl_array_splice_val_nocopy(ret, -1, 0, &val);
+
+              }
+            gavl_array_free(&arr);
+            return 1;
+            }
+          else if(*id == '/')
+            {
+            char * pos;
+            id++;
+
+            if(!(pos = strchr(id, '/')))
+              {
+              char * cond = bg_sqlite_make_group_condition(id);
+
+              if(cond)
+                {
+                sql = gavl_sprintf("SELECT songs."META_DB_ID" "
+                                 "FROM song_genres_arr INNER JOIN songs "
+                                 "ON song_genres_arr.OBJ_ID = songs."META_DB_ID" "
+                                 "WHERE song_genres_arr.NAME_ID = ?1 AND "
+                                 "songs."GAVL_META_SEARCH_TITLE" %s ORDER BY songs."META_SORT_KEY";", cond);
+                bg_sqlite_exec_cached(s->stmts, sql, append_id_callback, &a, 1, genre_id);
+                free(sql);
+                free(cond);
+                return 1;
+                }
+              }
+            else
+              return 0;
+            }
+          else
+            return 0;
           }
         else
           return 0;
-      
         }
-      else if(starts_with(&id, "director"))
+      }
+    }
+  else if(s->albums_id && starts_with(&id, s->albums_id))
+    {
+    if(*id == '\0') // /albums
+      {
+      append_id(ret, gavl_sprintf("%s/artist", s->albums_id));
+      append_id(ret, gavl_sprintf("%s/genre-artist", s->albums_id));
+      append_id(ret, gavl_sprintf("%s/genre-year", s->albums_id));
+      append_id(ret, gavl_sprintf("%s/year", s->albums_id));
+      return 1;
+      }
+    else
+      {
+      if(*id != '/')
+        return 0;
+
+      id++;
+
+      a.arr       = ret;
+      a.parent_id = id_orig;
+
+      if(starts_with(&id, "artist"))
         {
         if(*id == '\0')
           {
@@ -5845,7 +6757,7 @@ static int browse_children_ids(bg_mdb_backend_t * b, const char * id,
           gavl_array_t arr;
           gavl_array_init(&arr);
           
-          bg_sqlite_exec(s->db, "SELECT NAME FROM movie_directors", append_string_callback, &arr);
+          bg_sqlite_exec_cached(s->stmts, "SELECT NAME FROM album_artists", append_string_callback, &arr, 0);
           
           for(i = 0; i < bg_mdb_num_groups; i++)
             {
@@ -5862,8 +6774,10 @@ static int browse_children_ids(bg_mdb_backend_t * b, const char * id,
               {
               gavl_dictionary_t * dict, *m;
               
-              dict = append_id(ret, gavl_sprintf("%s/director/%s", s->movies_id, bg_mdb_groups[i].id));
+              dict = append_id(ret, gavl_sprintf("%s/artist/%s", s->albums_id, bg_mdb_groups[i].id));
 
+              gavl_track_set_num_children(dict, num, 0);
+                            
               m = gavl_track_get_metadata_nc(dict);
 
               gavl_track_set_num_children(dict, num, 0);
@@ -5873,305 +6787,1343 @@ static int browse_children_ids(bg_mdb_backend_t * b, const char * id,
           gavl_array_free(&arr);
           return 1;
           }
-        else if(*id == '/')
+        else
           {
           const char * pos;
           id++;
 
-          if(!(pos = strchr(id, '/')))  // /movies/director/a
+          if(!(pos = strchr(id, '/')))  // /albums/artist/a
             {
             char * cond;
 
             if((cond = bg_sqlite_make_group_condition(id)))
               {
-              sql = gavl_sprintf("SELECT ID FROM movie_directors WHERE NAME %s ORDER BY NAME;", cond);
-              bg_sqlite_exec(s->db, sql, append_id_callback, &a);  
+              sql = gavl_sprintf("SELECT ID FROM album_artists WHERE NAME %s ORDER BY NAME;", cond);
+              bg_sqlite_exec_cached(s->stmts, sql, append_id_callback, &a, 0);
               free(sql);
               free(cond);
               }
             return 1;
             }
-          else   // /movie/director/a/123
+          else   // /albums/artist/a/123
             {
-            int64_t director_id;
+            int64_t artist_id;
             
             id = pos;
             id++;
-            director_id = strtoll(id, NULL, 10);
+            artist_id = strtoll(id, &rest, 10);
 
-            sql = gavl_sprintf("SELECT movies."META_DB_ID" FROM movies INNER JOIN "
-                             "movie_directors_arr "
-                             "ON movies."META_DB_ID" = movie_directors_arr.OBJ_ID "
-                             "WHERE movie_directors_arr.NAME_ID = %"PRId64" ORDER BY "
-                             "movies."GAVL_META_DATE";", director_id);
+            id = rest;
+            
+            if(*id == '\0')
+              {
+              bg_sqlite_exec_cached(s->stmts,
+                                    SQL_ALBUMS_BY_ARTIST,
+                                    append_id_callback, &a, 1, artist_id);
+              return 1;
+              }
+            else if(*id == '/')
+              {
+              int64_t album_id;
+            
+              id++;
+              album_id = strtoll(id, &rest, 10);
 
-            bg_sqlite_exec(s->db, sql, append_id_callback, &a);  
-            free(sql);
-            return 1;
+              bg_sqlite_exec_cached(s->stmts,
+                                    SQL_ALBUM_TRACKS,
+                                    append_id_callback, &a, 1, album_id);
+              return 1;
+              
+              }
+            else
+              return 0;
             }
-          }
-        else
-          return 0;
-
-      
-        }
-      else if(starts_with(&id, "genre"))
-        {
-        if(*id == '\0')
-          {
-          bg_sqlite_exec(s->db,                                        
-                         "SELECT ID FROM movie_genres ORDER BY NAME", /* SQL to be evaluated */
-                         append_id_callback, &a);
-          return 1;
-          }
-        else if(*id == '/')
-          {
-          int64_t genre_id;
-            
-          id++;
-          genre_id = strtoll(id, NULL, 10);
           
-          sql = gavl_sprintf("SELECT movies."META_DB_ID" FROM movies INNER JOIN "
-                           "movie_genres_arr "
-                           "ON movies."META_DB_ID" = movie_genres_arr.OBJ_ID "
-                           "WHERE movie_genres_arr.NAME_ID = %"PRId64" ORDER BY "
-                           "movies."GAVL_META_SEARCH_TITLE" COLLATE strcoll;", genre_id);
-          
-          bg_sqlite_exec(s->db, sql, append_id_callback, &a);  
-          free(sql);
-          return 1;
           
           }
-        else
-          return 0;
-
       
         }
-      else if(starts_with(&id, "year"))
+      else if(starts_with(&id, "genre-artist"))
         {
         if(*id == '\0')
           {
-          bg_sqlite_exec(s->db,                                        
-                         "SELECT DISTINCT substr("GAVL_META_DATE", 1, 4) FROM movies ORDER BY "GAVL_META_DATE";",
-                         append_id_callback, &a);
+          bg_sqlite_exec_cached(s->stmts,
+                                "SELECT ID FROM album_genres ORDER BY NAME", /* SQL to be evaluated */
+                                append_id_callback, &a, 0);
           return 1;
           }
-        else if(*id == '/')
+        else if(*id == '/') // /genre/artist/1
           {
-          int year;
-            
           id++;
-          year = strtol(id, &rest, 10);
-
+          genre_id = strtoll(id, &rest, 10);
+        
+          if(id == rest)
+            return 0;
           id = rest;
-          
+
           if(*id == '\0')
             {
-            sql = gavl_sprintf("SELECT "META_DB_ID" FROM movies WHERE substr("GAVL_META_DATE", 1, 4) = '%d' ORDER BY "GAVL_META_SEARCH_TITLE" COLLATE strcoll;", year);
-            bg_sqlite_exec(s->db,                                        
-                           sql, append_id_callback, &a);
-            free(sql);
+            bg_sqlite_exec_cached(s->stmts,
+                                  "SELECT ID FROM album_artists WHERE ID in (SELECT DISTINCT album_artists_arr.NAME_ID "
+                                  "FROM album_artists_arr INNER JOIN album_genres_arr "
+                                  "ON album_artists_arr.OBJ_ID = album_genres_arr.OBJ_ID "
+                                  "WHERE album_genres_arr.NAME_ID = ?1) ORDER BY NAME;",
+                                  append_id_callback, &a, 1, genre_id);
             return 1;
             }
-          else
-            return 0;
-          }
-        else
-          return 0;
-        }
-      }
+          else if(*id == '/')  // /genre/artist/1/7
+            {
+
+            int64_t artist_id;
+            id++;
+            artist_id = strtoll(id, &rest, 10);
+            
+            id = rest;
+            
+            if(*id == '\0')
+              {
+              bg_sqlite_exec_cached(s->stmts,
+                                    "SELECT album_artists_arr.OBJ_ID "
+                                    "FROM "
+                                    "album_artists_arr INNER JOIN album_genres_arr "
+                                    "ON album_artists_arr.OBJ_ID = album_genres_arr.OBJ_ID "
+                                    "INNER JOIN albums "
+                                    "ON albums."META_DB_ID" = album_genres_arr.OBJ_ID "
+                                    "WHERE album_genres_arr.NAME_ID = ?1 AND "
+                                    "album_artists_arr.NAME_ID = ?2 ORDER BY albums."GAVL_META_DATE", albums."META_SORT_KEY";",
+                                    append_id_callback, &a, 2, genre_id, artist_id);
+              return 1;
+              }
+            else if(*id == '/') // /genre/artist/1/7/110
+
+              {
+              int64_t album_id;
+              id++;
+              album_id = strtoll(id, &rest, 10);
+
+              id = rest;
+
+              if(*id == '\0')
+                {
+                bg_sqlite_exec_cached(s->stmts,
+                                      SQL_ALBUM_TRACKS,
+                                      append_id_callback, &a, 1, album_id);
+                return 1;
+                }
+              else
+                return 0;
+              }
+            else
+              return 0;
+            }
+          else
+            return 0;
+          
+          }
+        else
+          return 0;
+        }
+      else if(starts_with(&id, "genre-year"))
+        {
+        if(*id == '\0')
+          {
+          bg_sqlite_exec_cached(s->stmts,
+                                "SELECT ID FROM album_genres ORDER BY NAME", /* SQL to be evaluated */
+                                append_id_callback, &a, 0);
+          return 1;
+          }
+        else if(*id == '/')
+          {
+          id++;
+          
+          genre_id = strtoll(id, &rest, 10);
+        
+          if(id == rest)
+            return 0;
+          id = rest;
+          
+          if(*id == '\0')
+            {
+
+            bg_sqlite_exec_cached(s->stmts,
+                                  "SELECT DISTINCT substr(albums."GAVL_META_DATE", 1, 4) FROM "
+                                  "albums INNER JOIN album_genres_arr ON "
+                                  "album_genres_arr.OBJ_ID = albums.DBID WHERE "
+                                  "album_genres_arr.NAME_ID = ?1 ORDER BY albums."GAVL_META_DATE";",
+                                  append_id_callback, &a, 1, genre_id);
+            return 1;
+
+            
+            }
+          else if(*id == '/')
+            {
+
+            int year;
+            id++;
+
+            year = strtol(id, &rest, 10);
+        
+            if(id == rest)
+              return 0;
+            id = rest;
+
+            if(*id == '\0')
+              {
+              bg_sqlite_exec_cached(s->stmts,
+                                    "SELECT albums."META_DB_ID" FROM "
+                                    "albums INNER JOIN album_genres_arr ON "
+                                    "album_genres_arr.OBJ_ID = albums.DBID WHERE "
+                                    "album_genres_arr.NAME_ID = ?1 AND albums."GAVL_META_DATE" GLOB (?2 || '*') "
+                                    "ORDER BY albums."META_SORT_KEY";",
+                                    append_id_callback, &a, 2, genre_id, (int64_t)year);
+              return 1;
+              }
+            else if(*id == '/')
+              {
+              int64_t album_id;
+            
+              id++;
+              album_id = strtoll(id, &rest, 10);
+
+              bg_sqlite_exec_cached(s->stmts,
+                                    SQL_ALBUM_TRACKS,
+                                    append_id_callback, &a, 1, album_id);
+              return 1;
+              
+
+              }
+            
+            }
+          else
+            return 0;
+          }
+        else
+          return 0;
+        
+        }
+
+      /* /albums/year */
+
+      else if(starts_with(&id, "year"))
+        {
+        if(*id == '\0')
+          {
+          bg_sqlite_exec_cached(s->stmts,
+                                "SELECT DISTINCT substr("GAVL_META_DATE", 1, 4) FROM "
+                                "albums ORDER BY "GAVL_META_DATE";",
+                                append_id_callback, &a, 0);
+          return 1;
+          }
+        else if(*id == '/') // /songs/year/1960
+          {
+          int year;
+          id++;
+
+          year = strtol(id, &rest, 10);
+        
+          if(id == rest)
+            return 0;
+          id = rest;
+
+          if(*id == '\0')
+            {
+            bg_sqlite_exec_cached(s->stmts,
+                                  "select "META_DB_ID" FROM "
+                                  "albums WHERE "
+                                  GAVL_META_DATE" GLOB (?1 || '*') "
+                                  "ORDER BY "META_SORT_KEY";",
+                                  append_id_callback, &a, 1, (int64_t)year);
+            return 1;
+            }
+          else if(*id == '/')
+            {
+            int64_t album_id;
+            
+            id++;
+            album_id = strtoll(id, &rest, 10);
+
+            bg_sqlite_exec_cached(s->stmts,
+                                  SQL_ALBUM_TRACKS,
+                                  append_id_callback, &a, 1, album_id);
+            return 1;
+            }
+          else 
+            return 0;
+          }
+        else
+          return 0;
+          
+        
+        }
+
+
+
+      
+      }
+
+    }
+  else if(s->movies_id && starts_with(&id, s->movies_id))
+    {
+    if(*id == '\0') // /movies
+      {
+      append_id(ret, gavl_sprintf("%s/all", s->movies_id));
+      append_id(ret, gavl_sprintf("%s/actor", s->movies_id));
+      append_id(ret, gavl_sprintf("%s/director", s->movies_id));
+      append_id(ret, gavl_sprintf("%s/genre", s->movies_id));
+      append_id(ret, gavl_sprintf("%s/year", s->movies_id));
+      append_id(ret, gavl_sprintf("%s/country", s->movies_id));
+      append_id(ret, gavl_sprintf("%s/language", s->movies_id));
+      return 1;
+      }
+    else
+      {
+      if(*id != '/')
+        return 0;
+      id++;
+      
+      a.arr       = ret;
+      a.parent_id = id_orig;
+
+      if(starts_with(&id, "actor"))
+        {
+        if(*id == '\0') // /movies/actor
+          {
+          /* Groups */
+          int i, j;
+          int num;
+          gavl_array_t arr;
+          gavl_array_init(&arr);
+          
+          bg_sqlite_exec_cached(s->stmts, "SELECT NAME FROM movie_actors", append_string_callback, &arr, 0);
+          
+          for(i = 0; i < bg_mdb_num_groups; i++)
+            {
+            num = 0;
+            
+            for(j = 0; j < arr.num_entries; j++)
+              {
+              if(bg_mdb_test_group_condition(bg_mdb_groups[i].id, 
+                                      gavl_value_get_string(&arr.entries[j])))
+                num++;
+              }
+
+            if(num)
+              {
+              gavl_dictionary_t * dict, *m;
+              
+              dict = append_id(ret, gavl_sprintf("%s/actor/%s", s->movies_id, bg_mdb_groups[i].id));
+
+              m = gavl_track_get_metadata_nc(dict);
+
+              gavl_track_set_num_children(dict, num, 0);
+              gavl_dictionary_set_string(m, GAVL_META_LABEL, bg_mdb_groups[i].label);
+              }
+            }
+          gavl_array_free(&arr);
+          return 1;
+          }
+        else if(*id == '/')
+          {
+          const char * pos;
+          id++;
+
+          if(!(pos = strchr(id, '/')))  // /movies/actor/a
+            {
+            char * cond;
+
+            if((cond = bg_sqlite_make_group_condition(id)))
+              {
+              sql = gavl_sprintf("SELECT ID FROM movie_actors WHERE NAME %s ORDER BY NAME;", cond);
+              bg_sqlite_exec_cached(s->stmts, sql, append_id_callback, &a, 0);
+              free(sql);
+              free(cond);
+              }
+            return 1;
+            }
+          else   // /movie/actor/a/123
+            {
+            int64_t actor_id;
+            
+            id = pos;
+            id++;
+            actor_id = strtoll(id, NULL, 10);
+
+            bg_sqlite_exec_cached(s->stmts,
+                                  "SELECT movies."META_DB_ID" FROM movies INNER JOIN "
+                                  "movie_actors_arr "
+                                  "ON movies."META_DB_ID" = movie_actors_arr.OBJ_ID "
+                                  "WHERE movie_actors_arr.NAME_ID = ?1 ORDER BY "
+                                  "movies."GAVL_META_DATE";",
+                                  append_id_callback, &a, 1, actor_id);
+            return 1;
+            }
+          }
+        else
+          return 0;
+        
+        }
+      else if(starts_with(&id, "all"))
+        {
+        if(*id == '\0') // /movies/all
+          {
+          // fprintf(stderr, "SELECT "META_DB_ID" FROM movies ORDER BY "META_SORT_KEY";\n"); /* SQL to be evaluated */
+          
+          bg_sqlite_exec_cached(s->stmts,
+                                "SELECT "META_DB_ID" FROM movies ORDER BY "META_SORT_KEY";", /* SQL to be evaluated */
+                                append_id_callback, &a, 0);
+          return 1;
+          }
+        else if(*id == '/')
+          {
+          
+          }
+        else
+          return 0;
+        
+        }
+      else if(starts_with(&id, "country"))
+        {
+        if(*id == '\0') // /movies/country
+          {
+          bg_sqlite_exec_cached(s->stmts,
+                                "SELECT ID FROM movie_countries ORDER BY NAME;", /* SQL to be evaluated */
+                                append_id_callback, &a, 0);
+          return 1;
+          }
+        else if(*id == '/')
+          {
+          int64_t country_id;
+            
+          id++;
+          country_id = strtoll(id, NULL, 10);
+          
+          bg_sqlite_exec_cached(s->stmts,
+                                "SELECT movies."META_DB_ID" FROM movies INNER JOIN "
+                                "movie_countries_arr "
+                                "ON movies."META_DB_ID" = movie_countries_arr.OBJ_ID "
+                                "WHERE movie_countries_arr.NAME_ID = ?1 ORDER BY "
+                                "movies."GAVL_META_SEARCH_TITLE";",
+                                append_id_callback, &a, 1, country_id);
+          return 1;
+          
+          }
+        else
+          return 0;
+      
+        }
+      else if(starts_with(&id, "language"))
+        {
+        if(*id == '\0') // /movies/language
+          {
+          bg_sqlite_exec_cached(s->stmts,
+                                "SELECT ID FROM movie_audio_languages ORDER BY NAME", /* SQL to be evaluated */
+                                append_id_callback, &a, 0);
+          return 1;
+          }
+        else if(*id == '/')
+          {
+          int64_t language_id;
+            
+          id++;
+          language_id = strtoll(id, NULL, 10);
+          
+          bg_sqlite_exec_cached(s->stmts,
+                                "SELECT movies."META_DB_ID" FROM movies INNER JOIN "
+                                "movie_audio_languages_arr "
+                                "ON movies."META_DB_ID" = movie_audio_languages_arr.OBJ_ID "
+                                "WHERE movie_audio_languages_arr.NAME_ID = ?1 ORDER BY "
+                                "movies."META_SORT_KEY";",
+                                append_id_callback, &a, 1, language_id);
+          return 1;
+          
+          }
+        else
+          return 0;
+      
+        }
+      else if(starts_with(&id, "director"))
+        {
+        if(*id == '\0')
+          {
+          /* Groups */
+          int i, j;
+          int num;
+          gavl_array_t arr;
+          gavl_array_init(&arr);
+          
+          bg_sqlite_exec_cached(s->stmts, "SELECT NAME FROM movie_directors", append_string_callback, &arr, 0);
+          
+          for(i = 0; i < bg_mdb_num_groups; i++)
+            {
+            num = 0;
+            
+            for(j = 0; j < arr.num_entries; j++)
+              {
+              if(bg_mdb_test_group_condition(bg_mdb_groups[i].id, 
+                                      gavl_value_get_string(&arr.entries[j])))
+                num++;
+              }
+
+            if(num)
+              {
+              gavl_dictionary_t * dict, *m;
+              
+              dict = append_id(ret, gavl_sprintf("%s/director/%s", s->movies_id, bg_mdb_groups[i].id));
+
+              m = gavl_track_get_metadata_nc(dict);
+
+              gavl_track_set_num_children(dict, num, 0);
+              gavl_dictionary_set_string(m, GAVL_META_LABEL, bg_mdb_groups[i].label);
+              }
+            }
+          gavl_array_free(&arr);
+          return 1;
+          }
+        else if(*id == '/')
+          {
+          const char * pos;
+          id++;
+
+          if(!(pos = strchr(id, '/')))  // /movies/director/a
+            {
+            char * cond;
+
+            if((cond = bg_sqlite_make_group_condition(id)))
+              {
+              sql = gavl_sprintf("SELECT ID FROM movie_directors WHERE NAME %s ORDER BY NAME;", cond);
+              bg_sqlite_exec_cached(s->stmts, sql, append_id_callback, &a, 0);
+              free(sql);
+              free(cond);
+              }
+            return 1;
+            }
+          else   // /movie/director/a/123
+            {
+            int64_t director_id;
+            
+            id = pos;
+            id++;
+            director_id = strtoll(id, NULL, 10);
+
+            bg_sqlite_exec_cached(s->stmts,
+                                  "SELECT movies."META_DB_ID" FROM movies INNER JOIN "
+                                  "movie_directors_arr "
+                                  "ON movies."META_DB_ID" = movie_directors_arr.OBJ_ID "
+                                  "WHERE movie_directors_arr.NAME_ID = ?1 ORDER BY "
+                                  "movies."GAVL_META_DATE";",
+                                  append_id_callback, &a, 1, director_id);
+            return 1;
+            }
+          }
+        else
+          return 0;
+
+      
+        }
+      else if(starts_with(&id, "genre"))
+        {
+        if(*id == '\0')
+          {
+          bg_sqlite_exec_cached(s->stmts,
+                                "SELECT ID FROM movie_genres ORDER BY NAME", /* SQL to be evaluated */
+                                append_id_callback, &a, 0);
+          return 1;
+          }
+        else if(*id == '/')
+          {
+          int64_t genre_id;
+            
+          id++;
+          genre_id = strtoll(id, NULL, 10);
+          
+          bg_sqlite_exec_cached(s->stmts,
+                                SQL_MOVIES_BY_GENRE,
+                                append_id_callback, &a, 1, genre_id);
+          return 1;
+          
+          }
+        else
+          return 0;
+
+      
+        }
+      else if(starts_with(&id, "year"))
+        {
+        if(*id == '\0')
+          {
+          bg_sqlite_exec_cached(s->stmts,
+                                "SELECT DISTINCT substr("GAVL_META_DATE", 1, 4) FROM movies ORDER BY "GAVL_META_DATE";",
+                                append_id_callback, &a, 0);
+          return 1;
+          }
+        else if(*id == '/')
+          {
+          int year;
+            
+          id++;
+          year = strtol(id, &rest, 10);
+
+          id = rest;
+          
+          if(*id == '\0')
+            {
+            bg_sqlite_exec_cached(s->stmts,
+                                  "SELECT "META_DB_ID" FROM movies WHERE substr("GAVL_META_DATE", 1, 4) = CAST(?1 AS TEXT) ORDER BY "META_SORT_KEY";",
+                                  append_id_callback, &a, 1, (int64_t)year);
+            return 1;
+            }
+          else
+            return 0;
+          }
+        else
+          return 0;
+        }
+      }
+
+    }
+  /* series */
+  else if(s->series_id && starts_with(&id, s->series_id))
+    {
+    if(*id == '\0') // /series
+      {
+      append_id(ret, gavl_sprintf("%s/all", s->series_id));
+      append_id(ret, gavl_sprintf("%s/genre", s->series_id));
+      return 1;
+      }
+    else
+      {
+      if(*id != '/')
+        return 0;
+      id++;
+
+      a.arr       = ret;
+      a.parent_id = id_orig;
+
+      if(starts_with(&id, "all"))
+        {
+        if(*id == '\0')
+          {
+          bg_sqlite_exec_cached(s->stmts,
+                                "SELECT "META_DB_ID" FROM shows ORDER BY "GAVL_META_SEARCH_TITLE, /* SQL to be evaluated */
+                                append_id_callback, &a, 0);
+          return 1;
+          }
+        else
+          {
+          return browse_children_series(b, id, &a);
+          }
+        }
+      else if(starts_with(&id, "genre"))
+        {
+        if(*id == '\0')
+          {
+          bg_sqlite_exec_cached(s->stmts,
+                                "SELECT ID FROM show_genres ORDER BY NAME", /* SQL to be evaluated */
+                                append_id_callback, &a, 0);
+          return 1;
+          }
+        else if(*id == '/')
+          {
+          id++;
+          genre_id = strtoll(id, &rest, 10);
+        
+          if(id == rest)
+            return 0;
+          id = rest;
+
+          if(*id == '\0')
+            {
+            bg_sqlite_exec_cached(s->stmts,
+                                  "SELECT shows."META_DB_ID" FROM shows INNER JOIN "
+                                  "show_genres_arr "
+                                  "ON shows."META_DB_ID" = show_genres_arr.OBJ_ID "
+                                  "WHERE show_genres_arr.NAME_ID = ?1 ORDER BY "
+                                  "shows."META_SORT_KEY";",
+                                  append_id_callback, &a, 1, genre_id);
+            return 1;
+            }
+          else
+            return browse_children_series(b, id, &a);
+          }
+      
+        }
+      }
+    }
+
+  return 0;
+  }
+
+static int browse_children(bg_mdb_backend_t * b, const gavl_msg_t * msg)
+  {
+  int i;
+  gavl_array_t children_ids;
+  gavl_array_t children_arr;
+  gavl_value_t val;
+  gavl_time_t time_msg = 0;
+  gavl_time_t current_time = 0;
+  const char * id;
+  //  const char * child_id;
+  gavl_dictionary_t * dict;
+  gavl_dictionary_t * m;
+  int idx;
+  int ret = 0;
+  int start, num;
+  int do_flush = 0;
+
+  int total = 0;
+  int one_answer;
+  sqlite_priv_t * s = b->priv;
+  
+  gavl_time_t start_time = gavl_timer_get(b->db->timer);
+  
+  bg_mdb_get_browse_children_request(msg, &id, &start, &num, &one_answer);
+  
+  gavl_array_init(&children_ids);
+  gavl_array_init(&children_arr);
+
+  if(!browse_children_ids(b, id, &children_ids))
+    goto fail;
+
+  if(!one_answer)
+    do_flush = 1;
+  
+  if(!bg_mdb_adjust_num(start, &num, children_ids.num_entries))
+    goto fail;
+
+  total = children_ids.num_entries;
+  
+  idx = start;
+  
+  for(i = 0; i < num; i++)
+    {
+    /* Load the database objects for the next batch of children at once */
+    if(!(i % PREFETCH_BATCH))
+      prefetch_objects(b, &children_ids, start + i,
+                       (num - i < PREFETCH_BATCH) ? num - i : PREFETCH_BATCH);
+    
+    gavl_value_init(&val);
+
+    dict = gavl_value_set_dictionary(&val);
+
+    gavl_dictionary_copy(dict, gavl_value_get_dictionary(&children_ids.entries[i + start])); 
+
+    /* Siblings are set below, so we don't need browse_object() here */
+    if(!browse_object_internal(b, NULL, dict))
+      goto fail;
+    bg_mdb_add_http_uris(b->db, dict);
+
+    /* Next next and previous sibling */
+    m = gavl_track_get_metadata_nc(dict);
+    
+    if(i + start > 0)
+      {
+      const gavl_dictionary_t * prev_m;
+      
+      if((prev_m = gavl_value_get_dictionary(&children_ids.entries[i+start-1])) &&
+         (prev_m = gavl_track_get_metadata(prev_m)))
+        gavl_dictionary_set_string(m, GAVL_META_PREVIOUS_ID, gavl_dictionary_get_string(prev_m, GAVL_META_ID));
+      }
+    if(i + start < children_ids.num_entries-1)
+      {
+      const gavl_dictionary_t * next_m;
+      
+      if((next_m = gavl_value_get_dictionary(&children_ids.entries[i+start+1])) &&
+         (next_m = gavl_track_get_metadata(next_m)))
+        gavl_dictionary_set_string(m, GAVL_META_NEXT_ID, gavl_dictionary_get_string(next_m, GAVL_META_ID));
+      }
+
+    
+    gavl_array_splice_val_nocopy(&children_arr, -1, 0, &val);
+
+    if(do_flush)
+      {
+      current_time = gavl_timer_get(b->db->timer) - start_time;
+    
+      if(current_time - time_msg > GAVL_TIME_SCALE)
+        {
+        int last = 0;
+        /* Flush objects */
+        gavl_msg_t * res = bg_msg_sink_get(b->ctrl.evt_sink);
+
+        if(idx + children_arr.num_entries == children_ids.num_entries)
+          last = 1;
+        
+        bg_mdb_set_browse_children_response(res, &children_arr, msg, &idx, last, total);
+        bg_msg_sink_put(b->ctrl.evt_sink);
+        time_msg = current_time;
+        gavl_array_reset(&children_arr);
+        }
+      }
+    
+    }
+  
+  
+  /* Flush remaining objects */
+  if(children_arr.num_entries > 0)
+    {
+    gavl_msg_t * res = bg_msg_sink_get(b->ctrl.evt_sink);
+    bg_mdb_set_browse_children_response(res, &children_arr, msg, &idx, 1, total);
+    bg_msg_sink_put(b->ctrl.evt_sink);
+    }
+  
+  ret = 1;
+  fail:
+
+  gavl_dictionary_reset(&s->prefetch);
+  gavl_dictionary_reset(&s->prefetch_types);
+  
+  gavl_array_free(&children_ids);
+  gavl_array_free(&children_arr);
+  
+  return ret;
+  }
+
+/* Search */
+
+static char * search_bind_string(gavl_array_t * vals, const char * str)
+  {
+  gavl_value_t val;
+  gavl_value_init(&val);
+  gavl_value_set_string(&val, str);
+  gavl_array_splice_val_nocopy(vals, -1, 0, &val);
+  return gavl_sprintf("?%d", vals->num_entries);
+  }
+
+static char * search_bind_long(gavl_array_t * vals, int64_t l)
+  {
+  gavl_value_t val;
+  gavl_value_init(&val);
+  gavl_value_set_long(&val, l);
+  gavl_array_splice_val_nocopy(vals, -1, 0, &val);
+  return gavl_sprintf("?%d", vals->num_entries);
+  }
+
+/* FTS5 string: Double quotes are escaped by doubling them */
+
+static char * fts_quote(char * ret, const char * str)
+  {
+  const char * pos;
+  
+  ret = gavl_strcat(ret, "\"");
+  
+  while((pos = strchr(str, '"')))
+    {
+    ret = gavl_strncat(ret, str, pos + 1);
+    ret = gavl_strcat(ret, "\"");
+    str = pos + 1;
+    }
+  ret = gavl_strcat(ret, str);
+  return gavl_strcat(ret, "\"");
+  }
+
+static int has_word_chars(const char * str)
+  {
+  while(*str)
+    {
+    if(isalnum(*str) || (*str & 0x80))
+      return 1;
+    str++;
+    }
+  return 0;
+  }
+
+/* FTS5 query for a column. If phrase is zero, each word must be the prefix
+   of a token (that's the closest we get to substring matching), otherwise
+   the words must appear as a phrase. Returns NULL if there are no words. */
+
+static char * fts_match_expr(const char * col, const char * str, int phrase)
+  {
+  int i;
+  int num = 0;
+  char ** words;
+  char * ret;
+  
+  ret = gavl_sprintf("%s : ", col);
+  
+  if(phrase)
+    {
+    if(has_word_chars(str))
+      return fts_quote(ret, str);
+    free(ret);
+    return NULL;
+    }
+
+  ret = gavl_strcat(ret, "(");
+  
+  words = gavl_strbreak(str, ' ');
+
+  i = 0;
+  while(words && words[i])
+    {
+    if(has_word_chars(words[i]))
+      {
+      if(num)
+        ret = gavl_strcat(ret, " AND ");
+      ret = fts_quote(ret, words[i]);
+      ret = gavl_strcat(ret, "*");
+      num++;
+      }
+    i++;
+    }
+
+  if(words)
+    gavl_strbreak_free(words);
+
+  if(!num)
+    {
+    free(ret);
+    return NULL;
+    }
+  
+  return gavl_strcat(ret, ")");
+  }
+
+static int is_compare_op(const char * op)
+  {
+  return !strcmp(op, BG_MDB_SEARCH_OP_EQUAL) ||
+    !strcmp(op, BG_MDB_SEARCH_OP_NOT_EQUAL) ||
+    !strcmp(op, BG_MDB_SEARCH_OP_LESS) ||
+    !strcmp(op, BG_MDB_SEARCH_OP_LESS_EQUAL) ||
+    !strcmp(op, BG_MDB_SEARCH_OP_GREATER) ||
+    !strcmp(op, BG_MDB_SEARCH_OP_GREATER_EQUAL);
+  }
+
+/* Translate a query (see mdb.h) into an SQL condition. The values are
+   appended to vals as bound parameters */
+
+#define SEARCH_MAX_DEPTH 32
+
+static char * search_to_sql(const gavl_dictionary_t * q, gavl_array_t * vals, int depth)
+  {
+  int i;
+  int idx;
+  const char * op;
+  const char * tag;
+  const char * val;
+  const char * col;
+  char * ret;
+  char * tmp_string;
+  char * arg1;
+  char * arg2;
+  
+  if(!(op = gavl_dictionary_get_string(q, BG_MDB_SEARCH_OP)))
+    return gavl_strdup("1");
+  
+  if(!strcmp(op, BG_MDB_SEARCH_OP_AND) ||
+     !strcmp(op, BG_MDB_SEARCH_OP_OR))
+    {
+    const gavl_array_t * args;
+    const gavl_dictionary_t * arg;
+    int is_and = !strcmp(op, BG_MDB_SEARCH_OP_AND);
+
+    if(depth >= SEARCH_MAX_DEPTH)
+      {
+      gavl_log(GAVL_LOG_ERROR, LOG_DOMAIN, "Search query nested too deeply");
+      return NULL;
+      }
+    
+    if(!(args = gavl_dictionary_get_array(q, BG_MDB_SEARCH_ARGS)) ||
+       !args->num_entries)
+      return gavl_strdup(is_and ? "1" : "0");
+
+    ret = gavl_strdup("(");
+    
+    for(i = 0; i < args->num_entries; i++)
+      {
+      if(!(arg = gavl_value_get_dictionary(&args->entries[i])) ||
+         !(tmp_string = search_to_sql(arg, vals, depth + 1)))
+        {
+        free(ret);
+        return NULL;
+        }
+      if(i)
+        ret = gavl_strcat(ret, is_and ? " AND " : " OR ");
+      ret = gavl_strcat(ret, tmp_string);
+      free(tmp_string);
+      }
+    return gavl_strcat(ret, ")");
+    }
+
+  if(!(tag = gavl_dictionary_get_string(q, BG_MDB_SEARCH_TAG)) ||
+     !(val = gavl_dictionary_get_string(q, BG_MDB_SEARCH_VAL)))
+    {
+    gavl_log(GAVL_LOG_ERROR, LOG_DOMAIN, "Invalid search query");
+    return NULL;
+    }
+
+  idx = fts_get_col(tag);
+  
+  if(!strcmp(op, BG_MDB_SEARCH_OP_EXISTS))
+    {
+    int exists = !strcmp(val, "true");
+
+    if(!strcmp(tag, GAVL_META_CLASS))
+      return gavl_strdup(exists ? "1" : "0");
+    else if(idx < 0)
+      return gavl_strdup(exists ? "0" : "1");
+    else
+      return gavl_sprintf(FTS_TABLE".%s IS %sNULL", fts_cols[idx].col, (exists ? "NOT " : ""));
+    }
+
+  if(!strcmp(tag, GAVL_META_CLASS))
+    {
+    /* Classes not in the database have type 0 and never match */
+    if(!strcmp(op, BG_MDB_SEARCH_OP_EQUAL) || !strcmp(op, BG_MDB_SEARCH_OP_NOT_EQUAL))
+      return gavl_sprintf("objects.TYPE %s %d", op, get_type_id(val));
+    
+    gavl_log(GAVL_LOG_ERROR, LOG_DOMAIN, "Unsupported search operator %s for class", op);
+    return NULL;
+    }
+  
+  if(idx < 0)
+    {
+    gavl_log(GAVL_LOG_ERROR, LOG_DOMAIN, "Searching for %s not supported", tag);
+    return NULL;
+    }
+
+  col = fts_cols[idx].col;
+  
+  if(!strcmp(op, BG_MDB_SEARCH_OP_CONTAINS) ||
+     !strcmp(op, BG_MDB_SEARCH_OP_NOT_CONTAINS))
+    {
+    int contains = !strcmp(op, BG_MDB_SEARCH_OP_CONTAINS);
+    
+    if(fts_cols[idx].flags & FTS_COL_INDEXED)
+      {
+      if(!(tmp_string = fts_match_expr(col, val, 0)))
+        return gavl_strdup(contains ? "1" : "0");
+      
+      arg1 = search_bind_string(vals, tmp_string);
+      ret = gavl_sprintf("objects."META_DB_ID" %sIN (SELECT rowid FROM "FTS_TABLE" WHERE "FTS_TABLE" MATCH %s)",
+                         (contains ? "" : "NOT "), arg1);
+      free(tmp_string);
+      free(arg1);
+      }
+    else
+      {
+      arg1 = search_bind_string(vals, val);
+      ret = gavl_sprintf("coalesce(instr("FTS_TABLE".%s, %s), 0) %s 0",
+                         col, arg1, (contains ? ">" : "="));
+      free(arg1);
+      }
+    return ret;
+    }
+  
+  if(!is_compare_op(op))
+    {
+    gavl_log(GAVL_LOG_ERROR, LOG_DOMAIN, "Unsupported search operator %s", op);
+    return NULL;
+    }
+
+  if(fts_cols[idx].flags & FTS_COL_INT)
+    arg1 = search_bind_long(vals, strtoll(val, NULL, 10));
+  else if((fts_cols[idx].flags & FTS_COL_INDEXED) &&
+          (!strcmp(op, BG_MDB_SEARCH_OP_EQUAL) || !strcmp(op, BG_MDB_SEARCH_OP_NOT_EQUAL)) &&
+          (tmp_string = fts_match_expr(col, val, 1)))
+    {
+    /* Use the index to find the phrase. Columns with multiple values can
+       only be checked for the phrase. */
+    arg1 = search_bind_string(vals, tmp_string);
+    free(tmp_string);
+    
+    if(fts_cols[idx].flags & FTS_COL_MULTI)
+      ret = gavl_sprintf("objects."META_DB_ID" %sIN (SELECT rowid FROM "FTS_TABLE" WHERE "FTS_TABLE" MATCH %s)",
+                         (strcmp(op, BG_MDB_SEARCH_OP_EQUAL) ? "NOT " : ""), arg1);
+    else
+      {
+      arg2 = search_bind_string(vals, val);
+      ret = gavl_sprintf("objects."META_DB_ID" %sIN (SELECT rowid FROM "FTS_TABLE" WHERE "FTS_TABLE" MATCH %s "
+                         "AND %s = %s COLLATE NOCASE)",
+                         (strcmp(op, BG_MDB_SEARCH_OP_EQUAL) ? "NOT " : ""), arg1, col, arg2);
+      free(arg2);
+      }
+    free(arg1);
+    return ret;
+    }
+  else
+    arg1 = search_bind_string(vals, val);
+
+  ret = gavl_sprintf(FTS_TABLE".%s %s %s", col, op, arg1);
+  free(arg1);
+  return ret;
+  }
+
+static char * search_sort_sql(const gavl_array_t * sort)
+  {
+  int i;
+  int idx;
+  int desc;
+  const char * str;
+  char * ret = NULL;
+  char * tmp_string;
+  
+  for(i = 0; i < sort->num_entries; i++)
+    {
+    if(!(str = gavl_string_array_get(sort, i)))
+      continue;
+
+    desc = 0;
+    
+    if(*str == '-')
+      {
+      desc = 1;
+      str++;
+      }
+    else if(*str == '+')
+      str++;
+
+    if((idx = fts_get_col(str)) < 0)
+      {
+      gavl_log(GAVL_LOG_WARNING, LOG_DOMAIN, "Sorting by %s not supported", str);
+      continue;
+      }
+
+    tmp_string = gavl_sprintf(FTS_TABLE".%s%s %s", fts_cols[idx].col,
+                              (fts_cols[idx].flags & FTS_COL_INDEXED) ? " COLLATE strcoll" : "",
+                              desc ? "DESC" : "ASC");
+    if(ret)
+      {
+      ret = gavl_strcat(ret, ", ");
+      ret = gavl_strcat(ret, tmp_string);
+      free(tmp_string);
+      }
+    else
+      ret = tmp_string;
+    }
+
+  if(!ret)
+    ret = gavl_strdup("objects."META_DB_ID);
+  return ret;
+  }
+
+/* First album artist */
+
+static char * get_album_path(bg_mdb_backend_t * b, int64_t album_id)
+  {
+  sqlite3_stmt * st;
+  char * name;
+  char * ret = NULL;
+  sqlite_priv_t * s = b->priv;
+
+  if(!s->albums_id)
+    return NULL;
+  
+  if(!(st = bg_sqlite_stmt_cache_get(s->stmts,
+                                     "SELECT album_artists.ID, album_artists.NAME FROM album_artists "
+                                     "INNER JOIN album_artists_arr ON album_artists.ID = album_artists_arr.NAME_ID "
+                                     "WHERE album_artists_arr.OBJ_ID = ?1 LIMIT 1;")))
+    return NULL;
 
-    }
-  /* series */
-  else if(s->series_id && starts_with(&id, s->series_id))
-    {
-    if(*id == '\0') // /series
-      {
-      append_id(ret, gavl_sprintf("%s/all", s->series_id));
-      append_id(ret, gavl_sprintf("%s/genre", s->series_id));
-      return 1;
-      }
-    else
-      {
-      if(*id != '/')
-        return 0;
-      id++;
+  bg_sqlite_bind_long(st, 1, album_id);
 
-      a.arr       = ret;
-      a.parent_id = id_orig;
+  if((bg_sqlite_step(st) > 0) &&
+     (name = bg_sqlite_get_col_str(st, 1)))
+    {
+    ret = gavl_sprintf("%s/artist/%s/%"PRId64"/%"PRId64, s->albums_id,
+                       bg_mdb_get_group_id(name), (int64_t)sqlite3_column_int64(st, 0), album_id);
+    free(name);
+    }
+  bg_sqlite_stmt_cache_release(s->stmts, st);
+  return ret;
+  }
 
-      if(starts_with(&id, "all"))
-        {
-        if(*id == '\0')
-          {
-          bg_sqlite_exec(s->db,                                         
-                         "SELECT "META_DB_ID" FROM shows ORDER BY "GAVL_META_SEARCH_TITLE, /* SQL to be evaluated */
-                         append_id_callback, &a);
-          return 1;
-          }
-        else
-          {
-          return browse_children_series(b, id, &a);
-          }
-        }
-      else if(starts_with(&id, "genre"))
-        {
-        if(*id == '\0')
-          {
-          bg_sqlite_exec(s->db,                                        
-                         "SELECT ID FROM show_genres ORDER BY NAME", /* SQL to be evaluated */
-                         append_id_callback, &a);
-          return 1;
-          }
-        else if(*id == '/')
-          {
-          id++;
-          genre_id = strtoll(id, &rest, 10);
-        
-          if(id == rest)
-            return 0;
-          id = rest;
+/* Browseable ID of a search result */
 
-          if(*id == '\0')
-            {
-            sql = gavl_sprintf("SELECT shows."META_DB_ID" FROM shows INNER JOIN "
-                             "show_genres_arr "
-                             "ON shows."META_DB_ID" = show_genres_arr.OBJ_ID "
-                             "WHERE show_genres_arr.NAME_ID = %"PRId64" ORDER BY "
-                             "shows."GAVL_META_SEARCH_TITLE" COLLATE strcoll;", genre_id);
-            bg_sqlite_exec(s->db, sql, append_id_callback, &a);  
-            free(sql);
-            return 1;
-            }
-          else
-            return browse_children_series(b, id, &a);
-          }
+static char * get_object_path(bg_mdb_backend_t * b, int64_t id, type_id_t type)
+  {
+  char * ret;
+  char * tmp_string;
+  int64_t parent_id;
+  int64_t show_id;
+  sqlite_priv_t * s = b->priv;
+  
+  switch(type)
+    {
+    case TYPE_SONG:
+      parent_id = bg_sqlite_id_to_id_cached(s->stmts, "songs", META_PARENT_ID, META_DB_ID, id);
       
-        }
-      }
+      if(!(tmp_string = get_album_path(b, parent_id)))
+        return NULL;
+      
+      ret = gavl_sprintf("%s/%"PRId64, tmp_string, id);
+      free(tmp_string);
+      return ret;
+    case TYPE_ALBUM:
+      return get_album_path(b, id);
+    case TYPE_MOVIE:
+      if(s->movies_id)
+        return gavl_sprintf("%s/all/%"PRId64, s->movies_id, id);
+      break;
+    case TYPE_TV_SHOW:
+      if(s->series_id)
+        return gavl_sprintf("%s/all/%"PRId64, s->series_id, id);
+      break;
+    case TYPE_TV_EPISODE:
+      if(!s->series_id)
+        break;
+      parent_id = bg_sqlite_id_to_id_cached(s->stmts, "episodes", META_PARENT_ID, META_DB_ID, id);
+      show_id = bg_sqlite_id_to_id_cached(s->stmts, "seasons", META_PARENT_ID, META_DB_ID, parent_id);
+      return gavl_sprintf("%s/all/%"PRId64"/%"PRId64"/%"PRId64, s->series_id, show_id, parent_id, id);
+    default:
+      break;
     }
+  return NULL;
+  }
+
+static int search_callback(void * data, int argc, char **argv, char **azColName)
+  {
+  bg_sqlite_id_tab_t * tab = data;
 
+  bg_sqlite_id_tab_push(&tab[0], strtoll(argv[0], NULL, 10));
+  bg_sqlite_id_tab_push(&tab[1], strtoll(argv[1], NULL, 10));
   return 0;
   }
 
-static int browse_children(bg_mdb_backend_t * b, const gavl_msg_t * msg)
+static int search_exec(bg_sqlite_stmt_cache_t * stmts, const char * sql, const gavl_array_t * vals,
+                       int (*callback)(void*,int,char**,char**), void * data)
   {
   int i;
-  gavl_array_t children_ids;
-  gavl_array_t children_arr;
-  gavl_value_t val;
-  gavl_time_t time_msg = 0;
-  gavl_time_t current_time = 0;
-  const char * id;
-  //  const char * child_id;
-  gavl_dictionary_t * dict;
-  gavl_dictionary_t * m;
-  int idx;
-  int ret = 0;
-  int start, num;
-  int do_flush = 0;
+  sqlite3_stmt * st;
 
-  int total = 0;
-  int one_answer;
+  if(!(st = bg_sqlite_stmt_cache_get(stmts, sql)))
+    return -1;
   
-  gavl_time_t start_time = gavl_timer_get(b->db->timer);
+  for(i = 0; i < vals->num_entries; i++)
+    bg_sqlite_bind_value(st, i+1, &vals->entries[i]);
+
+  if(!callback)
+    return bg_sqlite_stmt_get_int(stmts, st);
+
+  return bg_sqlite_stmt_exec(stmts, st, callback, data);
+  }
+
+static void search(bg_mdb_backend_t * b, const gavl_msg_t * msg)
+  {
+  int i;
+  int start;
+  int num;
+  int total = 0;
+  char * cond = NULL;
+  char * order;
+  char * sql;
+  char * id;
+  char * tmp_string;
+  gavl_array_t vals;
+  gavl_array_t tracks;
+  const gavl_value_t * arg;
+  const gavl_array_t * sort = NULL;
+  const gavl_dictionary_t * query = NULL;
+  gavl_dictionary_t * dict;
+  gavl_value_t val;
+  gavl_msg_t * res;
+  bg_sqlite_id_tab_t tab[2];
+  sqlite_priv_t * s = b->priv;
+
+  gavl_array_init(&vals);
+  gavl_array_init(&tracks);
+  bg_sqlite_id_tab_init(&tab[0]);
+  bg_sqlite_id_tab_init(&tab[1]);
+
+  if((arg = gavl_msg_get_arg_c(msg, 0)))
+    query = gavl_value_get_dictionary(arg);
+  if((arg = gavl_msg_get_arg_c(msg, 1)))
+    sort = gavl_value_get_array(arg);
   
-  bg_mdb_get_browse_children_request(msg, &id, &start, &num, &one_answer);
+  start = gavl_msg_get_arg_int(msg, 2);
+  num   = gavl_msg_get_arg_int(msg, 3);
+
+  if(start < 0)
+    start = 0;
   
-  gavl_array_init(&children_ids);
-  gavl_array_init(&children_arr);
+  if(!s->have_fts)
+    {
+    gavl_log(GAVL_LOG_ERROR, LOG_DOMAIN, "Cannot search: No full text index");
+    goto end;
+    }
 
-  if(!browse_children_ids(b, id, &children_ids))
-    goto fail;
+  if(!query)
+    cond = gavl_strdup("1");
+  else if(!(cond = search_to_sql(query, &vals, 0)))
+    goto end;
 
-  if(!one_answer)
-    do_flush = 1;
+  /* Total matches */
+  sql = gavl_sprintf("SELECT count(*) FROM objects INNER JOIN "FTS_TABLE" ON "FTS_TABLE".rowid = objects."META_DB_ID" "
+                     "WHERE %s;", cond);
+  total = search_exec(s->stmts, sql, &vals, NULL, NULL);
+  free(sql);
+
+  if(total < 0)
+    {
+    total = 0;
+    goto end;
+    }
   
-  if(!bg_mdb_adjust_num(start, &num, children_ids.num_entries))
-    goto fail;
+  if(!bg_mdb_adjust_num(start, &num, total))
+    goto end;
 
-  total = children_ids.num_entries;
+  /* Page */
+  if(sort)
+    order = search_sort_sql(sort);
+  else
+    order = gavl_strdup("objects."META_DB_ID);
+
+  tmp_string = search_bind_long(&vals, num);
+  free(tmp_string);
+  tmp_string = search_bind_long(&vals, start);
+  free(tmp_string);
   
-  idx = start;
+  sql = gavl_sprintf("SELECT objects."META_DB_ID", objects.TYPE FROM objects INNER JOIN "FTS_TABLE" "
+                     "ON "FTS_TABLE".rowid = objects."META_DB_ID" WHERE %s ORDER BY %s LIMIT ?%d OFFSET ?%d;",
+                     cond, order, vals.num_entries - 1, vals.num_entries);
   
-  for(i = 0; i < num; i++)
+  search_exec(s->stmts, sql, &vals, search_callback, tab);
+  free(sql);
+  free(order);
+  
+  for(i = 0; i < tab[0].num_val; i++)
     {
-    gavl_value_init(&val);
+    if(!(id = get_object_path(b, tab[0].val[i], tab[1].val[i])))
+      continue;
 
+    gavl_value_init(&val);
     dict = gavl_value_set_dictionary(&val);
+    gavl_dictionary_get_dictionary_create(dict, GAVL_META_METADATA);
 
-    gavl_dictionary_move(dict, gavl_value_get_dictionary_nc(&children_ids.entries[i + start])); 
-    
-    if(!browse_object(b, NULL, dict))
-      goto fail;
-
-    /* Next next and previous sibling */
-    m = gavl_track_get_metadata_nc(dict);
-    
-    if(i + start > 0)
-      {
-      const gavl_dictionary_t * prev_m;
-      
-      if((prev_m = gavl_value_get_dictionary(&children_ids.entries[i+start-1])) &&
-         (prev_m = gavl_track_get_metadata(prev_m)))
-        gavl_dictionary_set_string(m, GAVL_META_PREVIOUS_ID, gavl_dictionary_get_string(prev_m, GAVL_META_ID));
-      }
-    if(i + start < children_ids.num_entries-1)
-      {
-      const gavl_dictionary_t * next_m;
-      
-      if((next_m = gavl_value_get_dictionary(&children_ids.entries[i+1])) &&
-         (next_m = gavl_track_get_metadata(next_m)))
-        gavl_dictionary_set_string(m, GAVL_META_NEXT_ID, gavl_dictionary_get_string(next_m, GAVL_META_ID));
-      }
-
-    
-    gavl_array_splice_val_nocopy(&children_arr, -1, 0, &val);
-
-    if(do_flush)
+    if(browse_object_internal(b, id, dict))
       {
-      current_time = gavl_timer_get(b->db->timer) - start_time;
-    
-      if(current_time - time_msg > GAVL_TIME_SCALE)
-        {
-        int last = 0;
-        /* Flush objects */
-        gavl_msg_t * res = bg_msg_sink_get(b->ctrl.evt_sink);
-
-        if(idx + children_arr.num_entries == children_ids.num_entries)
-          last = 1;
-        
-        bg_mdb_set_browse_children_response(res, &children_arr, msg, &idx, last, total);
-        bg_msg_sink_put(b->ctrl.evt_sink);
-        time_msg = current_time;
-        gavl_array_reset(&children_arr);
-        }
+      bg_mdb_add_http_uris(b->db, dict);
+      gavl_array_splice_val_nocopy(&tracks, -1, 0, &val);
       }
-    
+    else
+      gavl_value_free(&val);
+    free(id);
     }
+
+  bg_mdb_tracks_finalize(&tracks, start, total);
   
+  end:
   
-  /* Flush remaining objects */
-  if(children_arr.num_entries > 0)
-    {
-    gavl_msg_t * res = bg_msg_sink_get(b->ctrl.evt_sink);
-    bg_mdb_set_browse_children_response(res, &children_arr, msg, &idx, 1, total);
-    bg_msg_sink_put(b->ctrl.evt_sink);
-    }
-  
-  ret = 1;
-  fail:
+  res = bg_msg_sink_get(b->ctrl.evt_sink);
+  gavl_msg_set_id_ns(res, BG_RESP_DB_SEARCH, BG_MSG_NS_DB);
+  gavl_msg_set_arg_array_nocopy(res, 0, &tracks);
+  gavl_msg_set_arg_int(res, 1, start);
+  gavl_msg_set_arg_int(res, 2, total);
+  gavl_msg_set_resp_for_req(res, msg);
+  bg_msg_sink_put(b->ctrl.evt_sink);
   
-  gavl_array_free(&children_ids);
-  gavl_array_free(&children_arr);
+  if(cond)
+    free(cond);
   
-  return ret;
+  gavl_array_free(&vals);
+  gavl_array_free(&tracks);
+  bg_sqlite_id_tab_free(&tab[0]);
+  bg_sqlite_id_tab_free(&tab[1]);
   }
 
 static int make_thumbnail_callback(void * data, int argc, char **argv, char **azColName)
   {
   bg_mdb_t * mdb = data;
-  bg_mdb_make_thumbnails(mdb, argv[0]);
+  bg_mdb_queue_thumbnails(mdb, argv[0], BG_MDB_THUMBNAIL_PRIORITY_LOW);
   return 0;
   }
 
@@ -6227,6 +8179,9 @@ static int handle_msg_sqlite(void * priv, gavl_msg_t * msg)
         case BG_FUNC_DB_BROWSE_CHILDREN:
           browse_children(be, msg);
           break;
+        case BG_FUNC_DB_SEARCH:
+          search(be, msg);
+          break;
         case BG_FUNC_DB_RESCAN:
           {
           int i;
@@ -6256,6 +8211,7 @@ static int handle_msg_sqlite(void * priv, gavl_msg_t * msg)
           gavl_msg_set_resp_for_req(res, msg);
           bg_msg_sink_put(be->ctrl.evt_sink);
           gavl_log(GAVL_LOG_INFO, LOG_DOMAIN, "Rescan done");
+          bg_sqlite_stmt_cache_log_stats(s->stmts);
           }
           break;
         /* SQL Specific */
@@ -6371,7 +8327,9 @@ static int handle_msg_sqlite(void * priv, gavl_msg_t * msg)
             return 1;
             }
 
-          if(!strcmp(name, "dirs"))
+          if(!strcmp(name, "probe_threads"))
+            gavl_value_get_int(&val, &s->probe_threads);
+          else if(!strcmp(name, "dirs"))
             {
             int i;
             const gavl_array_t * dirs;
@@ -6458,6 +8416,15 @@ static int handle_msg_sqlite(void * priv, gavl_msg_t * msg)
 
 static const bg_parameter_info_t parameters[] =
   {
+    {
+      .name =        "probe_threads",
+      .long_name =   TRS("Scan threads"),
+      .type =        BG_PARAMETER_INT,
+      .val_default = GAVL_VALUE_INIT_INT(0),
+      .val_min     = GAVL_VALUE_INIT_INT(0),
+      .val_max     = GAVL_VALUE_INIT_INT(64),
+      .help_string = TRS("Number of threads, which load the media infos of new files. 0 means one thread per CPU."),
+    },
     {
       .name = "dirs",
       .long_name = TRS("Directories"),
@@ -6627,6 +8594,9 @@ void bg_mdb_create_sqlite(bg_mdb_backend_t * b)
   b->destroy = destroy_sqlite;
 
   bg_sqlite_init_strcoll(priv->db);
+  set_pragmas(priv);
+  
+  priv->stmts = bg_sqlite_stmt_cache_create(priv->db, STMT_CACHE_SIZE);
   
   bg_controllable_init(&b->ctrl,
                        bg_msg_sink_create(handle_msg_sqlite, b, 0),
@@ -6635,7 +8605,15 @@ void bg_mdb_create_sqlite(bg_mdb_backend_t * b)
   if(!exists && !create_tables(b))
     return; // Should not happen if the path is writeable
 
+  if(migrate_schema(b))
+    update_sort_keys(priv);
+
+  init_fts(priv);
+
   create_root_containers(b);
+
+  if((priv->watch = bg_fs_watch_create()))
+    b->ping_func = ping_sqlite;
   }
 
 void bg_mdb_add_sql_directory(bg_controllable_t * db, const char * dir)
@@ -6682,3 +8660,104 @@ void bg_mdb_del_sql_directory_sync(bg_controllable_t * db, const char * dir)
   bg_controllable_call_function(db, &msg, NULL, NULL, 1000*2*3600);
   gavl_msg_free(&msg);
   }
+
+/* Query plans of the standard browse queries */
+
+static const struct
+  {
+  const char * label;
+  const char * sql;
+  }
+explain_queries[] =
+  {
+    { "Songs by artist", SQL_SONGS_BY_ARTIST },
+    { "Artists by genre", SQL_ARTISTS_BY_GENRE },
+    { "Songs by genre and artist", SQL_SONGS_BY_GENRE_ARTIST },
+    { "Song years", SQL_SONG_YEARS },
+    { "Songs by year", SQL_SONGS_BY_YEAR },
+    { "Songs by genre and year", SQL_SONGS_BY_GENRE_YEAR },
+    { "Albums by artist", SQL_ALBUMS_BY_ARTIST },
+    { "Album tracks", SQL_ALBUM_TRACKS },
+    { "Movies by genre", SQL_MOVIES_BY_GENRE },
+    { "Movie parts", SQL_MOVIE_PARTS },
+    { "Episodes of a season", SQL_SEASON_EPISODES },
+    { /* End */ }
+  };
+
+/* Rows of EXPLAIN QUERY PLAN: id, parent, notused, detail */
+
+#define EXPLAIN_MAX_ROWS 64
+
+typedef struct
+  {
+  int num;
+  int id[EXPLAIN_MAX_ROWS];
+  int depth[EXPLAIN_MAX_ROWS];
+  } explain_t;
+
+static int explain_callback(void * data, int argc, char **argv, char **azColName)
+  {
+  int i;
+  int depth = 0;
+  explain_t * e = data;
+  int parent = atoi(argv[1]);
+
+  for(i = e->num - 1; i >= 0; i--)
+    {
+    if(e->id[i] == parent)
+      {
+      depth = e->depth[i] + 1;
+      break;
+      }
+    }
+  
+  if(e->num < EXPLAIN_MAX_ROWS)
+    {
+    e->id[e->num]    = atoi(argv[0]);
+    e->depth[e->num] = depth;
+    e->num++;
+    }
+  
+  printf("  %*s%s\n", 2*depth, "", argv[3]);
+  return 0;
+  }
+
+void bg_mdb_explain_queries(bg_mdb_t * mdb)
+  {
+  int i;
+  char * sql;
+  sqlite3 * db = NULL;
+  explain_t e;
+  
+  sql = gavl_sprintf("%s/db.sqlite", mdb->path);
+
+  if(sqlite3_open_v2(sql, &db, SQLITE_OPEN_READONLY, NULL))
+    {
+    gavl_log(GAVL_LOG_ERROR, LOG_DOMAIN, "Cannot open database %s: %s", sql,
+             sqlite3_errmsg(db));
+    sqlite3_close(db);
+    free(sql);
+    return;
+    }
+  free(sql);
+  
+  bg_sqlite_init_strcoll(db);
+
+  printf("Schema version: %"PRId64"\n\n", bg_sqlite_get_int(db, "PRAGMA user_version;"));
+  
+  i = 0;
+  while(explain_queries[i].label)
+    {
+    printf("%s:\n", explain_queries[i].label);
+    
+    e.num = 0;
+    sql = gavl_sprintf("EXPLAIN QUERY PLAN %s", explain_queries[i].sql);
+    bg_sqlite_exec(db, sql, explain_callback, &e);
+    free(sql);
+
+    printf("\n");
+    i++;
+    }
+  
+  sqlite3_close(db);
+  }
@@ -26,6 +26,8 @@
 #include <sys/stat.h>
 #include <unistd.h>
 #include <string.h>
+#include <time.h>
+#include <pthread.h>
 
 #include <gmerlin/translation.h>
 
@@ -36,6 +38,7 @@
 #include <gmerlin/mdb.h>
 
 #include <gmerlin/utils.h>
+#include <gmerlin/state.h>
 
 #include <mdb_private.h>
 
@@ -45,41 +48,304 @@
 
 /* Create thumbs */
 
-static int make_thumbnail(bg_mdb_t * mdb, int64_t image_id,
-                          const char * filename,
+/* Largest size first, each size is scaled from the previous one */
+
+static const int thumbnail_sizes[] = { 600, 320, 160, 0 };
+
+/* Scale the image like bg_make_thumbnail() does so the result can be
+   passed to it without further scaling */
+
+static void scale_image(gavl_video_frame_t ** f,
+                        gavl_video_format_t * format,
+                        int max_width, int max_height)
+  {
+  double ar;
+  gavl_video_format_t out_format;
+  gavl_video_frame_t * out_frame;
+  gavl_video_converter_t * cnv;
+  
+  ar = (double)format->image_width / (double)format->image_height;
+  
+  gavl_video_format_copy(&out_format, format);
+  
+  if((double)format->image_width / (double)max_width >
+     (double)format->image_height / (double)max_height)
+    {
+    out_format.image_width  = max_width;
+    out_format.image_height = (int)((double)max_width / ar + 0.5);
+    }
+  else
+    {
+    out_format.image_height = max_height;
+    out_format.image_width = (int)((double)max_height * ar + 0.5);
+    }
+  
+  out_format.pixel_width = 1;
+  out_format.pixel_height = 1;
+  out_format.interlace_mode = GAVL_INTERLACE_NONE;
+  out_format.frame_width = out_format.image_width;
+  out_format.frame_height = out_format.image_height;
+
+  cnv = gavl_video_converter_create();
+  gavl_video_options_set_quality(gavl_video_converter_get_options(cnv), 3);
+  
+  if(gavl_video_converter_init(cnv, format, &out_format))
+    {
+    out_frame = gavl_video_frame_create(&out_format);
+    gavl_video_frame_clear(out_frame, &out_format);
+    gavl_video_convert(cnv, *f, out_frame);
+    
+    gavl_video_frame_destroy(*f);
+    *f = out_frame;
+    gavl_video_format_copy(format, &out_format);
+    }
+  
+  gavl_video_converter_destroy(cnv);
+  }
+
+/* Thumbnail queue.
+ *
+ * Requests are deduplicated by filename and served by a pool of workers,
+ * which decode, scale and encode the images without touching the database.
+ * The results are inserted by a single writer thread in batches.
+ */
+
+#define NUM_SIZES   3
+#define HASH_SIZE   1024
+
+#define WRITE_BATCH 64
+#define WRITE_DELAY 500  // Milliseconds to wait for more results
+
+#define JOB_QUEUED  0
+#define JOB_RUNNING 1
+#define JOB_WRITE   2 // Waiting for the writer
+#define JOB_DONE    3 // In the database
+
+#define THUMBNAIL_MIMETYPE "image/jpeg"
+
+typedef struct
+  {
+  int width;
+  int height;
+  char * uri; // Relative to the thumbnail directory
+  } tn_row_t;
+
+typedef struct tn_job_s
+  {
+  char * filename;
+  int priority;
+  int state;
+  int waiters; // Synchronous callers
+
+  /* Results */
+  int64_t image_id;
+  int new_image;
+  int64_t mtime;
+
+  tn_row_t rows[NUM_SIZES];
+  int num_rows;
+  
+  struct tn_job_s * prev;
+  struct tn_job_s * next;
+  struct tn_job_s * hnext; // Hash chain
+  } tn_job_t;
+
+typedef struct
+  {
+  tn_job_t * head;
+  tn_job_t * tail;
+  } job_list_t;
+
+struct bg_mdb_thumbnailer_s
+  {
+  pthread_mutex_t mutex;
+  pthread_cond_t job_cond;   // Signalled for the workers
+  pthread_cond_t write_cond; // Signalled for the writer
+  pthread_cond_t done_cond;  // Signalled for synchronous callers
+
+  job_list_t queue[BG_MDB_THUMBNAIL_NUM_PRIORITIES];
+  job_list_t write;
+  int num_write;
+  
+  tn_job_t * hash[HASH_SIZE];
+
+  /* Progress */
+  int num_pending; // Queued, running or not written yet
+  int num_done;
+  
+  int64_t next_image_id;
+  
+  pthread_t * workers;
+  int num_workers;
+  pthread_t writer;
+  int started;
+  int quit;       // Stop the workers, no new jobs are accepted
+  int write_quit; // Stop the writer after the workers are finished
+  int num_callers; // Synchronous callers in bg_mdb_make_thumbnails()
+  };
+
+static int hash_filename(const char * filename)
+  {
+  uint32_t ret = 5381;
+
+  while(*filename)
+    {
+    ret = ret * 33 + (uint8_t)(*filename);
+    filename++;
+    }
+  return ret & (HASH_SIZE-1);
+  }
+
+static tn_job_t * hash_find(bg_mdb_thumbnailer_t * t, const char * filename)
+  {
+  tn_job_t * job = t->hash[hash_filename(filename)];
+
+  while(job)
+    {
+    if(!strcmp(job->filename, filename))
+      return job;
+    job = job->hnext;
+    }
+  return NULL;
+  }
+
+static void hash_remove(bg_mdb_thumbnailer_t * t, tn_job_t * job)
+  {
+  tn_job_t ** ptr = &t->hash[hash_filename(job->filename)];
+
+  while(*ptr)
+    {
+    if(*ptr == job)
+      {
+      *ptr = job->hnext;
+      break;
+      }
+    ptr = &(*ptr)->hnext;
+    }
+  job->hnext = NULL;
+  }
+
+static void list_append(job_list_t * l, tn_job_t * job)
+  {
+  job->next = NULL;
+  job->prev = l->tail;
+
+  if(l->tail)
+    l->tail->next = job;
+  else
+    l->head = job;
+  l->tail = job;
+  }
+
+static void list_remove(job_list_t * l, tn_job_t * job)
+  {
+  if(job->prev)
+    job->prev->next = job->next;
+  else
+    l->head = job->next;
+
+  if(job->next)
+    job->next->prev = job->prev;
+  else
+    l->tail = job->prev;
+
+  job->prev = NULL;
+  job->next = NULL;
+  }
+
+static void job_free(tn_job_t * job)
+  {
+  int i;
+  for(i = 0; i < job->num_rows; i++)
+    free(job->rows[i].uri);
+  free(job->filename);
+  free(job);
+  }
+
+/* Call with t->mutex locked. Returns the existing job if there is one */
+
+static tn_job_t * add_job(bg_mdb_thumbnailer_t * t, const char * filename, int priority)
+  {
+  tn_job_t * job;
+  int hash;
+  
+  if(priority < 0)
+    priority = 0;
+  else if(priority >= BG_MDB_THUMBNAIL_NUM_PRIORITIES)
+    priority = BG_MDB_THUMBNAIL_NUM_PRIORITIES - 1;
+  
+  if((job = hash_find(t, filename)))
+    {
+    /* Move to the front */
+    if((job->state == JOB_QUEUED) && (priority > job->priority))
+      {
+      list_remove(&t->queue[job->priority], job);
+      job->priority = priority;
+      list_append(&t->queue[job->priority], job);
+      }
+    return job;
+    }
+
+  job = calloc(1, sizeof(*job));
+  job->filename = gavl_strdup(filename);
+  job->priority = priority;
+  job->image_id = -1;
+
+  hash = hash_filename(filename);
+  job->hnext = t->hash[hash];
+  t->hash[hash] = job;
+  
+  list_append(&t->queue[priority], job);
+  t->num_pending++;
+  pthread_cond_signal(&t->job_cond);
+  return job;
+  }
+
+/* Call with t->mutex locked */
+
+static tn_job_t * get_job(bg_mdb_thumbnailer_t * t)
+  {
+  int i;
+  tn_job_t * job;
+  
+  for(i = BG_MDB_THUMBNAIL_NUM_PRIORITIES - 1; i >= 0; i--)
+    {
+    if((job = t->queue[i].head))
+      {
+      list_remove(&t->queue[i], job);
+      job->state = JOB_RUNNING;
+      return job;
+      }
+    }
+  return NULL;
+  }
+
+/* Call with t->mutex locked */
+
+static void job_finished(bg_mdb_thumbnailer_t * t, tn_job_t * job)
+  {
+  job->state = JOB_WRITE;
+  list_append(&t->write, job);
+  t->num_write++;
+  pthread_cond_signal(&t->write_cond);
+  }
+
+static int make_thumbnail(bg_mdb_t * mdb, tn_job_t * job,
                           gavl_video_format_t * format,
                           gavl_video_frame_t ** f,
                           gavl_dictionary_t * metadata,
+                          int orig_width, int orig_height,
                           int width, int height)
   {
   char * tn_file = NULL;
   char * tn_path = NULL;
   char * real_path = NULL;
-  int64_t thumbnail_id = -1;
-  int64_t mimetype_id = -1;
-  char * sql;
   int result = 0;
-  const char * mimetype = "image/jpeg";
-
-  /* Load the file if necessary */
-
-  if(!(*f))
-    {
-    *f = bg_plugin_registry_load_image(bg_plugin_reg,
-                                           filename,
-                                           format, metadata);
-    
-    if(!(*f))
-      {
-      gavl_log(GAVL_LOG_ERROR, LOG_DOMAIN, "Loading %s failed", filename);
-      goto end;
-      }
-    }
   
   /* Don't upscale images */
-  if((format->image_width <= width) ||
-     (format->image_height <= height))
-    goto end;
+  if((orig_width <= width) ||
+     (orig_height <= height))
+    return 1;
 
   /* Make sure the directory exists */
   tn_path = gavl_sprintf("%s/thumbnails/%dx%d", mdb->path, width, height);
@@ -90,8 +356,8 @@ static int make_thumbnail(bg_mdb_t * mdb, int64_t image_id,
   /* */
   
   tn_file = gavl_sprintf("%dx%d/%"PRId64".%s",
-                       width, height, image_id,
-                       bg_mimetype_to_ext(mimetype));
+                       width, height, job->image_id,
+                       bg_mimetype_to_ext(THUMBNAIL_MIMETYPE));
   
   tn_path = gavl_sprintf("%s/thumbnails/%s",
                        mdb->path, tn_file);
@@ -100,35 +366,35 @@ static int make_thumbnail(bg_mdb_t * mdb, int64_t image_id,
    mtime check is done by bg_mdb_purge_thumbnails() */
   
   if(!access(tn_path, R_OK))
+    {
+    result = 1;
     goto end;
+    }
 
+  /* The next smaller size is made from this one */
+  scale_image(f, format, width, height);
   
   real_path = bg_make_thumbnail(*f,
                                 format,
                                 &width, &height,
                                 tn_path,
-                                mimetype, metadata);
+                                THUMBNAIL_MIMETYPE, metadata);
 
   if(!real_path)
+    {
     gavl_log(GAVL_LOG_ERROR, LOG_DOMAIN, "Creating thumbnail failed");
+    goto end;
+    }
   else
     gavl_log(GAVL_LOG_INFO, LOG_DOMAIN, "Created thumbnail %s", real_path);
 
-  mimetype_id = bg_sqlite_string_to_id_add(mdb->thumbnail_db,
-                                           "mimetypes",
-                                           "ID",
-                                           GAVL_META_MIMETYPE,
-                                           mimetype);
-
-  thumbnail_id = bg_sqlite_get_max_int(mdb->thumbnail_db, "thumbnails", "ID")+1;
-  
-  sql = sqlite3_mprintf("INSERT INTO thumbnails "
-                        "(ID, PARENT, "GAVL_META_WIDTH", "GAVL_META_HEIGHT", "META_MIMETYPE_ID", "GAVL_META_URI") VALUES "
-                        "(%"PRId64", %"PRId64", %d, %d, %"PRId64", %Q);", thumbnail_id, image_id, width, height, mimetype_id, tn_file);
+  /* Inserted by the writer */
+  job->rows[job->num_rows].width = width;
+  job->rows[job->num_rows].height = height;
+  job->rows[job->num_rows].uri = tn_file;
+  job->num_rows++;
+  tn_file = NULL;
   
-  bg_sqlite_exec(mdb->thumbnail_db, sql, NULL, NULL);
-  sqlite3_free(sql);
-
   result = 1;
   
   end:
@@ -144,79 +410,80 @@ static int make_thumbnail(bg_mdb_t * mdb, int64_t image_id,
 
   return result;
   }
-  
-void bg_mdb_make_thumbnails(bg_mdb_t * mdb, const char * filename)
+
+/* Decode, scale and encode. Runs in a worker or in a synchronous caller */
+
+static void process_job(bg_mdb_t * mdb, tn_job_t * job)
   {
-  int64_t image_id;
+  int i;
+  int orig_width, orig_height;
   gavl_video_frame_t * in_frame = NULL;
   gavl_video_format_t in_format;
   gavl_dictionary_t metadata;
+  struct stat st;
+  bg_mdb_thumbnailer_t * t = mdb->thumbnailer;
+  
+  if(stat(job->filename, &st))
+    return;
 
-  memset(&in_format, 0, sizeof(in_format));
+  job->mtime = st.st_mtime;
   
+  memset(&in_format, 0, sizeof(in_format));
   gavl_dictionary_init(&metadata);
-
-  if(!strncasecmp(filename, "file://", 7))
-    filename += 7;
-
-  if(strstr(filename, "://"))
-    return;
   
-  pthread_mutex_lock(&mdb->thumbnail_mutex);
-  bg_sqlite_start_transaction(mdb->thumbnail_db);
-    
-  /* Check if the file is already there. */
-
-  image_id = bg_sqlite_string_to_id(mdb->thumbnail_db,
-                                    "images",
-                                    "ID",
-                                    GAVL_META_URI,
-                                    filename);
+  /* Check if the file is already there. New images get their ID here
+     since it's part of the thumbnail filenames */
 
+  pthread_mutex_lock(&mdb->thumbnail_mutex);
   
-  if(image_id < 0)
+  job->image_id = bg_sqlite_string_to_id(mdb->thumbnail_db,
+                                         "images",
+                                         "ID",
+                                         GAVL_META_URI,
+                                         job->filename);
+  if(job->image_id < 0)
     {
-    char * sql;
-    struct stat st;
+    pthread_mutex_lock(&t->mutex);
 
-    if(stat(filename, &st))
-      goto end;
-    
-    /* Create entry */
+    if(t->next_image_id < 0)
+      {
+      t->next_image_id = bg_sqlite_get_max_int(mdb->thumbnail_db, "images", "ID") + 1;
+      if(t->next_image_id < 1)
+        t->next_image_id = 1;
+      }
     
-    image_id = bg_sqlite_get_max_int(mdb->thumbnail_db, "images", "ID") + 1;
-
-    sql = sqlite3_mprintf("INSERT INTO images (ID, "GAVL_META_URI", "GAVL_META_MTIME") VALUES "
-                          "(%"PRId64", %Q, %"PRId64");", image_id, filename, (int64_t)st.st_mtime);
-    bg_sqlite_exec(mdb->thumbnail_db, sql, NULL, NULL);
-    sqlite3_free(sql);
+    job->image_id = t->next_image_id++;
+    job->new_image = 1;
+    pthread_mutex_unlock(&t->mutex);
     }
-
   
-  if(!make_thumbnail(mdb, image_id,
-                     filename,
-                     &in_format, // const gavl_video_format_t * format,
-                     &in_frame, // const gavl_video_frame_t * fr,
-                     &metadata,
-                     160, 160))
-    goto end;
-
-  if(!make_thumbnail(mdb, image_id,
-                     filename,
-                     &in_format, // const gavl_video_format_t * format,
-                     &in_frame, // const gavl_video_frame_t * fr,
-                     &metadata,
-                     320, 320))
-    goto end;
-
-  if(!make_thumbnail(mdb, image_id,
-                     filename,
-                     &in_format, // const gavl_video_format_t * format,
-                     &in_frame, // const gavl_video_frame_t * fr,
-                     &metadata,
-                     600, 600))
+  pthread_mutex_unlock(&mdb->thumbnail_mutex);
+  
+  /* Load the image. Readers, which support it (e.g. JPEG) decode a reduced
+     version, which is still larger than the largest thumbnail */
+  
+  in_frame = bg_plugin_registry_load_image_max(bg_plugin_reg,
+                                               job->filename,
+                                               &in_format, &metadata,
+                                               thumbnail_sizes[0], thumbnail_sizes[0]);
+  if(!in_frame)
+    {
+    gavl_log(GAVL_LOG_ERROR, LOG_DOMAIN, "Loading %s failed", job->filename);
     goto end;
+    }
 
+  orig_width = in_format.image_width;
+  orig_height = in_format.image_height;
+  
+  for(i = 0; thumbnail_sizes[i]; i++)
+    {
+    if(!make_thumbnail(mdb, job,
+                       &in_format, &in_frame,
+                       &metadata,
+                       orig_width, orig_height,
+                       thumbnail_sizes[i], thumbnail_sizes[i]))
+      goto end;
+    }
   
   /*
    *  We *don't check against mtime here since this is done by
@@ -228,13 +495,357 @@ void bg_mdb_make_thumbnails(bg_mdb_t * mdb, const char * filename)
   if(in_frame)
     gavl_video_frame_destroy(in_frame);
   
+  gavl_dictionary_free(&metadata);
+  }
+
+/* Insert the results of a batch of jobs */
+
+static void write_jobs(bg_mdb_t * mdb, tn_job_t * jobs)
+  {
+  int i;
+  char * sql;
+  int64_t mimetype_id;
+  int64_t thumbnail_id;
+  tn_job_t * job;
+  
+  pthread_mutex_lock(&mdb->thumbnail_mutex);
+  bg_sqlite_start_transaction(mdb->thumbnail_db);
+
+  mimetype_id = bg_sqlite_string_to_id_add(mdb->thumbnail_db,
+                                           "mimetypes",
+                                           "ID",
+                                           GAVL_META_MIMETYPE,
+                                           THUMBNAIL_MIMETYPE);
+
+  thumbnail_id = bg_sqlite_get_max_int(mdb->thumbnail_db, "thumbnails", "ID")+1;
+
+  for(job = jobs; job; job = job->next)
+    {
+    if(job->new_image)
+      {
+      sql = sqlite3_mprintf("INSERT INTO images (ID, "GAVL_META_URI", "GAVL_META_MTIME") VALUES "
+                            "(%"PRId64", %Q, %"PRId64");", job->image_id, job->filename, job->mtime);
+      bg_sqlite_exec(mdb->thumbnail_db, sql, NULL, NULL);
+      sqlite3_free(sql);
+      }
+
+    for(i = 0; i < job->num_rows; i++)
+      {
+      sql = sqlite3_mprintf("INSERT INTO thumbnails "
+                            "(ID, PARENT, "GAVL_META_WIDTH", "GAVL_META_HEIGHT", "META_MIMETYPE_ID", "GAVL_META_URI") VALUES "
+                            "(%"PRId64", %"PRId64", %d, %d, %"PRId64", %Q);",
+                            thumbnail_id, job->image_id, job->rows[i].width, job->rows[i].height,
+                            mimetype_id, job->rows[i].uri);
+      bg_sqlite_exec(mdb->thumbnail_db, sql, NULL, NULL);
+      sqlite3_free(sql);
+      thumbnail_id++;
+      }
+    }
+  
   bg_sqlite_end_transaction(mdb->thumbnail_db);
   pthread_mutex_unlock(&mdb->thumbnail_mutex);
+  }
 
-  gavl_dictionary_free(&metadata);
+/* State variable mdb/thumbnails: Dictionary with the number of pending
+   and finished images. The counters are reset when the queue becomes empty. */
+
+static void send_progress(bg_mdb_t * mdb, int pending, int done)
+  {
+  gavl_value_t val;
+  gavl_dictionary_t * dict;
+
+  gavl_value_init(&val);
+  dict = gavl_value_set_dictionary(&val);
+  gavl_dictionary_set_int(dict, "pending", pending);
+  gavl_dictionary_set_int(dict, "done", done);
   
+  bg_state_set(NULL, 1, "mdb", "thumbnails", &val, mdb->ctrl.evt_sink, BG_MSG_STATE_CHANGED);
+  gavl_value_free(&val);
   }
 
+static int write_has_waiters(bg_mdb_thumbnailer_t * t)
+  {
+  tn_job_t * job;
+  for(job = t->write.head; job; job = job->next)
+    {
+    if(job->waiters)
+      return 1;
+    }
+  return 0;
+  }
+
+static void * writer_func(void * data)
+  {
+  tn_job_t * jobs;
+  tn_job_t * job;
+  struct timespec ts;
+  int pending, done;
+  bg_mdb_t * mdb = data;
+  bg_mdb_thumbnailer_t * t = mdb->thumbnailer;
+  
+  pthread_mutex_lock(&t->mutex);
+  
+  while(1)
+    {
+    while(!t->num_write && !t->write_quit)
+      pthread_cond_wait(&t->write_cond, &t->mutex);
+
+    if(!t->num_write)
+      break;
+
+    /* Collect a batch unless someone is waiting for the results */
+    
+    clock_gettime(CLOCK_REALTIME, &ts);
+    ts.tv_nsec += WRITE_DELAY * 1000000L;
+    ts.tv_sec += ts.tv_nsec / 1000000000L;
+    ts.tv_nsec %= 1000000000L;
+    
+    while((t->num_write < WRITE_BATCH) && !t->quit &&
+          !write_has_waiters(t) &&
+          (t->num_write < t->num_pending))
+      {
+      if(pthread_cond_timedwait(&t->write_cond, &t->mutex, &ts))
+        break;
+      }
+    
+    jobs = t->write.head;
+    t->write.head = NULL;
+    t->write.tail = NULL;
+    t->num_write = 0;
+    
+    pthread_mutex_unlock(&t->mutex);
+
+    write_jobs(mdb, jobs);
+    
+    pthread_mutex_lock(&t->mutex);
+
+    while((job = jobs))
+      {
+      jobs = job->next;
+      hash_remove(t, job);
+      job->state = JOB_DONE;
+      job->next = NULL;
+      
+      t->num_pending--;
+      t->num_done++;
+
+      /* Otherwise freed by the waiting thread */
+      if(!job->waiters)
+        job_free(job);
+      }
+    
+    pthread_cond_broadcast(&t->done_cond);
+
+    pending = t->num_pending;
+    done = t->num_done;
+
+    if(!t->num_pending)
+      t->num_done = 0;
+    
+    pthread_mutex_unlock(&t->mutex);
+    send_progress(mdb, pending, done);
+    pthread_mutex_lock(&t->mutex);
+    }
+  
+  pthread_mutex_unlock(&t->mutex);
+  return NULL;
+  }
+
+static void * worker_func(void * data)
+  {
+  tn_job_t * job;
+  bg_mdb_t * mdb = data;
+  bg_mdb_thumbnailer_t * t = mdb->thumbnailer;
+  
+  pthread_mutex_lock(&t->mutex);
+  
+  while(1)
+    {
+    while(!t->quit && !(job = get_job(t)))
+      pthread_cond_wait(&t->job_cond, &t->mutex);
+
+    if(t->quit)
+      break;
+
+    pthread_mutex_unlock(&t->mutex);
+    process_job(mdb, job);
+    pthread_mutex_lock(&t->mutex);
+
+    job_finished(t, job);
+    }
+  
+  pthread_mutex_unlock(&t->mutex);
+  return NULL;
+  }
+
+/* Call with t->mutex locked */
+
+static void start_threads(bg_mdb_t * mdb)
+  {
+  int i;
+  long num;
+  bg_mdb_thumbnailer_t * t = mdb->thumbnailer;
+
+  if(t->started)
+    return;
+  
+  if((num = sysconf(_SC_NPROCESSORS_ONLN)) < 1)
+    num = 1;
+  
+  t->num_workers = num;
+  t->workers = calloc(t->num_workers, sizeof(*t->workers));
+
+  for(i = 0; i < t->num_workers; i++)
+    pthread_create(&t->workers[i], NULL, worker_func, mdb);
+
+  pthread_create(&t->writer, NULL, writer_func, mdb);
+  t->started = 1;
+  }
+
+/* Stop and join the threads. Queued jobs, which were not started yet,
+   are dropped */
+
+static void thumbnailer_stop(bg_mdb_thumbnailer_t * t)
+  {
+  int i;
+  
+  pthread_mutex_lock(&t->mutex);
+  t->quit = 1;
+  pthread_cond_broadcast(&t->job_cond);
+  pthread_cond_broadcast(&t->write_cond);
+  pthread_mutex_unlock(&t->mutex);
+
+  /* Running jobs are finished and written */
+  if(!t->started)
+    return;
+  
+  for(i = 0; i < t->num_workers; i++)
+    pthread_join(t->workers[i], NULL);
+  
+  /* Synchronous callers, which came before the quit flag, can still add
+     jobs for the writer */
+  pthread_mutex_lock(&t->mutex);
+  while(t->num_callers)
+    pthread_cond_wait(&t->done_cond, &t->mutex);
+  
+  t->write_quit = 1;
+  pthread_cond_broadcast(&t->write_cond);
+  pthread_mutex_unlock(&t->mutex);
+  
+  pthread_join(t->writer, NULL);
+  free(t->workers);
+  t->workers = NULL;
+  t->started = 0;
+  }
+
+static void thumbnailer_destroy(bg_mdb_thumbnailer_t * t)
+  {
+  int i;
+  tn_job_t * job;
+
+  thumbnailer_stop(t);
+  
+  for(i = 0; i < BG_MDB_THUMBNAIL_NUM_PRIORITIES; i++)
+    {
+    while((job = t->queue[i].head))
+      {
+      list_remove(&t->queue[i], job);
+      job_free(job);
+      }
+    }
+  
+  pthread_mutex_destroy(&t->mutex);
+  pthread_cond_destroy(&t->job_cond);
+  pthread_cond_destroy(&t->write_cond);
+  pthread_cond_destroy(&t->done_cond);
+  free(t);
+  }
+
+static const char * get_local_filename(const char * filename)
+  {
+  if(!strncasecmp(filename, "file://", 7))
+    filename += 7;
+
+  if(strstr(filename, "://"))
+    return NULL;
+  return filename;
+  }
+
+void bg_mdb_queue_thumbnails(bg_mdb_t * mdb, const char * filename, int priority)
+  {
+  int idle;
+  bg_mdb_thumbnailer_t * t = mdb->thumbnailer;
+  
+  if(!mdb->thumbnail_db || !(filename = get_local_filename(filename)))
+    return;
+
+  pthread_mutex_lock(&t->mutex);
+
+  if(t->quit)
+    {
+    pthread_mutex_unlock(&t->mutex);
+    return;
+    }
+  
+  idle = !t->num_pending;
+  start_threads(mdb);
+  add_job(t, filename, priority);
+  pthread_mutex_unlock(&t->mutex);
+
+  if(idle)
+    send_progress(mdb, 1, 0);
+  }
+
+int bg_mdb_make_thumbnails(bg_mdb_t * mdb, const char * filename)
+  {
+  tn_job_t * job;
+  bg_mdb_thumbnailer_t * t = mdb->thumbnailer;
+  
+  if(!mdb->thumbnail_db || !(filename = get_local_filename(filename)))
+    return 0;
+  
+  pthread_mutex_lock(&t->mutex);
+
+  /* Shutting down */
+  if(t->quit)
+    {
+    pthread_mutex_unlock(&t->mutex);
+    return 0;
+    }
+
+  t->num_callers++;
+  
+  start_threads(mdb);
+  job = add_job(t, filename, BG_MDB_THUMBNAIL_PRIORITY_HIGH);
+  job->waiters++;
+  
+  /* Don't wait for a worker, do it ourselves */
+  if(job->state == JOB_QUEUED)
+    {
+    list_remove(&t->queue[job->priority], job);
+    job->state = JOB_RUNNING;
+    
+    pthread_mutex_unlock(&t->mutex);
+    process_job(mdb, job);
+    pthread_mutex_lock(&t->mutex);
+
+    job_finished(t, job);
+    }
+
+  while(job->state != JOB_DONE)
+    pthread_cond_wait(&t->done_cond, &t->mutex);
+  
+  job->waiters--;
+  if(!job->waiters)
+    job_free(job);
+
+  t->num_callers--;
+  if(!t->num_callers)
+    pthread_cond_broadcast(&t->done_cond);
+  
+  pthread_mutex_unlock(&t->mutex);
+  return 1;
+  }
 
 typedef struct
   {
@@ -365,8 +976,17 @@ void bg_mdb_clear_thumbnail_uris(gavl_dictionary_t * track)
 /* Global funcs */
 
 /* Delete thumbnails for a particular file */
+void bg_mdb_stop_thumbnails(bg_mdb_t * mdb)
+  {
+  if(mdb->thumbnailer)
+    thumbnailer_stop(mdb->thumbnailer);
+  }
+
 void bg_mdb_cleanup_thumbnails(bg_mdb_t * mdb)
   {
+  if(mdb->thumbnailer)
+    thumbnailer_destroy(mdb->thumbnailer);
+  
   pthread_mutex_destroy(&mdb->thumbnail_mutex);
   sqlite3_close(mdb->thumbnail_db);
   }
@@ -393,6 +1013,13 @@ void bg_mdb_init_thumbnails(bg_mdb_t * mdb)
   int result;
   pthread_mutex_init(&mdb->thumbnail_mutex, NULL);
 
+  mdb->thumbnailer = calloc(1, sizeof(*mdb->thumbnailer));
+  pthread_mutex_init(&mdb->thumbnailer->mutex, NULL);
+  pthread_cond_init(&mdb->thumbnailer->job_cond, NULL);
+  pthread_cond_init(&mdb->thumbnailer->write_cond, NULL);
+  pthread_cond_init(&mdb->thumbnailer->done_cond, NULL);
+  mdb->thumbnailer->next_image_id = -1;
+
   mdb->thumbs_dir = gavl_sprintf("%s/thumbnails", mdb->path);
   gavl_ensure_directory(mdb->thumbs_dir, 0);
 
@@ -31,6 +31,7 @@ static gavl_source_status_t process_video(bg_media_source_stream_t * st, gavl_ti
 static gavl_source_status_t process_video_noncont(bg_media_source_stream_t * st, gavl_time_t t);
 static gavl_source_status_t process_packet(bg_media_source_stream_t * st, gavl_time_t t);
 static gavl_source_status_t process_packet_noncont(bg_media_source_stream_t * st, gavl_time_t t);
+static void queue_destroy(bg_encoder_queue_t * q);
 
 int bg_media_encoder_init(bg_media_source_t * src,
                           bg_plugin_handle_t * h)
@@ -263,21 +264,37 @@ static void free_encoder(void * priv)
   {
   bg_encoder_t * s = priv;
   pthread_mutex_destroy(&s->mutex);
+  pthread_mutex_destroy(&s->read_mutex);
+  pthread_mutex_destroy(&s->write_mutex);
+  pthread_mutex_destroy(&s->noncont_mutex);
+  pthread_cond_destroy(&s->cond);
   free(s);
   }
 
 static bg_encoder_t * get_common(bg_media_source_t * src)
   {
   bg_encoder_t * ret;
-
+  pthread_mutexattr_t attr;
+  
   if(src->user_data)
     return src->user_data;
   
   ret = calloc(1, sizeof(*ret));
 
+  /* Demultiplexers might read packets of other streams while we hold the lock */
+  pthread_mutexattr_init(&attr);
+  pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+  
   pthread_mutex_init(&ret->mutex, NULL);
+  pthread_mutex_init(&ret->read_mutex, &attr);
+  pthread_mutex_init(&ret->write_mutex, NULL);
+  pthread_mutex_init(&ret->noncont_mutex, NULL);
+
+  pthread_mutexattr_destroy(&attr);
+  pthread_cond_init(&ret->cond, NULL);
 
   ret->time = GAVL_TIME_UNDEFINED;
+  ret->src = src;
   
   src->user_data = ret;
   src->free_user_data = free_encoder;
@@ -289,6 +306,8 @@ static void free_encoder_stream(void * priv)
   bg_encoder_stream_t * s = priv;
   
   gavl_compression_info_free(&s->ci);
+  if(s->q)
+    queue_destroy(s->q);
   free(s);
   }
 
@@ -658,6 +677,11 @@ int bg_media_encoder_connect(bg_media_source_t * enc_src,
       case GAVL_STREAM_NONE:
         break;
       }
+
+    if((st->type != GAVL_STREAM_MSG) && (st->type != GAVL_STREAM_NONE) &&
+       (s->asink || s->vsink) &&
+       !(h->plugin->flags & BG_PLUGIN_THREADED_ENCODING))
+      s->flags |= BG_ENCODER_STREAM_LOCK_WRITE;
     }
 
   /* Negotiate formats */
@@ -666,6 +690,47 @@ int bg_media_encoder_connect(bg_media_source_t * enc_src,
   return 1;
   }
 
+/*
+ *  Packet sinks only multiplex, so in multithreaded mode they are
+ *  serialized by write_mutex. Frame sinks also encode, they are only
+ *  serialized if the plugin doesn't support BG_PLUGIN_THREADED_ENCODING.
+ */
+
+static gavl_sink_status_t put_audio_frame(bg_encoder_stream_t * s, gavl_audio_frame_t * f)
+  {
+  gavl_sink_status_t ret;
+
+  if(!(s->flags & BG_ENCODER_STREAM_LOCK_WRITE))
+    return gavl_audio_sink_put_frame(s->asink, f);
+  
+  pthread_mutex_lock(&s->com->write_mutex);
+  ret = gavl_audio_sink_put_frame(s->asink, f);
+  pthread_mutex_unlock(&s->com->write_mutex);
+  return ret;
+  }
+
+static gavl_sink_status_t put_video_frame(bg_encoder_stream_t * s, gavl_video_frame_t * f)
+  {
+  gavl_sink_status_t ret;
+
+  if(!(s->flags & BG_ENCODER_STREAM_LOCK_WRITE))
+    return gavl_video_sink_put_frame(s->vsink, f);
+  
+  pthread_mutex_lock(&s->com->write_mutex);
+  ret = gavl_video_sink_put_frame(s->vsink, f);
+  pthread_mutex_unlock(&s->com->write_mutex);
+  return ret;
+  }
+
+static gavl_sink_status_t put_packet(bg_encoder_stream_t * s, gavl_packet_t * p)
+  {
+  gavl_sink_status_t ret;
+  pthread_mutex_lock(&s->com->write_mutex);
+  ret = gavl_packet_sink_put_packet(s->psink, p);
+  pthread_mutex_unlock(&s->com->write_mutex);
+  return ret;
+  }
+
 static gavl_source_status_t process_audio(bg_media_source_stream_t * st, gavl_time_t t)
   {
   gavl_source_status_t result;
@@ -685,7 +750,7 @@ static gavl_source_status_t process_audio(bg_media_source_stream_t * st, gavl_ti
   
   s->time = gavl_time_unscale(s->dst_scale, f->timestamp + f->valid_samples);
         
-  if(gavl_audio_sink_put_frame(s->asink, f) == GAVL_SINK_OK)
+  if(put_audio_frame(s, f) == GAVL_SINK_OK)
     return GAVL_SOURCE_OK;
   else
     return GAVL_SOURCE_EOF;
@@ -712,7 +777,7 @@ static gavl_source_status_t process_video(bg_media_source_stream_t * st, gavl_ti
                                   0, 0);
 
   
-  if(gavl_video_sink_put_frame(s->vsink, f) == GAVL_SINK_OK)
+  if(put_video_frame(s, f) == GAVL_SINK_OK)
     return GAVL_SOURCE_OK;
   else
     return GAVL_SOURCE_EOF;
@@ -745,7 +810,7 @@ static gavl_source_status_t process_packet(bg_media_source_stream_t * st, gavl_t
                                   s->p->buf.len, s->p->flags);
 
   
-  if(gavl_packet_sink_put_packet(s->psink, s->p) != GAVL_SINK_OK)
+  if(put_packet(s, s->p) != GAVL_SINK_OK)
     {
     s->p = NULL;
     return GAVL_SOURCE_EOF;
@@ -779,7 +844,7 @@ static gavl_source_status_t process_packet(bg_media_source_stream_t * st, gavl_t
         break;
         }
 
-      if(gavl_packet_sink_put_packet(s->psink, s->p) != GAVL_SINK_OK)
+      if(put_packet(s, s->p) != GAVL_SINK_OK)
         {
         s->p = NULL;
         return GAVL_SOURCE_EOF;
@@ -830,7 +895,7 @@ static gavl_source_status_t process_packet_noncont(bg_media_source_stream_t * st
     return GAVL_SOURCE_AGAIN;
 
     
-  if(gavl_packet_sink_put_packet(s->psink, s->p) == GAVL_SINK_OK)
+  if(put_packet(s, s->p) == GAVL_SINK_OK)
     result = GAVL_SOURCE_OK;
   else
     result = GAVL_SOURCE_EOF;
@@ -878,7 +943,7 @@ static gavl_source_status_t process_video_noncont(bg_media_source_stream_t * st,
      ((t != GAVL_TIME_UNDEFINED) && (s->time - t > GAVL_TIME_SCALE/2)))
     return GAVL_SOURCE_AGAIN;
   
-  if(gavl_video_sink_put_frame(s->vsink, s->vframe) == GAVL_SINK_OK)
+  if(put_video_frame(s, s->vframe) == GAVL_SINK_OK)
     result = GAVL_SOURCE_OK;
   else
     result = GAVL_SOURCE_EOF;
@@ -974,12 +1039,383 @@ gavl_source_status_t bg_media_encoder_process(bg_media_source_t * src, gavl_time
   return GAVL_SOURCE_OK;
   }
 
+/*
+ *  Multithreaded mode
+ *
+ *  Each continuous stream is encoded in its own thread. With
+ *  BG_ENCODER_SYNC_READ, the decoded A/V streams get an additional
+ *  thread, which reads (decodes and filters) the frames into a small
+ *  queue.
+ *
+ *  All streams share one demultiplexer, so reading packets from the
+ *  input is serialized by read_mutex, which is installed as lock function
+ *  of the input packet sources (see bg_media_encoder_set_input()).
+ *  Decoding, filtering and encoding run outside this lock. Only streams,
+ *  which are decoded by the input plugin itself
+ *  (BG_ENCODER_STREAM_LOCK_READ), read their frames under read_mutex.
+ *
+ *  Multiplexing is serialized by write_mutex (see put_packet()).
+ */
+
+/* Maximum time difference between the continuous streams (BG_ENCODER_SYNC_INTERLEAVE) */
+#define MAX_SKEW      (GAVL_TIME_SCALE/2)
+
+/* Decoded frames between reading and encoding */
+#define QUEUE_FRAMES  4
+
+struct bg_encoder_queue_s
+  {
+  gavl_audio_frame_t * aframes[QUEUE_FRAMES];
+  gavl_video_frame_t * vframes[QUEUE_FRAMES];
+
+  gavl_audio_format_t afmt;
+  gavl_video_format_t vfmt;
+  
+  int start;  // First ready frame
+  int num;    // Number of ready frames
+  int eof;    // Set by the reader on EOF or by the encoder when it stops
+  
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;
+  pthread_t th;
+  };
+
+static int is_running(bg_encoder_t * com)
+  {
+  int ret;
+  pthread_mutex_lock(&com->mutex);
+  ret = (com->state == BG_ENCODER_STATE_RUNNING);
+  pthread_mutex_unlock(&com->mutex);
+  return ret;
+  }
+
+static bg_encoder_queue_t * queue_create(bg_media_source_stream_t * st)
+  {
+  int i;
+  bg_encoder_queue_t * ret;
+  bg_encoder_stream_t * s = st->user_data;
+
+  if(st->asrc)
+    {
+    ret = calloc(1, sizeof(*ret));
+    gavl_audio_format_copy(&ret->afmt, gavl_audio_sink_get_format(s->asink));
+
+    for(i = 0; i < QUEUE_FRAMES; i++)
+      ret->aframes[i] = gavl_audio_frame_create(&ret->afmt);
+    }
+  else if(st->vsrc)
+    {
+    const gavl_video_format_t * vfmt = gavl_video_sink_get_format(s->vsink);
+
+    /* Hardware frames are encoded directly */
+    if(vfmt->hwctx)
+      return NULL;
+    
+    ret = calloc(1, sizeof(*ret));
+    gavl_video_format_copy(&ret->vfmt, vfmt);
+    
+    for(i = 0; i < QUEUE_FRAMES; i++)
+      ret->vframes[i] = gavl_video_frame_create(&ret->vfmt);
+    }
+  else
+    return NULL;
+  
+  pthread_mutex_init(&ret->mutex, NULL);
+  pthread_cond_init(&ret->cond, NULL);
+  return ret;
+  }
+
+static void queue_destroy(bg_encoder_queue_t * q)
+  {
+  int i;
+
+  for(i = 0; i < QUEUE_FRAMES; i++)
+    {
+    if(q->aframes[i])
+      gavl_audio_frame_destroy(q->aframes[i]);
+    if(q->vframes[i])
+      gavl_video_frame_destroy(q->vframes[i]);
+    }
+  pthread_mutex_destroy(&q->mutex);
+  pthread_cond_destroy(&q->cond);
+  free(q);
+  }
+
+static void queue_set_eof(bg_encoder_queue_t * q)
+  {
+  pthread_mutex_lock(&q->mutex);
+  q->eof = 1;
+  pthread_cond_broadcast(&q->cond);
+  pthread_mutex_unlock(&q->mutex);
+  }
+
+/* Get the next ready frame or -1 on EOF */
+static int queue_get(bg_encoder_stream_t * s)
+  {
+  int ret = -1;
+  bg_encoder_queue_t * q = s->q;
+  
+  pthread_mutex_lock(&q->mutex);
+
+  while(!q->num && !q->eof && is_running(s->com))
+    pthread_cond_wait(&q->cond, &q->mutex);
+
+  if(q->num)
+    ret = q->start;
+  
+  pthread_mutex_unlock(&q->mutex);
+  return ret;
+  }
+
+static void queue_advance(bg_encoder_queue_t * q)
+  {
+  pthread_mutex_lock(&q->mutex);
+  q->start = (q->start + 1) % QUEUE_FRAMES;
+  q->num--;
+  pthread_cond_broadcast(&q->cond);
+  pthread_mutex_unlock(&q->mutex);
+  }
+
+static void * reader_thread(void * data)
+  {
+  int idx;
+  gavl_source_status_t result;
+  bg_media_source_stream_t * st = data;
+  bg_encoder_stream_t * s = st->user_data;
+  bg_encoder_queue_t * q = s->q;
+  
+  while(1)
+    {
+    /* Wait for a free frame */
+    pthread_mutex_lock(&q->mutex);
+
+    while((q->num == QUEUE_FRAMES) && !q->eof && is_running(s->com))
+      pthread_cond_wait(&q->cond, &q->mutex);
+
+    if(q->eof || !is_running(s->com))
+      {
+      pthread_mutex_unlock(&q->mutex);
+      break;
+      }
+    
+    /* The encoder never touches this one before we increment q->num */
+    idx = (q->start + q->num) % QUEUE_FRAMES;
+    pthread_mutex_unlock(&q->mutex);
+
+    if(s->flags & BG_ENCODER_STREAM_LOCK_READ)
+      pthread_mutex_lock(&s->com->read_mutex);
+    
+    if(st->asrc)
+      result = gavl_audio_source_read_frame(st->asrc, &q->aframes[idx]);
+    else
+      result = gavl_video_source_read_frame(st->vsrc, &q->vframes[idx]);
+
+    if(s->flags & BG_ENCODER_STREAM_LOCK_READ)
+      pthread_mutex_unlock(&s->com->read_mutex);
+
+    if(result == GAVL_SOURCE_AGAIN)
+      continue;
+    
+    if(result != GAVL_SOURCE_OK)
+      {
+      queue_set_eof(q);
+      break;
+      }
+    
+    pthread_mutex_lock(&q->mutex);
+    q->num++;
+    pthread_cond_broadcast(&q->cond);
+    pthread_mutex_unlock(&q->mutex);
+    }
+  return NULL;
+  }
+
+static gavl_source_status_t process_audio_queue(bg_media_source_stream_t * st, gavl_time_t t)
+  {
+  int idx;
+  gavl_sink_status_t result;
+  gavl_audio_frame_t * in;
+  gavl_audio_frame_t * f;
+  bg_encoder_stream_t * s = st->user_data;
+
+  if((idx = queue_get(s)) < 0)
+    return GAVL_SOURCE_EOF;
+
+  in = s->q->aframes[idx];
+
+  if((f = gavl_audio_sink_get_frame(s->asink)))
+    {
+    gavl_audio_frame_copy(&s->q->afmt, f, in, 0, 0,
+                          in->valid_samples, in->valid_samples);
+    f->valid_samples = in->valid_samples;
+    f->timestamp = in->timestamp;
+    }
+  else
+    f = in;
+  
+  gavl_stream_stats_update_params(&s->stats, f->timestamp, f->valid_samples,
+                                  0, 0);
+  
+  s->time = gavl_time_unscale(s->dst_scale, f->timestamp + f->valid_samples);
+
+  result = put_audio_frame(s, f);
+  queue_advance(s->q);
+  
+  if(result == GAVL_SINK_OK)
+    return GAVL_SOURCE_OK;
+  else
+    return GAVL_SOURCE_EOF;
+  }
+
+static gavl_source_status_t process_video_queue(bg_media_source_stream_t * st, gavl_time_t t)
+  {
+  int idx;
+  gavl_sink_status_t result;
+  gavl_video_frame_t * in;
+  gavl_video_frame_t * f;
+  bg_encoder_stream_t * s = st->user_data;
+
+  if((idx = queue_get(s)) < 0)
+    return GAVL_SOURCE_EOF;
+
+  in = s->q->vframes[idx];
+
+  if((f = gavl_video_sink_get_frame(s->vsink)))
+    {
+    gavl_video_frame_copy(&s->q->vfmt, f, in);
+    gavl_video_frame_copy_metadata(f, in);
+    }
+  else
+    f = in;
+
+  s->time = gavl_time_unscale(s->dst_scale, f->timestamp + f->duration);
+
+  gavl_stream_stats_update_params(&s->stats, f->timestamp, f->duration,
+                                  0, 0);
+  
+  result = put_video_frame(s, f);
+  queue_advance(s->q);
+  
+  if(result == GAVL_SINK_OK)
+    return GAVL_SOURCE_OK;
+  else
+    return GAVL_SOURCE_EOF;
+  }
+
+/* Smallest time of the unfinished continuous streams except skip.
+   Call with com->mutex locked */
+
+static gavl_time_t get_min_time(bg_encoder_t * com, bg_encoder_stream_t * skip)
+  {
+  int i;
+  bg_encoder_stream_t * s;
+  gavl_time_t ret = GAVL_TIME_UNDEFINED;
+  
+  for(i = 0; i < com->src->num_streams; i++)
+    {
+    if((com->src->streams[i]->action == BG_STREAM_ACTION_OFF) ||
+       (com->src->streams[i]->type == GAVL_STREAM_MSG))
+      continue;
+
+    s = com->src->streams[i]->user_data;
+
+    if((s == skip) || s->sync_eof)
+      continue;
+    
+    if((ret == GAVL_TIME_UNDEFINED) || (s->sync_time < ret))
+      ret = s->sync_time;
+    }
+  return ret;
+  }
+
+/* Don't run ahead of the other streams */
+
+static void interleave_wait(bg_encoder_stream_t * s)
+  {
+  gavl_time_t min_time;
+  
+  pthread_mutex_lock(&s->com->mutex);
+
+  while(s->com->state == BG_ENCODER_STATE_RUNNING)
+    {
+    min_time = get_min_time(s->com, s);
+    
+    if((min_time == GAVL_TIME_UNDEFINED) ||
+       (s->sync_time <= min_time + MAX_SKEW))
+      break;
+    
+    pthread_cond_wait(&s->com->cond, &s->com->mutex);
+    }
+  
+  pthread_mutex_unlock(&s->com->mutex);
+  }
+
+static void sync_update(bg_encoder_stream_t * s, int eof)
+  {
+  pthread_mutex_lock(&s->com->mutex);
+  s->sync_time = s->time;
+  if(eof)
+    s->sync_eof = 1;
+  pthread_cond_broadcast(&s->com->cond);
+  pthread_mutex_unlock(&s->com->mutex);
+  }
+
+/* Flush the non-continuous streams up to the slowest continuous one.
+   If all continuous streams are finished, flush everything. */
+
+static void flush_noncont(bg_encoder_t * com)
+  {
+  int i;
+  gavl_time_t t;
+  bg_encoder_stream_t * s;
+  gavl_source_status_t result;
+  
+  pthread_mutex_lock(&com->mutex);
+  t = get_min_time(com, NULL);
+  pthread_mutex_unlock(&com->mutex);
+
+  /* Another thread is already flushing. The final flush must not be skipped. */
+  if(t == GAVL_TIME_UNDEFINED)
+    pthread_mutex_lock(&com->noncont_mutex);
+  else if(pthread_mutex_trylock(&com->noncont_mutex))
+    return;
+  
+  for(i = 0; i < com->src->num_streams; i++)
+    {
+    if(com->src->streams[i]->action == BG_STREAM_ACTION_OFF)
+      continue;
+    
+    s = com->src->streams[i]->user_data;
+    if((s->flags & (BG_ENCODER_STREAM_NONCONT | BG_ENCODER_STREAM_EOF)) !=
+       BG_ENCODER_STREAM_NONCONT)
+      continue;
+
+    do
+      {
+      if(s->flags & BG_ENCODER_STREAM_LOCK_READ)
+        pthread_mutex_lock(&com->read_mutex);
+      
+      result = bg_media_encoder_process_stream(com->src->streams[i], t);
+
+      if(s->flags & BG_ENCODER_STREAM_LOCK_READ)
+        pthread_mutex_unlock(&com->read_mutex);
+      
+      } while((t == GAVL_TIME_UNDEFINED) && (result == GAVL_SOURCE_OK));
+    }
+  
+  pthread_mutex_unlock(&com->noncont_mutex);
+  }
+
 static void * encoder_stream_thread(void * data)
   {
   gavl_source_status_t result = GAVL_SOURCE_OK;
   bg_media_source_stream_t * st = data;
   bg_encoder_stream_t * s = st->user_data;
 
+  int lock_read   = (s->flags & BG_ENCODER_STREAM_LOCK_READ) && !s->q;
+  int interleave  = (s->com->flags & BG_ENCODER_SYNC_INTERLEAVE) &&
+    !(s->flags & BG_ENCODER_STREAM_NONCONT);
+  
   pthread_barrier_wait(&s->com->barrier);
   
   while(1)
@@ -992,11 +1428,31 @@ static void * encoder_stream_thread(void * data)
     if(result == GAVL_SOURCE_EOF)
       break;
 
+    if(interleave)
+      interleave_wait(s);
+    
+    if(lock_read)
+      pthread_mutex_lock(&s->com->read_mutex);
+    
     result = bg_media_encoder_process_stream(st, GAVL_TIME_UNDEFINED);
 
+    if(lock_read)
+      pthread_mutex_unlock(&s->com->read_mutex);
+
+    sync_update(s, result == GAVL_SOURCE_EOF);
+    
+    if(s->com->num_noncont)
+      flush_noncont(s->com);
+    
     if(result == GAVL_SOURCE_EOF)
       break;
     }
+
+  sync_update(s, 1);
+
+  /* Let the reader finish */
+  if(s->q)
+    queue_set_eof(s->q);
   
   pthread_mutex_lock(&s->com->mutex);
   s->com->num_threads--;
@@ -1008,6 +1464,99 @@ static void * encoder_stream_thread(void * data)
   
   } 
 
+void bg_media_encoder_set_flags(bg_media_source_t * src, int flags)
+  {
+  bg_encoder_t * enc = src->user_data;
+  enc->flags = flags;
+  }
+
+void bg_media_encoder_set_input(bg_media_source_t * src, bg_media_source_t * input)
+  {
+  bg_encoder_t * enc = src->user_data;
+  enc->input = input;
+  }
+
+static void read_lock(void * priv)
+  {
+  bg_encoder_t * enc = priv;
+  pthread_mutex_lock(&enc->read_mutex);
+  }
+
+static void read_unlock(void * priv)
+  {
+  bg_encoder_t * enc = priv;
+  pthread_mutex_unlock(&enc->read_mutex);
+  }
+
+/* Packet source of the input, which is read by a codec plugin or directly
+   by the encoder */
+
+static gavl_packet_source_t * get_input_psrc(bg_encoder_t * enc, int idx)
+  {
+  bg_media_source_stream_t * st;
+  
+  if(!enc->input || (idx >= enc->input->num_streams))
+    return NULL;
+
+  st = enc->input->streams[idx];
+
+  if((st->type != enc->src->streams[idx]->type) ||
+     (st->action == BG_STREAM_ACTION_OFF) ||
+     ((st->action == BG_STREAM_ACTION_DECODE) && !st->codec_handle))
+    return NULL;
+  
+  return st->psrc;
+  }
+
+/* Serialize reading from the demultiplexer */
+
+static void set_read_locks(bg_encoder_t * enc, int set)
+  {
+  int i;
+  bg_encoder_stream_t * s;
+  gavl_packet_source_t * psrc;
+  
+  for(i = 0; i < enc->src->num_streams; i++)
+    {
+    if((enc->src->streams[i]->action == BG_STREAM_ACTION_OFF) ||
+       (enc->src->streams[i]->type == GAVL_STREAM_MSG))
+      continue;
+
+    s = enc->src->streams[i]->user_data;
+    
+    if(set)
+      {
+      if((psrc = get_input_psrc(enc, i)))
+        gavl_packet_source_set_lock_funcs(psrc, read_lock, read_unlock, enc);
+      else
+        s->flags |= BG_ENCODER_STREAM_LOCK_READ;
+      }
+    else
+      {
+      if((psrc = get_input_psrc(enc, i)))
+        gavl_packet_source_set_lock_funcs(psrc, NULL, NULL, NULL);
+      s->flags &= ~BG_ENCODER_STREAM_LOCK_READ;
+      }
+    }
+  }
+
+/* Streams, which run in an own encoder thread */
+
+static int has_thread(bg_encoder_t * enc, bg_media_source_stream_t * st)
+  {
+  bg_encoder_stream_t * s;
+  
+  if((st->action == BG_STREAM_ACTION_OFF) ||
+     (st->type == GAVL_STREAM_MSG))
+    return 0;
+
+  s = st->user_data;
+  
+  if(enc->num_noncont && (s->flags & BG_ENCODER_STREAM_NONCONT))
+    return 0;
+
+  return 1;
+  }
 
 void bg_media_encoder_start(bg_media_source_t * src)
   {
@@ -1015,17 +1564,69 @@ void bg_media_encoder_start(bg_media_source_t * src)
   int i;
   bg_encoder_stream_t * s;
   bg_encoder_t * enc = src->user_data;
-
+  int num_readers = 0;
+  
+  enc->num_threads = 0;
+  enc->num_noncont = 0;
+  
   for(i = 0; i < src->num_streams; i++)
     {
     if((src->streams[i]->action == BG_STREAM_ACTION_OFF) ||
        (src->streams[i]->type == GAVL_STREAM_MSG))
       continue;
-    enc->num_threads++;
+
+    s = src->streams[i]->user_data;
+    s->sync_time = s->time;
+    s->sync_eof = 0;
+    
+    if(s->flags & BG_ENCODER_STREAM_NONCONT)
+      {
+      s->sync_eof = 1;
+      enc->num_noncont++;
+      }
+    else
+      enc->num_threads++;
+    }
+
+  /*
+   *  Non-continuous streams are flushed by the continuous threads
+   *  when reading is serialized. Otherwise (or if there is nothing else)
+   *  they get their own threads.
+   */
+  
+  if(!(enc->flags & BG_ENCODER_SYNC_READ) || !enc->num_threads)
+    {
+    enc->num_threads += enc->num_noncont;
+    enc->num_noncont = 0;
     }
+  
+  if(enc->flags & BG_ENCODER_SYNC_READ)
+    {
+    set_read_locks(enc, 1);
+    
+    for(i = 0; i < src->num_streams; i++)
+      {
+      if(!has_thread(enc, src->streams[i]))
+        continue;
+      
+      s = src->streams[i]->user_data;
+      
+      if((s->flags & BG_ENCODER_STREAM_NONCONT) ||
+         !(s->q = queue_create(src->streams[i])))
+        continue;
+
+      if(src->streams[i]->asrc)
+        s->process = process_audio_queue;
+      else
+        s->process = process_video_queue;
 
+      num_readers++;
+      }
+    }
+  
   gavl_log(GAVL_LOG_INFO, LOG_DOMAIN,
-           "Starting encoding (%d threads)\n", enc->num_threads);
+           "Starting encoding (%d threads, %d reader threads)",
+           enc->num_threads, num_readers);
   
   enc->state = BG_ENCODER_STATE_RUNNING;
   
@@ -1033,12 +1634,14 @@ void bg_media_encoder_start(bg_media_source_t * src)
   
   for(i = 0; i < src->num_streams; i++)
     {
-    if((src->streams[i]->action == BG_STREAM_ACTION_OFF) ||
-       (src->streams[i]->type == GAVL_STREAM_MSG))
+    if(!has_thread(enc, src->streams[i]))
       continue;
     
     s = src->streams[i]->user_data;
     pthread_create(&s->th, NULL, encoder_stream_thread, src->streams[i]);
+
+    if(s->q)
+      pthread_create(&s->q->th, NULL, reader_thread, src->streams[i]);
     }
 
   pthread_barrier_wait(&enc->barrier);
@@ -1052,19 +1655,36 @@ void bg_media_encoder_stop(bg_media_source_t * src)
 
   bg_encoder_t * enc = src->user_data;
   pthread_mutex_lock(&enc->mutex);
-  enc->state = BG_ENCODER_STATE_STOP;
+  if(enc->state == BG_ENCODER_STATE_RUNNING)
+    enc->state = BG_ENCODER_STATE_STOP;
+  pthread_cond_broadcast(&enc->cond);
   pthread_mutex_unlock(&enc->mutex);
 
+  /* Wake up threads waiting for queues */
   for(i = 0; i < src->num_streams; i++)
     {
-    if((src->streams[i]->action == BG_STREAM_ACTION_OFF) ||
-       (src->streams[i]->type == GAVL_STREAM_MSG))
+    if(!has_thread(enc, src->streams[i]))
       continue;
     
     s = src->streams[i]->user_data;
-    pthread_join(s->th, NULL);
+    if(s->q)
+      queue_set_eof(s->q);
     }
   
+  for(i = 0; i < src->num_streams; i++)
+    {
+    if(!has_thread(enc, src->streams[i]))
+      continue;
+    
+    s = src->streams[i]->user_data;
+    pthread_join(s->th, NULL);
+
+    if(s->q)
+      pthread_join(s->q->th, NULL);
+    }
+
+  if(enc->flags & BG_ENCODER_SYNC_READ)
+    set_read_locks(enc, 0);
   }
 
 int bg_media_encoder_eof(bg_media_source_t * src)
@@ -1079,6 +1699,34 @@ int bg_media_encoder_eof(bg_media_source_t * src)
   return ret;
   }
 
+gavl_time_t bg_media_encoder_get_time(bg_media_source_t * src)
+  {
+  int i;
+  bg_encoder_stream_t * s;
+  gavl_time_t ret = GAVL_TIME_UNDEFINED;
+  bg_encoder_t * enc = src->user_data;
+  
+  pthread_mutex_lock(&enc->mutex);
+
+  for(i = 0; i < src->num_streams; i++)
+    {
+    if((src->streams[i]->action == BG_STREAM_ACTION_OFF) ||
+       (src->streams[i]->type == GAVL_STREAM_MSG))
+      continue;
+    
+    s = src->streams[i]->user_data;
+    
+    if(s->flags & BG_ENCODER_STREAM_NONCONT)
+      continue;
+    
+    if((ret == GAVL_TIME_UNDEFINED) || (s->sync_time > ret))
+      ret = s->sync_time;
+    }
+  
+  pthread_mutex_unlock(&enc->mutex);
+  return ret;
+  }
+
 static void dump_stats_type(bg_media_source_t * src, gavl_stream_type_t type)
   {
   int i, num;
@@ -238,6 +238,7 @@ void bg_msg_to_json_buf(const gavl_msg_t * msg, gavl_buffer_t * buf)
   
   memcpy(buf->buf + buf->len, str, len);
   buf->len += len;
+  json_object_put(obj);
   }
 
 int bg_msg_from_json(gavl_msg_t * msg, json_object * obj)
@@ -25,8 +25,14 @@
 #include <pthread.h>
 #include <unistd.h>
 #include <errno.h>
+#include <poll.h>
+#include <fcntl.h>
 #include <uuid/uuid.h>
 
+#ifdef HAVE_SYS_EVENTFD_H
+#include <sys/eventfd.h>
+#endif
+
 #include <gavl/gavlsocket.h>
 #include <gavl/utils.h>
 
@@ -61,23 +67,6 @@ static void msg_buf_push(msg_buf_t * buf, gavl_msg_t * msg)
   buf->len++;
   }
 
-static gavl_msg_t * msg_buf_shift(msg_buf_t * buf)
-  {
-  gavl_msg_t * ret;
-  if(!buf->len)
-    return NULL;
-
-  ret = buf->buf[0];
-  buf->len--;
-
-  if(buf->len > 0)
-    memmove(buf->buf, buf->buf + 1, buf->len * sizeof(*buf->buf));
-  
-  buf->buf[buf->len] = NULL;
-  
-  return ret;
-  }
-
 static gavl_msg_t * msg_buf_pop(msg_buf_t * buf)
   {
   gavl_msg_t * ret;
@@ -101,6 +90,77 @@ static void msg_buf_free(msg_buf_t * buf)
     free(buf->buf);
   }
 
+/* Circular buffer for the queue. The pool is a stack */
+
+static void msg_ring_grow(msg_ring_t * r)
+  {
+  int old_alloc = r->alloc;
+  
+  r->alloc = r->alloc ? r->alloc * 2 : 32;
+  r->buf = realloc(r->buf, r->alloc * sizeof(*r->buf));
+
+  /* Unwrap */
+  if(r->start + r->len > old_alloc)
+    {
+    int tail = old_alloc - r->start;
+    memmove(r->buf + (r->alloc - tail), r->buf + r->start, tail * sizeof(*r->buf));
+    r->start = r->alloc - tail;
+    }
+  }
+
+static void msg_ring_push(msg_ring_t * r, gavl_msg_t * msg)
+  {
+  if(r->len == r->alloc)
+    msg_ring_grow(r);
+  
+  r->buf[(r->start + r->len) % r->alloc] = msg;
+  r->len++;
+  }
+
+/* Put back to the front */
+static void msg_ring_unshift(msg_ring_t * r, gavl_msg_t * msg)
+  {
+  if(r->len == r->alloc)
+    msg_ring_grow(r);
+  
+  r->start = (r->start + r->alloc - 1) % r->alloc;
+  r->buf[r->start] = msg;
+  r->len++;
+  }
+
+static gavl_msg_t * msg_ring_shift(msg_ring_t * r)
+  {
+  gavl_msg_t * ret;
+  if(!r->len)
+    return NULL;
+
+  ret = r->buf[r->start];
+  r->buf[r->start] = NULL;
+  r->start = (r->start + 1) % r->alloc;
+  r->len--;
+  
+  if(!r->len)
+    r->start = 0;
+  
+  return ret;
+  }
+
+static gavl_msg_t * msg_ring_last(msg_ring_t * r)
+  {
+  if(!r->len)
+    return NULL;
+  return r->buf[(r->start + r->len - 1) % r->alloc];
+  }
+
+static void msg_ring_free(msg_ring_t * r)
+  {
+  int i;
+  for(i = 0; i < r->len; i++)
+    gavl_msg_destroy(r->buf[(r->start + i) % r->alloc]);
+  if(r->buf)
+    free(r->buf);
+  }
+
 static gavl_msg_t * queue_get_write(msg_queue_t * q)
   {
   gavl_msg_t * ret;
@@ -115,18 +175,20 @@ static gavl_msg_t * queue_get_write(msg_queue_t * q)
 
 static void queue_done_write(msg_queue_t * q, gavl_msg_t * msg)
   {
-  if(q->queue.len && bg_msg_merge(q->queue.buf[q->queue.len-1], msg))
+  gavl_msg_t * last;
+  
+  if((last = msg_ring_last(&q->queue)) && bg_msg_merge(last, msg))
     {
     gavl_log(GAVL_LOG_INFO, LOG_DOMAIN, "Merged messages");
     msg_buf_push(&q->pool, msg);
     }
   else
-    msg_buf_push(&q->queue, msg);
+    msg_ring_push(&q->queue, msg);
   }
 
 static gavl_msg_t * queue_get_read(msg_queue_t * q)
   {
-  return msg_buf_shift(&q->queue);
+  return msg_ring_shift(&q->queue);
   }
 
 static void queue_done_read(msg_queue_t * q, gavl_msg_t * msg)
@@ -136,7 +198,7 @@ static void queue_done_read(msg_queue_t * q, gavl_msg_t * msg)
 
 static void queue_destroy(msg_queue_t * q)
   {
-  msg_buf_free(&q->queue);
+  msg_ring_free(&q->queue);
   msg_buf_free(&q->pool);
   free(q);
   }
@@ -147,6 +209,72 @@ static msg_queue_t * queue_create()
   return ret;
   }
 
+/* Wakeup handle. Must be called with the write mutex locked */
+
+static void wakeup_signal(bg_msg_sink_t * sink)
+  {
+#ifdef HAVE_SYS_EVENTFD_H
+  uint64_t val = 1;
+#else
+  uint8_t val = 1;
+#endif
+  
+  if((sink->wakeup_fd_write < 0) || sink->wakeup_signalled)
+    return;
+
+  if(write(sink->wakeup_fd_write, &val, sizeof(val)) == sizeof(val))
+    sink->wakeup_signalled = 1;
+  }
+
+static void wakeup_clear(bg_msg_sink_t * sink)
+  {
+#ifdef HAVE_SYS_EVENTFD_H
+  uint64_t val;
+#else
+  uint8_t val;
+#endif
+  
+  if((sink->wakeup_fd_read < 0) || !sink->wakeup_signalled)
+    return;
+
+  if(read(sink->wakeup_fd_read, &val, sizeof(val)) == sizeof(val))
+    sink->wakeup_signalled = 0;
+  }
+
+static int wakeup_create(bg_msg_sink_t * sink)
+  {
+#ifdef HAVE_SYS_EVENTFD_H
+  if((sink->wakeup_fd_read = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) < 0)
+    goto fail;
+  sink->wakeup_fd_write = sink->wakeup_fd_read;
+#else
+  int fds[2];
+  if(pipe(fds))
+    goto fail;
+  fcntl(fds[0], F_SETFL, O_NONBLOCK);
+  fcntl(fds[1], F_SETFL, O_NONBLOCK);
+  fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+  fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+  sink->wakeup_fd_read  = fds[0];
+  sink->wakeup_fd_write = fds[1];
+#endif
+  return 1;
+  
+  fail:
+  gavl_log(GAVL_LOG_ERROR, LOG_DOMAIN, "Cannot create wakeup handle: %s", strerror(errno));
+  sink->wakeup_fd_read  = -1;
+  sink->wakeup_fd_write = -1;
+  return 0;
+  }
+
+static void wakeup_destroy(bg_msg_sink_t * sink)
+  {
+  if(sink->wakeup_fd_read >= 0)
+    close(sink->wakeup_fd_read);
+  if((sink->wakeup_fd_write >= 0) && (sink->wakeup_fd_write != sink->wakeup_fd_read))
+    close(sink->wakeup_fd_write);
+  }
+
 /* And entry in the routing table needs to survive
    only from the FUNC msg up to the last RESP msg */
 
@@ -256,6 +384,7 @@ void bg_msg_sink_put(bg_msg_sink_t * sink)
   if(sink->queue)
     {
     queue_done_write(sink->queue, sink->m);
+    wakeup_signal(sink);
     }
   else
     {
@@ -286,6 +415,9 @@ bg_msg_sink_t * bg_msg_sink_create(gavl_handle_msg_func cb, void * cb_data, int
   pthread_mutex_init(&ret->rm, NULL);
   pthread_mutex_init(&ret->write_mutex, NULL);
 
+  ret->wakeup_fd_read  = -1;
+  ret->wakeup_fd_write = -1;
+  
   return ret;
   }
 
@@ -298,6 +430,8 @@ void bg_msg_sink_destroy(bg_msg_sink_t * sink)
 
   pthread_mutex_destroy(&sink->rm);
   pthread_mutex_destroy(&sink->write_mutex);
+
+  wakeup_destroy(sink);
   
   free(sink);
   }
@@ -323,7 +457,8 @@ gavl_msg_t * bg_msg_sink_get_read(bg_msg_sink_t * sink)
     }
 
   pthread_mutex_lock(&sink->write_mutex);
-  ret = queue_get_read(sink->queue);
+  if(!(ret = queue_get_read(sink->queue)))
+    wakeup_clear(sink);
   pthread_mutex_unlock(&sink->write_mutex);
 
   return ret;
@@ -337,66 +472,159 @@ void bg_msg_sink_done_read(bg_msg_sink_t * sink, gavl_msg_t * m)
   }
 
 
+/* Messages taken from the queue with one lock */
+#define ITERATION_BATCH 32
+
 /* For asynchronous sinks */
 int bg_msg_sink_iteration(bg_msg_sink_t * sink)
   {
-  gavl_msg_t * m;
+  gavl_msg_t * batch[ITERATION_BATCH];
+  int num, i, j;
   int result = 1;
   sink->num_msg = 0;
 
   /* Do nothing for synchronous queues */
   if(!sink->queue)
     return 1;
+
+  num = 0;
   
   while(1)
     {
     pthread_mutex_lock(&sink->write_mutex);
-    m = queue_get_read(sink->queue);
+
+    /* Return messages from the last batch to the pool */
+    for(i = 0; i < num; i++)
+      queue_done_read(sink->queue, batch[i]);
+    
+    num = 0;
+    while((num < ITERATION_BATCH) &&
+          (batch[num] = queue_get_read(sink->queue)))
+      num++;
+    
+    if(!num)
+      wakeup_clear(sink);
+    
     pthread_mutex_unlock(&sink->write_mutex);
 
-    if(!m)
+    if(!num)
       break;
-
-#if 0 // Must be handled by the clients
-    /* Check for quit command */
-    if((m->NS == GAVL_MSG_NS_GENERIC) &&
-       (m->ID == GAVL_CMD_QUIT))
+    
+    for(i = 0; i < num; i++)
       {
-      gavl_log(GAVL_LOG_DEBUG, LOG_DOMAIN,
-               "bg_msg_sink_iteration: Got quit command");
+      /* Call callback function */
+      
+      if(sink->cb)
+        result = sink->cb(sink->cb_data, batch[i]);
+      
+      if((batch[i]->NS == GAVL_MSG_NS_GENERIC) &&
+         (batch[i]->ID == GAVL_CMD_QUIT))
+        result = 0;
+      
+      if(!result)
+        break;
+      
+      sink->num_msg++;
+      }
 
+    if(!result)
+      {
+      /* Put back unhandled messages */
       pthread_mutex_lock(&sink->write_mutex);
-      queue_done_read(sink->queue, m); // Prevent memory leak
-      pthread_mutex_unlock(&sink->write_mutex);
 
-      sink->num_msg++;
-
-      result = 0;
+      for(j = num - 1; j > i; j--)
+        msg_ring_unshift(&sink->queue->queue, batch[j]);
       
+      for(j = 0; j <= i; j++)
+        queue_done_read(sink->queue, batch[j]);
+
+      pthread_mutex_unlock(&sink->write_mutex);
       break;
       }
-#endif
-    
-    /* Call callback function */
+    }
+  
+  return result;
+  }
 
-    if(result && sink->cb)
-      result = sink->cb(sink->cb_data, m);
+int bg_msg_sink_get_fd(bg_msg_sink_t * sink)
+  {
+  int ret;
+  
+  if(!sink->queue)
+    return -1;
+  
+  pthread_mutex_lock(&sink->write_mutex);
 
-    if((m->NS == GAVL_MSG_NS_GENERIC) &&
-       (m->ID == GAVL_CMD_QUIT))
-      result = 0;
-    
-    pthread_mutex_lock(&sink->write_mutex);
-    queue_done_read(sink->queue, m);
-    pthread_mutex_unlock(&sink->write_mutex);
+  if((sink->wakeup_fd_read < 0) && wakeup_create(sink) && sink->queue->queue.len)
+    wakeup_signal(sink);
+  
+  ret = sink->wakeup_fd_read;
+  pthread_mutex_unlock(&sink->write_mutex);
+  return ret;
+  }
+
+#define MAX_WAIT_FDS 64
+
+int bg_msg_sinks_wait(bg_msg_sink_t ** sinks, int num_sinks,
+                      const int * fds, int num_fds, int timeout)
+  {
+  int i;
+  int num = 0;
+  int result;
+  struct pollfd pfds[MAX_WAIT_FDS];
+
+  for(i = 0; i < num_sinks; i++)
+    {
+    if(num == MAX_WAIT_FDS)
+      break;
     
-    if(!result)
+    if((pfds[num].fd = bg_msg_sink_get_fd(sinks[i])) >= 0)
+      {
+      pfds[num].events = POLLIN;
+      pfds[num].revents = 0;
+      num++;
+      }
+    }
+
+  for(i = 0; i < num_fds; i++)
+    {
+    if(num == MAX_WAIT_FDS)
       break;
+    
+    if((pfds[num].fd = fds[i]) >= 0)
+      {
+      pfds[num].events = POLLIN;
+      pfds[num].revents = 0;
+      num++;
+      }
+    }
+  
+  if(!num)
+    {
+    /* Nothing to wait for */
+    if(timeout > 0)
+      {
+      gavl_time_t delay_time = gavl_time_unscale(1000, timeout);
+      gavl_time_delay(&delay_time);
+      }
+    return 0;
+    }
+  
+  result = poll(pfds, num, timeout);
 
-    sink->num_msg++;
+  if(result < 0)
+    {
+    if(errno != EINTR)
+      gavl_log(GAVL_LOG_ERROR, LOG_DOMAIN, "poll failed: %s", strerror(errno));
+    return 0;
     }
   
-  return result;
+  return !!result;
+  }
+
+int bg_msg_sink_wait(bg_msg_sink_t * sink, int timeout)
+  {
+  return bg_msg_sinks_wait(&sink, 1, NULL, 0, timeout);
   }
 
 void bg_msg_sink_set_id(bg_msg_sink_t * sink, const char * id)
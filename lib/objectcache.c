@@ -25,6 +25,12 @@
 #include <pthread.h>
 #include <time.h>
 #include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
 
 #include <config.h>
 
@@ -41,35 +47,117 @@
 #define LOG_DOMAIN "objcache"
 
 
-#define ROOT_NAME_ENTRY "cacheentry"
-#define ROOT_NAME_INDEX "cacheindex"
-#define INDEX_FILENAME  "INDEX"
+/*
+ *  The disk cache is an append-only data file containing records
+ *  (record_header_t followed by the value serialized with bg_value_to_buffer()).
+ *  A record with zero length marks an entry as deleted. The index file contains
+ *  the offsets of the valid records in LRU order. If it's missing or outdated,
+ *  the index is rebuilt from the data file.
+ *
+ *  If more than half of the data file is occupied by deleted records,
+ *  a new data file is written in a background thread.
+ */
+
+#define DATA_FILENAME   "objects.dat"
+#define INDEX_FILENAME  "objects.idx"
+
+#define DATA_MAGIC      "BGOCDAT1"
+#define INDEX_MAGIC     "BGOCIDX1"
+#define MAGIC_LEN       8
+
+/* Start compaction if at least this many bytes are wasted */
+#define COMPACT_MIN_BYTES (4*1024*1024)
+
+/* Files used by the old XML based cache */
+#define LEGACY_ROOT_NAME_INDEX "cacheindex"
+#define LEGACY_INDEX_FILENAME  "INDEX"
 
 typedef struct
   {
   uint32_t md5[4];
-  gavl_value_t val;
-  char * id;
-  } mem_cache_entry_t;
+  uint32_t len;
+  } record_header_t;
 
 typedef struct
   {
   uint32_t md5[4];
-  } disk_cache_entry_t;
+  int64_t offset;
+  uint32_t len;
+  uint32_t reserved;
+  } index_entry_t;
 
-struct bg_object_cache_s
+typedef struct
   {
-  int max_disk_cache_size;
-  int max_memory_cache_size;
-  
-  int disk_cache_size;
-  int memory_cache_size;
+  uint32_t md5[4];
+  int64_t offset;
+  int64_t new_offset;
+  uint32_t len;
+  } compact_entry_t;
+
+/* Both tiers are hash tables with an intrusive doubly linked LRU list.
+   Entries are allocated once and never move, so pointers to the values
+   stay valid until the next call. */
+
+typedef struct cache_entry_s
+  {
+  uint32_t md5[4];
+  gavl_value_t val; // Memory cache only
+
+  /* Disk cache only: Position of the serialized value in the data file */
+  int64_t offset;
+  uint32_t len;
+
+  struct cache_entry_s * prev;      // LRU list, prev is more recently used
+  struct cache_entry_s * next;
+  struct cache_entry_s * hash_next; // Hash chain or free list
+  } cache_entry_t;
+
+typedef struct
+  {
+  cache_entry_t * entries;
+  cache_entry_t * free_entries;
+
+  cache_entry_t ** hash;
+  uint32_t hash_mask;
+
+  cache_entry_t * first;
+  cache_entry_t * last;
   
-  mem_cache_entry_t * memory_cache;
-  disk_cache_entry_t * disk_cache;
+  int size;
+  int max_size;
+  } cache_tier_t;
 
+struct bg_object_cache_s
+  {
+  cache_tier_t memory_cache;
+  cache_tier_t disk_cache;
+  
   char * directory;
 
+  /* Data file */
+  int data_fd;
+  int64_t data_size;
+  int64_t dead_bytes; // Occupied by deleted records
+  
+  uint8_t * map;
+  int64_t map_size;
+
+  gavl_buffer_t buf;
+  
+  /* Compaction */
+  pthread_t compact_thread;
+  pthread_mutex_t compact_mutex;
+  int compacting;
+  int compact_disabled; // Thread could not be started
+  int compact_done;
+  int compact_result;
+  int compact_fd;
+  int64_t compact_size; // Size of the new file
+  int64_t compact_end;  // Size of the old file when compaction started
+  compact_entry_t * compact_entries;
+  int num_compact_entries;
+
+  bg_object_cache_stats_t stats;
   };
 
 static gavl_value_t * object_cache_put_nocopy(bg_object_cache_t * cache,
@@ -79,35 +167,137 @@ static gavl_value_t * object_cache_put(bg_object_cache_t * cache,
                                        const char * id, const gavl_value_t * val);
 
 static gavl_value_t * object_cache_prepend_nocopy(bg_object_cache_t * cache,
-                                                  const char * id, gavl_value_t * val);
+                                                  const uint32_t * md5, gavl_value_t * val);
 
+/* Cache tier */
 
-static void move_to_front_mem(mem_cache_entry_t * arr, int num, int idx)
+static void tier_init(cache_tier_t * t, int max_size)
   {
-  mem_cache_entry_t sav;
-  memcpy(&sav, arr + idx, sizeof(sav));
+  int i;
+  int hash_size = 16;
+  
+  if(max_size < 1)
+    max_size = 1;
 
-  if(idx < num - 1)
-    memmove(arr + idx, arr + (idx + 1), (num - 1 - idx) * sizeof(*arr));
+  /* Load factor <= 0.5 */
+  while(hash_size < 2 * max_size)
+    hash_size <<= 1;
+  
+  t->max_size = max_size;
+  t->hash_mask = hash_size - 1;
+  t->hash = calloc(hash_size, sizeof(*t->hash));
+  t->entries = calloc(max_size, sizeof(*t->entries));
 
-  if(num - 1 > 0)
-    memmove(arr + 1, arr, (num - 1) * sizeof(*arr));
+  for(i = max_size - 1; i >= 0; i--)
+    {
+    t->entries[i].hash_next = t->free_entries;
+    t->free_entries = &t->entries[i];
+    }
+  }
+
+static void tier_free(cache_tier_t * t)
+  {
+  int i;
+  for(i = 0; i < t->max_size; i++)
+    gavl_value_free(&t->entries[i].val);
   
-  memcpy(arr, &sav, sizeof(sav));
+  free(t->entries);
+  free(t->hash);
+  }
+
+static int md5_equal(const uint32_t * md5_1, const uint32_t * md5_2)
+  {
+  return ((md5_1[0] == md5_2[0]) &&
+          (md5_1[1] == md5_2[1]) &&
+          (md5_1[2] == md5_2[2]) &&
+          (md5_1[3] == md5_2[3]));
   }
 
-static void move_to_front_disk(disk_cache_entry_t * arr, int num, int idx)
+static cache_entry_t * tier_find(const cache_tier_t * t, const uint32_t * md5)
   {
-  disk_cache_entry_t sav;
-  memcpy(&sav, arr + idx, sizeof(sav));
+  cache_entry_t * e = t->hash[md5[0] & t->hash_mask];
+
+  while(e)
+    {
+    if(md5_equal(e->md5, md5))
+      return e;
+    e = e->hash_next;
+    }
+  return NULL;
+  }
+
+static void tier_unlink(cache_tier_t * t, cache_entry_t * e)
+  {
+  if(e->prev)
+    e->prev->next = e->next;
+  else
+    t->first = e->next;
+
+  if(e->next)
+    e->next->prev = e->prev;
+  else
+    t->last = e->prev;
+
+  e->prev = NULL;
+  e->next = NULL;
+  }
+
+static void tier_link_front(cache_tier_t * t, cache_entry_t * e)
+  {
+  e->prev = NULL;
+  e->next = t->first;
+
+  if(t->first)
+    t->first->prev = e;
+  else
+    t->last = e;
+
+  t->first = e;
+  }
+
+static void tier_move_to_front(cache_tier_t * t, cache_entry_t * e)
+  {
+  if(t->first == e)
+    return;
+  tier_unlink(t, e);
+  tier_link_front(t, e);
+  }
+
+/* Remove entry from the hash table and the LRU list. The value must be freed
+   or moved away by the caller */
+
+static void tier_remove(cache_tier_t * t, cache_entry_t * e)
+  {
+  cache_entry_t ** ptr = &t->hash[e->md5[0] & t->hash_mask];
+
+  while(*ptr != e)
+    ptr = &(*ptr)->hash_next;
+  *ptr = e->hash_next;
   
-  if(idx < num - 1)
-    memmove(arr + idx, arr + (idx + 1), (num - 1 - idx) * sizeof(*arr));
+  tier_unlink(t, e);
+  
+  e->hash_next = t->free_entries;
+  t->free_entries = e;
+  t->size--;
+  }
+
+/* Add a new entry in front. The tier must not be full */
 
-  if(num - 1 > 0)
-    memmove(arr + 1, arr, (num - 1) * sizeof(*arr));
+static cache_entry_t * tier_prepend(cache_tier_t * t, const uint32_t * md5)
+  {
+  cache_entry_t * e;
+  cache_entry_t ** bucket = &t->hash[md5[0] & t->hash_mask];
   
-  memcpy(arr, &sav, sizeof(sav));
+  e = t->free_entries;
+  t->free_entries = e->hash_next;
+
+  memcpy(e->md5, md5, sizeof(e->md5));
+  e->hash_next = *bucket;
+  *bucket = e;
+
+  tier_link_front(t, e);
+  t->size++;
+  return e;
   }
 
 /* Utils */
@@ -118,296 +308,732 @@ static void id_2_md5(const char * id, void * ret)
   gavl_md5_buffer(id, strlen(id), ret);
   }
 
-static char * create_filename(const bg_object_cache_t * cache, const uint32_t * md5)
+static char * create_filename(const bg_object_cache_t * cache, const char * name)
+  {
+  return gavl_sprintf("%s/%s", cache->directory, name);
+  }
+
+static int write_all(int fd, const void * data, int64_t len)
+  {
+  ssize_t result;
+  const uint8_t * ptr = data;
+
+  while(len > 0)
+    {
+    if((result = write(fd, ptr, len)) < 0)
+      {
+      if(errno == EINTR)
+        continue;
+      return 0;
+      }
+    ptr += result;
+    len -= result;
+    }
+  return 1;
+  }
+
+static int read_all(int fd, void * data, int64_t len, int64_t offset)
+  {
+  ssize_t result;
+  uint8_t * ptr = data;
+
+  while(len > 0)
+    {
+    if((result = pread(fd, ptr, len, offset)) <= 0)
+      {
+      if((result < 0) && (errno == EINTR))
+        continue;
+      return 0;
+      }
+    ptr += result;
+    len -= result;
+    offset += result;
+    }
+  return 1;
+  }
+
+/* Make sure the data file is mapped up to end */
+
+static int ensure_map(bg_object_cache_t * cache, int64_t end)
+  {
+  if(end <= cache->map_size)
+    return 1;
+
+  if(cache->map)
+    {
+    munmap(cache->map, cache->map_size);
+    cache->map = NULL;
+    cache->map_size = 0;
+    }
+
+  if(end > cache->data_size)
+    return 0;
+  
+  cache->map = mmap(NULL, cache->data_size, PROT_READ, MAP_SHARED, cache->data_fd, 0);
+
+  if(cache->map == MAP_FAILED)
+    {
+    gavl_log(GAVL_LOG_ERROR, LOG_DOMAIN, "mmap failed: %s", strerror(errno));
+    cache->map = NULL;
+    return 0;
+    }
+  cache->map_size = cache->data_size;
+  return 1;
+  }
+
+static void unmap_data(bg_object_cache_t * cache)
   {
-  char str[GAVL_MD5_LENGTH];
-  gavl_md5_2_string(md5, str);
-  return gavl_sprintf("%s/%s", cache->directory, str);
+  if(cache->map)
+    {
+    munmap(cache->map, cache->map_size);
+    cache->map = NULL;
+    cache->map_size = 0;
+    }
   }
 
-static void load_disk_index(bg_object_cache_t * cache)
+/* Append a record to the data file. Returns the offset of the payload or -1 */
+
+static int64_t append_record(bg_object_cache_t * cache, const uint32_t * md5, const gavl_value_t * val)
   {
+  int64_t ret;
+  record_header_t h;
+
+  if(cache->data_fd < 0)
+    return -1;
+  
+  gavl_buffer_reset(&cache->buf);
+  
+  memcpy(h.md5, md5, sizeof(h.md5));
+  gavl_buffer_append_data(&cache->buf, (const uint8_t*)&h, sizeof(h));
+
+  if(val)
+    bg_value_to_buffer(val, &cache->buf);
+
+  h.len = cache->buf.len - sizeof(h);
+  memcpy(cache->buf.buf, &h, sizeof(h));
+
+  if(!write_all(cache->data_fd, cache->buf.buf, cache->buf.len))
+    {
+    gavl_log(GAVL_LOG_ERROR, LOG_DOMAIN, "Writing disk cache entry failed: %s", strerror(errno));
+    /* Cut off partially written data */
+    if(ftruncate(cache->data_fd, cache->data_size))
+      gavl_log(GAVL_LOG_ERROR, LOG_DOMAIN, "ftruncate failed: %s", strerror(errno));
+    return -1;
+    }
+  ret = cache->data_size + sizeof(h);
+  cache->data_size += cache->buf.len;
+  return ret;
+  }
+
+static int64_t get_live_bytes(const bg_object_cache_t * cache)
+  {
+  const cache_entry_t * e;
+  int64_t ret = MAGIC_LEN;
+  
+  for(e = cache->disk_cache.first; e; e = e->next)
+    ret += sizeof(record_header_t) + e->len;
+  return ret;
+  }
+
+/* Remove files from the XML based cache */
+
+static void remove_legacy_files(bg_object_cache_t * cache)
+  {
+  int i;
   char * filename;
+  char * entry_filename;
   const gavl_array_t * arr;
+  const char * md5_string;
   gavl_value_t val;
-
-  gavl_value_init(&val);
   
-  filename = gavl_sprintf("%s/%s", cache->directory, INDEX_FILENAME);
-  if(!access(filename, R_OK))
-    bg_value_load_xml(&val, filename, ROOT_NAME_INDEX);
-  free(filename);
+  filename = create_filename(cache, LEGACY_INDEX_FILENAME);
+
+  if(access(filename, R_OK))
+    {
+    free(filename);
+    return;
+    }
 
-  cache->disk_cache_size = 0;
+  gavl_log(GAVL_LOG_INFO, LOG_DOMAIN, "Removing old cache files from %s", cache->directory);
+  
+  gavl_value_init(&val);
+  bg_value_load_xml(&val, filename, LEGACY_ROOT_NAME_INDEX);
   
   if((arr = gavl_value_get_array(&val)))
     {
-    while((cache->disk_cache_size < cache->max_disk_cache_size) &&
-          (cache->disk_cache_size < arr->num_entries))
+    for(i = 0; i < arr->num_entries; i++)
       {
-      if(!gavl_string_2_md5(gavl_value_get_string(&arr->entries[cache->disk_cache_size]),
-                            cache->disk_cache[cache->disk_cache_size].md5))
-        break;
-      cache->disk_cache_size++;
+      if((md5_string = gavl_value_get_string(&arr->entries[i])))
+        {
+        entry_filename = create_filename(cache, md5_string);
+        remove(entry_filename);
+        free(entry_filename);
+        }
       }
     }
   gavl_value_free(&val);
+  remove(filename);
+  free(filename);
   }
 
-static void save_disk_index(const bg_object_cache_t * cache)
+/* Load index file. It's only valid if the data file wasn't changed since */
+
+static int load_disk_index(bg_object_cache_t * cache)
   {
   int i;
+  int fd;
+  int ret = 0;
   char * filename;
-  gavl_array_t * arr;
-  gavl_value_t val;
-  gavl_value_t el;
+  char magic[MAGIC_LEN];
+  int64_t data_size;
+  uint32_t num;
+  index_entry_t * entries = NULL;
+  
+  filename = create_filename(cache, INDEX_FILENAME);
+  fd = open(filename, O_RDONLY);
+  free(filename);
 
-  char md5_string[GAVL_MD5_LENGTH];
+  if(fd < 0)
+    return 0;
+
+  if(!read_all(fd, magic, MAGIC_LEN, 0) ||
+     memcmp(magic, INDEX_MAGIC, MAGIC_LEN) ||
+     !read_all(fd, &data_size, sizeof(data_size), MAGIC_LEN) ||
+     (data_size != cache->data_size) ||
+     !read_all(fd, &num, sizeof(num), MAGIC_LEN + sizeof(data_size)) ||
+     (num > data_size / sizeof(record_header_t)))
+    goto fail;
+
+  entries = malloc(num * sizeof(*entries));
+
+  if(!read_all(fd, entries, num * sizeof(*entries), MAGIC_LEN + sizeof(data_size) + sizeof(num)))
+    goto fail;
+
+  /* The index is saved most recently used first */
+  if(num > cache->disk_cache.max_size)
+    num = cache->disk_cache.max_size;
   
-  gavl_value_init(&val);
-  filename = gavl_sprintf("%s/%s", cache->directory, INDEX_FILENAME);
+  for(i = num - 1; i >= 0; i--)
+    {
+    cache_entry_t * e;
+    
+    if((entries[i].offset < (int64_t)(MAGIC_LEN + sizeof(record_header_t))) ||
+       (entries[i].offset + entries[i].len > cache->data_size) ||
+       tier_find(&cache->disk_cache, entries[i].md5))
+      continue;
+    
+    e = tier_prepend(&cache->disk_cache, entries[i].md5);
+    e->offset = entries[i].offset;
+    e->len    = entries[i].len;
+    }
+  ret = 1;
+  
+  fail:
 
-  gavl_log(GAVL_LOG_INFO, LOG_DOMAIN, "Saving disk index %s", filename);
+  if(entries)
+    free(entries);
+  close(fd);
+  return ret;
+  }
+
+/* Rebuild the index from the data file */
+
+static void scan_data_file(bg_object_cache_t * cache)
+  {
+  int64_t pos = MAGIC_LEN;
+  record_header_t h;
+  cache_entry_t * e;
+
+  gavl_log(GAVL_LOG_INFO, LOG_DOMAIN, "Rebuilding disk cache index");
+
+  if(!ensure_map(cache, cache->data_size))
+    return;
   
-  arr = gavl_value_set_array(&val);
+  while(pos + sizeof(h) <= cache->data_size)
+    {
+    memcpy(&h, cache->map + pos, sizeof(h));
 
-  for(i = 0; i < cache->disk_cache_size; i++)
+    if(pos + sizeof(h) + h.len > cache->data_size)
+      break;
+    
+    if((e = tier_find(&cache->disk_cache, h.md5)))
+      tier_remove(&cache->disk_cache, e);
+
+    if(h.len)
+      {
+      if(cache->disk_cache.size == cache->disk_cache.max_size)
+        tier_remove(&cache->disk_cache, cache->disk_cache.last);
+      
+      e = tier_prepend(&cache->disk_cache, h.md5);
+      e->offset = pos + sizeof(h);
+      e->len = h.len;
+      }
+    pos += sizeof(h) + h.len;
+    }
+
+  if(pos < cache->data_size)
     {
-    gavl_value_init(&el);
-    gavl_md5_2_string(cache->disk_cache[i].md5, md5_string);
-    gavl_value_set_string(&el, md5_string);
-    gavl_array_splice_val_nocopy(arr, -1, 0, &el);
+    /* Cut off incomplete record */
+    gavl_log(GAVL_LOG_WARNING, LOG_DOMAIN, "Truncating disk cache after %"PRId64" bytes", pos);
+    unmap_data(cache);
+    if(!ftruncate(cache->data_fd, pos))
+      cache->data_size = pos;
     }
+  }
+
+static void open_data_file(bg_object_cache_t * cache)
+  {
+  char * filename;
+  struct stat st;
+  char magic[MAGIC_LEN];
   
-  bg_value_save_xml(&val, filename, ROOT_NAME_INDEX);
-  
-  gavl_value_free(&val);
+  filename = create_filename(cache, DATA_FILENAME);
+  cache->data_fd = open(filename, O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+
+  if(cache->data_fd < 0)
+    {
+    gavl_log(GAVL_LOG_ERROR, LOG_DOMAIN, "Cannot open %s: %s", filename, strerror(errno));
+    free(filename);
+    return;
+    }
   free(filename);
+  
+  if(fstat(cache->data_fd, &st) ||
+     (st.st_size < MAGIC_LEN) ||
+     !read_all(cache->data_fd, magic, MAGIC_LEN, 0) ||
+     memcmp(magic, DATA_MAGIC, MAGIC_LEN))
+    {
+    /* New or invalid file */
+    if(ftruncate(cache->data_fd, 0) ||
+       !write_all(cache->data_fd, DATA_MAGIC, MAGIC_LEN))
+      {
+      close(cache->data_fd);
+      cache->data_fd = -1;
+      return;
+      }
+    cache->data_size = MAGIC_LEN;
+    return;
+    }
+  
+  cache->data_size = st.st_size;
+
+  if(!load_disk_index(cache))
+    scan_data_file(cache);
+
+  cache->dead_bytes = cache->data_size - get_live_bytes(cache);
   }
 
-static void delete_memory_cache_idx(bg_object_cache_t * cache,
-                                    int idx)
+static void save_disk_index(bg_object_cache_t * cache)
   {
-  gavl_value_reset(&cache->memory_cache[idx].val);
+  int fd;
+  int i;
+  char * filename;
+  const cache_entry_t * e;
+  uint32_t num;
+  index_entry_t * entries;
+  
+  filename = create_filename(cache, INDEX_FILENAME);
   
-  if(idx < cache->memory_cache_size-1)
+  gavl_log(GAVL_LOG_INFO, LOG_DOMAIN, "Saving disk index %s", filename);
+
+  if((fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644)) < 0)
     {
-    memmove(cache->memory_cache + idx,
-            cache->memory_cache + (idx + 1),
-            sizeof(*cache->memory_cache) * (cache->memory_cache_size-1-idx));
+    gavl_log(GAVL_LOG_ERROR, LOG_DOMAIN, "Cannot open %s: %s", filename, strerror(errno));
+    free(filename);
+    return;
     }
-  cache->memory_cache_size--;
+  
+  num = cache->disk_cache.size;
+  entries = calloc(num, sizeof(*entries));
+
+  i = 0;
+  for(e = cache->disk_cache.first; e; e = e->next)
+    {
+    memcpy(entries[i].md5, e->md5, sizeof(e->md5));
+    entries[i].offset = e->offset;
+    entries[i].len    = e->len;
+    i++;
+    }
+
+  if(!write_all(fd, INDEX_MAGIC, MAGIC_LEN) ||
+     !write_all(fd, &cache->data_size, sizeof(cache->data_size)) ||
+     !write_all(fd, &num, sizeof(num)) ||
+     !write_all(fd, entries, num * sizeof(*entries)))
+    {
+    gavl_log(GAVL_LOG_ERROR, LOG_DOMAIN, "Writing %s failed: %s", filename, strerror(errno));
+    close(fd);
+    remove(filename);
+    }
+  else
+    close(fd);
+  
+  free(entries);
+  free(filename);
   }
 
-static void delete_disk_cache_idx(bg_object_cache_t * cache,
-                                  int idx)
+/* Compaction */
+
+static void * compact_thread(void * data)
   {
-  char * str = create_filename(cache, cache->disk_cache[idx].md5);
-  remove(str);
-  free(str);
-    
-  if(idx < cache->disk_cache_size-1)
+  int i;
+  int result = 0;
+  bg_object_cache_t * cache = data;
+  gavl_buffer_t buf;
+  
+  gavl_buffer_init(&buf);
+
+  if(!write_all(cache->compact_fd, DATA_MAGIC, MAGIC_LEN))
+    goto fail;
+  
+  cache->compact_size = MAGIC_LEN;
+
+  for(i = 0; i < cache->num_compact_entries; i++)
     {
-    memmove(cache->disk_cache + idx,
-            cache->disk_cache + (idx + 1),
-            sizeof(*cache->disk_cache) * (cache->disk_cache_size-1-idx));
+    compact_entry_t * e = &cache->compact_entries[i];
+    int64_t len = sizeof(record_header_t) + e->len;
+    
+    gavl_buffer_alloc(&buf, len);
+
+    if(!read_all(cache->data_fd, buf.buf, len, e->offset - sizeof(record_header_t)) ||
+       !write_all(cache->compact_fd, buf.buf, len))
+      goto fail;
+
+    e->new_offset = cache->compact_size + sizeof(record_header_t);
+    cache->compact_size += len;
     }
-  cache->disk_cache_size--;
-  }
 
+  result = 1;
+  fail:
+  
+  gavl_buffer_free(&buf);
 
-/* object cache */
+  pthread_mutex_lock(&cache->compact_mutex);
+  cache->compact_result = result;
+  cache->compact_done = 1;
+  pthread_mutex_unlock(&cache->compact_mutex);
+  return NULL;
+  }
 
-static int mem_cache_index(const bg_object_cache_t * cache, const uint32_t * md5)
+static void start_compaction(bg_object_cache_t * cache)
   {
   int i;
-  for(i = 0; i < cache->memory_cache_size; i++)
+  char * filename;
+  const cache_entry_t * e;
+  
+  filename = create_filename(cache, DATA_FILENAME".tmp");
+  cache->compact_fd = open(filename, O_RDWR | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0644);
+  free(filename);
+  
+  if(cache->compact_fd < 0)
+    return;
+  
+  gavl_log(GAVL_LOG_INFO, LOG_DOMAIN, "Compacting disk cache (%"PRId64" bytes)", cache->data_size);
+  
+  /* Snapshot of the live entries. The thread only reads the file up to compact_end */
+  cache->num_compact_entries = cache->disk_cache.size;
+  cache->compact_entries = calloc(cache->num_compact_entries, sizeof(*cache->compact_entries));
+
+  i = 0;
+  for(e = cache->disk_cache.first; e; e = e->next)
     {
-    if((cache->memory_cache[i].md5[0] == md5[0]) &&
-       (cache->memory_cache[i].md5[1] == md5[1]) &&
-       (cache->memory_cache[i].md5[2] == md5[2]) &&
-       (cache->memory_cache[i].md5[3] == md5[3]))
-      {
-      return i;
-      }
+    memcpy(cache->compact_entries[i].md5, e->md5, sizeof(e->md5));
+    cache->compact_entries[i].offset = e->offset;
+    cache->compact_entries[i].len    = e->len;
+    i++;
+    }
+  
+  cache->compact_end = cache->data_size;
+  cache->compact_done = 0;
+  cache->compacting = 1;
+  
+  if(pthread_create(&cache->compact_thread, NULL, compact_thread, cache))
+    {
+    gavl_log(GAVL_LOG_ERROR, LOG_DOMAIN, "Cannot start compaction thread");
+    cache->compacting = 0;
+    cache->compact_disabled = 1;
+    close(cache->compact_fd);
+    cache->compact_fd = -1;
+
+    filename = create_filename(cache, DATA_FILENAME".tmp");
+    remove(filename);
+    free(filename);
+    
+    free(cache->compact_entries);
+    cache->compact_entries = NULL;
+    cache->num_compact_entries = 0;
     }
-  return -1;
   }
 
-static int disk_cache_index(const bg_object_cache_t * cache, const uint32_t * md5)
+static void finish_compaction(bg_object_cache_t * cache)
   {
   int i;
+  char * filename;
+  char * tmp_filename;
+  cache_entry_t * e;
+  int64_t delta;
+  int64_t tail;
+  gavl_buffer_t buf;
+  
+  pthread_join(cache->compact_thread, NULL);
+  cache->compacting = 0;
 
-  //  fprintf(stderr, "disk_cache_index\n");
-  //  gavl_hexdump((const uint8_t *)md5, 16, 16);
+  filename = create_filename(cache, DATA_FILENAME);
+  tmp_filename = create_filename(cache, DATA_FILENAME".tmp");
   
-  for(i = 0; i < cache->disk_cache_size; i++)
+  gavl_buffer_init(&buf);
+
+  if(!cache->compact_result)
+    goto fail;
+  
+  /* Copy records, which were appended in the meantime */
+  tail = cache->data_size - cache->compact_end;
+
+  if(tail > 0)
     {
-    //    gavl_hexdump((const uint8_t *)cache->disk_cache[i].md5, 16, 16);
-    
-    if((cache->disk_cache[i].md5[0] == md5[0]) &&
-       (cache->disk_cache[i].md5[1] == md5[1]) &&
-       (cache->disk_cache[i].md5[2] == md5[2]) &&
-       (cache->disk_cache[i].md5[3] == md5[3]))
-      {
-      return i;
-      }
+    gavl_buffer_alloc(&buf, tail);
+    if(!read_all(cache->data_fd, buf.buf, tail, cache->compact_end) ||
+       !write_all(cache->compact_fd, buf.buf, tail))
+      goto fail;
+    }
+
+  if(rename(tmp_filename, filename))
+    goto fail;
+  
+  /* Update offsets. The compacted records come first: Their new offsets
+     are below compact_end, so they are not moved again with the appended ones.
+     The other way round, a moved record could match an old snapshot offset. */
+  for(i = 0; i < cache->num_compact_entries; i++)
+    {
+    if((e = tier_find(&cache->disk_cache, cache->compact_entries[i].md5)) &&
+       (e->offset == cache->compact_entries[i].offset))
+      e->offset = cache->compact_entries[i].new_offset;
+    }
+
+  delta = cache->compact_size - cache->compact_end;
+  
+  for(e = cache->disk_cache.first; e; e = e->next)
+    {
+    if(e->offset >= cache->compact_end)
+      e->offset += delta;
     }
-  return -1;
+  
+  unmap_data(cache);
+  close(cache->data_fd);
+  cache->data_fd = cache->compact_fd;
+  cache->data_size = cache->compact_size + tail;
+  cache->dead_bytes = cache->data_size - get_live_bytes(cache);
+  cache->compact_fd = -1;
+  
+  gavl_log(GAVL_LOG_INFO, LOG_DOMAIN, "Compacted disk cache to %"PRId64" bytes", cache->data_size);
+  cache->stats.compactions++;
+  
+  fail:
+
+  if(cache->compact_fd >= 0)
+    {
+    gavl_log(GAVL_LOG_ERROR, LOG_DOMAIN, "Compacting disk cache failed");
+    close(cache->compact_fd);
+    cache->compact_fd = -1;
+    remove(tmp_filename);
+    }
+  
+  free(cache->compact_entries);
+  cache->compact_entries = NULL;
+  cache->num_compact_entries = 0;
+  
+  gavl_buffer_free(&buf);
+  free(filename);
+  free(tmp_filename);
   }
 
+/* Called from the API functions */
+
+static void check_compaction(bg_object_cache_t * cache)
+  {
+  int done;
+  
+  if(cache->compacting)
+    {
+    pthread_mutex_lock(&cache->compact_mutex);
+    done = cache->compact_done;
+    pthread_mutex_unlock(&cache->compact_mutex);
+
+    if(done)
+      finish_compaction(cache);
+    return;
+    }
+
+  if((cache->data_fd < 0) || cache->compact_disabled)
+    return;
+  
+  if((cache->dead_bytes > COMPACT_MIN_BYTES) &&
+     (cache->dead_bytes > cache->data_size / 2))
+    start_compaction(cache);
+  }
+
+static void delete_memory_cache_entry(bg_object_cache_t * cache,
+                                      cache_entry_t * e)
+  {
+  gavl_value_reset(&e->val);
+  tier_remove(&cache->memory_cache, e);
+  }
+
+static void delete_disk_cache_entry(bg_object_cache_t * cache,
+                                    cache_entry_t * e)
+  {
+  /* Tombstone */
+  if(append_record(cache, e->md5, NULL) > 0)
+    cache->dead_bytes += sizeof(record_header_t);
+  
+  cache->dead_bytes += sizeof(record_header_t) + e->len;
+  tier_remove(&cache->disk_cache, e);
+  }
+
+/* object cache */
+
 gavl_value_t * bg_object_cache_get(bg_object_cache_t * cache, const char * id)
   {
-  int idx;
-  int done = 0;
+  cache_entry_t * e;
   gavl_value_t * ret = NULL;
-  gavl_value_t * val = NULL;
   
   uint32_t md5[4];
+
+  check_compaction(cache);
   
   /* Calculate md5 of id */
   id_2_md5(id, md5);
   
   /* 1. Try memory cache */
-  if((idx = mem_cache_index(cache, md5)) >= 0)
+  if((e = tier_find(&cache->memory_cache, md5)))
     {
-    move_to_front_mem(cache->memory_cache, cache->memory_cache_size, idx);
-    done = 1;
-    ret = &cache->memory_cache[0].val;
+    tier_move_to_front(&cache->memory_cache, e);
+    cache->stats.memory_hits++;
+    return &e->val;
     }
  
   /* 2. Try disk cache */
-  if(!done)
+  if((e = tier_find(&cache->disk_cache, md5)))
     {
-    if((idx = disk_cache_index(cache, md5)) >= 0)
+    gavl_value_t v;
+    gavl_value_init(&v);
+    
+    if(ensure_map(cache, e->offset + e->len) &&
+       bg_value_from_buffer(&v, cache->map + e->offset, e->len))
       {
-      gavl_dictionary_t dict;
-      char * filename = create_filename(cache, md5);
-      /* Load value from cache */
-      gavl_dictionary_init(&dict);
-      
-      if((done = bg_dictionary_load_xml(&dict, filename, ROOT_NAME_ENTRY)))
-        {
-        val = gavl_dictionary_get_nc(&dict, "v");
-        ret = object_cache_prepend_nocopy(cache, id, val);
-        
-        move_to_front_disk(cache->disk_cache, cache->disk_cache_size, idx);
-        }
-      free(filename);
-      gavl_dictionary_free(&dict);
+      tier_move_to_front(&cache->disk_cache, e);
+      ret = object_cache_prepend_nocopy(cache, md5, &v);
+      cache->stats.disk_hits++;
+      }
+    else
+      {
+      gavl_log(GAVL_LOG_WARNING, LOG_DOMAIN, "Corrupted disk cache entry");
+      gavl_value_free(&v);
+      delete_disk_cache_entry(cache, e);
       }
     }
+
+  if(!ret)
+    cache->stats.misses++;
   
   return ret;
   }
 
-static void delete_memory_cache(bg_object_cache_t * cache,
-                                uint32_t * md5)
-  {
-  int idx;
-  if((idx = mem_cache_index(cache, md5)) >= 0)
-    delete_memory_cache_idx(cache, idx);
-  }
-
-
-static void delete_disk_cache(bg_object_cache_t * cache,
-                              uint32_t * md5)
-  {
-  int idx;
-  if((idx = disk_cache_index(cache, md5)) >= 0)
-    delete_disk_cache_idx(cache, idx);
-  }
-
 void bg_object_cache_delete(bg_object_cache_t * cache,
                             const char * id)
   {
+  cache_entry_t * e;
   uint32_t md5[4];
   id_2_md5(id, md5);
-  delete_memory_cache(cache, md5);
-  delete_disk_cache(cache, md5);
+  
+  if((e = tier_find(&cache->memory_cache, md5)))
+    delete_memory_cache_entry(cache, e);
+
+  if((e = tier_find(&cache->disk_cache, md5)))
+    delete_disk_cache_entry(cache, e);
   }
 
 static void put_disk_cache_nocopy(bg_object_cache_t * cache, const uint32_t * md5,
-                                  gavl_value_t * val, const char * id)
+                                  gavl_value_t * val)
   {
-  int idx;
-  char * filename;
-  gavl_dictionary_t dict;
+  cache_entry_t * e;
+  int64_t offset;
+  
+  if(cache->data_fd < 0)
+    {
+    gavl_value_free(val);
+    return;
+    }
   
   /* If entry is there, we don't rewrite it. Just move it to the front in the index */
-  if((idx = disk_cache_index(cache, md5)) >= 0)
+  if((e = tier_find(&cache->disk_cache, md5)))
     {
-    disk_cache_entry_t tmp;
-    memcpy(&tmp, &cache->disk_cache[idx], sizeof(tmp));
-    if(idx < cache->disk_cache_size-1)
-      {
-      memmove(cache->disk_cache + idx,
-              cache->disk_cache + (idx + 1),
-              sizeof(*cache->disk_cache) * (cache->disk_cache_size-1-idx));
-      }
-
-    if(cache->disk_cache_size > 1)
-      memmove(&cache->disk_cache[1], &cache->disk_cache[0], (cache->disk_cache_size-1) * sizeof(*cache->disk_cache));
-
-    memcpy(&cache->disk_cache[0], &tmp, sizeof(tmp));
+    tier_move_to_front(&cache->disk_cache, e);
     gavl_value_free(val);
     return;
     }
   
   /* Make space in disk cache */
-  if(cache->disk_cache_size == cache->max_disk_cache_size)
-    delete_disk_cache_idx(cache, cache->disk_cache_size-1);
-
-  if(cache->disk_cache_size > 0)
-    memmove(&cache->disk_cache[1], &cache->disk_cache[0], cache->disk_cache_size * sizeof(*cache->disk_cache));
-  
-  memcpy(cache->disk_cache[0].md5, md5, 4*sizeof(*md5));
-  cache->disk_cache_size++;
+  if(cache->disk_cache.size == cache->disk_cache.max_size)
+    {
+    delete_disk_cache_entry(cache, cache->disk_cache.last);
+    cache->stats.disk_evictions++;
+    }
   
   /* Save value */
+  if((offset = append_record(cache, md5, val)) > 0)
+    {
+    e = tier_prepend(&cache->disk_cache, md5);
+    e->offset = offset;
+    e->len = cache->buf.len - sizeof(record_header_t);
+    }
+  gavl_value_free(val);
+  }
 
-  gavl_dictionary_init(&dict);
-  gavl_dictionary_set_nocopy(&dict, "v", val);
-  
-  filename = create_filename(cache, md5);
+/* Move the least recently used entry of the memory cache to the disk cache */
 
-  gavl_log(GAVL_LOG_INFO, LOG_DOMAIN, "Saving disk cache entry %s", filename);
-  bg_dictionary_save_xml(&dict, filename, ROOT_NAME_ENTRY);
-  free(filename);
-  gavl_dictionary_free(&dict);
+static void memory_cache_evict(bg_object_cache_t * cache)
+  {
+  uint32_t md5[4];
+  gavl_value_t val;
+  cache_entry_t * e = cache->memory_cache.last;
+
+  memcpy(md5, e->md5, sizeof(md5));
+  gavl_value_init(&val);
+  gavl_value_move(&val, &e->val);
+  tier_remove(&cache->memory_cache, e);
+  
+  put_disk_cache_nocopy(cache, md5, &val);
   }
 
 static gavl_value_t * object_cache_prepend_nocopy(bg_object_cache_t * cache,
-                                                        const char * id, gavl_value_t * val)
+                                                  const uint32_t * md5, gavl_value_t * val)
   {
+  cache_entry_t * e;
+  
   /* Make space in memory cache */
-  if(cache->memory_cache_size == cache->max_memory_cache_size)
+  if(cache->memory_cache.size == cache->memory_cache.max_size)
     {
-    mem_cache_entry_t * e = &cache->memory_cache[cache->max_memory_cache_size-1];
-    put_disk_cache_nocopy(cache, e->md5, &e->val, e->id);
-    cache->memory_cache_size--;
+    memory_cache_evict(cache);
+    cache->stats.memory_evictions++;
     }
   
   /* Move in front of the memory cache */
-  if(cache->memory_cache_size)
-    memmove(cache->memory_cache+1, cache->memory_cache, sizeof(*cache->memory_cache)*cache->memory_cache_size);
-  
-  gavl_value_move(&cache->memory_cache[0].val, val);
-
-
-  gavl_md5_buffer(id, strlen(id), cache->memory_cache[0].md5);
-  
-  cache->memory_cache_size++;
-
-  return &cache->memory_cache[0].val;
-  
+  e = tier_prepend(&cache->memory_cache, md5);
+  gavl_value_move(&e->val, val);
+  return &e->val;
   }
 
 static gavl_value_t * object_cache_put_nocopy(bg_object_cache_t * cache,
                                                     const char * id, gavl_value_t * val)
   {
+  uint32_t md5[4];
+
+  check_compaction(cache);
+  
   bg_object_cache_delete(cache, id);
-  return object_cache_prepend_nocopy(cache, id, val);
+
+  id_2_md5(id, md5);
+  return object_cache_prepend_nocopy(cache, md5, val);
   }
 
 static gavl_value_t * object_cache_put(bg_object_cache_t * cache,
@@ -441,40 +1067,57 @@ bg_object_cache_t * bg_object_cache_create(int max_disk_cache_size,
   {
   bg_object_cache_t * ret = calloc(1, sizeof(*ret));
 
-  ret->max_disk_cache_size = max_disk_cache_size;
-  ret->max_memory_cache_size = max_memory_cache_size;
-
-  ret->disk_cache = calloc(ret->max_disk_cache_size, sizeof(*ret->disk_cache));
-  ret->memory_cache = calloc(ret->max_memory_cache_size, sizeof(*ret->memory_cache));
+  tier_init(&ret->disk_cache, max_disk_cache_size);
+  tier_init(&ret->memory_cache, max_memory_cache_size);
   
   ret->directory = gavl_strdup(directory);
-
-  gavl_ensure_directory(ret->directory, 1);
+  ret->compact_fd = -1;
+  pthread_mutex_init(&ret->compact_mutex, NULL);
   
-  load_disk_index(ret);
+  gavl_ensure_directory(ret->directory, 1);
+
+  remove_legacy_files(ret);
+  open_data_file(ret);
   return ret;
   }
 
+void bg_object_cache_get_stats(const bg_object_cache_t * cache,
+                               bg_object_cache_stats_t * ret)
+  {
+  memcpy(ret, &cache->stats, sizeof(*ret));
+  }
+
 void bg_object_cache_destroy(bg_object_cache_t * cache)
   {
   /* Move memory cache to disk.
      We do this backwards such that the first entry in the memory cache becomes the
      first entry in the disk cache */
 
-  int i;
-  for(i = cache->memory_cache_size-1; i >= 0; i--)
-    {
-    mem_cache_entry_t * e = cache->memory_cache + i;
-    put_disk_cache_nocopy(cache, e->md5, &e->val, e->id);
-    }
+  if(cache->compacting)
+    finish_compaction(cache);
   
-  save_disk_index(cache);
+  while(cache->memory_cache.last)
+    memory_cache_evict(cache);
+
+  if(cache->data_fd >= 0)
+    save_disk_index(cache);
 
+  gavl_log(GAVL_LOG_INFO, LOG_DOMAIN,
+           "Memory hits: %"PRId64", disk hits: %"PRId64", misses: %"PRId64", "
+           "memory evictions: %"PRId64", disk evictions: %"PRId64", compactions: %"PRId64,
+           cache->stats.memory_hits, cache->stats.disk_hits, cache->stats.misses,
+           cache->stats.memory_evictions, cache->stats.disk_evictions, cache->stats.compactions);
+  
   /* Free stuff */
-  free(cache->memory_cache);
-  free(cache->disk_cache);
+  tier_free(&cache->memory_cache);
+  tier_free(&cache->disk_cache);
   free(cache->directory);
+
+  unmap_data(cache);
+  if(cache->data_fd >= 0)
+    close(cache->data_fd);
+  gavl_buffer_free(&cache->buf);
+  pthread_mutex_destroy(&cache->compact_mutex);
   
   free(cache);
   }
-
@@ -358,6 +358,7 @@ bg_player_t * bg_player_create()
   
   ret->threads[0] = ret->audio_stream.th;
   ret->threads[1] = ret->video_stream.th;
+  ret->threads[2] = ret->video_stream.decode_th;
   
   pthread_mutex_init(&ret->seek_window_mutex, NULL);
   pthread_mutex_init(&ret->state_mutex, NULL);
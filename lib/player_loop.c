@@ -325,6 +325,11 @@ static int init_playback(bg_player_t * p, gavl_time_t time, int state)
     {
     bg_thread_set_func(p->video_stream.th, NULL, NULL);
     }
+
+  if(DO_VIDEO(p->flags) && p->video_stream.q.active)
+    bg_thread_set_func(p->video_stream.decode_th, bg_player_ov_decode_thread, p);
+  else
+    bg_thread_set_func(p->video_stream.decode_th, NULL, NULL);
   
   bg_player_time_init(p);
 
@@ -23,6 +23,7 @@
 #include <string.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <time.h>
 
 #include <gavl/keycodes.h>
 #include <gmerlin/accelerator.h>
@@ -36,8 +37,6 @@
 // #define DUMP_SUBTITLE
 // #define DUMP_TIMESTAMPS
 
-#define NOSKIP
-
 #define STATE_READ  1  // Try to read frame
 #define STATE_WAIT  2  // Wait to show frame
 #define STATE_STILL 3 // Show still image
@@ -428,9 +427,285 @@ void bg_player_set_ov_uri(bg_player_t * player, const char * uri)
   
   }
 
+/*
+ *  Decode-ahead queue: The decoder thread reads frames into a small pool
+ *  owned by us. The output thread takes them from the ready list and copies
+ *  them into the frame of the sink when they are due. Hardware frames are
+ *  not buffered and are read synchronously like before.
+ */
+
+#define QUEUE_WAIT 10 // Milliseconds to block before checking the thread status again
+
+/* Called with locked mutex */
+static void queue_wait(bg_player_video_queue_t * q)
+  {
+  struct timespec ts;
+  
+  clock_gettime(CLOCK_REALTIME, &ts);
+  ts.tv_nsec += QUEUE_WAIT * 1000000L;
+  ts.tv_sec += ts.tv_nsec / 1000000000L;
+  ts.tv_nsec %= 1000000000L;
+  
+  pthread_cond_timedwait(&q->cond, &q->mutex, &ts);
+  }
+
+static void queue_put_free(bg_player_video_queue_t * q, gavl_video_frame_t * f)
+  {
+  q->free[q->num_free++] = f;
+  pthread_cond_broadcast(&q->cond);
+  }
+
+static void queue_put_ready(bg_player_video_queue_t * q, gavl_video_frame_t * f)
+  {
+  q->ready[(q->ready_start + q->num_ready) % BG_PLAYER_VIDEO_QUEUE_FRAMES] = f;
+  q->num_ready++;
+  pthread_cond_broadcast(&q->cond);
+  }
+
+static gavl_video_frame_t * queue_get_ready(bg_player_video_queue_t * q)
+  {
+  gavl_video_frame_t * ret;
+
+  if(!q->num_ready)
+    return NULL;
+  
+  ret = q->ready[q->ready_start];
+  q->ready_start = (q->ready_start + 1) % BG_PLAYER_VIDEO_QUEUE_FRAMES;
+  q->num_ready--;
+  return ret;
+  }
+
+/* Give back the current frame */
+static void release_frame(bg_player_video_stream_t * s)
+  {
+  if(s->frame && s->q.active)
+    {
+    pthread_mutex_lock(&s->q.mutex);
+    queue_put_free(&s->q, s->frame);
+    pthread_mutex_unlock(&s->q.mutex);
+    }
+  s->frame = NULL;
+  }
+
+/* Drop all decoded frames. The decoder thread must not run. */
+static void queue_flush(bg_player_video_stream_t * s)
+  {
+  gavl_video_frame_t * f;
+  bg_player_video_queue_t * q = &s->q;
+  
+  pthread_mutex_lock(&q->mutex);
+
+  if(s->frame)
+    {
+    queue_put_free(q, s->frame);
+    s->frame = NULL;
+    }
+  
+  while((f = queue_get_ready(q)))
+    queue_put_free(q, f);
+
+  q->eof = 0;
+  pthread_mutex_unlock(&q->mutex);
+  }
+
+static gavl_source_status_t queue_decode(bg_player_video_stream_t * s,
+                                         gavl_video_frame_t * f)
+  {
+  gavl_source_status_t st;
+  gavl_time_t time_before = gavl_timer_get(s->timer);
+  
+  if((st = gavl_video_source_read_frame(s->src, &f)) == GAVL_SOURCE_OK)
+    {
+    pthread_mutex_lock(&s->q.mutex);
+    s->q.decode_time += gavl_timer_get(s->timer) - time_before;
+    s->q.decode_frames++;
+    pthread_mutex_unlock(&s->q.mutex);
+    }
+  return st;
+  }
+
+/* Read a frame in the calling thread. The decoder thread must not run. */
+static gavl_source_status_t queue_read_sync(bg_player_video_stream_t * s,
+                                            gavl_video_frame_t ** ret)
+  {
+  gavl_source_status_t st;
+  gavl_video_frame_t * f = NULL;
+  bg_player_video_queue_t * q = &s->q;
+  
+  pthread_mutex_lock(&q->mutex);
+
+  /* Decoded in advance */
+  if((*ret = queue_get_ready(q)))
+    {
+    pthread_mutex_unlock(&q->mutex);
+    return GAVL_SOURCE_OK;
+    }
+  
+  if(q->num_free)
+    f = q->free[--q->num_free];
+  pthread_mutex_unlock(&q->mutex);
+
+  if(!f)
+    return GAVL_SOURCE_AGAIN;
+  
+  if((st = queue_decode(s, f)) != GAVL_SOURCE_OK)
+    {
+    pthread_mutex_lock(&q->mutex);
+    queue_put_free(q, f);
+    pthread_mutex_unlock(&q->mutex);
+    return st;
+    }
+  
+  *ret = f;
+  return st;
+  }
+
+void bg_player_ov_init_queue(bg_player_t * p)
+  {
+  int i;
+  bg_player_video_stream_t * s = &p->video_stream;
+  bg_player_video_queue_t * q = &s->q;
+  
+  q->active = 0;
+  q->num_free = 0;
+  q->num_ready = 0;
+  q->ready_start = 0;
+  q->eof = 0;
+  q->decode_time = 0;
+  q->decode_frames = 0;
+  
+  if(DO_STILL(p->flags) || DO_SUBTITLE_ONLY(p->flags) || s->output_format.hwctx)
+    return;
+  
+  for(i = 0; i < BG_PLAYER_VIDEO_QUEUE_FRAMES; i++)
+    {
+    q->frames[i] = gavl_video_frame_create(&s->output_format);
+    q->free[i] = q->frames[i];
+    }
+  q->num_free = BG_PLAYER_VIDEO_QUEUE_FRAMES;
+  q->active = 1;
+  }
+
+static void queue_cleanup(bg_player_video_stream_t * s)
+  {
+  int i;
+  
+  if(!s->q.active)
+    return;
+  
+  for(i = 0; i < BG_PLAYER_VIDEO_QUEUE_FRAMES; i++)
+    {
+    gavl_video_frame_destroy(s->q.frames[i]);
+    s->q.frames[i] = NULL;
+    }
+  s->q.num_free = 0;
+  s->q.num_ready = 0;
+  s->q.active = 0;
+  s->frame = NULL;
+  }
+
+void * bg_player_ov_decode_thread(void * data)
+  {
+  bg_player_t * p = data;
+  bg_player_video_stream_t * s = &p->video_stream;
+  bg_player_video_queue_t * q = &s->q;
+  gavl_video_frame_t * f;
+  gavl_source_status_t st;
+  
+  /* The output thread reads the first frame itself */
+  if(!bg_thread_wait_for_start(s->decode_th))
+    return NULL;
+  
+  while(bg_thread_check(s->decode_th))
+    {
+    pthread_mutex_lock(&q->mutex);
+
+    if(q->eof || !q->num_free)
+      {
+      queue_wait(q);
+      pthread_mutex_unlock(&q->mutex);
+      continue;
+      }
+    
+    f = q->free[--q->num_free];
+    pthread_mutex_unlock(&q->mutex);
+    
+    st = queue_decode(s, f);
+    
+    pthread_mutex_lock(&q->mutex);
+    if(st == GAVL_SOURCE_OK)
+      queue_put_ready(q, f);
+    else
+      {
+      queue_put_free(q, f);
+      q->eof = 1;
+      }
+    pthread_mutex_unlock(&q->mutex);
+    }
+  return NULL;
+  }
+
+/* Get the next decoded frame in the output thread */
+static gavl_source_status_t queue_read(bg_player_video_stream_t * s, int sync)
+  {
+  gavl_source_status_t st = GAVL_SOURCE_AGAIN;
+  bg_player_video_queue_t * q = &s->q;
+
+  if(sync)
+    return queue_read_sync(s, &s->frame);
+  
+  pthread_mutex_lock(&q->mutex);
+  
+  if(!q->num_ready && !q->eof)
+    queue_wait(q);
+  
+  if((s->frame = queue_get_ready(q)))
+    st = GAVL_SOURCE_OK;
+  else if(q->eof)
+    st = GAVL_SOURCE_EOF;
+  
+  pthread_mutex_unlock(&q->mutex);
+  return st;
+  }
+
+/* Pass a frame from the queue to the sink */
+static void queue_put_frame(bg_player_video_stream_t * s,
+                            gavl_video_sink_t * sink,
+                            gavl_video_frame_t * f)
+  {
+  gavl_video_frame_t * out;
+
+  if((out = gavl_video_sink_get_frame(sink)))
+    {
+    gavl_video_frame_copy(&s->output_format, out, f);
+    gavl_video_frame_copy_metadata(out, f);
+    gavl_video_sink_put_frame(sink, out);
+    }
+  else
+    gavl_video_sink_put_frame(sink, f);
+  }
+
 gavl_time_t bg_player_ov_resync(bg_player_t * p)
   {
   bg_player_video_stream_t * s = &p->video_stream;
+
+  if(s->q.active)
+    {
+    gavl_video_frame_t * f = NULL;
+
+    /* Called with paused threads after seeking: Start over */
+    queue_flush(s);
+
+    if(queue_read_sync(s, &f) != GAVL_SOURCE_OK)
+      return GAVL_TIME_UNDEFINED;
+    
+    pthread_mutex_lock(&s->q.mutex);
+    queue_put_ready(&s->q, f);
+    pthread_mutex_unlock(&s->q.mutex);
+    
+    s->state = STATE_READ;
+    return gavl_time_unscale(s->output_format.timescale, f->timestamp);
+    }
   
   if(gavl_video_source_read_frame(s->src, &s->frame) != GAVL_SOURCE_OK)
     return GAVL_TIME_UNDEFINED;
@@ -496,11 +771,21 @@ void bg_player_ov_update_still(bg_player_t * p)
   bg_player_video_stream_t * s = &p->video_stream;
 
   sink = bg_ov_get_sink(s->ov);
+
+  if(s->q.active)
+    {
+    /* Threads are paused here */
+    if(queue_read_sync(s, &frame) != GAVL_SOURCE_OK)
+      return;
+    }
+  else
+    {
+    frame = gavl_video_sink_get_frame(sink);
   
-  frame = gavl_video_sink_get_frame(sink);
+    if(gavl_video_source_read_frame(s->src, &frame) != GAVL_SOURCE_OK)
+      return;
+    }
   
-  if(gavl_video_source_read_frame(s->src, &frame) != GAVL_SOURCE_OK)
-    return;
   s->frame_time =
     gavl_time_unscale(s->output_format.timescale,
                       frame->timestamp);
@@ -513,7 +798,16 @@ void bg_player_ov_update_still(bg_player_t * p)
   frame->duration = -1;
 
   //  fprintf(stderr, "ov_put_frame (s): %p\n", frame);
-  gavl_video_sink_put_frame(sink, frame);
+  if(s->q.active)
+    {
+    queue_put_frame(s, sink, frame);
+    
+    pthread_mutex_lock(&s->q.mutex);
+    queue_put_free(&s->q, frame);
+    pthread_mutex_unlock(&s->q.mutex);
+    }
+  else
+    gavl_video_sink_put_frame(sink, frame);
   }
 
 void bg_player_ov_cleanup(bg_player_video_stream_t * s)
@@ -521,6 +815,7 @@ void bg_player_ov_cleanup(bg_player_video_stream_t * s)
   
   //  destroy_frame(s, s->frame);
   //  s->frame = NULL;
+  queue_cleanup(s);
   bg_ov_close(s->ov);
   }
 
@@ -560,7 +855,7 @@ void bg_player_ov_handle_events(bg_player_video_stream_t * s)
   bg_ov_handle_events(s->ov);
   }
 
-static gavl_source_status_t read_frame(bg_player_t * p)
+static gavl_source_status_t read_frame(bg_player_t * p, int sync)
   {
   bg_player_video_stream_t * s;
   gavl_time_t frame_time;
@@ -572,20 +867,37 @@ static gavl_source_status_t read_frame(bg_player_t * p)
   
   //    fprintf(stderr, "do read\n");
 
-  time_before = gavl_timer_get(s->timer);
+  if(s->q.active)
+    {
+    if((st = queue_read(s, sync)) == GAVL_SOURCE_AGAIN)
+      return st;
+    }
+  else
+    {
+    time_before = gavl_timer_get(s->timer);
+    
+    s->frame = gavl_video_sink_get_frame(bg_ov_get_sink(s->ov));
+    st = gavl_video_source_read_frame(s->src, &s->frame);
+    
+    s->decode_duration = gavl_timer_get(s->timer) - time_before;
 
-  s->frame = gavl_video_sink_get_frame(bg_ov_get_sink(s->ov));
+    pthread_mutex_lock(&s->q.mutex);
+    s->q.decode_time += s->decode_duration;
+    s->q.decode_frames++;
+    pthread_mutex_unlock(&s->q.mutex);
+    }
   
-  if((st = gavl_video_source_read_frame(s->src, &s->frame)) != GAVL_SOURCE_OK)
+  if(st != GAVL_SOURCE_OK)
     {
     bg_player_video_set_eof(p);
     if(!bg_thread_wait_for_start(s->th))
       return GAVL_SOURCE_EOF;
-    
+
+    /* Queue was flushed if we seeked back */
+    if(s->q.active)
+      return GAVL_SOURCE_AGAIN;
     }
   
-  s->decode_duration = gavl_timer_get(s->timer) - time_before;
-  
   //  fprintf(stderr, "Reading took %f seconds\n", gavl_time_to_seconds(s->decode_duration));
 
   if(!s->frame)
@@ -627,6 +939,42 @@ static gavl_source_status_t read_frame(bg_player_t * p)
 
 #define QOS_FRAMES 100 // Check QOS after this many frames
 
+/* Send statistics to the player thread, which stores them in the state */
+static void send_stats(bg_player_t * p, gavl_time_t render_time, int render_frames)
+  {
+  gavl_value_t val;
+  gavl_dictionary_t * dict;
+  bg_player_video_stream_t * s = &p->video_stream;
+  
+  gavl_value_init(&val);
+  dict = gavl_value_set_dictionary(&val);
+  
+  pthread_mutex_lock(&s->q.mutex);
+  
+  if(s->q.decode_frames)
+    gavl_dictionary_set_long(dict, BG_PLAYER_VIDEO_STATS_DECODE_DURATION,
+                             s->q.decode_time / s->q.decode_frames);
+  
+  gavl_dictionary_set_int(dict, BG_PLAYER_VIDEO_STATS_QUEUE_DEPTH, s->q.num_ready);
+  
+  s->q.decode_time = 0;
+  s->q.decode_frames = 0;
+  pthread_mutex_unlock(&s->q.mutex);
+  
+  if(render_frames)
+    gavl_dictionary_set_long(dict, BG_PLAYER_VIDEO_STATS_RENDER_DURATION,
+                             render_time / render_frames);
+  
+  gavl_dictionary_set_int(dict, BG_PLAYER_VIDEO_STATS_QUEUE_SIZE,
+                          s->q.active ? BG_PLAYER_VIDEO_QUEUE_SIZE : 0);
+  gavl_dictionary_set_long(dict, BG_PLAYER_VIDEO_STATS_DROPPED, s->frames_dropped);
+
+  /* p->state belongs to the player thread */
+  bg_state_set(NULL, 1, BG_PLAYER_STATE_CTX, BG_PLAYER_STATE_VIDEO_STATS, &val,
+               p->ctrl.cmd_sink, BG_CMD_SET_STATE);
+  gavl_value_free(&val);
+  }
+
 void * bg_player_ov_thread(void * data)
   {
   bg_player_video_stream_t * s;
@@ -638,6 +986,11 @@ void * bg_player_ov_thread(void * data)
   int warn_wait = 0;
   int done = 0;
   int still_shown = 0;
+  int frames_shown = 0;
+
+  /* Rendering time since the last statistics update */
+  gavl_time_t render_time = 0;
+  int render_frames = 0;
 
   /* Evaluate QOS after this number of frames */
   int frames_since_qos = 0;
@@ -659,7 +1012,7 @@ void * bg_player_ov_thread(void * data)
   bg_player_time_get(p, 1, &current_time);
   while(1)
     {
-    if(read_frame(p) != GAVL_SOURCE_OK)
+    if(read_frame(p, 1) != GAVL_SOURCE_OK)
       return NULL;
 
     if(s->frame_time >= current_time)
@@ -667,7 +1020,7 @@ void * bg_player_ov_thread(void * data)
     else
       {
       gavl_log(GAVL_LOG_INFO, LOG_DOMAIN, "Skipping initial video frame");
-      s->frame = NULL;
+      release_frame(s);
       }
     }
   
@@ -689,7 +1042,9 @@ void * bg_player_ov_thread(void * data)
     if(s->state == STATE_READ)
       {
       warn_wait = 0;
-      if(read_frame(p) != GAVL_SOURCE_OK)
+      if((st = read_frame(p, 0)) == GAVL_SOURCE_AGAIN)
+        continue;
+      else if(st != GAVL_SOURCE_OK)
         {
         done = 1;
         continue;
@@ -738,24 +1093,27 @@ void * bg_player_ov_thread(void * data)
           {
           bg_player_speed_up(p);
           }
+        send_stats(p, render_time, render_frames);
+        render_time = 0;
+        render_frames = 0;
         frames_since_qos = 0;
         }
       else
         frames_since_qos++;
       
-#if 0
       /* Drop frame */
-      else if((diff_time < -GAVL_TIME_SCALE / 20) && (frames_shown > 10)) // 50 ms
+      if(s->do_skip && (diff_time < -GAVL_TIME_SCALE / 20) && (frames_shown > 10)) // 50 ms
         {
-        gavl_log(GAVL_LOG_WARNING, LOG_DOMAIN, "Dropping frame (diff: %f, cur: %f, frame: %f)",
+        gavl_log(GAVL_LOG_DEBUG, LOG_DOMAIN, "Dropping frame (diff: %f, cur: %f, frame: %f)",
                  gavl_time_to_seconds(diff_time),
                  gavl_time_to_seconds(current_time),
                  gavl_time_to_seconds(s->frame_time));
+        release_frame(s);
         s->skip++;
+        s->frames_dropped++;
         s->state = STATE_READ;
         continue;
         }
-#endif
       s->state = STATE_SHOW;
       }
     
@@ -811,23 +1169,28 @@ void * bg_player_ov_thread(void * data)
       //    fprintf(stderr, "ov_put_frame (v): %p\n", frame);
 
       time_before = gavl_timer_get(s->timer);
-      
-      gavl_video_sink_put_frame(sink, s->frame);
 
+      if(s->q.active)
+        queue_put_frame(s, sink, s->frame);
+      else
+        gavl_video_sink_put_frame(sink, s->frame);
+      
       s->render_duration = gavl_timer_get(s->timer) - time_before;
       s->skip = 0;
 
+      render_time += s->render_duration;
+      render_frames++;
+      frames_shown++;
+      
       bg_ov_handle_events(s->ov);
       
-      s->frame = NULL;
+      release_frame(s);
 
       
       if(DO_STILL(p->flags))
         s->state = STATE_STILL;
       else
         s->state = STATE_READ;
-
-      /* TODO: Update stats */
       
       }
     
@@ -38,6 +38,7 @@ void bg_player_video_create(bg_player_t * p)
   bg_player_video_stream_t * s = &p->video_stream;
   
   s->th = bg_thread_create(p->thread_common);
+  s->decode_th = bg_thread_create(p->thread_common);
   
   bg_gavl_video_options_init(&s->options);
 
@@ -45,6 +46,8 @@ void bg_player_video_create(bg_player_t * p)
   
   pthread_mutex_init(&s->config_mutex,NULL);
   pthread_mutex_init(&s->eof_mutex,NULL);
+  pthread_mutex_init(&s->q.mutex,NULL);
+  pthread_cond_init(&s->q.cond,NULL);
   s->ss = &p->subtitle_stream;
   
   s->accel_map = bg_accelerator_map_create();
@@ -58,9 +61,12 @@ void bg_player_video_destroy(bg_player_t * p)
   bg_player_video_stream_t * s = &p->video_stream;
   pthread_mutex_destroy(&s->config_mutex);
   pthread_mutex_destroy(&s->eof_mutex);
+  pthread_mutex_destroy(&s->q.mutex);
+  pthread_cond_destroy(&s->q.cond);
   bg_gavl_video_options_free(&s->options);
   bg_video_filter_chain_destroy(s->fc);
   bg_thread_destroy(s->th);
+  bg_thread_destroy(s->decode_th);
   
   bg_osd_destroy(s->osd);
   bg_accelerator_map_destroy(s->accel_map);
@@ -81,6 +87,7 @@ int bg_player_video_init(bg_player_t * player, int video_stream)
 
   s->skip = 0;
   s->frames_read = 0;
+  s->frames_dropped = 0;
 
   
   if(!DO_VIDEO(player->flags))
@@ -119,6 +126,8 @@ int bg_player_video_init(bg_player_t * player, int video_stream)
   if(!DO_SUBTITLE_ONLY(player->flags))
     gavl_video_source_set_dst(s->src, 0, &s->output_format);
 
+  bg_player_ov_init_queue(player);
+
   /* Read first video frame(s). Here we skip initial video frames if the
      audio stream starts later */
 
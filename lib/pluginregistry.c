@@ -2089,9 +2089,10 @@ bg_plugin_registry_load_cover_cnv(bg_plugin_registry_t * r,
   }
 
 
-int bg_plugin_registry_probe_image(const char * filename,
-                                   gavl_video_format_t * format,
-                                   gavl_dictionary_t * m, bg_plugin_handle_t ** h)
+static int probe_image(const char * filename,
+                       gavl_video_format_t * format,
+                       gavl_dictionary_t * m, bg_plugin_handle_t ** h,
+                       int max_width, int max_height)
   {
   bg_image_reader_plugin_t * ir;
   bg_plugin_handle_t * handle = NULL;
@@ -2112,6 +2113,9 @@ int bg_plugin_registry_probe_image(const char * filename,
 
   ir = (bg_image_reader_plugin_t*)handle->plugin;
 
+  if(ir->set_max_size)
+    ir->set_max_size(handle->priv, max_width, max_height);
+  
   if(!ir->read_header(handle->priv, filename, format))
     {
     bg_plugin_unref(handle);
@@ -2128,6 +2132,12 @@ int bg_plugin_registry_probe_image(const char * filename,
   return 1;
   }
 
+int bg_plugin_registry_probe_image(const char * filename,
+                                   gavl_video_format_t * format,
+                                   gavl_dictionary_t * m, bg_plugin_handle_t ** h)
+  {
+  return probe_image(filename, format, m, h, 0, 0);
+  }
 
 gavl_video_frame_t *
 bg_plugin_registry_load_image(bg_plugin_registry_t * r,
@@ -2135,6 +2145,16 @@ bg_plugin_registry_load_image(bg_plugin_registry_t * r,
                               gavl_video_format_t * format,
                               gavl_dictionary_t * m)
   {
+  return bg_plugin_registry_load_image_max(r, filename, format, m, 0, 0);
+  }
+
+gavl_video_frame_t *
+bg_plugin_registry_load_image_max(bg_plugin_registry_t * r,
+                                  const char * filename,
+                                  gavl_video_format_t * format,
+                                  gavl_dictionary_t * m,
+                                  int max_width, int max_height)
+  {
   bg_image_reader_plugin_t * ir;
   bg_plugin_handle_t * handle = NULL;
   gavl_video_frame_t * ret = NULL;
@@ -2142,8 +2162,7 @@ bg_plugin_registry_load_image(bg_plugin_registry_t * r,
   // fprintf(stderr, "bg_plugin_registry_load_image\n");
   memset(format, 0, sizeof(*format));
   
-  if(!bg_plugin_registry_probe_image(filename, format,
-                                     m, &handle))
+  if(!probe_image(filename, format, m, &handle, max_width, max_height))
     goto fail;
   
   ir = (bg_image_reader_plugin_t*)handle->plugin;
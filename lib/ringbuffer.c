@@ -32,23 +32,41 @@
 
 
 
-typedef struct buf_element_s
-  {
-  int64_t seqno;
+/* Elements are reference counted: The slot holds one reference and each
+   reader, which didn't copy the data yet, holds another one. The writer
+   fills an unreferenced element and swaps it into the slot so neither
+   the writer nor the readers copy data while holding the mutex. */
 
+struct bg_ring_buffer_ref_s
+  {
   void * data;
-    
-  } buf_element_t;
+  int refcount;
+  struct bg_ring_buffer_ref_s * next; // Free list
+  };
+
+typedef struct
+  {
+  int64_t seqno;
+  bg_ring_buffer_ref_t * e;
+  } slot_t;
 
 struct bg_ring_buffer_s
   {
-  int write_idx;
-  
+  /* Next sequence number to be written */
   int64_t seqno;
   
-  int num_elements;
-  buf_element_t * elements;
+  /* Element with seqno is at slots[seqno % num_slots] */
+  int num_slots;
+  slot_t * slots;
+
+  /* All allocated elements */
+  bg_ring_buffer_ref_t ** pool;
+  int pool_size;
+  int pool_alloc;
+  
+  bg_ring_buffer_ref_t * free_list;
   
+  bg_ring_buffer_alloc_func alloc_func;
   bg_ring_buffer_free_func free_func;
   bg_ring_buffer_copy_func copy_func;
   void * priv;
@@ -59,6 +77,34 @@ struct bg_ring_buffer_s
   
   };
 
+/* Call with mutex locked */
+
+static bg_ring_buffer_ref_t * element_create(bg_ring_buffer_t * buf)
+  {
+  bg_ring_buffer_ref_t * ret;
+  
+  if(buf->pool_size == buf->pool_alloc)
+    {
+    buf->pool_alloc += 8;
+    buf->pool = realloc(buf->pool, buf->pool_alloc * sizeof(*buf->pool));
+    }
+  
+  ret = calloc(1, sizeof(*ret));
+  ret->data = buf->alloc_func(buf->priv);
+  buf->pool[buf->pool_size++] = ret;
+  return ret;
+  }
+
+static void element_unref(bg_ring_buffer_t * buf, bg_ring_buffer_ref_t * e)
+  {
+  e->refcount--;
+  if(!e->refcount)
+    {
+    e->next = buf->free_list;
+    buf->free_list = e;
+    }
+  }
+
 bg_ring_buffer_t * bg_ring_buffer_create(int num_elements,
                                          bg_ring_buffer_alloc_func alloc_func,
                                          bg_ring_buffer_free_func free_func,
@@ -68,36 +114,36 @@ bg_ring_buffer_t * bg_ring_buffer_create(int num_elements,
   int i;
   bg_ring_buffer_t * ret;
 
+  if(!(flags & BG_RINGBUFFER_OVERWRITE))
+    {
+    fprintf(stderr, "buffers without BG_RINGBUFFER_OVERWRITE are not supported yet\n");
+    return NULL;
+    }
+  
   ret = calloc(1, sizeof(*ret));
 
+  ret->alloc_func = alloc_func;
   ret->free_func = free_func;
   ret->copy_func = copy_func;
   ret->priv = priv;
 
-  ret->num_elements = num_elements;
-  ret->elements = calloc(ret->num_elements, sizeof(*ret->elements));
+  ret->num_slots = num_elements;
+  ret->slots = calloc(ret->num_slots, sizeof(*ret->slots));
 
   ret->seqno = 1;
 
-  for(i = 0; i < ret->num_elements; i++)
+  /* One more than slots so the writer has always a free one
+     as long as no reader holds a reference */
+  for(i = 0; i <= ret->num_slots; i++)
     {
-    ret->elements[i].data = alloc_func(priv);
+    bg_ring_buffer_ref_t * e = element_create(ret);
+    e->next = ret->free_list;
+    ret->free_list = e;
     }
-
+  
   pthread_mutex_init(&ret->mutex, NULL);
 
   ret->flags = flags;
-
-  if(!(ret->flags & BG_RINGBUFFER_OVERWRITE))
-    {
-    fprintf(stderr, "buffers without BG_RINGBUFFER_OVERWRITE are not supported yet\n");
-    return NULL;
-    }
-  if(!(ret->flags & BG_RINGBUFFER_SINGLE_READER))
-    {
-    fprintf(stderr, "buffers without BG_RINGBUFFER_SINGLE_READER are not supported yet\n");
-    return NULL;
-    }
   
   return ret;
   
@@ -106,99 +152,121 @@ bg_ring_buffer_t * bg_ring_buffer_create(int num_elements,
 void bg_ring_buffer_destroy(bg_ring_buffer_t * buf)
   {
   int i;
-  if(buf->elements)
+
+  for(i = 0; i < buf->pool_size; i++)
     {
-    for(i = 0; i < buf->num_elements; i++)
-      {
-      buf->free_func(buf->priv, buf->elements[i].data);
-      }
-    free(buf->elements);
+    buf->free_func(buf->priv, buf->pool[i]->data);
+    free(buf->pool[i]);
     }
+  if(buf->pool)
+    free(buf->pool);
+  
+  if(buf->slots)
+    free(buf->slots);
+  
   pthread_mutex_destroy(&buf->mutex);
   free(buf);
   }
 
 void bg_ring_buffer_write(bg_ring_buffer_t * buf, const void * data)
   {
+  bg_ring_buffer_ref_t * e;
+  slot_t * slot;
+  
   pthread_mutex_lock(&buf->mutex);
 
-  if(!(buf->flags & BG_RINGBUFFER_OVERWRITE))
-    {
-    /* TODO: Wait until the buffer is consumed */
-    }
+  /* Readers still hold all spare elements: Make a new one */
+  if(!(e = buf->free_list))
+    e = element_create(buf);
+  else
+    buf->free_list = e->next;
+  
+  e->refcount = 1;
+  
+  pthread_mutex_unlock(&buf->mutex);
 
-  buf->copy_func(buf->priv, buf->elements[buf->write_idx].data, data);
-  buf->elements[buf->write_idx].seqno = buf->seqno;
-  buf->seqno++;
+  /* Nobody else sees this element now */
+  buf->copy_func(buf->priv, e->data, data);
 
-  buf->write_idx++;
-  if(buf->write_idx == buf->num_elements)
-    buf->write_idx = 0;
+  pthread_mutex_lock(&buf->mutex);
+
+  slot = &buf->slots[buf->seqno % buf->num_slots];
+  
+  if(slot->e)
+    element_unref(buf, slot->e);
+  
+  slot->e = e;
+  slot->seqno = buf->seqno;
+  buf->seqno++;
   
   pthread_mutex_unlock(&buf->mutex);
   }
 
+/* Call with mutex locked */
+
+static bg_ring_buffer_ref_t * get_element(bg_ring_buffer_t * buf, int64_t * seqno)
+  {
+  slot_t * slot;
+  int64_t oldest;
+  
+  if(buf->seqno == 1) // Nothing written yet
+    return NULL;
+
+  oldest = buf->seqno - buf->num_slots;
+  if(oldest < 1)
+    oldest = 1;
+  
+  /* First read or reader too slow: Take the oldest one */
+  if(*seqno < oldest)
+    *seqno = oldest;
+  else if(*seqno >= buf->seqno)
+    return NULL;
+
+  slot = &buf->slots[*seqno % buf->num_slots];
+
+  if(slot->seqno != *seqno)
+    return NULL; // Should not happen
+  
+  (*seqno)++;
+  slot->e->refcount++;
+  return slot->e;
+  }
+
 /* The sequence number identifies the buffer element. When you call read() the first time,
    set it to zero. When doing continuous reads, it is incremented by one after the call. 
    If was incremented by more than one, it means that data were skipped */
    
 int bg_ring_buffer_read(bg_ring_buffer_t * buf, void * data, int64_t * seqno)
   {
-  int i;
-  int min_idx = -1;
-  int64_t min_seq = -1;
+  bg_ring_buffer_ref_t * e;
+  
+  if(!bg_ring_buffer_read_ref(buf, seqno, &e))
+    return 0;
 
-  int ret = 0;
+  buf->copy_func(buf->priv, data, e->data);
   
+  bg_ring_buffer_unref(buf, e);
+  return 1;
+  }
+
+const void * bg_ring_buffer_read_ref(bg_ring_buffer_t * buf, int64_t * seqno,
+                                     bg_ring_buffer_ref_t ** ref)
+  {
   pthread_mutex_lock(&buf->mutex);
+  *ref = get_element(buf, seqno);
+  pthread_mutex_unlock(&buf->mutex);
 
-  /* First read: Take lowest seqno */
-  if(*seqno <= 0)
-    {
-    for(i = 0; i < buf->num_elements; i++)
-      {
-      if((buf->elements[i].seqno > 0) &&
-         ((min_seq < 0) || (min_seq > buf->elements[i].seqno)))
-        {
-        min_seq = buf->elements[i].seqno;
-        min_idx = i;
-        }
-      }
-    }
-  else
-    {
-    
-    for(i = 0; i < buf->num_elements; i++)
-      {
-      if(*seqno == buf->elements[i].seqno)
-        {
-        min_seq = buf->elements[i].seqno;
-        min_idx = i;
-        break;
-        }
-      
-      if((buf->elements[i].seqno > 0) &&
-         (*seqno < buf->elements[i].seqno) &&
-         ((min_seq < 0) || (min_seq > buf->elements[i].seqno)))
-        {
-        min_seq = buf->elements[i].seqno;
-        min_idx = i;
-        }
-      }
-
-    
-    }
-  
-  if(min_idx >= 0)
-    {
-    *seqno = min_seq + 1;
-    buf->copy_func(buf->priv, data, buf->elements[min_idx].data);
-    ret = 1;
-    }
+  if(!(*ref))
+    return NULL;
   
-  pthread_mutex_unlock(&buf->mutex);
+  return (*ref)->data;
+  }
 
-  return ret;
+void bg_ring_buffer_unref(bg_ring_buffer_t * buf, bg_ring_buffer_ref_t * ref)
+  {
+  pthread_mutex_lock(&buf->mutex);
+  element_unref(buf, ref);
+  pthread_mutex_unlock(&buf->mutex);
   }
 
 /* Audio buffer */
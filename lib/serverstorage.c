@@ -21,6 +21,7 @@
 
 
 #include <string.h>
+#include <pthread.h>
 
 #include <config.h>
 #include <gavl/gavl.h>
@@ -45,6 +46,9 @@ struct bg_server_storage_s
   char ** client_ids;
   char * path;
   const char ** vars;
+
+  /* Handlers run in parallel in the http workers */
+  pthread_mutex_t mutex;
   };
 
 static char * index_filename(bg_server_storage_t * s)
@@ -111,6 +115,7 @@ bg_server_storage_create(const char * local_path,
   ret->client_ids = calloc(ret->max_clients + 1, sizeof(*ret->client_ids));
   ret->vars = vars;
   ret->path = gavl_strdup(local_path);
+  pthread_mutex_init(&ret->mutex, NULL);
   read_index(ret);
   return ret;
   }
@@ -128,13 +133,16 @@ bg_server_storage_destroy(bg_server_storage_t * s)
     free(s->client_ids);
 
   free(s->path);
+  pthread_mutex_destroy(&s->mutex);
   free(s);
   }
 
 
+/* Must be called with the mutex locked */
+
 static char * make_path(bg_server_storage_t * s,
                         const char * id,
-                        const char * var, int wr)
+                        const char * var, int wr, int * added)
   {
   int i;
   
@@ -190,6 +198,7 @@ static char * make_path(bg_server_storage_t * s,
         gavl_log(GAVL_LOG_INFO, LOG_DOMAIN, "Deleting %s", path);
         remove(path);
         free(path);
+        i++;
         }
       path = gavl_sprintf("%s/%s", s->path, last_id);
       gavl_log(GAVL_LOG_INFO, LOG_DOMAIN, "Deleting %s", path);
@@ -210,6 +219,9 @@ static char * make_path(bg_server_storage_t * s,
     path = gavl_sprintf("%s/%s", s->path, id);
     gavl_ensure_directory(path, 1);
     free(path);
+
+    if(added)
+      *added = 1;
     }
   
   return gavl_sprintf("%s/%s/%s", s->path, id, var);
@@ -220,15 +232,22 @@ void * bg_server_storage_get(bg_server_storage_t * s,
                              const char * var, int * len)
   {
   gavl_buffer_t buf;
-  char * path = make_path(s, client_id, var, 0);
+  char * path;
 
+  pthread_mutex_lock(&s->mutex);
+  path = make_path(s, client_id, var, 0, NULL);
+  pthread_mutex_unlock(&s->mutex);
+  
   gavl_buffer_init(&buf);
   
   if(!path)
     return NULL;
 
   if(!gavl_read_file(path, &buf))
+    {
+    free(path);
     return NULL;
+    }
   
   free(path);
 
@@ -242,13 +261,24 @@ int bg_server_storage_put(bg_server_storage_t * s,
                           const char * var,
                           void * data, int len)
   {
-  char * path = make_path(s, client_id, var, 1);
+  int added = 0;
+  char * path;
 
-  if(!path)
+  pthread_mutex_lock(&s->mutex);
+  
+  if(!(path = make_path(s, client_id, var, 1, &added)))
+    {
+    pthread_mutex_unlock(&s->mutex);
     return 0;
-
+    }
+  
   gavl_write_file(path, data, len);
 
+  if(added)
+    write_index(s);
+  
+  pthread_mutex_unlock(&s->mutex);
+  
   free(path);
   return 1;
   }
@@ -25,6 +25,7 @@
 
 #include <string.h>
 #include <ctype.h>
+#include <stdarg.h>
 
 #include <gmerlin/utils.h>
 #include <gmerlin/log.h>
@@ -298,22 +299,552 @@ char * bg_sqlite_get_col_str(sqlite3_stmt * st, int col)
   return gavl_strdup((const char*)sqlite3_column_text(st, col));
   }
 
+/* Prepared statement cache */
+
+typedef struct
+  {
+  char * sql;
+  uint32_t hash;
+  sqlite3_stmt * st;
+  int64_t last_use;
+  int in_use;
+  } stmt_cache_entry_t;
+
+struct bg_sqlite_stmt_cache_s
+  {
+  sqlite3 * db;
+
+  stmt_cache_entry_t * entries;
+  int num_entries;
+  int max_entries;
+
+  int64_t counter;
+  
+  int64_t hits;
+  int64_t compiles;
+  };
+
+static uint32_t stmt_hash(const char * str)
+  {
+  /* FNV-1a */
+  uint32_t ret = 2166136261u;
+
+  while(*str)
+    {
+    ret ^= (uint8_t)(*str);
+    ret *= 16777619u;
+    str++;
+    }
+  return ret;
+  }
+
+bg_sqlite_stmt_cache_t * bg_sqlite_stmt_cache_create(sqlite3 * db, int max_stmts)
+  {
+  bg_sqlite_stmt_cache_t * ret = calloc(1, sizeof(*ret));
+
+  ret->db = db;
+  ret->max_entries = max_stmts;
+  ret->entries = calloc(ret->max_entries, sizeof(*ret->entries));
+  return ret;
+  }
+
+void bg_sqlite_stmt_cache_destroy(bg_sqlite_stmt_cache_t * c)
+  {
+  int i;
+
+  bg_sqlite_stmt_cache_log_stats(c);
+  
+  for(i = 0; i < c->num_entries; i++)
+    {
+    sqlite3_finalize(c->entries[i].st);
+    free(c->entries[i].sql);
+    }
+  if(c->entries)
+    free(c->entries);
+  free(c);
+  }
+
+sqlite3 * bg_sqlite_stmt_cache_get_db(bg_sqlite_stmt_cache_t * c)
+  {
+  return c->db;
+  }
+
+static sqlite3_stmt * stmt_compile(bg_sqlite_stmt_cache_t * c, const char * sql)
+  {
+  sqlite3_stmt * ret = NULL;
+  
+  c->compiles++;
+  
+  if(sqlite3_prepare_v2(c->db, sql, -1, &ret, NULL) != SQLITE_OK)
+    {
+    gavl_log(GAVL_LOG_ERROR, LOG_DOMAIN, "Preparing SQL statement: \"%s\" failed: %s",
+             sql, sqlite3_errmsg(c->db));
+    if(ret)
+      sqlite3_finalize(ret);
+    return NULL;
+    }
+  return ret;
+  }
+
+sqlite3_stmt * bg_sqlite_stmt_cache_get(bg_sqlite_stmt_cache_t * c, const char * sql)
+  {
+  int i;
+  uint32_t hash = stmt_hash(sql);
+  stmt_cache_entry_t * e = NULL;
+  
+  c->counter++;
+  
+  for(i = 0; i < c->num_entries; i++)
+    {
+    if((c->entries[i].hash == hash) &&
+       !strcmp(c->entries[i].sql, sql))
+      {
+      e = &c->entries[i];
+      break;
+      }
+    }
+
+  if(e)
+    {
+    /* Nested usage of the same statement: Compile a temporary one */
+    if(e->in_use)
+      return stmt_compile(c, sql);
+    
+    c->hits++;
+    e->in_use = 1;
+    e->last_use = c->counter;
+    return e->st;
+    }
+
+  /* Find a slot */
+  if(c->num_entries < c->max_entries)
+    {
+    e = &c->entries[c->num_entries];
+    c->num_entries++;
+    }
+  else
+    {
+    /* Evict least recently used statement */
+    for(i = 0; i < c->num_entries; i++)
+      {
+      if(c->entries[i].in_use)
+        continue;
+      
+      if(!e || (c->entries[i].last_use < e->last_use))
+        e = &c->entries[i];
+      }
+
+    if(!e) /* All statements are in use */
+      return stmt_compile(c, sql);
+    
+    sqlite3_finalize(e->st);
+    free(e->sql);
+    memset(e, 0, sizeof(*e));
+    }
+  
+  if(!(e->st = stmt_compile(c, sql)))
+    {
+    /* Give the slot back */
+    c->num_entries--;
+    if(e != &c->entries[c->num_entries])
+      memcpy(e, &c->entries[c->num_entries], sizeof(*e));
+    return NULL;
+    }
+  
+  e->sql = gavl_strdup(sql);
+  e->hash = hash;
+  e->last_use = c->counter;
+  e->in_use = 1;
+  return e->st;
+  }
+
+void bg_sqlite_stmt_cache_release(bg_sqlite_stmt_cache_t * c, sqlite3_stmt * st)
+  {
+  int i;
+
+  if(!st)
+    return;
+  
+  for(i = 0; i < c->num_entries; i++)
+    {
+    if(c->entries[i].st == st)
+      {
+      sqlite3_reset(st);
+      sqlite3_clear_bindings(st);
+      c->entries[i].in_use = 0;
+      return;
+      }
+    }
+  /* Temporary statement */
+  sqlite3_finalize(st);
+  }
+
+void bg_sqlite_stmt_cache_get_stats(bg_sqlite_stmt_cache_t * c,
+                                    int64_t * hits, int64_t * compiles)
+  {
+  if(hits)
+    *hits = c->hits;
+  if(compiles)
+    *compiles = c->compiles;
+  }
+
+void bg_sqlite_stmt_cache_log_stats(bg_sqlite_stmt_cache_t * c)
+  {
+  gavl_log(GAVL_LOG_INFO, LOG_DOMAIN,
+           "Statement cache: %"PRId64" hits, %"PRId64" compiles, %d cached statements",
+           c->hits, c->compiles, c->num_entries);
+  }
+
+int bg_sqlite_bind_int(sqlite3_stmt * st, int idx, int val)
+  {
+  return (sqlite3_bind_int(st, idx, val) == SQLITE_OK);
+  }
+
+int bg_sqlite_bind_long(sqlite3_stmt * st, int idx, int64_t val)
+  {
+  return (sqlite3_bind_int64(st, idx, val) == SQLITE_OK);
+  }
+
+int bg_sqlite_bind_string(sqlite3_stmt * st, int idx, const char * val)
+  {
+  if(!val)
+    return (sqlite3_bind_null(st, idx) == SQLITE_OK);
+  return (sqlite3_bind_text(st, idx, val, -1, SQLITE_TRANSIENT) == SQLITE_OK);
+  }
+
+int bg_sqlite_bind_value(sqlite3_stmt * st, int idx, const gavl_value_t * val)
+  {
+  switch(val->type)
+    {
+    case GAVL_TYPE_INT:
+      return bg_sqlite_bind_int(st, idx, val->v.i);
+    case GAVL_TYPE_LONG:
+      return bg_sqlite_bind_long(st, idx, val->v.l);
+    case GAVL_TYPE_FLOAT:
+      return (sqlite3_bind_double(st, idx, val->v.d) == SQLITE_OK);
+    case GAVL_TYPE_STRING:
+      return bg_sqlite_bind_string(st, idx, val->v.str);
+    default:
+      break;
+    }
+  return (sqlite3_bind_null(st, idx) == SQLITE_OK);
+  }
+
+int bg_sqlite_step(sqlite3_stmt * st)
+  {
+  int result = sqlite3_step(st);
+
+  if(result == SQLITE_ROW)
+    return 1;
+  else if(result == SQLITE_DONE)
+    return 0;
+  
+  gavl_log(GAVL_LOG_ERROR, LOG_DOMAIN, "SQL query: \"%s\" failed: %s",
+           sqlite3_sql(st), sqlite3_errmsg(sqlite3_db_handle(st)));
+  return -1;
+  }
+
+#define MAX_STACK_COLS 64
+
+int bg_sqlite_stmt_exec(bg_sqlite_stmt_cache_t * c,
+                        sqlite3_stmt * st,
+                        int (*callback)(void*,int,char**,char**),
+                        void * data)
+  {
+  int i;
+  int result;
+  int ret = 1;
+  int num_cols;
+  char * argv_stack[MAX_STACK_COLS];
+  char * names_stack[MAX_STACK_COLS];
+  char ** argv  = argv_stack;
+  char ** names = names_stack;
+
+  if(!st)
+    return 0;
+  
+  num_cols = sqlite3_column_count(st);
+  
+  if(callback && (num_cols > MAX_STACK_COLS))
+    {
+    argv  = malloc(num_cols * sizeof(*argv));
+    names = malloc(num_cols * sizeof(*names));
+    }
+  
+  while((result = bg_sqlite_step(st)) > 0)
+    {
+    if(!callback)
+      continue;
+    
+    for(i = 0; i < num_cols; i++)
+      {
+      argv[i]  = (char*)sqlite3_column_text(st, i);
+      names[i] = (char*)sqlite3_column_name(st, i);
+      }
+    
+    if(callback(data, num_cols, argv, names))
+      break;
+    }
+
+  if(result < 0)
+    ret = 0;
+  
+  if(argv != argv_stack)
+    {
+    free(argv);
+    free(names);
+    }
+  
+  bg_sqlite_stmt_cache_release(c, st);
+  return ret;
+  }
+
+int64_t bg_sqlite_stmt_get_int(bg_sqlite_stmt_cache_t * c, sqlite3_stmt * st)
+  {
+  int64_t ret = -1;
+
+  if(!st)
+    return -1;
+  
+  if((bg_sqlite_step(st) > 0) &&
+     (sqlite3_column_type(st, 0) != SQLITE_NULL))
+    ret = sqlite3_column_int64(st, 0);
+  
+  bg_sqlite_stmt_cache_release(c, st);
+  return ret;
+  }
+
+int bg_sqlite_exec_cached(bg_sqlite_stmt_cache_t * c,
+                          const char * sql,
+                          int (*callback)(void*,int,char**,char**),
+                          void * data, int num_args, ...)
+  {
+  int i;
+  va_list args;
+  sqlite3_stmt * st;
+
+  if(!(st = bg_sqlite_stmt_cache_get(c, sql)))
+    return 0;
+  
+  va_start(args, num_args);
+
+  for(i = 0; i < num_args; i++)
+    bg_sqlite_bind_long(st, i+1, va_arg(args, int64_t));
+  
+  va_end(args);
+  
+  return bg_sqlite_stmt_exec(c, st, callback, data);
+  }
+
+int64_t bg_sqlite_string_to_id_cached(bg_sqlite_stmt_cache_t * c,
+                                      const char * table,
+                                      const char * id_row,
+                                      const char * string_row,
+                                      const char * str)
+  {
+  char * sql;
+  sqlite3_stmt * st;
+  
+  sql = sqlite3_mprintf("SELECT %s FROM %s WHERE %s = ?1;",
+                        id_row, table, string_row);
+  st = bg_sqlite_stmt_cache_get(c, sql);
+  sqlite3_free(sql);
+
+  if(!st)
+    return -1;
+
+  bg_sqlite_bind_string(st, 1, str);
+  return bg_sqlite_stmt_get_int(c, st);
+  }
+
+int64_t bg_sqlite_get_max_int_cached(bg_sqlite_stmt_cache_t * c, const char * table,
+                                     const char * row)
+  {
+  char * sql;
+  sqlite3_stmt * st;
+  int64_t ret;
+  
+  sql = sqlite3_mprintf("SELECT max(%s) FROM %s;", row, table);
+  st = bg_sqlite_stmt_cache_get(c, sql);
+  sqlite3_free(sql);
+
+  if(!st)
+    return -1;
+  
+  if((bg_sqlite_step(st) < 0))
+    ret = -1;
+  else if(sqlite3_column_type(st, 0) == SQLITE_NULL) // Empty table
+    ret = 0;
+  else
+    ret = sqlite3_column_int64(st, 0);
+  
+  bg_sqlite_stmt_cache_release(c, st);
+
+  if(ret < 0)
+    return -1;
+  return ret;
+  }
+
+int64_t bg_sqlite_string_to_id_add_cached(bg_sqlite_stmt_cache_t * c,
+                                          const char * table,
+                                          const char * id_row,
+                                          const char * string_row,
+                                          const char * str)
+  {
+  char * sql;
+  sqlite3_stmt * st;
+  int result;
+  int64_t ret;
+
+  ret = bg_sqlite_string_to_id_cached(c, table, id_row, string_row, str);
+  if(ret >= 0)
+    return ret;
+  ret = bg_sqlite_get_max_int_cached(c, table, id_row);
+  if(ret < 0)
+    return ret;
+
+  ret++;
+  
+  /* Insert into table */
+  sql = sqlite3_mprintf("INSERT INTO %s ( %s, %s ) VALUES ( ?1, ?2 );",
+                        table, id_row, string_row);
+  st = bg_sqlite_stmt_cache_get(c, sql);
+  sqlite3_free(sql);
+
+  if(!st)
+    return -1;
+
+  bg_sqlite_bind_long(st, 1, ret);
+  bg_sqlite_bind_string(st, 2, str);
+  
+  result = bg_sqlite_stmt_exec(c, st, NULL, NULL);
+  
+  if(!result)
+    return -1;
+  return ret;
+  }
+
+char * bg_sqlite_id_to_string_cached(bg_sqlite_stmt_cache_t * c,
+                                     const char * table,
+                                     const char * string_row,
+                                     const char * id_row,
+                                     int64_t id)
+  {
+  char * sql;
+  char * ret = NULL;
+  sqlite3_stmt * st;
+  
+  sql = sqlite3_mprintf("SELECT %s FROM %s WHERE %s = ?1;",
+                        string_row, table, id_row);
+  st = bg_sqlite_stmt_cache_get(c, sql);
+  sqlite3_free(sql);
+
+  if(!st)
+    return NULL;
+
+  bg_sqlite_bind_long(st, 1, id);
+  
+  if(bg_sqlite_step(st) > 0)
+    {
+    const char * str = (const char*)sqlite3_column_text(st, 0);
+    if(str && (*str != '\0'))
+      ret = gavl_strdup(str);
+    }
+  bg_sqlite_stmt_cache_release(c, st);
+  return ret;
+  }
+
+int64_t bg_sqlite_id_to_id_cached(bg_sqlite_stmt_cache_t * c,
+                                  const char * table,
+                                  const char * dst_row,
+                                  const char * src_row,
+                                  int64_t id)
+  {
+  char * sql;
+  sqlite3_stmt * st;
+  
+  sql = sqlite3_mprintf("SELECT %s FROM %s WHERE %s = ?1;",
+                        dst_row, table, src_row);
+  st = bg_sqlite_stmt_cache_get(c, sql);
+  sqlite3_free(sql);
+
+  if(!st)
+    return -1;
+
+  bg_sqlite_bind_long(st, 1, id);
+  return bg_sqlite_stmt_get_int(c, st);
+  }
+
+/* Strings up to this size are compared and transformed without allocating */
+#define STRCOLL_BUF_SIZE 256
+
+static char * strcoll_copy(char * buf, const void * text, int size)
+  {
+  char * ret;
+
+  if(size < STRCOLL_BUF_SIZE)
+    ret = buf;
+  else
+    ret = malloc(size + 1);
+  
+  memcpy(ret, text, size);
+  ret[size] = '\0';
+  return ret;
+  }
+
 static int compare_func(void* udp, int sizeA, const void* textA, int sizeB, const void* textB)
   {
   int result;
+  char bufA[STRCOLL_BUF_SIZE];
+  char bufB[STRCOLL_BUF_SIZE];
+  
+  char * sA = strcoll_copy(bufA, textA, sizeA);
+  char * sB = strcoll_copy(bufB, textB, sizeB);
 
-  char * sA = gavl_strndup(textA, textA + sizeA);
-  char * sB = gavl_strndup(textB, textB + sizeB);
   result = strcoll(sA, sB);
-  free(sA);
-  free(sB);
+
+  if(sA != bufA)
+    free(sA);
+  if(sB != bufB)
+    free(sB);
   
   return result;
   }
 
+/* sortkey(text): strxfrm() of the argument as BLOB. BLOBs are compared with
+   memcmp(), which gives the same order as strcoll() on the strings */
+
+static void sortkey_func(sqlite3_context * ctx, int argc, sqlite3_value ** argv)
+  {
+  size_t len;
+  char * key;
+  const char * str;
+  char buf[STRCOLL_BUF_SIZE];
+  
+  if(!(str = (const char*)sqlite3_value_text(argv[0])))
+    {
+    sqlite3_result_null(ctx);
+    return;
+    }
+  
+  len = strxfrm(buf, str, STRCOLL_BUF_SIZE);
+  
+  if(len < STRCOLL_BUF_SIZE)
+    {
+    sqlite3_result_blob(ctx, buf, len, SQLITE_TRANSIENT);
+    return;
+    }
+
+  key = malloc(len + 1);
+  strxfrm(key, str, len + 1);
+  sqlite3_result_blob(ctx, key, len, free);
+  }
+
 void bg_sqlite_init_strcoll(sqlite3 * db)
   {
   sqlite3_create_collation(db, "strcoll", SQLITE_UTF8, NULL, compare_func);
+  sqlite3_create_function(db, "sortkey", 1, SQLITE_UTF8 | SQLITE_DETERMINISTIC, NULL,
+                          sortkey_func, NULL, NULL);
   }
 
 char * bg_sqlite_make_group_condition(const char * id)
@@ -32,6 +32,7 @@
 
 #include <gmerlin/utils.h>
 #include <gmerlin/upnp/didl.h>
+#include <gmerlin/mdb.h>
 
 
 #include <gmerlin/translation.h>
@@ -929,3 +930,436 @@ xmlNodePtr bg_track_to_didl(xmlDocPtr ret, const gavl_dictionary_t * track, char
   return data.node;
   }
 
+
+/*
+ *  Search- and SortCriteria (ContentDirectory v1, section 2.5.5 and 2.5.7)
+ *
+ *  The search criteria are converted into the query tree understood by
+ *  BG_FUNC_DB_SEARCH (see gmerlin/mdb.h).
+ */
+
+/* Maximum nesting depth of parentheses. The criteria come from the
+   network, so don't let them exhaust the stack */
+#define SEARCH_MAX_DEPTH 32
+
+typedef struct
+  {
+  const char * pos;
+  char * tok;
+  int quoted;
+  int depth;
+  } search_parser_t;
+
+static void search_advance(search_parser_t * p)
+  {
+  const char * end;
+  char * dst;
+  
+  if(p->tok)
+    {
+    free(p->tok);
+    p->tok = NULL;
+    }
+  p->quoted = 0;
+  
+  while(isspace(*p->pos))
+    p->pos++;
+
+  if(*p->pos == '\0')
+    return;
+
+  if((*p->pos == '(') || (*p->pos == ')'))
+    {
+    p->tok = gavl_strndup(p->pos, p->pos + 1);
+    p->pos++;
+    return;
+    }
+
+  if(*p->pos == '"')
+    {
+    p->pos++;
+    p->quoted = 1;
+    
+    p->tok = malloc(strlen(p->pos) + 1);
+    dst = p->tok;
+    
+    while(*p->pos && (*p->pos != '"'))
+      {
+      if((*p->pos == '\\') && p->pos[1])
+        p->pos++;
+      *(dst++) = *(p->pos++);
+      }
+    *dst = '\0';
+    
+    if(*p->pos == '"')
+      p->pos++;
+    return;
+    }
+  
+  end = p->pos;
+  while(*end && !isspace(*end) && (*end != '(') && (*end != ')') && (*end != '"'))
+    end++;
+
+  p->tok = gavl_strndup(p->pos, end);
+  p->pos = end;
+  }
+
+static int search_is_word(search_parser_t * p, const char * word)
+  {
+  return p->tok && !p->quoted && !strcasecmp(p->tok, word);
+  }
+
+static gavl_dictionary_t * search_append_node(gavl_array_t * arr)
+  {
+  gavl_value_t val;
+  gavl_value_init(&val);
+  gavl_value_set_dictionary(&val);
+  gavl_array_splice_val_nocopy(arr, -1, 0, &val);
+  return gavl_value_get_dictionary_nc(&arr->entries[arr->num_entries-1]);
+  }
+
+static void search_set_node(gavl_dictionary_t * ret,
+                            const char * op, const char * tag, const char * val)
+  {
+  gavl_dictionary_set_string(ret, BG_MDB_SEARCH_OP, op);
+  gavl_dictionary_set_string(ret, BG_MDB_SEARCH_TAG, tag);
+  gavl_dictionary_set_string(ret, BG_MDB_SEARCH_VAL, val);
+  }
+
+/* upnp:class = "x" and upnp:class derivedfrom "x" can match more than one
+   gavl class. */
+
+static int search_class_to_query(const char * op, const char * val,
+                                 gavl_dictionary_t * ret)
+  {
+  int i;
+  int derived;
+  int negate = 0;
+  const char * klass;
+  gavl_array_t classes;
+  gavl_array_t * args;
+  
+  if(!strcmp(op, "exists"))
+    {
+    search_set_node(ret, BG_MDB_SEARCH_OP_EXISTS, GAVL_META_CLASS, val);
+    return 1;
+    }
+
+  if(!strcmp(op, "derivedfrom"))
+    derived = 1;
+  else if(!strcmp(op, "="))
+    derived = 0;
+  else if(!strcmp(op, "!="))
+    {
+    derived = 0;
+    negate = 1;
+    }
+  else
+    return 0;
+
+  gavl_array_init(&classes);
+  
+  for(i = 0; class_names[i].gavl_class; i++)
+    {
+    if((derived && gavl_string_starts_with(class_names[i].didl_class, val)) ||
+       (!derived && !strcmp(class_names[i].didl_class, val)))
+      {
+      if(gavl_string_array_indexof(&classes, class_names[i].gavl_class) < 0)
+        gavl_string_array_add(&classes, class_names[i].gavl_class);
+      }
+    }
+
+  if(!classes.num_entries && (klass = class_didl_to_gavl(val)))
+    gavl_string_array_add(&classes, klass);
+
+  if(classes.num_entries == 1)
+    {
+    search_set_node(ret, negate ? BG_MDB_SEARCH_OP_NOT_EQUAL : BG_MDB_SEARCH_OP_EQUAL,
+                    GAVL_META_CLASS, gavl_string_array_get(&classes, 0));
+    }
+  else if(!classes.num_entries)
+    {
+    /* Unknown class: Matches nothing (or everything if negated) */
+    search_set_node(ret, BG_MDB_SEARCH_OP_EXISTS, GAVL_META_CLASS,
+                    negate ? "true" : "false");
+    }
+  else
+    {
+    /* !(a | b) = !a & !b */
+    gavl_dictionary_set_string(ret, BG_MDB_SEARCH_OP,
+                               negate ? BG_MDB_SEARCH_OP_AND : BG_MDB_SEARCH_OP_OR);
+    args = gavl_dictionary_get_array_create(ret, BG_MDB_SEARCH_ARGS);
+    
+    for(i = 0; i < classes.num_entries; i++)
+      search_set_node(search_append_node(args),
+                      negate ? BG_MDB_SEARCH_OP_NOT_EQUAL : BG_MDB_SEARCH_OP_EQUAL,
+                      GAVL_META_CLASS, gavl_string_array_get(&classes, i));
+    }
+  
+  gavl_array_free(&classes);
+  return 1;
+  }
+
+static int search_rel_to_query(const char * prop, const char * op, const char * val,
+                               gavl_dictionary_t * ret)
+  {
+  int i;
+  const char * tag = NULL;
+  
+  static const char * ops[] =
+    {
+      BG_MDB_SEARCH_OP_EQUAL,
+      BG_MDB_SEARCH_OP_NOT_EQUAL,
+      BG_MDB_SEARCH_OP_LESS,
+      BG_MDB_SEARCH_OP_LESS_EQUAL,
+      BG_MDB_SEARCH_OP_GREATER,
+      BG_MDB_SEARCH_OP_GREATER_EQUAL,
+      BG_MDB_SEARCH_OP_CONTAINS,
+      BG_MDB_SEARCH_OP_NOT_CONTAINS,
+      BG_MDB_SEARCH_OP_EXISTS,
+      NULL
+    };
+  
+  if(!strcmp(prop, "upnp:class"))
+    return search_class_to_query(op, val, ret);
+
+  for(i = 0; gavl_didl_names[i].gavl_name; i++)
+    {
+    if(!strcmp(gavl_didl_names[i].didl_name, prop))
+      {
+      tag = gavl_didl_names[i].gavl_name;
+      break;
+      }
+    }
+
+  if(!tag)
+    {
+    /* Properties we don't know simply don't exist */
+    if(strcmp(op, BG_MDB_SEARCH_OP_EXISTS))
+      {
+      gavl_log(GAVL_LOG_WARNING, LOG_DOMAIN, "Unsupported search property %s", prop);
+      return 0;
+      }
+    tag = prop;
+    }
+
+  for(i = 0; ops[i]; i++)
+    {
+    if(!strcmp(ops[i], op))
+      {
+      search_set_node(ret, op, tag, val);
+      return 1;
+      }
+    }
+  
+  gavl_log(GAVL_LOG_WARNING, LOG_DOMAIN, "Unsupported search operator %s", op);
+  return 0;
+  }
+
+static int search_parse_or(search_parser_t * p, gavl_dictionary_t * ret);
+
+static int search_parse_primary(search_parser_t * p, gavl_dictionary_t * ret)
+  {
+  int result = 0;
+  char * prop = NULL;
+  char * op = NULL;
+  
+  if(!p->tok)
+    return 0;
+  
+  if(!p->quoted && !strcmp(p->tok, "("))
+    {
+    if(p->depth >= SEARCH_MAX_DEPTH)
+      {
+      gavl_log(GAVL_LOG_WARNING, LOG_DOMAIN, "Search criteria nested too deeply");
+      return 0;
+      }
+    
+    search_advance(p);
+
+    p->depth++;
+    result = search_parse_or(p, ret);
+    p->depth--;
+    
+    if(!result ||
+       !p->tok || p->quoted || strcmp(p->tok, ")"))
+      return 0;
+    search_advance(p);
+    return 1;
+    }
+
+  if(p->quoted)
+    return 0;
+  
+  /* relExp: property binOp quotedVal | property existsOp boolVal */
+  prop = p->tok;
+  p->tok = NULL;
+  search_advance(p);
+
+  if(!p->tok || p->quoted)
+    goto fail;
+  
+  op = p->tok;
+  p->tok = NULL;
+  search_advance(p);
+
+  if(!p->tok)
+    goto fail;
+
+  if(!strcmp(op, "exists") &&
+     (p->quoted || (strcmp(p->tok, "true") && strcmp(p->tok, "false"))))
+    goto fail;
+  
+  if(!search_rel_to_query(prop, op, p->tok, ret))
+    goto fail;
+  
+  search_advance(p);
+  result = 1;
+  
+  fail:
+
+  free(prop);
+  if(op)
+    free(op);
+  return result;
+  }
+
+static int search_parse_and(search_parser_t * p, gavl_dictionary_t * ret)
+  {
+  gavl_dictionary_t node;
+  gavl_array_t * args;
+  
+  gavl_dictionary_init(&node);
+  
+  if(!search_parse_primary(p, &node))
+    {
+    gavl_dictionary_free(&node);
+    return 0;
+    }
+
+  if(!search_is_word(p, "and"))
+    {
+    gavl_dictionary_move(ret, &node);
+    return 1;
+    }
+
+  gavl_dictionary_set_string(ret, BG_MDB_SEARCH_OP, BG_MDB_SEARCH_OP_AND);
+  args = gavl_dictionary_get_array_create(ret, BG_MDB_SEARCH_ARGS);
+  gavl_dictionary_move(search_append_node(args), &node);
+  
+  while(search_is_word(p, "and"))
+    {
+    search_advance(p);
+    if(!search_parse_primary(p, search_append_node(args)))
+      return 0;
+    }
+  return 1;
+  }
+
+static int search_parse_or(search_parser_t * p, gavl_dictionary_t * ret)
+  {
+  gavl_dictionary_t node;
+  gavl_array_t * args;
+  
+  gavl_dictionary_init(&node);
+  
+  if(!search_parse_and(p, &node))
+    {
+    gavl_dictionary_free(&node);
+    return 0;
+    }
+
+  if(!search_is_word(p, "or"))
+    {
+    gavl_dictionary_move(ret, &node);
+    return 1;
+    }
+
+  gavl_dictionary_set_string(ret, BG_MDB_SEARCH_OP, BG_MDB_SEARCH_OP_OR);
+  args = gavl_dictionary_get_array_create(ret, BG_MDB_SEARCH_ARGS);
+  gavl_dictionary_move(search_append_node(args), &node);
+  
+  while(search_is_word(p, "or"))
+    {
+    search_advance(p);
+    if(!search_parse_and(p, search_append_node(args)))
+      return 0;
+    }
+  return 1;
+  }
+
+int bg_didl_parse_search_criteria(const char * str, gavl_dictionary_t * ret)
+  {
+  int result;
+  search_parser_t p;
+
+  memset(&p, 0, sizeof(p));
+  p.pos = str;
+  
+  search_advance(&p);
+
+  /* Empty or "*": Match everything */
+  if(!p.tok || (!p.quoted && !strcmp(p.tok, "*") && !p.pos[strspn(p.pos, " \t\r\n")]))
+    {
+    if(p.tok)
+      free(p.tok);
+    return 1;
+    }
+  
+  result = search_parse_or(&p, ret);
+
+  /* Trailing garbage */
+  if(result && p.tok)
+    result = 0;
+  
+  if(p.tok)
+    free(p.tok);
+
+  if(!result)
+    gavl_log(GAVL_LOG_WARNING, LOG_DOMAIN, "Invalid search criteria: %s", str);
+  
+  return result;
+  }
+
+int bg_didl_parse_sort_criteria(const char * str, gavl_array_t * ret)
+  {
+  int i, j;
+  char ** arr;
+  const char * name;
+  char dir;
+  
+  if(!str || (*str == '\0'))
+    return 1;
+  
+  arr = gavl_strbreak(str, ',');
+
+  for(i = 0; arr[i]; i++)
+    {
+    name = gavl_strip_space(arr[i]);
+
+    dir = '+';
+    if((*name == '+') || (*name == '-'))
+      {
+      dir = *name;
+      name++;
+      }
+
+    for(j = 0; gavl_didl_names[j].gavl_name; j++)
+      {
+      if(!strcmp(gavl_didl_names[j].didl_name, name))
+        break;
+      }
+
+    if(!gavl_didl_names[j].gavl_name)
+      {
+      gavl_log(GAVL_LOG_WARNING, LOG_DOMAIN, "Unsupported sort property %s", name);
+      gavl_strbreak_free(arr);
+      return 0;
+      }
+    
+    gavl_string_array_add_nocopy(ret, gavl_sprintf("%c%s", dir, gavl_didl_names[j].gavl_name));
+    }
+  
+  gavl_strbreak_free(arr);
+  return 1;
+  }
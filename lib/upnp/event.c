@@ -23,6 +23,7 @@
 
 #include <unistd.h>
 #include <string.h>
+#include <pthread.h>
 
 #include <config.h>
 
@@ -93,6 +94,8 @@
 #define SERVER_VALUE_CHANGED  "changed"
 #define SERVER_COUNTER        "counter"
 #define SERVER_EXPIRE_TIME    "expire_time"
+#define SERVER_INITIAL        "initial"       // Initial event not sent yet
+#define SERVER_INITIAL_EVENT  "initial_event" // Copies to be sent only
 
 static gavl_dictionary_t * server_get_vars_nc(gavl_dictionary_t * dict)
   {
@@ -272,8 +275,10 @@ static char * create_event(gavl_dictionary_t * dict, int * len, int force, gavl_
   return ret;
   }
 
-static int send_event(gavl_dictionary_t * es,
-                      char * event, int len)
+/* es is a copy made by snapshot_subscription(), the SEQ is already assigned */
+
+static int send_event(const gavl_dictionary_t * es,
+                      const char * event, int len)
   {
   gavl_dictionary_t m;
   gavl_socket_address_t * addr = NULL;
@@ -328,12 +333,7 @@ static int send_event(gavl_dictionary_t * es,
   tmp_string = gavl_sprintf("uuid:%s", uuid);  
   gavl_dictionary_set_string(&m, "SID", tmp_string);
   free(tmp_string);
-  gavl_dictionary_set_long(&m, "SEQ", key++);
-
-  if(key > 0x100000000LL)
-    key = 0;
-
-  gavl_dictionary_set_long(es, SERVER_COUNTER, key);
+  gavl_dictionary_set_long(&m, "SEQ", key);
   
   //  fprintf(stderr, "Sending event: %s (%d %d)\n", es->url, len, strlen(event));
   //  gavl_dictionary_dump(&m, 0);
@@ -343,7 +343,7 @@ static int send_event(gavl_dictionary_t * es,
     {
     goto fail;
     }
-  if(!gavl_io_write_data(io, (uint8_t*)event, len))
+  if(!gavl_io_write_data(io, (const uint8_t*)event, len))
     {
     goto fail;
     }
@@ -406,8 +406,6 @@ static int add_subscription(gavl_dictionary_t * dict,
   uuid_t uuid;
   int seconds;
   int result = 0;
-  char * event = NULL;
-  int len;
   gavl_value_t val;
   gavl_array_t * arr;
   char uuid_str[37];
@@ -461,13 +459,11 @@ static int add_subscription(gavl_dictionary_t * dict,
 
   bg_http_connection_write_res(conn);
 
-  len = 0;
-
   //  fprintf(stderr, "Add subscription\n");
   //  gavl_dictionary_dump(s, 2);
-  
-  if((event = create_event(dict, &len, 1, GAVL_TIME_UNDEFINED)))
-    send_event(s, event, len);
+
+  /* Sent by bg_upnp_event_context_server_update() before any other event */
+  gavl_dictionary_set_int(s, SERVER_INITIAL, 1);
   
   result = 1;
   
@@ -481,8 +477,6 @@ static int add_subscription(gavl_dictionary_t * dict,
   else
     gavl_array_splice_val_nocopy(arr, -1, 0, &val);
   
-  if(event)
-    free(event);
   return result;
   }
 
@@ -504,7 +498,12 @@ static int find_subscription(gavl_dictionary_t * dict, const char * sid)
   return -1;
   }
 
-static int server_handle_http(bg_http_connection_t * conn, void * data)
+/* Subscriptions are handled by the http worker threads while the
+   variables are updated by the main thread */
+
+static pthread_mutex_t server_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static void server_handle_http_locked(bg_http_connection_t * conn, void * data)
   {
   gavl_dictionary_t * dict = data;
 
@@ -532,7 +531,7 @@ static int server_handle_http(bg_http_connection_t * conn, void * data)
         {
         
         add_subscription(dict, conn, callback, timeout);
-        return 1;
+        return;
         }
       else
         {
@@ -598,9 +597,14 @@ static int server_handle_http(bg_http_connection_t * conn, void * data)
     bg_http_connection_init_res(conn, "HTTP/1.1", 400, "Bad Request");
   
   bg_http_connection_write_res(conn);
+  }
+
+static int server_handle_http(bg_http_connection_t * conn, void * data)
+  {
+  pthread_mutex_lock(&server_mutex);
+  server_handle_http_locked(conn, data);
+  pthread_mutex_unlock(&server_mutex);
   return 1;
-  
-  
   }
   
 void bg_upnp_event_context_init_server(gavl_dictionary_t * dict,
@@ -621,12 +625,17 @@ void bg_upnp_event_context_server_set_value(gavl_dictionary_t * dict, const char
   gavl_dictionary_t * var;
 
   
+  pthread_mutex_lock(&server_mutex);
+  
   vars = server_get_vars_nc(dict);
   var = gavl_dictionary_get_dictionary_create(vars, name);
   
   if((old_value = gavl_dictionary_get_string(var, SERVER_VALUE)) &&
      !strcmp(old_value, val))
+    {
+    pthread_mutex_unlock(&server_mutex);
     return;
+    }
 
   gavl_dictionary_set_string(var, SERVER_VALUE, val);
   gavl_dictionary_set_int(var, SERVER_VALUE_CHANGED, 1);
@@ -636,7 +645,7 @@ void bg_upnp_event_context_server_set_value(gavl_dictionary_t * dict, const char
     /* Send events not immediately */
     gavl_dictionary_set_long(var, SERVER_EVENT_INTERVAL, update_interval);
     }
-  
+  pthread_mutex_unlock(&server_mutex);
   }
 
 const char * bg_upnp_event_context_server_get_value(const gavl_dictionary_t * dict, const char * name)
@@ -651,22 +660,89 @@ const char * bg_upnp_event_context_server_get_value(const gavl_dictionary_t * di
     return NULL;
   }
 
-/* Send moderate events */
+char * bg_upnp_event_context_server_get_value_dup(const gavl_dictionary_t * dict, const char * name)
+  {
+  char * ret;
+  pthread_mutex_lock(&server_mutex);
+  ret = gavl_strdup(bg_upnp_event_context_server_get_value(dict, name));
+  pthread_mutex_unlock(&server_mutex);
+  return ret;
+  }
 
-int bg_upnp_event_context_server_update(gavl_dictionary_t * dict)
+/* Copy a subscription for sending and assign the next SEQ */
+
+static void snapshot_subscription(gavl_array_t * ret, gavl_dictionary_t * es,
+                                  const char * initial_event)
+  {
+  int64_t key = 0;
+  gavl_value_t val;
+  gavl_dictionary_t * copy;
+
+  gavl_value_init(&val);
+  copy = gavl_value_set_dictionary(&val);
+  gavl_dictionary_copy(copy, es);
+
+  if(initial_event)
+    gavl_dictionary_set_string(copy, SERVER_INITIAL_EVENT, initial_event);
+  
+  gavl_dictionary_get_long(es, SERVER_COUNTER, &key);
+  key++;
+  if(key > 0x100000000LL)
+    key = 0;
+  gavl_dictionary_set_long(es, SERVER_COUNTER, key);
+  
+  gavl_array_splice_val_nocopy(ret, -1, 0, &val);
+  }
+
+static void delete_subscription(gavl_dictionary_t * dict, const char * id)
+  {
+  int i;
+  gavl_array_t * arr;
+  const gavl_dictionary_t * es;
+  const char * val;
+  
+  pthread_mutex_lock(&server_mutex);
 
+  arr = server_get_subscriptions(dict);
+  
+  for(i = 0; i < arr->num_entries; i++)
+    {
+    if((es = gavl_value_get_dictionary(&arr->entries[i])) &&
+       (val = gavl_dictionary_get_string(es, GAVL_META_ID)) &&
+       !strcmp(val, id))
+      {
+      gavl_log(GAVL_LOG_INFO, LOG_DOMAIN, "Deleting subscription %s", id);
+      gavl_array_splice_val(arr, i, 1, NULL);
+      break;
+      }
+    }
+  pthread_mutex_unlock(&server_mutex);
+  }
+
+/* Send moderate events */
 
+int bg_upnp_event_context_server_update(gavl_dictionary_t * dict)
   {
   int i = 0;
   int ret = 0;
+  int initial;
   char * event;
+  char * initial_event;
   int event_len = 0;
+  int result;
   gavl_array_t * arr;
   gavl_dictionary_t * es;
-
+  const gavl_dictionary_t * copy;
+  const char * str;
+  gavl_array_t send;
+  
   gavl_time_t expire_time;
 
   gavl_time_t current_time = gavl_time_get_monotonic();
+
+  gavl_array_init(&send);
+  
+  pthread_mutex_lock(&server_mutex);
   
   arr = server_get_subscriptions(dict);
   
@@ -689,36 +765,59 @@ int bg_upnp_event_context_server_update(gavl_dictionary_t * dict)
       i++;
     }
 
+  /* Initial events of new subscriptions */
+
+  for(i = 0; i < arr->num_entries; i++)
+    {
+    es = gavl_value_get_dictionary_nc(&arr->entries[i]);
+
+    if(!gavl_dictionary_get_int(es, SERVER_INITIAL, &initial) || !initial)
+      continue;
+
+    if((initial_event = create_event(dict, &event_len, 1, GAVL_TIME_UNDEFINED)))
+      {
+      snapshot_subscription(&send, es, initial_event);
+      free(initial_event);
+      ret++;
+      }
+    gavl_dictionary_set(es, SERVER_INITIAL, NULL);
+    }
+  
   /* Check wether to send events */
   
   if((event = create_event(dict, &event_len, 0, current_time)))
     {
-    i = 0;
-
     //    gavl_log(GAVL_LOG_INFO, LOG_DOMAIN, "Sending event");
     
     //    fprintf(stderr, "Sending event: %s\n", event);
     
-    while(i < arr->num_entries)
-      {
-      es = gavl_value_get_dictionary_nc(&arr->entries[i]);
-      
-      if(!send_event(es, event, event_len))
-        {
-        gavl_log(GAVL_LOG_INFO, LOG_DOMAIN, "Deleting subscription %s",
-               gavl_dictionary_get_string(es, GAVL_META_ID));
-        
-        gavl_array_splice_val(arr, i, 1, NULL);
-        }
-      else
-        i++;
-      }
-    
-    free(event);
+    for(i = 0; i < arr->num_entries; i++)
+      snapshot_subscription(&send, gavl_value_get_dictionary_nc(&arr->entries[i]), NULL);
     ret++;
     }
-  return ret;
+  pthread_mutex_unlock(&server_mutex);
+
+  /* Send without holding the lock: A slow subscriber must not block
+     the http workers */
+  
+  for(i = 0; i < send.num_entries; i++)
+    {
+    copy = gavl_value_get_dictionary(&send.entries[i]);
+
+    if((str = gavl_dictionary_get_string(copy, SERVER_INITIAL_EVENT)))
+      result = send_event(copy, str, strlen(str));
+    else
+      result = send_event(copy, event, event_len);
+    
+    if(!result)
+      delete_subscription(dict, gavl_dictionary_get_string(copy, GAVL_META_ID));
+    }
+
+  if(event)
+    free(event);
+  gavl_array_free(&send);
   
+  return ret;
   }
 
 
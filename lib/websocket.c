@@ -28,6 +28,8 @@
 #include <sys/socket.h>
 #include <netinet/tcp.h>
 
+#include <zlib.h>
+
 #include <config.h>
 
 #include <gavl/numptr.h>
@@ -56,6 +58,23 @@
 #define PING_INTERVAL  (2*GAVL_TIME_SCALE)
 #define PING_TIMEOUT  (10*GAVL_TIME_SCALE)
 
+/* Subprotocols (Sec-WebSocket-Protocol) */
+#define PROTOCOL_JSON   "json"        // Text frames, see bg_msg_to_json()
+#define PROTOCOL_BINARY "gmerlin-bin" // Binary frames, see bg_msg_to_buffer()
+
+#define ENCODING_JSON   0
+#define ENCODING_BINARY 1
+#define NUM_ENCODINGS   2
+
+/* Encoded broadcast messages, which are remembered during one iteration */
+#define ENCODE_CACHE_SIZE 64
+
+/* permessage-deflate (RFC 7692) */
+#define DEFLATE_EXTENSION "permessage-deflate"
+#define DEFLATE_MIN_SIZE  256 // Smaller messages are sent uncompressed
+#define DEFLATE_LEVEL     3
+#define DEFLATE_MAX_SIZE  (64*1024*1024) // Maximum size of an inflated message
+
 // #define STATE_CLOSED    0 // Must be 0 for initialization
 // #define STATE_RUNNING   1
 // #define STATE_FINISHED  2
@@ -71,6 +90,38 @@
  * Common for server and client
  **************************************************************/
 
+/* Payload, which is shared by several server connections.
+   Protected by the conn_mutex of the context */
+
+typedef struct
+  {
+  gavl_buffer_t buf;
+  int refcount;
+  int compressed;
+  } frame_payload_t;
+
+typedef struct
+  {
+  int enabled;
+  int no_context_takeover; // Reset our compressor after each message
+  int window_bits;         // Of our compressor
+  
+  z_stream def;
+  z_stream inf;
+  int def_init;
+  int inf_init;
+  } deflate_t;
+
+/* Extension parameters */
+
+typedef struct
+  {
+  int server_no_context_takeover;
+  int client_no_context_takeover;
+  int server_max_window_bits; // 0 if not given
+  int client_max_window_bits; // 0 if not given, -1 if given without value
+  } deflate_params_t;
+
 typedef struct
   {
   gavl_buffer_t buf;
@@ -79,6 +130,10 @@ typedef struct
   int head_written;
 
   uint8_t * mask;
+
+  /* If non-NULL, the payload is taken from here and
+     buf is only used for the write position */
+  frame_payload_t * payload;
   } msg_write_t;
 
 
@@ -88,6 +143,14 @@ struct bg_websocket_connection_s
   
   int is_client;
 
+  /* ENCODING_JSON or ENCODING_BINARY, negotiated during handshake */
+  int encoding;
+  
+  /* Context for server connections */
+  bg_websocket_context_t * ctx;
+
+  deflate_t z;
+
   /* handled by the thread of the context */
 
   gavl_time_t last_ping_time;
@@ -111,6 +174,9 @@ struct bg_websocket_connection_s
     
     uint64_t payload_len;
     uint64_t payload_read;
+
+    int opcode; // Of the first frame
+    int compressed;
     
     } read_msg;
   
@@ -121,6 +187,23 @@ struct bg_websocket_connection_s
   
   };
 
+static frame_payload_t * payload_create()
+  {
+  frame_payload_t * ret = calloc(1, sizeof(*ret));
+  ret->refcount = 1;
+  return ret;
+  }
+
+static void payload_unref(frame_payload_t * p)
+  {
+  p->refcount--;
+  if(!p->refcount)
+    {
+    gavl_buffer_free(&p->buf);
+    free(p);
+    }
+  }
+
 static void msg_write_reset(msg_write_t * msg)
   {
   //  fprintf(stderr, "msg_write_reset\n");
@@ -128,6 +211,12 @@ static void msg_write_reset(msg_write_t * msg)
   msg->head_len = 0;
   msg->head_written = 0;
   msg->mask = NULL;
+
+  if(msg->payload)
+    {
+    payload_unref(msg->payload);
+    msg->payload = NULL;
+    }
   }
 
 static void conn_reset_read_msg_segment(bg_websocket_connection_t * conn)
@@ -143,6 +232,217 @@ static void conn_reset_read_msg(bg_websocket_connection_t * conn)
   {
   conn_reset_read_msg_segment(conn);
   gavl_buffer_reset(&conn->read_msg.buf);
+  conn->read_msg.opcode = 0;
+  conn->read_msg.compressed = 0;
+  }
+
+/* Compression */
+
+static void deflate_free(deflate_t * z)
+  {
+  if(z->def_init)
+    deflateEnd(&z->def);
+  if(z->inf_init)
+    inflateEnd(&z->inf);
+  memset(z, 0, sizeof(*z));
+  }
+
+/* Append the compressed data to out */
+
+static int deflate_data(deflate_t * z, const uint8_t * data, int len, gavl_buffer_t * out)
+  {
+  int result;
+  
+  if(!z->def_init)
+    {
+    memset(&z->def, 0, sizeof(z->def));
+    
+    /* Negative window bits: Raw deflate without zlib header */
+    if(deflateInit2(&z->def, DEFLATE_LEVEL, Z_DEFLATED, -z->window_bits,
+                    8, Z_DEFAULT_STRATEGY) != Z_OK)
+      {
+      gavl_log(GAVL_LOG_ERROR, LOG_DOMAIN, "deflateInit2 failed");
+      return 0;
+      }
+    z->def_init = 1;
+    }
+
+  z->def.next_in = (Bytef*)data;
+  z->def.avail_in = len;
+
+  do
+    {
+    gavl_buffer_alloc(out, out->len + len / 4 + 64);
+    z->def.next_out = out->buf + out->len;
+    z->def.avail_out = out->alloc - out->len;
+    
+    result = deflate(&z->def, Z_SYNC_FLUSH);
+    out->len = out->alloc - z->def.avail_out;
+
+    if((result != Z_OK) && (result != Z_BUF_ERROR))
+      {
+      gavl_log(GAVL_LOG_ERROR, LOG_DOMAIN, "deflate failed: %d", result);
+      /* The other side never sees this, so we start over */
+      deflateReset(&z->def);
+      return 0;
+      }
+    } while(z->def.avail_in || !z->def.avail_out);
+
+  /* Strip the empty block appended by Z_SYNC_FLUSH (RFC 7692, 7.2.1) */
+  if((out->len >= 4) &&
+     !memcmp(out->buf + out->len - 4, "\x00\x00\xff\xff", 4))
+    out->len -= 4;
+  
+  if(z->no_context_takeover)
+    deflateReset(&z->def);
+  
+  return 1;
+  }
+
+/* Replace the buffer content with the inflated data */
+
+static int inflate_data(deflate_t * z, gavl_buffer_t * buf)
+  {
+  int result;
+  gavl_buffer_t out;
+
+  if(!z->inf_init)
+    {
+    memset(&z->inf, 0, sizeof(z->inf));
+    
+    /* We accept any window size */
+    if(inflateInit2(&z->inf, -MAX_WBITS) != Z_OK)
+      {
+      gavl_log(GAVL_LOG_ERROR, LOG_DOMAIN, "inflateInit2 failed");
+      return 0;
+      }
+    z->inf_init = 1;
+    }
+  
+  gavl_buffer_init(&out);
+  
+  /* Re-append the tail removed by the sender */
+  gavl_buffer_append_data(buf, (const uint8_t*)"\x00\x00\xff\xff", 4);
+  
+  z->inf.next_in = buf->buf;
+  z->inf.avail_in = buf->len;
+  
+  do
+    {
+    if(out.len > DEFLATE_MAX_SIZE)
+      {
+      gavl_log(GAVL_LOG_ERROR, LOG_DOMAIN, "Inflated message too large");
+      goto fail;
+      }
+    
+    gavl_buffer_alloc(&out, out.len + 4 * buf->len + 1024);
+    z->inf.next_out = out.buf + out.len;
+    z->inf.avail_out = out.alloc - out.len;
+
+    result = inflate(&z->inf, Z_SYNC_FLUSH);
+    out.len = out.alloc - z->inf.avail_out;
+
+    if(result == Z_STREAM_END)
+      {
+      /* Final block: The next message will start a new stream */
+      inflateReset(&z->inf);
+      break;
+      }
+    else if(result == Z_BUF_ERROR)
+      {
+      if(z->inf.avail_out)
+        break;
+      }
+    else if(result != Z_OK)
+      {
+      gavl_log(GAVL_LOG_ERROR, LOG_DOMAIN, "inflate failed: %d", result);
+      goto fail;
+      }
+    } while(z->inf.avail_in || !z->inf.avail_out);
+
+  /* Zero terminate for json */
+  gavl_buffer_alloc(&out, out.len + 1);
+  out.buf[out.len] = '\0';
+  
+  gavl_buffer_free(buf);
+  memcpy(buf, &out, sizeof(out));
+  return 1;
+  
+  fail:
+  gavl_buffer_free(&out);
+  return 0;
+  }
+
+/* Parse one extension like "permessage-deflate; client_max_window_bits" */
+
+static int parse_deflate_params(const char * str, deflate_params_t * ret)
+  {
+  int i;
+  int result = 0;
+  char ** params;
+  char * name;
+  char * val;
+  
+  memset(ret, 0, sizeof(*ret));
+  
+  params = gavl_strbreak(str, ';');
+
+  if(!params || !params[0] ||
+     strcmp(gavl_strip_space(params[0]), DEFLATE_EXTENSION))
+    goto fail;
+
+  for(i = 1; params[i]; i++)
+    {
+    name = gavl_strip_space(params[i]);
+
+    if((val = strchr(name, '=')))
+      {
+      *val = '\0';
+      val++;
+      name = gavl_strip_space(name);
+      val = gavl_strip_space(val);
+
+      /* Values can be quoted */
+      if(*val == '"')
+        {
+        val++;
+        if(*val && (val[strlen(val)-1] == '"'))
+          val[strlen(val)-1] = '\0';
+        }
+      }
+
+    if(!strcmp(name, "server_no_context_takeover") && !val)
+      ret->server_no_context_takeover = 1;
+    else if(!strcmp(name, "client_no_context_takeover") && !val)
+      ret->client_no_context_takeover = 1;
+    else if(!strcmp(name, "server_max_window_bits") && val)
+      {
+      ret->server_max_window_bits = atoi(val);
+      if((ret->server_max_window_bits < 8) || (ret->server_max_window_bits > 15))
+        goto fail;
+      }
+    else if(!strcmp(name, "client_max_window_bits"))
+      {
+      if(val)
+        {
+        ret->client_max_window_bits = atoi(val);
+        if((ret->client_max_window_bits < 8) || (ret->client_max_window_bits > 15))
+          goto fail;
+        }
+      else
+        ret->client_max_window_bits = -1;
+      }
+    else
+      goto fail;
+    }
+  
+  result = 1;
+  
+  fail:
+  
+  if(params)
+    gavl_strbreak_free(params);
+  return result;
   }
 
 
@@ -208,20 +508,17 @@ static msg_write_t * get_msg_write(bg_websocket_connection_t * conn)
   return ret;
   }
 
+/* Header and masking after the payload is in write_msg->buf */
+
 static void
-msg_write(bg_websocket_connection_t * conn, const void * msg, uint64_t len, int type)
+msg_write_finish(bg_websocket_connection_t * conn, msg_write_t * write_msg, int type, int compressed)
   {
-  msg_write_t * write_msg;
-  
-  write_msg = get_msg_write(conn);
-
+  uint64_t len = write_msg->buf.len;
   
   create_msg_header(conn, write_msg, len, type);
 
-  
-  gavl_buffer_alloc(&write_msg->buf, len);
-  memcpy(write_msg->buf.buf, msg, len);
-  write_msg->buf.len = len;
+  if(compressed)
+    write_msg->head[0] |= 0x40; // RSV1
 
 #ifdef DUMP_SERVER_WRITE
   if(!conn->is_client)
@@ -253,6 +550,93 @@ msg_write(bg_websocket_connection_t * conn, const void * msg, uint64_t len, int
     }
   }
 
+static void
+msg_write(bg_websocket_connection_t * conn, const void * msg, uint64_t len, int type)
+  {
+  msg_write_t * write_msg;
+  
+  write_msg = get_msg_write(conn);
+
+  gavl_buffer_alloc(&write_msg->buf, len);
+  memcpy(write_msg->buf.buf, msg, len);
+  write_msg->buf.len = len;
+
+  msg_write_finish(conn, write_msg, type, 0);
+  }
+
+/* Data messages only, control frames must not be compressed */
+
+static void
+msg_write_deflate(bg_websocket_connection_t * conn, const void * msg, uint64_t len, int type)
+  {
+  msg_write_t * write_msg;
+  
+  write_msg = get_msg_write(conn);
+
+  if(deflate_data(&conn->z, msg, len, &write_msg->buf))
+    msg_write_finish(conn, write_msg, type, 1);
+  else
+    {
+    gavl_buffer_reset(&write_msg->buf);
+    gavl_buffer_append_data(&write_msg->buf, msg, len);
+    msg_write_finish(conn, write_msg, type, 0);
+    }
+  }
+
+/* Server only: Payloads are never masked */
+
+static void
+msg_write_payload(bg_websocket_connection_t * conn, frame_payload_t * p, int type)
+  {
+  msg_write_t * write_msg;
+  
+  write_msg = get_msg_write(conn);
+  create_msg_header(conn, write_msg, p->buf.len, type);
+
+  if(p->compressed)
+    write_msg->head[0] |= 0x40; // RSV1
+  
+  write_msg->payload = p;
+  p->refcount++;
+  }
+
+static void encode_msg(const gavl_msg_t * msg, int encoding, gavl_buffer_t * buf)
+  {
+  if(encoding == ENCODING_BINARY)
+    bg_msg_to_buffer(msg, buf);
+  else
+    bg_msg_to_json_buf(msg, buf);
+  }
+
+static int encoding_to_opcode(int encoding)
+  {
+  if(encoding == ENCODING_BINARY)
+    return 0x2; // binary frame
+  else
+    return 0x1; // text frame
+  }
+
+static int protocol_to_encoding(const char * protocol)
+  {
+  if(!strcmp(protocol, PROTOCOL_JSON))
+    return ENCODING_JSON;
+  else if(!strcmp(protocol, PROTOCOL_BINARY))
+    return ENCODING_BINARY;
+  return -1;
+  }
+
+static const char * encoding_to_protocol(int encoding)
+  {
+  if(encoding == ENCODING_BINARY)
+    return PROTOCOL_BINARY;
+  else
+    return PROTOCOL_JSON;
+  }
+
+static frame_payload_t * context_get_payload(bg_websocket_context_t * ctx,
+                                             const gavl_msg_t * msg, int encoding,
+                                             int compressed);
+
 #define RETURN_RES \
   if(result < 0) \
     { \
@@ -363,6 +747,20 @@ msg_read(bg_websocket_connection_t * conn)
 
     /* Parse header */
 
+    /* Remember if we have a text or binary message */
+    if(((conn->read_msg.head[0] & 0x0f) == 0x1) ||
+       ((conn->read_msg.head[0] & 0x0f) == 0x2))
+      {
+      conn->read_msg.opcode = conn->read_msg.head[0] & 0x0f;
+
+      /* RSV1: Compressed message (only in the first frame) */
+      if((conn->read_msg.head[0] & 0x40) && conn->z.enabled)
+        {
+        conn->read_msg.compressed = 1;
+        conn->read_msg.head[0] &= ~0x40;
+        }
+      }
+    
     if(conn->read_msg.head[0] & 0x70) //  RSV1 RSV2 RSV3
       {
       gavl_log(GAVL_LOG_ERROR, LOG_DOMAIN, "Got reserved bits");
@@ -448,7 +846,12 @@ msg_read(bg_websocket_connection_t * conn)
     case 0x1: // text frame
     case 0x2: // binary frame
       if(conn->read_msg.head[0] & 0x80) // FIN
+        {
+        if(conn->read_msg.compressed &&
+           !inflate_data(&conn->z, &conn->read_msg.buf))
+          return GAVL_SOURCE_EOF;
         return GAVL_SOURCE_OK;
+        }
       else
         {
         /* Read another segment */
@@ -495,8 +898,6 @@ msg_read(bg_websocket_connection_t * conn)
 
 static int msg_write_cb(void * data, gavl_msg_t * msg)
   {
-  char * str = NULL;
-  uint64_t len = 0;
   bg_websocket_connection_t * conn = data;
 
   /*  
@@ -504,14 +905,43 @@ static int msg_write_cb(void * data, gavl_msg_t * msg)
   gavl_msg_dump(msg, 2);
   fprintf(stderr, "\n");
   */
-  
-  str = bg_msg_to_json_str(msg);
-  len = strlen(str);
-  
-  msg_write(conn, str, len, 0x1 /* text frame */ );
-  
-  if(str)
-    free(str);
+
+  if(conn->ctx)
+    {
+    frame_payload_t * p;
+    
+    /* Server: Encode once for all connections. Without context takeover,
+       the compressed data can be shared as well */
+
+    if(conn->z.enabled && conn->z.no_context_takeover &&
+       (conn->z.window_bits == MAX_WBITS))
+      {
+      p = context_get_payload(conn->ctx, msg, conn->encoding, 1);
+      msg_write_payload(conn, p, encoding_to_opcode(conn->encoding));
+      }
+    else
+      {
+      p = context_get_payload(conn->ctx, msg, conn->encoding, 0);
+
+      if(conn->z.enabled && (p->buf.len >= DEFLATE_MIN_SIZE))
+        msg_write_deflate(conn, p->buf.buf, p->buf.len, encoding_to_opcode(conn->encoding));
+      else
+        msg_write_payload(conn, p, encoding_to_opcode(conn->encoding));
+      }
+    payload_unref(p);
+    }
+  else
+    {
+    gavl_buffer_t buf;
+    gavl_buffer_init(&buf);
+    encode_msg(msg, conn->encoding, &buf);
+
+    if(conn->z.enabled && (buf.len >= DEFLATE_MIN_SIZE))
+      msg_write_deflate(conn, buf.buf, buf.len, encoding_to_opcode(conn->encoding));
+    else
+      msg_write(conn, buf.buf, buf.len, encoding_to_opcode(conn->encoding));
+    gavl_buffer_free(&buf);
+    }
 
   /* Close if we get a QUIT command */
   if((msg->NS == GAVL_MSG_NS_GENERIC) &&
@@ -563,6 +993,8 @@ static void conn_close(bg_websocket_connection_t * conn)
 
   for(i = 0; i < conn->write_msg_alloc; i++)
     msg_write_reset(&conn->write_msg[i]);
+
+  deflate_free(&conn->z);
   }
 
 static void conn_free(bg_websocket_connection_t * conn)
@@ -637,6 +1069,7 @@ bg_websocket_connection_create(const char * url, int timeout,
   gavl_socket_address_t * addr = NULL;
   const char * var;
   gavl_io_t * io = NULL;
+  int encoding = ENCODING_JSON;
   
   gavl_dictionary_init(&req);
   gavl_dictionary_init(&res);
@@ -681,8 +1114,10 @@ bg_websocket_connection_create(const char * url, int timeout,
     gavl_dictionary_set_string_nocopy(&req, "Origin",
                             gavl_sprintf("http://%s", gavl_dictionary_get_string(&req, "Host")));
 
-  gavl_dictionary_set_string(&req, "Sec-WebSocket-Protocol", "json");
+  /* Prefer binary messages, older servers will choose json */
+  gavl_dictionary_set_string(&req, "Sec-WebSocket-Protocol", PROTOCOL_BINARY", "PROTOCOL_JSON);
   gavl_dictionary_set_string(&req, "Sec-WebSocket-Version",  "13");
+  gavl_dictionary_set_string(&req, "Sec-WebSocket-Extensions", DEFLATE_EXTENSION);
 
   if((fd = gavl_socket_connect_inet(addr, timeout)) < 0)
     {
@@ -712,7 +1147,7 @@ bg_websocket_connection_create(const char * url, int timeout,
      !(var = gavl_dictionary_get_string(&res, "Sec-WebSocket-Accept")) ||
      strcasecmp(var, key_res) ||
      !(var = gavl_dictionary_get_string(&res, "Sec-WebSocket-Protocol")) ||
-     strcasecmp(var, "json"))
+     ((encoding = protocol_to_encoding(var)) < 0))
     {
     gavl_log(GAVL_LOG_ERROR, LOG_DOMAIN, "Got response: %d %s",
              gavl_http_response_get_status_int(&res), gavl_http_response_get_status_str(&res));
@@ -724,6 +1159,26 @@ bg_websocket_connection_create(const char * url, int timeout,
 
   conn_init(ret, 1);
   ret->io = io;
+  ret->encoding = encoding;
+
+  if((var = gavl_dictionary_get_string(&res, "Sec-WebSocket-Extensions")))
+    {
+    deflate_params_t params;
+
+    /* Our inflater accepts any window size, so only the parameters
+       for our side matter */
+    if(!parse_deflate_params(var, &params) ||
+       (params.client_max_window_bits && (params.client_max_window_bits < 9)))
+      {
+      gavl_log(GAVL_LOG_ERROR, LOG_DOMAIN, "Invalid extension response: %s", var);
+      conn_close(ret);
+      goto fail;
+      }
+    
+    ret->z.enabled = 1;
+    ret->z.no_context_takeover = params.client_no_context_takeover;
+    ret->z.window_bits = params.client_max_window_bits > 0 ? params.client_max_window_bits : MAX_WBITS;
+    }
   
   fail:
 
@@ -763,6 +1218,8 @@ bg_websocket_connection_iteration(bg_websocket_connection_t * conn)
   {
   int ret = 0;
   int result;
+  int len;
+  const uint8_t * data;
   int write_failed = 0;
   gavl_source_status_t st;
   
@@ -828,15 +1285,26 @@ bg_websocket_connection_iteration(bg_websocket_connection_t * conn)
         goto read;
       }
     
-    if(conn->write_msg[0].buf.pos < conn->write_msg[0].buf.len)
+    if(conn->write_msg[0].payload)
+      {
+      data = conn->write_msg[0].payload->buf.buf;
+      len  = conn->write_msg[0].payload->buf.len;
+      }
+    else
+      {
+      data = conn->write_msg[0].buf.buf;
+      len  = conn->write_msg[0].buf.len;
+      }
+    
+    if(conn->write_msg[0].buf.pos < len)
       {
       result = gavl_io_write_data_nonblock(conn->io,
-                                           conn->write_msg[0].buf.buf + conn->write_msg[0].buf.pos,
-                                           conn->write_msg[0].buf.len - conn->write_msg[0].buf.pos);
+                                           data + conn->write_msg[0].buf.pos,
+                                           len - conn->write_msg[0].buf.pos);
       if(result < 0)
         {
         gavl_log(GAVL_LOG_WARNING, LOG_DOMAIN, "Writing %d bytes failed",
-                 conn->write_msg[0].buf.len - conn->write_msg[0].buf.pos);
+                 len - conn->write_msg[0].buf.pos);
         write_failed = 1;
         goto read;
         }
@@ -845,7 +1313,7 @@ bg_websocket_connection_iteration(bg_websocket_connection_t * conn)
       
       conn->write_msg[0].buf.pos += result;
       
-      if(conn->write_msg[0].buf.pos < conn->write_msg[0].buf.len)
+      if(conn->write_msg[0].buf.pos < len)
         goto read;
       }
 
@@ -888,7 +1356,12 @@ bg_websocket_connection_iteration(bg_websocket_connection_t * conn)
     
     /* Handle message */
 
-    if(!bg_msg_from_json_str(&msg, (const char*)conn->read_msg.buf.buf))
+    if(conn->read_msg.opcode == 0x2)
+      {
+      if(!bg_msg_from_buffer(&msg, conn->read_msg.buf.buf, conn->read_msg.buf.len))
+        return -1;
+      }
+    else if(!bg_msg_from_json_str(&msg, (const char*)conn->read_msg.buf.buf))
       {
       fprintf(stderr, "bg_msg_from_json_str failed (got %d bytes), mask: %p\n",
               conn->read_msg.buf.len, conn->read_msg.mask);
@@ -966,6 +1439,12 @@ bg_websocket_connection_get_controllable(bg_websocket_connection_t * conn)
 
 /* Ping status */
 
+typedef struct
+  {
+  gavl_msg_t * msg;
+  frame_payload_t * payload[NUM_ENCODINGS][2]; // Uncompressed, compressed
+  } encoded_msg_t;
+
 struct bg_websocket_context_s
   {
   bg_websocket_connection_t conn[BG_WEBSOCKET_MAX_CONNECTIONS];
@@ -973,8 +1452,138 @@ struct bg_websocket_context_s
   
   char * path;
   pthread_mutex_t conn_mutex;
+
+  /* Each connection gets its own copy of the events. We encode
+     each event only once and share the payload among the connections */
+  encoded_msg_t cache[ENCODE_CACHE_SIZE];
+  int num_cache;
+  int num_active;
+
+  /* Compression */
+  int deflate_enable;
+  int deflate_server_takeover;
+  int deflate_client_takeover;
+  
+  /* Shared compressor for connections without context takeover */
+  deflate_t z;
   };
 
+static int msg_equal(const gavl_msg_t * m1, const gavl_msg_t * m2)
+  {
+  int i;
+  
+  if((m1->NS != m2->NS) ||
+     (m1->ID != m2->ID) ||
+     (m1->num_args != m2->num_args) ||
+     gavl_dictionary_compare(&m1->header, &m2->header))
+    return 0;
+
+  for(i = 0; i < m1->num_args; i++)
+    {
+    if(gavl_value_compare(&m1->args[i], &m2->args[i]))
+      return 0;
+    }
+  return 1;
+  }
+
+static void encoded_msg_free(encoded_msg_t * e)
+  {
+  int i, j;
+  gavl_msg_destroy(e->msg);
+  
+  for(i = 0; i < NUM_ENCODINGS; i++)
+    {
+    for(j = 0; j < 2; j++)
+      {
+      if(e->payload[i][j])
+        payload_unref(e->payload[i][j]);
+      }
+    }
+  memset(e, 0, sizeof(*e));
+  }
+
+static void context_clear_cache(bg_websocket_context_t * ctx)
+  {
+  int i;
+  for(i = 0; i < ctx->num_cache; i++)
+    encoded_msg_free(&ctx->cache[i]);
+  ctx->num_cache = 0;
+  }
+
+static frame_payload_t * context_encode(bg_websocket_context_t * ctx,
+                                        const gavl_msg_t * msg, int encoding,
+                                        int compressed)
+  {
+  frame_payload_t * ret = payload_create();
+  encode_msg(msg, encoding, &ret->buf);
+
+  if(compressed && (ret->buf.len >= DEFLATE_MIN_SIZE))
+    {
+    gavl_buffer_t buf;
+    gavl_buffer_init(&buf);
+
+    if(deflate_data(&ctx->z, ret->buf.buf, ret->buf.len, &buf))
+      {
+      gavl_buffer_free(&ret->buf);
+      memcpy(&ret->buf, &buf, sizeof(buf));
+      ret->compressed = 1;
+      }
+    else
+      gavl_buffer_free(&buf);
+    }
+  return ret;
+  }
+
+/* Returns a new reference */
+
+static frame_payload_t * context_get_payload(bg_websocket_context_t * ctx,
+                                             const gavl_msg_t * msg, int encoding,
+                                             int compressed)
+  {
+  int i;
+  encoded_msg_t * e = NULL;
+  frame_payload_t * ret;
+  
+  /* Messages for a single client and messages, which are sent to
+     only one client, aren't cached */
+  
+  if((ctx->num_active < 2) || gavl_msg_get_client_id(msg))
+    return context_encode(ctx, msg, encoding, compressed);
+
+  /* Search backwards since other connections most likely
+     need the message we encoded last */
+  
+  for(i = ctx->num_cache - 1; i >= 0; i--)
+    {
+    if(msg_equal(ctx->cache[i].msg, msg))
+      {
+      e = &ctx->cache[i];
+      break;
+      }
+    }
+
+  if(!e)
+    {
+    if(ctx->num_cache == ENCODE_CACHE_SIZE)
+      {
+      encoded_msg_free(&ctx->cache[0]);
+      memmove(&ctx->cache[0], &ctx->cache[1], (ENCODE_CACHE_SIZE-1) * sizeof(ctx->cache[0]));
+      ctx->num_cache--;
+      }
+    e = &ctx->cache[ctx->num_cache++];
+    memset(e, 0, sizeof(*e));
+    e->msg = gavl_msg_create();
+    gavl_msg_copy(e->msg, msg);
+    }
+
+  if(!e->payload[encoding][compressed])
+    e->payload[encoding][compressed] = context_encode(ctx, msg, encoding, compressed);
+  
+  ret = e->payload[encoding][compressed];
+  ret->refcount++;
+  return ret;
+  }
+
 /* Connection */
 
 static int conn_start_server(bg_websocket_connection_t * conn,
@@ -988,7 +1597,11 @@ static int conn_start_server(bg_websocket_connection_t * conn,
   
   const char * key;
   const char * var;
-
+  char ** protocols;
+  int i;
+  int encoding = -1;
+  deflate_params_t deflate_params;
+  
   //  fprintf(stderr, "conn_start_server\n");
   
   /* Sanity check */
@@ -1003,9 +1616,42 @@ static int conn_start_server(bg_websocket_connection_t * conn,
   if(!(key = gavl_dictionary_get_string(&c->req, "Sec-WebSocket-Key")))
     goto fail;
 
-  if(!(var = gavl_dictionary_get_string(&c->req, "Sec-WebSocket-Protocol")) ||
-     !strstr(var, "json"))
+  if(!(var = gavl_dictionary_get_string(&c->req, "Sec-WebSocket-Protocol")))
     goto fail;
+
+  /* Take the first one we support */
+  protocols = gavl_strbreak(var, ',');
+  
+  for(i = 0; protocols[i]; i++)
+    {
+    if((encoding = protocol_to_encoding(gavl_strip_space(protocols[i]))) >= 0)
+      break;
+    }
+  gavl_strbreak_free(protocols);
+  
+  if(encoding < 0)
+    goto fail;
+
+  /* Extensions: Take the first permessage-deflate offer we can accept */
+  deflate_free(&conn->z);
+  
+  if(ctx->deflate_enable &&
+     (var = gavl_dictionary_get_string(&c->req, "Sec-WebSocket-Extensions")))
+    {
+    char ** extensions = gavl_strbreak(var, ',');
+    
+    for(i = 0; extensions[i]; i++)
+      {
+      /* zlib can't do window bits of 8 for raw deflate */
+      if(parse_deflate_params(extensions[i], &deflate_params) &&
+         (deflate_params.server_max_window_bits != 8))
+        {
+        conn->z.enabled = 1;
+        break;
+        }
+      }
+    gavl_strbreak_free(extensions);
+    }
   
   /* Do handshake */
 
@@ -1016,7 +1662,32 @@ static int conn_start_server(bg_websocket_connection_t * conn,
   gavl_dictionary_set_string(&c->res, "Upgrade", "websocket");
   gavl_dictionary_set_string(&c->res, "Connection" , "Upgrade");
 
-  gavl_dictionary_set_string(&c->res, "Sec-WebSocket-Protocol", "json");
+  gavl_dictionary_set_string(&c->res, "Sec-WebSocket-Protocol", encoding_to_protocol(encoding));
+
+  if(conn->z.enabled)
+    {
+    conn->z.no_context_takeover =
+      deflate_params.server_no_context_takeover || !ctx->deflate_server_takeover;
+    
+    conn->z.window_bits = deflate_params.server_max_window_bits ?
+      deflate_params.server_max_window_bits : MAX_WBITS;
+    
+    str = gavl_strdup(DEFLATE_EXTENSION);
+
+    if(conn->z.no_context_takeover)
+      str = gavl_strcat(str, "; server_no_context_takeover");
+
+    if(deflate_params.client_no_context_takeover || !ctx->deflate_client_takeover)
+      str = gavl_strcat(str, "; client_no_context_takeover");
+
+    if(deflate_params.server_max_window_bits)
+      {
+      char * tmp = gavl_sprintf("; server_max_window_bits=%d", conn->z.window_bits);
+      str = gavl_strcat(str, tmp);
+      free(tmp);
+      }
+    gavl_dictionary_set_string(&c->res, "Sec-WebSocket-Extensions", str);
+    }
   
   /* Key */
   
@@ -1041,6 +1712,9 @@ static int conn_start_server(bg_websocket_connection_t * conn,
     goto fail;
   
   c->fd = -1;
+
+  conn->encoding = encoding;
+  conn->ctx = ctx;
   
   bg_controllable_connect(ctx->ctrl, &conn->ctrl_server);
   
@@ -1164,6 +1838,13 @@ bg_websocket_context_create(const char * klass,
   for(i = 0; i < BG_WEBSOCKET_MAX_CONNECTIONS; i++)
     conn_init(&ctx->conn[i], 0);
 
+  ctx->deflate_enable = 1;
+  ctx->deflate_server_takeover = 1;
+  ctx->deflate_client_takeover = 1;
+  
+  ctx->z.no_context_takeover = 1;
+  ctx->z.window_bits = MAX_WBITS;
+
   ctx->ctrl = ctrl;
 
   if(path)
@@ -1189,6 +1870,13 @@ int bg_websocket_context_iteration(bg_websocket_context_t * ctx)
   int ret = 0;
 
   pthread_mutex_lock(&ctx->conn_mutex);
+
+  ctx->num_active = 0;
+  for(i = 0; i < BG_WEBSOCKET_MAX_CONNECTIONS; i++)
+    {
+    if(ctx->conn[i].io)
+      ctx->num_active++;
+    }
   
   for(i = 0; i < BG_WEBSOCKET_MAX_CONNECTIONS; i++)
     {
@@ -1213,6 +1901,8 @@ int bg_websocket_context_iteration(bg_websocket_context_t * ctx)
       ret += bg_msg_sink_get_num(ctx->conn[i].ctrl_server.evt_sink);
       }
     }
+
+  context_clear_cache(ctx);
   
   pthread_mutex_unlock(&ctx->conn_mutex);
 
@@ -1229,6 +1919,9 @@ void bg_websocket_context_destroy(bg_websocket_context_t * ctx)
   for(i = 0; i < BG_WEBSOCKET_MAX_CONNECTIONS; i++)
     conn_free(&ctx->conn[i]);
 
+  context_clear_cache(ctx);
+  deflate_free(&ctx->z);
+  
   if(ctx->path)
     free(ctx->path);
   pthread_mutex_destroy(&ctx->conn_mutex);
@@ -1236,6 +1929,16 @@ void bg_websocket_context_destroy(bg_websocket_context_t * ctx)
   free(ctx);
   }
 
+void bg_websocket_context_set_compression(bg_websocket_context_t * ctx, int enable,
+                                          int server_takeover, int client_takeover)
+  {
+  pthread_mutex_lock(&ctx->conn_mutex);
+  ctx->deflate_enable = enable;
+  ctx->deflate_server_takeover = server_takeover;
+  ctx->deflate_client_takeover = client_takeover;
+  pthread_mutex_unlock(&ctx->conn_mutex);
+  }
+
 int bg_websocket_context_num_clients(bg_websocket_context_t * ctx)
   {
   int ret = 0;
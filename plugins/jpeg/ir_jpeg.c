@@ -98,6 +98,10 @@ typedef struct
   gavl_dictionary_t metadata;
 
   gavl_buffer_t buf;
+
+  /* Size hint from the caller */
+  int max_width;
+  int max_height;
   
   } jpeg_t;
 
@@ -149,6 +153,33 @@ static void destroy_jpeg(void* priv)
     
 // bg_parameter_func set_parameter;
 
+static void set_max_size_jpeg(void * priv, int max_width, int max_height)
+  {
+  jpeg_t * jpeg = priv;
+  jpeg->max_width = max_width;
+  jpeg->max_height = max_height;
+  }
+
+/* Get the largest DCT scaling factor (1/2, 1/4 or 1/8), for which the
+   image is still larger than the requested size. These are supported by
+   all libjpeg versions. */
+
+static int get_scale_denom(jpeg_t * jpeg)
+  {
+  int denom;
+
+  if((jpeg->max_width <= 0) || (jpeg->max_height <= 0))
+    return 1;
+  
+  for(denom = 8; denom > 1; denom /= 2)
+    {
+    if(((jpeg->cinfo.image_width + denom - 1) / denom > jpeg->max_width) &&
+       ((jpeg->cinfo.image_height + denom - 1) / denom > jpeg->max_height))
+      return denom;
+    }
+  return 1;
+  }
+
 static
 int read_header_jpeg(void * priv, const char * filename,
                      gavl_video_format_t * format)
@@ -182,6 +213,21 @@ int read_header_jpeg(void * priv, const char * filename,
   format->pixel_width = 1;
   format->pixel_height = 1;
 
+  /* Reduced resolution: Let the IDCT do the downscaling */
+
+  jpeg->cinfo.scale_num = 1;
+  jpeg->cinfo.scale_denom = get_scale_denom(jpeg);
+  
+  if(jpeg->cinfo.scale_denom > 1)
+    {
+    jpeg_calc_output_dimensions(&jpeg->cinfo);
+    
+    format->image_width  = jpeg->cinfo.output_width;
+    format->image_height = jpeg->cinfo.output_height;
+    format->frame_width  = jpeg->cinfo.output_width;
+    format->frame_height = jpeg->cinfo.output_height;
+    }
+  
   /*
    *  Get the colorspace, we handle YUV 444, YUV 422, YUV 420 directly.
    *  All other formats are converted to RGB24
@@ -190,7 +236,12 @@ int read_header_jpeg(void * priv, const char * filename,
   switch(jpeg->cinfo.jpeg_color_space)
     {
     case JCS_YCbCr:
-      if((jpeg->cinfo.comp_info[0].h_samp_factor == 2) &&
+      /* The raw data reading below assumes full size DCT blocks */
+      if(jpeg->cinfo.scale_denom > 1)
+        {
+        format->pixelformat = GAVL_RGB_24;
+        }
+      else if((jpeg->cinfo.comp_info[0].h_samp_factor == 2) &&
          (jpeg->cinfo.comp_info[0].v_samp_factor == 2) &&
          (jpeg->cinfo.comp_info[1].h_samp_factor == 1) &&
          (jpeg->cinfo.comp_info[1].v_samp_factor == 1) &&
@@ -390,6 +441,7 @@ const bg_image_reader_plugin_t the_plugin =
     .get_metadata = get_metadata_jpeg,
     .get_compression_info = get_compression_info_jpeg,
     .read_image =  read_image_jpeg,
+    .set_max_size = set_max_size_jpeg,
   };
 
 /* Include this into all plugin modules exactly once
@@ -22,6 +22,7 @@
 #include <string.h>
 #include <sys/utsname.h>
 #include <unistd.h>
+#include <pthread.h>
 
 
 
@@ -64,6 +65,9 @@ static const char * cd_desc;
 /* ConnectionManager */
 static const char * cm_desc;
 
+#define SEARCH_CAPS "upnp:class,dc:title,dc:creator,upnp:artist,upnp:actor,upnp:director,upnp:album,upnp:genre,dc:date,upnp:originalTrackNumber"
+#define SORT_CAPS   "dc:title,dc:creator,upnp:artist,upnp:album,upnp:genre,dc:date,upnp:originalTrackNumber"
+
 typedef struct 
   {
   char * desc;
@@ -72,7 +76,9 @@ typedef struct
   gavl_dictionary_t cd_evt;
 
   gavl_array_t requests;
-
+  /* Requests are stored by the http threads and answered by the main thread */
+  pthread_mutex_t requests_mutex;
+  
   gavl_dictionary_t state;
 
   bg_control_t control;
@@ -80,6 +86,28 @@ typedef struct
   } bg_mdb_frontend_upnp_t;
 
 
+static void store_request(bg_mdb_frontend_upnp_t * priv, gavl_msg_t * msg,
+                          bg_http_connection_t * c, const gavl_dictionary_t * soap)
+  {
+  gavl_dictionary_t * req;
+  gavl_dictionary_t * conn_dict;
+  
+  pthread_mutex_lock(&priv->requests_mutex);
+  
+  req = bg_function_push(&priv->requests, msg);
+  conn_dict = gavl_dictionary_get_dictionary_create(req, "conn");
+      
+  bg_http_connection_to_dict_nocopy(c, conn_dict);
+  c->fd = -1;
+
+  gavl_dictionary_copy(gavl_dictionary_get_dictionary_create(req, "soap"), soap);
+  
+  //      fprintf(stderr, "Got browse request\n");
+  //      gavl_dictionary_dump(req, 2);
+  
+  pthread_mutex_unlock(&priv->requests_mutex);
+  }
+
 static int handle_http_mdb_upnp(bg_http_connection_t * c, void * data)
   {
   bg_mdb_frontend_upnp_t * priv = data;
@@ -135,20 +163,17 @@ static int handle_http_mdb_upnp(bg_http_connection_t * c, void * data)
     if(!strcmp(func, "GetSearchCapabilities"))
       {
       //      fprintf(stderr, "Get Search Capabilities\n");
-      gavl_dictionary_set_string(args_out, "SearchCaps", BG_SOAP_ARG_EMPTY);
+      gavl_dictionary_set_string(args_out, "SearchCaps", SEARCH_CAPS);
       bg_upnp_finish_soap_request(&soap, c, srv);
       }
     else if(!strcmp(func, "GetSortCapabilities"))
       {
       //      fprintf(stderr, "Get Sort Capabilities\n");
-      gavl_dictionary_set_string(args_out, "SortCaps", BG_SOAP_ARG_EMPTY);
+      gavl_dictionary_set_string(args_out, "SortCaps", SORT_CAPS);
       bg_upnp_finish_soap_request(&soap, c, srv);
       }
     else if(!strcmp(func, "Browse"))
       {
-      gavl_dictionary_t * req;
-      gavl_dictionary_t * conn_dict;
-      
       gavl_msg_t * msg;
       
       const char * ObjectID;
@@ -196,22 +221,58 @@ static int handle_http_mdb_upnp(bg_http_connection_t * c, void * data)
         }
       
       /* 2. Store request */
-
-      req = bg_function_push(&priv->requests, msg);
-      conn_dict = gavl_dictionary_get_dictionary_create(req, "conn");
+      store_request(priv, msg, c, &soap);
       
-      bg_http_connection_to_dict_nocopy(c, conn_dict);
-      c->fd = -1;
-
-      gavl_dictionary_copy(gavl_dictionary_get_dictionary_create(req, "soap"), &soap);
+      /* 3. Send request message */
+      bg_msg_sink_put(priv->control.cmd_sink);
+      }
+    else if(!strcmp(func, "Search"))
+      {
+      gavl_msg_t * msg;
+      gavl_dictionary_t query;
+      gavl_array_t sort;
       
-      //gavl_dictionary_set_dictionary_nocopy(req, "soap", &soap);
+      const char * ContainerID;
+      const char * SearchCriteria;
+      const char * StartingIndex;
+      const char * RequestedCount;
       
-      //      fprintf(stderr, "Got browse request\n");
-      //      gavl_dictionary_dump(req, 2);
+      if(!(ContainerID    = gavl_dictionary_get_string(args_in, "ContainerID")) ||
+         !(SearchCriteria = gavl_dictionary_get_string(args_in, "SearchCriteria")) ||
+         !(StartingIndex  = gavl_dictionary_get_string(args_in, "StartingIndex")) ||
+         !(RequestedCount = gavl_dictionary_get_string(args_in, "RequestedCount")))
+        {
+        gavl_dictionary_free(&soap);
+        return 0;
+        }
+
+      gavl_dictionary_init(&query);
+      gavl_array_init(&sort);
+
+      //      fprintf(stderr, "Search(%s %s)\n", ContainerID, SearchCriteria);
       
-      /* 3. Send request message */
-      bg_msg_sink_put(priv->control.cmd_sink);
+      if(!bg_didl_parse_search_criteria(SearchCriteria, &query))
+        {
+        bg_soap_request_set_error(&soap, 708, "Unsupported or invalid search criteria");
+        bg_upnp_finish_soap_request(&soap, c, srv);
+        }
+      else if(!bg_didl_parse_sort_criteria(gavl_dictionary_get_string(args_in, "SortCriteria"), &sort))
+        {
+        bg_soap_request_set_error(&soap, 709, "Unsupported or invalid sort criteria");
+        bg_upnp_finish_soap_request(&soap, c, srv);
+        }
+      else
+        {
+        /* We always search the whole library, ContainerID is just passed back */
+        msg = bg_msg_sink_get(priv->control.cmd_sink);
+        bg_mdb_set_search_request(msg, ContainerID, &query, &sort,
+                                  atoi(StartingIndex), atoi(RequestedCount));
+        store_request(priv, msg, c, &soap);
+        bg_msg_sink_put(priv->control.cmd_sink);
+        }
+      
+      gavl_dictionary_free(&query);
+      gavl_array_free(&sort);
       }
     gavl_dictionary_free(&soap);
     }
@@ -264,11 +325,16 @@ static int handle_mdb_message_upnp(void * priv, gavl_msg_t * msg)
           bg_http_connection_t conn;
           
           /* Find request */
+
+          pthread_mutex_lock(&p->requests_mutex);
           
           if(!(req = bg_function_get(&p->requests, msg, &idx)) ||
              !(soap = gavl_dictionary_get_dictionary_nc(req, "soap")) ||
              !(conn_dict = gavl_dictionary_get_dictionary_nc(req, "conn")))
+            {
+            pthread_mutex_unlock(&p->requests_mutex);
             return 1;
+            }
 
           if(msg->ID == BG_RESP_DB_BROWSE_OBJECT)
             {
@@ -415,7 +481,79 @@ static int handle_mdb_message_upnp(void * priv, gavl_msg_t * msg)
               }
             gavl_value_free(&val); 
             }
+          pthread_mutex_unlock(&p->requests_mutex);
+          }
+          break;
+        case BG_RESP_DB_SEARCH:
+          {
+          int idx = -1;
+          int i;
+          int total = 0;
+          int num_returned = 0;
+          gavl_dictionary_t * req;
+          gavl_dictionary_t * conn_dict;
+          gavl_dictionary_t * soap;
+          const gavl_dictionary_t * args_in;
+          gavl_dictionary_t * args_out;
+          const gavl_array_t * tracks;
+          const gavl_dictionary_t * track;
+          const char * Filter;
+          char ** filter_el;
+          xmlDocPtr didl;
+          bg_http_connection_t conn;
+
+          pthread_mutex_lock(&p->requests_mutex);
+          
+          if(!(req = bg_function_get(&p->requests, msg, &idx)) ||
+             !(soap = gavl_dictionary_get_dictionary_nc(req, "soap")) ||
+             !(conn_dict = gavl_dictionary_get_dictionary_nc(req, "conn")))
+            {
+            pthread_mutex_unlock(&p->requests_mutex);
+            return 1;
+            }
+          
+          bg_http_connection_from_dict_nocopy(&conn, conn_dict);
+          
+          args_in  = gavl_dictionary_get_dictionary(soap, BG_SOAP_META_ARGS_IN);
+          args_out = gavl_dictionary_get_dictionary_nc(soap, BG_SOAP_META_ARGS_OUT);
+          
+          Filter = gavl_dictionary_get_string(args_in, "Filter");
+          
+          if(Filter && strcmp(Filter, "*"))
+            filter_el = bg_didl_create_filter(Filter);
+          else
+            filter_el = NULL;
+
+          didl = bg_didl_create();
+
+          if((tracks = gavl_value_get_array(gavl_msg_get_arg_c(msg, 0))))
+            {
+            for(i = 0; i < tracks->num_entries; i++)
+              {
+              if((track = gavl_value_get_dictionary(&tracks->entries[i])))
+                {
+                bg_track_to_didl(didl, track, filter_el);
+                num_returned++;
+                }
+              }
+            }
+          total = gavl_msg_get_arg_int(msg, 2);
           
+          gavl_dictionary_set_string_nocopy(args_out, "Result",
+                                            bg_xml_save_to_memory_opt(didl, XML_SAVE_NO_DECL));
+          gavl_dictionary_set_string_nocopy(args_out, "NumberReturned", gavl_sprintf("%d", num_returned));
+          gavl_dictionary_set_string_nocopy(args_out, "TotalMatches", gavl_sprintf("%d", total));
+          gavl_dictionary_set_string(args_out, "UpdateID", "0");
+
+          bg_upnp_finish_soap_request(soap, &conn, bg_http_server_get());
+          gavl_array_splice_val(&p->requests, idx, 1, NULL);
+          
+          pthread_mutex_unlock(&p->requests_mutex);
+          
+          xmlFreeDoc(didl);
+          
+          if(filter_el)
+            gavl_strbreak_free(filter_el);
           }
           break;
         }
@@ -460,6 +598,7 @@ static void destroy_mdb_upnp(void * priv)
   gavl_dictionary_free(&p->cd_evt);
   gavl_dictionary_free(&p->cm_evt);
   gavl_array_free(&p->requests);
+  pthread_mutex_destroy(&p->requests_mutex);
 
   gavl_dictionary_free(&p->state);
   
@@ -554,7 +693,7 @@ static void * create_mdb_upnp()
   bg_mdb_frontend_upnp_t * priv;
   priv = calloc(1, sizeof(*priv));
 
-  
+  pthread_mutex_init(&priv->requests_mutex, NULL);
   
   return priv;
   }
@@ -733,6 +872,61 @@ static const char * cd_desc =
 "        </argument>"
 "      </argumentList>"
 "    </action>"
+"    <action>"
+"      <name>Search</name>"
+"      <argumentList>"
+"        <argument>"
+"          <name>ContainerID</name>"
+"          <direction>in</direction>"
+"          <relatedStateVariable>A_ARG_TYPE_ObjectID</relatedStateVariable>"
+"        </argument>"
+"        <argument>"
+"          <name>SearchCriteria</name>"
+"          <direction>in</direction>"
+"          <relatedStateVariable>A_ARG_TYPE_SearchCriteria</relatedStateVariable>"
+"        </argument>"
+"        <argument>"
+"          <name>Filter</name>"
+"          <direction>in</direction>"
+"          <relatedStateVariable>A_ARG_TYPE_Filter</relatedStateVariable>"
+"        </argument>"
+"        <argument>"
+"          <name>StartingIndex</name>"
+"          <direction>in</direction>"
+"          <relatedStateVariable>A_ARG_TYPE_Index</relatedStateVariable>"
+"        </argument>"
+"        <argument>"
+"          <name>RequestedCount</name>"
+"          <direction>in</direction>"
+"          <relatedStateVariable>A_ARG_TYPE_Count</relatedStateVariable>"
+"        </argument>"
+"        <argument>"
+"          <name>SortCriteria</name>"
+"          <direction>in</direction>"
+"          <relatedStateVariable>A_ARG_TYPE_SortCriteria</relatedStateVariable>"
+"        </argument>"
+"        <argument>"
+"          <name>Result</name>"
+"          <direction>out</direction>"
+"          <relatedStateVariable>A_ARG_TYPE_Result</relatedStateVariable>"
+"        </argument>"
+"        <argument>"
+"          <name>NumberReturned</name>"
+"          <direction>out</direction>"
+"          <relatedStateVariable>A_ARG_TYPE_Count</relatedStateVariable>"
+"        </argument>"
+"        <argument>"
+"          <name>TotalMatches</name>"
+"          <direction>out</direction>"
+"          <relatedStateVariable>A_ARG_TYPE_Count</relatedStateVariable>"
+"        </argument>"
+"        <argument>"
+"          <name>UpdateID</name>"
+"          <direction>out</direction>"
+"          <relatedStateVariable>A_ARG_TYPE_UpdateID</relatedStateVariable>"
+"        </argument>"
+"      </argumentList>"
+"    </action>"
 "  </actionList>"
 "  <serviceStateTable>"
 "    <stateVariable sendEvents=\"no\">"
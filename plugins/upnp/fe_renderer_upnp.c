@@ -22,6 +22,7 @@
 #include <string.h>
 #include <sys/utsname.h>
 #include <unistd.h>
+#include <pthread.h>
 #include <uuid/uuid.h>
 #include <limits.h>
 
@@ -180,6 +181,9 @@ typedef struct
   gavl_dictionary_t rc_evt;
   gavl_dictionary_t avt_evt;
   gavl_dictionary_t state;
+  /* state is read by the http threads */
+  pthread_mutex_t state_mutex;
+  
   char control_id[37];
 
   char * next_uri;
@@ -217,6 +221,7 @@ static void destroy_renderer_upnp(void * priv)
   gavl_dictionary_free(&p->cm_evt);
   gavl_dictionary_free(&p->avt_evt);
   gavl_dictionary_free(&p->state);
+  pthread_mutex_destroy(&p->state_mutex);
 
   if(p->protocol_info)
     free(p->protocol_info);
@@ -333,7 +338,9 @@ static int handle_player_message_upnp(void * priv, gavl_msg_t * msg)
           gavl_value_init(&val);
           
           /* Store state locally */
+          pthread_mutex_lock(&p->state_mutex);
           gavl_msg_get_state(msg, &last, &ctx, &var, &val, &p->state);
+          pthread_mutex_unlock(&p->state_mutex);
 
           if(!strcmp(ctx, BG_PLAYER_STATE_CTX))
             {
@@ -555,6 +562,15 @@ static void make_track(gavl_dictionary_t * track,
     }
 
 
+static void set_arg_from_event(gavl_dictionary_t * args_out, const char * arg,
+                               const gavl_dictionary_t * evt, const char * var)
+  {
+  char * val = bg_upnp_event_context_server_get_value_dup(evt, var);
+  gavl_dictionary_set_string(args_out, arg, val);
+  if(val)
+    free(val);
+  }
+
 static int handle_http_request(bg_http_connection_t * c, void * data)
   {
   const char * InstanceID;
@@ -619,7 +635,7 @@ static int handle_http_request(bg_http_connection_t * c, void * data)
       {
       CHECK_INSTANCE_ID(702);
       
-      gavl_dictionary_set_string(args_out, "CurrentMute", bg_upnp_event_context_server_get_value(&priv->rc_evt, "Mute"));
+      set_arg_from_event(args_out, "CurrentMute", &priv->rc_evt, "Mute");
       bg_upnp_finish_soap_request(soap, c, bg_http_server_get());
       }
     
@@ -631,8 +647,7 @@ static int handle_http_request(bg_http_connection_t * c, void * data)
     else if(!strcmp(func, "GetVolume"))
       {
       CHECK_INSTANCE_ID(702);
-      gavl_dictionary_set_string(args_out, "CurrentVolume",
-                                 bg_upnp_event_context_server_get_value(&priv->rc_evt, "Volume"));
+      set_arg_from_event(args_out, "CurrentVolume", &priv->rc_evt, "Volume");
       bg_upnp_finish_soap_request(soap, c, bg_http_server_get());
       return 1;
       }
@@ -645,8 +660,7 @@ static int handle_http_request(bg_http_connection_t * c, void * data)
     else if(!strcmp(func, "GetVolumeDB"))
       {
       CHECK_INSTANCE_ID(702);
-      gavl_dictionary_set_string(args_out, "CurrentVolume",
-                                 bg_upnp_event_context_server_get_value(&priv->rc_evt, "VolumeDB"));
+      set_arg_from_event(args_out, "CurrentVolume", &priv->rc_evt, "VolumeDB");
       bg_upnp_finish_soap_request(soap, c, bg_http_server_get());
       return 1;
       }
@@ -855,8 +869,7 @@ static int handle_http_request(bg_http_connection_t * c, void * data)
       {
       CHECK_INSTANCE_ID(718);
       
-      gavl_dictionary_set_string(args_out, "Actions",
-                                 bg_upnp_event_context_server_get_value(&priv->avt_evt, "CurrentTransportActions"));
+      set_arg_from_event(args_out, "Actions", &priv->avt_evt, "CurrentTransportActions");
       
       bg_upnp_finish_soap_request(soap, c, bg_http_server_get());
       }
@@ -886,14 +899,14 @@ static int handle_http_request(bg_http_connection_t * c, void * data)
       {
       CHECK_INSTANCE_ID(718);
       
-      gavl_dictionary_set_string(args_out, "NrTracks",      bg_upnp_event_context_server_get_value(&priv->avt_evt, "NumberOfTracks"));
+      set_arg_from_event(args_out, "NrTracks", &priv->avt_evt, "NumberOfTracks");
       gavl_dictionary_set_string(args_out, "MediaDuration", "NOT_IMPLEMENTED");
 
-      gavl_dictionary_set_string(args_out, "CurrentURI",         bg_upnp_event_context_server_get_value(&priv->avt_evt, "AVTransportURI"));
-      gavl_dictionary_set_string(args_out, "CurrentURIMetaData", bg_upnp_event_context_server_get_value(&priv->avt_evt, "AVTransportURIMetaData"));
+      set_arg_from_event(args_out, "CurrentURI", &priv->avt_evt, "AVTransportURI");
+      set_arg_from_event(args_out, "CurrentURIMetaData", &priv->avt_evt, "AVTransportURIMetaData");
 
-      gavl_dictionary_set_string(args_out, "NextURI",            bg_upnp_event_context_server_get_value(&priv->avt_evt, "NextAVTransportURI"));
-      gavl_dictionary_set_string(args_out, "NextURIMetaData",    bg_upnp_event_context_server_get_value(&priv->avt_evt, "NextAVTransportURIMetaData"));
+      set_arg_from_event(args_out, "NextURI", &priv->avt_evt, "NextAVTransportURI");
+      set_arg_from_event(args_out, "NextURIMetaData", &priv->avt_evt, "NextAVTransportURIMetaData");
       
       gavl_dictionary_set_string(args_out, "PlayMedium",   "NETWORK");
       gavl_dictionary_set_string(args_out, "RecordMedium", "NOT_IMPLEMENTED");
@@ -918,10 +931,11 @@ static int handle_http_request(bg_http_connection_t * c, void * data)
 
       gavl_dictionary_set_string(args_out, "Track", "0"); // TODO
       
-      gavl_dictionary_set_string(args_out, "TrackDuration", bg_upnp_event_context_server_get_value(&priv->avt_evt, "CurrentTrackDuration")); // TODO
-      gavl_dictionary_set_string(args_out, "TrackMetaData", bg_upnp_event_context_server_get_value(&priv->avt_evt, "CurrentTrackMetaData"));
-      gavl_dictionary_set_string(args_out, "TrackURI",      bg_upnp_event_context_server_get_value(&priv->avt_evt, "CurrentTrackURI")); // TODO
+      set_arg_from_event(args_out, "TrackDuration", &priv->avt_evt, "CurrentTrackDuration"); // TODO
+      set_arg_from_event(args_out, "TrackMetaData", &priv->avt_evt, "CurrentTrackMetaData");
+      set_arg_from_event(args_out, "TrackURI", &priv->avt_evt, "CurrentTrackURI"); // TODO
       
+      pthread_mutex_lock(&priv->state_mutex);
       if((val = bg_state_get(&priv->state,
                              BG_PLAYER_STATE_CTX,
                              BG_PLAYER_STATE_TIME)) &&
@@ -929,6 +943,7 @@ static int handle_http_request(bg_http_connection_t * c, void * data)
         gavl_time_prettyprint_ms_full(t, time_str);
       else
         strncpy(time_str, "0:00:00.000", GAVL_TIME_STRING_LEN_MS);
+      pthread_mutex_unlock(&priv->state_mutex);
 
       // fprintf(stderr, "Got time: %s\n", time_str);
       
@@ -949,8 +964,8 @@ static int handle_http_request(bg_http_connection_t * c, void * data)
       {
       CHECK_INSTANCE_ID(718);
 
-      gavl_dictionary_set_string(args_out, "CurrentTransportState",  bg_upnp_event_context_server_get_value(&priv->avt_evt, "TransportState"));
-      gavl_dictionary_set_string(args_out, "CurrentTransportStatus", bg_upnp_event_context_server_get_value(&priv->avt_evt, "TransportStatus"));
+      set_arg_from_event(args_out, "CurrentTransportState", &priv->avt_evt, "TransportState");
+      set_arg_from_event(args_out, "CurrentTransportStatus", &priv->avt_evt, "TransportStatus");
       gavl_dictionary_set_string(args_out, "CurrentSpeed", "1");
       bg_upnp_finish_soap_request(soap, c, bg_http_server_get());
       }
@@ -964,7 +979,7 @@ static int handle_http_request(bg_http_connection_t * c, void * data)
       {
       CHECK_INSTANCE_ID(718);
 
-      gavl_dictionary_set_string(args_out, "PlayMode", bg_upnp_event_context_server_get_value(&priv->avt_evt, "CurrentPlayMode"));
+      set_arg_from_event(args_out, "PlayMode", &priv->avt_evt, "CurrentPlayMode");
       gavl_dictionary_set_string(args_out, "RecQualityMode", "NOT_IMPLEMENTED");
       bg_upnp_finish_soap_request(soap, c, bg_http_server_get());
       }
@@ -1149,6 +1164,7 @@ static void * create_renderer_upnp()
   {
   bg_renderer_frontend_upnp_t * priv;
   priv = calloc(1, sizeof(*priv));
+  pthread_mutex_init(&priv->state_mutex, NULL);
   return priv;
   }
 
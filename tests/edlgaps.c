@@ -0,0 +1,377 @@
+/*****************************************************************
+ * gmerlin - a general purpose multimedia framework and applications
+ *
+ * Copyright (c) 2001 - 2024 Members of the Gmerlin project
+ * http://github.com/bplaum
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * *****************************************************************/
+
+/* Measure gaps and stalls at the cuts of an EDL
+ *
+ * Usage: edlgaps <location> [num_cuts] [cut_seconds]
+ *
+ * Builds an EDL, which jumps around in the first audio and video
+ * stream of the file, and decodes it. Reported are timestamp gaps,
+ * digital silence around the cuts and the time needed to read the
+ * first frame after each cut.
+ *
+ * The test fails if nothing was decoded, if there are timestamp gaps or
+ * if the audio is silent for more than MAX_CUT_SILENCE per cut.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include <gavl/gavl.h>
+#include <gavl/metatags.h>
+#include <gavl/trackinfo.h>
+#include <gavl/edl.h>
+#include <gavl/utils.h>
+
+#include <gmerlin/pluginregistry.h>
+#include <gmerlin/utils.h>
+
+/* Silence within this distance from a cut is counted */
+#define CUT_WINDOW (GAVL_TIME_SCALE/20)
+
+/* Maximum average silence per cut */
+#define MAX_CUT_SILENCE (GAVL_TIME_SCALE/100)
+
+typedef struct
+  {
+  int num_frames;
+  int num_gaps;
+  int64_t gap_duration;  // Absolute sum in stream timescale
+
+  gavl_time_t read_time;
+  gavl_time_t cut_read_time;
+  gavl_time_t max_cut_read_time;
+  int num_cuts;
+
+  int64_t silent_samples; // Audio only
+  } stats_t;
+
+static void add_segments(gavl_dictionary_t * s, int timescale,
+                         int num_cuts, int64_t cut_len, int num_positions)
+  {
+  int i;
+  gavl_array_t * arr;
+  gavl_value_t val;
+  gavl_dictionary_t * seg;
+  gavl_dictionary_t * m;
+
+  m = gavl_stream_get_metadata_nc(s);
+  gavl_dictionary_set_int(m, GAVL_META_STREAM_SAMPLE_TIMESCALE, timescale);
+
+  arr = gavl_dictionary_get_array_create(s, GAVL_EDL_SEGMENTS);
+
+  for(i = 0; i < num_cuts; i++)
+    {
+    gavl_value_init(&val);
+    seg = gavl_value_set_dictionary(&val);
+
+    gavl_dictionary_set_int(seg, GAVL_EDL_TRACK_IDX, 0);
+    gavl_dictionary_set_int(seg, GAVL_EDL_STREAM_IDX, 0);
+    gavl_dictionary_set_int(seg, GAVL_META_STREAM_SAMPLE_TIMESCALE, timescale);
+
+    /* Jump around in the source */
+    gavl_dictionary_set_long(seg, GAVL_EDL_SRC_TIME,
+                             ((i * 7) % num_positions) * cut_len);
+    gavl_dictionary_set_long(seg, GAVL_EDL_DST_TIME, i * cut_len);
+    gavl_dictionary_set_long(seg, GAVL_EDL_DST_DUR, cut_len);
+
+    gavl_array_splice_val_nocopy(arr, -1, 0, &val);
+    }
+  }
+
+/* Update timing statistics */
+
+static void check_frame(stats_t * st, int64_t pts, int64_t duration,
+                       int64_t * next_pts, int64_t cut_len, gavl_time_t read_time)
+  {
+  st->num_frames++;
+  st->read_time += read_time;
+
+  if((*next_pts != GAVL_TIME_UNDEFINED) && (pts != *next_pts))
+    {
+    st->num_gaps++;
+    st->gap_duration += llabs(pts - *next_pts);
+    fprintf(stderr, "Gap at %"PRId64": %"PRId64"\n", *next_pts, pts - *next_pts);
+    }
+
+  if((*next_pts == GAVL_TIME_UNDEFINED) ||
+     (pts / cut_len != *next_pts / cut_len))
+    {
+    st->num_cuts++;
+    st->cut_read_time += read_time;
+    if(read_time > st->max_cut_read_time)
+      st->max_cut_read_time = read_time;
+    }
+
+  *next_pts = pts + duration;
+  }
+
+static void dump_stats(const char * type, const stats_t * st, int timescale)
+  {
+  printf("%s: %d frames, %d cuts\n", type, st->num_frames, st->num_cuts);
+  printf("  Timestamp gaps:     %d (%f sec)\n", st->num_gaps,
+         (double)st->gap_duration / timescale);
+
+  if(st->num_frames > st->num_cuts)
+    printf("  Read time:          %f ms/frame\n",
+           gavl_time_to_seconds(st->read_time - st->cut_read_time) * 1000.0 /
+           (st->num_frames - st->num_cuts));
+
+  if(st->num_cuts)
+    printf("  Read time at cuts:  %f ms (max %f ms)\n",
+           gavl_time_to_seconds(st->cut_read_time) * 1000.0 / st->num_cuts,
+           gavl_time_to_seconds(st->max_cut_read_time) * 1000.0);
+  }
+
+/* Checks common to audio and video */
+
+static int check_stats(const char * type, const stats_t * st)
+  {
+  if(!st->num_frames)
+    {
+    printf("%s FAILED: No frames decoded\n", type);
+    return 0;
+    }
+  if(st->num_gaps)
+    {
+    printf("%s FAILED: %d timestamp gaps\n", type, st->num_gaps);
+    return 0;
+    }
+  return 1;
+  }
+
+static int test_audio(bg_plugin_handle_t * h, int64_t cut_len_time)
+  {
+  int i;
+  stats_t st;
+  gavl_audio_format_t fmt;
+  gavl_audio_source_t * src;
+  gavl_audio_frame_t * f;
+  gavl_timer_t * timer;
+  gavl_time_t t;
+  int64_t next_pts = GAVL_TIME_UNDEFINED;
+  int64_t cut_len;
+  int64_t window;
+  int64_t pos;
+
+  memset(&st, 0, sizeof(st));
+  src = bg_media_source_get_audio_source(h->src, 0);
+
+  gavl_audio_format_copy(&fmt, gavl_audio_source_get_src_format(src));
+  fmt.sample_format = GAVL_SAMPLE_FLOAT;
+  fmt.interleave_mode = GAVL_INTERLEAVE_ALL;
+  gavl_audio_source_set_dst(src, 0, &fmt);
+
+  cut_len = gavl_time_scale(fmt.samplerate, cut_len_time);
+  window = gavl_time_scale(fmt.samplerate, CUT_WINDOW);
+
+  timer = gavl_timer_create();
+  gavl_timer_start(timer);
+
+  while(1)
+    {
+    f = NULL;
+    t = gavl_timer_get(timer);
+    if(gavl_audio_source_read_frame(src, &f) != GAVL_SOURCE_OK)
+      break;
+    t = gavl_timer_get(timer) - t;
+
+    check_frame(&st, f->timestamp, f->valid_samples, &next_pts, cut_len, t);
+
+    /* Count silent samples near the cuts */
+    for(i = 0; i < f->valid_samples; i++)
+      {
+      int j;
+
+      pos = (f->timestamp + i) % cut_len;
+
+      if((pos >= window) && (pos < cut_len - window))
+        continue;
+
+      for(j = 0; j < fmt.num_channels; j++)
+        {
+        if(fabs(f->samples.f[i * fmt.num_channels + j]) > 1e-6)
+          break;
+        }
+      if(j == fmt.num_channels)
+        st.silent_samples++;
+      }
+    }
+  gavl_timer_destroy(timer);
+
+  dump_stats("Audio", &st, fmt.samplerate);
+  printf("  Silence at cuts:    %f sec\n\n", (double)st.silent_samples / fmt.samplerate);
+
+  if(!check_stats("Audio", &st))
+    return 0;
+
+  if(st.silent_samples > gavl_time_scale(fmt.samplerate, MAX_CUT_SILENCE) * st.num_cuts)
+    {
+    printf("Audio FAILED: %f ms silence per cut\n",
+           (double)st.silent_samples * 1000.0 / fmt.samplerate / st.num_cuts);
+    return 0;
+    }
+  return 1;
+  }
+
+static int test_video(bg_plugin_handle_t * h, int64_t cut_len_time)
+  {
+  stats_t st;
+  const gavl_video_format_t * fmt;
+  gavl_video_source_t * src;
+  gavl_video_frame_t * f;
+  gavl_timer_t * timer;
+  gavl_time_t t;
+  int64_t next_pts = GAVL_TIME_UNDEFINED;
+  int64_t cut_len;
+
+  memset(&st, 0, sizeof(st));
+  src = bg_media_source_get_video_source(h->src, 0);
+  fmt = gavl_video_source_get_src_format(src);
+  gavl_video_source_set_dst(src, 0, fmt);
+
+  cut_len = gavl_time_scale(fmt->timescale, cut_len_time);
+
+  timer = gavl_timer_create();
+  gavl_timer_start(timer);
+
+  while(1)
+    {
+    f = NULL;
+    t = gavl_timer_get(timer);
+    if(gavl_video_source_read_frame(src, &f) != GAVL_SOURCE_OK)
+      break;
+    t = gavl_timer_get(timer) - t;
+
+    check_frame(&st, f->timestamp, f->duration, &next_pts, cut_len, t);
+    }
+  gavl_timer_destroy(timer);
+
+  dump_stats("Video", &st, fmt->timescale);
+  printf("\n");
+
+  return check_stats("Video", &st);
+  }
+
+int main(int argc, char ** argv)
+  {
+  int ret = 1;
+  int num_cuts = 100;
+  double cut_seconds = 2.0;
+  gavl_time_t cut_len;
+  gavl_time_t duration;
+  int num_positions;
+
+  gavl_dictionary_t * mi;
+  const gavl_dictionary_t * src_track;
+  const gavl_audio_format_t * afmt = NULL;
+  const gavl_video_format_t * vfmt = NULL;
+
+  gavl_dictionary_t edl;
+  gavl_dictionary_t * track;
+  bg_plugin_handle_t * h;
+
+  if(argc < 2)
+    {
+    fprintf(stderr, "Usage: %s <location> [num_cuts] [cut_seconds]\n", argv[0]);
+    return EXIT_FAILURE;
+    }
+
+  if(argc > 2)
+    num_cuts = atoi(argv[2]);
+  if(argc > 3)
+    cut_seconds = strtod(argv[3], NULL);
+
+  cut_len = gavl_seconds_to_time(cut_seconds);
+
+  bg_plugins_init();
+
+  if(!(mi = bg_plugin_registry_load_media_info(bg_plugin_reg, argv[1],
+                                               BG_INPUT_FLAG_GET_FORMAT)) ||
+     !(src_track = gavl_get_track(mi, 0)))
+    {
+    fprintf(stderr, "Cannot open %s\n", argv[1]);
+    return EXIT_FAILURE;
+    }
+
+  duration = gavl_track_get_duration(src_track);
+
+  if((duration == GAVL_TIME_UNDEFINED) || (duration < cut_len))
+    {
+    fprintf(stderr, "%s is too short\n", argv[1]);
+    return EXIT_FAILURE;
+    }
+
+  num_positions = duration / cut_len;
+
+  /* Build EDL */
+  gavl_dictionary_init(&edl);
+  gavl_dictionary_set_string(&edl, GAVL_META_URI, argv[1]);
+  track = gavl_append_track(&edl, NULL);
+
+  gavl_dictionary_set_long(gavl_track_get_metadata_nc(track),
+                           GAVL_META_APPROX_DURATION, num_cuts * cut_len);
+
+  if(gavl_track_get_num_audio_streams(src_track))
+    {
+    afmt = gavl_track_get_audio_format(src_track, 0);
+    add_segments(gavl_track_append_audio_stream(track), afmt->samplerate,
+                 num_cuts, gavl_time_scale(afmt->samplerate, cut_len), num_positions);
+    }
+  if(gavl_track_get_num_video_streams(src_track))
+    {
+    vfmt = gavl_track_get_video_format(src_track, 0);
+    add_segments(gavl_track_append_video_stream(track), vfmt->timescale,
+                 num_cuts, gavl_time_scale(vfmt->timescale, cut_len), num_positions);
+    }
+
+  printf("%d cuts of %.2f sec from %s\n\n", num_cuts, cut_seconds, argv[1]);
+
+  /* Decode */
+
+  if(afmt)
+    {
+    h = bg_input_plugin_load_edl(&edl);
+    bg_input_plugin_set_track(h, 0);
+    bg_media_source_set_audio_action(h->src, 0, BG_STREAM_ACTION_DECODE);
+    bg_input_plugin_start(h);
+    if(!test_audio(h, cut_len))
+      ret = 0;
+    bg_plugin_unref(h);
+    }
+
+  if(vfmt)
+    {
+    h = bg_input_plugin_load_edl(&edl);
+    bg_input_plugin_set_track(h, 0);
+    bg_media_source_set_video_action(h->src, 0, BG_STREAM_ACTION_DECODE);
+    bg_input_plugin_start(h);
+    if(!test_video(h, cut_len))
+      ret = 0;
+    bg_plugin_unref(h);
+    }
+
+  gavl_dictionary_free(&edl);
+  gavl_dictionary_destroy(mi);
+  bg_plugins_cleanup();
+  return ret ? EXIT_SUCCESS : EXIT_FAILURE;
+  }
@@ -0,0 +1,209 @@
+/*****************************************************************
+ * gmerlin - a general purpose multimedia framework and applications
+ *
+ * Copyright (c) 2001 - 2024 Members of the Gmerlin project
+ * http://github.com/bplaum
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * *****************************************************************/
+
+/* Many concurrent keep-alive clients against the http server
+ *
+ * Usage: httpclients [num_clients] [num_rounds]
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/resource.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include <config.h>
+
+#include <gavl/gavl.h>
+#include <gavl/gavlsocket.h>
+#include <gavl/utils.h>
+
+#include <gmerlin/httpserver.h>
+
+#define BODY "hello"
+
+static bg_http_server_t * srv;
+static int quit = 0;
+
+static int handle_hello(bg_http_connection_t * conn, void * data)
+  {
+  bg_http_connection_init_res(conn, conn->protocol, 200, "OK");
+  gavl_dictionary_set_int(&conn->res, "Content-Length", strlen(BODY));
+  bg_http_connection_check_keepalive(conn);
+
+  if(!bg_http_server_write_res(srv, conn) ||
+     (gavl_socket_write_data(conn->fd, (const uint8_t*)BODY, strlen(BODY)) < strlen(BODY)))
+    bg_http_connection_clear_keepalive(conn);
+  return 1;
+  }
+
+static void * server_thread(void * data)
+  {
+  while(!quit)
+    {
+    if(!bg_http_server_iteration(srv))
+      bg_http_server_wait(srv, NULL, 0, 10);
+    }
+  return NULL;
+  }
+
+static int client_connect(int port)
+  {
+  int fd;
+  struct sockaddr_in addr;
+  
+  if((fd = socket(AF_INET, SOCK_STREAM, 0)) < 0)
+    return -1;
+
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+  if(connect(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0)
+    {
+    close(fd);
+    return -1;
+    }
+  return fd;
+  }
+
+static int client_request(int fd)
+  {
+  const char * req = "GET /hello HTTP/1.1\r\nHost: localhost\r\n\r\n";
+  int len = strlen(req);
+  
+  return (write(fd, req, len) == len);
+  }
+
+static int client_response(int fd)
+  {
+  char buf[1024];
+  int len = 0;
+  int result;
+  char * pos;
+  
+  while(len < sizeof(buf) - 1)
+    {
+    if((result = read(fd, buf + len, sizeof(buf) - 1 - len)) <= 0)
+      return 0;
+    len += result;
+    buf[len] = '\0';
+    
+    if((pos = strstr(buf, "\r\n\r\n")) &&
+       (len - (pos + 4 - buf) >= strlen(BODY)))
+      return !strncmp(buf, "HTTP/1.1 200", 12);
+    }
+  return 0;
+  }
+
+int main(int argc, char ** argv)
+  {
+  int i, j;
+  int port;
+  int num_clients = 1000;
+  int num_rounds = 5;
+  int num_ok = 0;
+  int slow_fd;
+  int * fds;
+  double t;
+  pthread_t th;
+  struct rlimit rl;
+  gavl_timer_t * timer;
+  
+  if(argc > 1)
+    num_clients = atoi(argv[1]);
+  if(argc > 2)
+    num_rounds = atoi(argv[2]);
+  
+  /* Client and server sockets are in the same process */
+  if(!getrlimit(RLIMIT_NOFILE, &rl) && (rl.rlim_cur < 2 * num_clients + 64))
+    {
+    rl.rlim_cur = 2 * num_clients + 64;
+    if(rl.rlim_cur > rl.rlim_max)
+      rl.rlim_cur = rl.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &rl);
+    }
+  
+  srv = bg_http_server_create();
+  bg_http_server_add_handler(srv, handle_hello, BG_HTTP_PROTO_HTTP, "/hello", NULL);
+
+  if(!bg_http_server_start(srv))
+    return EXIT_FAILURE;
+
+  port = gavl_socket_address_get_port(bg_http_server_get_address(srv));
+  pthread_create(&th, NULL, server_thread, NULL);
+
+  /* A client which never finishes its request must not stall the others */
+  if((slow_fd = client_connect(port)) >= 0)
+    write(slow_fd, "GET /hello HTTP/1.1\r\n", 21);
+  
+  fds = calloc(num_clients, sizeof(*fds));
+
+  timer = gavl_timer_create();
+  gavl_timer_start(timer);
+  
+  for(i = 0; i < num_clients; i++)
+    {
+    if((fds[i] = client_connect(port)) < 0)
+      {
+      fprintf(stderr, "Connecting client %d failed\n", i);
+      num_clients = i;
+      break;
+      }
+    }
+  
+  for(j = 0; j < num_rounds; j++)
+    {
+    for(i = 0; i < num_clients; i++)
+      client_request(fds[i]);
+    
+    for(i = 0; i < num_clients; i++)
+      {
+      if(client_response(fds[i]))
+        num_ok++;
+      }
+    }
+  
+  t = gavl_time_to_seconds(gavl_timer_get(timer));
+
+  printf("%d clients, %d rounds: %d of %d requests succeeded in %.3f sec (%.0f requests/sec)\n",
+         num_clients, num_rounds, num_ok, num_clients * num_rounds, t,
+         t > 0.0 ? num_ok / t : 0.0);
+  
+  for(i = 0; i < num_clients; i++)
+    close(fds[i]);
+  if(slow_fd >= 0)
+    close(slow_fd);
+  
+  quit = 1;
+  pthread_join(th, NULL);
+  
+  free(fds);
+  gavl_timer_destroy(timer);
+  bg_http_server_destroy(srv);
+  
+  return (num_ok == num_clients * num_rounds) ? EXIT_SUCCESS : EXIT_FAILURE;
+  }
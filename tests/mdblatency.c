@@ -0,0 +1,103 @@
+/*****************************************************************
+ * gmerlin - a general purpose multimedia framework and applications
+ *
+ * Copyright (c) 2001 - 2024 Members of the Gmerlin project
+ * http://github.com/bplaum
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * *****************************************************************/
+
+/* Measure the latency of synchronous browse requests
+ *
+ * Usage: mdblatency <db_path> [id] [num_requests]
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <gavl/gavl.h>
+#include <gavl/utils.h>
+
+#include <gmerlin/mdb.h>
+#include <gmerlin/pluginregistry.h>
+#include <gmerlin/utils.h>
+
+int main(int argc, char ** argv)
+  {
+  int i;
+  bg_mdb_t * mdb;
+  const char * id = "/";
+  int num = 100;
+  int failed = 0;
+  gavl_timer_t * timer;
+  gavl_time_t t;
+  gavl_time_t t_min = 0;
+  gavl_time_t t_max = 0;
+  gavl_time_t t_total = 0;
+  gavl_dictionary_t ret;
+  
+  if(argc < 2)
+    {
+    fprintf(stderr, "Usage: %s <db_path> [id] [num_requests]\n", argv[0]);
+    return EXIT_FAILURE;
+    }
+
+  if(argc > 2)
+    id = argv[2];
+  if(argc > 3)
+    num = atoi(argv[3]);
+  
+  bg_plugins_init();
+
+  if(!(mdb = bg_mdb_create(argv[1], 0, NULL)))
+    {
+    fprintf(stderr, "Cannot open database %s\n", argv[1]);
+    return EXIT_FAILURE;
+    }
+
+  timer = gavl_timer_create();
+  gavl_timer_start(timer);
+  
+  for(i = 0; i < num; i++)
+    {
+    gavl_dictionary_init(&ret);
+
+    t = gavl_timer_get(timer);
+    
+    if(!bg_mdb_browse_object_sync(bg_mdb_get_controllable(mdb), &ret, id, 10000))
+      failed++;
+    
+    t = gavl_timer_get(timer) - t;
+
+    if(!i || (t < t_min))
+      t_min = t;
+    if(t > t_max)
+      t_max = t;
+    t_total += t;
+    
+    gavl_dictionary_free(&ret);
+    }
+
+  printf("%d requests for %s (%d failed), latency min: %.3f ms, avg: %.3f ms, max: %.3f ms\n",
+         num, id, failed,
+         gavl_time_to_seconds(t_min) * 1000.0,
+         gavl_time_to_seconds(t_total) * 1000.0 / num,
+         gavl_time_to_seconds(t_max) * 1000.0);
+  
+  gavl_timer_destroy(timer);
+  bg_mdb_destroy(mdb);
+  
+  return EXIT_SUCCESS;
+  }
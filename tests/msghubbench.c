@@ -0,0 +1,138 @@
+/*****************************************************************
+ * gmerlin - a general purpose multimedia framework and applications
+ *
+ * Copyright (c) 2001 - 2024 Members of the Gmerlin project
+ * http://github.com/bplaum
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * *****************************************************************/
+
+/* Stress benchmark for message sinks and hubs
+ *
+ * Usage: msghubbench [num_messages] [num_sinks]
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <gavl/gavl.h>
+#include <gavl/msg.h>
+#include <gavl/utils.h>
+
+#include <gmerlin/bgmsg.h>
+
+#define MSG_NS  1000
+#define MSG_INT 1
+
+typedef struct
+  {
+  bg_msg_sink_t * sink;
+  pthread_t th;
+  int64_t num;
+  int64_t sum;
+  } consumer_t;
+
+static int handle_msg(void * data, gavl_msg_t * msg)
+  {
+  consumer_t * c = data;
+
+  if((msg->NS == MSG_NS) && (msg->ID == MSG_INT))
+    {
+    c->num++;
+    c->sum += gavl_msg_get_arg_int(msg, 0);
+    }
+  return 1;
+  }
+
+static void * consumer_thread(void * data)
+  {
+  consumer_t * c = data;
+  
+  while(bg_msg_sink_iteration(c->sink))
+    {
+    if(!bg_msg_sink_get_num(c->sink))
+      bg_msg_sink_wait(c->sink, 100);
+    }
+  return NULL;
+  }
+
+int main(int argc, char ** argv)
+  {
+  int i;
+  int num_messages = 1000000;
+  int num_sinks = 4;
+  int64_t sum = 0;
+  double t;
+  gavl_msg_t * msg;
+  gavl_timer_t * timer;
+  bg_msg_hub_t * hub;
+  bg_msg_sink_t * hub_sink;
+  consumer_t * consumers;
+  
+  if(argc > 1)
+    num_messages = atoi(argv[1]);
+  if(argc > 2)
+    num_sinks = atoi(argv[2]);
+
+  hub = bg_msg_hub_create(1);
+  hub_sink = bg_msg_hub_get_sink(hub);
+  
+  consumers = calloc(num_sinks, sizeof(*consumers));
+
+  for(i = 0; i < num_sinks; i++)
+    {
+    consumers[i].sink = bg_msg_sink_create(handle_msg, &consumers[i], 0);
+    bg_msg_hub_connect_sink(hub, consumers[i].sink);
+    pthread_create(&consumers[i].th, NULL, consumer_thread, &consumers[i]);
+    }
+
+  timer = gavl_timer_create();
+  gavl_timer_start(timer);
+  
+  for(i = 0; i < num_messages; i++)
+    {
+    msg = bg_msg_sink_get(hub_sink);
+    gavl_msg_set_id_ns(msg, MSG_INT, MSG_NS);
+    gavl_msg_set_arg_int(msg, 0, i);
+    bg_msg_sink_put(hub_sink);
+    sum += i;
+    }
+
+  msg = bg_msg_sink_get(hub_sink);
+  gavl_msg_set_id_ns(msg, GAVL_CMD_QUIT, GAVL_MSG_NS_GENERIC);
+  bg_msg_sink_put(hub_sink);
+
+  for(i = 0; i < num_sinks; i++)
+    pthread_join(consumers[i].th, NULL);
+
+  t = gavl_time_to_seconds(gavl_timer_get(timer));
+  
+  printf("%d messages to %d sinks in %.3f sec: %.0f messages/sec delivered\n",
+         num_messages, num_sinks, t, t > 0.0 ? (double)num_messages * num_sinks / t : 0.0);
+  
+  for(i = 0; i < num_sinks; i++)
+    {
+    if((consumers[i].num != num_messages) || (consumers[i].sum != sum))
+      printf("Sink %d: Got %"PRId64" messages, checksum mismatch\n", i, consumers[i].num);
+    
+    bg_msg_hub_disconnect_sink(hub, consumers[i].sink);
+    bg_msg_sink_destroy(consumers[i].sink);
+    }
+
+  free(consumers);
+  gavl_timer_destroy(timer);
+  bg_msg_hub_destroy(hub);
+  return EXIT_SUCCESS;
+  }
@@ -0,0 +1,126 @@
+/*****************************************************************
+ * gmerlin - a general purpose multimedia framework and applications
+ *
+ * Copyright (c) 2001 - 2024 Members of the Gmerlin project
+ * http://github.com/bplaum
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * *****************************************************************/
+
+/* Microbenchmark for the object cache
+ *
+ * Usage: objectcache [memory_size] [disk_size] [num_gets]
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <gavl/gavl.h>
+#include <gavl/utils.h>
+
+#include <gmerlin/objectcache.h>
+#include <gmerlin/utils.h>
+
+#define DIRECTORY "./objectcache"
+
+static void print_time(const char * label, gavl_timer_t * timer, int num)
+  {
+  double t = gavl_time_to_seconds(gavl_timer_get(timer));
+  printf("%s: %d operations in %.3f sec (%.3f usec/op)\n",
+         label, num, t, num ? t * 1.0e6 / num : 0.0);
+  }
+
+int main(int argc, char ** argv)
+  {
+  int i;
+  int memory_size = 20000;
+  int disk_size = 50000;
+  int num_gets = 1000000;
+  int num_hits = 0;
+  char id[32];
+  gavl_value_t val;
+  gavl_timer_t * timer;
+  bg_object_cache_t * cache;
+  bg_object_cache_stats_t stats;
+  
+  if(argc > 1)
+    memory_size = atoi(argv[1]);
+  if(argc > 2)
+    disk_size = atoi(argv[2]);
+  if(argc > 3)
+    num_gets = atoi(argv[3]);
+
+  timer = gavl_timer_create();
+  
+  cache = bg_object_cache_create(disk_size, memory_size, DIRECTORY);
+
+  /* Fill memory cache */
+  gavl_timer_start(timer);
+  for(i = 0; i < memory_size; i++)
+    {
+    snprintf(id, sizeof(id), "id-%d", i);
+    gavl_value_init(&val);
+    gavl_value_set_int(&val, i);
+    bg_object_cache_put_nocopy(cache, id, &val);
+    }
+  gavl_timer_stop(timer);
+  print_time("Put", timer, memory_size);
+  
+  /* Random lookups, all of which hit the memory cache */
+  gavl_timer_set(timer, 0);
+  gavl_timer_start(timer);
+  
+  for(i = 0; i < num_gets; i++)
+    {
+    snprintf(id, sizeof(id), "id-%d", rand() % memory_size);
+    if(bg_object_cache_get(cache, id))
+      num_hits++;
+    }
+  gavl_timer_stop(timer);
+  print_time("Get", timer, num_gets);
+  
+  /* Lookups of non existing ids */
+  gavl_timer_set(timer, 0);
+  gavl_timer_start(timer);
+  
+  for(i = 0; i < num_gets; i++)
+    {
+    snprintf(id, sizeof(id), "missing-%d", i);
+    bg_object_cache_get(cache, id);
+    }
+  gavl_timer_stop(timer);
+  print_time("Miss", timer, num_gets);
+  
+  bg_object_cache_get_stats(cache, &stats);
+
+  printf("Hits: %d, memory hits: %"PRId64", disk hits: %"PRId64", misses: %"PRId64", "
+         "memory evictions: %"PRId64", disk evictions: %"PRId64"\n",
+         num_hits, stats.memory_hits, stats.disk_hits, stats.misses,
+         stats.memory_evictions, stats.disk_evictions);
+  
+  bg_object_cache_destroy(cache);
+
+  /* Loading the disk index */
+  gavl_timer_set(timer, 0);
+  gavl_timer_start(timer);
+  cache = bg_object_cache_create(disk_size, memory_size, DIRECTORY);
+  gavl_timer_stop(timer);
+  print_time("Open", timer, 1);
+  bg_object_cache_destroy(cache);
+  
+  gavl_timer_destroy(timer);
+  
+  return EXIT_SUCCESS;
+  }
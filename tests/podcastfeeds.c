@@ -0,0 +1,312 @@
+/*****************************************************************
+ * gmerlin - a general purpose multimedia framework and applications
+ *
+ * Copyright (c) 2001 - 2024 Members of the Gmerlin project
+ * http://github.com/bplaum
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * *****************************************************************/
+
+/* Refresh podcast feeds from a local stand-in server
+ *
+ * Usage: podcastfeeds [num_feeds] [num_threads] [delay_ms]
+ *
+ * The server answers each request after delay_ms to simulate a remote
+ * host. The feeds are loaded once, revalidated (all must be 304) and
+ * revalidated again after every second feed changed. The http cache
+ * is created in a temporary directory, which is removed afterwards.
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <config.h>
+
+#include <gavl/gavl.h>
+#include <gavl/gavlsocket.h>
+#include <gavl/http.h>
+#include <gavl/utils.h>
+
+#include <gmerlin/application.h>
+#include <gmerlin/http.h>
+#include <gmerlin/httpserver.h>
+#include <gmerlin/utils.h>
+
+#define FEED_MTIME 1700000000
+
+static bg_http_server_t * srv;
+static int quit = 0;
+
+static int num_feeds = 150;
+static int delay = 50; // ms
+static int * versions;
+
+static int num_ok = 0;
+static int num_not_modified = 0;
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/* Server */
+
+static int handle_feed(bg_http_connection_t * conn, void * data)
+  {
+  int idx;
+  int version;
+  int not_modified;
+  gavl_time_t t;
+  char * etag;
+  char * body = NULL;
+  const char * var;
+
+  if(((idx = atoi(conn->path)) < 0) || (idx >= num_feeds))
+    {
+    bg_http_connection_init_res(conn, conn->protocol, 404, "Not Found");
+    bg_http_server_write_res(srv, conn);
+    return 1;
+    }
+
+  t = (gavl_time_t)delay * GAVL_TIME_SCALE / 1000;
+  gavl_time_delay(&t);
+
+  pthread_mutex_lock(&mutex);
+  version = versions[idx];
+  pthread_mutex_unlock(&mutex);
+
+  etag = gavl_sprintf("\"%d-%d\"", idx, version);
+
+  /* If-None-Match has precedence over If-Modified-Since */
+  if((var = gavl_dictionary_get_string_i(&conn->req, "If-None-Match")))
+    {
+    if((not_modified = !strcmp(var, etag)))
+      bg_http_connection_init_res(conn, conn->protocol, 304, "Not Modified");
+    }
+  else
+    not_modified = bg_http_connection_not_modified(conn, FEED_MTIME + version);
+  
+  if(not_modified)
+    {
+    pthread_mutex_lock(&mutex);
+    num_not_modified++;
+    pthread_mutex_unlock(&mutex);
+    }
+  else
+    {
+    body = gavl_sprintf("<?xml version=\"1.0\"?>\n"
+                        "<rss version=\"2.0\"><channel>"
+                        "<title>Feed %d</title>"
+                        "<lastBuildDate>Mon, 0%d Jan 2024 12:00:00 GMT</lastBuildDate>"
+                        "<item><title>Episode %d</title>"
+                        "<enclosure url=\"http://localhost/%d-%d.mp3\" type=\"audio/mpeg\"/>"
+                        "</item></channel></rss>\n",
+                        idx, version + 1, version, idx, version);
+
+    bg_http_connection_init_res(conn, conn->protocol, 200, "OK");
+    gavl_dictionary_set_string(&conn->res, "Content-Type", "text/xml");
+    gavl_dictionary_set_int(&conn->res, "Content-Length", strlen(body));
+    gavl_http_header_set_time(&conn->res, "Last-Modified", FEED_MTIME + version);
+
+    pthread_mutex_lock(&mutex);
+    num_ok++;
+    pthread_mutex_unlock(&mutex);
+    }
+
+  gavl_dictionary_set_string(&conn->res, "ETag", etag);
+  bg_http_connection_check_keepalive(conn);
+
+  if(!bg_http_server_write_res(srv, conn) ||
+     (body && (gavl_socket_write_data(conn->fd, (const uint8_t*)body, strlen(body)) < strlen(body))))
+    bg_http_connection_clear_keepalive(conn);
+
+  free(etag);
+  if(body)
+    free(body);
+  return 1;
+  }
+
+static void * server_thread(void * data)
+  {
+  while(!quit)
+    {
+    if(!bg_http_server_iteration(srv))
+      bg_http_server_wait(srv, NULL, 0, 10);
+    }
+  return NULL;
+  }
+
+/* Clients */
+
+typedef struct
+  {
+  char ** uris;
+  int * results;
+  int next;
+  int revalidate;
+  } fetch_t;
+
+static void * fetch_thread(void * data)
+  {
+  int idx;
+  gavl_buffer_t buf;
+  fetch_t * f = data;
+
+  gavl_buffer_init(&buf);
+
+  while(1)
+    {
+    pthread_mutex_lock(&mutex);
+    idx = f->next++;
+    pthread_mutex_unlock(&mutex);
+
+    if(idx >= num_feeds)
+      break;
+
+    gavl_buffer_reset(&buf);
+    f->results[idx] = bg_http_cache_fetch(f->uris[idx], &buf, NULL, NULL, f->revalidate);
+    }
+
+  gavl_buffer_free(&buf);
+  return NULL;
+  }
+
+static int run(fetch_t * f, int num_threads, const char * label,
+               int expect_loaded, int expect_not_modified)
+  {
+  int i;
+  int loaded = 0;
+  int not_modified = 0;
+  int failed = 0;
+  pthread_t * th;
+  gavl_timer_t * timer;
+
+  f->next = 0;
+  num_ok = 0;
+  num_not_modified = 0;
+
+  th = calloc(num_threads, sizeof(*th));
+
+  timer = gavl_timer_create();
+  gavl_timer_start(timer);
+
+  for(i = 0; i < num_threads; i++)
+    pthread_create(&th[i], NULL, fetch_thread, f);
+  for(i = 0; i < num_threads; i++)
+    pthread_join(th[i], NULL);
+
+  for(i = 0; i < num_feeds; i++)
+    {
+    if(f->results[i] == BG_HTTP_FETCH_LOADED)
+      loaded++;
+    else if(f->results[i] == BG_HTTP_FETCH_NOT_MODIFIED)
+      not_modified++;
+    else
+      failed++;
+    }
+
+  printf("%-12s %.3f sec, %d loaded, %d not modified, %d failed (server: %d x 200, %d x 304)\n",
+         label, gavl_time_to_seconds(gavl_timer_get(timer)),
+         loaded, not_modified, failed, num_ok, num_not_modified);
+
+  gavl_timer_destroy(timer);
+  free(th);
+
+  return (loaded == expect_loaded) && (not_modified == expect_not_modified);
+  }
+
+int main(int argc, char ** argv)
+  {
+  int i;
+  int port;
+  int ret = 1;
+  int num_threads = 8;
+  pthread_t th;
+  fetch_t f;
+  char cache_dir[] = "/tmp/podcastfeeds-XXXXXX";
+
+  if(argc > 1)
+    num_feeds = atoi(argv[1]);
+  if(argc > 2)
+    num_threads = atoi(argv[2]);
+  if(argc > 3)
+    delay = atoi(argv[3]);
+
+  /* Keep the real cache of the user clean */
+  if(!mkdtemp(cache_dir))
+    {
+    fprintf(stderr, "Cannot create temporary directory\n");
+    return EXIT_FAILURE;
+    }
+  setenv("XDG_CACHE_HOME", cache_dir, 1);
+  
+  bg_app_init("podcastfeeds", "Podcast feed test", NULL);
+  bg_http_cache_init();
+
+  versions = calloc(num_feeds, sizeof(*versions));
+
+  srv = bg_http_server_create();
+  bg_http_server_add_handler(srv, handle_feed, BG_HTTP_PROTO_HTTP, "/feeds/", NULL);
+
+  if(!bg_http_server_start(srv))
+    {
+    bg_http_cache_cleanup();
+    bg_remove_file(cache_dir);
+    return EXIT_FAILURE;
+    }
+
+  port = gavl_socket_address_get_port(bg_http_server_get_address(srv));
+  pthread_create(&th, NULL, server_thread, NULL);
+
+  memset(&f, 0, sizeof(f));
+  f.uris = calloc(num_feeds, sizeof(*f.uris));
+  f.results = calloc(num_feeds, sizeof(*f.results));
+
+  /* The cache is empty, so the first rounds load all feeds */
+  for(i = 0; i < num_feeds; i++)
+    f.uris[i] = gavl_sprintf("http://127.0.0.1:%d/feeds/%d", port, i);
+
+  printf("%d feeds, %d threads, %d ms server delay\n", num_feeds, num_threads, delay);
+
+  f.revalidate = 0;
+  if(!run(&f, 1, "Sequential", num_feeds, 0))
+    ret = 0;
+
+  if(!run(&f, num_threads, "Full", num_feeds, 0))
+    ret = 0;
+
+  f.revalidate = 1;
+  if(!run(&f, num_threads, "Unchanged", 0, num_feeds))
+    ret = 0;
+
+  for(i = 0; i < num_feeds; i += 2)
+    versions[i]++;
+
+  if(!run(&f, num_threads, "Half changed", (num_feeds + 1) / 2, num_feeds / 2))
+    ret = 0;
+
+  quit = 1;
+  pthread_join(th, NULL);
+  bg_http_server_destroy(srv);
+
+  for(i = 0; i < num_feeds; i++)
+    free(f.uris[i]);
+  free(f.uris);
+  free(f.results);
+  free(versions);
+
+  bg_http_cache_cleanup();
+  bg_remove_file(cache_dir);
+
+  return ret ? EXIT_SUCCESS : EXIT_FAILURE;
+  }
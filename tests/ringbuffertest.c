@@ -0,0 +1,160 @@
+/*****************************************************************
+ * gmerlin - a general purpose multimedia framework and applications
+ *
+ * Copyright (c) 2001 - 2024 Members of the Gmerlin project
+ * http://github.com/bplaum
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * *****************************************************************/
+
+/* Multi reader test for the ringbuffer
+ *
+ * Usage: ringbuffertest [num_elements] [num_readers]
+ *
+ * Each element stores its own sequence number. The readers check that
+ * they never get an element twice or out of order. Every second reader
+ * accesses the data without copying.
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <gavl/gavl.h>
+
+#include <gmerlin/ringbuffer.h>
+
+#define NUM_WRITES 200000
+
+typedef struct
+  {
+  bg_ring_buffer_t * buf;
+  pthread_t th;
+  int zerocopy;
+  int64_t num;
+  int64_t skipped;
+  int errors;
+  } reader_t;
+
+static int done = 0;
+
+static void * alloc_func(void * priv)
+  {
+  return calloc(1, sizeof(int64_t));
+  }
+
+static void free_func(void * priv, void * buffer)
+  {
+  free(buffer);
+  }
+
+static void copy_func(void * priv, void * dst, const void * src)
+  {
+  *((int64_t*)dst) = *((const int64_t*)src);
+  }
+
+static void * reader_thread(void * data)
+  {
+  int64_t val;
+  int64_t seqno = 0;
+  int64_t last = 0;
+  const int64_t * ptr;
+  bg_ring_buffer_ref_t * ref;
+  reader_t * r = data;
+
+  while(1)
+    {
+    if(r->zerocopy)
+      {
+      if((ptr = bg_ring_buffer_read_ref(r->buf, &seqno, &ref)))
+        {
+        val = *ptr;
+        /* Hold the element a bit so the writer passes us */
+        if(!(val % 1000))
+          usleep(100);
+        if(*ptr != val)
+          r->errors++;
+        bg_ring_buffer_unref(r->buf, ref);
+        }
+      }
+    else if(!bg_ring_buffer_read(r->buf, &val, &seqno))
+      ptr = NULL;
+    else
+      ptr = &val;
+
+    if(!ptr)
+      {
+      if(__atomic_load_n(&done, __ATOMIC_ACQUIRE))
+        break;
+      continue;
+      }
+
+    /* seqno points to the next element now */
+    if((val != seqno - 1) || (val <= last))
+      r->errors++;
+
+    r->skipped += val - last - 1;
+    last = val;
+    r->num++;
+    }
+  return NULL;
+  }
+
+int main(int argc, char ** argv)
+  {
+  int i;
+  int64_t val;
+  int num_elements = 16;
+  int num_readers = 3;
+  int errors = 0;
+  reader_t * readers;
+  bg_ring_buffer_t * buf;
+
+  if(argc > 1)
+    num_elements = atoi(argv[1]);
+  if(argc > 2)
+    num_readers = atoi(argv[2]);
+
+  buf = bg_ring_buffer_create(num_elements, alloc_func, free_func, copy_func,
+                              NULL, BG_RINGBUFFER_OVERWRITE);
+
+  readers = calloc(num_readers, sizeof(*readers));
+
+  for(i = 0; i < num_readers; i++)
+    {
+    readers[i].buf = buf;
+    readers[i].zerocopy = i & 1;
+    pthread_create(&readers[i].th, NULL, reader_thread, &readers[i]);
+    }
+
+  for(val = 1; val <= NUM_WRITES; val++)
+    bg_ring_buffer_write(buf, &val);
+
+  __atomic_store_n(&done, 1, __ATOMIC_RELEASE);
+
+  for(i = 0; i < num_readers; i++)
+    {
+    pthread_join(readers[i].th, NULL);
+    printf("Reader %d (%s): %"PRId64" read, %"PRId64" skipped, %d errors\n",
+           i, (readers[i].zerocopy ? "zerocopy" : "copy"),
+           readers[i].num, readers[i].skipped, readers[i].errors);
+    errors += readers[i].errors;
+    }
+
+  bg_ring_buffer_destroy(buf);
+  free(readers);
+  
+  return errors ? EXIT_FAILURE : EXIT_SUCCESS;
+  }